@@ -25,6 +25,7 @@
 #include <libavutil/mem.h>
 #include <libavutil/version.h>
 
+#include "config.h"
 #include "mpv_talloc.h"
 #include "common/common.h"
 #include "fmt-conversion.h"
@@ -492,6 +493,9 @@ fail:
 struct mp_audio_pool {
     AVBufferPool *avpool;
     int element_size;
+    // Number of data buffers that had to be newly allocated, i.e. which could
+    // not be recycled from the pool.
+    int64_t num_allocs;
 };
 
 struct mp_audio_pool *mp_audio_pool_create(void *ta_parent)
@@ -505,6 +509,16 @@ static void mp_audio_pool_destructor(void *p)
     av_buffer_pool_uninit(&pool->avpool);
 }
 
+#if HAVE_AV_BUFFER_POOL_INIT2
+// Called by libavutil only if there is no free buffer in the pool.
+static AVBufferRef *mp_audio_pool_alloc(void *opaque, int size)
+{
+    struct mp_audio_pool *pool = opaque;
+    pool->num_allocs++;
+    return av_buffer_alloc(size);
+}
+#endif
+
 // Allocate data using the given format and number of samples.
 // Returns NULL on error.
 struct mp_audio *mp_audio_pool_get(struct mp_audio_pool *pool,
@@ -519,7 +533,14 @@ struct mp_audio *mp_audio_pool_get(struct mp_audio_pool *pool,
             return NULL;
         av_buffer_pool_uninit(&pool->avpool);
         pool->element_size = alloc;
+#if HAVE_AV_BUFFER_POOL_INIT2
+        pool->avpool = av_buffer_pool_init2(pool->element_size, pool,
+                                            mp_audio_pool_alloc, NULL);
+#else
+        // Can't see individual allocations; count the pool reinit only.
+        pool->num_allocs++;
         pool->avpool = av_buffer_pool_init(pool->element_size, NULL);
+#endif
         if (!pool->avpool)
             return NULL;
         talloc_set_destructor(pool, mp_audio_pool_destructor);
@@ -567,3 +588,10 @@ int mp_audio_pool_make_writeable(struct mp_audio_pool *pool,
     mp_audio_steal_data(data, new);
     return 0;
 }
+
+// Return the number of audio data buffers the pool allocated so far, instead
+// of reusing previously freed ones. In steady state, this should not increase.
+int64_t mp_audio_pool_num_allocs(struct mp_audio_pool *pool)
+{
+    return pool->num_allocs;
+}
@@ -91,5 +91,6 @@ struct mp_audio *mp_audio_pool_new_copy(struct mp_audio_pool *pool,
                                         struct mp_audio *frame);
 int mp_audio_pool_make_writeable(struct mp_audio_pool *pool,
                                  struct mp_audio *frame);
+int64_t mp_audio_pool_num_allocs(struct mp_audio_pool *pool);
 
 #endif
@@ -23,6 +23,7 @@
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
 #include <libavutil/opt.h>
+#include <libavutil/intreadwrite.h>
 
 #include "config.h"
 #include "common/msg.h"
@@ -32,6 +33,20 @@
 
 #define OUTBUF_SIZE 65536
 
+// IEC 61937 framing, for the codecs packed without libavformat.
+#define BURST_HEADER_SIZE   8
+#define AC3_BURST_SIZE      (1536 * 4)
+#define EAC3_BURST_SIZE     (6144 * 4)
+#define DTS_SYNCWORD_CORE_BE 0x7FFE8001
+
+enum {
+    IEC61937_AC3    = 0x01,
+    IEC61937_DTS1   = 0x0B,     // 512 samples
+    IEC61937_DTS2   = 0x0C,     // 1024 samples
+    IEC61937_DTS3   = 0x0D,     // 2048 samples
+    IEC61937_EAC3   = 0x15,
+};
+
 struct spdifContext {
     struct mp_log   *log;
     enum AVCodecID   codec_id;
@@ -40,6 +55,9 @@ struct spdifContext {
     uint8_t          out_buffer[OUTBUF_SIZE];
     bool             need_close;
     bool             use_dts_hd;
+    bool             direct;        // framing done by write_direct()
+    int              eac3_frames;   // E-AC3 frames collected in out_buffer
+    double           eac3_pts;
     struct mp_audio  fmt;
     struct mp_audio_pool *pool;
 };
@@ -149,41 +167,6 @@ static int init_filter(struct dec_audio *da, AVPacket *pkt)
     if (spdif_ctx->codec_id == AV_CODEC_ID_DTS)
         profile = determine_codec_profile(da, pkt);
 
-    AVFormatContext *lavf_ctx  = avformat_alloc_context();
-    if (!lavf_ctx)
-        goto fail;
-
-    spdif_ctx->lavf_ctx = lavf_ctx;
-
-    lavf_ctx->oformat = av_guess_format("spdif", NULL, NULL);
-    if (!lavf_ctx->oformat)
-        goto fail;
-
-    void *buffer = av_mallocz(OUTBUF_SIZE);
-    if (!buffer)
-        abort();
-    lavf_ctx->pb = avio_alloc_context(buffer, OUTBUF_SIZE, 1, spdif_ctx, NULL,
-                                      write_packet, NULL);
-    if (!lavf_ctx->pb) {
-        av_free(buffer);
-        goto fail;
-    }
-
-    // Request minimal buffering (not available on Libav)
-#if LIBAVFORMAT_VERSION_MICRO >= 100
-    lavf_ctx->pb->direct = 1;
-#endif
-
-    AVStream *stream = avformat_new_stream(lavf_ctx, 0);
-    if (!stream)
-        goto fail;
-
-#if HAVE_AVCODEC_HAS_CODECPAR
-    stream->codecpar->codec_id = spdif_ctx->codec_id;
-#else
-    stream->codec->codec_id = spdif_ctx->codec_id;
-#endif
-
     AVDictionary *format_opts = NULL;
 
     int num_channels = 0;
@@ -199,6 +182,7 @@ static int init_filter(struct dec_audio *da, AVPacket *pkt)
         sample_format                   = AF_FORMAT_S_AC3;
         samplerate                      = 48000;
         num_channels                    = 2;
+        spdif_ctx->direct               = true;
         break;
     case AV_CODEC_ID_DTS: {
         bool is_hd = profile == FF_PROFILE_DTS_HD_HRA ||
@@ -213,6 +197,9 @@ static int init_filter(struct dec_audio *da, AVPacket *pkt)
             sample_format               = AF_FORMAT_S_DTS;
             samplerate                  = 48000;
             num_channels                = 2;
+            // Other bitstream variants (14 bit, little endian) need lavf.
+            spdif_ctx->direct           = pkt->size >= 9 &&
+                                          AV_RB32(pkt->data) == DTS_SYNCWORD_CORE_BE;
         }
         break;
     }
@@ -220,6 +207,7 @@ static int init_filter(struct dec_audio *da, AVPacket *pkt)
         sample_format                   = AF_FORMAT_S_EAC3;
         samplerate                      = 192000;
         num_channels                    = 2;
+        spdif_ctx->direct               = true;
         break;
     case AV_CODEC_ID_MP3:
         sample_format                   = AF_FORMAT_S_MP3;
@@ -238,9 +226,49 @@ static int init_filter(struct dec_audio *da, AVPacket *pkt)
     mp_audio_set_format(&spdif_ctx->fmt, sample_format);
     spdif_ctx->fmt.rate = samplerate;
 
+    if (spdif_ctx->direct) {
+        MP_VERBOSE(da, "Using internal IEC 61937 packer.\n");
+        av_dict_free(&format_opts);
+        return 0;
+    }
+
+    AVFormatContext *lavf_ctx  = avformat_alloc_context();
+    if (!lavf_ctx)
+        goto fail;
+
+    spdif_ctx->lavf_ctx = lavf_ctx;
+
+    lavf_ctx->oformat = av_guess_format("spdif", NULL, NULL);
+    if (!lavf_ctx->oformat)
+        goto fail;
+
+    void *buffer = av_mallocz(OUTBUF_SIZE);
+    if (!buffer)
+        abort();
+    lavf_ctx->pb = avio_alloc_context(buffer, OUTBUF_SIZE, 1, spdif_ctx, NULL,
+                                      write_packet, NULL);
+    if (!lavf_ctx->pb) {
+        av_free(buffer);
+        goto fail;
+    }
+
+    // Request minimal buffering (not available on Libav)
+#if LIBAVFORMAT_VERSION_MICRO >= 100
+    lavf_ctx->pb->direct = 1;
+#endif
+
+    AVStream *stream = avformat_new_stream(lavf_ctx, 0);
+    if (!stream)
+        goto fail;
+
+#if HAVE_AVCODEC_HAS_CODECPAR
+    stream->codecpar->codec_id = spdif_ctx->codec_id;
+#else
+    stream->codec->codec_id = spdif_ctx->codec_id;
+#endif
+
     if (avformat_write_header(lavf_ctx, &format_opts) < 0) {
         MP_FATAL(da, "libavformat spdif initialization failed.\n");
-        av_dict_free(&format_opts);
         goto fail;
     }
     av_dict_free(&format_opts);
@@ -250,17 +278,140 @@ static int init_filter(struct dec_audio *da, AVPacket *pkt)
     return 0;
 
 fail:
+    av_dict_free(&format_opts);
     uninit(da);
+    spdif_ctx->lavf_ctx = NULL;
     return -1;
 }
 
+// Return a new frame containing one IEC 61937 burst of burst_size bytes. The
+// payload is converted to little endian 16 bit words, like libavformat does.
+// If preamble is false, the payload fills the whole burst (DTS only).
+static struct mp_audio *write_burst(struct spdifContext *ctx, int data_type,
+                                    int length_code, const uint8_t *data,
+                                    int size, int burst_size, bool preamble)
+{
+    int header = preamble ? BURST_HEADER_SIZE : 0;
+    int padded = (size + 1) & ~1;
+    if (padded > burst_size - header) {
+        MP_ERR(ctx, "spdif packet too large.\n");
+        return NULL;
+    }
+
+    struct mp_audio *mpa =
+        mp_audio_pool_get(ctx->pool, &ctx->fmt, burst_size / ctx->fmt.sstride);
+    if (!mpa)
+        return NULL;
+
+    uint8_t *dst = mpa->planes[0];
+    if (preamble) {
+        AV_WL16(dst + 0, 0xF872);
+        AV_WL16(dst + 2, 0x4E1F);
+        AV_WL16(dst + 4, data_type);
+        AV_WL16(dst + 6, length_code);
+        dst += BURST_HEADER_SIZE;
+    }
+    for (int n = 0; n + 1 < size; n += 2) {
+        dst[n + 0] = data[n + 1];
+        dst[n + 1] = data[n + 0];
+    }
+    // A final lone byte has to be MSB aligned.
+    if (size & 1) {
+        dst[size - 1] = 0;
+        dst[size] = data[size - 1];
+    }
+    memset(dst + padded, 0, burst_size - header - padded);
+    return mpa;
+}
+
+// Pack AC3, E-AC3 and DTS core frames without going through libavformat.
+// This mirrors libavformat's spdifenc for these codecs.
+static int write_direct(struct dec_audio *da, AVPacket *pkt, double pts,
+                        struct mp_audio **out)
+{
+    struct spdifContext *spdif_ctx = da->priv;
+    const uint8_t *data = pkt->data;
+    int size = pkt->size;
+
+    switch (spdif_ctx->codec_id) {
+    case AV_CODEC_ID_AC3: {
+        if (size < 6)
+            return -1;
+        int bitstream_mode = data[5] & 0x7;
+        *out = write_burst(spdif_ctx, IEC61937_AC3 | (bitstream_mode << 8),
+                           ((size + 1) & ~1) << 3, data, size,
+                           AC3_BURST_SIZE, true);
+        break;
+    }
+    case AV_CODEC_ID_EAC3: {
+        static const uint8_t eac3_repeat[4] = {6, 3, 2, 1};
+        if (size < 6)
+            return -1;
+        // Frames with less than 6 blocks are collected into one burst.
+        int repeat = 1;
+        int bsid = data[5] >> 3;
+        if (bsid > 10 && (data[4] & 0xc0) != 0xc0) // fscod
+            repeat = eac3_repeat[(data[4] & 0x30) >> 4]; // numblkscod
+        if (spdif_ctx->out_buffer_len + size > OUTBUF_SIZE) {
+            MP_ERR(da, "spdif packet too large.\n");
+            spdif_ctx->out_buffer_len = spdif_ctx->eac3_frames = 0;
+            return -1;
+        }
+        if (!spdif_ctx->eac3_frames)
+            spdif_ctx->eac3_pts = pts;
+        memcpy(spdif_ctx->out_buffer + spdif_ctx->out_buffer_len, data, size);
+        spdif_ctx->out_buffer_len += size;
+        if (++spdif_ctx->eac3_frames < repeat)
+            return 0;
+        *out = write_burst(spdif_ctx, IEC61937_EAC3, spdif_ctx->out_buffer_len,
+                           spdif_ctx->out_buffer, spdif_ctx->out_buffer_len,
+                           EAC3_BURST_SIZE, true);
+        pts = spdif_ctx->eac3_pts;
+        spdif_ctx->out_buffer_len = spdif_ctx->eac3_frames = 0;
+        break;
+    }
+    case AV_CODEC_ID_DTS: {
+        if (size < 9 || AV_RB32(data) != DTS_SYNCWORD_CORE_BE) {
+            MP_ERR(da, "Unsupported DTS frame.\n");
+            return -1;
+        }
+        int blocks = ((AV_RB16(data + 4) >> 2) & 0x7f) + 1;
+        int core_size = ((AV_RB24(data + 5) >> 4) & 0x3fff) + 1;
+        int data_type;
+        switch (blocks) {
+        case 512 >> 5:  data_type = IEC61937_DTS1; break;
+        case 1024 >> 5: data_type = IEC61937_DTS2; break;
+        case 2048 >> 5: data_type = IEC61937_DTS3; break;
+        default:
+            MP_ERR(da, "%d samples in DTS frame not supported.\n", blocks << 5);
+            return -1;
+        }
+        int length_code = ((size + 1) & ~1) << 3;
+        // Discard extension data (such as DTS-HD) after the core.
+        if (core_size < size) {
+            size = core_size;
+            length_code = core_size << 3;
+        }
+        int burst_size = blocks << 7;
+        *out = write_burst(spdif_ctx, data_type, length_code, data, size,
+                           burst_size, size != burst_size);
+        break;
+    }
+    default:
+        abort();
+    }
+
+    if (!*out)
+        return -1;
+    (*out)->pts = pts;
+    return 0;
+}
+
 static int decode_packet(struct dec_audio *da, struct demux_packet *mpkt,
                          struct mp_audio **out)
 {
     struct spdifContext *spdif_ctx = da->priv;
 
-    spdif_ctx->out_buffer_len  = 0;
-
     if (!mpkt)
         return 0;
 
@@ -270,10 +421,14 @@ static int decode_packet(struct dec_audio *da, struct demux_packet *mpkt,
     mp_set_av_packet(&pkt, mpkt, NULL);
     mpkt->len = 0; // will be fully consumed
     pkt.pts = pkt.dts = 0;
-    if (!spdif_ctx->lavf_ctx) {
+    if (!spdif_ctx->lavf_ctx && !spdif_ctx->direct) {
         if (init_filter(da, &pkt) < 0)
             return -1;
     }
+    if (spdif_ctx->direct)
+        return write_direct(da, &pkt, pts, out);
+
+    spdif_ctx->out_buffer_len = 0;
     int ret = av_write_frame(spdif_ctx->lavf_ctx, &pkt);
     avio_flush(spdif_ctx->lavf_ctx->pb);
     if (ret < 0)
@@ -292,6 +447,18 @@ static int decode_packet(struct dec_audio *da, struct demux_packet *mpkt,
 
 static int control(struct dec_audio *da, int cmd, void *arg)
 {
+    struct spdifContext *spdif_ctx = da->priv;
+
+    switch (cmd) {
+    case ADCTRL_RESET:
+        // The libavformat muxer keeps its own state, which can't be reset.
+        if (!spdif_ctx->direct)
+            break;
+        // Drop E-AC3 frames collected for an incomplete burst.
+        spdif_ctx->out_buffer_len = spdif_ctx->eac3_frames = 0;
+        spdif_ctx->eac3_pts = MP_NOPTS_VALUE;
+        return CONTROL_TRUE;
+    }
     return CONTROL_UNKNOWN;
 }
 
@@ -20,6 +20,7 @@
 #include <unistd.h>
 #include <math.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <libavutil/mem.h>
 
@@ -28,6 +29,7 @@
 #include "common/codecs.h"
 #include "common/msg.h"
 #include "misc/bstr.h"
+#include "osdep/threads.h"
 
 #include "stream/stream.h"
 #include "demux/demux.h"
@@ -51,9 +53,78 @@ static const struct ad_functions * const ad_drivers[] = {
     NULL
 };
 
+// Decoding on a separate thread (--ad-queue-frames). While the thread is
+// running, it owns all "internal" fields of dec_audio, as well as the decoder.
+// The user thread only accesses them with the lock held and busy unset.
+struct dec_queue {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    bool exit;
+    bool busy;          // thread is decoding without holding the lock
+    bool kick;          // audio_work() was called (new packets may be there)
+    int state;          // DATA_AGAIN, or why the thread stopped decoding
+    struct mp_audio **frames;
+    int num_frames;
+    int max_frames;
+    void (*wakeup_cb)(void *ctx);
+    void *wakeup_cb_ctx;
+};
+
+static void reset_decoder(struct dec_audio *d_audio);
+
+// Get exclusive access to the decoder state. Must be paired with unlock_idle().
+static void lock_idle(struct dec_audio *d_audio)
+{
+    struct dec_queue *q = d_audio->queue;
+    if (!q)
+        return;
+    pthread_mutex_lock(&q->lock);
+    while (q->busy)
+        pthread_cond_wait(&q->wakeup, &q->lock);
+}
+
+static void unlock_idle(struct dec_audio *d_audio)
+{
+    struct dec_queue *q = d_audio->queue;
+    if (!q)
+        return;
+    pthread_cond_broadcast(&q->wakeup);
+    pthread_mutex_unlock(&q->lock);
+}
+
+// Drop queued frames. Must be called between lock_idle() and unlock_idle().
+static void flush_queue(struct dec_audio *d_audio)
+{
+    struct dec_queue *q = d_audio->queue;
+    if (!q)
+        return;
+    for (int n = 0; n < q->num_frames; n++)
+        talloc_free(q->frames[n]);
+    q->num_frames = 0;
+    q->state = DATA_AGAIN;
+}
+
+static void stop_thread(struct dec_audio *d_audio)
+{
+    struct dec_queue *q = d_audio->queue;
+    if (!q)
+        return;
+    pthread_mutex_lock(&q->lock);
+    q->exit = true;
+    pthread_cond_broadcast(&q->wakeup);
+    pthread_mutex_unlock(&q->lock);
+    pthread_join(q->thread, NULL);
+    flush_queue(d_audio);
+    pthread_cond_destroy(&q->wakeup);
+    pthread_mutex_destroy(&q->lock);
+    talloc_free(q);
+    d_audio->queue = NULL;
+}
+
 static void uninit_decoder(struct dec_audio *d_audio)
 {
-    audio_reset_decoding(d_audio);
+    reset_decoder(d_audio);
     if (d_audio->ad_driver) {
         MP_VERBOSE(d_audio, "Uninit audio decoder.\n");
         d_audio->ad_driver->uninit(d_audio);
@@ -111,7 +182,7 @@ static const struct ad_functions *find_driver(const char *name)
     return NULL;
 }
 
-int audio_init_best_codec(struct dec_audio *d_audio)
+static int init_best_codec(struct dec_audio *d_audio)
 {
     uninit_decoder(d_audio);
     assert(!d_audio->ad_driver);
@@ -151,15 +222,25 @@ int audio_init_best_codec(struct dec_audio *d_audio)
     return !!d_audio->ad_driver;
 }
 
+int audio_init_best_codec(struct dec_audio *d_audio)
+{
+    lock_idle(d_audio);
+    int r = init_best_codec(d_audio);
+    flush_queue(d_audio);
+    unlock_idle(d_audio);
+    return r;
+}
+
 void audio_uninit(struct dec_audio *d_audio)
 {
     if (!d_audio)
         return;
+    stop_thread(d_audio);
     uninit_decoder(d_audio);
     talloc_free(d_audio);
 }
 
-void audio_reset_decoding(struct dec_audio *d_audio)
+static void reset_decoder(struct dec_audio *d_audio)
 {
     if (d_audio->ad_driver)
         d_audio->ad_driver->control(d_audio, ADCTRL_RESET, NULL);
@@ -173,6 +254,14 @@ void audio_reset_decoding(struct dec_audio *d_audio)
     d_audio->start = d_audio->end = MP_NOPTS_VALUE;
 }
 
+void audio_reset_decoding(struct dec_audio *d_audio)
+{
+    lock_idle(d_audio);
+    reset_decoder(d_audio);
+    flush_queue(d_audio);
+    unlock_idle(d_audio);
+}
+
 static void fix_audio_pts(struct dec_audio *da)
 {
     if (!da->current_frame)
@@ -195,7 +284,7 @@ static void fix_audio_pts(struct dec_audio *da)
         da->pts += da->current_frame->samples / (double)da->current_frame->rate;
 }
 
-void audio_work(struct dec_audio *da)
+static void decode_next(struct dec_audio *da)
 {
     if (da->current_frame)
         return;
@@ -258,7 +347,7 @@ void audio_work(struct dec_audio *da)
         if (da->ad_driver)
             da->ad_driver->uninit(da);
         da->ad_driver = NULL;
-        audio_init_best_codec(da);
+        init_best_codec(da);
 
         da->start = new_segment->start;
         da->end = new_segment->end;
@@ -270,12 +359,7 @@ void audio_work(struct dec_audio *da)
     }
 }
 
-// Fetch an audio frame decoded with audio_work(). Returns one of:
-//  DATA_OK:    *out_frame is set to a new image
-//  DATA_WAIT:  waiting for demuxer; will receive a wakeup signal
-//  DATA_EOF:   end of file, no more frames to be expected
-//  DATA_AGAIN: dropped frame or something similar
-int audio_get_frame(struct dec_audio *da, struct mp_audio **out_frame)
+static int get_frame(struct dec_audio *da, struct mp_audio **out_frame)
 {
     *out_frame = NULL;
     if (da->current_frame) {
@@ -287,3 +371,109 @@ int audio_get_frame(struct dec_audio *da, struct mp_audio **out_frame)
         return DATA_AGAIN;
     return da->current_state;
 }
+
+static void *dec_thread(void *arg)
+{
+    struct dec_audio *da = arg;
+    struct dec_queue *q = da->queue;
+    mpthread_set_name("ad");
+
+    pthread_mutex_lock(&q->lock);
+    while (!q->exit) {
+        bool stopped = q->state == DATA_WAIT || q->state == DATA_EOF;
+        if (q->num_frames >= q->max_frames || (stopped && !q->kick)) {
+            pthread_cond_wait(&q->wakeup, &q->lock);
+            continue;
+        }
+        q->kick = false;
+        q->busy = true;
+        pthread_mutex_unlock(&q->lock);
+
+        struct mp_audio *frame = NULL;
+        decode_next(da);
+        int res = get_frame(da, &frame);
+
+        pthread_mutex_lock(&q->lock);
+        q->busy = false;
+        pthread_cond_broadcast(&q->wakeup);
+        int old_state = q->state;
+        q->state = res == DATA_OK ? DATA_AGAIN : res;
+        if (frame)
+            MP_TARRAY_APPEND(q, q->frames, q->num_frames, frame);
+        // Don't wake up the player for repeated EOF/WAIT results, or the
+        // player and this thread would wake up each other forever.
+        if ((frame || (q->state != DATA_AGAIN && q->state != old_state)) &&
+            q->wakeup_cb)
+            q->wakeup_cb(q->wakeup_cb_ctx);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return NULL;
+}
+
+// Decode on a separate thread from now on, keeping up to max_frames decoded
+// frames queued. wakeup_cb is called (on the decoder thread) if
+// audio_get_frame() may return a different result.
+void audio_start_thread(struct dec_audio *d_audio, int max_frames,
+                        void (*wakeup_cb)(void *ctx), void *wakeup_cb_ctx)
+{
+    if (d_audio->queue || max_frames < 1)
+        return;
+
+    struct dec_queue *q = talloc_zero(NULL, struct dec_queue);
+    *q = (struct dec_queue){
+        .state = DATA_AGAIN,
+        .max_frames = max_frames,
+        .wakeup_cb = wakeup_cb,
+        .wakeup_cb_ctx = wakeup_cb_ctx,
+    };
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->wakeup, NULL);
+    d_audio->queue = q;
+
+    if (pthread_create(&q->thread, NULL, dec_thread, d_audio)) {
+        MP_ERR(d_audio, "Could not start decoder thread.\n");
+        pthread_cond_destroy(&q->wakeup);
+        pthread_mutex_destroy(&q->lock);
+        talloc_free(q);
+        d_audio->queue = NULL;
+        return;
+    }
+    MP_VERBOSE(d_audio, "Decoding on a separate thread.\n");
+}
+
+void audio_work(struct dec_audio *da)
+{
+    struct dec_queue *q = da->queue;
+    if (q) {
+        pthread_mutex_lock(&q->lock);
+        q->kick = true;
+        pthread_cond_broadcast(&q->wakeup);
+        pthread_mutex_unlock(&q->lock);
+        return;
+    }
+    decode_next(da);
+}
+
+// Fetch an audio frame decoded with audio_work(). Returns one of:
+//  DATA_OK:    *out_frame is set to a new image
+//  DATA_WAIT:  waiting for demuxer; will receive a wakeup signal
+//  DATA_EOF:   end of file, no more frames to be expected
+//  DATA_AGAIN: dropped frame or something similar
+int audio_get_frame(struct dec_audio *da, struct mp_audio **out_frame)
+{
+    struct dec_queue *q = da->queue;
+    if (!q)
+        return get_frame(da, out_frame);
+
+    *out_frame = NULL;
+    pthread_mutex_lock(&q->lock);
+    int res = q->state == DATA_EOF ? DATA_EOF : DATA_WAIT;
+    if (q->num_frames) {
+        *out_frame = q->frames[0];
+        MP_TARRAY_REMOVE_AT(q->frames, q->num_frames, 0);
+        pthread_cond_broadcast(&q->wakeup);
+        res = DATA_OK;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return res;
+}
@@ -48,12 +48,15 @@ struct dec_audio {
     struct demux_packet *new_segment;
     struct mp_audio *current_frame;
     int current_state;
+    struct dec_queue *queue;
 };
 
 struct mp_decoder_list *audio_decoder_list(void);
 int audio_init_best_codec(struct dec_audio *d_audio);
 void audio_uninit(struct dec_audio *d_audio);
 
+void audio_start_thread(struct dec_audio *d_audio, int max_frames,
+                        void (*wakeup_cb)(void *ctx), void *wakeup_cb_ctx);
 void audio_work(struct dec_audio *d_audio);
 int audio_get_frame(struct dec_audio *d_audio, struct mp_audio **out_frame);
 
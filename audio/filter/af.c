@@ -21,11 +21,14 @@
 #include <string.h>
 #include <assert.h>
 
+#include <libavutil/cpu.h>
+
 #include "common/common.h"
 #include "common/global.h"
 
 #include "options/m_option.h"
 #include "options/m_config.h"
+#include "osdep/timer.h"
 
 #include "audio/audio_buffer.h"
 #include "af.h"
@@ -165,6 +168,7 @@ static struct af_instance *af_create(struct af_stream *s, char *name,
         .opts = s->opts,
         .replaygain_data = s->replaygain_data,
         .out_pool = mp_audio_pool_create(af),
+        .stream = s,
     };
     struct m_config *config = m_config_from_obj_desc(af, s->log, &desc);
     if (m_config_apply_defaults(config, name, s->opts->af_defs) < 0)
@@ -259,6 +263,14 @@ static void af_print_filter_chain(struct af_stream *s, struct af_instance *at,
         if (af == at)
             mp_snprintf_cat(b, sizeof(b), " <-");
         MP_MSG(s, msg_level, "%s\n", b);
+        struct af_metrics *m = &af->metrics;
+        if (m->calls && mp_msg_test(s->log, MSGL_V)) {
+            MP_MSG(s, msg_level, "      in=%"PRId64" out=%"PRId64
+                   " queued=%d calls=%"PRId64" time=%"PRId64"ms"
+                   " peak=%"PRId64"us allocs=%"PRId64"\n", m->frames_in,
+                   m->frames_out, af->num_out_queued, m->calls,
+                   m->time_us / 1000, m->peak_us, m->allocs);
+        }
 
         af = af->next;
     }
@@ -683,13 +695,32 @@ void af_add_output_frame(struct af_instance *af, struct mp_audio *frame)
     if (frame) {
         assert(mp_audio_config_equals(&af->fmt_out, frame));
         MP_TARRAY_APPEND(af, af->out_queued, af->num_out_queued, frame);
+        af->metrics.frames_out++;
     }
 }
 
+static void account_call(struct af_instance *af, int64_t start)
+{
+    int64_t t = mp_time_us() - start;
+    af->metrics.calls++;
+    af->metrics.time_us += t;
+    af->metrics.peak_us = MPMAX(af->metrics.peak_us, t);
+    if (af->out_pool)
+        af->metrics.allocs = mp_audio_pool_num_allocs(af->out_pool);
+}
+
+static int call_filter_out(struct af_instance *af)
+{
+    int64_t start = mp_time_us();
+    int r = af->filter_out(af);
+    account_call(af, start);
+    return r;
+}
+
 static bool af_has_output_frame(struct af_instance *af)
 {
     if (!af->num_out_queued && af->filter_out) {
-        if (af->filter_out(af) < 0)
+        if (call_filter_out(af) < 0)
             MP_ERR(af, "Error filtering frame.\n");
     }
     return af->num_out_queued > 0;
@@ -710,16 +741,20 @@ static void read_remaining(struct af_instance *af)
     int num_frames;
     do {
         num_frames = af->num_out_queued;
-        if (!af->filter_out || af->filter_out(af) < 0)
+        if (!af->filter_out || call_filter_out(af) < 0)
             break;
     } while (num_frames != af->num_out_queued);
 }
 
 static int af_do_filter(struct af_instance *af, struct mp_audio *frame)
 {
-    if (frame)
+    if (frame) {
         assert(mp_audio_config_equals(&af->fmt_in, frame));
+        af->metrics.frames_in++;
+    }
+    int64_t start = mp_time_us();
     int r = af->filter_frame(af, frame);
+    account_call(af, start);
     if (r < 0)
         MP_ERR(af, "Error filtering frame.\n");
     return r;
@@ -792,6 +827,36 @@ int af_make_writeable(struct af_instance *af, struct mp_audio *frame)
     return mp_audio_pool_make_writeable(af->out_pool, frame);
 }
 
+// Call fn(ctx, index) for each index in [0, count), where index is typically
+// a channel. If the frame's channels*rate reaches --audio-parallel-threshold,
+// the calls are distributed over worker threads shared by the whole filter
+// chain; otherwise they run sequentially on the calling thread. The calls
+// can happen in any order, and fn must not touch state of other indexes.
+void af_run_parallel(struct af_instance *af, struct mp_audio *frame,
+                     mp_thread_pool_fn fn, void *ctx, int count)
+{
+    struct af_stream *s = af->stream;
+    int threshold = af->opts->audio_parallel_threshold;
+    if (s && threshold > 0 && count > 1 &&
+        (int64_t)frame->nch * frame->rate >= threshold)
+    {
+        if (!s->thread_pool_init) {
+            s->thread_pool_init = true;
+            int threads = MPMIN(av_cpu_count(), 4) - 1;
+            if (threads > 0) {
+                s->thread_pool = mp_thread_pool_create(s, threads);
+                MP_VERBOSE(s, "Using %d worker threads.\n", threads);
+            }
+        }
+        if (s->thread_pool) {
+            mp_thread_pool_run(s->thread_pool, fn, ctx, count);
+            return;
+        }
+    }
+    for (int n = 0; n < count; n++)
+        fn(ctx, n);
+}
+
 void af_seek_reset(struct af_stream *s)
 {
     af_control_all(s, AF_CONTROL_RESET, NULL);
@@ -28,6 +28,7 @@
 #include "audio/audio.h"
 #include "common/msg.h"
 #include "common/common.h"
+#include "misc/thread_pool.h"
 
 struct af_instance;
 struct mpv_global;
@@ -49,6 +50,16 @@ struct af_info {
     const struct m_option *options;
 };
 
+// Per-filter accounting, updated by af.c.
+struct af_metrics {
+    int64_t calls;          // number of filter callback invocations
+    int64_t frames_in;
+    int64_t frames_out;
+    int64_t time_us;        // total time spent in the filter callbacks
+    int64_t peak_us;        // longest single callback invocation
+    int64_t allocs;         // newly allocated output data buffers
+};
+
 // Linked list of audio filters
 struct af_instance {
     const struct af_info *info;
@@ -80,6 +91,10 @@ struct af_instance {
     int num_out_queued;
 
     struct mp_audio_pool *out_pool;
+
+    struct af_metrics metrics;
+
+    struct af_stream *stream; // filter chain this filter belongs to
 };
 
 // Current audio stream
@@ -98,6 +113,10 @@ struct af_stream {
     struct mp_log *log;
     struct MPOpts *opts;
     struct replaygain_data *replaygain_data;
+
+    // Worker threads shared by all filters, see af_run_parallel().
+    struct mp_thread_pool *thread_pool;
+    bool thread_pool_init;
 };
 
 // Return values
@@ -150,6 +169,8 @@ int af_output_frame(struct af_stream *s, bool eof);
 struct mp_audio *af_read_output_frame(struct af_stream *s);
 void af_unread_output_frame(struct af_stream *s, struct mp_audio *frame);
 int af_make_writeable(struct af_instance *af, struct mp_audio *frame);
+void af_run_parallel(struct af_instance *af, struct mp_audio *frame,
+                     mp_thread_pool_fn fn, void *ctx, int count);
 
 double af_calc_delay(struct af_stream *s);
 
@@ -157,5 +178,9 @@ int af_test_output(struct af_instance *af, struct mp_audio *out);
 
 int af_from_ms(int n, float *in, int *out, int rate, float mi, float ma);
 float af_softclip(float a);
+void af_gain_float(float *a, int n, float gain);
+void af_gain_s16(int16_t *a, int n, int vol);
+void af_mix_float(float *out, int ncho, const float *in, int nchi,
+                  const float *mat, int samples);
 
 #endif /* MPLAYER_AF_H */
@@ -75,6 +75,9 @@ typedef struct af_volume_s
     // "Ideal" level
     float mid_s16;
     float mid_float;
+    // state for the per-channel functions
+    struct mp_audio *cur;
+    float energy[AF_NCH];
 }af_drc_t;
 
 // Initialization and runtime control
@@ -96,20 +99,75 @@ static int control(struct af_instance* af, int cmd, void* arg)
   return AF_UNKNOWN;
 }
 
-static void method1_int16(af_drc_t *s, struct mp_audio *c)
+// Sum of the squared samples of channel ci in s->cur.
+static void energy_channel(void *ctx, int ci)
 {
-  register int i = 0;
-  int16_t *data = (int16_t*)c->planes[0];       // Audio data
-  int len = c->samples*c->nch;          // Number of samples
-  float curavg = 0.0, newavg, neededmul;
-  int tmp;
+  af_drc_t *s = ctx;
+  struct mp_audio *c = s->cur;
+  int len = c->samples*c->nch;
+  float sum = 0.0;
+
+  if (c->format == AF_FORMAT_S16) {
+    int16_t *data = (int16_t*)c->planes[0];
+    for (int i = ci; i < len; i += c->nch)
+      sum += data[i] * data[i];
+  } else {
+    float *data = (float*)c->planes[0];
+    for (int i = ci; i < len; i += c->nch)
+      sum += data[i] * data[i];
+  }
+  s->energy[ci] = sum;
+}
 
-  for (i = 0; i < len; i++)
-  {
-    tmp = data[i];
-    curavg += tmp * tmp;
+// Scale & clamp the samples of channel ci in s->cur.
+static void scale_channel(void *ctx, int ci)
+{
+  af_drc_t *s = ctx;
+  struct mp_audio *c = s->cur;
+  int len = c->samples*c->nch;
+
+  if (c->format == AF_FORMAT_S16) {
+    int16_t *data = (int16_t*)c->planes[0];
+    for (int i = ci; i < len; i += c->nch) {
+      int tmp = s->mul * data[i];
+      data[i] = MPCLAMP(tmp, SHRT_MIN, SHRT_MAX);
+    }
+  } else {
+    float *data = (float*)c->planes[0];
+    for (int i = ci; i < len; i += c->nch)
+      data[i] *= s->mul;
   }
-  curavg = sqrt(curavg / (float) len);
+}
+
+// Root mean square of all samples in c.
+static float get_avg(struct af_instance *af, struct mp_audio *c)
+{
+  af_drc_t *s = af->priv;
+  float sum = 0.0;
+
+  s->cur = c;
+  af_run_parallel(af, c, energy_channel, s, c->nch);
+  s->cur = NULL;
+  for (int ci = 0; ci < c->nch; ci++)
+    sum += s->energy[ci];
+  return sqrt(sum / (float)(c->samples * c->nch));
+}
+
+static void scale(struct af_instance *af, struct mp_audio *c)
+{
+  af_drc_t *s = af->priv;
+
+  s->cur = c;
+  af_run_parallel(af, c, scale_channel, s, c->nch);
+  s->cur = NULL;
+}
+
+static void method1_int16(struct af_instance *af, struct mp_audio *c)
+{
+  af_drc_t *s = af->priv;
+  float curavg = 0.0, newavg, neededmul;
+
+  curavg = get_avg(af, c);
 
   // Evaluate an adequate 'mul' coefficient based on previous state, current
   // samples level, etc
@@ -123,13 +181,7 @@ static void method1_int16(af_drc_t *s, struct mp_audio *c)
     s->mul = MPCLAMP(s->mul, MUL_MIN, MUL_MAX);
   }
 
-  // Scale & clamp the samples
-  for (i = 0; i < len; i++)
-  {
-    tmp = s->mul * data[i];
-    tmp = MPCLAMP(tmp, SHRT_MIN, SHRT_MAX);
-    data[i] = tmp;
-  }
+  scale(af, c);
 
   // Evaluation of newavg (not 100% accurate because of values clamping)
   newavg = s->mul * curavg;
@@ -138,19 +190,12 @@ static void method1_int16(af_drc_t *s, struct mp_audio *c)
   s->lastavg = (1.0 - SMOOTH_LASTAVG) * s->lastavg + SMOOTH_LASTAVG * newavg;
 }
 
-static void method1_float(af_drc_t *s, struct mp_audio *c)
+static void method1_float(struct af_instance *af, struct mp_audio *c)
 {
-  register int i = 0;
-  float *data = (float*)c->planes[0];   // Audio data
-  int len = c->samples*c->nch;          // Number of samples
-  float curavg = 0.0, newavg, neededmul, tmp;
+  af_drc_t *s = af->priv;
+  float curavg = 0.0, newavg, neededmul;
 
-  for (i = 0; i < len; i++)
-  {
-    tmp = data[i];
-    curavg += tmp * tmp;
-  }
-  curavg = sqrt(curavg / (float) len);
+  curavg = get_avg(af, c);
 
   // Evaluate an adequate 'mul' coefficient based on previous state, current
   // samples level, etc
@@ -164,9 +209,7 @@ static void method1_float(af_drc_t *s, struct mp_audio *c)
     s->mul = MPCLAMP(s->mul, MUL_MIN, MUL_MAX);
   }
 
-  // Scale & clamp the samples
-  for (i = 0; i < len; i++)
-    data[i] *= s->mul;
+  scale(af, c);
 
   // Evaluation of newavg (not 100% accurate because of values clamping)
   newavg = s->mul * curavg;
@@ -175,20 +218,15 @@ static void method1_float(af_drc_t *s, struct mp_audio *c)
   s->lastavg = (1.0 - SMOOTH_LASTAVG) * s->lastavg + SMOOTH_LASTAVG * newavg;
 }
 
-static void method2_int16(af_drc_t *s, struct mp_audio *c)
+static void method2_int16(struct af_instance *af, struct mp_audio *c)
 {
+  af_drc_t *s = af->priv;
   register int i = 0;
-  int16_t *data = (int16_t*)c->planes[0];       // Audio data
   int len = c->samples*c->nch;          // Number of samples
   float curavg = 0.0, newavg, avg = 0.0;
-  int tmp, totallen = 0;
+  int totallen = 0;
 
-  for (i = 0; i < len; i++)
-  {
-    tmp = data[i];
-    curavg += tmp * tmp;
-  }
-  curavg = sqrt(curavg / (float) len);
+  curavg = get_avg(af, c);
 
   // Evaluate an adequate 'mul' coefficient based on previous state, current
   // samples level, etc
@@ -208,13 +246,7 @@ static void method2_int16(af_drc_t *s, struct mp_audio *c)
     }
   }
 
-  // Scale & clamp the samples
-  for (i = 0; i < len; i++)
-  {
-    tmp = s->mul * data[i];
-    tmp = MPCLAMP(tmp, SHRT_MIN, SHRT_MAX);
-    data[i] = tmp;
-  }
+  scale(af, c);
 
   // Evaluation of newavg (not 100% accurate because of values clamping)
   newavg = s->mul * curavg;
@@ -225,20 +257,15 @@ static void method2_int16(af_drc_t *s, struct mp_audio *c)
   s->idx = (s->idx + 1) % NSAMPLES;
 }
 
-static void method2_float(af_drc_t *s, struct mp_audio *c)
+static void method2_float(struct af_instance *af, struct mp_audio *c)
 {
+  af_drc_t *s = af->priv;
   register int i = 0;
-  float *data = (float*)c->planes[0];   // Audio data
   int len = c->samples*c->nch;          // Number of samples
-  float curavg = 0.0, newavg, avg = 0.0, tmp;
+  float curavg = 0.0, newavg, avg = 0.0;
   int totallen = 0;
 
-  for (i = 0; i < len; i++)
-  {
-    tmp = data[i];
-    curavg += tmp * tmp;
-  }
-  curavg = sqrt(curavg / (float) len);
+  curavg = get_avg(af, c);
 
   // Evaluate an adequate 'mul' coefficient based on previous state, current
   // samples level, etc
@@ -258,9 +285,7 @@ static void method2_float(af_drc_t *s, struct mp_audio *c)
     }
   }
 
-  // Scale & clamp the samples
-  for (i = 0; i < len; i++)
-    data[i] *= s->mul;
+  scale(af, c);
 
   // Evaluation of newavg (not 100% accurate because of values clamping)
   newavg = s->mul * curavg;
@@ -286,16 +311,16 @@ static int filter(struct af_instance *af, struct mp_audio *data)
   if(af->data->format == (AF_FORMAT_S16))
   {
     if (s->method == 2)
-        method2_int16(s, data);
+        method2_int16(af, data);
     else
-        method1_int16(s, data);
+        method1_int16(af, data);
   }
   else if(af->data->format == (AF_FORMAT_FLOAT))
   {
     if (s->method == 2)
-        method2_float(s, data);
+        method2_float(af, data);
     else
-        method1_float(s, data);
+        method1_float(af, data);
   }
   af_add_output_frame(af, data);
   return 0;
@@ -68,6 +68,7 @@ typedef struct af_equalizer_s
   int     channels;             // Number of channels
   float   gain_factor;     // applied at output to avoid clipping
   double  p[KM];
+  struct mp_audio *cur;         // frame being filtered by filter_channel()
 } af_equalizer_t;
 
 // 2nd order Band-pass Filter design
@@ -140,48 +141,56 @@ static int control(struct af_instance* af, int cmd, void* arg)
   return AF_UNKNOWN;
 }
 
+// Filter a single channel of s->cur; channels are independent of each other,
+// so this can run concurrently for different channels.
+static void filter_channel(void *ctx, int ci)
+{
+  af_equalizer_t*  s    = ctx;
+  struct mp_audio* c    = s->cur;
+  uint32_t         nch  = c->nch;                       // Number of channels
+  float*      g   = s->g[ci];      // Gain factor
+  float*      in  = ((float*)c->planes[0])+ci;
+  float*      out = ((float*)c->planes[0])+ci;
+  float*      end = in + c->samples*c->nch; // Block loop end
+
+  while(in < end){
+    register int      k  = 0;         // Frequency band index
+    register float    yt = *in;       // Current input sample
+    in+=nch;
+
+    // Run the filters
+    for(;k<s->K;k++){
+      // Pointer to circular buffer wq
+      register float* wq = s->wq[ci][k];
+      // Calculate output from AR part of current filter
+      register float w=yt*s->b[k][0] + wq[0]*s->a[k][0] + wq[1]*s->a[k][1];
+      // Calculate output form MA part of current filter
+      yt+=(w + wq[1]*s->b[k][1])*g[k];
+      // Update circular buffer
+      wq[1] = wq[0];
+      wq[0] = w;
+    }
+    // Calculate output
+    *out=yt*s->gain_factor;
+    out+=nch;
+  }
+}
+
 static int filter(struct af_instance* af, struct mp_audio* data)
 {
-  struct mp_audio*       c      = data;                         // Current working data
-  if (!c)
+  if (!data)
     return 0;
   af_equalizer_t*  s    = (af_equalizer_t*)af->priv;    // Setup
-  uint32_t         ci   = af->data->nch;                // Index for channels
-  uint32_t         nch  = af->data->nch;                // Number of channels
 
   if (af_make_writeable(af, data) < 0) {
     talloc_free(data);
     return -1;
   }
 
-  while(ci--){
-    float*      g   = s->g[ci];      // Gain factor
-    float*      in  = ((float*)c->planes[0])+ci;
-    float*      out = ((float*)c->planes[0])+ci;
-    float*      end = in + c->samples*c->nch; // Block loop end
-
-    while(in < end){
-      register int      k  = 0;         // Frequency band index
-      register float    yt = *in;       // Current input sample
-      in+=nch;
-
-      // Run the filters
-      for(;k<s->K;k++){
-        // Pointer to circular buffer wq
-        register float* wq = s->wq[ci][k];
-        // Calculate output from AR part of current filter
-        register float w=yt*s->b[k][0] + wq[0]*s->a[k][0] + wq[1]*s->a[k][1];
-        // Calculate output form MA part of current filter
-        yt+=(w + wq[1]*s->b[k][1])*g[k];
-        // Update circular buffer
-        wq[1] = wq[0];
-        wq[0] = w;
-      }
-      // Calculate output
-      *out=yt*s->gain_factor;
-      out+=nch;
-    }
-  }
+  s->cur = data;
+  af_run_parallel(af, data, filter_channel, s, af->data->nch);
+  s->cur = NULL;
+
   af_add_output_frame(af, data);
   return 0;
 }
@@ -53,6 +53,7 @@ const uint16_t ac3_bitrate_tab[19] = {
 typedef struct af_ac3enc_s {
     struct AVCodec        *lavc_acodec;
     struct AVCodecContext *lavc_actx;
+    struct AVFrame *lavc_frame; // reused for every encoder call
     int bit_rate;
     struct mp_audio *input;     // frame passed to libavcodec
     struct mp_audio *pending;   // unconsumed input data
@@ -196,6 +197,7 @@ static void uninit(struct af_instance* af)
             avcodec_close(s->lavc_actx);
             av_free(s->lavc_actx);
         }
+        av_frame_free(&s->lavc_frame);
         talloc_free(s->pending);
     }
 }
@@ -270,11 +272,7 @@ static int filter_out(struct af_instance *af)
     if (!s->pending)
         return 0;
 
-    AVFrame *frame = av_frame_alloc();
-    if (!frame) {
-        MP_FATAL(af, "Could not allocate memory \n");
-        return -1;
-    }
+    AVFrame *frame = s->lavc_frame;
     int err = -1;
 
     AVPacket pkt = {0};
@@ -370,7 +368,7 @@ static int filter_out(struct af_instance *af)
     err = 0;
 done:
     av_packet_unref(&pkt);
-    av_frame_free(&frame);
+    av_frame_unref(frame);
     update_delay(af);
     return err;
 }
@@ -408,6 +406,12 @@ static int af_open(struct af_instance* af){
         return AF_ERROR;
     }
 
+    s->lavc_frame = av_frame_alloc();
+    if (!s->lavc_frame) {
+        MP_ERR(af, "Could not allocate memory\n");
+        return AF_ERROR;
+    }
+
     s->input = talloc_zero(s, struct mp_audio);
 
     if (s->cfg_bit_rate) {
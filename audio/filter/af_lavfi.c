@@ -69,6 +69,10 @@ struct priv {
 
     struct mp_tags *metadata;
 
+    // Reused for every frame passed to and returned from the graph.
+    AVFrame *in_frame;
+    AVFrame *out_frame;
+
     // options
     char *cfg_graph;
     char **cfg_avopts;
@@ -267,24 +271,25 @@ static int filter_frame(struct af_instance *af, struct mp_audio *data)
         goto error;
 
     if (data) {
-        frame = mp_audio_to_avframe_and_unref(data);
-        data = NULL;
-        if (!frame)
+        frame = p->in_frame;
+        if (mp_audio_to_avframe(data, frame) < 0)
             goto error;
+        talloc_free(data);
+        data = NULL;
 
         // Timebase is 1/sample_rate
         frame->pts = p->samples_in;
         p->samples_in += frame->nb_samples;
     }
 
+    // This takes over the frame references (if any), and resets the frame.
     if (av_buffersrc_add_frame(p->in, frame) < 0)
         goto error;
 
-    av_frame_free(&frame);
-    talloc_free(data);
     return 0;
 error:
-    av_frame_free(&frame);
+    if (frame)
+        av_frame_unref(frame);
     talloc_free(data);
     return -1;
 }
@@ -292,20 +297,17 @@ error:
 static int filter_out(struct af_instance *af)
 {
     struct priv *p = af->priv;
+    AVFrame *frame = p->out_frame;
 
     if (!p->graph)
         goto error;
 
-    AVFrame *frame = av_frame_alloc();
-    if (!frame)
-        goto error;
-
     int err = av_buffersink_get_frame(p->out, frame);
     if (err == AVERROR(EAGAIN) || err == AVERROR_EOF) {
         // Not an error situation - no more output buffers in queue.
         // AVERROR_EOF means we shouldn't even give the filter more
         // input, but we don't handle that completely correctly.
-        av_frame_free(&frame);
+        av_frame_unref(frame);
         p->eof |= err == AVERROR_EOF;
         return 0;
     }
@@ -327,20 +329,30 @@ static int filter_out(struct af_instance *af)
 
     get_metadata_from_av_frame(af, frame);
     af_add_output_frame(af, out);
-    av_frame_free(&frame);
+    av_frame_unref(frame);
     return 0;
 error:
-    av_frame_free(&frame);
+    av_frame_unref(frame);
     return -1;
 }
 
 static void uninit(struct af_instance *af)
 {
+    struct priv *p = af->priv;
     destroy_graph(af);
+    av_frame_free(&p->in_frame);
+    av_frame_free(&p->out_frame);
 }
 
 static int af_open(struct af_instance *af)
 {
+    struct priv *p = af->priv;
+    p->in_frame = av_frame_alloc();
+    p->out_frame = av_frame_alloc();
+    if (!p->in_frame || !p->out_frame) {
+        uninit(af);
+        return AF_ERROR;
+    }
     af->control = control;
     af->uninit = uninit;
     af->filter_frame = filter_frame;
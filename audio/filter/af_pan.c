@@ -118,28 +118,19 @@ static int filter_frame(struct af_instance *af, struct mp_audio *c)
   mp_audio_copy_attributes(l, c);
 
   af_pan_t*     s    = af->priv;        // Setup for this instance
-  float*        in   = c->planes[0];    // Input audio data
-  float*        out  = NULL;            // Output audio data
-  float*        end  = in+c->samples*c->nch;    // End of loop
   int           nchi = c->nch;          // Number of input channels
   int           ncho = l->nch;          // Number of output channels
-  register int  j,k;
 
-  out = l->planes[0];
-  // Execute panning
-  // FIXME: Too slow
-  while(in < end){
-    for(j=0;j<ncho;j++){
-      register float  x   = 0.0;
-      register float* tin = in;
-      for(k=0;k<nchi;k++)
-        x += tin[k] * s->level[j][k];
-      out[j] = x;
-    }
-    out+= ncho;
-    in+= nchi;
+  // Transposed gain matrix, so that adjacent output channels are contiguous
+  float mat[AF_NCH * AF_NCH];
+  for (int k = 0; k < nchi; k++) {
+    for (int j = 0; j < ncho; j++)
+      mat[k * ncho + j] = s->level[j][k];
   }
 
+  // Execute panning
+  af_mix_float(l->planes[0], ncho, c->planes[0], nchi, mat, c->samples);
+
   talloc_free(c);
   af_add_output_frame(af, l);
   return 0;
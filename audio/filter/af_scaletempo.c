@@ -35,6 +35,13 @@
 #include <limits.h>
 #include <assert.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
 #include "common/common.h"
 
 #include "af.h"
@@ -117,6 +124,39 @@ static int fill_queue(struct af_instance *af, struct mp_audio *data, int offset)
 
 #define UNROLL_PADDING (4 * 4)
 
+// Return the sum of a[i] * b[i] for 0 <= i < n.
+static float dot_float(const float *a, const float *b, int n)
+{
+    float sum = 0;
+    int i = 0;
+#if defined(__SSE2__)
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i),
+                                           _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4),
+                                           _mm_loadu_ps(b + i + 4)));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+    sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    float32x4_t acc0 = vdupq_n_f32(0);
+    float32x4_t acc1 = vdupq_n_f32(0);
+    for (; i + 8 <= n; i += 8) {
+        acc0 = vmlaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+        acc1 = vmlaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    float32x4_t acc = vaddq_f32(acc0, acc1);
+    sum = (vgetq_lane_f32(acc, 0) + vgetq_lane_f32(acc, 1)) +
+          (vgetq_lane_f32(acc, 2) + vgetq_lane_f32(acc, 3));
+#endif
+    for (; i < n; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
 static int best_overlap_offset_float(af_scaletempo_t *s)
 {
     float best_corr = INT_MIN;
@@ -130,12 +170,9 @@ static int best_overlap_offset_float(af_scaletempo_t *s)
         *ppc++ = *pw++ **po++;
 
     float *search_start = (float *)s->buf_queue + s->num_channels;
+    int num = s->samples_overlap - s->num_channels;
     for (int off = 0; off < s->frames_search; off++) {
-        float corr = 0;
-        float *ps = search_start;
-        ppc = s->buf_pre_corr;
-        for (int i = s->num_channels; i < s->samples_overlap; i++)
-            corr += *ppc++ **ps++;
+        float corr = dot_float(s->buf_pre_corr, search_start, num);
         if (corr > best_corr) {
             best_corr = corr;
             best_off  = off;
@@ -127,11 +127,7 @@ static void filter_plane(struct af_instance *af, struct mp_audio *data, int p)
         if (vol != 256) {
             if (af_make_writeable(af, data) < 0)
                 return; // oom
-            int16_t *a = data->planes[p];
-            for (int i = 0; i < num_samples; i++) {
-                int x = (a[i] * vol) >> 8;
-                a[i] = MPCLAMP(x, SHRT_MIN, SHRT_MAX);
-            }
+            af_gain_s16(data->planes[p], num_samples, vol);
         }
     } else if (af_fmt_from_planar(af->data->format) == AF_FORMAT_FLOAT) {
         float vol = level;
@@ -139,9 +135,11 @@ static void filter_plane(struct af_instance *af, struct mp_audio *data, int p)
             if (af_make_writeable(af, data) < 0)
                 return; // oom
             float *a = data->planes[p];
-            for (int i = 0; i < num_samples; i++) {
-                float x = a[i] * vol;
-                a[i] = s->soft ? af_softclip(x) : MPCLAMP(x, -1.0, 1.0);
+            if (s->soft) {
+                for (int i = 0; i < num_samples; i++)
+                    a[i] = af_softclip(a[i] * vol);
+            } else {
+                af_gain_float(a, num_samples, vol);
             }
         }
     }
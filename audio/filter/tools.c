@@ -17,6 +17,14 @@
 
 #include <math.h>
 #include <string.h>
+#include <limits.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
 
 #include "common/common.h"
 #include "af.h"
@@ -70,3 +78,87 @@ float af_softclip(float a)
     else
         return sin(a);
 }
+
+// Multiply n samples by gain, and clip the result to [-1, 1].
+void af_gain_float(float *a, int n, float gain)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    __m128 vgain = _mm_set1_ps(gain);
+    __m128 vmin = _mm_set1_ps(-1.0f);
+    __m128 vmax = _mm_set1_ps(1.0f);
+    for (; i + 4 <= n; i += 4) {
+        __m128 x = _mm_mul_ps(_mm_loadu_ps(a + i), vgain);
+        _mm_storeu_ps(a + i, _mm_min_ps(_mm_max_ps(x, vmin), vmax));
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    float32x4_t vmin = vdupq_n_f32(-1.0f);
+    float32x4_t vmax = vdupq_n_f32(1.0f);
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t x = vmulq_n_f32(vld1q_f32(a + i), gain);
+        vst1q_f32(a + i, vminq_f32(vmaxq_f32(x, vmin), vmax));
+    }
+#endif
+    for (; i < n; i++)
+        a[i] = MPCLAMP(a[i] * gain, -1.0f, 1.0f);
+}
+
+// Multiply n samples by vol/256, with saturation.
+void af_gain_s16(int16_t *a, int n, int vol)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    // The 16x16->32 bit multiplication below requires vol to fit into 16 bit.
+    if (vol >= SHRT_MIN && vol <= SHRT_MAX) {
+        __m128i vvol = _mm_set1_epi16(vol);
+        for (; i + 8 <= n; i += 8) {
+            __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+            __m128i lo = _mm_mullo_epi16(x, vvol);
+            __m128i hi = _mm_mulhi_epi16(x, vvol);
+            __m128i p0 = _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), 8);
+            __m128i p1 = _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), 8);
+            _mm_storeu_si128((__m128i *)(a + i), _mm_packs_epi32(p0, p1));
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        int x = (a[i] * vol) >> 8;
+        a[i] = MPCLAMP(x, SHRT_MIN, SHRT_MAX);
+    }
+}
+
+// Mix interleaved float audio with nchi channels into interleaved output with
+// ncho channels. mat[k * ncho + j] is the gain from input channel k to output
+// channel j. Output channels are computed in blocks of 4.
+void af_mix_float(float *out, int ncho, const float *in, int nchi,
+                  const float *mat, int samples)
+{
+    for (int s = 0; s < samples; s++) {
+        int j = 0;
+#if defined(__SSE2__)
+        for (; j + 4 <= ncho; j += 4) {
+            __m128 acc = _mm_setzero_ps();
+            for (int k = 0; k < nchi; k++) {
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(in[k]),
+                                        _mm_loadu_ps(mat + k * ncho + j)));
+            }
+            _mm_storeu_ps(out + j, acc);
+        }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+        for (; j + 4 <= ncho; j += 4) {
+            float32x4_t acc = vdupq_n_f32(0);
+            for (int k = 0; k < nchi; k++)
+                acc = vmlaq_n_f32(acc, vld1q_f32(mat + k * ncho + j), in[k]);
+            vst1q_f32(out + j, acc);
+        }
+#endif
+        for (; j < ncho; j++) {
+            float x = 0;
+            for (int k = 0; k < nchi; k++)
+                x += in[k] * mat[k * ncho + j];
+            out[j] = x;
+        }
+        in += nchi;
+        out += ncho;
+    }
+}
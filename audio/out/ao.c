@@ -41,6 +41,7 @@ extern const struct ao_driver audio_out_coreaudio_exclusive;
 extern const struct ao_driver audio_out_rsound;
 extern const struct ao_driver audio_out_sndio;
 extern const struct ao_driver audio_out_pulse;
+extern const struct ao_driver audio_out_pulse_callback;
 extern const struct ao_driver audio_out_jack;
 extern const struct ao_driver audio_out_openal;
 extern const struct ao_driver audio_out_opensles;
@@ -87,6 +88,9 @@ static const struct ao_driver * const audio_out_drivers[] = {
     &audio_out_null,
 #if HAVE_COREAUDIO
     &audio_out_coreaudio_exclusive,
+#endif
+#if HAVE_PULSE
+    &audio_out_pulse_callback,
 #endif
     &audio_out_pcm,
 #if HAVE_ENCODING
@@ -200,6 +204,20 @@ static struct ao *ao_init(bool probing, struct mpv_global *global,
         goto fail;
     }
 
+    ao_init_buffer_params(ao);
+
+    if (ao->api->init(ao) < 0)
+        goto fail;
+    return ao;
+
+fail:
+    talloc_free(ao);
+    return NULL;
+}
+
+// Derive the data layout and buffer sizes from the format the driver accepted.
+void ao_init_buffer_params(struct ao *ao)
+{
     ao->sstride = af_fmt_to_bytes(ao->format);
     ao->num_planes = 1;
     if (af_fmt_is_planar(ao->format)) {
@@ -218,14 +236,32 @@ static struct ao *ao_init(bool probing, struct mpv_global *global,
     int align = af_format_sample_alignment(ao->format);
     ao->buffer = (ao->buffer + align - 1) / align * align;
     MP_VERBOSE(ao, "using soft-buffer of %d samples.\n", ao->buffer);
+}
 
-    if (ao->api->init(ao) < 0)
-        goto fail;
-    return ao;
+// Switch an opened AO to a different PCM format, if the driver supports doing
+// this without reopening the device (AOCONTROL_REINIT_FORMAT). All buffered
+// audio is dropped. As with ao_init_best(), the AO can pick a different format
+// than requested; use ao_get_format() to get it.
+// Returns false if the switch is not supported or failed. In this case, the AO
+// must be destroyed.
+bool ao_reconfigure(struct ao *ao, int samplerate, int format,
+                    struct mp_chmap channels)
+{
+    // Passthrough usually requires reopening the device with special settings,
+    // and the pull API can't be stopped without the driver's cooperation.
+    if (ao->api != &ao_api_push || !ao->driver->control ||
+        !af_fmt_is_pcm(format) || !af_fmt_is_pcm(ao->format))
+        return false;
 
-fail:
-    talloc_free(ao);
-    return NULL;
+    MP_VERBOSE(ao, "reconfiguring to %d Hz, %s channels, %s\n", samplerate,
+               mp_chmap_to_str(&channels), af_fmt_to_str(format));
+
+    struct ao_reinit_format fmt = {
+        .samplerate = samplerate,
+        .format = format,
+        .channels = channels,
+    };
+    return ao->api->control(ao, AOCONTROL_REINIT_FORMAT, &fmt) == CONTROL_OK;
 }
 
 static void split_ao_device(void *tmp, char *opt, char **out_ao, char **out_dev)
@@ -353,6 +389,23 @@ double ao_get_delay(struct ao *ao)
     return ao->api->get_delay(ao);
 }
 
+// Return timing and underrun statistics, for diagnostics only.
+void ao_get_stats(struct ao *ao, struct ao_stats *stats)
+{
+    *stats = (struct ao_stats){
+        .callback_interval = -1,
+        .callback_jitter = -1,
+        .wakeup_latency = -1,
+        .wakeup_latency_max = -1,
+        .xruns = -1,
+    };
+    if (ao->api->get_stats)
+        ao->api->get_stats(ao, stats);
+    int64_t xruns;
+    if (ao_control(ao, AOCONTROL_GET_XRUNS, &xruns) == CONTROL_OK)
+        stats->xruns = xruns;
+}
+
 // Return free size of the internal audio buffer. This controls how much audio
 // the core should decode and try to queue with ao_play().
 int ao_get_space(struct ao *ao)
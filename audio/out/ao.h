@@ -39,6 +39,13 @@ enum aocontrol {
     AOCONTROL_HAS_SOFT_VOLUME,
     // like above, but volume persists (per app), mpv won't restore volume
     AOCONTROL_HAS_PER_APP_VOLUME,
+    // Reconfigure the device for the format in ao->samplerate/format/channels
+    // without closing it. Like init(), the AO may adjust these fields. Only
+    // sent by ao_reconfigure(), with all audio dropped and playback stopped.
+    // On failure, the AO is considered unusable.
+    AOCONTROL_REINIT_FORMAT,
+    // Number of xruns reported by the audio server (int64_t*).
+    AOCONTROL_GET_XRUNS,
 };
 
 // If set, then the queued audio data is the last. Note that after a while, new
@@ -75,6 +82,21 @@ struct ao_device_list {
     int num_devices;
 };
 
+// Timing statistics, see ao_get_stats(). Times are in seconds. Fields which
+// do not apply to the AO type (push or pull) are set to -1.
+struct ao_stats {
+    double buffered;            // audio queued in mpv's own buffer
+    double device_delay;        // latency reported by (or derived from) driver
+    int64_t underruns;          // number of times the device ran dry
+    double last_underrun;       // mp_time_sec() of the last underrun, or 0
+    double callback_interval;   // pull: time between last 2 audio callbacks
+    double callback_jitter;     // pull: average deviation from the interval
+                                //       expected from the requested samples
+    double wakeup_latency;      // push: last wakeup request->playthread run
+    double wakeup_latency_max;  // push: maximum of wakeup_latency
+    int64_t xruns;              // xruns reported by the audio server, or -1
+};
+
 struct ao;
 struct mpv_global;
 struct input_ctx;
@@ -87,6 +109,8 @@ struct ao *ao_init_best(struct mpv_global *global,
                         struct encode_lavc_context *encode_lavc_ctx,
                         int samplerate, int format, struct mp_chmap channels);
 void ao_uninit(struct ao *ao);
+bool ao_reconfigure(struct ao *ao, int samplerate, int format,
+                    struct mp_chmap channels);
 void ao_get_format(struct ao *ao, struct mp_audio *format);
 const char *ao_get_name(struct ao *ao);
 const char *ao_get_description(struct ao *ao);
@@ -94,6 +118,7 @@ bool ao_untimed(struct ao *ao);
 int ao_play(struct ao *ao, void **data, int samples, int flags);
 int ao_control(struct ao *ao, enum aocontrol cmd, void *arg);
 double ao_get_delay(struct ao *ao);
+void ao_get_stats(struct ao *ao, struct ao_stats *stats);
 int ao_get_space(struct ao *ao);
 void ao_reset(struct ao *ao);
 void ao_pause(struct ao *ao);
@@ -68,6 +68,10 @@ struct priv {
     int cfg_resample;
     int cfg_ni;
     int cfg_ignore_chmap;
+    int cfg_mmap;
+    int cfg_buffer_time;
+    int cfg_periods;
+    int cfg_realtime;
 };
 
 #define BUFFER_TIME 250000  // 250ms
@@ -102,6 +106,8 @@ static bool check_device_present(struct ao *ao, int alsa_err)
     return false;
 }
 
+static int reinit_format(struct ao *ao);
+
 static int control(struct ao *ao, enum aocontrol cmd, void *arg)
 {
     struct priv *p = ao->priv;
@@ -213,6 +219,8 @@ static int control(struct ao *ao, enum aocontrol cmd, void *arg)
         return CONTROL_OK;
     }
 
+    case AOCONTROL_REINIT_FORMAT:
+        return reinit_format(ao);
     } //end switch
     return CONTROL_UNKNOWN;
 
@@ -601,36 +609,15 @@ alsa_error: ;
 
 #define INIT_DEVICE_ERR_GENERIC -1
 #define INIT_DEVICE_ERR_HWPARAMS -2
-static int init_device(struct ao *ao, int mode)
+
+// Negotiate and install hw and sw parameters for the format requested in the
+// ao fields. The device must be open, and not have hw parameters set.
+static int setup_device(struct ao *ao)
 {
     struct priv *p = ao->priv;
     int ret = INIT_DEVICE_ERR_GENERIC;
-    char *tmp;
-    size_t tmp_s;
     int err;
 
-    err = snd_output_buffer_open(&p->output);
-    CHECK_ALSA_ERROR("Unable to create output buffer");
-
-    const char *device = "default";
-    if (ao->device)
-        device = ao->device;
-    if (p->cfg_device && p->cfg_device[0])
-        device = p->cfg_device;
-
-    err = try_open_device(ao, device, mode);
-    CHECK_ALSA_ERROR("Playback open error");
-
-    err = snd_pcm_dump(p->alsa, p->output);
-    CHECK_ALSA_WARN("Dump PCM error");
-    tmp_s = snd_output_buffer_string(p->output, &tmp);
-    if (tmp)
-        MP_DBG(ao, "PCM setup:\n---\n%.*s---\n", (int)tmp_s, tmp);
-    snd_output_flush(p->output);
-
-    err = snd_pcm_nonblock(p->alsa, 0);
-    CHECK_ALSA_WARN("Unable to set blocking mode");
-
     snd_pcm_hw_params_t *alsa_hwparams;
     snd_pcm_hw_params_alloca(&alsa_hwparams);
 
@@ -647,13 +634,18 @@ static int init_device(struct ao *ao, int mode)
     }
     dump_hw_params(ao, MSGL_DEBUG, "HW params after rate:\n", alsa_hwparams);
 
-    snd_pcm_access_t access = af_fmt_is_planar(ao->format)
-                                    ? SND_PCM_ACCESS_RW_NONINTERLEAVED
+    snd_pcm_access_t access_ni = p->cfg_mmap
+                                    ? SND_PCM_ACCESS_MMAP_NONINTERLEAVED
+                                    : SND_PCM_ACCESS_RW_NONINTERLEAVED;
+    snd_pcm_access_t access_i = p->cfg_mmap
+                                    ? SND_PCM_ACCESS_MMAP_INTERLEAVED
                                     : SND_PCM_ACCESS_RW_INTERLEAVED;
+    snd_pcm_access_t access = af_fmt_is_planar(ao->format) ? access_ni
+                                                           : access_i;
     err = snd_pcm_hw_params_set_access(p->alsa, alsa_hwparams, access);
     if (err < 0 && af_fmt_is_planar(ao->format)) {
         ao->format = af_fmt_from_planar(ao->format);
-        access = SND_PCM_ACCESS_RW_INTERLEAVED;
+        access = access_i;
         err = snd_pcm_hw_params_set_access(p->alsa, alsa_hwparams, access);
     }
     CHECK_ALSA_ERROR("Unable to set access type");
@@ -718,12 +710,15 @@ static int init_device(struct ao *ao, int mode)
     snd_pcm_hw_params_copy(hwparams_backup, alsa_hwparams);
 
     // Cargo-culted buffer settings; might still be useful for PulseAudio.
+    unsigned int buffer_time = p->cfg_buffer_time ? p->cfg_buffer_time
+                                                  : BUFFER_TIME;
+    unsigned int periods = p->cfg_periods ? p->cfg_periods : FRAGCOUNT;
     err = snd_pcm_hw_params_set_buffer_time_near
-            (p->alsa, alsa_hwparams, &(unsigned int){BUFFER_TIME}, NULL);
+            (p->alsa, alsa_hwparams, &buffer_time, NULL);
     CHECK_ALSA_WARN("Unable to set buffer time near");
     if (err >= 0) {
         err = snd_pcm_hw_params_set_periods_near
-                    (p->alsa, alsa_hwparams, &(unsigned int){FRAGCOUNT}, NULL);
+                    (p->alsa, alsa_hwparams, &periods, NULL);
         CHECK_ALSA_WARN("Unable to set periods");
     }
     if (err < 0)
@@ -789,6 +784,48 @@ static int init_device(struct ao *ao, int mode)
     MP_VERBOSE(ao, "period size: %d samples\n", (int)p->outburst);
 
     ao->device_buffer = p->buffersize;
+    ao->realtime_thread = p->cfg_realtime;
+
+    return 0;
+
+alsa_error:
+    uninit(ao);
+    return ret;
+}
+
+static int init_device(struct ao *ao, int mode)
+{
+    struct priv *p = ao->priv;
+    int ret = INIT_DEVICE_ERR_GENERIC;
+    char *tmp;
+    size_t tmp_s;
+    int err;
+
+    err = snd_output_buffer_open(&p->output);
+    CHECK_ALSA_ERROR("Unable to create output buffer");
+
+    const char *device = "default";
+    if (ao->device)
+        device = ao->device;
+    if (p->cfg_device && p->cfg_device[0])
+        device = p->cfg_device;
+
+    err = try_open_device(ao, device, mode);
+    CHECK_ALSA_ERROR("Playback open error");
+
+    err = snd_pcm_dump(p->alsa, p->output);
+    CHECK_ALSA_WARN("Dump PCM error");
+    tmp_s = snd_output_buffer_string(p->output, &tmp);
+    if (tmp)
+        MP_DBG(ao, "PCM setup:\n---\n%.*s---\n", (int)tmp_s, tmp);
+    snd_output_flush(p->output);
+
+    err = snd_pcm_nonblock(p->alsa, 0);
+    CHECK_ALSA_WARN("Unable to set blocking mode");
+
+    ret = setup_device(ao);
+    if (ret < 0)
+        return ret;
 
     // ao_alsa implements this by relying on underrun behavior (no data means
     // underrun, during which silence is played). Trigger by playing some
@@ -851,6 +888,38 @@ static int init(struct ao *ao)
     return r;
 }
 
+// AOCONTROL_REINIT_FORMAT: renegotiate the hw parameters on the open device,
+// which is much faster than closing and reopening it.
+static int reinit_format(struct ao *ao)
+{
+    struct priv *p = ao->priv;
+    int err;
+
+    if (!p->alsa || p->device_lost)
+        return CONTROL_ERROR;
+
+    if (!p->cfg_ni)
+        ao->format = af_fmt_from_planar(ao->format);
+
+    err = snd_pcm_drop(p->alsa);
+    CHECK_ALSA_WARN("pcm drop error");
+    err = snd_pcm_hw_free(p->alsa);
+    CHECK_ALSA_ERROR("Unable to free hw-parameters");
+
+    p->paused = false;
+    p->prepause_frames = 0;
+    p->delay_before_pause = 0;
+
+    // No initial silence for --audio-stream-silence: the player writes audio
+    // in the new format right after this.
+    if (setup_device(ao) < 0)
+        return CONTROL_ERROR;
+    return CONTROL_OK;
+
+alsa_error:
+    return CONTROL_ERROR;
+}
+
 static void drain(struct ao *ao)
 {
     struct priv *p = ao->priv;
@@ -1008,6 +1077,62 @@ static void reset(struct ao *ao)
 alsa_error: ;
 }
 
+// Copy the audio directly into the device's mmap'ed ring buffer. Returns the
+// number of samples written, or a negative ALSA error code.
+static snd_pcm_sframes_t write_mmap(struct ao *ao, void **data, int samples)
+{
+    struct priv *p = ao->priv;
+    snd_pcm_sframes_t written = 0;
+
+    // Describe the source data, so ALSA can deal with the device layout.
+    int nch = ao->channels.num;
+    int bits = af_fmt_to_bytes(ao->format) * 8;
+    bool planar = af_fmt_is_planar(ao->format);
+    snd_pcm_channel_area_t src[MP_NUM_CHANNELS];
+    for (int c = 0; c < nch; c++) {
+        src[c] = (snd_pcm_channel_area_t){
+            .addr = planar ? data[c] : data[0],
+            .first = planar ? 0 : c * bits,
+            .step = planar ? bits : nch * bits,
+        };
+    }
+
+    snd_pcm_sframes_t avail = snd_pcm_avail_update(p->alsa);
+    if (avail < 0)
+        return avail;
+
+    while (written < samples && avail > 0) {
+        const snd_pcm_channel_area_t *areas;
+        snd_pcm_uframes_t offset;
+        snd_pcm_uframes_t frames = MPMIN(samples - written, avail);
+        int err = snd_pcm_mmap_begin(p->alsa, &areas, &offset, &frames);
+        if (err < 0)
+            return err;
+
+        err = snd_pcm_areas_copy(areas, offset, src, written, nch, frames,
+                                 p->alsa_fmt);
+        if (err < 0)
+            return err;
+
+        snd_pcm_sframes_t res = snd_pcm_mmap_commit(p->alsa, offset, frames);
+        if (res < 0)
+            return res;
+        if ((snd_pcm_uframes_t)res != frames)
+            return -EPIPE;
+        written += frames;
+        avail -= frames;
+    }
+
+    // Unlike snd_pcm_writei(), committing doesn't start the device on its own.
+    if (written > 0 && snd_pcm_state(p->alsa) == SND_PCM_STATE_PREPARED) {
+        int err = snd_pcm_start(p->alsa);
+        if (err < 0)
+            return err;
+    }
+
+    return written;
+}
+
 static int play(struct ao *ao, void **data, int samples, int flags)
 {
     struct priv *p = ao->priv;
@@ -1019,7 +1144,9 @@ static int play(struct ao *ao, void **data, int samples, int flags)
         return 0;
 
     do {
-        if (af_fmt_is_planar(ao->format)) {
+        if (p->cfg_mmap) {
+            res = write_mmap(ao, data, samples);
+        } else if (af_fmt_is_planar(ao->format)) {
             res = snd_pcm_writen(p->alsa, data, samples);
         } else {
             res = snd_pcm_writei(p->alsa, data[0], samples);
@@ -1158,6 +1285,10 @@ const struct ao_driver audio_out_alsa = {
         OPT_INTRANGE("mixer-index", cfg_mixer_index, 0, 0, 99),
         OPT_FLAG("non-interleaved", cfg_ni, 0),
         OPT_FLAG("ignore-chmap", cfg_ignore_chmap, 0),
+        OPT_FLAG("mmap", cfg_mmap, 0),
+        OPT_INTRANGE("buffer-time", cfg_buffer_time, 0, 0, 10000000),
+        OPT_INTRANGE("periods", cfg_periods, 0, 0, 1024),
+        OPT_FLAG("realtime", cfg_realtime, 0),
         {0}
     },
 };
@@ -34,6 +34,7 @@
 #include "internal.h"
 #include "audio/format.h"
 #include "osdep/timer.h"
+#include "osdep/atomics.h"
 #include "options/m_option.h"
 
 #include <jack/jack.h>
@@ -52,6 +53,8 @@ struct priv {
     jack_port_t *ports[MP_NUM_CHANNELS];
 
     int activated;
+
+    atomic_llong xruns;
 };
 
 static int process(jack_nframes_t nframes, void *arg)
@@ -72,6 +75,28 @@ static int process(jack_nframes_t nframes, void *arg)
     return 0;
 }
 
+static int xrun(void *arg)
+{
+    struct ao *ao = arg;
+    struct priv *p = ao->priv;
+
+    atomic_fetch_add(&p->xruns, 1);
+
+    return 0;
+}
+
+static int control(struct ao *ao, enum aocontrol cmd, void *arg)
+{
+    struct priv *p = ao->priv;
+
+    switch (cmd) {
+    case AOCONTROL_GET_XRUNS:
+        *(int64_t *)arg = atomic_load(&p->xruns);
+        return CONTROL_OK;
+    }
+    return CONTROL_UNKNOWN;
+}
+
 static int
 connect_to_outports(struct ao *ao)
 {
@@ -183,6 +208,7 @@ static int init(struct ao *ao)
         goto err_create_ports;
 
     jack_set_process_callback(p->client, process, ao);
+    jack_set_xrun_callback(p->client, xrun, ao);
 
     ao->samplerate = jack_get_sample_rate(p->client);
 
@@ -220,6 +246,7 @@ const struct ao_driver audio_out_jack = {
     .name        = "jack",
     .init      = init,
     .uninit    = uninit,
+    .control   = control,
     .resume    = resume,
     .priv_size = sizeof(struct priv),
     .priv_defaults = &(const struct priv) {
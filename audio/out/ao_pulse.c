@@ -30,8 +30,10 @@
 
 #include "config.h"
 #include "audio/format.h"
+#include "common/common.h"
 #include "common/msg.h"
 #include "options/m_option.h"
+#include "osdep/timer.h"
 #include "ao.h"
 #include "internal.h"
 
@@ -62,6 +64,11 @@ struct priv {
     char *cfg_sink;
     int cfg_buffer;
     int cfg_latency_hacks;
+
+    // Set for pulse_callback: the stream's write callback fills the buffer
+    // via ao_read_data() (pull.c), instead of the push.c thread.
+    int use_callback;
+    bool corked;
 };
 
 #define GENERIC_ERR_MSG(str) \
@@ -128,10 +135,53 @@ static void wakeup(struct ao *ao)
     pthread_mutex_unlock(&priv->wakeup_lock);
 }
 
+// Called on the mainloop thread, with the mainloop locked.
+static void fill_callback(struct ao *ao, pa_stream *s, size_t length)
+{
+    struct priv *priv = ao->priv;
+    while (length >= ao->sstride) {
+        void *buf = NULL;
+        size_t size = length;
+        // Write directly into the server's memory block (no extra copy).
+        if (pa_stream_begin_write(s, &buf, &size) < 0 || !buf)
+            return;
+        int samples = MPMIN(size, length) / ao->sstride;
+        if (samples <= 0) {
+            pa_stream_cancel_write(s);
+            return;
+        }
+
+        pa_usec_t latency = 0;
+        int negative = 0;
+        if (pa_stream_get_latency(s, &latency, &negative) < 0 || negative)
+            latency = 0;
+        int64_t end = mp_time_us() + latency +
+                      samples * (int64_t)1000000 / ao->samplerate;
+
+        // While corked, pulse still asks to fill the buffer. Don't prefill it
+        // with silence, which would delay the start of playback. During
+        // playback, underruns are filled with silence, so that the server
+        // keeps requesting data.
+        if (ao_read_data(ao, &buf, samples, end) == 0 && priv->corked) {
+            pa_stream_cancel_write(s);
+            return;
+        }
+
+        if (pa_stream_write(s, buf, samples * ao->sstride, NULL, 0,
+                            PA_SEEK_RELATIVE) < 0)
+            return;
+        length -= samples * ao->sstride;
+    }
+}
+
 static void stream_request_cb(pa_stream *s, size_t length, void *userdata)
 {
     struct ao *ao = userdata;
     struct priv *priv = ao->priv;
+    if (priv->use_callback) {
+        fill_callback(ao, s, length);
+        return;
+    }
     wakeup(ao);
     pa_threaded_mainloop_signal(priv->mainloop, 0);
 }
@@ -451,6 +501,7 @@ static int init(struct ao *ao)
     pa_proplist_free(proplist);
     proplist = NULL;
 
+    priv->corked = priv->use_callback;
     pa_stream_set_state_callback(priv->stream, stream_state_cb, ao);
     pa_stream_set_write_callback(priv->stream, stream_request_cb, ao);
     pa_stream_set_latency_update_callback(priv->stream,
@@ -466,8 +517,11 @@ static int init(struct ao *ao)
     };
 
     int flags = PA_STREAM_NOT_MONOTONIC;
-    if (!priv->cfg_latency_hacks)
+    if (!priv->cfg_latency_hacks || priv->use_callback)
         flags |= PA_STREAM_INTERPOLATE_TIMING|PA_STREAM_AUTO_TIMING_UPDATE;
+    // pull.c calls resume() when the first audio is queued.
+    if (priv->use_callback)
+        flags |= PA_STREAM_START_CORKED;
 
     if (pa_stream_connect_playback(priv->stream, sink, &bufattr,
                                    flags, NULL, NULL) < 0)
@@ -509,6 +563,7 @@ static void cork(struct ao *ao, bool pause)
     struct priv *priv = ao->priv;
     pa_threaded_mainloop_lock(priv->mainloop);
     priv->retval = 0;
+    priv->corked = pause;
     if (!waitop(priv, pa_stream_cork(priv->stream, pause, success_cb, ao)) ||
         !priv->retval)
         GENERIC_ERR_MSG("pa_stream_cork() failed");
@@ -559,6 +614,30 @@ static void resume(struct ao *ao)
     cork(ao, false);
 }
 
+// pulse_callback: start playback. The server won't request the data it
+// requested while corked again, so write it here.
+static void resume_callback(struct ao *ao)
+{
+    cork(ao, false);
+    struct priv *priv = ao->priv;
+    pa_threaded_mainloop_lock(priv->mainloop);
+    fill_callback(ao, priv->stream, pa_stream_writable_size(priv->stream));
+    pa_threaded_mainloop_unlock(priv->mainloop);
+}
+
+// pulse_callback: stop the write callbacks and drop the server's buffer. The
+// stream stays corked until resume() is called.
+static void reset_callback(struct ao *ao)
+{
+    cork(ao, true);
+    struct priv *priv = ao->priv;
+    pa_threaded_mainloop_lock(priv->mainloop);
+    priv->retval = 0;
+    if (!waitop(priv, pa_stream_flush(priv->stream, success_cb, ao)) ||
+        !priv->retval)
+        GENERIC_ERR_MSG("pa_stream_flush() failed");
+}
+
 // Return number of samples that may be written to the server without blocking
 static int get_space(struct ao *ao)
 {
@@ -842,3 +921,29 @@ const struct ao_driver audio_out_pulse = {
         {0}
     },
 };
+
+// Same as "pulse", but driven by PulseAudio's write callback through pull.c.
+// This avoids waking up a separate audio thread for every refill.
+const struct ao_driver audio_out_pulse_callback = {
+    .description = "PulseAudio audio output (callback based)",
+    .name      = "pulse_callback",
+    .control   = control,
+    .init      = init,
+    .uninit    = uninit,
+    .reset     = reset_callback,
+    .resume    = resume_callback,
+    .hotplug_init = hotplug_init,
+    .hotplug_uninit = hotplug_uninit,
+    .list_devs = list_devs,
+    .priv_size = sizeof(struct priv),
+    .priv_defaults = &(const struct priv) {
+        .cfg_buffer = 250,
+        .use_callback = 1,
+    },
+    .options = (const struct m_option[]) {
+        OPT_STRING("host", cfg_host, 0),
+        OPT_STRING("sink", cfg_sink, 0),
+        OPT_CHOICE_OR_INT("buffer", cfg_buffer, 0, 1, 2000, ({"native", 0})),
+        {0}
+    },
+};
@@ -45,6 +45,8 @@ struct ao {
     struct mp_log *log; // Using e.g. "[ao/coreaudio]" as prefix
     int init_flags; // AO_INIT_* flags
     bool stream_silence;        // if audio inactive, just play silence
+    bool realtime_thread;       // set by the driver on init: run the push.c
+                                // playthread with realtime priority
 
     // The device as selected by the user, usually using ao_device_desc.name
     // from an entry from the list returned by driver->list_devices. If the
@@ -71,6 +73,16 @@ struct ao {
 extern const struct ao_driver ao_api_push;
 extern const struct ao_driver ao_api_pull;
 
+void ao_init_buffer_params(struct ao *ao);
+
+// Argument for AOCONTROL_REINIT_FORMAT, as passed to the API (push.c), which
+// sets the ao fields and buffers before and after calling the driver.
+struct ao_reinit_format {
+    int samplerate;
+    int format;
+    struct mp_chmap channels;
+};
+
 
 /* Note:
  *
@@ -145,6 +157,8 @@ struct ao_driver {
     void (*drain)(struct ao *ao);
     // Optional. Return true if audio has stopped in any way.
     bool (*get_eof)(struct ao *ao);
+    // Optional. Implemented by push.c/pull.c only; see ao_get_stats().
+    void (*get_stats)(struct ao *ao, struct ao_stats *stats);
     // Wait until the audio buffer needs to be refilled. The lock is the
     // internal mutex usually protecting the internal AO state (and used to
     // protect driver calls), and must be temporarily unlocked while waiting.
@@ -57,6 +57,22 @@ struct ao_pull_state {
 
     // Device delay of the last written sample, in realtime.
     atomic_llong end_time_us;
+
+    // Set while drain() waits for the buffer to run empty.
+    atomic_bool draining;
+
+    // Set by the audio callback when it requested more data, cleared when the
+    // writer looks at the buffer again. Avoids a wakeup syscall on every
+    // callback with small device periods.
+    atomic_bool wakeup_pending;
+
+    // Statistics (see ao_get_stats()). Written by the audio callback only.
+    bool in_underrun;
+    int64_t last_callback_us;
+    atomic_llong underruns;
+    atomic_llong last_underrun_us;
+    atomic_llong callback_interval_us;
+    atomic_llong callback_jitter_us; // moving average
 };
 
 static void set_state(struct ao *ao, int new_state)
@@ -77,6 +93,7 @@ static void set_state(struct ao *ao, int new_state)
 static int get_space(struct ao *ao)
 {
     struct ao_pull_state *p = ao->api_priv;
+    atomic_store(&p->wakeup_pending, false);
     // Since the reader will read the last plane last, its free space is the
     // minimum free space across all planes.
     return mp_ring_available(p->buffers[ao->num_planes - 1]) / ao->sstride;
@@ -115,6 +132,8 @@ static int play(struct ao *ao, void **data, int samples, int flags)
 // If this is called in paused mode, it will always return 0.
 // The caller should set out_time_us to the expected delay until the last sample
 // reaches the speakers, in microseconds, using mp_time_us() as reference.
+// This is called from realtime audio threads, so it must never block: it uses
+// atomics only, and doesn't allocate memory or lock mutexes.
 int ao_read_data(struct ao *ao, void **data, int samples, int64_t out_time_us)
 {
     assert(ao->api == &ao_api_pull);
@@ -123,11 +142,26 @@ int ao_read_data(struct ao *ao, void **data, int samples, int64_t out_time_us)
     int full_bytes = samples * ao->sstride;
     bool need_wakeup = false;
     int bytes = 0;
+    int64_t now = mp_time_us();
 
     // Play silence in states other than AO_STATE_PLAY.
     if (!atomic_compare_exchange_strong(&p->state, &(int){AO_STATE_PLAY},
                                         AO_STATE_BUSY))
+    {
+        p->last_callback_us = 0; // don't count pauses as callback jitter
         goto end;
+    }
+
+    if (p->last_callback_us) {
+        int64_t interval = now - p->last_callback_us;
+        int64_t expected = samples * 1000000LL / ao->samplerate;
+        int64_t dev = interval > expected ? interval - expected
+                                          : expected - interval;
+        int64_t jitter = atomic_load(&p->callback_jitter_us);
+        atomic_store(&p->callback_interval_us, interval);
+        atomic_store(&p->callback_jitter_us, (jitter * 15 + dev) / 16);
+    }
+    p->last_callback_us = now;
 
     // Since the writer will write the first plane last, its buffered amount
     // of data is the minimum amount across all planes.
@@ -145,12 +179,20 @@ int ao_read_data(struct ao *ao, void **data, int samples, int64_t out_time_us)
     // Half of the buffer played -> request more.
     need_wakeup = buffered_bytes - bytes <= mp_ring_size(p->buffers[0]) / 2;
 
+    bool underrun = bytes < full_bytes && !atomic_load(&p->draining);
+    if (underrun && !p->in_underrun) {
+        atomic_fetch_add(&p->underruns, 1);
+        atomic_store(&p->last_underrun_us, now);
+    }
+    p->in_underrun = underrun;
+
     // Should never fail.
     atomic_compare_exchange_strong(&p->state, &(int){AO_STATE_BUSY}, AO_STATE_PLAY);
 
 end:
 
-    if (need_wakeup)
+    if (need_wakeup && atomic_compare_exchange_strong(&p->wakeup_pending,
+                                                      &(bool){false}, true))
         mp_input_wakeup_nolock(ao->input_ctx);
 
     // pad with silence (underflow/paused/eof)
@@ -182,6 +224,20 @@ static double get_delay(struct ao *ao)
     return mp_ring_buffered(p->buffers[0]) / (double)ao->bps + driver_delay;
 }
 
+static void get_stats(struct ao *ao, struct ao_stats *stats)
+{
+    struct ao_pull_state *p = ao->api_priv;
+
+    int64_t end = atomic_load(&p->end_time_us);
+    int64_t last_underrun = atomic_load(&p->last_underrun_us);
+    stats->buffered = mp_ring_buffered(p->buffers[0]) / (double)ao->bps;
+    stats->device_delay = MPMAX(0, (end - mp_time_us()) / 1e6);
+    stats->underruns = atomic_load(&p->underruns);
+    stats->last_underrun = last_underrun ? last_underrun / 1e6 : 0;
+    stats->callback_interval = atomic_load(&p->callback_interval_us) / 1e6;
+    stats->callback_jitter = atomic_load(&p->callback_jitter_us) / 1e6;
+}
+
 static void reset(struct ao *ao)
 {
     struct ao_pull_state *p = ao->api_priv;
@@ -191,6 +247,7 @@ static void reset(struct ao *ao)
     for (int n = 0; n < ao->num_planes; n++)
         mp_ring_reset(p->buffers[n]);
     atomic_store(&p->end_time_us, 0);
+    atomic_store(&p->wakeup_pending, false);
 }
 
 static void pause(struct ao *ao)
@@ -219,6 +276,7 @@ static void drain(struct ao *ao)
     struct ao_pull_state *p = ao->api_priv;
     int state = atomic_load(&p->state);
     if (IS_PLAYING(state)) {
+        atomic_store(&p->draining, true);
         // Wait for lower bound.
         mp_sleep_us(mp_ring_buffered(p->buffers[0]) / (double)ao->bps * 1e6);
         // And then poll for actual end. (Unfortunately, this code considers
@@ -230,6 +288,7 @@ static void drain(struct ao *ao)
             mp_sleep_us(1);
     }
     reset(ao);
+    atomic_store(&p->draining, false);
 }
 
 static void uninit(struct ao *ao)
@@ -263,5 +322,6 @@ const struct ao_driver ao_api_pull = {
     .get_eof = get_eof,
     .pause = pause,
     .resume = resume,
+    .get_stats = get_stats,
     .priv_size = sizeof(struct ao_pull_state),
 };
@@ -59,6 +59,14 @@ struct ao_push_state {
     bool final_chunk;
     double expected_end_time;
 
+    // Statistics (see ao_get_stats())
+    bool device_started;    // data was written since the last reset/pause
+    bool in_underrun;
+    int64_t underruns;
+    double last_underrun;
+    int64_t wakeup_request;  // mp_time_us() of the pending wakeup, or 0
+    int64_t wakeup_latency, wakeup_latency_max;
+
     int wakeup_pipe[2];
 };
 
@@ -69,16 +77,56 @@ static void wakeup_playthread(struct ao *ao)
     if (ao->driver->wakeup)
         ao->driver->wakeup(ao);
     p->need_wakeup = true;
+    if (!p->wakeup_request)
+        p->wakeup_request = mp_time_us();
     pthread_cond_signal(&p->wakeup);
 }
 
+// lock must be held
+static int reinit_format(struct ao *ao, struct ao_reinit_format *fmt)
+{
+    struct ao_push_state *p = ao->api_priv;
+
+    if (ao->driver->reset)
+        ao->driver->reset(ao);
+    mp_audio_buffer_clear(p->buffer);
+    p->paused = false;
+    p->final_chunk = false;
+    p->device_started = false;
+    p->in_underrun = false;
+    p->still_playing = false;
+
+    ao->samplerate = fmt->samplerate;
+    ao->format = fmt->format;
+    ao->channels = fmt->channels;
+    ao->device_buffer = 0;
+
+    int r = ao->driver->control(ao, AOCONTROL_REINIT_FORMAT, NULL);
+    if (r != CONTROL_OK)
+        return r;
+
+    ao_init_buffer_params(ao);
+    if (ao->device_buffer <= 0) {
+        MP_ERR(ao, "Couldn't probe device buffer size.\n");
+        return CONTROL_ERROR;
+    }
+    mp_audio_buffer_reinit_fmt(p->buffer, ao->format,
+                               &ao->channels, ao->samplerate);
+    mp_audio_buffer_preallocate_min(p->buffer, ao->buffer);
+    return CONTROL_OK;
+}
+
 static int control(struct ao *ao, enum aocontrol cmd, void *arg)
 {
     int r = CONTROL_UNKNOWN;
     if (ao->driver->control) {
         struct ao_push_state *p = ao->api_priv;
         pthread_mutex_lock(&p->lock);
-        r = ao->driver->control(ao, cmd, arg);
+        if (cmd == AOCONTROL_REINIT_FORMAT) {
+            r = reinit_format(ao, arg);
+        } else {
+            r = ao->driver->control(ao, cmd, arg);
+        }
         pthread_mutex_unlock(&p->lock);
     }
     return r;
@@ -102,6 +150,19 @@ static double get_delay(struct ao *ao)
     return delay;
 }
 
+static void get_stats(struct ao *ao, struct ao_stats *stats)
+{
+    struct ao_push_state *p = ao->api_priv;
+    pthread_mutex_lock(&p->lock);
+    stats->buffered = mp_audio_buffer_seconds(p->buffer);
+    stats->device_delay = ao->driver->get_delay ? ao->driver->get_delay(ao) : 0;
+    stats->underruns = p->underruns;
+    stats->last_underrun = p->last_underrun;
+    stats->wakeup_latency = p->wakeup_latency / 1e6;
+    stats->wakeup_latency_max = p->wakeup_latency_max / 1e6;
+    pthread_mutex_unlock(&p->lock);
+}
+
 static void reset(struct ao *ao)
 {
     struct ao_push_state *p = ao->api_priv;
@@ -110,6 +171,7 @@ static void reset(struct ao *ao)
         ao->driver->reset(ao);
     mp_audio_buffer_clear(p->buffer);
     p->paused = false;
+    p->device_started = false;
     if (p->still_playing)
         wakeup_playthread(ao);
     p->still_playing = false;
@@ -123,6 +185,7 @@ static void audio_pause(struct ao *ao)
     if (ao->driver->pause)
         ao->driver->pause(ao);
     p->paused = true;
+    p->device_started = false;
     wakeup_playthread(ao);
     pthread_mutex_unlock(&p->lock);
 }
@@ -266,6 +329,15 @@ static void ao_play_data(struct ao *ao)
     int max = data.samples;
     int space = ao->driver->get_space(ao);
     space = MPMAX(space, 0);
+    // A completely empty device buffer during playback means it ran dry.
+    bool empty = p->device_started && !p->final_chunk &&
+                 space >= ao->device_buffer;
+    if (empty && !p->in_underrun) {
+        p->underruns++;
+        p->last_underrun = mp_time_sec();
+        MP_VERBOSE(ao, "Audio device underrun detected.\n");
+    }
+    p->in_underrun = empty;
     if (data.samples > space)
         data.samples = space;
     int flags = 0;
@@ -288,8 +360,10 @@ static void ao_play_data(struct ao *ao)
         r = max;
     }
     mp_audio_buffer_skip(p->buffer, r);
-    if (r > 0)
+    if (r > 0) {
         p->expected_end_time = 0;
+        p->device_started = true;
+    }
     // Nothing written, but more input data than space - this must mean the
     // AO's get_space() doesn't do period alignment correctly.
     bool stuck = r == 0 && max >= space && space > 0;
@@ -315,6 +389,8 @@ static void *playthread(void *arg)
     struct ao *ao = arg;
     struct ao_push_state *p = ao->api_priv;
     mpthread_set_name("ao");
+    if (ao->realtime_thread && !mpthread_set_realtime())
+        MP_WARN(ao, "Could not enable realtime priority for audio thread.\n");
     pthread_mutex_lock(&p->lock);
     while (!p->terminate) {
         if (!p->paused)
@@ -372,6 +448,12 @@ static void *playthread(void *arg)
             }
             MP_STATS(ao, "end audio wait");
         }
+        if (p->wakeup_request) {
+            p->wakeup_latency = mp_time_us() - p->wakeup_request;
+            p->wakeup_latency_max = MPMAX(p->wakeup_latency_max,
+                                          p->wakeup_latency);
+            p->wakeup_request = 0;
+        }
         p->need_wakeup = false;
     }
     pthread_mutex_unlock(&p->lock);
@@ -442,6 +524,7 @@ const struct ao_driver ao_api_push = {
     .resume = resume,
     .drain = drain,
     .get_eof = get_eof,
+    .get_stats = get_stats,
     .priv_size = sizeof(struct ao_push_state),
 };
 
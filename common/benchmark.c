@@ -0,0 +1,211 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/common.h"
+#include "misc/node.h"
+#include "osdep/threads.h"
+#include "osdep/timer.h"
+
+#include "benchmark.h"
+
+struct bench_entry {
+    char *name;
+    bool is_value;      // from "value" events, instead of a time range
+    double *samples;    // in seconds (or the unit of the value)
+    int num_samples;
+    double cpu_time;    // sum of thread CPU time, in seconds
+    int num_cpu;
+};
+
+// A "start" event waiting for its "end" event.
+struct bench_open {
+    pthread_t thread;
+    struct bench_entry *entry;
+    int64_t start;
+    int64_t cpu_start;
+};
+
+struct mp_benchmark {
+    struct bench_entry **entries;
+    int num_entries;
+    struct bench_open *open;
+    int num_open;
+    int64_t first_event, last_event;
+};
+
+struct mp_benchmark *mp_benchmark_create(void *ta_parent)
+{
+    struct mp_benchmark *b = talloc_zero(ta_parent, struct mp_benchmark);
+    b->first_event = -1;
+    return b;
+}
+
+static struct bench_entry *find_entry(struct mp_benchmark *b, const char *name,
+                                      bool is_value)
+{
+    for (int n = 0; n < b->num_entries; n++) {
+        struct bench_entry *e = b->entries[n];
+        if (e->is_value == is_value && strcmp(e->name, name) == 0)
+            return e;
+    }
+    struct bench_entry *e = talloc_zero(b, struct bench_entry);
+    e->name = talloc_strdup(e, name);
+    e->is_value = is_value;
+    MP_TARRAY_APPEND(b, b->entries, b->num_entries, e);
+    return e;
+}
+
+static void add_sample(struct bench_entry *e, double v)
+{
+    MP_TARRAY_APPEND(e, e->samples, e->num_samples, v);
+}
+
+static struct bench_open *find_open(struct mp_benchmark *b,
+                                    struct bench_entry *e)
+{
+    pthread_t self = pthread_self();
+    for (int n = 0; n < b->num_open; n++) {
+        struct bench_open *o = &b->open[n];
+        if (o->entry == e && pthread_equal(o->thread, self))
+            return o;
+    }
+    return NULL;
+}
+
+static const char *skip_word(const char *text)
+{
+    const char *space = strchr(text, ' ');
+    return space ? space + 1 : NULL;
+}
+
+void mp_benchmark_event(struct mp_benchmark *b, const char *text)
+{
+    int64_t now = mp_time_us();
+    if (b->first_event < 0)
+        b->first_event = now;
+    b->last_event = now;
+
+    if (strncmp(text, "start ", 6) == 0) {
+        struct bench_entry *e = find_entry(b, text + 6, false);
+        struct bench_open *o = find_open(b, e);
+        if (!o) {
+            MP_TARRAY_GROW(b, b->open, b->num_open);
+            o = &b->open[b->num_open++];
+        }
+        *o = (struct bench_open){
+            .thread = pthread_self(),
+            .entry = e,
+            .start = now,
+            .cpu_start = mpthread_get_cpu_time_us(),
+        };
+    } else if (strncmp(text, "end ", 4) == 0) {
+        struct bench_entry *e = find_entry(b, text + 4, false);
+        struct bench_open *o = find_open(b, e);
+        if (!o)
+            return;
+        add_sample(e, (now - o->start) / 1e6);
+        int64_t cpu_end = mpthread_get_cpu_time_us();
+        if (o->cpu_start >= 0 && cpu_end >= 0) {
+            e->cpu_time += (cpu_end - o->cpu_start) / 1e6;
+            e->num_cpu++;
+        }
+        MP_TARRAY_REMOVE_AT(b->open, b->num_open, o - b->open);
+    } else if (strncmp(text, "value ", 6) == 0) {
+        double v;
+        const char *name = skip_word(text + 6);
+        if (name && sscanf(text + 6, "%lf", &v) == 1)
+            add_sample(find_entry(b, name, true), v);
+    } else if (strncmp(text, "range-timed ", 12) == 0) {
+        int64_t t1, t2;
+        const char *name = skip_word(text + 12);
+        name = name ? skip_word(name) : NULL;
+        if (name && sscanf(text + 12, "%"SCNd64" %"SCNd64, &t1, &t2) == 2)
+            add_sample(find_entry(b, name, false), MPMAX(t2 - t1, 0) / 1e6);
+    }
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double va = *(const double *)a, vb = *(const double *)b;
+    return va < vb ? -1 : (va > vb ? 1 : 0);
+}
+
+// Nearest-rank percentile of sorted samples.
+static double percentile(double *sorted, int num, double p)
+{
+    int idx = (int)ceil(p / 100.0 * num) - 1;
+    return sorted[MPCLAMP(idx, 0, num - 1)];
+}
+
+static void add_double(struct mpv_node *dst, const char *key, double v)
+{
+    node_map_add(dst, key, MPV_FORMAT_DOUBLE)->u.double_ = v;
+}
+
+static void add_entry_stats(struct mpv_node *dst, struct bench_entry *e)
+{
+    double *sorted = talloc_memdup(NULL, e->samples,
+                                   e->num_samples * sizeof(e->samples[0]));
+    qsort(sorted, e->num_samples, sizeof(sorted[0]), cmp_double);
+    double total = 0;
+    for (int n = 0; n < e->num_samples; n++)
+        total += sorted[n];
+
+    node_map_add(dst, "count", MPV_FORMAT_INT64)->u.int64 = e->num_samples;
+    add_double(dst, "total", total);
+    add_double(dst, "avg", total / e->num_samples);
+    add_double(dst, "min", sorted[0]);
+    add_double(dst, "p50", percentile(sorted, e->num_samples, 50));
+    add_double(dst, "p90", percentile(sorted, e->num_samples, 90));
+    add_double(dst, "p99", percentile(sorted, e->num_samples, 99));
+    add_double(dst, "max", sorted[e->num_samples - 1]);
+    if (e->num_cpu) {
+        add_double(dst, "cpu-total", e->cpu_time);
+        add_double(dst, "cpu-avg", e->cpu_time / e->num_cpu);
+    }
+
+    talloc_free(sorted);
+}
+
+void mp_benchmark_get_report(struct mp_benchmark *b, const char *frame_event,
+                             struct mpv_node *dst)
+{
+    node_init(dst, MPV_FORMAT_NODE_MAP, NULL);
+
+    double wall = b->first_event < 0 ? 0 : (b->last_event - b->first_event) / 1e6;
+    int frames = find_entry(b, frame_event, false)->num_samples;
+    add_double(dst, "wall-time", wall);
+    node_map_add(dst, "frames", MPV_FORMAT_INT64)->u.int64 = frames;
+    add_double(dst, "fps", wall > 0 ? frames / wall : 0);
+
+    struct mpv_node *stages = node_map_add(dst, "stages", MPV_FORMAT_NODE_MAP);
+    struct mpv_node *values = node_map_add(dst, "values", MPV_FORMAT_NODE_MAP);
+    for (int n = 0; n < b->num_entries; n++) {
+        struct bench_entry *e = b->entries[n];
+        if (!e->num_samples)
+            continue;
+        struct mpv_node *list = e->is_value ? values : stages;
+        add_entry_stats(node_map_add(list, e->name, MPV_FORMAT_NODE_MAP), e);
+    }
+}
@@ -0,0 +1,44 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_BENCHMARK_H_
+#define MP_BENCHMARK_H_
+
+struct mpv_node;
+
+// Values for --benchmark-stage. Each stage includes the ones before it.
+enum mp_benchmark_stage {
+    MP_BENCHMARK_DEMUX,         // read packets, don't decode them
+    MP_BENCHMARK_DECODE,        // decode, no filters, vo_null
+    MP_BENCHMARK_FILTER,        // decode and filter, vo_null
+    MP_BENCHMARK_RENDER,        // render with the real VO, but never flip
+    MP_BENCHMARK_PRESENT,       // full pipeline
+};
+
+// Aggregates MP_STATS() events (see TOOLS/stats-conv.py for the format) into
+// per-event timing statistics. Not thread-safe; msg.c serializes the calls.
+struct mp_benchmark;
+
+struct mp_benchmark *mp_benchmark_create(void *ta_parent);
+void mp_benchmark_event(struct mp_benchmark *b, const char *text);
+
+// Write the statistics as MPV_FORMAT_NODE_MAP to dst. All times are in
+// seconds. frame_event names the timed event counted as "frames" (for "fps").
+void mp_benchmark_get_report(struct mp_benchmark *b, const char *frame_event,
+                             struct mpv_node *dst);
+
+#endif
@@ -29,6 +29,8 @@ struct encode_opts {
     int video_first;
     int audio_first;
     int metadata;
+    int threads;
+    int muxthread;
 };
 
 // interface for mplayer.c
@@ -32,6 +32,12 @@
 #include "video/out/vo.h"
 #include "mpv_talloc.h"
 #include "stream/stream.h"
+#include "osdep/threads.h"
+
+// Maximum number of packets queued for the mux thread. Writing a packet
+// blocks if the queue is full, which limits memory usage if the output is
+// slower than the encoders.
+#define MUX_QUEUE_SIZE 64
 
 #define OPT_BASE_STRUCT struct encode_opts
 const struct m_sub_options encode_config = {
@@ -55,11 +61,15 @@ const struct m_sub_options encode_config = {
         OPT_FLAG("ovfirst", video_first, CONF_GLOBAL),
         OPT_FLAG("oafirst", audio_first, CONF_GLOBAL),
         OPT_FLAG("ometadata", metadata, CONF_GLOBAL),
+        OPT_CHOICE_OR_INT("othreads", threads, CONF_GLOBAL, 1, 64,
+                          ({"default", -1}, {"auto", 0})),
+        OPT_FLAG("omuxthread", muxthread, CONF_GLOBAL),
         {0}
     },
     .size = sizeof(struct encode_opts),
     .defaults = &(const struct encode_opts){
         .metadata = 1,
+        .threads = -1,
     },
 };
 
@@ -174,6 +184,8 @@ struct encode_lavc_context *encode_lavc_init(struct encode_opts *options,
 
     ctx = talloc_zero(NULL, struct encode_lavc_context);
     pthread_mutex_init(&ctx->lock, NULL);
+    pthread_mutex_init(&ctx->mux_lock, NULL);
+    pthread_cond_init(&ctx->mux_wakeup, NULL);
     ctx->log = mp_log_new(ctx, global->log, "encode-lavc");
     ctx->global = global;
     encode_lavc_discontinuity(ctx);
@@ -281,6 +293,85 @@ void encode_lavc_set_metadata(struct encode_lavc_context *ctx,
         ctx->metadata = metadata;
 }
 
+static void *mux_thread(void *p)
+{
+    struct encode_lavc_context *ctx = p;
+    mpthread_set_name("encode-mux");
+
+    pthread_mutex_lock(&ctx->mux_lock);
+    while (1) {
+        if (ctx->num_mux_queue) {
+            AVPacket *packet = ctx->mux_queue[0];
+            MP_TARRAY_REMOVE_AT(ctx->mux_queue, ctx->num_mux_queue, 0);
+            pthread_cond_broadcast(&ctx->mux_wakeup);
+            pthread_mutex_unlock(&ctx->mux_lock);
+
+            int r = av_interleaved_write_frame(ctx->avc, packet);
+            av_packet_unref(packet);
+            av_free(packet);
+            int64_t written = ctx->avc->pb ? avio_size(ctx->avc->pb) : 0;
+
+            pthread_mutex_lock(&ctx->mux_lock);
+            if (r < 0)
+                ctx->mux_error = r;
+            ctx->mux_written = written;
+            continue;
+        }
+        if (ctx->mux_terminate)
+            break;
+        pthread_cond_wait(&ctx->mux_wakeup, &ctx->mux_lock);
+    }
+    pthread_mutex_unlock(&ctx->mux_lock);
+    return NULL;
+}
+
+// Wait until all queued packets are written, and stop the mux thread.
+static void stop_mux_thread(struct encode_lavc_context *ctx)
+{
+    if (!ctx->mux_thread_running)
+        return;
+
+    pthread_mutex_lock(&ctx->mux_lock);
+    ctx->mux_terminate = true;
+    pthread_cond_broadcast(&ctx->mux_wakeup);
+    pthread_mutex_unlock(&ctx->mux_lock);
+
+    pthread_join(ctx->mux_thread, NULL);
+    ctx->mux_thread_running = false;
+
+    if (ctx->mux_error < 0)
+        MP_ERR(ctx, "error writing packets: %s\n", av_err2str(ctx->mux_error));
+}
+
+static int queue_packet(struct encode_lavc_context *ctx, AVPacket *packet)
+{
+    AVPacket *copy = av_malloc(sizeof(*copy));
+    if (!copy)
+        return AVERROR(ENOMEM);
+    av_init_packet(copy);
+    int r = av_packet_ref(copy, packet);
+    if (r < 0) {
+        av_free(copy);
+        return r;
+    }
+
+    pthread_mutex_lock(&ctx->mux_lock);
+    while (ctx->num_mux_queue >= MUX_QUEUE_SIZE && !ctx->mux_error)
+        pthread_cond_wait(&ctx->mux_wakeup, &ctx->mux_lock);
+    r = ctx->mux_error;
+    if (r >= 0) {
+        MP_TARRAY_APPEND(ctx, ctx->mux_queue, ctx->num_mux_queue, copy);
+        pthread_cond_broadcast(&ctx->mux_wakeup);
+    }
+    pthread_mutex_unlock(&ctx->mux_lock);
+
+    if (r < 0) {
+        av_packet_unref(copy);
+        av_free(copy);
+    }
+    return r;
+}
+
 int encode_lavc_start(struct encode_lavc_context *ctx)
 {
     AVDictionaryEntry *de;
@@ -292,6 +383,11 @@ int encode_lavc_start(struct encode_lavc_context *ctx)
 
     CHECK_FAIL(ctx, 0);
 
+    // A video encoder which takes hardware frames is opened only with the
+    // first frame (see vo_lavc.c), and must be open before the header.
+    if (ctx->vcc && !avcodec_is_open(ctx->vcc))
+        return 0;
+
     if (ctx->expect_video && ctx->vcc == NULL) {
         if (ctx->avc->oformat->video_codec != AV_CODEC_ID_NONE ||
             ctx->options->vcodec) {
@@ -346,6 +442,15 @@ int encode_lavc_start(struct encode_lavc_context *ctx)
     av_dict_free(&ctx->foptions);
 
     ctx->header_written = 1;
+
+    if (ctx->options->muxthread) {
+        if (pthread_create(&ctx->mux_thread, NULL, mux_thread, ctx)) {
+            MP_WARN(ctx, "could not create mux thread, muxing directly\n");
+        } else {
+            ctx->mux_thread_running = true;
+        }
+    }
+
     return 1;
 }
 
@@ -358,6 +463,8 @@ void encode_lavc_free(struct encode_lavc_context *ctx)
         encode_lavc_fail(ctx,
                          "called encode_lavc_free without encode_lavc_finish\n");
 
+    pthread_cond_destroy(&ctx->mux_wakeup);
+    pthread_mutex_destroy(&ctx->mux_lock);
     pthread_mutex_destroy(&ctx->lock);
     talloc_free(ctx);
 }
@@ -372,6 +479,8 @@ void encode_lavc_finish(struct encode_lavc_context *ctx)
     if (ctx->finished)
         return;
 
+    stop_mux_thread(ctx);
+
     if (ctx->avc) {
         if (ctx->header_written > 0)
             av_write_trailer(ctx->avc);  // this is allowed to fail
@@ -605,6 +714,8 @@ int encode_lavc_alloc_stream(struct encode_lavc_context *ctx,
         // Using codec->time_base is deprecated, but needed for older lavf.
         ctx->vst->time_base = ctx->timebase;
         ctx->vcc->time_base = ctx->timebase;
+        if (ctx->options->threads >= 0)
+            ctx->vcc->thread_count = ctx->options->threads;
 
         ctx->voptions = NULL;
 
@@ -645,6 +756,8 @@ int encode_lavc_alloc_stream(struct encode_lavc_context *ctx,
         // Using codec->time_base is deprecated, but needed for older lavf.
         ctx->ast->time_base = ctx->timebase;
         ctx->acc->time_base = ctx->timebase;
+        if (ctx->options->threads >= 0)
+            ctx->acc->thread_count = ctx->options->threads;
 
         ctx->aoptions = 0;
 
@@ -845,7 +958,11 @@ int encode_lavc_write_frame(struct encode_lavc_context *ctx, AVStream *stream,
             break;
     }
 
-    r = av_interleaved_write_frame(ctx->avc, packet);
+    if (ctx->mux_thread_running) {
+        r = queue_packet(ctx, packet);
+    } else {
+        r = av_interleaved_write_frame(ctx->avc, packet);
+    }
 
     return r;
 }
@@ -1120,7 +1237,14 @@ int encode_lavc_getstatus(struct encode_lavc_context *ctx,
     CHECK_FAIL_UNLOCK(ctx, -1);
 
     minutes = (now - ctx->t0) / 60.0 * (1 - f) / f;
-    megabytes = ctx->avc->pb ? (avio_size(ctx->avc->pb) / 1048576.0 / f) : 0;
+    if (ctx->mux_thread_running) {
+        // The AVIOContext is owned by the mux thread.
+        pthread_mutex_lock(&ctx->mux_lock);
+        megabytes = ctx->mux_written / 1048576.0 / f;
+        pthread_mutex_unlock(&ctx->mux_lock);
+    } else {
+        megabytes = ctx->avc->pb ? (avio_size(ctx->avc->pb) / 1048576.0 / f) : 0;
+    }
     fps = ctx->frames / (now - ctx->t0);
     x = ctx->audioseconds / (now - ctx->t0);
     if (ctx->frames)
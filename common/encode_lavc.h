@@ -91,6 +91,19 @@ struct encode_lavc_context {
     // has encoding failed?
     bool failed;
     bool finished;
+
+    // --omuxthread: packets are queued by encode_lavc_write_frame() and
+    // written by a separate thread, so that muxing and file I/O don't stall
+    // the encoders. All fields below are protected by mux_lock.
+    pthread_mutex_t mux_lock;
+    pthread_cond_t mux_wakeup;
+    pthread_t mux_thread;
+    bool mux_thread_running;
+    bool mux_terminate;
+    AVPacket **mux_queue;
+    int num_mux_queue;
+    int mux_error;          // last error returned by the muxer, or 0
+    int64_t mux_written;    // output file size after the last packet
 };
 
 // interface for vo/ao drivers
@@ -8,6 +8,7 @@ struct mpv_global {
     struct MPOpts *opts;
     struct mp_log *log;
     struct mp_client_api *client_api;
+    struct mp_memgov *memgov;
 };
 
 #endif
@@ -0,0 +1,182 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include "common/common.h"
+#include "mpv_talloc.h"
+
+#include "memgov.h"
+
+struct mp_memgov {
+    pthread_mutex_t lock;
+    int64_t budget;
+    struct mp_memgov_client **clients;
+    int num_clients;
+};
+
+struct mp_memgov_client {
+    struct mp_memgov *gov;
+    char *name;
+    enum mp_memgov_class class;
+    int64_t usage;
+    int64_t wanted;
+};
+
+static void destroy_memgov(void *p)
+{
+    struct mp_memgov *gov = p;
+    pthread_mutex_destroy(&gov->lock);
+}
+
+struct mp_memgov *mp_memgov_create(void *talloc_ctx)
+{
+    struct mp_memgov *gov = talloc_zero(talloc_ctx, struct mp_memgov);
+    talloc_set_destructor(gov, destroy_memgov);
+    pthread_mutex_init(&gov->lock, NULL);
+    return gov;
+}
+
+// bytes<=0 disables the limit.
+void mp_memgov_set_budget(struct mp_memgov *gov, int64_t bytes)
+{
+    if (!gov)
+        return;
+    pthread_mutex_lock(&gov->lock);
+    gov->budget = MPMAX(bytes, 0);
+    pthread_mutex_unlock(&gov->lock);
+}
+
+// wanted is the amount of memory the client would use without a budget.
+struct mp_memgov_client *mp_memgov_register(struct mp_memgov *gov,
+                                            const char *name,
+                                            enum mp_memgov_class class,
+                                            int64_t wanted)
+{
+    if (!gov)
+        return NULL;
+    struct mp_memgov_client *c = talloc_ptrtype(NULL, c);
+    *c = (struct mp_memgov_client){
+        .gov = gov,
+        .name = talloc_strdup(c, name),
+        .class = class,
+        .wanted = wanted,
+    };
+    pthread_mutex_lock(&gov->lock);
+    MP_TARRAY_APPEND(gov, gov->clients, gov->num_clients, c);
+    pthread_mutex_unlock(&gov->lock);
+    return c;
+}
+
+void mp_memgov_unregister(struct mp_memgov_client *c)
+{
+    if (!c)
+        return;
+    struct mp_memgov *gov = c->gov;
+    pthread_mutex_lock(&gov->lock);
+    for (int n = 0; n < gov->num_clients; n++) {
+        if (gov->clients[n] == c) {
+            MP_TARRAY_REMOVE_AT(gov->clients, gov->num_clients, n);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&gov->lock);
+    talloc_free(c);
+}
+
+// wanted<0 leaves the previously set value unchanged.
+void mp_memgov_report(struct mp_memgov_client *c, int64_t usage,
+                      int64_t wanted)
+{
+    if (!c)
+        return;
+    pthread_mutex_lock(&c->gov->lock);
+    c->usage = usage;
+    if (wanted >= 0)
+        c->wanted = wanted;
+    pthread_mutex_unlock(&c->gov->lock);
+}
+
+// Pools may use whatever the other pools leave of the budget. Readahead
+// clients share what the pools leave, in proportion to what they want.
+static int64_t compute_limit(struct mp_memgov *gov, struct mp_memgov_client *c)
+{
+    if (!gov->budget)
+        return c->wanted;
+
+    int64_t pools = 0, readahead_wanted = 0;
+    for (int n = 0; n < gov->num_clients; n++) {
+        struct mp_memgov_client *o = gov->clients[n];
+        if (o->class == MP_MEMGOV_POOL) {
+            pools += o->usage;
+        } else {
+            readahead_wanted += o->wanted;
+        }
+    }
+
+    int64_t avail;
+    if (c->class == MP_MEMGOV_POOL) {
+        avail = gov->budget - (pools - c->usage);
+    } else {
+        avail = gov->budget - pools;
+        if (readahead_wanted > 0)
+            avail = avail * ((double)c->wanted / readahead_wanted);
+    }
+    return MPCLAMP(avail, 0, c->wanted);
+}
+
+// Return how many bytes the client should use at most. This can be 0; it's up
+// to the client to keep a working minimum.
+int64_t mp_memgov_get_limit(struct mp_memgov_client *c)
+{
+    if (!c)
+        return INT64_MAX;
+    pthread_mutex_lock(&c->gov->lock);
+    int64_t limit = compute_limit(c->gov, c);
+    pthread_mutex_unlock(&c->gov->lock);
+    return limit;
+}
+
+void mp_memgov_get_stats(struct mp_memgov *gov, void *talloc_ctx,
+                         struct mp_memgov_stats *st)
+{
+    *st = (struct mp_memgov_stats){0};
+    if (!gov)
+        return;
+    pthread_mutex_lock(&gov->lock);
+    st->budget = gov->budget;
+    for (int n = 0; n < gov->num_clients; n++) {
+        struct mp_memgov_client *c = gov->clients[n];
+        struct mp_memgov_entry *e = NULL;
+        for (int i = 0; i < st->num_entries; i++) {
+            if (strcmp(st->entries[i].name, c->name) == 0)
+                e = &st->entries[i];
+        }
+        if (!e) {
+            struct mp_memgov_entry new = {
+                .name = talloc_strdup(talloc_ctx, c->name),
+            };
+            MP_TARRAY_APPEND(talloc_ctx, st->entries, st->num_entries, new);
+            e = &st->entries[st->num_entries - 1];
+        }
+        e->usage += c->usage;
+        e->limit += compute_limit(gov, c);
+        st->total += c->usage;
+    }
+    pthread_mutex_unlock(&gov->lock);
+}
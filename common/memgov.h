@@ -0,0 +1,67 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_MEMGOV_H_
+#define MP_MEMGOV_H_
+
+#include <stdint.h>
+
+// Memory accounting for caches and pools, which share a global budget
+// (--memory-budget). Subsystems register a client, report how much memory
+// they use and would like to use, and query how much they may use.
+// All functions are thread-safe, and accept NULL for the governor or client
+// (in which case there is no limit).
+
+enum mp_memgov_class {
+    // Readahead buffers; shrunk first when over budget.
+    MP_MEMGOV_READAHEAD,
+    // Image pools etc.; shrunk only if they alone exceed the budget.
+    MP_MEMGOV_POOL,
+};
+
+struct mp_memgov;
+struct mp_memgov_client;
+
+struct mp_memgov *mp_memgov_create(void *talloc_ctx);
+void mp_memgov_set_budget(struct mp_memgov *gov, int64_t bytes);
+
+struct mp_memgov_client *mp_memgov_register(struct mp_memgov *gov,
+                                            const char *name,
+                                            enum mp_memgov_class class,
+                                            int64_t wanted);
+void mp_memgov_unregister(struct mp_memgov_client *c);
+void mp_memgov_report(struct mp_memgov_client *c, int64_t usage,
+                      int64_t wanted);
+int64_t mp_memgov_get_limit(struct mp_memgov_client *c);
+
+struct mp_memgov_entry {
+    char *name;         // subsystem (clients with the same name are summed)
+    int64_t usage;      // bytes currently used
+    int64_t limit;      // bytes allowed by the budget
+};
+
+struct mp_memgov_stats {
+    int64_t budget;     // 0 if unlimited
+    int64_t total;      // sum of all usage
+    struct mp_memgov_entry *entries;
+    int num_entries;
+};
+
+void mp_memgov_get_stats(struct mp_memgov *gov, void *talloc_ctx,
+                         struct mp_memgov_stats *st);
+
+#endif
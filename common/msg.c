@@ -28,6 +28,7 @@
 
 #include "misc/bstr.h"
 #include "osdep/atomics.h"
+#include "common/benchmark.h"
 #include "common/common.h"
 #include "common/global.h"
 #include "misc/ring.h"
@@ -35,6 +36,7 @@
 #include "options/options.h"
 #include "osdep/terminal.h"
 #include "osdep/io.h"
+#include "osdep/threads.h"
 #include "osdep/timer.h"
 
 #include "libmpv/client.h"
@@ -58,7 +60,21 @@ struct mp_log_root {
     struct mp_log_buffer **buffers;
     int num_buffers;
     FILE *log_file;
+    // --- protected by log_file_lock
+    // Log file lines are formatted by the caller and written by log_thread.
+    pthread_t log_thread;
+    bool log_thread_running;
+    pthread_mutex_t log_file_lock;
+    pthread_cond_t log_file_wakeup;
+    bstr log_file_queue;
+    size_t log_file_dropped;    // bytes dropped since the last write
+    bool log_file_terminate;
+    // --- protected by mp_msg_lock
     FILE *stats_file;
+    bool stats_trace;   // stats_file uses the Chrome trace event format
+    pthread_t *stats_threads; // index+1 is the trace "tid"
+    int num_stats_threads;
+    struct mp_benchmark *benchmark; // --benchmark
     // --- must be accessed atomically
     /* This is incremented every time the msglevels must be reloaded.
      * (This is perhaps better than maintaining a globally accessible and
@@ -82,6 +98,7 @@ struct mp_log_buffer {
     struct mp_log_root *root;
     struct mp_ring *ring;
     int level;
+    char **prefixes;        // if not NULL, only messages from these modules
     void (*wakeup_cb)(void *ctx);
     void *wakeup_cb_ctx;
 };
@@ -115,7 +132,7 @@ static void update_loglevel(struct mp_log *log)
         log->level = MPMAX(log->level, log->root->buffers[n]->level);
     if (log->root->log_file)
         log->level = MPMAX(log->level, MSGL_V);
-    if (log->root->stats_file)
+    if (log->root->stats_file || log->root->benchmark)
         log->level = MPMAX(log->level, MSGL_STATS);
     atomic_store(&log->reload_counter, atomic_load(&log->root->reload_counter));
     pthread_mutex_unlock(&mp_msg_lock);
@@ -197,6 +214,19 @@ bool mp_msg_has_status_line(struct mpv_global *global)
     return r;
 }
 
+// Return whether printing the same status text again would be redundant: the
+// last status line is still on the terminal, or there are no terminal control
+// codes (e.g. when writing to a pipe), and each status update is printed as a
+// new line, so an identical update never adds anything.
+bool mp_msg_status_line_is_redundant(struct mpv_global *global)
+{
+    pthread_mutex_lock(&mp_msg_lock);
+    struct mp_log_root *root = global->log->root;
+    bool r = root->status_lines > 0 || !root->termosd;
+    pthread_mutex_unlock(&mp_msg_lock);
+    return r;
+}
+
 static void set_term_color(FILE *stream, int c)
 {
     if (c == -1) {
@@ -275,6 +305,76 @@ static void print_terminal_line(struct mp_log *log, int lev,
     fflush(stream);
 }
 
+// If the writer thread falls behind by this much, drop new log file lines
+// instead of letting the queue grow without bounds.
+#define MAX_LOG_FILE_QUEUE (4 * 1024 * 1024)
+
+static void *log_file_thread(void *p)
+{
+    struct mp_log_root *root = p;
+
+    mpthread_set_name("msg/logfile");
+
+    bstr data = {0};
+    pthread_mutex_lock(&root->log_file_lock);
+    while (1) {
+        if (root->log_file_queue.len) {
+            // Swap the buffers, so callers can keep appending while the
+            // (possibly slow) file I/O runs unlocked.
+            MPSWAP(bstr, data, root->log_file_queue);
+            root->log_file_queue.len = 0;
+            size_t dropped = root->log_file_dropped;
+            root->log_file_dropped = 0;
+            pthread_mutex_unlock(&root->log_file_lock);
+
+            fwrite(data.start, data.len, 1, root->log_file);
+            if (dropped) {
+                fprintf(root->log_file, "[log file writer too slow, %zu bytes "
+                        "of messages lost]\n", dropped);
+            }
+            fflush(root->log_file);
+
+            pthread_mutex_lock(&root->log_file_lock);
+            continue;
+        }
+        if (root->log_file_terminate)
+            break;
+        pthread_cond_wait(&root->log_file_wakeup, &root->log_file_lock);
+    }
+    pthread_mutex_unlock(&root->log_file_lock);
+
+    talloc_free(data.start);
+    return NULL;
+}
+
+static void open_log_file(struct mp_log_root *root, const char *path)
+{
+    root->log_file = fopen(path, "wb");
+    if (!root->log_file)
+        return;
+    root->log_file_terminate = false;
+    root->log_thread_running =
+        !pthread_create(&root->log_thread, NULL, log_file_thread, root);
+}
+
+static void close_log_file(struct mp_log_root *root)
+{
+    if (!root->log_file)
+        return;
+    if (root->log_thread_running) {
+        pthread_mutex_lock(&root->log_file_lock);
+        root->log_file_terminate = true;
+        pthread_cond_signal(&root->log_file_wakeup);
+        pthread_mutex_unlock(&root->log_file_lock);
+        pthread_join(root->log_thread, NULL);
+        root->log_thread_running = false;
+    }
+    talloc_free(root->log_file_queue.start);
+    root->log_file_queue = (bstr){0};
+    fclose(root->log_file);
+    root->log_file = NULL;
+}
+
 static void write_log_file(struct mp_log *log, int lev, char *text)
 {
     struct mp_log_root *root = log->root;
@@ -282,10 +382,24 @@ static void write_log_file(struct mp_log *log, int lev, char *text)
     if (lev > MSGL_V || !root->log_file)
         return;
 
-    fprintf(root->log_file, "[%8.3f][%c][%s] %s",
-            (mp_time_us() - MP_START_TIME) / 1e6,
-            mp_log_levels[lev][0],
-            log->verbose_prefix, text);
+    double time = (mp_time_us() - MP_START_TIME) / 1e6;
+    char level = mp_log_levels[lev][0];
+
+    if (!root->log_thread_running) {
+        fprintf(root->log_file, "[%8.3f][%c][%s] %s",
+                time, level, log->verbose_prefix, text);
+        return;
+    }
+
+    pthread_mutex_lock(&root->log_file_lock);
+    if (root->log_file_queue.len < MAX_LOG_FILE_QUEUE) {
+        bstr_xappend_asprintf(NULL, &root->log_file_queue, "[%8.3f][%c][%s] %s",
+                              time, level, log->verbose_prefix, text);
+        pthread_cond_signal(&root->log_file_wakeup);
+    } else {
+        root->log_file_dropped += strlen(text);
+    }
+    pthread_mutex_unlock(&root->log_file_lock);
 }
 
 static void write_msg_to_buffers(struct mp_log *log, int lev, char *text)
@@ -296,38 +410,150 @@ static void write_msg_to_buffers(struct mp_log *log, int lev, char *text)
         int buffer_level = buffer->level;
         if (buffer_level == MP_LOG_BUFFER_MSGL_TERM)
             buffer_level = log->terminal_level;
-        if (lev <= buffer_level && lev != MSGL_STATUS) {
-            // Assuming a single writer (serialized by msg lock)
-            int avail = mp_ring_available(buffer->ring) / sizeof(void *);
-            if (avail < 1)
+        if (lev > buffer_level || lev == MSGL_STATUS)
+            continue;
+        if (buffer->prefixes) {
+            bool match = false;
+            for (int i = 0; buffer->prefixes[i] && !match; i++)
+                match = match_mod(log->verbose_prefix, buffer->prefixes[i]);
+            if (!match)
                 continue;
-            struct mp_log_buffer_entry *entry = talloc_ptrtype(NULL, entry);
-            if (avail > 1) {
-                *entry = (struct mp_log_buffer_entry) {
-                    .prefix = talloc_strdup(entry, log->verbose_prefix),
-                    .level = lev,
-                    .text = talloc_strdup(entry, text),
-                };
-            } else {
-                // write overflow message to signal that messages might be lost
-                *entry = (struct mp_log_buffer_entry) {
-                    .prefix = "overflow",
-                    .level = MSGL_FATAL,
-                    .text = "log message buffer overflow\n",
-                };
-            }
-            mp_ring_write(buffer->ring, (unsigned char *)&entry, sizeof(entry));
-            if (buffer->wakeup_cb)
-                buffer->wakeup_cb(buffer->wakeup_cb_ctx);
+        }
+        // Assuming a single writer (serialized by msg lock)
+        int avail = mp_ring_available(buffer->ring) / sizeof(void *);
+        if (avail < 1)
+            continue;
+        struct mp_log_buffer_entry *entry = talloc_ptrtype(NULL, entry);
+        if (avail > 1) {
+            *entry = (struct mp_log_buffer_entry) {
+                .prefix = talloc_strdup(entry, log->verbose_prefix),
+                .level = lev,
+                .text = talloc_strdup(entry, text),
+            };
+        } else {
+            // write overflow message to signal that messages might be lost
+            *entry = (struct mp_log_buffer_entry) {
+                .prefix = "overflow",
+                .level = MSGL_FATAL,
+                .text = "log message buffer overflow\n",
+            };
+        }
+        mp_ring_write(buffer->ring, (unsigned char *)&entry, sizeof(entry));
+        if (buffer->wakeup_cb)
+            buffer->wakeup_cb(buffer->wakeup_cb_ctx);
+    }
+}
+
+static void write_json_string(FILE *f, struct bstr s)
+{
+    fputc('"', f);
+    for (int n = 0; n < s.len; n++) {
+        unsigned char c = s.start[n];
+        if (c == '"' || c == '\\') {
+            fprintf(f, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(f, "\\u%04x", c);
+        } else {
+            fputc(c, f);
         }
     }
+    fputc('"', f);
+}
+
+// Map the calling thread to a trace thread ID. A thread is named after the
+// log prefix of the first stats event it writes.
+static int get_stats_thread_id(struct mp_log *log)
+{
+    struct mp_log_root *root = log->root;
+    pthread_t self = pthread_self();
+    for (int n = 0; n < root->num_stats_threads; n++) {
+        if (pthread_equal(root->stats_threads[n], self))
+            return n + 1;
+    }
+    MP_TARRAY_APPEND(root, root->stats_threads, root->num_stats_threads, self);
+    int tid = root->num_stats_threads;
+    fprintf(root->stats_file, "{\"name\":\"thread_name\",\"ph\":\"M\","
+            "\"pid\":1,\"tid\":%d,\"args\":{\"name\":", tid);
+    write_json_string(root->stats_file, bstr0(log->verbose_prefix));
+    fprintf(root->stats_file, "}},\n");
+    return tid;
+}
+
+// Write the event as Chrome trace event (also readable by Perfetto). See
+// TOOLS/stats-conv.py for the event types.
+static void dump_stats_trace(struct mp_log *log, char *text)
+{
+    FILE *f = log->root->stats_file;
+    int tid = get_stats_thread_id(log);
+
+    struct bstr s = bstr0(text);
+    int64_t ts = mp_time_us(), dur = 0;
+    double value = 0;
+    char ph = 'i';
+    if (bstr_eatstart0(&s, "start ")) {
+        ph = 'B';
+    } else if (bstr_eatstart0(&s, "end ")) {
+        ph = 'E';
+    } else if (bstr_eatstart0(&s, "value ")) {
+        ph = 'C';
+        value = bstrtod(s, &s);
+    } else if (bstr_eatstart0(&s, "event-timed ")) {
+        ts = bstrtoll(s, &s, 10);
+    } else if (bstr_eatstart0(&s, "value-timed ")) {
+        ph = 'C';
+        ts = bstrtoll(s, &s, 10);
+        value = bstrtod(s, &s);
+    } else if (bstr_eatstart0(&s, "range-timed ")) {
+        ph = 'X';
+        ts = bstrtoll(s, &s, 10);
+        dur = bstrtoll(s, &s, 10) - ts;
+    } else {
+        bstr_eatstart0(&s, "signal ");
+    }
+
+    fprintf(f, "{\"name\":");
+    write_json_string(f, bstr_strip(s));
+    fprintf(f, ",\"cat\":");
+    write_json_string(f, bstr0(log->verbose_prefix));
+    fprintf(f, ",\"ph\":\"%c\",\"ts\":%"PRId64",\"pid\":1,\"tid\":%d",
+            ph, ts, tid);
+    if (ph == 'C')
+        fprintf(f, ",\"args\":{\"value\":%f}", value);
+    if (ph == 'X')
+        fprintf(f, ",\"dur\":%"PRId64, MPMAX(dur, 0));
+    if (ph == 'i')
+        fprintf(f, ",\"s\":\"t\"");
+    fprintf(f, "},\n");
 }
 
 static void dump_stats(struct mp_log *log, int lev, char *text)
 {
     struct mp_log_root *root = log->root;
-    if (lev == MSGL_STATS && root->stats_file)
+    if (lev != MSGL_STATS)
+        return;
+    if (root->benchmark)
+        mp_benchmark_event(root->benchmark, text);
+    if (!root->stats_file)
+        return;
+    if (root->stats_trace) {
+        dump_stats_trace(log, text);
+    } else {
         fprintf(root->stats_file, "%"PRId64" %s\n", mp_time_us(), text);
+    }
+}
+
+static void close_stats_file(struct mp_log_root *root)
+{
+    if (!root->stats_file)
+        return;
+    // Terminate the JSON array (all events are followed by a ",").
+    if (root->stats_trace) {
+        fprintf(root->stats_file, "{\"name\":\"process_name\",\"ph\":\"M\","
+                "\"pid\":1,\"args\":{\"name\":\"mpv\"}}\n]\n");
+    }
+    fclose(root->stats_file);
+    root->stats_file = NULL;
+    root->num_stats_threads = 0;
 }
 
 void mp_msg_va(struct mp_log *log, int lev, const char *format, va_list va)
@@ -448,6 +674,8 @@ void mp_msg_init(struct mpv_global *global)
         .global = global,
         .reload_counter = ATOMIC_VAR_INIT(1),
     };
+    pthread_mutex_init(&root->log_file_lock, NULL);
+    pthread_cond_init(&root->log_file_wakeup, NULL);
 
     struct mp_log dummy = { .root = root };
     struct mp_log *log = mp_log_new(root, &dummy, "");
@@ -481,7 +709,7 @@ void mp_msg_update_msglevels(struct mpv_global *global)
                                  &global->opts->msg_levels);
 
     if (!root->log_file && opts->log_file && opts->log_file[0])
-        root->log_file = fopen(opts->log_file, "wb");
+        open_log_file(root, opts->log_file);
 
     atomic_fetch_add(&root->reload_counter, 1);
     pthread_mutex_unlock(&mp_msg_lock);
@@ -497,10 +725,10 @@ void mp_msg_force_stderr(struct mpv_global *global, bool force_stderr)
 void mp_msg_uninit(struct mpv_global *global)
 {
     struct mp_log_root *root = global->log->root;
-    if (root->stats_file)
-        fclose(root->stats_file);
-    if (root->log_file)
-        fclose(root->log_file);
+    close_stats_file(root);
+    close_log_file(root);
+    pthread_mutex_destroy(&root->log_file_lock);
+    pthread_cond_destroy(&root->log_file_wakeup);
     m_option_type_msglevels.free(&root->msg_levels);
     talloc_free(root);
     global->log = NULL;
@@ -569,6 +797,26 @@ found:
     pthread_mutex_unlock(&mp_msg_lock);
 }
 
+// Only pass messages from the given modules (or submodules of them) to the
+// buffer. prefixes is a NULL-terminated list; NULL passes all messages.
+void mp_msg_log_buffer_set_prefixes(struct mp_log_buffer *buffer,
+                                    char **prefixes)
+{
+    pthread_mutex_lock(&mp_msg_lock);
+    talloc_free(buffer->prefixes);
+    buffer->prefixes = NULL;
+    int num = 0;
+    while (prefixes && prefixes[num])
+        num++;
+    if (num) {
+        buffer->prefixes = talloc_array(buffer, char *, num + 1);
+        for (int n = 0; n < num; n++)
+            buffer->prefixes[n] = talloc_strdup(buffer->prefixes, prefixes[n]);
+        buffer->prefixes[num] = NULL;
+    }
+    pthread_mutex_unlock(&mp_msg_lock);
+}
+
 // Return a queued message, or if the buffer is empty, NULL.
 // Thread-safety: one buffer can be read by a single thread only.
 struct mp_log_buffer_entry *mp_msg_log_buffer_read(struct mp_log_buffer *buffer)
@@ -582,16 +830,19 @@ struct mp_log_buffer_entry *mp_msg_log_buffer_read(struct mp_log_buffer *buffer)
     return ptr;
 }
 
-int mp_msg_open_stats_file(struct mpv_global *global, const char *path)
+int mp_msg_open_stats_file(struct mpv_global *global, const char *path,
+                           bool trace)
 {
     struct mp_log_root *root = global->log->root;
     int r;
 
     pthread_mutex_lock(&mp_msg_lock);
 
-    if (root->stats_file)
-        fclose(root->stats_file);
+    close_stats_file(root);
     root->stats_file = fopen(path, "wb");
+    root->stats_trace = trace;
+    if (root->stats_file && trace)
+        fprintf(root->stats_file, "[\n");
     r = root->stats_file ? 0 : -1;
 
     pthread_mutex_unlock(&mp_msg_lock);
@@ -600,6 +851,38 @@ int mp_msg_open_stats_file(struct mpv_global *global, const char *path)
     return r;
 }
 
+// Start collecting MP_STATS() events for mp_msg_get_benchmark_report().
+void mp_msg_enable_benchmark(struct mpv_global *global)
+{
+    struct mp_log_root *root = global->log->root;
+
+    pthread_mutex_lock(&mp_msg_lock);
+    if (!root->benchmark)
+        root->benchmark = mp_benchmark_create(root);
+    pthread_mutex_unlock(&mp_msg_lock);
+
+    mp_msg_update_msglevels(global);
+}
+
+// Returns false if mp_msg_enable_benchmark() was not called. Otherwise, dst is
+// set to the mp_benchmark_get_report() result, which the caller must free
+// with talloc_free(dst->u.list).
+bool mp_msg_get_benchmark_report(struct mpv_global *global,
+                                 const char *frame_event, struct mpv_node *dst)
+{
+    struct mp_log_root *root = global->log->root;
+    bool r = false;
+
+    pthread_mutex_lock(&mp_msg_lock);
+    if (root->benchmark) {
+        mp_benchmark_get_report(root->benchmark, frame_event, dst);
+        r = true;
+    }
+    pthread_mutex_unlock(&mp_msg_lock);
+
+    return r;
+}
+
 // Thread-safety: fully thread-safe, but keep in mind that the lifetime of
 //                log must be guaranteed during the call.
 //                Never call this from signal handlers.
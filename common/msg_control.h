@@ -4,11 +4,13 @@
 #include <stdbool.h>
 
 struct mpv_global;
+struct mpv_node;
 void mp_msg_init(struct mpv_global *global);
 void mp_msg_uninit(struct mpv_global *global);
 void mp_msg_update_msglevels(struct mpv_global *global);
 void mp_msg_force_stderr(struct mpv_global *global, bool force_stderr);
 bool mp_msg_has_status_line(struct mpv_global *global);
+bool mp_msg_status_line_is_redundant(struct mpv_global *global);
 
 void mp_msg_flush_status_line(struct mp_log *log);
 
@@ -27,9 +29,16 @@ struct mp_log_buffer *mp_msg_log_buffer_new(struct mpv_global *global,
                                             void (*wakeup_cb)(void *ctx),
                                             void *wakeup_cb_ctx);
 void mp_msg_log_buffer_destroy(struct mp_log_buffer *buffer);
+void mp_msg_log_buffer_set_prefixes(struct mp_log_buffer *buffer,
+                                    char **prefixes);
 struct mp_log_buffer_entry *mp_msg_log_buffer_read(struct mp_log_buffer *buffer);
 
-int mp_msg_open_stats_file(struct mpv_global *global, const char *path);
+int mp_msg_open_stats_file(struct mpv_global *global, const char *path,
+                           bool trace);
+void mp_msg_enable_benchmark(struct mpv_global *global);
+bool mp_msg_get_benchmark_report(struct mpv_global *global,
+                                 const char *frame_event, struct mpv_node *dst);
+
 int mp_msg_find_level(const char *s);
 
 extern const char *const mp_log_levels[MSGL_MAX + 1];
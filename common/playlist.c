@@ -75,6 +75,13 @@ void playlist_insert(struct playlist *pl, struct playlist_entry *after,
     }
     add->pl = pl;
     talloc_steal(pl, add);
+
+    if (pl->entries_valid && !add->next) {
+        add->pl_index = pl->num_entries;
+        MP_TARRAY_APPEND(pl, pl->entries, pl->num_entries, add);
+    } else {
+        pl->entries_valid = false;
+    }
 }
 
 void playlist_add(struct playlist *pl, struct playlist_entry *add)
@@ -101,6 +108,12 @@ static void playlist_unlink(struct playlist *pl, struct playlist_entry *entry)
     } else {
         pl->first = entry->next;
     }
+    if (pl->entries_valid && entry->pl_index == pl->num_entries - 1) {
+        pl->num_entries--;
+    } else {
+        pl->entries_valid = false;
+    }
+
     entry->next = entry->prev = NULL;
     // xxx: we'd want to reset the talloc parent of entry
     entry->pl = NULL;
@@ -150,19 +163,11 @@ void playlist_add_file(struct playlist *pl, const char *filename)
     playlist_add(pl, playlist_entry_new(filename));
 }
 
-static int playlist_count(struct playlist *pl)
-{
-    int c = 0;
-    for (struct playlist_entry *e = pl->first; e; e = e->next)
-        c++;
-    return c;
-}
-
 void playlist_shuffle(struct playlist *pl)
 {
     struct playlist_entry *save_current = pl->current;
     bool save_replaced = pl->current_was_replaced;
-    int count = playlist_count(pl);
+    int count = playlist_entry_count(pl);
     struct playlist_entry **arr = talloc_array(NULL, struct playlist_entry *,
                                                count);
     for (int n = 0; n < count; n++) {
@@ -243,36 +248,42 @@ void playlist_append_entries(struct playlist *pl, struct playlist *source_pl)
     }
 }
 
+static void update_entries(struct playlist *pl)
+{
+    if (pl->entries_valid)
+        return;
+    pl->num_entries = 0;
+    for (struct playlist_entry *e = pl->first; e; e = e->next) {
+        e->pl_index = pl->num_entries;
+        MP_TARRAY_APPEND(pl, pl->entries, pl->num_entries, e);
+    }
+    pl->entries_valid = true;
+}
+
 // Return number of entries between list start and e.
 // Return -1 if e is not on the list, or if e is NULL.
 int playlist_entry_to_index(struct playlist *pl, struct playlist_entry *e)
 {
-    struct playlist_entry *cur = pl->first;
-    int pos = 0;
-    if (!e)
+    if (!e || e->pl != pl)
         return -1;
-    while (cur && cur != e) {
-        cur = cur->next;
-        pos++;
-    }
-    return cur == e ? pos : -1;
+    update_entries(pl);
+    return e->pl_index;
 }
 
 int playlist_entry_count(struct playlist *pl)
 {
-    return playlist_entry_to_index(pl, pl->last) + 1;
+    update_entries(pl);
+    return pl->num_entries;
 }
 
 // Return entry for which playlist_entry_to_index() would return index.
 // Return NULL if not found.
 struct playlist_entry *playlist_entry_from_index(struct playlist *pl, int index)
 {
-    struct playlist_entry *e = pl->first;
-    for (int n = 0; ; n++) {
-        if (!e || n == index)
-            return e;
-        e = e->next;
-    }
+    update_entries(pl);
+    if (index < 0 || index >= pl->num_entries)
+        return NULL;
+    return pl->entries[index];
 }
 
 struct playlist *playlist_parse_file(const char *file, struct mpv_global *global)
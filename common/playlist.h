@@ -28,6 +28,8 @@ struct playlist_param {
 struct playlist_entry {
     struct playlist_entry *prev, *next;
     struct playlist *pl;
+    // Position in pl->entries; only valid if pl->entries_valid is set.
+    int pl_index;
 
     char *filename;
 
@@ -71,6 +73,13 @@ struct playlist {
     bool current_was_replaced;
 
     bool disable_safety;
+
+    // Array of all entries in list order, for O(1) positional access. Updated
+    // cheaply when appending; any other change invalidates it, and it is
+    // rebuilt lazily on the next positional access.
+    struct playlist_entry **entries;
+    int num_entries;
+    bool entries_valid;
 };
 
 void playlist_entry_add_param(struct playlist_entry *e, bstr name, bstr value);
@@ -32,7 +32,11 @@
 #include "mpv_talloc.h"
 #include "common/msg.h"
 #include "common/global.h"
+#include "common/memgov.h"
 #include "osdep/threads.h"
+#include "osdep/timer.h"
+#include "options/path.h"
+#include "misc/ctype.h"
 
 #include "stream/stream.h"
 #include "demux.h"
@@ -118,6 +122,18 @@ struct demux_internal {
     double min_secs;
     int max_packs;
     int max_bytes;
+    int max_bytes_bw;           // budget of already returned packets (0=off)
+    int max_bytes_type[STREAM_TYPE_COUNT]; // per-type readahead budget (0=off)
+    struct mp_memgov_client *memgov; // readahead share of --memory-budget
+
+    // Adaptive cache sizing (--cache-adaptive-max). Accessed by the thread
+    // which calls update_cache() only, except min_secs.
+    int64_t adapt_max;          // memory cap in bytes (0=off)
+    double adapt_last;          // time of the last speed sample
+    double adapt_last_resize;   // time of the last cache resize
+    double adapt_speed;         // smoothed download speed (bytes/sec)
+    double adapt_speed_var;     // smoothed variance of the download speed
+    int64_t adapt_size;         // last requested stream cache size
 
     // Set if we know that we are at the start of the file. This is used to
     // avoid a redundant initial seek after enabling streams. We could just
@@ -125,6 +141,8 @@ struct demux_internal {
     bool initial_state;
 
     bool tracks_switched;       // thread needs to inform demuxer of this
+    bool prefill_tracks;        // use prefill_stream() instead of refresh seeks
+    bool need_prefill;          // some stream has need_prefill set
 
     bool seeking;               // there's a seek queued
     int seek_flags;             // flags for next seek (if seeking==true)
@@ -134,6 +152,13 @@ struct demux_internal {
 
     double ts_offset;           // timestamp offset to apply to everything
 
+    // Cached packet ranges. The current range is the one packets are appended
+    // to. The list is sorted by last use, so the current range is always the
+    // last element (if there are other ranges, they're only kept for seeking).
+    struct demux_cached_range **ranges;
+    int num_ranges;
+    struct demux_cached_range *current_range;
+
     void (*run_fn)(void *);     // if non-NULL, function queued to be run on
     void *run_fn_arg;           // the thread as run_fn(run_fn_arg)
 
@@ -147,6 +172,30 @@ struct demux_internal {
     char *stream_base_filename;
 };
 
+// A continuous range of cached packets for all streams (one demux_queue for
+// each stream, indexed by sh_stream.index).
+struct demux_cached_range {
+    struct demux_queue **streams;
+    int num_streams;
+};
+
+// The packet queue of a single stream within a cached range.
+struct demux_queue {
+    struct demux_stream *ds;
+    struct demux_cached_range *range;
+
+    struct demux_packet *head;          // oldest packet in the queue
+    struct demux_packet *tail;          // newest packet in the queue
+    struct demux_packet *keyframe_latest; // last added keyframe packet
+    size_t bytes;                       // total bytes of all packets
+
+    bool correct_dts;       // packet DTS is strictly monotonically increasing
+    bool correct_pos;       // packet pos is strictly monotonically increasing
+    int64_t last_pos;       // pos of the newest packet
+    double last_dts;        // DTS of the newest packet
+    double seek_end;        // highest timestamp of all packets
+};
+
 struct demux_stream {
     struct demux_internal *in;
     enum stream_type type;
@@ -157,20 +206,30 @@ struct demux_stream {
                             // read (like subtitles)
     bool eof;               // end of demuxed stream? (true if all buffer empty)
     bool need_refresh;      // enabled mid-stream
+    bool need_prefill;      // enabled mid-stream (prefill_stream() mode)
     bool refreshing;
-    bool correct_dts;       // packet DTS is strictly monotonically increasing
-    bool correct_pos;       // packet pos is strictly monotonically increasing
-    size_t packs;           // number of packets in buffer
-    size_t bytes;           // total bytes of packets in buffer
+    size_t packs;           // number of packets in buffer (after reader_head)
+    size_t bytes;           // total bytes of packets in buffer (after reader_head)
     double base_ts;         // timestamp of the last packet returned to decoder
     double last_ts;         // timestamp of the last packet added to queue
     double last_br_ts;      // timestamp of last packet bitrate was calculated
     size_t last_br_bytes;   // summed packet sizes since last bitrate calculation
     double bitrate;
-    int64_t last_pos;
-    double last_dts;
-    struct demux_packet *head;
-    struct demux_packet *tail;
+    // statistics (see demux_get_stream_stats())
+    int64_t stat_packets_in;
+    int64_t stat_packets_out;
+    int64_t stat_underruns;
+    bool stat_in_underrun;  // reader found the queue empty, and is waiting
+    double stat_underrun_start; // mp_time_sec() when the underrun started
+    double stat_blocked;
+    double stat_rate_time;  // mp_time_sec() of last rate update
+    int64_t stat_rate_in, stat_rate_out; // packet counts at stat_rate_time
+    double stat_in_rate, stat_out_rate;
+    // Queue of the current range. Packets between queue->head and reader_head
+    // were already returned to the decoder, and are kept only for seeking
+    // within the cache (this is always empty if in->max_bytes_bw is 0).
+    struct demux_queue *queue;
+    struct demux_packet *reader_head;   // next packet returned to the decoder
 
     // for closed captions (demuxer_feed_caption)
     struct sh_stream *cc;
@@ -187,17 +246,30 @@ struct demux_stream {
 static void demuxer_sort_chapters(demuxer_t *demuxer);
 static void *demux_thread(void *pctx);
 static void update_cache(struct demux_internal *in);
+static void execute_seek(struct demux_internal *in);
 
 // called locked
-static void ds_flush(struct demux_stream *ds)
+static void clear_queue(struct demux_queue *queue)
 {
-    demux_packet_t *dp = ds->head;
+    demux_packet_t *dp = queue->head;
     while (dp) {
         demux_packet_t *dn = dp->next;
         free_demux_packet(dp);
         dp = dn;
     }
-    ds->head = ds->tail = NULL;
+    queue->head = queue->tail = queue->keyframe_latest = NULL;
+    queue->bytes = 0;
+    queue->last_pos = -1;
+    queue->last_dts = MP_NOPTS_VALUE;
+    queue->seek_end = MP_NOPTS_VALUE;
+    queue->correct_dts = queue->correct_pos = true;
+}
+
+// Reset the reader position, but keep the cached packets.
+// called locked
+static void ds_clear_reader_state(struct demux_stream *ds)
+{
+    ds->reader_head = NULL;
     ds->packs = 0;
     ds->bytes = 0;
     ds->last_ts = ds->base_ts = ds->last_br_ts = MP_NOPTS_VALUE;
@@ -207,9 +279,94 @@ static void ds_flush(struct demux_stream *ds)
     ds->active = false;
     ds->refreshing = false;
     ds->need_refresh = false;
-    ds->last_pos = -1;
-    ds->last_dts = MP_NOPTS_VALUE;
-    ds->correct_dts = ds->correct_pos = true;
+    ds->need_prefill = false;
+}
+
+// called locked
+static void ds_flush(struct demux_stream *ds)
+{
+    clear_queue(ds->queue);
+    ds_clear_reader_state(ds);
+}
+
+static void add_queue_to_range(struct demux_cached_range *range,
+                               struct demux_stream *ds)
+{
+    struct demux_queue *queue = talloc_ptrtype(range, queue);
+    *queue = (struct demux_queue){
+        .ds = ds,
+        .range = range,
+    };
+    clear_queue(queue);
+    MP_TARRAY_APPEND(range, range->streams, range->num_streams, queue);
+}
+
+// Create a new empty range, with queues for all current streams.
+// called locked
+static struct demux_cached_range *add_cached_range(struct demux_internal *in)
+{
+    struct demux_cached_range *range = talloc_zero(in, struct demux_cached_range);
+    for (int n = 0; n < in->num_streams; n++)
+        add_queue_to_range(range, in->streams[n]->ds);
+    MP_TARRAY_APPEND(in, in->ranges, in->num_ranges, range);
+    return range;
+}
+
+static void free_cached_range(struct demux_internal *in,
+                              struct demux_cached_range *range)
+{
+    assert(range != in->current_range);
+    for (int n = 0; n < range->num_streams; n++)
+        clear_queue(range->streams[n]);
+    for (int n = 0; n < in->num_ranges; n++) {
+        if (in->ranges[n] == range) {
+            MP_TARRAY_REMOVE_AT(in->ranges, in->num_ranges, n);
+            break;
+        }
+    }
+    talloc_free(range);
+}
+
+// Make the given range the current one. The reader state is reset; the caller
+// has to reposition it.
+// called locked
+static void switch_current_range(struct demux_internal *in,
+                                 struct demux_cached_range *range)
+{
+    in->current_range = range;
+    // Move to the end of the list, which keeps the list sorted by last use.
+    for (int n = 0; n < in->num_ranges; n++) {
+        if (in->ranges[n] == range) {
+            MP_TARRAY_REMOVE_AT(in->ranges, in->num_ranges, n);
+            break;
+        }
+    }
+    MP_TARRAY_APPEND(in, in->ranges, in->num_ranges, range);
+    for (int n = 0; n < in->num_streams; n++) {
+        struct demux_stream *ds = in->streams[n]->ds;
+        ds_clear_reader_state(ds);
+        ds->queue = range->streams[n];
+    }
+    // Empty ranges are useless (e.g. left over from a seek interrupted by
+    // another seek).
+    for (int n = in->num_ranges - 1; n >= 0; n--) {
+        struct demux_cached_range *other = in->ranges[n];
+        bool empty = true;
+        for (int i = 0; i < other->num_streams; i++)
+            empty &= !other->streams[i]->head;
+        if (empty && other != range)
+            free_cached_range(in, other);
+    }
+}
+
+// Discard all cached data except the (cleared) current range.
+// called locked
+static void free_other_ranges(struct demux_internal *in)
+{
+    for (int n = in->num_ranges - 1; n >= 0; n--) {
+        if (in->ranges[n] != in->current_range)
+            free_cached_range(in, in->ranges[n]);
+    }
 }
 
 void demux_set_ts_offset(struct demuxer *demuxer, double offset)
@@ -254,6 +411,7 @@ void demux_add_sh_stream(struct demuxer *demuxer, struct sh_stream *sh)
         .type = sh->type,
         .selected = in->autoselect,
     };
+    ds_clear_reader_state(sh->ds);
 
     if (!sh->codec->codec)
         sh->codec->codec = "";
@@ -271,6 +429,10 @@ void demux_add_sh_stream(struct demuxer *demuxer, struct sh_stream *sh)
 
     MP_TARRAY_APPEND(in, in->streams, in->num_streams, sh);
 
+    for (int n = 0; n < in->num_ranges; n++)
+        add_queue_to_range(in->ranges[n], sh->ds);
+    sh->ds->queue = in->current_range->streams[sh->index];
+
     in->events |= DEMUX_EVENT_STREAMS;
     if (in->wakeup_cb)
         in->wakeup_cb(in->wakeup_cb_ctx);
@@ -339,10 +501,15 @@ void free_demuxer(demuxer_t *demuxer)
 
     if (demuxer->desc->close)
         demuxer->desc->close(in->d_thread);
-    for (int n = in->num_streams - 1; n >= 0; n--) {
-        ds_flush(in->streams[n]->ds);
-        talloc_free(in->streams[n]);
+    for (int n = 0; n < in->num_ranges; n++) {
+        struct demux_cached_range *range = in->ranges[n];
+        for (int i = 0; i < range->num_streams; i++)
+            clear_queue(range->streams[i]);
     }
+    for (int n = in->num_streams - 1; n >= 0; n--)
+        talloc_free(in->streams[n]);
+    demux_packet_pool_destroy(demuxer->packet_pool);
+    mp_memgov_unregister(in->memgov);
     pthread_mutex_destroy(&in->lock);
     pthread_cond_destroy(&in->wakeup);
     talloc_free(demuxer);
@@ -370,6 +537,24 @@ void demux_start_thread(struct demuxer *demuxer)
     }
 }
 
+// Make the demuxer thread read ahead on the selected audio and video streams,
+// even if no packets were requested yet.
+void demux_start_prefetch(struct demuxer *demuxer)
+{
+    struct demux_internal *in = demuxer->in;
+    assert(demuxer == in->d_user);
+
+    pthread_mutex_lock(&in->lock);
+    for (int n = 0; n < in->num_streams; n++) {
+        struct demux_stream *ds = in->streams[n]->ds;
+        if (ds->type == STREAM_VIDEO || ds->type == STREAM_AUDIO)
+            ds->active = ds->selected;
+    }
+    in->eof = false;
+    pthread_cond_signal(&in->wakeup);
+    pthread_mutex_unlock(&in->lock);
+}
+
 void demux_stop_thread(struct demuxer *demuxer)
 {
     struct demux_internal *in = demuxer->in;
@@ -453,7 +638,7 @@ static double get_refresh_seek_pts(struct demux_internal *in)
         normal_seek &= ds->need_refresh;
         ds->need_refresh = false;
 
-        refresh_possible &= ds->correct_dts || ds->correct_pos;
+        refresh_possible &= ds->queue->correct_dts || ds->queue->correct_pos;
     }
 
     if (!needed || start_ts == MP_NOPTS_VALUE || !demux->desc->seek ||
@@ -472,7 +657,7 @@ static double get_refresh_seek_pts(struct demux_internal *in)
         struct demux_stream *ds = in->streams[n]->ds;
         // Streams which didn't have any packets yet will return all packets,
         // other streams return packets only starting from the last position.
-        if (ds->last_pos != -1 || ds->last_dts != MP_NOPTS_VALUE)
+        if (ds->queue->last_pos != -1 || ds->queue->last_dts != MP_NOPTS_VALUE)
             ds->refreshing = true;
     }
 
@@ -480,54 +665,283 @@ static double get_refresh_seek_pts(struct demux_internal *in)
     return start_ts - 1.0;
 }
 
-void demux_add_packet(struct sh_stream *stream, demux_packet_t *dp)
+// Return the first (oldest) keyframe in the queue which can be seeked to.
+static struct demux_packet *queue_first_keyframe(struct demux_queue *queue)
 {
-    struct demux_stream *ds = stream ? stream->ds : NULL;
-    if (!dp || !ds) {
-        talloc_free(dp);
+    for (struct demux_packet *dp = queue->head; dp; dp = dp->next) {
+        if (dp->keyframe && dp->kf_seek_pts != MP_NOPTS_VALUE)
+            return dp;
+    }
+    return NULL;
+}
+
+// Return the timestamp range [*r_start, *r_end] of the given cached range
+// which can be seeked to without asking the demuxer implementation. Only
+// selected streams are considered, and subtitles are ignored, because they are
+// sparse. Returns false if there is no such range.
+static bool get_range_seek_bounds(struct demux_internal *in,
+                                  struct demux_cached_range *range,
+                                  double *r_start, double *r_end)
+{
+    double start = MP_NOPTS_VALUE, end = MP_NOPTS_VALUE;
+    bool any = false;
+    for (int n = 0; n < range->num_streams; n++) {
+        struct demux_queue *queue = range->streams[n];
+        if (!queue->ds->selected || queue->ds->type == STREAM_SUB)
+            continue;
+        struct demux_packet *kf = queue_first_keyframe(queue);
+        if (!kf || queue->seek_end == MP_NOPTS_VALUE)
+            return false;
+        start = MP_PTS_MAX(start, kf->kf_seek_pts);
+        end = MP_PTS_MIN(end, queue->seek_end);
+        any = true;
+    }
+    *r_start = start;
+    *r_end = end;
+    return any && start <= end;
+}
+
+// Whether reading can be resumed at the end of the range after a low-level
+// seek (this requires finding the last packet of each queue again).
+static bool range_is_resumable(struct demux_cached_range *range)
+{
+    for (int n = 0; n < range->num_streams; n++) {
+        struct demux_queue *queue = range->streams[n];
+        if (queue->ds->selected && queue->head &&
+            !queue->correct_dts && !queue->correct_pos)
+            return false;
+    }
+    return true;
+}
+
+// Queue a low-level seek to the end of the current range, and drop all
+// packets until the last cached packet of each stream is reached again.
+// called locked
+static void seek_to_range_end(struct demux_internal *in)
+{
+    double start, end;
+    if (!get_range_seek_bounds(in, in->current_range, &start, &end))
         return;
+    for (int n = 0; n < in->num_streams; n++) {
+        struct demux_stream *ds = in->streams[n]->ds;
+        ds->refreshing = ds->selected && (ds->queue->last_pos != -1 ||
+                                          ds->queue->last_dts != MP_NOPTS_VALUE);
+    }
+    MP_VERBOSE(in, "resuming reading at end of cached range (%f)\n", end);
+    in->seeking = true;
+    in->seek_flags = SEEK_BACKWARD | SEEK_HR;
+    in->seek_pts = end - 1.0;
+    in->eof = in->last_eof = false;
+}
+
+// Return the packet in the queue that corresponds to the newest packet of the
+// other queue, or NULL if it can't be found.
+static struct demux_packet *find_queue_join_point(struct demux_queue *queue,
+                                                  struct demux_queue *other)
+{
+    for (struct demux_packet *dp = queue->head; dp; dp = dp->next) {
+        if (other->correct_dts && queue->correct_dts) {
+            if (dp->dts == other->last_dts)
+                return dp;
+            if (dp->dts > other->last_dts)
+                break;
+        } else if (other->correct_pos && queue->correct_pos) {
+            if (dp->pos == other->last_pos)
+                return dp;
+            if (dp->pos > other->last_pos)
+                break;
+        } else {
+            break;
+        }
+    }
+    return NULL;
+}
+
+// Append the packets of the range next to the current range, starting after
+// the join point.
+static void join_queues(struct demux_queue *queue, struct demux_queue *next,
+                        struct demux_packet *join_point)
+{
+    struct demux_stream *ds = queue->ds;
+
+    // Drop everything up to and including the join point.
+    struct demux_packet *dp = next->head;
+    if (join_point) {
+        while (dp) {
+            struct demux_packet *dn = dp->next;
+            bool last = dp == join_point;
+            next->bytes -= dp->len;
+            if (next->keyframe_latest == dp)
+                next->keyframe_latest = NULL;
+            free_demux_packet(dp);
+            dp = dn;
+            if (last)
+                break;
+        }
     }
+    next->head = dp;
+    if (!dp) {
+        clear_queue(next);
+        return;
+    }
+
+    // The packets up to the first keyframe belong to the keyframe range of
+    // the last keyframe in this queue.
+    for (struct demux_packet *p = dp; p && !p->keyframe; p = p->next) {
+        if (queue->keyframe_latest) {
+            queue->keyframe_latest->kf_seek_pts =
+                MP_PTS_MIN(queue->keyframe_latest->kf_seek_pts, p->pts);
+        }
+    }
+
+    if (queue->tail) {
+        queue->tail->next = dp;
+    } else {
+        queue->head = dp;
+    }
+    queue->tail = next->tail;
+    queue->bytes += next->bytes;
+    if (next->keyframe_latest)
+        queue->keyframe_latest = next->keyframe_latest;
+    queue->correct_dts &= next->correct_dts;
+    queue->correct_pos &= next->correct_pos;
+    queue->last_pos = next->last_pos;
+    queue->last_dts = next->last_dts;
+    queue->seek_end = MP_PTS_MAX(queue->seek_end, next->seek_end);
+
+    if (ds->queue == queue) {
+        if (!ds->reader_head)
+            ds->reader_head = dp;
+        for (struct demux_packet *p = dp; p; p = p->next) {
+            ds->packs++;
+            ds->bytes += p->len;
+        }
+        ds->last_ts = MP_PTS_MAX(ds->last_ts, queue->seek_end);
+    }
+
+    next->head = next->tail = next->keyframe_latest = NULL;
+    next->bytes = 0;
+    clear_queue(next);
+}
+
+// If the current range overlaps with another cached range, join them, and
+// continue reading at the end of the joined range.
+// called locked
+static void attempt_range_joining(struct demux_internal *in)
+{
+    struct demux_cached_range *cur = in->current_range;
+    double cur_start, cur_end;
+    if (in->num_ranges < 2 || in->seeking ||
+        !get_range_seek_bounds(in, cur, &cur_start, &cur_end))
+        return;
+
+    for (int n = in->num_ranges - 1; n >= 0; n--) {
+        struct demux_cached_range *next = in->ranges[n];
+        double next_start, next_end;
+        if (next == cur || !get_range_seek_bounds(in, next, &next_start, &next_end))
+            continue;
+        if (next_start < cur_start || next_start > cur_end)
+            continue;
+
+        bool ok = range_is_resumable(next);
+        struct demux_packet **join_points =
+            talloc_zero_array(NULL, struct demux_packet *, in->num_streams);
+        for (int i = 0; i < in->num_streams && ok; i++) {
+            struct demux_queue *q1 = cur->streams[i];
+            struct demux_queue *q2 = next->streams[i];
+            if (!q1->ds->selected || !q1->tail || !q2->head)
+                continue;
+            join_points[i] = find_queue_join_point(q2, q1);
+            if (!join_points[i] && q1->ds->type == STREAM_SUB) {
+                // Sparse streams don't necessarily overlap. Append everything
+                // if the other queue starts after this one, otherwise drop
+                // the other queue's packets.
+                struct demux_packet *h = q2->head;
+                bool after = false;
+                if (q1->correct_dts && q2->correct_dts) {
+                    after = h->dts > q1->last_dts;
+                } else if (q1->correct_pos && q2->correct_pos) {
+                    after = h->pos > q1->last_pos;
+                }
+                if (!after)
+                    join_points[i] = q2->tail;
+                continue;
+            }
+            ok &= !!join_points[i];
+        }
+
+        if (ok) {
+            MP_VERBOSE(in, "joining cached range %f-%f with %f-%f\n",
+                       cur_start, cur_end, next_start, next_end);
+            for (int i = 0; i < in->num_streams; i++) {
+                struct demux_queue *q1 = cur->streams[i];
+                struct demux_queue *q2 = next->streams[i];
+                if (q1->ds->selected)
+                    join_queues(q1, q2, join_points[i]);
+            }
+            free_cached_range(in, next);
+            seek_to_range_end(in);
+        } else if (cur_end >= next_end) {
+            // Completely overlapped by the current range, but there's no
+            // consistent join point. Just get rid of it.
+            MP_VERBOSE(in, "discarding overlapped cached range %f-%f\n",
+                       next_start, next_end);
+            free_cached_range(in, next);
+        }
+        talloc_free(join_points);
+        if (ok)
+            break;
+    }
+}
+
+// called locked
+static void add_packet_locked(struct sh_stream *stream, demux_packet_t *dp)
+{
+    struct demux_stream *ds = stream->ds;
     struct demux_internal *in = ds->in;
-    pthread_mutex_lock(&in->lock);
+    struct demux_queue *queue = ds->queue;
 
     bool drop = ds->refreshing;
     if (ds->refreshing) {
         // Resume reading once the old position was reached (i.e. we start
         // returning packets where we left off before the refresh).
         // If it's the same position, drop, but continue normally next time.
-        if (ds->correct_dts) {
-            ds->refreshing = dp->dts < ds->last_dts;
-        } else if (ds->correct_pos) {
-            ds->refreshing = dp->pos < ds->last_pos;
+        if (queue->correct_dts) {
+            ds->refreshing = dp->dts < queue->last_dts;
+        } else if (queue->correct_pos) {
+            ds->refreshing = dp->pos < queue->last_pos;
         } else {
             ds->refreshing = false; // should not happen
         }
     }
 
     if (!ds->selected || ds->need_refresh || in->seeking || drop) {
-        pthread_mutex_unlock(&in->lock);
         talloc_free(dp);
         return;
     }
 
-    ds->correct_pos &= dp->pos >= 0 && dp->pos > ds->last_pos;
-    ds->correct_dts &= dp->dts != MP_NOPTS_VALUE && dp->dts > ds->last_dts;
-    ds->last_pos = dp->pos;
-    ds->last_dts = dp->dts;
+    queue->correct_pos &= dp->pos >= 0 && dp->pos > queue->last_pos;
+    queue->correct_dts &= dp->dts != MP_NOPTS_VALUE && dp->dts > queue->last_dts;
+    queue->last_pos = dp->pos;
+    queue->last_dts = dp->dts;
 
     dp->stream = stream->index;
     dp->next = NULL;
 
     ds->packs++;
     ds->bytes += dp->len;
-    if (ds->tail) {
+    ds->stat_packets_in++;
+    queue->bytes += dp->len;
+    if (queue->tail) {
         // next packet in stream
-        ds->tail->next = dp;
-        ds->tail = dp;
+        queue->tail->next = dp;
+        queue->tail = dp;
     } else {
         // first packet in stream
-        ds->head = ds->tail = dp;
+        queue->head = queue->tail = dp;
     }
+    if (!ds->reader_head)
+        ds->reader_head = dp;
 
     // obviously not true anymore
     ds->eof = false;
@@ -543,35 +957,81 @@ void demux_add_packet(struct sh_stream *stream, demux_packet_t *dp)
         ds->last_ts = ts;
     if (ds->base_ts == MP_NOPTS_VALUE)
         ds->base_ts = ds->last_ts;
+    queue->seek_end = MP_PTS_MAX(queue->seek_end, ts);
+
+    // The seek target of a keyframe is the lowest PTS of all packets that
+    // follow it up to the next keyframe (PTS can be reordered).
+    dp->kf_seek_pts = MP_NOPTS_VALUE;
+    if (dp->keyframe)
+        queue->keyframe_latest = dp;
+    if (queue->keyframe_latest) {
+        queue->keyframe_latest->kf_seek_pts =
+            MP_PTS_MIN(queue->keyframe_latest->kf_seek_pts, dp->pts);
+    }
 
     MP_DBG(in, "append packet to %s: size=%d pts=%f dts=%f pos=%"PRIi64" "
            "[num=%zd size=%zd]\n", stream_type_name(stream->type),
            dp->len, dp->pts, dp->dts, dp->pos, ds->packs, ds->bytes);
 
-    if (ds->in->wakeup_cb && !ds->head->next)
+    if (ds->in->wakeup_cb && ds->reader_head == dp)
         ds->in->wakeup_cb(ds->in->wakeup_cb_ctx);
+
+    attempt_range_joining(in);
+
     pthread_cond_signal(&in->wakeup);
+}
+
+void demux_add_packet(struct sh_stream *stream, demux_packet_t *dp)
+{
+    struct demux_stream *ds = stream ? stream->ds : NULL;
+    if (!dp || !ds) {
+        talloc_free(dp);
+        return;
+    }
+    struct demux_internal *in = ds->in;
+    pthread_mutex_lock(&in->lock);
+    add_packet_locked(stream, dp);
     pthread_mutex_unlock(&in->lock);
 }
 
 // Returns true if there was "progress" (lock was released temporarily).
 static bool read_packet(struct demux_internal *in)
 {
+    // Implicit seek queued by the cache (only in non-threaded mode, because
+    // the demuxer thread executes it before reading).
+    if (in->seeking) {
+        execute_seek(in);
+        return true;
+    }
+
     in->eof = false;
     in->idle = true;
 
     // Check if we need to read a new packet. We do this if all queues are below
     // the minimum, or if a stream explicitly needs new packets. Also includes
     // safe-guards against packet queue overflow.
-    bool active = false, read_more = false;
+    // A stream which exceeds its per-type budget does not cause reading by
+    // itself, but it keeps growing if another stream needs more packets. Since
+    // the demuxer can't read a specific stream, this makes the stream closest
+    // to underrun decide about reading, while the total queue size is still
+    // capped by max_bytes.
+    bool active = false, read_more = false, starving = false;
     size_t packs = 0, bytes = 0;
     for (int n = 0; n < in->num_streams; n++) {
         struct demux_stream *ds = in->streams[n]->ds;
         active |= ds->active;
-        read_more |= ds->active && !ds->head;
         packs += ds->packs;
         bytes += ds->bytes;
-        if (ds->active && ds->last_ts != MP_NOPTS_VALUE && in->min_secs > 0 &&
+        if (!ds->active)
+            continue;
+        if (!ds->reader_head) {
+            read_more = starving = true;
+            continue;
+        }
+        int budget = in->max_bytes_type[ds->type];
+        if (budget > 0 && ds->bytes >= (size_t)budget)
+            continue;
+        if (ds->last_ts != MP_NOPTS_VALUE && in->min_secs > 0 &&
             ds->last_ts >= ds->base_ts)
             read_more |= ds->last_ts - ds->base_ts < in->min_secs;
     }
@@ -591,7 +1051,7 @@ static bool read_packet(struct demux_internal *in)
         }
         for (int n = 0; n < in->num_streams; n++) {
             struct demux_stream *ds = in->streams[n]->ds;
-            bool eof = !ds->head;
+            bool eof = !ds->reader_head;
             if (eof && !ds->eof) {
                 if (in->wakeup_cb)
                     in->wakeup_cb(in->wakeup_cb_ctx);
@@ -602,6 +1062,11 @@ static bool read_packet(struct demux_internal *in)
         return false;
     }
 
+    // Over the --memory-budget share, only read to feed empty streams.
+    mp_memgov_report(in->memgov, bytes, -1);
+    if (bytes >= mp_memgov_get_limit(in->memgov))
+        read_more = starving;
+
     if (!read_more)
         return false;
 
@@ -620,7 +1085,9 @@ static bool read_packet(struct demux_internal *in)
         demux->desc->seek(demux, seek_pts, SEEK_BACKWARD | SEEK_HR);
     }
 
+    MP_STATS(in, "start read packet");
     bool eof = !demux->desc->fill_buffer || demux->desc->fill_buffer(demux) <= 0;
+    MP_STATS(in, "end read packet");
     update_cache(in);
 
     pthread_mutex_lock(&in->lock);
@@ -642,6 +1109,28 @@ static bool read_packet(struct demux_internal *in)
     return true;
 }
 
+// Count an underrun, i.e. the reader wants a packet, but none is queued. The
+// time until the underrun ends is counted as blocked time, both for blocking
+// and for async reads.
+// called locked
+static void ds_mark_underrun(struct demux_stream *ds)
+{
+    if (!ds->stat_in_underrun) {
+        if (!ds->eof)
+            ds->stat_underruns++;
+        ds->stat_underrun_start = mp_time_sec();
+    }
+    ds->stat_in_underrun = true;
+}
+
+// called locked
+static void ds_end_underrun(struct demux_stream *ds)
+{
+    if (ds->stat_in_underrun)
+        ds->stat_blocked += mp_time_sec() - ds->stat_underrun_start;
+    ds->stat_in_underrun = false;
+}
+
 // must be called locked; may temporarily unlock
 static void ds_get_packets(struct demux_stream *ds)
 {
@@ -650,7 +1139,10 @@ static void ds_get_packets(struct demux_stream *ds)
     MP_DBG(in, "reading packet for %s\n", t);
     in->eof = false; // force retry
     ds->eof = false;
-    while (ds->selected && !ds->head && !ds->eof) {
+    if (!ds->selected || ds->reader_head)
+        return;
+    ds_mark_underrun(ds);
+    while (ds->selected && !ds->reader_head && !ds->eof) {
         ds->active = true;
         // Note: the following code marks EOF if it can't continue
         if (in->threading) {
@@ -661,6 +1153,8 @@ static void ds_get_packets(struct demux_stream *ds)
             read_packet(in);
         }
     }
+    if (!ds->reader_head)
+        ds_end_underrun(ds); // EOF or deselected
 }
 
 static void execute_trackswitch(struct demux_internal *in)
@@ -701,6 +1195,147 @@ static void execute_seek(struct demux_internal *in)
     pthread_mutex_lock(&in->lock);
 }
 
+// Whether the stream can be opened a second time, independently of the first.
+static bool can_reopen_stream(struct stream *s)
+{
+    if (!s->seekable || !s->url)
+        return false;
+    if (s->is_network)
+        return true;
+    return s->uncached_type == STREAMTYPE_FILE && strcmp(s->url, "-") != 0 &&
+           strncmp(s->url, "fd://", 5) != 0;
+}
+
+// Read the packets of a newly selected stream from the playback position up to
+// the current read position of the demuxer, using a second demuxer instance on
+// the same file. Unlike a refresh seek, this leaves the main read position and
+// the queues of the other streams alone. Returns false if not possible, in
+// which case the caller should fall back to a refresh seek. Also returns true
+// if the packets became stale meanwhile (and were dropped).
+// called locked, from the demuxer thread.
+static bool prefill_stream(struct demux_internal *in, struct demux_stream *ds)
+{
+    struct demuxer *demux = in->d_thread;
+    struct sh_stream *sh = NULL;
+
+    if (!demux->desc->seek || !demux->seekable || demux->partially_seekable ||
+        demux->desc == &demuxer_desc_timeline || !can_reopen_stream(demux->stream))
+        return false;
+
+    // The handover to the main demuxer happens at the file position of the
+    // last packet read, so this must be known for all other streams.
+    double start_ts = in->ref_pts;
+    int64_t stop_pos = -1;
+    for (int n = 0; n < in->num_streams; n++) {
+        struct demux_stream *other = in->streams[n]->ds;
+        if (other == ds)
+            sh = in->streams[n];
+        if (other == ds || !other->selected)
+            continue;
+        if (!other->queue->correct_pos || other->queue->last_pos < 0)
+            return false;
+        stop_pos = MPMAX(stop_pos, other->queue->last_pos);
+        if (other->type == STREAM_VIDEO || other->type == STREAM_AUDIO)
+            start_ts = MP_PTS_MIN(start_ts, other->base_ts);
+    }
+    if (stop_pos < 0 || start_ts == MP_NOPTS_VALUE)
+        return false;
+
+    char *url = talloc_strdup(NULL, demux->stream->url);
+    struct demuxer_params params = {
+        .force_format = (char *)demux->desc->name,
+        .disable_cache = true,
+    };
+    struct mp_cancel *cancel = demux->stream->cancel;
+    struct mpv_global *global = demux->global;
+
+    pthread_mutex_unlock(&in->lock);
+
+    MP_VERBOSE(in, "prefilling %s stream %d from %f\n",
+               stream_type_name(sh->type), sh->index, start_ts);
+
+    bool ok = false, stale = false;
+    struct demuxer *second = demux_open_url(url, &params, cancel, global);
+    struct sh_stream *sh2 = NULL;
+    if (second && sh->index < demux_get_num_stream(second)) {
+        sh2 = demux_get_stream(second, sh->index);
+        if (sh2->type != sh->type || !sh2->codec->codec || !sh->codec->codec ||
+            strcmp(sh2->codec->codec, sh->codec->codec) != 0)
+            sh2 = NULL;
+    }
+    if (sh2) {
+        demuxer_select_track(second, sh2, MP_NOPTS_VALUE, true);
+        if (demux_seek(second, start_ts - 1.0, SEEK_BACKWARD | SEEK_HR)) {
+            int64_t num = 0;
+            while (1) {
+                struct demux_packet *pkt = demux_read_packet(sh2);
+                if (!pkt || pkt->pos < 0 || mp_cancel_test(cancel)) {
+                    talloc_free(pkt);
+                    break;
+                }
+                if (pkt->pos > stop_pos) {
+                    talloc_free(pkt);
+                    ok = true;
+                    break;
+                }
+                pkt->codec = NULL;
+                pkt->start = pkt->end = MP_NOPTS_VALUE;
+                pkt->new_segment = false;
+                // The player may have seeked, or deselected and reselected
+                // the track meanwhile. The packets are stale then, and the
+                // new state is handled by the normal seek/refresh logic.
+                pthread_mutex_lock(&in->lock);
+                stale = !ds->selected || in->seeking || ds->need_prefill ||
+                        ds->need_refresh;
+                if (!stale)
+                    add_packet_locked(sh, pkt);
+                pthread_mutex_unlock(&in->lock);
+                if (stale) {
+                    talloc_free(pkt);
+                    break;
+                }
+                num++;
+            }
+            MP_VERBOSE(in, "prefilled %"PRId64" packets\n", num);
+        }
+    }
+    free_demuxer_and_stream(second);
+    talloc_free(url);
+
+    pthread_mutex_lock(&in->lock);
+
+    if (stale)
+        return true;
+
+    if (ok && ds->selected) {
+        // Drop packets the main demuxer returns for positions that were
+        // already read by the second demuxer.
+        ds->refreshing = ds->queue->last_pos >= 0;
+    }
+    return ok;
+}
+
+// called locked, from the demuxer thread.
+static void execute_prefill(struct demux_internal *in)
+{
+    in->need_prefill = false;
+
+    for (int n = 0; n < in->num_streams; n++) {
+        struct demux_stream *ds = in->streams[n]->ds;
+        if (!ds->need_prefill)
+            continue;
+        ds->need_prefill = false;
+        if (!ds->selected || in->seeking)
+            continue;
+        if (!prefill_stream(in, ds)) {
+            if (ds->selected && !in->seeking) {
+                ds_flush(ds);
+                ds->need_refresh = true;
+            }
+        }
+    }
+}
+
 static void *demux_thread(void *pctx)
 {
     struct demux_internal *in = pctx;
@@ -717,6 +1352,10 @@ static void *demux_thread(void *pctx)
             execute_trackswitch(in);
             continue;
         }
+        if (in->need_prefill) {
+            execute_prefill(in);
+            continue;
+        }
         if (in->seeking) {
             execute_seek(in);
             continue;
@@ -739,17 +1378,111 @@ static void *demux_thread(void *pctx)
     return NULL;
 }
 
+// Remove the oldest packet from the queue. It must not be the reader position.
+static void queue_drop_head(struct demux_queue *queue)
+{
+    struct demux_packet *dp = queue->head;
+    assert(dp && dp != queue->ds->reader_head);
+    queue->head = dp->next;
+    if (!queue->head)
+        queue->tail = NULL;
+    if (queue->keyframe_latest == dp)
+        queue->keyframe_latest = NULL;
+    queue->bytes -= dp->len;
+    free_demux_packet(dp);
+}
+
+// Drop the oldest keyframe range of the stream with the oldest packets in the
+// given range. Returns false if there was nothing to drop.
+static bool prune_range(struct demux_cached_range *range)
+{
+    struct demux_queue *oldest = NULL;
+    double oldest_ts = MP_NOPTS_VALUE;
+    for (int n = 0; n < range->num_streams; n++) {
+        struct demux_queue *queue = range->streams[n];
+        if (!queue->head || queue->head == queue->ds->reader_head)
+            continue;
+        struct demux_packet *dp = queue->head;
+        double ts = dp->dts == MP_NOPTS_VALUE ? dp->pts : dp->dts;
+        if (!oldest || (ts != MP_NOPTS_VALUE &&
+                        (oldest_ts == MP_NOPTS_VALUE || ts < oldest_ts)))
+        {
+            oldest = queue;
+            oldest_ts = ts;
+        }
+    }
+    if (!oldest)
+        return false;
+    queue_drop_head(oldest);
+    while (oldest->head && oldest->head != oldest->ds->reader_head &&
+           !oldest->head->keyframe)
+        queue_drop_head(oldest);
+    return true;
+}
+
+// Drop cached packets until the back buffer fits into the budget. The back
+// buffer consists of all packets not in the readahead of the current range.
+// Data is removed from the least recently used range first, and from the
+// current range only if nothing else is left. Data is removed from the start
+// of a range, and always up to the next keyframe, so that all remaining ranges
+// start at a keyframe.
+static void prune_back_buffer(struct demux_internal *in)
+{
+    while (1) {
+        size_t total = 0;
+        for (int n = 0; n < in->num_ranges; n++) {
+            struct demux_cached_range *range = in->ranges[n];
+            for (int i = 0; i < range->num_streams; i++)
+                total += range->streams[i]->bytes;
+        }
+        for (int n = 0; n < in->num_streams; n++)
+            total -= in->streams[n]->ds->bytes;
+        if (total <= (size_t)in->max_bytes_bw)
+            break;
+
+        struct demux_cached_range *range = in->ranges[0];
+        if (!prune_range(range)) {
+            if (range == in->current_range)
+                break;
+            free_cached_range(in, range);
+            continue;
+        }
+        bool empty = true;
+        for (int i = 0; i < range->num_streams; i++)
+            empty &= !range->streams[i]->head;
+        if (empty && range != in->current_range)
+            free_cached_range(in, range);
+    }
+}
+
 static struct demux_packet *dequeue_packet(struct demux_stream *ds)
 {
-    if (!ds->head)
+    if (!ds->reader_head)
         return NULL;
-    struct demux_packet *pkt = ds->head;
-    ds->head = pkt->next;
-    pkt->next = NULL;
-    if (!ds->head)
-        ds->tail = NULL;
+    struct demux_packet *pkt = ds->reader_head;
+    ds->reader_head = pkt->next;
     ds->bytes -= pkt->len;
     ds->packs--;
+    ds->stat_packets_out++;
+    ds_end_underrun(ds);
+
+    if (ds->in->max_bytes_bw > 0) {
+        // Keep the packet for in-memory seeking. The decoder gets a new
+        // reference to the same data.
+        pkt = demux_copy_packet(pkt);
+        prune_back_buffer(ds->in);
+        if (!pkt)
+            return NULL;
+    } else {
+        struct demux_queue *queue = ds->queue;
+        queue->head = ds->reader_head;
+        queue->bytes -= pkt->len;
+        if (!queue->head)
+            queue->tail = NULL;
+        if (queue->keyframe_latest == pkt)
+            queue->keyframe_latest = NULL;
+        pkt->next = NULL;
+    }
 
     double ts = pkt->dts == MP_NOPTS_VALUE ? pkt->pts : pkt->dts;
     if (ts != MP_NOPTS_VALUE)
@@ -842,6 +1575,11 @@ int demux_read_packet_async(struct sh_stream *sh, struct demux_packet **out_pkt)
                 r = *out_pkt ? 1 : -1;
             } else {
                 r = *out_pkt ? 1 : ((ds->eof || !ds->selected) ? -1 : 0);
+                if (r == 0) {
+                    ds_mark_underrun(ds);
+                } else if (r < 0) {
+                    ds_end_underrun(ds);
+                }
                 ds->active = ds->selected; // enable readahead
                 ds->in->eof = false; // force retry
                 pthread_cond_signal(&ds->in->wakeup); // possibly read more
@@ -861,7 +1599,7 @@ bool demux_has_packet(struct sh_stream *sh)
     bool has_packet = false;
     if (sh) {
         pthread_mutex_lock(&sh->ds->in->lock);
-        has_packet = sh->ds->head;
+        has_packet = sh->ds->reader_head;
         pthread_mutex_unlock(&sh->ds->in->lock);
     }
     return has_packet;
@@ -1192,6 +1930,7 @@ static struct demuxer *open_given_type(struct mpv_global *global,
         .filename = talloc_strdup(demuxer, stream->url),
         .is_network = stream->is_network,
         .events = DEMUX_EVENT_ALL,
+        .packet_pool = demux_packet_pool_create(),
     };
     demuxer->seekable = stream->seekable;
     if (demuxer->stream->uncached_stream &&
@@ -1207,13 +1946,25 @@ static struct demuxer *open_given_type(struct mpv_global *global,
         .min_secs = demuxer->opts->demuxer_min_secs,
         .max_packs = demuxer->opts->demuxer_max_packs,
         .max_bytes = demuxer->opts->demuxer_max_bytes,
+        .max_bytes_bw = demuxer->opts->demuxer_max_back_bytes,
+        .prefill_tracks = demuxer->opts->demuxer_prefill_tracks,
+        .max_bytes_type = {
+            [STREAM_VIDEO] = demuxer->opts->demuxer_max_bytes_video,
+            [STREAM_AUDIO] = demuxer->opts->demuxer_max_bytes_audio,
+            [STREAM_SUB] = demuxer->opts->demuxer_max_bytes_sub,
+        },
         .initial_state = true,
     };
+    in->current_range = add_cached_range(in);
+    in->memgov = mp_memgov_register(global->memgov, "demuxer",
+                                    MP_MEMGOV_READAHEAD, in->max_bytes);
     pthread_mutex_init(&in->lock, NULL);
     pthread_cond_init(&in->wakeup, NULL);
 
-    if (stream->uncached_stream)
+    if (stream->uncached_stream) {
         in->min_secs = MPMAX(in->min_secs, demuxer->opts->demuxer_min_secs_cache);
+        in->adapt_max = demuxer->opts->stream_cache.adaptive_max * 1024LL;
+    }
 
     *in->d_thread = *demuxer;
     *in->d_buffer = *demuxer;
@@ -1276,6 +2027,99 @@ static const int d_normal[]  = {DEMUX_CHECK_NORMAL, DEMUX_CHECK_UNSAFE, -1};
 static const int d_request[] = {DEMUX_CHECK_REQUEST, -1};
 static const int d_force[]   = {DEMUX_CHECK_FORCE, -1};
 
+// Recently successful probe results, keyed by file extension and the first
+// bytes of the file (for --demuxer-fast-probe).
+#define PROBE_CACHE_SIZE 16
+#define PROBE_MAGIC_SIZE 16
+
+struct probe_key {
+    char ext[16];
+    uint8_t magic[PROBE_MAGIC_SIZE];
+    int magic_len;
+};
+
+struct probe_cache_entry {
+    struct probe_key key;
+    const struct demuxer_desc *desc;
+    char lavf_type[32];         // libavformat format name if desc is lavf
+};
+
+static pthread_mutex_t probe_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct probe_cache_entry probe_cache[PROBE_CACHE_SIZE];
+static int probe_cache_next;
+
+static void get_probe_key(struct stream *stream, struct probe_key *key)
+{
+    *key = (struct probe_key){0};
+    char *ext = mp_splitext(stream->url, NULL);
+    for (int n = 0; ext && ext[n] && n < sizeof(key->ext) - 1; n++)
+        key->ext[n] = mp_tolower(ext[n]);
+    bstr magic = stream_peek(stream, PROBE_MAGIC_SIZE);
+    memcpy(key->magic, magic.start, magic.len);
+    key->magic_len = magic.len;
+}
+
+static bool probe_cache_lookup(struct probe_key *key,
+                               struct probe_cache_entry *out)
+{
+    bool found = false;
+    pthread_mutex_lock(&probe_cache_lock);
+    for (int n = 0; n < PROBE_CACHE_SIZE; n++) {
+        struct probe_cache_entry *e = &probe_cache[n];
+        if (e->desc && memcmp(&e->key, key, sizeof(*key)) == 0) {
+            *out = *e;
+            found = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&probe_cache_lock);
+    return found;
+}
+
+static void probe_cache_add(struct probe_key *key,
+                            const struct demuxer_desc *desc,
+                            struct demuxer *demuxer)
+{
+    if (!key->magic_len)
+        return;
+    struct probe_cache_entry entry = { .key = *key, .desc = desc };
+    if (strcmp(desc->name, "lavf") == 0 && demuxer->filetype)
+        snprintf(entry.lavf_type, sizeof(entry.lavf_type), "%s", demuxer->filetype);
+    pthread_mutex_lock(&probe_cache_lock);
+    struct probe_cache_entry *e = NULL;
+    for (int n = 0; n < PROBE_CACHE_SIZE; n++) {
+        if (memcmp(&probe_cache[n].key, key, sizeof(*key)) == 0)
+            e = &probe_cache[n];
+    }
+    if (!e) {
+        e = &probe_cache[probe_cache_next];
+        probe_cache_next = (probe_cache_next + 1) % PROBE_CACHE_SIZE;
+    }
+    *e = entry;
+    pthread_mutex_unlock(&probe_cache_lock);
+}
+
+// Try the demuxer that opened the last file with the same probe key. For lavf,
+// the format is forced, which skips libavformat probing.
+static struct demuxer *open_cached_type(struct mpv_global *global,
+                                        struct mp_log *log,
+                                        struct stream *stream,
+                                        struct demuxer_params *params,
+                                        struct probe_key *key)
+{
+    struct probe_cache_entry entry;
+    if (!probe_cache_lookup(key, &entry))
+        return NULL;
+    mp_verbose(log, "Trying demuxer %s%s%s from probe cache.\n",
+               entry.desc->name, entry.lavf_type[0] ? "/" : "", entry.lavf_type);
+    if (entry.lavf_type[0])
+        stream->lavf_type = entry.lavf_type;
+    struct demuxer *demuxer = open_given_type(global, log, entry.desc, stream,
+                                              params, DEMUX_CHECK_REQUEST);
+    stream->lavf_type = NULL;
+    return demuxer;
+}
+
 // params can be NULL
 struct demuxer *demux_open(struct stream *stream, struct demuxer_params *params,
                            struct mpv_global *global)
@@ -1305,6 +2149,19 @@ struct demuxer *demux_open(struct stream *stream, struct demuxer_params *params,
         }
     }
 
+    struct probe_key key;
+    bool use_probe_cache = !check_desc && !stream->lavf_type &&
+                           global->opts->demuxer_fast_probe;
+    if (use_probe_cache) {
+        get_probe_key(stream, &key);
+        demuxer = open_cached_type(global, log, stream, params, &key);
+        if (demuxer) {
+            talloc_steal(demuxer, log);
+            log = NULL;
+            goto done;
+        }
+    }
+
     // Test demuxers from first to last, one pass for each check_levels[] entry
     for (int pass = 0; check_levels[pass] != -1; pass++) {
         enum demux_check level = check_levels[pass];
@@ -1314,6 +2171,8 @@ struct demuxer *demux_open(struct stream *stream, struct demuxer_params *params,
             if (!check_desc || desc == check_desc) {
                 demuxer = open_given_type(global, log, desc, stream, params, level);
                 if (demuxer) {
+                    if (use_probe_cache && demuxer->desc == desc)
+                        probe_cache_add(&key, desc, demuxer);
                     talloc_steal(demuxer, log);
                     log = NULL;
                     goto done;
@@ -1360,12 +2219,14 @@ struct demuxer *demux_open_url(const char *url,
 
 static void flush_locked(demuxer_t *demuxer)
 {
-    for (int n = 0; n < demuxer->in->num_streams; n++)
-        ds_flush(demuxer->in->streams[n]->ds);
-    demuxer->in->warned_queue_overflow = false;
-    demuxer->in->eof = false;
-    demuxer->in->last_eof = false;
-    demuxer->in->idle = true;
+    struct demux_internal *in = demuxer->in;
+    for (int n = 0; n < in->num_streams; n++)
+        ds_flush(in->streams[n]->ds);
+    free_other_ranges(in);
+    in->warned_queue_overflow = false;
+    in->eof = false;
+    in->last_eof = false;
+    in->idle = true;
     demuxer->filepos = -1; // implicitly synchronized
 }
 
@@ -1377,6 +2238,107 @@ void demux_flush(demuxer_t *demuxer)
     pthread_mutex_unlock(&demuxer->in->lock);
 }
 
+// Return the keyframe packet that is the best seek target for pts, or NULL if
+// there is none.
+static struct demux_packet *find_seek_target(struct demux_queue *queue,
+                                             double pts, int flags)
+{
+    struct demux_packet *target = NULL;
+    struct demux_packet *before = NULL;
+    for (struct demux_packet *dp = queue->head; dp; dp = dp->next) {
+        if (!dp->keyframe || dp->kf_seek_pts == MP_NOPTS_VALUE)
+            continue;
+        double ts = dp->kf_seek_pts;
+        if (ts <= pts) {
+            if (!before || ts > before->kf_seek_pts)
+                before = dp;
+        } else if (flags & SEEK_FORWARD) {
+            if (!target || ts < target->kf_seek_pts)
+                target = dp;
+        }
+    }
+    return target ? target : before;
+}
+
+// Return the cached range which contains pts, or NULL.
+static struct demux_cached_range *find_cache_seek_range(struct demux_internal *in,
+                                                        double pts, int flags)
+{
+    for (int n = in->num_ranges - 1; n >= 0; n--) {
+        struct demux_cached_range *range = in->ranges[n];
+        double start, end;
+        if (!get_range_seek_bounds(in, range, &start, &end))
+            continue;
+        MP_VERBOSE(in, "cached range %d: %f - %f\n", n, start, end);
+        if (pts < start || pts > end)
+            continue;
+        if (range != in->current_range && !range_is_resumable(range))
+            continue;
+        bool ok = true;
+        for (int i = 0; i < range->num_streams; i++) {
+            struct demux_queue *queue = range->streams[i];
+            if (queue->ds->selected && queue->ds->type != STREAM_SUB)
+                ok &= !!find_seek_target(queue, pts, flags);
+        }
+        if (ok)
+            return range;
+    }
+    return NULL;
+}
+
+// Try to seek by moving the reader position within the already demuxed
+// packets. If the target is in the current range, no low-level seek is done,
+// and the demuxer thread continues reading at the end of the cached data. If
+// it's in another range, a low-level seek to the end of that range is queued.
+// Must be called locked. pts is in demuxer timebase (without ts_offset).
+static bool try_seek_cache(struct demux_internal *in, double pts, int flags)
+{
+    if ((flags & SEEK_FACTOR) || in->max_bytes_bw <= 0)
+        return false;
+
+    struct demux_cached_range *range = find_cache_seek_range(in, pts, flags);
+    if (!range)
+        return false;
+
+    bool switched = range != in->current_range;
+    if (switched) {
+        MP_VERBOSE(in, "switching to other cached range\n");
+        switch_current_range(in, range);
+    }
+
+    for (int n = 0; n < in->num_streams; n++) {
+        struct demux_stream *ds = in->streams[n]->ds;
+        struct demux_queue *queue = ds->queue;
+        if (!ds->selected)
+            continue;
+        // For subtitles, this picks the last packet before the seek target,
+        // or the start of the buffered data if there is none.
+        struct demux_packet *target = find_seek_target(queue, pts, flags);
+        if (!target)
+            target = queue->head;
+
+        ds->reader_head = target;
+        ds->packs = ds->bytes = 0;
+        for (struct demux_packet *dp = target; dp; dp = dp->next) {
+            ds->packs++;
+            ds->bytes += dp->len;
+        }
+        if (ds->reader_head) {
+            struct demux_packet *dp = ds->reader_head;
+            ds->base_ts = dp->dts == MP_NOPTS_VALUE ? dp->pts : dp->dts;
+            ds->eof = false;
+        }
+        ds->last_ts = queue->seek_end;
+        ds->last_br_ts = MP_NOPTS_VALUE;
+        ds->last_br_bytes = 0;
+        ds->bitrate = -1;
+    }
+
+    if (switched)
+        seek_to_range_end(in);
+    return true;
+}
+
 int demux_seek(demuxer_t *demuxer, double seek_pts, int flags)
 {
     struct demux_internal *in = demuxer->in;
@@ -1395,15 +2357,46 @@ int demux_seek(demuxer_t *demuxer, double seek_pts, int flags)
 
     pthread_mutex_lock(&in->lock);
 
+    double internal_pts = seek_pts;
+    if (!(flags & SEEK_FACTOR))
+        internal_pts = MP_ADD_PTS(internal_pts, -in->ts_offset);
+
+    if (try_seek_cache(in, internal_pts, flags)) {
+        MP_VERBOSE(in, "in-cache seek to %f\n", seek_pts);
+        demuxer->filepos = -1;
+        if (!in->threading && in->seeking)
+            execute_seek(in);
+        pthread_cond_signal(&in->wakeup);
+        pthread_mutex_unlock(&in->lock);
+        return 1;
+    }
+
     MP_VERBOSE(in, "queuing seek to %f%s\n", seek_pts,
                in->seeking ? " (cascade)" : "");
 
-    flush_locked(demuxer);
+    if (in->max_bytes_bw > 0 && !(flags & SEEK_FACTOR)) {
+        // Keep the current range for later seeks, and start a new one.
+        bool empty = true;
+        for (int n = 0; n < in->num_streams; n++)
+            empty &= !in->current_range->streams[n]->head;
+        if (empty) {
+            for (int n = 0; n < in->num_streams; n++)
+                ds_flush(in->streams[n]->ds);
+        } else {
+            switch_current_range(in, add_cached_range(in));
+        }
+        in->warned_queue_overflow = false;
+        in->eof = false;
+        in->last_eof = false;
+        in->idle = true;
+        demuxer->filepos = -1;
+        prune_back_buffer(in);
+    } else {
+        flush_locked(demuxer);
+    }
     in->seeking = true;
     in->seek_flags = flags;
-    in->seek_pts = seek_pts;
-    if (!(flags & SEEK_FACTOR))
-        in->seek_pts = MP_ADD_PTS(in->seek_pts, -in->ts_offset);
+    in->seek_pts = internal_pts;
 
     if (!in->threading)
         execute_seek(in);
@@ -1438,10 +2431,18 @@ void demuxer_select_track(struct demuxer *demuxer, struct sh_stream *stream,
     if (stream->ds->selected != selected) {
         stream->ds->selected = selected;
         ds_flush(stream->ds);
+        // Other cached ranges were read with a different set of streams.
+        free_other_ranges(in);
         in->tracks_switched = true;
         stream->ds->need_refresh = selected && !in->initial_state;
         if (stream->ds->need_refresh)
             in->ref_pts = MP_ADD_PTS(ref_pts, -in->ts_offset);
+        if (stream->ds->need_refresh && in->prefill_tracks && in->threading &&
+            in->ref_pts != MP_NOPTS_VALUE)
+        {
+            stream->ds->need_refresh = false;
+            stream->ds->need_prefill = in->need_prefill = true;
+        }
         if (in->threading) {
             pthread_cond_signal(&in->wakeup);
         } else {
@@ -1517,6 +2518,61 @@ int demuxer_add_chapter(demuxer_t *demuxer, char *name,
     return demuxer->num_chapters - 1;
 }
 
+// The pool is thread-safe, so this doesn't need to synchronize with the
+// demuxer thread.
+bool demux_get_packet_pool_stats(struct demuxer *demuxer,
+                                 struct demux_packet_pool_stats *stats)
+{
+    if (!demuxer->packet_pool)
+        return false;
+    demux_packet_pool_get_stats(demuxer->packet_pool, stats);
+    return true;
+}
+
+void demux_get_stream_stats(struct sh_stream *sh,
+                            struct demux_stream_stats *stats)
+{
+    struct demux_stream *ds = sh->ds;
+    pthread_mutex_lock(&ds->in->lock);
+
+    // Rates are averaged over at least 1 second between queries.
+    double now = mp_time_sec();
+    double d = now - ds->stat_rate_time;
+    if (ds->stat_rate_time == 0) {
+        ds->stat_in_rate = ds->stat_out_rate = -1;
+        ds->stat_rate_time = now;
+        ds->stat_rate_in = ds->stat_packets_in;
+        ds->stat_rate_out = ds->stat_packets_out;
+    } else if (d >= 1.0) {
+        ds->stat_in_rate = (ds->stat_packets_in - ds->stat_rate_in) / d;
+        ds->stat_out_rate = (ds->stat_packets_out - ds->stat_rate_out) / d;
+        ds->stat_rate_time = now;
+        ds->stat_rate_in = ds->stat_packets_in;
+        ds->stat_rate_out = ds->stat_packets_out;
+    }
+
+    double secs = -1;
+    if (ds->reader_head && ds->last_ts != MP_NOPTS_VALUE &&
+        ds->base_ts != MP_NOPTS_VALUE && ds->last_ts >= ds->base_ts)
+        secs = ds->last_ts - ds->base_ts;
+
+    *stats = (struct demux_stream_stats){
+        .selected = ds->selected,
+        .queued_secs = secs,
+        .queued_bytes = ds->bytes,
+        .queued_packets = ds->packs,
+        .packets_in = ds->stat_packets_in,
+        .packets_out = ds->stat_packets_out,
+        .packets_in_rate = ds->stat_in_rate,
+        .packets_out_rate = ds->stat_out_rate,
+        .blocked_secs = ds->stat_blocked +
+            (ds->stat_in_underrun ? now - ds->stat_underrun_start : 0),
+        .underruns = ds->stat_underruns,
+    };
+
+    pthread_mutex_unlock(&ds->in->lock);
+}
+
 double demuxer_get_time_length(struct demuxer *demuxer)
 {
     double len;
@@ -1525,6 +2581,80 @@ double demuxer_get_time_length(struct demuxer *demuxer)
     return -1;
 }
 
+// Minimum time between two cache resizes. Resizing copies the cache contents.
+#define ADAPT_RESIZE_INTERVAL 10.0
+
+// Adjust the readahead duration and the stream cache size according to the
+// ratio of download speed to bitrate, and to how much the speed fluctuates.
+// must be called not locked
+static void adapt_cache(struct demux_internal *in,
+                        struct stream_cache_info *info)
+{
+    struct MPOpts *opts = in->d_thread->opts;
+    double now = mp_time_sec();
+
+    // The cache updates its speed estimate once per second. If it's idle,
+    // the speed says nothing about the link.
+    if (!in->adapt_max || info->size < 0 || info->idle || info->speed <= 0 ||
+        now - in->adapt_last < 1.0)
+        return;
+    in->adapt_last = now;
+
+    double speed = info->speed;
+    if (in->adapt_speed <= 0) {
+        in->adapt_speed = speed;
+    } else {
+        double d = speed - in->adapt_speed;
+        in->adapt_speed += 0.2 * d;
+        in->adapt_speed_var = 0.8 * (in->adapt_speed_var + 0.2 * d * d);
+    }
+
+    pthread_mutex_lock(&in->lock);
+    double bitrate = 0;
+    for (int n = 0; n < in->num_streams; n++) {
+        struct demux_stream *ds = in->streams[n]->ds;
+        if (ds->selected && ds->bitrate > 0)
+            bitrate += ds->bitrate;
+    }
+    if (bitrate <= 0) {
+        pthread_mutex_unlock(&in->lock);
+        return;
+    }
+
+    // Buffer more if the link is barely faster than the media, or if its
+    // speed varies a lot, and less if it's much faster.
+    double ratio = in->adapt_speed / bitrate;
+    double cv = sqrt(in->adapt_speed_var) / in->adapt_speed;
+    double factor = MPCLAMP((1 + 2 * cv) * 2.0 / MPMAX(ratio, 0.1), 0.5, 4.0);
+    double secs = opts->demuxer_min_secs_cache * factor;
+
+    // Cache size needed for this; the extra half is for the demuxer's own
+    // packet queue lagging behind. The option limit wins over the minimum.
+    int64_t size = MPMIN(MPMAX(secs * bitrate * 1.5, 1024 * 1024),
+                         in->adapt_max);
+    secs = MPMIN(secs, size / (bitrate * 1.5));
+    secs = MPMAX(secs, opts->demuxer_min_secs);
+    if (fabs(in->min_secs - secs) > 0.5) {
+        MP_VERBOSE(in, "Adaptive cache: speed %.0f KB/s, bitrate %.0f KB/s, "
+                   "variation %.2f -> readahead %.1f s\n", in->adapt_speed / 1024,
+                   bitrate / 1024, cv, secs);
+        in->min_secs = secs;
+        pthread_cond_signal(&in->wakeup);
+    }
+    pthread_mutex_unlock(&in->lock);
+
+    // Resizing is a blocking operation; avoid it for small changes.
+    int64_t cur = in->adapt_size ? in->adapt_size : info->size;
+    if (now - in->adapt_last_resize >= ADAPT_RESIZE_INTERVAL &&
+        (size > cur * 5 / 4 || size < cur * 3 / 4))
+    {
+        in->adapt_last_resize = now;
+        struct stream *stream = in->d_thread->stream;
+        if (stream_control(stream, STREAM_CTRL_SET_CACHE_SIZE, &size) == STREAM_OK)
+            in->adapt_size = size;
+    }
+}
+
 // must be called not locked
 static void update_cache(struct demux_internal *in)
 {
@@ -1555,6 +2685,8 @@ static void update_cache(struct demux_internal *in)
         in->d_buffer->events |= DEMUX_EVENT_METADATA;
     }
     pthread_mutex_unlock(&in->lock);
+
+    adapt_cache(in, &stream_cache_info);
 }
 
 // must be called locked
@@ -1625,7 +2757,7 @@ static int cached_demux_control(struct demux_internal *in, int cmd, void *arg)
         for (int n = 0; n < in->num_streams; n++) {
             struct demux_stream *ds = in->streams[n]->ds;
             if (ds->active) {
-                r->underrun |= !ds->head && !ds->eof;
+                r->underrun |= !ds->reader_head && !ds->eof;
                 r->ts_range[0] = MP_PTS_MAX(r->ts_range[0], ds->base_ts);
                 r->ts_range[1] = MP_PTS_MIN(r->ts_range[1], ds->last_ts);
                 num_packets += ds->packs;
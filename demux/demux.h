@@ -52,6 +52,20 @@ struct demux_ctrl_reader_state {
     double ts_duration;
 };
 
+// Per-stream statistics, see demux_get_stream_stats().
+struct demux_stream_stats {
+    bool selected;
+    double queued_secs;         // readahead duration (-1 if unknown)
+    int64_t queued_bytes;       // readahead size
+    int64_t queued_packets;
+    int64_t packets_in;         // total packets added by the demuxer
+    int64_t packets_out;        // total packets returned to the decoder
+    double packets_in_rate;     // packets/second (-1 if not known yet)
+    double packets_out_rate;
+    double blocked_secs;        // total time the reader waited for packets
+    int64_t underruns;          // number of times the reader ran out of packets
+};
+
 struct demux_ctrl_stream_ctrl {
     int ctrl;
     void *arg;
@@ -160,6 +174,15 @@ struct demuxer_params {
     struct matroska_segment_uid *matroska_wanted_uids;
     int matroska_wanted_segment;
     bool *matroska_was_valid;
+    // If set, receives the segment UID of the probed segment, even if the
+    // segment was rejected because it's not one of the wanted ones.
+    struct matroska_segment_uid *matroska_found_uid;
+    // Set to true if the segment info was read, i.e. matroska_found_uid is
+    // valid (it stays all-zero if the segment has no UID).
+    bool *matroska_found_info;
+    // Set to true if the file was read successfully, but is not Matroska or
+    // has no segment matroska_wanted_segment. Not set on I/O errors.
+    bool *matroska_no_segment;
     struct timeline *timeline;
     // -- demux_open_url() only
     int stream_flags;
@@ -212,6 +235,9 @@ typedef struct demuxer {
     struct mp_log *log, *glog;
     struct demuxer_params *params;
 
+    // Recycles packet buffers; can be used with new_demux_packet_pool().
+    struct demux_packet_pool *packet_pool;
+
     // internal to demux.c
     struct demux_internal *in;
     struct mp_tags **update_stream_tags;
@@ -259,6 +285,7 @@ struct demuxer *demux_open_url(const char *url,
 
 void demux_start_thread(struct demuxer *demuxer);
 void demux_stop_thread(struct demuxer *demuxer);
+void demux_start_prefetch(struct demuxer *demuxer);
 void demux_set_wakeup_cb(struct demuxer *demuxer, void (*cb)(void *ctx), void *ctx);
 
 bool demux_cancel_test(struct demuxer *demuxer);
@@ -284,6 +311,11 @@ void demux_set_stream_tags(struct demuxer *demuxer, struct sh_stream *sh,
 
 double demuxer_get_time_length(struct demuxer *demuxer);
 
+bool demux_get_packet_pool_stats(struct demuxer *demuxer,
+                                 struct demux_packet_pool_stats *stats);
+void demux_get_stream_stats(struct sh_stream *sh,
+                            struct demux_stream_stats *stats);
+
 int demux_stream_control(demuxer_t *demuxer, int ctrl, void *arg);
 
 void demux_run_on_thread(struct demuxer *demuxer, void (*fn)(void *), void *ctx);
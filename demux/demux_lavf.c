@@ -56,6 +56,7 @@
 // Should correspond to IO_BUFFER_SIZE in libavformat/aviobuf.c (not public)
 // libavformat (almost) always reads data in blocks of this size.
 #define BIO_BUFFER_SIZE 32768
+#define AUTO_BUFFER_SIZE (256 * 1024)
 
 #define OPT_BASE_STRUCT struct demux_lavf_opts
 struct demux_lavf_opts {
@@ -76,8 +77,8 @@ const struct m_sub_options demux_lavf_conf = {
         OPT_INTRANGE("probesize", probesize, 0, 32, INT_MAX),
         OPT_STRING("format", format, 0),
         OPT_FLOATRANGE("analyzeduration", analyzeduration, 0, 0, 3600),
-        OPT_INTRANGE("buffersize", buffersize, 0, 1, 10 * 1024 * 1024,
-                     OPTDEF_INT(BIO_BUFFER_SIZE)),
+        OPT_CHOICE_OR_INT("buffersize", buffersize, 0, 1, 10 * 1024 * 1024,
+                          ({"auto", 0})),
         OPT_FLAG("allow-mimetype", allow_mimetype, 0),
         OPT_INTRANGE("probescore", probescore, 0, 1, AVPROBE_SCORE_MAX),
         OPT_STRING("cryptokey", cryptokey, 0),
@@ -115,6 +116,9 @@ struct format_hack {
     // segment, with e.g. HLS, player knows about the playlist main file only).
     bool clear_filepos : 1;
     bool ignore_start : 1;
+    // Format has no index, and seeking bisects the file by timestamps. Record
+    // keyframe positions while demuxing, and use them for seeking.
+    bool learn_index : 1;
 };
 
 #define BLACKLIST(fmt) {fmt, .ignore = true}
@@ -131,8 +135,8 @@ static const struct format_hack format_hacks[] = {
     {"mp3", NULL,         24, .max_probe = true},
 
     {"hls", .no_stream = true, .clear_filepos = true},
-    {"mpeg", .use_stream_ids = true},
-    {"mpegts", .use_stream_ids = true},
+    {"mpeg", .use_stream_ids = true, .learn_index = true},
+    {"mpegts", .use_stream_ids = true, .learn_index = true},
 
     // In theory, such streams might contain timestamps, but virtually none do.
     {"h264", .if_flags = AVFMT_NOTIMESTAMPS },
@@ -160,6 +164,16 @@ static const struct format_hack format_hacks[] = {
     {0}
 };
 
+// Keyframe position seen while demuxing (see record_keyframe()).
+struct learned_index_entry {
+    double pts;
+    int64_t pos;
+    // The file was read contiguously from the previous entry to this one.
+    bool linked;
+};
+
+#define MAX_LEARNED_INDEX 100000
+
 typedef struct lavf_priv {
     struct stream *stream;
     bool own_stream;
@@ -174,6 +188,13 @@ typedef struct lavf_priv {
     int cur_program;
     char *mime_type;
     double seek_delay;
+
+    // Learned index, sorted by pts.
+    struct learned_index_entry *index;
+    int num_index;
+    int index_stream;           // AVStream the index refers to, or -1
+    int64_t index_last_pos;     // last recorded keyframe since seek, or -1
+    double index_last_pts;
 } lavf_priv_t;
 
 // At least mp4 has name="mov,mp4,m4a,3gp,3g2,mj2", so we split the name
@@ -207,6 +228,20 @@ static int mp_read(void *opaque, uint8_t *buf, int size)
     return ret;
 }
 
+// Buffer size for --demuxer-lavf-buffersize=auto. The bitrate isn't known
+// before opening, and libavformat has no public API to resize the buffer
+// later, so this goes by the stream type. Local files get a larger buffer, so
+// that high bitrate files need fewer mp_read() calls. Network streams keep the
+// small buffer: mp_read() blocks until the buffer is filled, which would delay
+// probing.
+static int get_auto_buffer_size(struct demuxer *demuxer)
+{
+    struct stream *s = demuxer->stream;
+    if (s->is_network || !s->seekable || stream_get_size(s) < 16 * 1024 * 1024)
+        return BIO_BUFFER_SIZE;
+    return AUTO_BUFFER_SIZE;
+}
+
 static int64_t mp_seek(void *opaque, int64_t pos, int whence)
 {
     struct demuxer *demuxer = opaque;
@@ -280,7 +315,8 @@ static void convert_charset(struct demuxer *demuxer)
         return;
     }
     void *alloc = data.start;
-    cp = (char *)mp_charset_guess(priv, demuxer->log, data, cp, 0);
+    cp = (char *)mp_charset_guess_sampled(priv, demuxer->log, data, cp, 0,
+                                          demuxer->opts->sub_cp_probe_size);
     if (cp && !mp_charset_is_utf8(cp))
         MP_INFO(demuxer, "Using subtitle charset: %s\n", cp);
     // libavformat transparently converts UTF-16 to UTF-8
@@ -496,6 +532,43 @@ static void guess_and_set_vobsub_name(struct demuxer *demuxer, AVDictionary **d)
     talloc_free(tmp);
 }
 
+static void reset_learned_index(struct demuxer *demuxer)
+{
+    lavf_priv_t *priv = demuxer->priv;
+    talloc_free(priv->index);
+    priv->index = NULL;
+    priv->num_index = 0;
+    priv->index_last_pos = -1;
+}
+
+// Use the first selected video stream for the learned index, or the first
+// selected audio stream if there is no video.
+static void select_index_stream(struct demuxer *demuxer)
+{
+    lavf_priv_t *priv = demuxer->priv;
+    if (!priv->format_hack.learn_index)
+        return;
+
+    int index_stream = -1;
+    for (int n = 0; n < priv->num_streams; n++) {
+        struct sh_stream *stream = priv->streams[n];
+        if (!stream || !demux_stream_is_selected(stream) ||
+            stream->attached_picture)
+            continue;
+        if (stream->type == STREAM_VIDEO) {
+            index_stream = n;
+            break;
+        }
+        if (stream->type == STREAM_AUDIO && index_stream < 0)
+            index_stream = n;
+    }
+
+    if (index_stream != priv->index_stream) {
+        reset_learned_index(demuxer);
+        priv->index_stream = index_stream;
+    }
+}
+
 static void select_tracks(struct demuxer *demuxer, int start)
 {
     lavf_priv_t *priv = demuxer->priv;
@@ -506,6 +579,88 @@ static void select_tracks(struct demuxer *demuxer, int start)
                         !stream->attached_picture;
         st->discard = selected ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
     }
+    select_index_stream(demuxer);
+}
+
+// Add a keyframe of the index stream to the learned index. Entries are linked
+// if they were read without seeking in between, so a seek target between two
+// linked entries is known to be covered by them.
+static void record_keyframe(struct demuxer *demuxer, struct sh_stream *stream,
+                            double pts, int64_t pos)
+{
+    lavf_priv_t *priv = demuxer->priv;
+    if (pts == MP_NOPTS_VALUE || pos < 0)
+        return;
+
+    if (priv->index_last_pos >= 0) {
+        if (pts <= priv->index_last_pts || pos <= priv->index_last_pos) {
+            // Timestamp reset or wraparound: pts -> pos is not a function
+            // anymore, so the index can't be trusted.
+            MP_VERBOSE(demuxer, "Timestamp discontinuity, disabling learned "
+                       "index.\n");
+            reset_learned_index(demuxer);
+            priv->format_hack.learn_index = false;
+            priv->index_stream = -1;
+            return;
+        }
+        // Every audio packet is a keyframe; don't record all of them.
+        if (stream->type != STREAM_VIDEO && pts - priv->index_last_pts < 1.0)
+            return;
+    }
+
+    int lo = 0, hi = priv->num_index;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (priv->index[mid].pts < pts) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    bool linked = lo > 0 && priv->index[lo - 1].pos == priv->index_last_pos;
+    if (lo < priv->num_index && priv->index[lo].pts == pts) {
+        // Known already.
+        priv->index[lo].linked |= linked;
+    } else {
+        if (priv->num_index >= MAX_LEARNED_INDEX) {
+            priv->index_last_pos = -1;
+            return;
+        }
+        struct learned_index_entry e = {pts, pos, linked};
+        MP_TARRAY_INSERT_AT(priv, priv->index, priv->num_index, lo, e);
+    }
+
+    priv->index_last_pos = priv->index[lo].pos;
+    priv->index_last_pts = pts;
+}
+
+// Return the byte position to seek to, or -1 if the learned index doesn't
+// cover the target.
+static int64_t lookup_learned_index(struct demuxer *demuxer, double pts,
+                                    int flags)
+{
+    lavf_priv_t *priv = demuxer->priv;
+
+    // Find the first entry after the target.
+    int lo = 0, hi = priv->num_index;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (priv->index[mid].pts <= pts) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    // The target must be between two linked entries.
+    if (lo == 0 || lo == priv->num_index || !priv->index[lo].linked)
+        return -1;
+
+    struct learned_index_entry *e = &priv->index[lo - 1];
+    if (!(flags & SEEK_BACKWARD) && e->pts < pts)
+        e = &priv->index[lo];
+    return e->pos;
 }
 
 static void export_replaygain(demuxer_t *demuxer, struct sh_stream *sh,
@@ -744,6 +899,8 @@ static int demux_open_lavf(demuxer_t *demuxer, enum demux_check check)
     lavf_priv_t *priv = talloc_zero(NULL, lavf_priv_t);
     demuxer->priv = priv;
     priv->stream = demuxer->stream;
+    priv->index_stream = -1;
+    priv->index_last_pos = -1;
 
     if (lavf_check_file(demuxer, check) < 0)
         return -1;
@@ -793,10 +950,13 @@ static int demux_open_lavf(demuxer_t *demuxer, enum demux_check check)
         // This might be incorrect.
         demuxer->seekable = true;
     } else {
-        void *buffer = av_malloc(lavfdopts->buffersize);
+        int buffersize = lavfdopts->buffersize;
+        if (!buffersize)
+            buffersize = get_auto_buffer_size(demuxer);
+        void *buffer = av_malloc(buffersize);
         if (!buffer)
             return -1;
-        priv->pb = avio_alloc_context(buffer, lavfdopts->buffersize, 0,
+        priv->pb = avio_alloc_context(buffer, buffersize, 0,
                                       demuxer, mp_read, NULL, mp_seek);
         if (!priv->pb) {
             av_free(buffer);
@@ -922,6 +1082,9 @@ static int demux_lavf_fill_buffer(demuxer_t *demux)
     if (priv->format_hack.clear_filepos)
         dp->pos = -1;
 
+    if (dp->keyframe && pkt->stream_index == priv->index_stream)
+        record_keyframe(demux, stream, dp->pts, dp->pos);
+
     demux_add_packet(stream, dp);
     return 1;
 }
@@ -954,6 +1117,18 @@ static void demux_seek_lavf(demuxer_t *demuxer, double seek_pts, int flags)
         seek_pts_av = seek_pts * AV_TIME_BASE;
     }
 
+    priv->index_last_pos = -1;
+
+    if (!(flags & SEEK_FACTOR) && priv->num_index) {
+        int64_t pos = lookup_learned_index(demuxer, seek_pts, flags);
+        if (pos >= 0) {
+            MP_VERBOSE(demuxer, "Seeking to %"PRId64" from learned index.\n",
+                       pos);
+            if (av_seek_frame(priv->avfc, -1, pos, AVSEEK_FLAG_BYTE) >= 0)
+                return;
+        }
+    }
+
     int r = av_seek_frame(priv->avfc, -1, seek_pts_av, avsflags);
     if (r < 0 && (avsflags & AVSEEK_FLAG_BACKWARD)) {
         // When seeking before the beginning of the file, and seeking fails,
@@ -21,8 +21,10 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <pthread.h>
 
 #include "osdep/io.h"
+#include "osdep/threads.h"
 
 #include "mpv_talloc.h"
 #include "common/msg.h"
@@ -37,6 +39,33 @@
 
 #define MF_MAX_FILE_SIZE (1024 * 1024 * 256)
 
+enum {
+    MF_SLOT_FREE,
+    MF_SLOT_PENDING,    // queued for reading
+    MF_SLOT_READING,    // a prefetch thread is reading it
+    MF_SLOT_DONE,       // data is set (empty on failure)
+};
+
+struct mf_slot {
+    int frame;
+    int state;
+    bstr data;
+};
+
+// Reads the files following the current frame concurrently (--mf-prefetch).
+struct mf_prefetch {
+    struct mpv_global *global;
+    struct mp_cancel *cancel;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    bool exit;
+    char **names;
+    struct mf_slot *slots;
+    int num_slots;
+    pthread_t *threads;
+    int num_threads;
+};
+
 typedef struct mf {
     struct mp_log *log;
     struct sh_stream *sh;
@@ -45,6 +74,7 @@ typedef struct mf {
     char **names;
     // optional
     struct stream **streams;
+    struct mf_prefetch *prefetch;
 } mf_t;
 
 
@@ -159,6 +189,179 @@ static mf_t *open_mf_single(void *talloc_ctx, struct mp_log *log, char *filename
     return mf;
 }
 
+static bstr read_mf_file(const char *filename, struct mp_cancel *cancel,
+                         struct mpv_global *global)
+{
+    bstr data = {0};
+    struct stream *stream = stream_create(filename, STREAM_READ, cancel, global);
+    if (stream) {
+        data = stream_read_complete(stream, NULL, MF_MAX_FILE_SIZE);
+        free_stream(stream);
+    }
+    return data;
+}
+
+static void *prefetch_thread(void *arg)
+{
+    struct mf_prefetch *pf = arg;
+    mpthread_set_name("mf-prefetch");
+
+    pthread_mutex_lock(&pf->lock);
+    while (!pf->exit) {
+        struct mf_slot *slot = NULL;
+        for (int n = 0; n < pf->num_slots; n++) {
+            struct mf_slot *cur = &pf->slots[n];
+            if (cur->state == MF_SLOT_PENDING &&
+                (!slot || cur->frame < slot->frame))
+                slot = cur;
+        }
+        if (!slot) {
+            pthread_cond_wait(&pf->wakeup, &pf->lock);
+            continue;
+        }
+        slot->state = MF_SLOT_READING;
+        char *filename = pf->names[slot->frame];
+        pthread_mutex_unlock(&pf->lock);
+
+        bstr data = read_mf_file(filename, pf->cancel, pf->global);
+
+        pthread_mutex_lock(&pf->lock);
+        slot->data = data;
+        slot->state = MF_SLOT_DONE;
+        pthread_cond_broadcast(&pf->wakeup);
+    }
+    pthread_mutex_unlock(&pf->lock);
+    return NULL;
+}
+
+static void free_slot(struct mf_slot *slot)
+{
+    talloc_free(slot->data.start);
+    slot->data = (bstr){0};
+    slot->state = MF_SLOT_FREE;
+}
+
+// Queue the frames starting at mf->curr_frame, and recycle slots of frames
+// that are not needed anymore. Must be called with pf->lock held.
+static void schedule_prefetch(mf_t *mf)
+{
+    struct mf_prefetch *pf = mf->prefetch;
+    int start = mf->curr_frame;
+    int end = MPMIN(start + pf->num_slots, mf->nr_of_files);
+
+    for (int n = 0; n < pf->num_slots; n++) {
+        struct mf_slot *slot = &pf->slots[n];
+        if (slot->state != MF_SLOT_READING &&
+            (slot->frame < start || slot->frame >= end))
+            free_slot(slot);
+    }
+
+    bool queued = false;
+    for (int frame = start; frame < end; frame++) {
+        struct mf_slot *free_s = NULL;
+        bool found = false;
+        for (int n = 0; n < pf->num_slots; n++) {
+            struct mf_slot *slot = &pf->slots[n];
+            if (slot->state != MF_SLOT_FREE && slot->frame == frame)
+                found = true;
+            if (slot->state == MF_SLOT_FREE && !free_s)
+                free_s = slot;
+        }
+        if (found || !mf->names[frame])
+            continue;
+        if (!free_s)
+            break; // slots still being read for frames before a seek
+        free_s->frame = frame;
+        free_s->state = MF_SLOT_PENDING;
+        queued = true;
+    }
+
+    if (queued)
+        pthread_cond_broadcast(&pf->wakeup);
+}
+
+// Return the data of the current frame, reading it with the prefetch threads.
+// If all slots are still busy with frames from before a seek, the frame is
+// read synchronously instead.
+static bstr read_prefetched(mf_t *mf)
+{
+    struct mf_prefetch *pf = mf->prefetch;
+    bstr data = {0};
+    bool sync_read = false;
+
+    pthread_mutex_lock(&pf->lock);
+    while (1) {
+        schedule_prefetch(mf);
+        struct mf_slot *slot = NULL;
+        for (int n = 0; n < pf->num_slots; n++) {
+            if (pf->slots[n].state != MF_SLOT_FREE &&
+                pf->slots[n].frame == mf->curr_frame)
+                slot = &pf->slots[n];
+        }
+        if (!slot) {
+            sync_read = !!mf->names[mf->curr_frame];
+            break;
+        }
+        if (slot->state == MF_SLOT_DONE) {
+            data = slot->data;
+            slot->data = (bstr){0};
+            slot->state = MF_SLOT_FREE;
+            break;
+        }
+        pthread_cond_wait(&pf->wakeup, &pf->lock);
+    }
+    pthread_mutex_unlock(&pf->lock);
+
+    if (sync_read)
+        data = read_mf_file(mf->names[mf->curr_frame], pf->cancel, pf->global);
+
+    return data;
+}
+
+static void uninit_prefetch(mf_t *mf)
+{
+    struct mf_prefetch *pf = mf->prefetch;
+    if (!pf)
+        return;
+    pthread_mutex_lock(&pf->lock);
+    pf->exit = true;
+    pthread_cond_broadcast(&pf->wakeup);
+    pthread_mutex_unlock(&pf->lock);
+    mp_cancel_trigger(pf->cancel);
+    for (int n = 0; n < pf->num_threads; n++)
+        pthread_join(pf->threads[n], NULL);
+    for (int n = 0; n < pf->num_slots; n++)
+        free_slot(&pf->slots[n]);
+    pthread_cond_destroy(&pf->wakeup);
+    pthread_mutex_destroy(&pf->lock);
+    talloc_free(pf);
+    mf->prefetch = NULL;
+}
+
+static void init_prefetch(demuxer_t *demuxer, mf_t *mf, int depth)
+{
+    struct mf_prefetch *pf = talloc_zero(NULL, struct mf_prefetch);
+    pf->global = demuxer->global;
+    pf->cancel = mp_cancel_new(pf);
+    pf->names = mf->names;
+    pthread_mutex_init(&pf->lock, NULL);
+    pthread_cond_init(&pf->wakeup, NULL);
+    mf->prefetch = pf;
+
+    pf->num_slots = depth;
+    pf->slots = talloc_zero_array(pf, struct mf_slot, depth);
+    pf->threads = talloc_zero_array(pf, pthread_t, depth);
+    for (int n = 0; n < depth; n++) {
+        if (pthread_create(&pf->threads[n], NULL, prefetch_thread, pf))
+            break;
+        pf->num_threads++;
+    }
+    if (!pf->num_threads) {
+        MP_WARN(mf, "Could not start prefetch threads.\n");
+        uninit_prefetch(mf);
+    }
+}
+
 static void demux_seek_mf(demuxer_t *demuxer, double seek_pts, int flags)
 {
     mf_t *mf = demuxer->priv;
@@ -181,33 +384,27 @@ static int demux_mf_fill_buffer(demuxer_t *demuxer)
     if (mf->curr_frame >= mf->nr_of_files)
         return 0;
 
-    struct stream *entry_stream = NULL;
-    if (mf->streams)
-        entry_stream = mf->streams[mf->curr_frame];
-    struct stream *stream = entry_stream;
-    if (!stream) {
-        char *filename = mf->names[mf->curr_frame];
-        if (filename)
-            stream = stream_open(filename, demuxer->global);
+    bstr data = {0};
+    if (mf->prefetch) {
+        data = read_prefetched(mf);
+    } else if (mf->streams && mf->streams[mf->curr_frame]) {
+        struct stream *stream = mf->streams[mf->curr_frame];
+        stream_seek(stream, 0);
+        data = stream_read_complete(stream, NULL, MF_MAX_FILE_SIZE);
+    } else if (mf->names[mf->curr_frame]) {
+        data = read_mf_file(mf->names[mf->curr_frame], NULL, demuxer->global);
     }
 
-    if (stream) {
-        stream_seek(stream, 0);
-        bstr data = stream_read_complete(stream, NULL, MF_MAX_FILE_SIZE);
-        if (data.len) {
-            demux_packet_t *dp = new_demux_packet(data.len);
-            if (dp) {
-                memcpy(dp->buffer, data.start, data.len);
-                dp->pts = mf->curr_frame / mf->sh->codec->fps;
-                dp->keyframe = true;
-                demux_add_packet(mf->sh, dp);
-            }
+    if (data.len) {
+        demux_packet_t *dp = new_demux_packet_from_pool(demuxer->packet_pool,
+                                                        data.start, data.len);
+        if (dp) {
+            dp->pts = mf->curr_frame / mf->sh->codec->fps;
+            dp->keyframe = true;
+            demux_add_packet(mf->sh, dp);
         }
-        talloc_free(data.start);
     }
-
-    if (stream && stream != entry_stream)
-        free_stream(stream);
+    talloc_free(data.start);
 
     mf->curr_frame++;
     return 1;
@@ -329,6 +526,10 @@ static int demux_open_mf(demuxer_t *demuxer, enum demux_check check)
     demuxer->priv = (void *)mf;
     demuxer->seekable = true;
 
+    int depth = demuxer->opts->mf_prefetch;
+    if (depth > 0 && !mf->streams && mf->nr_of_files > 1)
+        init_prefetch(demuxer, mf, depth);
+
     return 0;
 
 error:
@@ -337,6 +538,9 @@ error:
 
 static void demux_close_mf(demuxer_t *demuxer)
 {
+    mf_t *mf = demuxer->priv;
+    if (mf)
+        uninit_prefetch(mf);
 }
 
 static int demux_control_mf(demuxer_t *demuxer, int cmd, void *arg)
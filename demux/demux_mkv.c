@@ -26,6 +26,8 @@
 #include <stdbool.h>
 #include <math.h>
 #include <assert.h>
+#include <pthread.h>
+#include <unistd.h>
 
 #include <libavutil/common.h>
 #include <libavutil/lzo.h>
@@ -45,6 +47,7 @@
 #include "common/av_common.h"
 #include "options/options.h"
 #include "options/m_option.h"
+#include "options/path.h"
 #include "misc/bstr.h"
 #include "stream/stream.h"
 #include "video/csputils.h"
@@ -57,6 +60,8 @@
 #include "video/img_fourcc.h"
 
 #include "common/msg.h"
+#include "osdep/io.h"
+#include "osdep/threads.h"
 
 static const unsigned char sipr_swaps[38][2] = {
     {0,63},{1,22},{2,44},{3,90},{5,81},{7,31},{8,86},{9,58},{10,36},{12,68},
@@ -157,7 +162,7 @@ struct block_info {
     int64_t timecode;
     mkv_track_t *track;
     bstr data;
-    void *alloc;
+    AVBufferRef *buf;   // backing allocation of data (with padding)
     int64_t filepos;
 };
 
@@ -180,6 +185,9 @@ typedef struct mkv_demuxer {
     size_t num_indexes;
     bool index_complete;
 
+    // Set if an index is being built by a separate thread (files without cues)
+    struct mkv_bg_index *bg_index;
+
     struct header_elem {
         int32_t id;
         int64_t pos;
@@ -206,6 +214,8 @@ struct demux_mkv_opts {
     double subtitle_preroll_secs_index;
     int probe_duration;
     int probe_start_time;
+    int background_index;
+    int index_cache;
 };
 
 const struct m_sub_options demux_mkv_conf = {
@@ -219,6 +229,8 @@ const struct m_sub_options demux_mkv_conf = {
         OPT_CHOICE("probe-video-duration", probe_duration, 0,
                    ({"no", 0}, {"yes", 1}, {"full", 2})),
         OPT_FLAG("probe-start-time", probe_start_time, 0),
+        OPT_FLAG("background-index", background_index, 0),
+        OPT_FLAG("index-cache", index_cache, 0),
         {0}
     },
     .size = sizeof(struct demux_mkv_opts),
@@ -411,6 +423,10 @@ static int demux_mkv_read_info(demuxer_t *demuxer)
         } else {
             memcpy(demuxer->matroska_data.uid.segment, info.segment_uid.start,
                    len);
+            if (demuxer->params && demuxer->params->matroska_found_uid) {
+                memcpy(demuxer->params->matroska_found_uid->segment,
+                       info.segment_uid.start, len);
+            }
             MP_VERBOSE(demuxer, "| + segment uid");
             for (int i = 0; i < len; i++)
                 MP_VERBOSE(demuxer, " %02x",
@@ -418,6 +434,8 @@ static int demux_mkv_read_info(demuxer_t *demuxer)
             MP_VERBOSE(demuxer, "\n");
         }
     }
+    if (demuxer->params && demuxer->params->matroska_found_info)
+        *demuxer->params->matroska_found_info = true;
     if (demuxer->params && demuxer->params->matroska_wanted_uids) {
         if (info.n_segment_uid) {
             for (int i = 0; i < demuxer->params->matroska_num_wanted_uids; i++) {
@@ -745,6 +763,134 @@ static void add_block_position(demuxer_t *demuxer, struct mkv_track *track,
     track->last_index_entry = mkv_d->num_indexes - 1;
 }
 
+#define INDEX_CACHE_DIR "mkv_index_cache"
+#define INDEX_CACHE_MAGIC "mpvmkvi1"
+
+// Return the index cache file name, or NULL if the file can't be cached.
+// The cache is keyed by segment UID and file size.
+static char *index_cache_filename(void *ta_ctx, struct demuxer *demuxer)
+{
+    struct MPOpts *opts = demuxer->opts;
+    uint8_t *uid = demuxer->matroska_data.uid.segment;
+
+    if (!opts->demux_mkv->index_cache || opts->index_mode != 1)
+        return NULL;
+
+    bool have_uid = false;
+    for (int n = 0; n < 16; n++)
+        have_uid |= uid[n];
+    int64_t size = stream_get_size(demuxer->stream);
+    if (!have_uid || size <= 0)
+        return NULL;
+
+    char *dir = mp_find_user_config_file(ta_ctx, demuxer->global,
+                                         INDEX_CACHE_DIR);
+    if (!dir)
+        return NULL;
+    char *name = talloc_strdup(ta_ctx, "");
+    for (int n = 0; n < 16; n++)
+        name = talloc_asprintf_append(name, "%02X", uid[n]);
+    name = talloc_asprintf_append(name, "-%"PRId64, size);
+    return mp_path_join(ta_ctx, dir, name);
+}
+
+static void index_cache_write(struct demuxer *demuxer)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+    void *tmp = talloc_new(NULL);
+
+    char *filename = index_cache_filename(tmp, demuxer);
+    if (!filename || !mkv_d->index_complete)
+        goto done;
+
+    mp_mk_config_dir(demuxer->global, INDEX_CACHE_DIR);
+
+    FILE *f = fopen(filename, "wb");
+    if (!f) {
+        MP_WARN(demuxer, "Could not write index cache %s\n", filename);
+        goto done;
+    }
+    uint8_t buf[32];
+    bool ok = fwrite(INDEX_CACHE_MAGIC, 8, 1, f) == 1;
+    AV_WL64(buf, mkv_d->num_indexes);
+    AV_WL64(buf + 8, mkv_d->index_has_durations);
+    ok &= fwrite(buf, 16, 1, f) == 1;
+    for (size_t i = 0; i < mkv_d->num_indexes && ok; i++) {
+        mkv_index_t *index = &mkv_d->indexes[i];
+        AV_WL64(buf, index->tnum);
+        AV_WL64(buf + 8, index->timecode);
+        AV_WL64(buf + 16, index->duration);
+        AV_WL64(buf + 24, index->filepos);
+        ok &= fwrite(buf, 32, 1, f) == 1;
+    }
+    ok &= fclose(f) == 0;
+    if (!ok) {
+        MP_WARN(demuxer, "Error writing index cache %s\n", filename);
+        unlink(filename);
+        goto done;
+    }
+    MP_VERBOSE(demuxer, "Wrote index cache %s\n", filename);
+
+done:
+    talloc_free(tmp);
+}
+
+// Returns true if the index was read from the cache.
+static bool index_cache_read(struct demuxer *demuxer)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+    void *tmp = talloc_new(NULL);
+    bool res = false;
+
+    char *filename = index_cache_filename(tmp, demuxer);
+    if (!filename || mkv_d->index_complete)
+        goto done;
+
+    FILE *f = fopen(filename, "rb");
+    if (!f)
+        goto done;
+
+    int64_t size = stream_get_size(demuxer->stream);
+    uint8_t buf[32];
+    char magic[8];
+    if (fread(magic, 8, 1, f) != 1 || memcmp(magic, INDEX_CACHE_MAGIC, 8) ||
+        fread(buf, 16, 1, f) != 1)
+        goto error;
+    uint64_t num = AV_RL64(buf);
+    bool has_durations = AV_RL64(buf + 8);
+    if (num < 1 || num > INT_MAX / sizeof(mkv_index_t))
+        goto error;
+    mkv_index_t *indexes = talloc_array(tmp, mkv_index_t, num);
+    for (uint64_t i = 0; i < num; i++) {
+        if (fread(buf, 32, 1, f) != 1)
+            goto error;
+        indexes[i] = (mkv_index_t) {
+            .tnum = AV_RL64(buf),
+            .timecode = AV_RL64(buf + 8),
+            .duration = AV_RL64(buf + 16),
+            .filepos = AV_RL64(buf + 24),
+        };
+        if (indexes[i].filepos >= size)
+            goto error;
+    }
+
+    talloc_free(mkv_d->indexes);
+    mkv_d->indexes = talloc_steal(mkv_d, indexes);
+    mkv_d->num_indexes = num;
+    mkv_d->index_has_durations = has_durations;
+    mkv_d->index_complete = true;
+    MP_VERBOSE(demuxer, "Using index cache %s\n", filename);
+    res = true;
+
+error:
+    if (!res)
+        MP_WARN(demuxer, "Ignoring invalid index cache %s\n", filename);
+    fclose(f);
+done:
+    talloc_free(tmp);
+    return res;
+}
+
 static int demux_mkv_read_cues(demuxer_t *demuxer)
 {
     struct MPOpts *opts = demuxer->opts;
@@ -801,6 +947,8 @@ static int demux_mkv_read_cues(demuxer_t *demuxer)
     // Do not attempt to create index on the fly.
     mkv_d->index_complete = true;
 
+    index_cache_write(demuxer);
+
 done:
     if (!mkv_d->index_complete)
         MP_WARN(demuxer, "Discarding potentially broken or useless index.\n");
@@ -1205,6 +1353,259 @@ static void read_deferred_cues(demuxer_t *demuxer)
     }
 }
 
+// State of the background indexer. The thread reads the file through its own
+// stream instance, and only exchanges the resulting index under the lock.
+struct mkv_bg_index {
+    struct mp_log *log;
+    struct mpv_global *global;
+    struct mp_cancel *cancel;
+    char *url;
+    int64_t start_pos;      // first cluster
+    int64_t segment_end;
+
+    // Per-track state (only accessed by the thread)
+    int num_tracks;
+    int64_t *tnums;
+    int64_t *last_tc;       // latest keyframe timecode added per track
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    // --- protected by lock
+    mkv_index_t *indexes;   // in file order
+    size_t num_indexes;
+    bool done;              // thread exited
+    bool complete;          // whole segment was scanned
+};
+
+static void bg_index_add(struct mkv_bg_index *bg, int64_t tnum,
+                         uint64_t filepos, int64_t timecode, int64_t duration)
+{
+    for (int n = 0; n < bg->num_tracks; n++) {
+        if (bg->tnums[n] != tnum)
+            continue;
+        // Same rule as add_block_position().
+        if (bg->last_tc[n] >= timecode)
+            return;
+        bg->last_tc[n] = timecode;
+        pthread_mutex_lock(&bg->lock);
+        MP_TARRAY_GROW(bg, bg->indexes, bg->num_indexes);
+        bg->indexes[bg->num_indexes++] = (mkv_index_t) {
+            .tnum = tnum,
+            .filepos = filepos,
+            .timecode = timecode,
+            .duration = duration,
+        };
+        pthread_mutex_unlock(&bg->lock);
+        return;
+    }
+}
+
+// Read the track number, relative timestamp and flags of a Block or
+// SimpleBlock, and skip the rest. Returns false on error.
+static bool bg_index_read_block_header(struct stream *s, int64_t *tnum,
+                                       int16_t *time, uint8_t *flags)
+{
+    uint64_t length = ebml_read_length(s);
+    if (length == EBML_UINT_INVALID)
+        return false;
+    int64_t end = stream_tell(s) + length;
+    uint8_t buf[8 + 3];
+    int len = stream_read(s, buf, MPMIN(length, sizeof(buf)));
+    bstr data = {buf, len};
+    uint64_t num = ebml_read_vlen_uint(&data);
+    if (num == EBML_UINT_INVALID || data.len < 3)
+        return false;
+    *tnum = num;
+    *time = data.start[0] << 8 | data.start[1];
+    *flags = data.start[2];
+    return stream_seek(s, end);
+}
+
+static bool bg_index_scan_cluster(struct mkv_bg_index *bg, struct stream *s,
+                                  int64_t cluster_pos, int64_t end)
+{
+    uint64_t cluster_tc = 0;
+
+    while (stream_tell(s) < end) {
+        int64_t tnum;
+        int16_t time;
+        uint8_t flags;
+
+        switch (ebml_read_id(s)) {
+        case MATROSKA_ID_TIMECODE:
+            cluster_tc = ebml_read_uint(s);
+            if (cluster_tc == EBML_UINT_INVALID)
+                return false;
+            break;
+
+        case MATROSKA_ID_SIMPLEBLOCK:
+            if (!bg_index_read_block_header(s, &tnum, &time, &flags))
+                return false;
+            if (flags & 0x80)
+                bg_index_add(bg, tnum, cluster_pos, cluster_tc + time, 0);
+            break;
+
+        case MATROSKA_ID_BLOCKGROUP: {
+            uint64_t length = ebml_read_length(s);
+            if (length == EBML_UINT_INVALID)
+                return false;
+            int64_t group_end = stream_tell(s) + length;
+            if (group_end > end)
+                return false;
+            bool have_block = false, keyframe = true;
+            uint64_t duration = 0;
+            while (stream_tell(s) < group_end) {
+                switch (ebml_read_id(s)) {
+                case MATROSKA_ID_BLOCK:
+                    if (!bg_index_read_block_header(s, &tnum, &time, &flags))
+                        return false;
+                    have_block = true;
+                    break;
+                case MATROSKA_ID_BLOCKDURATION:
+                    duration = ebml_read_uint(s);
+                    if (duration == EBML_UINT_INVALID)
+                        return false;
+                    break;
+                case MATROSKA_ID_REFERENCEBLOCK:;
+                    int64_t num = ebml_read_int(s);
+                    if (num == EBML_INT_INVALID)
+                        return false;
+                    if (num)
+                        keyframe = false;
+                    break;
+                case EBML_ID_INVALID:
+                    return false;
+                default:
+                    if (ebml_read_skip(bg->log, group_end, s) != 0)
+                        return false;
+                }
+            }
+            if (have_block && keyframe)
+                bg_index_add(bg, tnum, cluster_pos, cluster_tc + time, duration);
+            break;
+        }
+
+        case MATROSKA_ID_CLUSTER:
+        case EBML_ID_INVALID:
+            return false;
+
+        default:
+            if (ebml_read_skip(bg->log, end, s) != 0)
+                return false;
+        }
+    }
+    return true;
+}
+
+static void *bg_index_thread(void *p)
+{
+    struct mkv_bg_index *bg = p;
+    mpthread_set_name("mkvindex");
+
+    bool complete = false;
+    struct stream *s = stream_create(bg->url, STREAM_READ, bg->cancel,
+                                     bg->global);
+    if (s && stream_seek(s, bg->start_pos)) {
+        MP_VERBOSE(bg, "Building index in background...\n");
+        while (!mp_cancel_test(bg->cancel)) {
+            int64_t pos = stream_tell(s);
+            if (pos >= bg->segment_end) {
+                complete = true;
+                break;
+            }
+            uint32_t id = ebml_read_id(s);
+            if (s->eof) {
+                complete = true;
+                break;
+            }
+            if (id == EBML_ID_INVALID)
+                break;
+            if (id != MATROSKA_ID_CLUSTER) {
+                if (ebml_read_skip(bg->log, -1, s) != 0)
+                    break;
+                continue;
+            }
+            // Clusters with unknown size (live streams) are not supported.
+            uint64_t length = ebml_read_length(s);
+            if (length == EBML_UINT_INVALID)
+                break;
+            int64_t end = stream_tell(s) + length;
+            if (!bg_index_scan_cluster(bg, s, pos, end) || !stream_seek(s, end))
+                break;
+        }
+        MP_VERBOSE(bg, "Background indexing %s.\n",
+                   complete ? "done" : "stopped");
+    }
+    free_stream(s);
+
+    pthread_mutex_lock(&bg->lock);
+    bg->complete = complete;
+    bg->done = true;
+    pthread_mutex_unlock(&bg->lock);
+    return NULL;
+}
+
+// Whether opening the stream's URL again yields an independent file handle.
+static bool bg_index_can_reopen(struct stream *s)
+{
+    return s->seekable && s->uncached_type == STREAMTYPE_FILE &&
+           strcmp(s->url, "-") != 0 && strncmp(s->url, "fd://", 5) != 0;
+}
+
+static void bg_index_start(struct demuxer *demuxer, int64_t start_pos)
+{
+    struct mkv_demuxer *mkv_d = demuxer->priv;
+    struct MPOpts *opts = demuxer->opts;
+
+    if (!opts->demux_mkv->background_index || opts->index_mode != 1 ||
+        mkv_d->index_complete || !bg_index_can_reopen(demuxer->stream))
+        return;
+
+    // Deferred cues will be read on the first seek.
+    for (int n = 0; n < mkv_d->num_headers; n++) {
+        if (mkv_d->headers[n].id == MATROSKA_ID_CUES && !mkv_d->headers[n].parsed)
+            return;
+    }
+
+    struct mkv_bg_index *bg = talloc_zero(NULL, struct mkv_bg_index);
+    *bg = (struct mkv_bg_index){
+        .log = mp_log_new(bg, demuxer->log, "index"),
+        .global = demuxer->global,
+        .cancel = mp_cancel_new(bg),
+        .url = talloc_strdup(bg, demuxer->stream->url),
+        .start_pos = start_pos,
+        .segment_end = mkv_d->segment_end,
+        .num_tracks = mkv_d->num_tracks,
+    };
+    bg->tnums = talloc_array(bg, int64_t, bg->num_tracks);
+    bg->last_tc = talloc_array(bg, int64_t, bg->num_tracks);
+    for (int n = 0; n < bg->num_tracks; n++) {
+        bg->tnums[n] = mkv_d->tracks[n]->tnum;
+        bg->last_tc[n] = INT64_MIN;
+    }
+    pthread_mutex_init(&bg->lock, NULL);
+    if (pthread_create(&bg->thread, NULL, bg_index_thread, bg)) {
+        pthread_mutex_destroy(&bg->lock);
+        talloc_free(bg);
+        return;
+    }
+    mkv_d->bg_index = bg;
+}
+
+static void bg_index_stop(struct demuxer *demuxer)
+{
+    struct mkv_demuxer *mkv_d = demuxer->priv;
+    struct mkv_bg_index *bg = mkv_d->bg_index;
+
+    if (!bg)
+        return;
+    mp_cancel_trigger(bg->cancel);
+    pthread_join(bg->thread, NULL);
+    pthread_mutex_destroy(&bg->lock);
+    talloc_free(bg);
+    mkv_d->bg_index = NULL;
+}
+
 static void add_coverart(struct demuxer *demuxer)
 {
     for (int n = 0; n < demuxer->num_attachments; n++) {
@@ -1816,6 +2217,12 @@ static int read_ebml_header(demuxer_t *demuxer)
     return 1;
 }
 
+static void set_no_segment(demuxer_t *demuxer)
+{
+    if (demuxer->params && demuxer->params->matroska_no_segment)
+        *demuxer->params->matroska_no_segment = true;
+}
+
 static int read_mkv_segment_header(demuxer_t *demuxer, int64_t *segment_end)
 {
     stream_t *s = demuxer->stream;
@@ -1837,8 +2244,10 @@ static int read_mkv_segment_header(demuxer_t *demuxer, int64_t *segment_end)
         MP_VERBOSE(demuxer, "  (skipping)\n");
         if (*segment_end <= 0)
             break;
-        if (*segment_end >= stream_get_size(s))
+        if (*segment_end >= stream_get_size(s)) {
+            set_no_segment(demuxer);
             return 0;
+        }
         if (!stream_seek(s, *segment_end)) {
             MP_WARN(demuxer, "Failed to seek in file\n");
             return 0;
@@ -1849,6 +2258,10 @@ static int read_mkv_segment_header(demuxer_t *demuxer, int64_t *segment_end)
     }
 
     MP_VERBOSE(demuxer, "End of file, no further segments.\n");
+    // s->eof is also set on read errors.
+    int64_t size = stream_get_size(s);
+    if (!s->eof || (size >= 0 && stream_tell(s) >= size))
+        set_no_segment(demuxer);
     return 0;
 }
 
@@ -1864,8 +2277,11 @@ static int demux_mkv_open(demuxer_t *demuxer, enum demux_check check)
     uint32_t start_id = 0;
     for (int n = 0; n < start.len; n++)
         start_id = (start_id << 8) | start.start[n];
-    if (start_id != EBML_ID_EBML)
+    if (start_id != EBML_ID_EBML) {
+        if (start.len == 4)
+            set_no_segment(demuxer);
         return -1;
+    }
 
     if (!read_ebml_header(demuxer))
         return -1;
@@ -1902,6 +2318,8 @@ static int demux_mkv_open(demuxer_t *demuxer, enum demux_check check)
             return -1;
     }
 
+    index_cache_read(demuxer);
+
     int64_t end = stream_get_size(s);
 
     // Read headers that come after the first cluster (i.e. require seeking).
@@ -1944,6 +2362,8 @@ static int demux_mkv_open(demuxer_t *demuxer, enum demux_check check)
     if (opts->demux_mkv->probe_duration)
         probe_last_timestamp(demuxer, start_pos);
 
+    bg_index_start(demuxer, start_pos);
+
     return 0;
 }
 
@@ -2266,7 +2686,8 @@ static void mkv_parse_and_add_packet(demuxer_t *demuxer, mkv_track_t *track,
 
     if (strcmp(stream->codec->codec, "prores") == 0) {
         size_t newlen = dp->len + 8;
-        struct demux_packet *new = new_demux_packet(newlen);
+        struct demux_packet *new = new_demux_packet_pool(demuxer->packet_pool,
+                                                         newlen);
         if (new) {
             AV_WB32(new->buffer + 0, newlen);
             AV_WB32(new->buffer + 4, MKBETAG('i', 'c', 'p', 'f'));
@@ -2331,8 +2752,7 @@ static void mkv_parse_and_add_packet(demuxer_t *demuxer, mkv_track_t *track,
 
 static void free_block(struct block_info *block)
 {
-    free(block->alloc);
-    block->alloc = NULL;
+    av_buffer_unref(&block->buf);
     block->data = (bstr){0};
 }
 
@@ -2359,10 +2779,15 @@ static int read_block(demuxer_t *demuxer, int64_t end, struct block_info *block)
     length = ebml_read_length(s);
     if (length > 500000000 || stream_tell(s) + length > (uint64_t)end)
         goto exit;
-    block->alloc = malloc(length + AV_LZO_INPUT_PADDING);
-    if (!block->alloc)
+    // Read the block into a refcounted buffer, so that packets can reference
+    // it directly (see handle_block()).
+    size_t padding = MPMAX(AV_LZO_INPUT_PADDING, FF_INPUT_BUFFER_PADDING_SIZE);
+    block->buf = demux_packet_pool_get_buffer(demuxer->packet_pool,
+                                              length + padding);
+    if (!block->buf)
         goto exit;
-    block->data = (bstr){block->alloc, length};
+    memset(block->buf->data + length, 0, padding);
+    block->data = (bstr){block->buf->data, length};
     block->filepos = stream_tell(s);
     if (stream_read(s, block->data.start, block->data.len) != block->data.len)
         goto exit;
@@ -2461,9 +2886,21 @@ static int handle_block(demuxer_t *demuxer, struct block_info *block_info)
             bstr block = bstr_splice(data, 0, lace_size[i]);
             data = bstr_cut(data, lace_size[i]);
 
-            block = demux_mkv_decode(demuxer->log, track, block, 1);
+            bstr decoded = demux_mkv_decode(demuxer->log, track, block, 1);
 
-            demux_packet_t *dp = new_demux_packet_from(block.start, block.len);
+            demux_packet_t *dp;
+            // The last lace ends at the end of the padded block buffer. If
+            // decoding left it as is, reference it instead of copying.
+            if (decoded.start == block.start && decoded.len == block.len &&
+                !data.len)
+            {
+                dp = new_demux_packet_from_buf(block_info->buf,
+                                               block.start, block.len);
+            } else {
+                dp = new_demux_packet_from_pool(demuxer->packet_pool,
+                                                decoded.start, decoded.len);
+            }
+            block = decoded;
             if (!dp)
                 break;
             dp->keyframe = keyframe;
@@ -2564,7 +3001,7 @@ static int read_next_block(demuxer_t *demuxer, struct block_info *block)
     mkv_demuxer_t *mkv_d = (mkv_demuxer_t *) demuxer->priv;
     stream_t *s = demuxer->stream;
 
-    if (mkv_d->tmp_block.alloc) {
+    if (mkv_d->tmp_block.buf) {
         *block = mkv_d->tmp_block;
         mkv_d->tmp_block = (struct block_info){0};
         return 1;
@@ -2688,12 +3125,59 @@ static mkv_index_t *get_highest_index_entry(struct demuxer *demuxer)
     return index;
 }
 
+// Take over the index built by the background thread, if it reaches further
+// than the index built by reading packets.
+static void bg_index_adopt(struct demuxer *demuxer)
+{
+    struct mkv_demuxer *mkv_d = demuxer->priv;
+    struct mkv_bg_index *bg = mkv_d->bg_index;
+
+    if (!bg)
+        return;
+
+    if (mkv_d->index_complete) {
+        bg_index_stop(demuxer);
+        return;
+    }
+
+    pthread_mutex_lock(&bg->lock);
+    mkv_index_t *index = get_highest_index_entry(demuxer);
+    if (bg->num_indexes && (!index ||
+        bg->indexes[bg->num_indexes - 1].filepos > index->filepos))
+    {
+        MP_TARRAY_GROW(mkv_d, mkv_d->indexes, bg->num_indexes - 1);
+        memcpy(mkv_d->indexes, bg->indexes,
+               bg->num_indexes * sizeof(mkv_d->indexes[0]));
+        mkv_d->num_indexes = bg->num_indexes;
+        mkv_d->index_has_durations = true;
+        for (int n = 0; n < mkv_d->num_tracks; n++)
+            mkv_d->tracks[n]->last_index_entry = (size_t)-1;
+        for (size_t i = 0; i < mkv_d->num_indexes; i++) {
+            for (int n = 0; n < mkv_d->num_tracks; n++) {
+                if (mkv_d->tracks[n]->tnum == mkv_d->indexes[i].tnum)
+                    mkv_d->tracks[n]->last_index_entry = i;
+            }
+        }
+        mkv_d->index_complete = bg->complete;
+        if (mkv_d->index_complete)
+            index_cache_write(demuxer);
+        MP_VERBOSE(demuxer, "Using %s background index (%zu entries).\n",
+                   bg->complete ? "complete" : "partial", bg->num_indexes);
+    }
+    bool done = bg->done;
+    pthread_mutex_unlock(&bg->lock);
+
+    if (done)
+        bg_index_stop(demuxer);
+}
+
 static int create_index_until(struct demuxer *demuxer, int64_t timecode)
 {
     struct mkv_demuxer *mkv_d = demuxer->priv;
     struct stream *s = demuxer->stream;
 
     read_deferred_cues(demuxer);
+    bg_index_adopt(demuxer);
 
     if (mkv_d->index_complete)
         return 0;
@@ -2859,6 +3343,7 @@ static void demux_mkv_seek(demuxer_t *demuxer, double seek_pts, int flags)
         stream_t *s = demuxer->stream;
 
         read_deferred_cues(demuxer);
+        bg_index_adopt(demuxer);
 
         int64_t size = stream_get_size(s);
         int64_t target_filepos = size * MPCLAMP(seek_pts, 0, 1);
@@ -3010,6 +3495,7 @@ static void mkv_free(struct demuxer *demuxer)
     struct mkv_demuxer *mkv_d = demuxer->priv;
     if (!mkv_d)
         return;
+    bg_index_stop(demuxer);
     mkv_seek_reset(demuxer);
     for (int i = 0; i < mkv_d->num_tracks; i++)
         demux_mkv_free_trackentry(mkv_d->tracks[i]);
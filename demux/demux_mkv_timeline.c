@@ -25,6 +25,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <libavutil/common.h>
 
 #include "osdep/io.h"
@@ -39,6 +40,7 @@
 #include "options/options.h"
 #include "options/path.h"
 #include "misc/bstr.h"
+#include "misc/thread_pool.h"
 #include "common/common.h"
 #include "common/playlist.h"
 #include "stream/stream.h"
@@ -149,6 +151,122 @@ static char **find_files(const char *original_file)
     return results;
 }
 
+// Segment UIDs of files probed earlier, so that opening the next file with
+// ordered chapters from the same directory doesn't have to open every file
+// again. Entries are invalidated if the file's size or mtime change.
+struct uid_cache_file {
+    char *filename;
+    time_t mtime;
+    int64_t size;
+    // UIDs of segments 0..num_segments-1 (all-zero if a segment has none)
+    struct matroska_segment_uid *segments;
+    int num_segments;
+    // There are no further segments after num_segments.
+    bool complete;
+};
+
+#define UID_CACHE_MAX_FILES 10000
+
+static pthread_mutex_t uid_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static void *uid_cache_ctx;
+static struct uid_cache_file **uid_cache;
+static int uid_cache_num;
+
+// Must be called with uid_cache_lock held.
+static struct uid_cache_file *uid_cache_get(const char *filename,
+                                            struct stat *st)
+{
+    struct uid_cache_file *f = NULL;
+    for (int n = 0; n < uid_cache_num; n++) {
+        if (strcmp(uid_cache[n]->filename, filename) == 0) {
+            f = uid_cache[n];
+            break;
+        }
+    }
+    if (!f) {
+        if (uid_cache_num >= UID_CACHE_MAX_FILES) {
+            talloc_free(uid_cache_ctx);
+            uid_cache_ctx = NULL;
+            uid_cache = NULL;
+            uid_cache_num = 0;
+        }
+        if (!uid_cache_ctx)
+            uid_cache_ctx = talloc_new(NULL);
+        f = talloc_zero(uid_cache_ctx, struct uid_cache_file);
+        f->filename = talloc_strdup(f, filename);
+        f->mtime = st->st_mtime;
+        f->size = st->st_size;
+        MP_TARRAY_APPEND(uid_cache_ctx, uid_cache, uid_cache_num, f);
+    }
+    if (f->mtime != st->st_mtime || f->size != st->st_size) {
+        f->mtime = st->st_mtime;
+        f->size = st->st_size;
+        f->num_segments = 0;
+        f->complete = false;
+    }
+    return f;
+}
+
+// Return -1 if unknown, 0 if the segment doesn't exist, 1 if *uid was set.
+static int uid_cache_lookup(const char *filename, int segment,
+                            struct matroska_segment_uid *uid)
+{
+    struct stat st;
+    if (stat(filename, &st) || !S_ISREG(st.st_mode))
+        return -1;
+    int res = -1;
+    pthread_mutex_lock(&uid_cache_lock);
+    struct uid_cache_file *f = uid_cache_get(filename, &st);
+    if (segment < f->num_segments) {
+        *uid = f->segments[segment];
+        res = 1;
+    } else if (f->complete) {
+        res = 0;
+    }
+    pthread_mutex_unlock(&uid_cache_lock);
+    return res;
+}
+
+// uid==NULL means the segment doesn't exist.
+static void uid_cache_add(const char *filename, int segment,
+                          struct matroska_segment_uid *uid)
+{
+    struct stat st;
+    if (stat(filename, &st) || !S_ISREG(st.st_mode))
+        return;
+    pthread_mutex_lock(&uid_cache_lock);
+    struct uid_cache_file *f = uid_cache_get(filename, &st);
+    if (segment <= f->num_segments) {
+        if (!uid) {
+            f->num_segments = segment;
+            f->complete = true;
+        } else if (segment < f->num_segments) {
+            f->segments[segment] = *uid;
+        } else {
+            struct matroska_segment_uid entry = {0};
+            memcpy(entry.segment, uid->segment, 16);
+            MP_TARRAY_APPEND(f, f->segments, f->num_segments, entry);
+        }
+    }
+    pthread_mutex_unlock(&uid_cache_lock);
+}
+
+// Cache the result of probing a file, but only if it's definitive. Failing to
+// open or read the file can be transient, and the file would never be looked
+// at again while the cache entry is valid.
+static void uid_cache_add_result(struct tl_ctx *ctx, const char *filename,
+                                 int segment, bool found_info, bool no_segment,
+                                 struct matroska_segment_uid *uid)
+{
+    if (mp_cancel_test(ctx->tl->cancel))
+        return;
+    if (found_info) {
+        uid_cache_add(filename, segment, uid);
+    } else if (no_segment) {
+        uid_cache_add(filename, segment, NULL);
+    }
+}
+
 static bool has_source_request(struct tl_ctx *ctx,
                                struct matroska_segment_uid *new_uid)
 {
@@ -159,23 +277,47 @@ static bool has_source_request(struct tl_ctx *ctx,
     return false;
 }
 
+// Whether uid is the segment UID of a source that hasn't been found yet.
+static bool is_missing_uid(struct tl_ctx *ctx, struct matroska_segment_uid *uid)
+{
+    for (int i = 1; i < ctx->num_sources; i++) {
+        if (!ctx->sources[i] && !memcmp(ctx->uids[i].segment, uid->segment, 16))
+            return true;
+    }
+    return false;
+}
+
 // segment = get Nth segment of a multi-segment file
 static bool check_file_seg(struct tl_ctx *ctx, char *filename, int segment)
 {
-    bool was_valid = false;
+    bool was_valid = false, found_info = false, no_segment = false;
+    struct matroska_segment_uid found_uid = {0};
     struct demuxer_params params = {
         .force_format = "mkv",
         .matroska_num_wanted_uids = ctx->num_sources,
         .matroska_wanted_uids = ctx->uids,
         .matroska_wanted_segment = segment,
         .matroska_was_valid = &was_valid,
+        .matroska_found_uid = &found_uid,
+        .matroska_found_info = &found_info,
+        .matroska_no_segment = &no_segment,
         .disable_cache = true,
     };
     struct mp_cancel *cancel = ctx->tl->cancel;
     if (mp_cancel_test(cancel))
         return false;
 
+    // Don't open files which are known not to contain anything we need.
+    struct matroska_segment_uid cached_uid;
+    int cached = uid_cache_lookup(filename, segment, &cached_uid);
+    if (cached == 0)
+        return false;
+    if (cached > 0 && !is_missing_uid(ctx, &cached_uid))
+        return true;
+
     struct demuxer *d = demux_open_url(filename, &params, cancel, ctx->global);
+    uid_cache_add_result(ctx, filename, segment, found_info, no_segment,
+                         &found_uid);
     if (!d)
         return false;
 
@@ -236,6 +378,88 @@ static void check_file(struct tl_ctx *ctx, char *filename, int first)
     }
 }
 
+struct probe_ctx {
+    struct tl_ctx *ctx;
+    char **filenames;
+};
+
+static void probe_file(void *ptr, int index)
+{
+    struct probe_ctx *p = ptr;
+    struct tl_ctx *ctx = p->ctx;
+    char *filename = p->filenames[index];
+
+    struct matroska_segment_uid uid;
+    if (uid_cache_lookup(filename, 0, &uid) >= 0)
+        return;
+
+    // Only read the segment info: no real UID is all-zero, so the demuxer
+    // always rejects the file after reading it.
+    struct matroska_segment_uid none = {0};
+    bool found_info = false, no_segment = false;
+    struct matroska_segment_uid found_uid = {0};
+    struct demuxer_params params = {
+        .force_format = "mkv",
+        .matroska_num_wanted_uids = 1,
+        .matroska_wanted_uids = &none,
+        .matroska_found_uid = &found_uid,
+        .matroska_found_info = &found_info,
+        .matroska_no_segment = &no_segment,
+        .disable_cache = true,
+    };
+    struct mp_cancel *cancel = ctx->tl->cancel;
+    if (mp_cancel_test(cancel))
+        return;
+    struct demuxer *d = demux_open_url(filename, &params, cancel, ctx->global);
+    free_demuxer_and_stream(d);
+    uid_cache_add_result(ctx, filename, 0, found_info, no_segment, &found_uid);
+}
+
+static bool missing_in_cache(struct tl_ctx *ctx, char **filenames, int num)
+{
+    for (int i = 1; i < ctx->num_sources; i++) {
+        if (ctx->sources[i])
+            continue;
+        bool found = false;
+        for (int n = 0; n < num; n++) {
+            struct matroska_segment_uid uid;
+            if (uid_cache_lookup(filenames[n], 0, &uid) > 0 &&
+                !memcmp(uid.segment, ctx->uids[i].segment, 16))
+            {
+                found = true;
+                break;
+            }
+        }
+        if (!found)
+            return true;
+    }
+    return false;
+}
+
+#define PROBE_THREADS 4
+
+// Read the segment UIDs of the candidate files in parallel, so that the
+// sequential search below opens only the files it actually needs. Opening
+// files is mostly I/O bound (and slow on network filesystems), so this helps
+// even with few CPUs. Probing is done in batches, and stops as soon as all
+// sources referenced so far have been seen.
+static void prefetch_uids(struct tl_ctx *ctx, char **filenames, int num)
+{
+    struct mp_thread_pool *pool = mp_thread_pool_create(NULL, PROBE_THREADS);
+    if (!pool)
+        return;
+    struct probe_ctx p = { .ctx = ctx, .filenames = filenames };
+    for (int pos = 0; pos < num; pos += PROBE_THREADS * 2) {
+        if (!missing_in_cache(ctx, filenames, pos) ||
+            mp_cancel_test(ctx->tl->cancel))
+            break;
+        p.filenames = filenames + pos;
+        mp_thread_pool_run(pool, probe_file, &p,
+                           MPMIN(num - pos, PROBE_THREADS * 2));
+    }
+    talloc_free(pool);
+}
+
 static bool missing(struct tl_ctx *ctx)
 {
     for (int i = 0; i < ctx->num_sources; i++) {
@@ -274,6 +498,8 @@ static void find_ordered_chapter_sources(struct tl_ctx *ctx)
         }
         // Possibly get further segments appended to the first segment
         check_file(ctx, main_filename, 1);
+        if (missing(ctx))
+            prefetch_uids(ctx, filenames, num_filenames);
     }
 
     int old_source_count;
@@ -19,6 +19,7 @@
 #include <string.h>
 #include <strings.h>
 #include <dirent.h>
+#include <pthread.h>
 
 #include "config.h"
 #include "common/common.h"
@@ -28,6 +29,7 @@
 #include "options/path.h"
 #include "stream/stream.h"
 #include "osdep/io.h"
+#include "osdep/threads.h"
 #include "demux.h"
 
 #define PROBE_SIZE (8 * 1024)
@@ -56,6 +58,7 @@ struct pl_parser {
     enum demux_check check_level;
     struct stream *real_stream;
     char *format;
+    int scan_threads;
 };
 
 static char *pl_get_line0(struct pl_parser *p)
@@ -225,9 +228,12 @@ static bool same_st(struct stat *st1, struct stat *st2)
 }
 
 // Return true if this was a readable directory.
-static bool scan_dir(struct pl_parser *p, char *path,
+// Files and subdirectories listed in path are appended to files and subdirs.
+// If subdirs is NULL, subdirectories are scanned recursively instead.
+static bool scan_dir(struct pl_parser *p, void *ta_ctx, char *path,
                      struct stat *dir_stack, int num_dir_stack,
-                     char ***files, int *num_files)
+                     char ***files, int *num_files,
+                     char ***subdirs, int *num_subdirs)
 {
     if (strlen(path) >= 8192 || num_dir_stack == MAX_DIR_STACK)
         return false; // things like mount bind loops
@@ -246,7 +252,15 @@ static bool scan_dir(struct pl_parser *p, char *path,
         if (mp_cancel_test(p->s->cancel))
             break;
 
-        char *file = mp_path_join(p, path, ep->d_name);
+        char *file = mp_path_join(ta_ctx, path, ep->d_name);
+
+#ifdef DT_REG
+        // Avoid the stat() call for plain files if the FS tells us the type.
+        if (ep->d_type == DT_REG) {
+            MP_TARRAY_APPEND(ta_ctx, *files, *num_files, file);
+            continue;
+        }
+#endif
 
         struct stat st;
         if (stat(file, &st) == 0 && S_ISDIR(st.st_mode)) {
@@ -257,10 +271,16 @@ static bool scan_dir(struct pl_parser *p, char *path,
                 }
             }
 
+            if (subdirs) {
+                MP_TARRAY_APPEND(ta_ctx, *subdirs, *num_subdirs, file);
+                continue;
+            }
+
             dir_stack[num_dir_stack] = st;
-            scan_dir(p, file, dir_stack, num_dir_stack + 1, files, num_files);
+            scan_dir(p, ta_ctx, file, dir_stack, num_dir_stack + 1,
+                     files, num_files, NULL, NULL);
         } else {
-            MP_TARRAY_APPEND(p, *files, *num_files, file);
+            MP_TARRAY_APPEND(ta_ctx, *files, *num_files, file);
         }
 
         skip: ;
@@ -270,6 +290,81 @@ static bool scan_dir(struct pl_parser *p, char *path,
     return true;
 }
 
+// State shared by the threads scanning the subdirectories of a directory.
+struct dir_scan {
+    struct pl_parser *p;
+    char **subdirs;
+    int num_subdirs;
+    pthread_mutex_t lock;
+    int next;           // next entry in subdirs to scan
+    // Per-subdir results, so the result doesn't depend on thread timing.
+    // Each has its own talloc context, as talloc is not thread-safe.
+    void **ta_ctx;
+    char ***files;
+    int *num_files;
+};
+
+static void *dir_scan_thread(void *arg)
+{
+    struct dir_scan *ds = arg;
+    mpthread_set_name("dirscan");
+    for (;;) {
+        pthread_mutex_lock(&ds->lock);
+        int n = ds->next++;
+        pthread_mutex_unlock(&ds->lock);
+        if (n >= ds->num_subdirs)
+            break;
+
+        ds->ta_ctx[n] = talloc_new(NULL);
+        struct stat dir_stack[MAX_DIR_STACK];
+        if (stat(ds->subdirs[n], &dir_stack[0]) == 0) {
+            scan_dir(ds->p, ds->ta_ctx[n], ds->subdirs[n], dir_stack, 1,
+                     &ds->files[n], &ds->num_files[n], NULL, NULL);
+        }
+    }
+    return NULL;
+}
+
+// Like scan_dir(), but scan the subdirectories of path with multiple threads.
+// Every subdirectory (including its own subdirectories) is scanned by a
+// single thread.
+static void scan_dir_threaded(struct pl_parser *p, char *path,
+                              char ***files, int *num_files)
+{
+    struct dir_scan ds = {.p = p};
+    struct stat dir_stack[MAX_DIR_STACK];
+    if (!scan_dir(p, p, path, dir_stack, 0, files, num_files,
+                  &ds.subdirs, &ds.num_subdirs))
+        return;
+
+    ds.ta_ctx = talloc_zero_array(p, void *, ds.num_subdirs);
+    ds.files = talloc_zero_array(p, char **, ds.num_subdirs);
+    ds.num_files = talloc_zero_array(p, int, ds.num_subdirs);
+    pthread_mutex_init(&ds.lock, NULL);
+
+    int num_threads = MPMIN(p->scan_threads, ds.num_subdirs);
+    pthread_t *threads = talloc_zero_array(p, pthread_t, num_threads);
+    int started = 0;
+    for (int n = 0; n < num_threads; n++) {
+        if (pthread_create(&threads[n], NULL, dir_scan_thread, &ds))
+            break;
+        started++;
+    }
+    // If no thread could be created, scan on this thread.
+    if (!started)
+        dir_scan_thread(&ds);
+    for (int n = 0; n < started; n++)
+        pthread_join(threads[n], NULL);
+
+    pthread_mutex_destroy(&ds.lock);
+
+    for (int n = 0; n < ds.num_subdirs; n++) {
+        talloc_steal(p, ds.ta_ctx[n]);
+        for (int i = 0; i < ds.num_files[n]; i++)
+            MP_TARRAY_APPEND(p, *files, *num_files, ds.files[n][i]);
+    }
+}
+
 static int cmp_filename(const void *a, const void *b)
 {
     return strcmp(*(char **)a, *(char **)b);
@@ -286,9 +381,13 @@ static int parse_dir(struct pl_parser *p)
 
     char **files = NULL;
     int num_files = 0;
-    struct stat dir_stack[MAX_DIR_STACK];
 
-    scan_dir(p, path, dir_stack, 0, &files, &num_files);
+    if (p->scan_threads > 1) {
+        scan_dir_threaded(p, path, &files, &num_files);
+    } else {
+        struct stat dir_stack[MAX_DIR_STACK];
+        scan_dir(p, p, path, dir_stack, 0, &files, &num_files, NULL, NULL);
+    }
 
     if (files)
         qsort(files, num_files, sizeof(files[0]), cmp_filename);
@@ -346,6 +445,7 @@ static int open_file(struct demuxer *demuxer, enum demux_check check)
     p->pl = talloc_zero(p, struct playlist);
     p->real_stream = demuxer->stream;
     p->add_base = true;
+    p->scan_threads = demuxer->opts->directory_scan_threads;
 
     bstr probe_buf = stream_peek(demuxer->stream, PROBE_SIZE);
     p->s = open_memory_stream(probe_buf.start, probe_buf.len);
@@ -20,6 +20,7 @@
 
 #include "common/common.h"
 #include "common/msg.h"
+#include "options/options.h"
 
 #include "demux.h"
 #include "timeline.h"
@@ -55,6 +56,10 @@ struct priv {
     struct segment **segments;
     int num_segments;
     struct segment *current;
+    // Next segment, which is already seeked and read ahead in the background
+    // (with --demuxer-timeline-prefetch).
+    struct segment *prefetched;
+    double prefetch_secs;
 
     // As the demuxer user sees it.
     struct virtual_stream *streams;
@@ -82,13 +87,50 @@ static void reselect_streams(struct demuxer *demuxer)
             if (seg->stream_map[i] >= 0)
                 selected = p->streams[seg->stream_map[i]].selected;
             // This stops demuxer readahead for inactive segments.
-            if (!p->current || seg->d != p->current->d)
+            bool active = (p->current && seg->d == p->current->d) ||
+                          (p->prefetched && seg->d == p->prefetched->d);
+            if (!active)
                 selected = false;
             demuxer_select_track(seg->d, sh, MP_NOPTS_VALUE, selected);
         }
     }
 }
 
+// Stop background reading of the prefetched segment. If keep is false, its
+// streams are also deselected (discarding the prefetched packets).
+static void stop_prefetch(struct demuxer *demuxer, bool keep)
+{
+    struct priv *p = demuxer->priv;
+    struct segment *seg = p->prefetched;
+
+    if (!seg)
+        return;
+    demux_stop_thread(seg->d);
+    p->prefetched = NULL;
+    if (!keep)
+        reselect_streams(demuxer);
+}
+
+// Seek the source of the next segment to its start, and let it read ahead in
+// its own thread, so that switching to it does not interrupt playback.
+static void start_prefetch(struct demuxer *demuxer, struct segment *next)
+{
+    struct priv *p = demuxer->priv;
+
+    if (p->prefetched == next || next->d == p->current->d)
+        return;
+    stop_prefetch(demuxer, false);
+
+    MP_VERBOSE(demuxer, "prefetching segment %d\n", next->index);
+
+    p->prefetched = next;
+    reselect_streams(demuxer);
+    demux_set_ts_offset(next->d, next->start - next->d_start);
+    demux_seek(next->d, next->start, SEEK_BACKWARD | SEEK_HR);
+    demux_start_thread(next->d);
+    demux_start_prefetch(next->d);
+}
+
 static void switch_segment(struct demuxer *demuxer, struct segment *new,
                            double start_pts, int flags)
 {
@@ -100,10 +142,17 @@ static void switch_segment(struct demuxer *demuxer, struct segment *new,
 
     MP_VERBOSE(demuxer, "switch to segment %d\n", new->index);
 
+    // Continuing with the prefetched segment at its start needs no seek.
+    bool prefetched = p->prefetched == new && start_pts == new->start &&
+                      !(flags & SEEK_FORWARD);
+    stop_prefetch(demuxer, prefetched);
+
     p->current = new;
     reselect_streams(demuxer);
-    demux_set_ts_offset(new->d, new->start - new->d_start);
-    demux_seek(new->d, start_pts, flags);
+    if (!prefetched) {
+        demux_set_ts_offset(new->d, new->start - new->d_start);
+        demux_seek(new->d, start_pts, flags);
+    }
 
     for (int n = 0; n < p->num_streams; n++) {
         struct virtual_stream *vs = &p->streams[n];
@@ -147,6 +196,10 @@ static int d_fill_buffer(struct demuxer *demuxer)
     if (!pkt || pkt->pts >= seg->end)
         p->eos_packets += 1;
 
+    if (p->prefetch_secs > 0 && seg->index + 1 < p->num_segments && pkt &&
+        pkt->pts != MP_NOPTS_VALUE && pkt->pts >= seg->end - p->prefetch_secs)
+        start_prefetch(demuxer, p->segments[seg->index + 1]);
+
     // Test for EOF. Do this here to properly run into EOF even if other
     // streams are disabled etc. If it somehow doesn't manage to reach the end
     // after demuxing a high (bit arbitrary) number of packets, assume one of
@@ -349,6 +402,8 @@ static int d_open(struct demuxer *demuxer, enum demux_check check)
 
     print_timeline(demuxer);
 
+    p->prefetch_secs = demuxer->opts->demuxer_timeline_prefetch;
+
     demuxer->seekable = true;
     demuxer->partially_seekable = false;
 
@@ -363,6 +418,7 @@ static void d_close(struct demuxer *demuxer)
 {
     struct priv *p = demuxer->priv;
     struct demuxer *master = p->tl->demuxer;
+    stop_prefetch(demuxer, true);
     timeline_destroy(p->tl);
     free_demuxer(master);
 }
@@ -200,11 +200,18 @@ static int demux_tv_fill_buffer(demuxer_t *demux)
     if (want_video && tvh->functions->control(tvh->priv,
                             TVI_CONTROL_IS_VIDEO, 0) == TVI_CONTROL_TRUE)
     {
-        len = tvh->functions->get_video_framesize(tvh->priv);
-        dp=new_demux_packet(len);
+        // Prefer taking the driver's packet directly, which avoids a copy.
+        dp = NULL;
+        if (tvh->functions->control(tvh->priv, TVI_CONTROL_VID_GRAB_PACKET,
+                                    &dp) != TVI_CONTROL_TRUE)
+        {
+            len = tvh->functions->get_video_framesize(tvh->priv);
+            dp=new_demux_packet(len);
+            if (dp)
+                dp->pts=tvh->functions->grab_video_frame(tvh->priv, dp->buffer, len);
+        }
         if (dp) {
             dp->keyframe = true;
-            dp->pts=tvh->functions->grab_video_frame(tvh->priv, dp->buffer, len);
             demux_add_packet(want_video, dp);
         }
     }
@@ -18,6 +18,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <libavcodec/avcodec.h>
 #include <libavutil/intreadwrite.h>
@@ -29,10 +30,54 @@
 
 #include "packet.h"
 
+// Freed AVPacket headers are kept for reuse, which saves one malloc/free pair
+// per packet in the common case. Packets can be freed on any thread.
+#define MAX_CACHED_AVPACKETS 256
+
+static pthread_mutex_t avpacket_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static AVPacket *avpacket_cache[MAX_CACHED_AVPACKETS];
+static int num_avpacket_cache;
+
+static AVPacket *avpacket_get(void)
+{
+    AVPacket *pkt = NULL;
+    pthread_mutex_lock(&avpacket_cache_lock);
+    if (num_avpacket_cache)
+        pkt = avpacket_cache[--num_avpacket_cache];
+    pthread_mutex_unlock(&avpacket_cache_lock);
+    if (pkt)
+        return pkt;
+#if HAVE_AV_PACKET_ALLOC
+    return av_packet_alloc();
+#else
+    pkt = av_mallocz(sizeof(*pkt));
+    if (pkt)
+        av_init_packet(pkt);
+    return pkt;
+#endif
+}
+
+// pkt must have been unreferenced.
+static void avpacket_put(AVPacket *pkt)
+{
+    pthread_mutex_lock(&avpacket_cache_lock);
+    if (num_avpacket_cache < MAX_CACHED_AVPACKETS) {
+        avpacket_cache[num_avpacket_cache++] = pkt;
+        pkt = NULL;
+    }
+    pthread_mutex_unlock(&avpacket_cache_lock);
+#if HAVE_AV_PACKET_ALLOC
+    av_packet_free(&pkt);
+#else
+    av_free(pkt);
+#endif
+}
+
 static void packet_destroy(void *ptr)
 {
     struct demux_packet *dp = ptr;
     av_packet_unref(dp->avpacket);
+    avpacket_put(dp->avpacket);
 }
 
 // This actually preserves only data and side data, not PTS/DTS/pos/etc.
@@ -42,6 +87,9 @@ struct demux_packet *new_demux_packet_from_avpacket(struct AVPacket *avpkt)
 {
     if (avpkt->size > 1000000000)
         return NULL;
+    AVPacket *pkt = avpacket_get();
+    if (!pkt)
+        return NULL;
     struct demux_packet *dp = talloc(NULL, struct demux_packet);
     talloc_set_destructor(dp, packet_destroy);
     *dp = (struct demux_packet) {
@@ -52,9 +100,9 @@ struct demux_packet *new_demux_packet_from_avpacket(struct AVPacket *avpkt)
         .start = MP_NOPTS_VALUE,
         .end = MP_NOPTS_VALUE,
         .stream = -1,
-        .avpacket = talloc_zero(dp, AVPacket),
+        .kf_seek_pts = MP_NOPTS_VALUE,
+        .avpacket = pkt,
     };
-    av_init_packet(dp->avpacket);
     int r = -1;
     if (avpkt->data) {
         // We hope that this function won't need/access AVPacket input padding,
@@ -146,3 +194,209 @@ int demux_packet_set_padding(struct demux_packet *dp, int start, int end)
 #endif
     return 0;
 }
+
+// Buffers are pooled in power-of-2 size classes from 1<<POOL_MIN_SHIFT to
+// 1<<POOL_MAX_SHIFT bytes (including padding). Larger packets are allocated
+// normally.
+#define POOL_MIN_SHIFT 8
+#define POOL_MAX_SHIFT 22
+#define POOL_NUM_CLASSES (POOL_MAX_SHIFT - POOL_MIN_SHIFT + 1)
+// Maximum number of free buffers kept per size class.
+#define POOL_MAX_FREE 64
+// Maximum total size of free buffers kept by a pool.
+#define POOL_MAX_RETAINED (16 * 1024 * 1024)
+// Space in front of the buffer data. The first byte stores the size class. This
+// is large enough to keep the av_malloc() alignment.
+#define POOL_HEADER 64
+
+struct demux_packet_pool {
+    pthread_mutex_t lock;
+    // Owner reference + one reference for each buffer handed out. The pool is
+    // freed if this drops to 0, so buffers can outlive the demuxer.
+    int refcount;
+    void *free_bufs[POOL_NUM_CLASSES][POOL_MAX_FREE];
+    int num_free[POOL_NUM_CLASSES];
+    struct demux_packet_pool_stats stats;
+};
+
+struct demux_packet_pool *demux_packet_pool_create(void)
+{
+    struct demux_packet_pool *pool = talloc_zero(NULL, struct demux_packet_pool);
+    pthread_mutex_init(&pool->lock, NULL);
+    pool->refcount = 1;
+    return pool;
+}
+
+// Called locked. Returns true if nothing references the pool anymore, and the
+// caller has to free it.
+static bool pool_unref_locked(struct demux_packet_pool *pool)
+{
+    assert(pool->refcount > 0);
+    pool->refcount--;
+    return pool->refcount == 0;
+}
+
+static void pool_free(struct demux_packet_pool *pool)
+{
+    for (int c = 0; c < POOL_NUM_CLASSES; c++) {
+        for (int n = 0; n < pool->num_free[c]; n++)
+            av_free(pool->free_bufs[c][n]);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    talloc_free(pool);
+}
+
+// Release the owner reference. Buffers still in use keep the pool alive.
+void demux_packet_pool_destroy(struct demux_packet_pool *pool)
+{
+    if (!pool)
+        return;
+    pthread_mutex_lock(&pool->lock);
+    bool dead = pool_unref_locked(pool);
+    pthread_mutex_unlock(&pool->lock);
+    if (dead)
+        pool_free(pool);
+}
+
+void demux_packet_pool_get_stats(struct demux_packet_pool *pool,
+                                 struct demux_packet_pool_stats *stats)
+{
+    pthread_mutex_lock(&pool->lock);
+    *stats = pool->stats;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static int pool_size_class(size_t size)
+{
+    for (int c = 0; c < POOL_NUM_CLASSES; c++) {
+        if (size <= ((size_t)1 << (POOL_MIN_SHIFT + c)))
+            return c;
+    }
+    return -1;
+}
+
+// AVBufferRef free callback; can be called from any thread.
+static void pool_buffer_free(void *opaque, uint8_t *data)
+{
+    struct demux_packet_pool *pool = opaque;
+    pthread_mutex_lock(&pool->lock);
+    // The buffer size is implied by the class, which is stored in front of
+    // the data (see pool_buffer_get()).
+    uint8_t *base = data - POOL_HEADER;
+    int c = base[0];
+    size_t size = (size_t)1 << (POOL_MIN_SHIFT + c);
+    pool->stats.outstanding--;
+    if (pool->refcount > 1 && pool->num_free[c] < POOL_MAX_FREE &&
+        pool->stats.retained_bytes + size <= POOL_MAX_RETAINED)
+    {
+        pool->free_bufs[c][pool->num_free[c]++] = base;
+        pool->stats.retained_bytes += size;
+        base = NULL;
+    }
+    bool dead = pool_unref_locked(pool);
+    pthread_mutex_unlock(&pool->lock);
+    av_free(base);
+    if (dead)
+        pool_free(pool);
+}
+
+static AVBufferRef *pool_buffer_get(struct demux_packet_pool *pool, size_t size)
+{
+    int c = pool_size_class(size);
+    if (c < 0) {
+        pthread_mutex_lock(&pool->lock);
+        pool->stats.requests++;
+        pool->stats.unpooled++;
+        pthread_mutex_unlock(&pool->lock);
+        return av_buffer_alloc(size);
+    }
+    size_t class_size = (size_t)1 << (POOL_MIN_SHIFT + c);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stats.requests++;
+    uint8_t *base = NULL;
+    if (pool->num_free[c]) {
+        base = pool->free_bufs[c][--pool->num_free[c]];
+        pool->stats.retained_bytes -= class_size;
+        pool->stats.reused++;
+    } else {
+        pool->stats.allocated++;
+    }
+    pool->refcount++;
+    pool->stats.outstanding++;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (!base)
+        base = av_malloc(class_size + POOL_HEADER);
+    AVBufferRef *buf = NULL;
+    if (base) {
+        base[0] = c;
+        buf = av_buffer_create(base + POOL_HEADER, class_size,
+                               pool_buffer_free, pool, 0);
+        if (!buf)
+            av_free(base);
+    }
+    if (!buf) {
+        pthread_mutex_lock(&pool->lock);
+        pool->stats.outstanding--;
+        bool dead = pool_unref_locked(pool);
+        pthread_mutex_unlock(&pool->lock);
+        if (dead)
+            pool_free(pool);
+    }
+    return buf;
+}
+
+// Return a buffer of at least the given size. If pool is NULL, the buffer is
+// allocated normally. The contents are uninitialized.
+struct AVBufferRef *demux_packet_pool_get_buffer(struct demux_packet_pool *pool,
+                                                 size_t size)
+{
+    return pool ? pool_buffer_get(pool, size) : av_buffer_alloc(size);
+}
+
+// Create a packet that references data within buf, without copying. The
+// slice must be followed by FF_INPUT_BUFFER_PADDING_SIZE zeroed bytes, which
+// are within the buffer as well. The caller keeps its own reference to buf.
+struct demux_packet *new_demux_packet_from_buf(struct AVBufferRef *buf,
+                                               void *data, size_t len)
+{
+    if (len > INT_MAX)
+        return NULL;
+    assert((uint8_t *)data >= buf->data &&
+           (uint8_t *)data + len + FF_INPUT_BUFFER_PADDING_SIZE <=
+                buf->data + buf->size);
+    AVPacket pkt = { .buf = buf, .data = data, .size = len };
+    return new_demux_packet_from_avpacket(&pkt);
+}
+
+// Like new_demux_packet(), but take the packet buffer from the pool. pool can
+// be NULL, in which case this behaves exactly like new_demux_packet().
+struct demux_packet *new_demux_packet_pool(struct demux_packet_pool *pool,
+                                           size_t len)
+{
+    if (!pool)
+        return new_demux_packet(len);
+    if (len > INT_MAX - FF_INPUT_BUFFER_PADDING_SIZE)
+        return NULL;
+    AVBufferRef *buf = pool_buffer_get(pool, len + FF_INPUT_BUFFER_PADDING_SIZE);
+    if (!buf)
+        return NULL;
+    memset(buf->data + len, 0, FF_INPUT_BUFFER_PADDING_SIZE);
+    AVPacket pkt = { .buf = buf, .data = buf->data, .size = len };
+    struct demux_packet *dp = new_demux_packet_from_avpacket(&pkt);
+    av_buffer_unref(&buf);
+    return dp;
+}
+
+// Like new_demux_packet_from(), but take the packet buffer from the pool.
+struct demux_packet *new_demux_packet_from_pool(struct demux_packet_pool *pool,
+                                                void *data, size_t len)
+{
+    if (!pool)
+        return new_demux_packet_from(data, len);
+    struct demux_packet *dp = new_demux_packet_pool(pool, len);
+    if (dp)
+        memcpy(dp->buffer, data, len);
+    return dp;
+}
@@ -42,9 +42,21 @@ typedef struct demux_packet {
 
     // private
     struct demux_packet *next;
+    double kf_seek_pts;         // demux.c internal: seek pts of keyframe range
     struct AVPacket *avpacket;   // keep the buffer allocation and sidedata
 } demux_packet_t;
 
+struct demux_packet_pool;
+
+struct demux_packet_pool_stats {
+    int64_t requests;       // number of buffers requested
+    int64_t reused;         // requests served with a recycled buffer
+    int64_t allocated;      // requests that needed a new pooled buffer
+    int64_t unpooled;       // requests too large for the pool
+    int64_t retained_bytes; // size of all free buffers kept by the pool
+    int64_t outstanding;    // pooled buffers currently in use
+};
+
 struct demux_packet *new_demux_packet(size_t len);
 struct demux_packet *new_demux_packet_from_avpacket(struct AVPacket *avpkt);
 struct demux_packet *new_demux_packet_from(void *data, size_t len);
@@ -56,4 +68,17 @@ void demux_packet_copy_attribs(struct demux_packet *dst, struct demux_packet *sr
 
 int demux_packet_set_padding(struct demux_packet *dp, int start, int end);
 
+struct demux_packet_pool *demux_packet_pool_create(void);
+void demux_packet_pool_destroy(struct demux_packet_pool *pool);
+void demux_packet_pool_get_stats(struct demux_packet_pool *pool,
+                                 struct demux_packet_pool_stats *stats);
+struct demux_packet *new_demux_packet_pool(struct demux_packet_pool *pool,
+                                           size_t len);
+struct demux_packet *new_demux_packet_from_pool(struct demux_packet_pool *pool,
+                                                void *data, size_t len);
+struct AVBufferRef *demux_packet_pool_get_buffer(struct demux_packet_pool *pool,
+                                                 size_t size);
+struct demux_packet *new_demux_packet_from_buf(struct AVBufferRef *buf,
+                                               void *data, size_t len);
+
 #endif /* MPLAYER_DEMUX_PACKET_H */
@@ -126,6 +126,8 @@ const struct mp_cmd_def mp_cmds[] = {
                       {"window", 1},
                       {"subtitles", 2})),
   }},
+  { MP_CMD_THUMBNAIL, "thumbnail", { ARG_TIME, OARG_INT(160), OARG_INT(0) } },
+  { MP_CMD_THUMBNAIL_CANCEL, "thumbnail-cancel", },
   { MP_CMD_LOADFILE, "loadfile", {
       ARG_STRING,
       OARG_CHOICE(0, ({"replace", 0},
@@ -202,7 +204,12 @@ const struct mp_cmd_def mp_cmds[] = {
 
   { MP_CMD_WRITE_WATCH_LATER_CONFIG, "write-watch-later-config", },
 
-  { MP_CMD_HOOK_ADD, "hook-add", { ARG_STRING, ARG_INT, ARG_INT } },
+  { MP_CMD_HOOK_ADD, "hook-add", {
+      ARG_STRING, ARG_INT, ARG_INT,
+      OARG_CHOICE(0, ({"serial", 0},
+                      {"parallel", 1})),
+      OARG_DOUBLE(0),   // timeout
+  }},
   { MP_CMD_HOOK_ACK, "hook-ack", { ARG_STRING } },
 
   { MP_CMD_MOUSE, "mouse", {
@@ -49,6 +49,8 @@ enum mp_command_type {
     MP_CMD_SCREENSHOT,
     MP_CMD_SCREENSHOT_TO_FILE,
     MP_CMD_SCREENSHOT_RAW,
+    MP_CMD_THUMBNAIL,
+    MP_CMD_THUMBNAIL_CANCEL,
     MP_CMD_LOADFILE,
     MP_CMD_LOADLIST,
     MP_CMD_PLAYLIST_CLEAR,
@@ -16,6 +16,8 @@
  */
 
 #include <stddef.h>
+#include <stdlib.h>
+#include <pthread.h>
 
 #include "misc/bstr.h"
 #include "common/common.h"
@@ -63,6 +65,37 @@ static bool apply_flag(struct mp_cmd *cmd, bstr str)
     return false;
 }
 
+// mp_cmds[] entries sorted by name, for binary search in find_cmd().
+static const struct mp_cmd_def **sorted_cmds;
+static int num_sorted_cmds;
+static pthread_once_t sorted_cmds_once = PTHREAD_ONCE_INIT;
+
+static int cmp_cmd_def(const void *a, const void *b)
+{
+    const struct mp_cmd_def *da = *(const struct mp_cmd_def **)a;
+    const struct mp_cmd_def *db = *(const struct mp_cmd_def **)b;
+    return strcmp(da->name, db->name);
+}
+
+static int cmp_cmd_name(const void *key, const void *b)
+{
+    const struct mp_cmd_def *db = *(const struct mp_cmd_def **)b;
+    return strcmp(key, db->name);
+}
+
+static void init_sorted_cmds(void)
+{
+    int num = 0;
+    while (mp_cmds[num].name)
+        num++;
+    // Lives until process exit.
+    sorted_cmds = talloc_array(NULL, const struct mp_cmd_def *, num);
+    for (int n = 0; n < num; n++)
+        sorted_cmds[n] = &mp_cmds[n];
+    qsort(sorted_cmds, num, sizeof(sorted_cmds[0]), cmp_cmd_def);
+    num_sorted_cmds = num;
+}
+
 static bool find_cmd(struct mp_log *log, struct mp_cmd *cmd, bstr name)
 {
     if (name.len == 0) {
@@ -77,13 +110,14 @@ static bool find_cmd(struct mp_log *log, struct mp_cmd *cmd, bstr name)
             nname[n] = '-';
     }
 
-    for (int n = 0; mp_cmds[n].name; n++) {
-        if (strcmp(nname, mp_cmds[n].name) == 0) {
-            cmd->def = &mp_cmds[n];
-            cmd->name = (char *)cmd->def->name;
-            cmd->id = cmd->def->id;
-            return true;
-        }
+    pthread_once(&sorted_cmds_once, init_sorted_cmds);
+    const struct mp_cmd_def **def = bsearch(nname, sorted_cmds, num_sorted_cmds,
+                                            sizeof(sorted_cmds[0]), cmp_cmd_name);
+    if (def) {
+        cmd->def = *def;
+        cmd->name = (char *)cmd->def->name;
+        cmd->id = cmd->def->id;
+        return true;
     }
     mp_err(log, "Command '%.*s' not found.\n", BSTR_P(name));
     return false;
@@ -68,6 +68,7 @@ struct cmd_bind {
     int num_keys;
     char *cmd;
     char *location;     // filename/line number of definition
+    struct mp_cmd *parsed; // parsed cmd, cloned on use (NULL if invalid)
     bool is_builtin;
     struct cmd_bind_section *owner;
 };
@@ -83,6 +84,8 @@ struct cmd_bind_section {
 
 #define MP_MAX_SOURCES 10
 
+#define PARSE_CACHE_SIZE 8
+
 #define MAX_ACTIVE_SECTIONS 50
 
 struct active_section {
@@ -140,11 +143,24 @@ struct input_ctx {
 
     unsigned int mouse_event_counter;
 
+    // Mouse move command held back by --input-mouse-move-rate, and the time
+    // the last mouse move command was queued.
+    struct mp_cmd *pending_move;
+    int64_t last_move_time;
+
     struct mp_input_src *sources[MP_MAX_SOURCES];
     int num_sources;
 
     struct cmd_queue cmd_queue;
 
+    // Recently parsed command strings (mp_input_parse_cmd()), most recently
+    // used first. Avoids re-parsing the same strings sent by scripts/IPC.
+    struct parse_cache_entry {
+        char *str;
+        struct mp_cmd *cmd;
+    } parse_cache[PARSE_CACHE_SIZE];
+    int num_parse_cache;
+
     struct mp_cancel *cancel;
 };
 
@@ -168,6 +184,7 @@ struct input_opts {
     int use_app_events;
     int default_bindings;
     int enable_mouse_movements;
+    int mouse_move_rate;
     int vo_key_input;
     int test;
 };
@@ -185,6 +202,7 @@ const struct m_sub_options input_config = {
         OPT_FLAG("right-alt-gr", use_alt_gr, CONF_GLOBAL),
         OPT_INTRANGE("key-fifo-size", key_fifo_size, CONF_GLOBAL, 2, 65000),
         OPT_FLAG("cursor", enable_mouse_movements, CONF_GLOBAL),
+        OPT_INTRANGE("mouse-move-rate", mouse_move_rate, 0, 0, 10000),
         OPT_FLAG("vo-keyboard", vo_key_input, CONF_GLOBAL),
 #if HAVE_COCOA
         OPT_FLAG("appleremote", use_appleremote, CONF_GLOBAL),
@@ -269,8 +287,7 @@ static void append_bind_info(struct input_ctx *ictx, char **pmsg,
                              struct cmd_bind *bind)
 {
     char *msg = *pmsg;
-    struct mp_cmd *cmd = mp_input_parse_cmd(ictx, bstr0(bind->cmd),
-                                            bind->location);
+    struct mp_cmd *cmd = bind->parsed;
     bstr stripped = cmd ? cmd->original : bstr0(bind->cmd);
     msg = talloc_asprintf_append(msg, " '%.*s'", BSTR_P(stripped));
     if (!cmd)
@@ -281,7 +298,6 @@ static void append_bind_info(struct input_ctx *ictx, char **pmsg,
     msg = talloc_asprintf_append(msg, " in %s", bind->location);
     if (bind->is_builtin)
         msg = talloc_asprintf_append(msg, " (default)");
-    talloc_free(cmd);
     *pmsg = msg;
 }
 
@@ -459,7 +475,7 @@ static mp_cmd_t *get_cmd_from_keys(struct input_ctx *ictx, char *force_section,
         talloc_free(key_buf);
         return NULL;
     }
-    mp_cmd_t *ret = mp_input_parse_cmd(ictx, bstr0(cmd->cmd), cmd->location);
+    mp_cmd_t *ret = mp_cmd_clone(cmd->parsed);
     if (ret) {
         ret->input_section = cmd->owner->section;
         ret->key_name = talloc_steal(ret, mp_input_get_key_combo_name(&code, 1));
@@ -704,6 +720,26 @@ bool mp_input_vo_keyboard_enabled(struct input_ctx *ictx)
     return r;
 }
 
+// Time in microseconds until the next mouse move command may be queued
+// according to --input-mouse-move-rate (<= 0 if it may be queued now).
+static int64_t mouse_move_delay(struct input_ctx *ictx)
+{
+    int rate = ictx->opts->mouse_move_rate;
+    if (rate <= 0)
+        return 0;
+    return ictx->last_move_time + 1000000 / rate - mp_time_us();
+}
+
+// Queue the held back mouse move command, if any.
+static void flush_pending_move(struct input_ctx *ictx)
+{
+    if (ictx->pending_move) {
+        queue_add_tail(&ictx->cmd_queue, ictx->pending_move);
+        ictx->pending_move = NULL;
+        ictx->last_move_time = mp_time_us();
+    }
+}
+
 void mp_input_set_mouse_pos(struct input_ctx *ictx, int x, int y)
 {
     input_lock(ictx);
@@ -755,8 +791,17 @@ void mp_input_set_mouse_pos_artificial(struct input_ctx *ictx, int x, int y)
             if (tail && tail->mouse_move) {
                 queue_remove(&ictx->cmd_queue, tail);
                 talloc_free(tail);
+                mp_input_queue_cmd(ictx, cmd);
+            } else if (mouse_move_delay(ictx) > 0) {
+                // Deliver only the latest position once the delay is over.
+                bool was_pending = !!ictx->pending_move;
+                talloc_free(ictx->pending_move);
+                ictx->pending_move = cmd;
+                if (!was_pending)
+                    mp_input_wakeup(ictx); // recompute the wait time
+            } else {
+                mp_input_queue_cmd(ictx, cmd);
             }
-            mp_input_queue_cmd(ictx, cmd);
         }
     }
     input_unlock(ictx);
@@ -782,6 +827,8 @@ static void adjust_max_wait_time(struct input_ctx *ictx, double *time)
         *time = FFMIN(*time, 1.0 / opts->ar_rate);
         *time = FFMIN(*time, opts->ar_delay / 1000.0);
     }
+    if (ictx->pending_move)
+        *time = FFMIN(*time, FFMAX(mouse_move_delay(ictx), 0) / 1e6);
 }
 
 static bool test_abort_cmd(struct input_ctx *ictx, struct mp_cmd *new)
@@ -804,6 +851,10 @@ int mp_input_queue_cmd(struct input_ctx *ictx, mp_cmd_t *cmd)
     if (cmd) {
         if (ictx->cancel && test_abort_cmd(ictx, cmd))
             mp_cancel_trigger(ictx->cancel);
+        // Keep the order between mouse moves and other commands.
+        flush_pending_move(ictx);
+        if (cmd->mouse_move)
+            ictx->last_move_time = mp_time_us();
         queue_add_tail(&ictx->cmd_queue, cmd);
         mp_input_wakeup(ictx);
     }
@@ -877,6 +928,8 @@ void mp_input_wakeup(struct input_ctx *ictx)
 mp_cmd_t *mp_input_read_cmd(struct input_ctx *ictx)
 {
     input_lock(ictx);
+    if (ictx->pending_move && mouse_move_delay(ictx) <= 0)
+        flush_pending_move(ictx);
     struct mp_cmd *ret = queue_remove_head(&ictx->cmd_queue);
     if (!ret)
         ret = check_autorepeat(ictx);
@@ -1005,6 +1058,7 @@ static void bind_dealloc(struct cmd_bind *bind)
 {
     talloc_free(bind->cmd);
     talloc_free(bind->location);
+    talloc_free(bind->parsed);
 }
 
 // builtin: if true, remove all builtin binds, else remove all user binds
@@ -1082,6 +1136,10 @@ static void bind_keys(struct input_ctx *ictx, bool builtin, bstr section,
         .is_builtin = builtin,
         .num_keys = num_keys,
     };
+    // Parse once here (which also prints warnings for invalid commands), and
+    // only clone the result when the key is pressed.
+    bind->parsed = mp_input_parse_cmd_(ictx->log, command, loc);
+    talloc_steal(bs->binds, bind->parsed);
     memcpy(bind->keys, keys, num_keys * sizeof(bind->keys[0]));
     if (mp_msg_test(ictx->log, MSGL_DEBUG)) {
         char *s = mp_input_get_key_combo_name(keys, num_keys);
@@ -1155,9 +1213,6 @@ static int parse_config(struct input_ctx *ictx, bool builtin, bstr data,
 
         bind_keys(ictx, builtin, section, keys, num_keys, command, cur_loc);
         n_binds++;
-
-        // Print warnings if invalid commands are encountered.
-        talloc_free(mp_input_parse_cmd(ictx, command, cur_loc));
     }
 
     talloc_free(cur_loc);
@@ -1305,6 +1360,9 @@ void mp_input_uninit(struct input_ctx *ictx)
 
     close_input_sources(ictx);
     clear_queue(&ictx->cmd_queue);
+    for (int n = 0; n < ictx->num_parse_cache; n++)
+        talloc_free(ictx->parse_cache[n].cmd);
+    talloc_free(ictx->pending_move);
     talloc_free(ictx->current_down_cmd);
     pthread_mutex_destroy(&ictx->mutex);
     sem_destroy(&ictx->wakeup);
@@ -1326,7 +1384,37 @@ bool mp_input_use_alt_gr(struct input_ctx *ictx)
 struct mp_cmd *mp_input_parse_cmd(struct input_ctx *ictx, bstr str,
                                   const char *location)
 {
-    return mp_input_parse_cmd_(ictx->log, str, location);
+    input_lock(ictx);
+    struct parse_cache_entry *cache = ictx->parse_cache;
+    struct mp_cmd *cmd = NULL;
+    for (int n = 0; n < ictx->num_parse_cache; n++) {
+        if (bstr_equals0(str, cache[n].str)) {
+            struct parse_cache_entry e = cache[n];
+            memmove(&cache[1], &cache[0], n * sizeof(cache[0]));
+            cache[0] = e;
+            cmd = mp_cmd_clone(e.cmd);
+            goto done;
+        }
+    }
+
+    // Failures are not cached, so that error messages are always printed.
+    cmd = mp_input_parse_cmd_(ictx->log, str, location);
+    if (!cmd)
+        goto done;
+
+    if (ictx->num_parse_cache == PARSE_CACHE_SIZE)
+        talloc_free(cache[--ictx->num_parse_cache].cmd);
+    memmove(&cache[1], &cache[0], ictx->num_parse_cache * sizeof(cache[0]));
+    struct mp_cmd *tmpl = mp_cmd_clone(cmd);
+    cache[0] = (struct parse_cache_entry){
+        .str = bstrdup0(tmpl, str),
+        .cmd = tmpl,
+    };
+    ictx->num_parse_cache++;
+
+done:
+    input_unlock(ictx);
+    return cmd;
 }
 
 void mp_input_run_cmd(struct input_ctx *ictx, const char **cmd)
@@ -263,7 +263,25 @@ char *mp_json_encode_event(struct mpv_event *event);
 
 // Given the raw IPC input buffer "buf", remove the first newline-separated
 // command, execute it and return the result (if any) as an allocated string.
+// The command is removed by advancing buf past it; the memory it points to is
+// not touched. The caller should compact its buffer once all complete commands
+// were consumed.
 struct mpv_handle;
 char *mp_ipc_consume_next_command(struct mpv_handle *client, void *ctx, bstr *buf);
 
+// Serialize the given mpv_event structure to msgpack. The returned data is
+// allocated as talloc child of ta_parent.
+bstr mp_msgpack_encode_event(void *ta_parent, struct mpv_event *event);
+
+// Whether the raw IPC input buffer "buf" starts with a msgpack message. Returns
+// 1 if it does, 0 if it doesn't, and -1 if more data is needed to tell.
+int mp_ipc_is_msgpack(bstr buf);
+
+// Like mp_ipc_consume_next_command(), but for a msgpack message. Returns 1 if
+// a message was consumed (*out_reply is set to the allocated msgpack reply),
+// 0 if buf does not contain a complete message yet, and -1 if the data is
+// invalid (the connection can't be recovered).
+int mp_ipc_consume_next_msgpack(struct mpv_handle *client, void *ctx, bstr *buf,
+                                bstr *out_reply);
+
 #endif /* MPLAYER_INPUT_H */
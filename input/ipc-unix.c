@@ -43,6 +43,12 @@
 #define MSG_NOSIGNAL 0
 #endif
 
+// If more than this is queued for writing to a client, stop reading events
+// and commands from it until the client has read some of the data.
+#define MAX_WRITE_BUFFER (64 * 1024)
+
+struct client_arg;
+
 struct mp_ipc_ctx {
     struct mp_log *log;
     struct mp_client_api *client_api;
@@ -50,183 +56,396 @@ struct mp_ipc_ctx {
 
     pthread_t thread;
     int death_pipe[2];
+    // Written to by command threads when they queued a reply or exited.
+    int wakeup_pipe[2];
+
+    // Only accessed by the IPC thread (after it was started).
+    int listen_fd;
+    bool stopping;
+    struct client_arg **clients;
+    int num_clients;
+    int client_num;
 };
 
+// The IPC thread does all socket I/O and reads the events of all clients.
+// Commands can block for a long time (e.g. "loadfile" or property reads while
+// the core is busy), so they are run on a separate thread per client, which
+// exists only while the client has commands to run.
 struct client_arg {
+    struct mp_ipc_ctx *ctx;
     struct mp_log *log;
     struct mpv_handle *client;
 
     char *client_name;
     int client_fd;
     bool close_client_fd;
+    int wakeup_fd;
+
+    // -- only accessed by the IPC thread
+    // There may be unread events, even though the wakeup pipe was flushed.
+    bool events_pending;
+    // Disconnected, but the command thread still runs.
+    bool removing;
+    bool has_thread;
+    pthread_t thread;
+
+    pthread_mutex_t lock;
 
+    // -- protected by lock
     bool writable;
+    // Set once the client sent a msgpack message; events are then sent as
+    // msgpack as well.
+    bool msgpack;
+    bool running;       // command thread is active
+    bool new_input;     // read_buf was appended to since it was last parsed
+    bool failed;        // command thread hit an error; remove the client
+    bstr read_buf;
+    bstr write_buf;
 };
 
-static int ipc_write_str(struct client_arg *client, const char *buf)
+// Write as much of the queued data as possible without blocking.
+// Must be called with client->lock held.
+static int ipc_flush(struct client_arg *client)
 {
-    size_t count = strlen(buf);
-    while (count > 0) {
-        ssize_t rc = send(client->client_fd, buf, count, MSG_NOSIGNAL);
+    size_t done = 0;
+    while (done < client->write_buf.len) {
+        ssize_t rc = send(client->client_fd, client->write_buf.start + done,
+                          client->write_buf.len - done, MSG_NOSIGNAL);
         if (rc <= 0) {
             if (rc == 0)
                 return -1;
 
             if (errno == EBADF) {
                 client->writable = false;
-                return 0;
+                done = client->write_buf.len;
+                break;
             }
 
             if (errno == EINTR)
                 continue;
 
             if (errno == EAGAIN)
-                return 0;
+                break;
 
             return rc;
         }
 
-        count -= rc;
-        buf   += rc;
+        done += rc;
     }
 
+    if (done) {
+        client->write_buf.len -= done;
+        memmove(client->write_buf.start, client->write_buf.start + done,
+                client->write_buf.len);
+    }
     return 0;
 }
 
-static void *client_thread(void *p)
+// Must be called with client->lock held.
+static int ipc_write(struct client_arg *client, const void *data, size_t count)
 {
-    pthread_detach(pthread_self());
+    bstr_xappend(client, &client->write_buf, (bstr){(unsigned char *)data, count});
+    return ipc_flush(client);
+}
 
-    int rc;
+static int ipc_write_str(struct client_arg *client, const char *buf)
+{
+    return ipc_write(client, buf, strlen(buf));
+}
 
-    struct client_arg *arg = p;
-    bstr client_msg = { talloc_strdup(NULL, ""), 0 };
+static bool client_blocked(struct client_arg *arg)
+{
+    pthread_mutex_lock(&arg->lock);
+    bool blocked = arg->write_buf.len >= MAX_WRITE_BUFFER;
+    pthread_mutex_unlock(&arg->lock);
+    return blocked;
+}
 
-    mpthread_set_name(arg->client_name);
+// Returns false if the client should be removed.
+static bool client_read_events(struct client_arg *arg)
+{
+    while (!client_blocked(arg)) {
+        mpv_event *event = mpv_wait_event(arg->client, 0);
 
-    int pipe_fd = mpv_get_wakeup_pipe(arg->client);
-    if (pipe_fd < 0) {
-        MP_ERR(arg, "Could not get wakeup pipe\n");
-        goto done;
-    }
+        if (event->event_id == MPV_EVENT_NONE) {
+            arg->events_pending = false;
+            return true;
+        }
 
-    MP_VERBOSE(arg, "Client connected\n");
+        if (event->event_id == MPV_EVENT_SHUTDOWN)
+            return false;
+
+        pthread_mutex_lock(&arg->lock);
+        int rc = 0;
+        if (!arg->writable) {
+            // discard
+        } else if (arg->msgpack) {
+            bstr event_msg = mp_msgpack_encode_event(NULL, event);
+            rc = ipc_write(arg, event_msg.start, event_msg.len);
+            talloc_free(event_msg.start);
+        } else {
+            char *event_msg = mp_json_encode_event(event);
+            if (!event_msg) {
+                pthread_mutex_unlock(&arg->lock);
+                MP_ERR(arg, "Encoding error\n");
+                return false;
+            }
 
-    struct pollfd fds[2] = {
-        {.events = POLLIN, .fd = pipe_fd},
-        {.events = POLLIN, .fd = arg->client_fd},
-    };
+            rc = ipc_write_str(arg, event_msg);
+            talloc_free(event_msg);
+        }
+        pthread_mutex_unlock(&arg->lock);
+        if (rc < 0) {
+            MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
+            return false;
+        }
+    }
+
+    arg->events_pending = true;
+    return true;
+}
 
-    fcntl(arg->client_fd, F_SETFL, fcntl(arg->client_fd, F_GETFL, 0) | O_NONBLOCK);
-    mpv_suspend(arg->client);
+// Returns false if the client should be removed.
+static bool client_write_reply(struct client_arg *arg, const void *data,
+                               size_t count)
+{
+    pthread_mutex_lock(&arg->lock);
+    int rc = arg->writable ? ipc_write(arg, data, count) : 0;
+    pthread_mutex_unlock(&arg->lock);
+    // Let the IPC thread wait for POLLOUT if not everything could be sent.
+    (void)write(arg->ctx->wakeup_pipe[1], &(char){0}, 1);
+    if (rc < 0) {
+        MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
+        return false;
+    }
+    return true;
+}
 
+// Run all complete commands in buf, and remove them from it. Returns false if
+// the client should be removed.
+static bool client_run_commands(struct client_arg *arg, bstr *buf)
+{
     while (1) {
-        rc = poll(fds, 2, 0);
-        if (rc == 0) {
-            mpv_resume(arg->client);
-            rc = poll(fds, 2, -1);
-            mpv_suspend(arg->client);
-        }
-        if (rc < 0) {
-            MP_ERR(arg, "Poll error\n");
+        int is_msgpack = mp_ipc_is_msgpack(*buf);
+        if (is_msgpack < 0)
+            break;
+
+        if (is_msgpack) {
+            pthread_mutex_lock(&arg->lock);
+            arg->msgpack = true;
+            pthread_mutex_unlock(&arg->lock);
+
+            bstr reply = {0};
+            int rc = mp_ipc_consume_next_msgpack(arg->client, NULL, buf, &reply);
+            if (rc < 0)
+                return false;
+            if (rc == 0)
+                break;
+
+            bool ok = client_write_reply(arg, reply.start, reply.len);
+            talloc_free(reply.start);
+            if (!ok)
+                return false;
             continue;
         }
 
-        if (fds[0].revents & POLLIN) {
-            mp_flush_wakeup_pipe(pipe_fd);
+        if (bstrchr(*buf, '\n') == -1)
+            break;
 
-            while (1) {
-                mpv_event *event = mpv_wait_event(arg->client, 0);
+        char *reply_msg = mp_ipc_consume_next_command(arg->client, NULL, buf);
 
-                if (event->event_id == MPV_EVENT_NONE)
-                    break;
+        bool ok = !reply_msg ||
+                  client_write_reply(arg, reply_msg, strlen(reply_msg));
+        talloc_free(reply_msg);
+        if (!ok)
+            return false;
+    }
 
-                if (event->event_id == MPV_EVENT_SHUTDOWN)
-                    goto done;
+    return true;
+}
 
-                if (!arg->writable)
-                    continue;
+static void *client_command_thread(void *p)
+{
+    struct client_arg *arg = p;
 
-                char *event_msg = mp_json_encode_event(event);
-                if (!event_msg) {
-                    MP_ERR(arg, "Encoding error\n");
-                    goto done;
-                }
+    mpthread_set_name(arg->client_name);
 
-                rc = ipc_write_str(arg, event_msg);
-                talloc_free(event_msg);
-                if (rc < 0) {
-                    MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
-                    goto done;
-                }
-            }
-        }
+    pthread_mutex_lock(&arg->lock);
+    while (arg->new_input && !arg->failed) {
+        arg->new_input = false;
+        bstr buf = arg->read_buf;
+        arg->read_buf = (bstr){0};
+        pthread_mutex_unlock(&arg->lock);
+
+        bstr rest = buf;
+        bool ok = client_run_commands(arg, &rest);
+        // Move the unparsed rest to the start of the buffer.
+        memmove(buf.start, rest.start, rest.len);
+        buf.len = rest.len;
+
+        pthread_mutex_lock(&arg->lock);
+        // Data received in the meantime goes after the unparsed rest.
+        bstr_xappend(NULL, &buf, arg->read_buf);
+        talloc_free(arg->read_buf.start);
+        arg->read_buf = buf;
+        if (!ok)
+            arg->failed = true;
+    }
+    arg->running = false;
+    pthread_mutex_unlock(&arg->lock);
 
-        if (fds[1].revents & (POLLIN | POLLHUP)) {
-            while (1) {
-                char buf[128];
-                bstr append = { buf, 0 };
+    (void)write(arg->ctx->wakeup_pipe[1], &(char){0}, 1);
+    return NULL;
+}
 
-                ssize_t bytes = read(arg->client_fd, buf, sizeof(buf));
-                if (bytes < 0) {
-                    if (errno == EAGAIN)
-                        break;
+// Join the command thread, if it was started and has exited. Returns false if
+// it is still running.
+static bool client_join_thread(struct client_arg *arg)
+{
+    pthread_mutex_lock(&arg->lock);
+    bool running = arg->running;
+    pthread_mutex_unlock(&arg->lock);
+    if (running)
+        return false;
+    if (arg->has_thread)
+        pthread_join(arg->thread, NULL);
+    arg->has_thread = false;
+    return true;
+}
 
-                    MP_ERR(arg, "Read error (%s)\n", mp_strerror(errno));
-                    goto done;
-                }
+// Returns false if the client should be removed.
+static bool client_read_commands(struct client_arg *arg)
+{
+    char buf[4096];
 
-                if (bytes == 0) {
-                    MP_VERBOSE(arg, "Client disconnected\n");
-                    goto done;
-                }
+    ssize_t bytes = read(arg->client_fd, buf, sizeof(buf));
+    if (bytes < 0) {
+        if (errno == EAGAIN || errno == EINTR)
+            return true;
 
-                append.len = bytes;
+        MP_ERR(arg, "Read error (%s)\n", mp_strerror(errno));
+        return false;
+    }
 
-                bstr_xappend(NULL, &client_msg, append);
+    if (bytes == 0) {
+        MP_VERBOSE(arg, "Client disconnected\n");
+        return false;
+    }
 
-                while (bstrchr(client_msg, '\n') != -1) {
-                    char *reply_msg = mp_ipc_consume_next_command(arg->client,
-                        NULL, &client_msg);
+    pthread_mutex_lock(&arg->lock);
+    bstr_xappend(NULL, &arg->read_buf, (bstr){(unsigned char *)buf, bytes});
+    arg->new_input = true;
+    bool start = !arg->running;
+    arg->running = true;
+    pthread_mutex_unlock(&arg->lock);
+
+    if (start) {
+        // The previous command thread (if any) has exited already.
+        if (arg->has_thread)
+            pthread_join(arg->thread, NULL);
+        arg->has_thread = false;
+        if (pthread_create(&arg->thread, NULL, client_command_thread, arg)) {
+            pthread_mutex_lock(&arg->lock);
+            arg->running = false;
+            pthread_mutex_unlock(&arg->lock);
+            MP_ERR(arg, "Could not create command thread\n");
+            return false;
+        }
+        arg->has_thread = true;
+    }
 
-                    if (reply_msg && arg->writable) {
-                        rc = ipc_write_str(arg, reply_msg);
-                        if (rc < 0) {
-                            MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
-                            talloc_free(reply_msg);
-                            goto done;
-                        }
-                    }
+    return true;
+}
 
-                    talloc_free(reply_msg);
-                }
-            }
-        }
+// Returns false if the client should be removed.
+static bool client_process(struct client_arg *arg, struct pollfd *wakeup_pfd,
+                           struct pollfd *client_pfd)
+{
+    pthread_mutex_lock(&arg->lock);
+    bool failed = arg->failed;
+    int rc = 0;
+    if (client_pfd->revents & POLLOUT)
+        rc = ipc_flush(arg);
+    pthread_mutex_unlock(&arg->lock);
+    if (failed)
+        return false;
+    if (rc < 0) {
+        MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
+        return false;
     }
 
-done:
-    if (client_msg.len > 0)
-        MP_WARN(arg, "Ignoring unterminated command on disconnect.\n");
-    talloc_free(client_msg.start);
-    if (arg->close_client_fd)
-        close(arg->client_fd);
-    mpv_detach_destroy(arg->client);
-    talloc_free(arg);
-    return NULL;
+    if (wakeup_pfd->revents & POLLIN) {
+        mp_flush_wakeup_pipe(arg->wakeup_fd);
+        arg->events_pending = true;
+    }
+
+    if (arg->events_pending && !client_read_events(arg))
+        return false;
+
+    if (client_pfd->revents & (POLLIN | POLLHUP | POLLERR)) {
+        if (!client_read_commands(arg))
+            return false;
+    }
+
+    return true;
 }
 
-static void ipc_start_client(struct mp_ipc_ctx *ctx, struct client_arg *client)
+static void ipc_add_client(struct mp_ipc_ctx *ctx, struct client_arg *client)
 {
-    client->client = mp_new_client(ctx->client_api, client->client_name),
+    client->ctx    = ctx;
+    client->client = mp_new_client(ctx->client_api, client->client_name);
+    if (!client->client) {
+        MP_ERR(ctx, "Could not create client %s\n", client->client_name);
+        if (client->close_client_fd)
+            close(client->client_fd);
+        talloc_free(client);
+        return;
+    }
     client->log    = mp_client_get_log(client->client);
 
-    pthread_t client_thr;
-    if (pthread_create(&client_thr, NULL, client_thread, client)) {
+    client->wakeup_fd = mpv_get_wakeup_pipe(client->client);
+    if (client->wakeup_fd < 0) {
+        MP_ERR(client, "Could not get wakeup pipe\n");
         mpv_detach_destroy(client->client);
         if (client->close_client_fd)
             close(client->client_fd);
         talloc_free(client);
+        return;
     }
+
+    fcntl(client->client_fd, F_SETFL,
+          fcntl(client->client_fd, F_GETFL, 0) | O_NONBLOCK);
+
+    // Events that were queued before the wakeup pipe was created.
+    client->events_pending = true;
+
+    pthread_mutex_init(&client->lock, NULL);
+
+    MP_VERBOSE(client, "Client connected\n");
+
+    MP_TARRAY_APPEND(ctx, ctx->clients, ctx->num_clients, client);
+}
+
+// Remove the client, or if its command thread is still running, stop serving
+// it and remove it once the thread has exited.
+static void ipc_remove_client(struct mp_ipc_ctx *ctx, int index)
+{
+    struct client_arg *arg = ctx->clients[index];
+
+    arg->removing = true;
+    if (!client_join_thread(arg))
+        return;
+
+    if (arg->read_buf.len > 0)
+        MP_WARN(arg, "Ignoring unterminated command on disconnect.\n");
+    talloc_free(arg->read_buf.start);
+    pthread_mutex_destroy(&arg->lock);
+    if (arg->close_client_fd)
+        close(arg->client_fd);
+    mpv_detach_destroy(arg->client);
+    talloc_free(arg);
+
+    MP_TARRAY_REMOVE_AT(ctx->clients, ctx->num_clients, index);
 }
 
 static void ipc_start_client_json(struct mp_ipc_ctx *ctx, int id, int fd)
@@ -240,7 +459,7 @@ static void ipc_start_client_json(struct mp_ipc_ctx *ctx, int id, int fd)
         .writable = true,
     };
 
-    ipc_start_client(ctx, client);
+    ipc_add_client(ctx, client);
 }
 
 static void ipc_start_client_text(struct mp_ipc_ctx *ctx, const char *path)
@@ -282,26 +501,20 @@ static void ipc_start_client_text(struct mp_ipc_ctx *ctx, const char *path)
         .writable = writable,
     };
 
-    ipc_start_client(ctx, client);
+    ipc_add_client(ctx, client);
 }
 
-static void *ipc_thread(void *p)
+static int ipc_listen(struct mp_ipc_ctx *arg)
 {
     int rc;
 
     int ipc_fd;
     struct sockaddr_un ipc_un = {0};
 
-    struct mp_ipc_ctx *arg = p;
-
-    mpthread_set_name("ipc socket listener");
-
-    MP_VERBOSE(arg, "Starting IPC master\n");
-
     ipc_fd = socket(AF_UNIX, SOCK_STREAM, 0);
     if (ipc_fd < 0) {
         MP_ERR(arg, "Could not create IPC socket\n");
-        goto done;
+        goto error;
     }
 
 #if HAVE_FCHMOD
@@ -311,7 +524,7 @@ static void *ipc_thread(void *p)
     size_t path_len = strlen(arg->path);
     if (path_len >= sizeof(ipc_un.sun_path) - 1) {
         MP_ERR(arg, "Could not create IPC socket\n");
-        goto done;
+        goto error;
     }
 
     ipc_un.sun_family = AF_UNIX,
@@ -328,47 +541,122 @@ static void *ipc_thread(void *p)
     rc = bind(ipc_fd, (struct sockaddr *) &ipc_un, addr_len);
     if (rc < 0) {
         MP_ERR(arg, "Could not bind IPC socket\n");
-        goto done;
+        goto error;
     }
 
     rc = listen(ipc_fd, 10);
     if (rc < 0) {
         MP_ERR(arg, "Could not listen on IPC socket\n");
-        goto done;
+        goto error;
     }
 
-    int client_num = 0;
+    return ipc_fd;
 
-    struct pollfd fds[2] = {
-        {.events = POLLIN, .fd = arg->death_pipe[0]},
-        {.events = POLLIN, .fd = ipc_fd},
-    };
+error:
+    if (ipc_fd >= 0)
+        close(ipc_fd);
+    return -1;
+}
 
-    while (1) {
-        rc = poll(fds, 2, -1);
+// Serves the listening socket and all clients. After mp_uninit_ipc() was
+// called, no new clients are accepted, but the existing ones are served until
+// they receive MPV_EVENT_SHUTDOWN, and their command threads have exited.
+static void *ipc_thread(void *p)
+{
+    struct mp_ipc_ctx *arg = p;
+
+    mpthread_set_name("ipc");
+
+    if (arg->path) {
+        MP_VERBOSE(arg, "Starting IPC master\n");
+        arg->listen_fd = ipc_listen(arg);
+    }
+
+    struct pollfd *fds = NULL;
+    int num_fds = 0;
+
+    while (!arg->stopping || arg->num_clients) {
+        num_fds = 0;
+        MP_TARRAY_APPEND(arg, fds, num_fds, (struct pollfd){
+            .events = POLLIN,
+            .fd = arg->stopping ? -1 : arg->death_pipe[0],
+        });
+        MP_TARRAY_APPEND(arg, fds, num_fds, (struct pollfd){
+            .events = POLLIN,
+            .fd = arg->listen_fd,
+        });
+        MP_TARRAY_APPEND(arg, fds, num_fds, (struct pollfd){
+            .events = POLLIN,
+            .fd = arg->wakeup_pipe[0],
+        });
+
+        // Clients that still have events to read, but had to stop because
+        // of too much buffered output, need another try without waiting.
+        int timeout = -1;
+        for (int n = 0; n < arg->num_clients; n++) {
+            struct client_arg *client = arg->clients[n];
+            pthread_mutex_lock(&client->lock);
+            bool blocked = client->write_buf.len >= MAX_WRITE_BUFFER;
+            bool want_write = client->write_buf.len > 0;
+            pthread_mutex_unlock(&client->lock);
+            if (client->events_pending && !blocked && !client->removing)
+                timeout = 0;
+            MP_TARRAY_APPEND(arg, fds, num_fds, (struct pollfd){
+                .events = POLLIN,
+                .fd = blocked || client->removing ? -1 : client->wakeup_fd,
+            });
+            MP_TARRAY_APPEND(arg, fds, num_fds, (struct pollfd){
+                .events = (blocked ? 0 : POLLIN) | (want_write ? POLLOUT : 0),
+                .fd = client->removing ? -1 : client->client_fd,
+            });
+        }
+
+        int rc = poll(fds, num_fds, timeout);
         if (rc < 0) {
-            MP_ERR(arg, "Poll error\n");
+            if (errno != EINTR)
+                MP_ERR(arg, "Poll error\n");
             continue;
         }
 
-        if (fds[0].revents & POLLIN)
-            goto done;
+        if (fds[2].revents & POLLIN)
+            mp_flush_wakeup_pipe(arg->wakeup_pipe[0]);
+
+        // Iterate backwards, so removing clients doesn't affect the indexes
+        // of the clients not processed yet.
+        for (int n = arg->num_clients - 1; n >= 0; n--) {
+            struct client_arg *client = arg->clients[n];
+            struct pollfd *client_fds = &fds[3 + n * 2];
+            if (client->removing ||
+                !client_process(client, &client_fds[0], &client_fds[1]))
+                ipc_remove_client(arg, n);
+        }
+
+        if (fds[0].revents & POLLIN) {
+            arg->stopping = true;
+            if (arg->listen_fd >= 0)
+                close(arg->listen_fd);
+            arg->listen_fd = -1;
+            continue;
+        }
 
         if (fds[1].revents & POLLIN) {
-            int client_fd = accept(ipc_fd, NULL, NULL);
+            int client_fd = accept(arg->listen_fd, NULL, NULL);
             if (client_fd < 0) {
                 MP_ERR(arg, "Could not accept IPC client\n");
-                goto done;
+                close(arg->listen_fd);
+                arg->listen_fd = -1;
+                continue;
             }
 
-            ipc_start_client_json(arg, client_num++, client_fd);
+            ipc_start_client_json(arg, arg->client_num++, client_fd);
         }
     }
 
-done:
-    if (ipc_fd >= 0)
-        close(ipc_fd);
-
+    // If we get here, mp_uninit_ipc() was called, and all clients are gone.
+    if (arg->listen_fd >= 0)
+        close(arg->listen_fd);
+    arg->listen_fd = -1;
+    talloc_free(fds);
     return NULL;
 }
 
@@ -381,18 +669,22 @@ struct mp_ipc_ctx *mp_init_ipc(struct mp_client_api *client_api,
     *arg = (struct mp_ipc_ctx){
         .log        = mp_log_new(arg, global->log, "ipc"),
         .client_api = client_api,
-        .path       = mp_get_user_path(arg, global, opts->ipc_path),
         .death_pipe = {-1, -1},
+        .wakeup_pipe = {-1, -1},
+        .listen_fd  = -1,
     };
+    if (opts->ipc_path && *opts->ipc_path)
+        arg->path = mp_get_user_path(arg, global, opts->ipc_path);
     char *input_file = mp_get_user_path(arg, global, opts->input_file);
 
     if (input_file && *input_file)
         ipc_start_client_text(arg, input_file);
 
-    if (!opts->ipc_path || !*opts->ipc_path)
+    if (!arg->path && !arg->num_clients)
         goto out;
 
-    if (mp_make_wakeup_pipe(arg->death_pipe) < 0)
+    if (mp_make_wakeup_pipe(arg->death_pipe) < 0 ||
+        mp_make_wakeup_pipe(arg->wakeup_pipe) < 0)
         goto out;
 
     if (pthread_create(&arg->thread, NULL, ipc_thread, arg))
@@ -401,12 +693,19 @@ struct mp_ipc_ctx *mp_init_ipc(struct mp_client_api *client_api,
     return arg;
 
 out:
+    while (arg->num_clients)
+        ipc_remove_client(arg, arg->num_clients - 1);
     close(arg->death_pipe[0]);
     close(arg->death_pipe[1]);
+    close(arg->wakeup_pipe[0]);
+    close(arg->wakeup_pipe[1]);
     talloc_free(arg);
     return NULL;
 }
 
+// Stops accepting new clients, and waits until the IPC thread has exited. This
+// happens only once all existing clients were shut down, so this must be
+// called after they received MPV_EVENT_SHUTDOWN.
 void mp_uninit_ipc(struct mp_ipc_ctx *arg)
 {
     if (!arg)
@@ -417,5 +716,7 @@ void mp_uninit_ipc(struct mp_ipc_ctx *arg)
 
     close(arg->death_pipe[0]);
     close(arg->death_pipe[1]);
+    close(arg->wakeup_pipe[0]);
+    close(arg->wakeup_pipe[1]);
     talloc_free(arg);
 }
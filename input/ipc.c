@@ -20,6 +20,7 @@
 #include "common/msg.h"
 #include "input/input.h"
 #include "misc/json.h"
+#include "misc/msgpack.h"
 #include "options/m_option.h"
 #include "options/options.h"
 #include "options/path.h"
@@ -179,7 +180,8 @@ static void mpv_event_to_node(void *ta_parent, mpv_event *event, mpv_node *dst)
 
 char *mp_json_encode_event(mpv_event *event)
 {
-    void *ta_parent = talloc_new(NULL);
+    // The node tree is temporary and consists of many small allocations.
+    void *ta_parent = talloc_new_arena(NULL);
     mpv_node event_node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
 
     mpv_event_to_node(ta_parent, event, &event_node);
@@ -193,33 +195,39 @@ char *mp_json_encode_event(mpv_event *event)
     return output;
 }
 
-// Function is allowed to modify src[n].
-static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
-                                  char *src)
+bstr mp_msgpack_encode_event(void *ta_parent, mpv_event *event)
+{
+    void *tmp = talloc_new_arena(NULL);
+    mpv_node event_node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
+
+    mpv_event_to_node(tmp, event, &event_node);
+
+    bstr output = {0};
+    msgpack_write(ta_parent, &output, &event_node);
+
+    talloc_free(tmp);
+
+    return output;
+}
+
+// Execute the command in msg_node (NULL if the message could not be parsed),
+// and add the reply fields to reply_node (which must be a map). Used by both
+// the JSON and the msgpack protocol.
+static void execute_command_node(struct mpv_handle *client, void *ta_parent,
+                                 mpv_node *msg_node, mpv_node *reply_node)
 {
     int rc;
     const char *cmd = NULL;
-    struct mp_log *log = mp_client_get_log(client);
-
-    mpv_node msg_node;
-    mpv_node reply_node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
     mpv_node *reqid_node = NULL;
 
-    rc = json_parse(ta_parent, &msg_node, &src, 3);
-    if (rc < 0) {
-        mp_err(log, "malformed JSON received\n");
-        rc = MPV_ERROR_INVALID_PARAMETER;
-        goto error;
-    }
-
-    if (msg_node.format != MPV_FORMAT_NODE_MAP) {
+    if (!msg_node || msg_node->format != MPV_FORMAT_NODE_MAP) {
         rc = MPV_ERROR_INVALID_PARAMETER;
         goto error;
     }
 
-    reqid_node = mpv_node_map_get(&msg_node, "request_id");
+    reqid_node = mpv_node_map_get(msg_node, "request_id");
 
-    mpv_node *cmd_node = mpv_node_map_get(&msg_node, "command");
+    mpv_node *cmd_node = mpv_node_map_get(msg_node, "command");
     if (!cmd_node ||
         (cmd_node->format != MPV_FORMAT_NODE_ARRAY) ||
         !cmd_node->u.list->num)
@@ -238,15 +246,15 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
 
     if (!strcmp("client_name", cmd)) {
         const char *client_name = mpv_client_name(client);
-        mpv_node_map_add_string(ta_parent, &reply_node, "data", client_name);
+        mpv_node_map_add_string(ta_parent, reply_node, "data", client_name);
         rc = MPV_ERROR_SUCCESS;
     } else if (!strcmp("get_time_us", cmd)) {
         int64_t time_us = mpv_get_time_us(client);
-        mpv_node_map_add_int64(ta_parent, &reply_node, "data", time_us);
+        mpv_node_map_add_int64(ta_parent, reply_node, "data", time_us);
         rc = MPV_ERROR_SUCCESS;
     } else if (!strcmp("get_version", cmd)) {
         int64_t ver = mpv_client_api_version();
-        mpv_node_map_add_int64(ta_parent, &reply_node, "data", ver);
+        mpv_node_map_add_int64(ta_parent, reply_node, "data", ver);
         rc = MPV_ERROR_SUCCESS;
     } else if (!strcmp("get_property", cmd)) {
         mpv_node result_node;
@@ -264,7 +272,26 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
         rc = mpv_get_property(client, cmd_node->u.list->values[1].u.string,
                               MPV_FORMAT_NODE, &result_node);
         if (rc >= 0) {
-            mpv_node_map_add(ta_parent, &reply_node, "data", &result_node);
+            mpv_node_map_add(ta_parent, reply_node, "data", &result_node);
+            mpv_free_node_contents(&result_node);
+        }
+    } else if (!strcmp("get_properties", cmd)) {
+        mpv_node result_node;
+        int num_names = cmd_node->u.list->num - 1;
+        const char **names = talloc_array(ta_parent, const char *, num_names);
+
+        for (int n = 0; n < num_names; n++) {
+            mpv_node *name_node = &cmd_node->u.list->values[n + 1];
+            if (name_node->format != MPV_FORMAT_STRING) {
+                rc = MPV_ERROR_INVALID_PARAMETER;
+                goto error;
+            }
+            names[n] = name_node->u.string;
+        }
+
+        rc = mpv_get_properties(client, names, num_names, &result_node);
+        if (rc >= 0) {
+            mpv_node_map_add(ta_parent, reply_node, "data", &result_node);
             mpv_free_node_contents(&result_node);
         }
     } else if (!strcmp("get_property_string", cmd)) {
@@ -281,9 +308,9 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
         char *result = mpv_get_property_string(client,
                                         cmd_node->u.list->values[1].u.string);
         if (!result) {
-            mpv_node_map_add_null(ta_parent, &reply_node, "data");
+            mpv_node_map_add_null(ta_parent, reply_node, "data");
         } else {
-            mpv_node_map_add_string(ta_parent, &reply_node, "data", result);
+            mpv_node_map_add_string(ta_parent, reply_node, "data", result);
             mpv_free(result);
         }
     } else if (!strcmp("set_property", cmd)) {
@@ -428,7 +455,7 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
 
         rc = mpv_command_node(client, cmd_node, &result_node);
         if (rc >= 0)
-            mpv_node_map_add(ta_parent, &reply_node, "data", &result_node);
+            mpv_node_map_add(ta_parent, reply_node, "data", &result_node);
     }
 
 error:
@@ -437,12 +464,29 @@ error:
      * the original requests.
      */
     if (reqid_node) {
-        mpv_node_map_add(ta_parent, &reply_node, "request_id", reqid_node);
+        mpv_node_map_add(ta_parent, reply_node, "request_id", reqid_node);
     }
 
-    mpv_node_map_add_string(ta_parent, &reply_node, "error", mpv_error_string(rc));
+    mpv_node_map_add_string(ta_parent, reply_node, "error", mpv_error_string(rc));
+}
 
-    char *output = talloc_strdup(ta_parent, "");
+// Function is allowed to modify src[n].
+static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
+                                  char *src)
+{
+    struct mp_log *log = mp_client_get_log(client);
+
+    mpv_node msg_node;
+    mpv_node reply_node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
+
+    bool ok = json_parse(ta_parent, &msg_node, &src, 3) >= 0;
+    if (!ok)
+        mp_err(log, "malformed JSON received\n");
+
+    execute_command_node(client, ta_parent, ok ? &msg_node : NULL, &reply_node);
+
+    // Not allocated from ta_parent, as the caller takes ownership.
+    char *output = talloc_strdup(NULL, "");
     json_write(&output, &reply_node);
     output = ta_talloc_strdup_append(output, "\n");
 
@@ -458,13 +502,12 @@ static char *text_execute_command(struct mpv_handle *client, void *tmp, char *sr
 
 char *mp_ipc_consume_next_command(struct mpv_handle *client, void *ctx, bstr *buf)
 {
-    void *tmp = talloc_new(NULL);
+    void *tmp = talloc_new_arena(NULL);
 
     bstr rest;
     bstr line = bstr_getline(*buf, &rest);
     char *line0 = bstrto0(tmp, line);
-    talloc_steal(tmp, buf->start);
-    *buf = bstrdup(NULL, rest);
+    *buf = rest;
 
     json_skip_whitespace(&line0);
 
@@ -481,3 +524,67 @@ char *mp_ipc_consume_next_command(struct mpv_handle *client, void *ctx, bstr *bu
     talloc_free(tmp);
     return reply_msg;
 }
+
+int mp_ipc_is_msgpack(bstr buf)
+{
+    // A msgpack message is always a non-empty map (fixmap, map 16, or map 32),
+    // whose first key is a string. 0xde and 0xdf are also UTF-8 lead bytes,
+    // so the first byte alone doesn't rule out a text command.
+    if (!buf.len)
+        return 0;
+    unsigned char c = buf.start[0];
+    size_t header_size;
+    if (c > 0x80 && c <= 0x8f) {
+        header_size = 1;
+    } else if (c == 0xde) {
+        header_size = 3;
+    } else if (c == 0xdf) {
+        header_size = 5;
+    } else {
+        return 0;
+    }
+    if (buf.len <= header_size)
+        return -1;
+    unsigned char k = buf.start[header_size];
+    return (k >= 0xa0 && k <= 0xbf) || (k >= 0xd9 && k <= 0xdb);
+}
+
+int mp_ipc_consume_next_msgpack(struct mpv_handle *client, void *ctx, bstr *buf,
+                                bstr *out_reply)
+{
+    struct mp_log *log = mp_client_get_log(client);
+
+    size_t size;
+    int res = msgpack_message_size(*buf, 3, &size);
+    if (res < 0) {
+        mp_err(log, "malformed msgpack received\n");
+        // There is no way to resync, so the connection must be dropped.
+        return -1;
+    }
+    if (res == 0)
+        return 0;
+
+    void *tmp = talloc_new_arena(NULL);
+
+    // The parser mutates its input and needs a spare byte at the end. This is
+    // the only copy; strings in the command point into it.
+    unsigned char *data = talloc_size(tmp, size + 1);
+    memcpy(data, buf->start, size);
+    data[size] = '\0';
+    *buf = bstr_cut(*buf, size);
+
+    mpv_node msg_node;
+    mpv_node reply_node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
+
+    bool ok = msgpack_parse(tmp, &msg_node, data, size, 3) >= 0;
+    if (!ok)
+        mp_err(log, "malformed msgpack received\n");
+
+    execute_command_node(client, tmp, ok ? &msg_node : NULL, &reply_node);
+
+    *out_reply = (bstr){0};
+    msgpack_write(ctx, out_reply, &reply_node);
+
+    talloc_free(tmp);
+    return 1;
+}
@@ -215,7 +215,7 @@ extern "C" {
  * relational operators (<, >, <=, >=).
  */
 #define MPV_MAKE_VERSION(major, minor) (((major) << 16) | (minor) | 0UL)
-#define MPV_CLIENT_API_VERSION MPV_MAKE_VERSION(1, 23)
+#define MPV_CLIENT_API_VERSION MPV_MAKE_VERSION(1, 27)
 
 /**
  * Return the MPV_CLIENT_API_VERSION the mpv source has been compiled with.
@@ -945,6 +945,27 @@ int mpv_set_property_async(mpv_handle *ctx, uint64_t reply_userdata,
 int mpv_get_property(mpv_handle *ctx, const char *name, mpv_format format,
                      void *data);
 
+/**
+ * Read the values of multiple properties at once. This is equivalent to
+ * calling mpv_get_property() with MPV_FORMAT_NODE for each property, but the
+ * properties are all read in one go, which is faster and gives a consistent
+ * snapshot of the player state.
+ *
+ * The result is a MPV_FORMAT_NODE_MAP with an entry for each requested
+ * property, in the same order, using the property name as key. Properties
+ * which can't be read (for example because they are unavailable) have a value
+ * with MPV_FORMAT_NONE.
+ *
+ * @param names Array of property names.
+ * @param num_names Number of entries in names.
+ * @param[out] data Set to the resulting map on success. Free it with
+ *                  mpv_free_node_contents().
+ * @return error code (only for invalid parameters; errors for single
+ *         properties are not returned)
+ */
+int mpv_get_properties(mpv_handle *ctx, const char **names, int num_names,
+                       mpv_node *data);
+
 /**
  * Return the value of the property with the given name as string. This is
  * equivalent to mpv_get_property() with MPV_FORMAT_STRING.
@@ -1146,6 +1167,9 @@ typedef enum mpv_event_id {
      * this will be sent in lower frequency if there is no video, or playback
      * is paused - but that will be removed in the future, and it will be
      * restricted to video frames only.
+     *
+     * A new tick is not queued while the client still has an unread tick
+     * event in its queue (since API version 1.25).
      */
     MPV_EVENT_TICK              = 14,
     /**
@@ -1459,6 +1483,19 @@ int mpv_request_event(mpv_handle *ctx, mpv_event_id event, int enable);
  */
 int mpv_request_log_messages(mpv_handle *ctx, const char *min_level);
 
+/**
+ * Restrict the log messages received with MPV_EVENT_LOG_MESSAGE to the given
+ * modules (the mpv_event_log_message.prefix field). A prefix also matches its
+ * submodules, e.g. "ao" matches "ao" and "ao/alsa". Messages from other
+ * modules are dropped before they are queued, and don't wake up the client.
+ * The filter is kept across mpv_request_log_messages() calls.
+ *
+ * @param prefixes NULL-terminated list of module names. NULL or an empty
+ *                 list removes the filter, and all messages are received.
+ * @return error code
+ */
+int mpv_set_log_message_filter(mpv_handle *ctx, const char **prefixes);
+
 /**
  * Wait for the next event, or until the timeout expires, or if another thread
  * makes a call to mpv_wakeup(). Passing 0 as timeout will never wait, and
@@ -1610,7 +1647,14 @@ typedef enum mpv_sub_api {
      * Will return NULL if unavailable (if OpenGL support was not compiled in).
      * See opengl_cb.h for details.
      */
-    MPV_SUB_API_OPENGL_CB = 1
+    MPV_SUB_API_OPENGL_CB = 1,
+    /**
+     * For rendering video into memory buffers provided by the API user.
+     * mpv_get_sub_api(MPV_SUB_API_SW_CB) returns mpv_sw_cb_context*.
+     * This context can be used with mpv_sw_cb_* functions.
+     * See sw_cb.h for details.
+     */
+    MPV_SUB_API_SW_CB = 2
 } mpv_sub_api;
 
 /**
@@ -153,6 +153,64 @@ typedef int64_t (*mpv_stream_cb_size_fn)(void *cookie);
  */
 typedef void (*mpv_stream_cb_close_fn)(void *cookie);
 
+/**
+ * Handle for a read request started with mpv_stream_cb_read_async_fn. It must
+ * be completed with mpv_stream_cb_read_complete().
+ */
+typedef struct mpv_stream_cb_read_request mpv_stream_cb_read_request;
+
+/**
+ * Asynchronous read callback, which can be used instead of
+ * mpv_stream_cb_read_fn. The callback starts reading up to nbytes into buf,
+ * and returns immediately. The request is finished by calling
+ * mpv_stream_cb_read_complete() with the same result values as
+ * mpv_stream_cb_read_fn would return. This function can be called from any
+ * thread, including from within this callback. mpv doesn't start another read
+ * on the same stream until the request has been completed.
+ *
+ * The buf memory must not be accessed after mpv_stream_cb_read_complete()
+ * has been called.
+ *
+ * While mpv waits for the request, it can react to its own cancellation
+ * (e.g. when the user stops playback). It then calls the cancel callback, if
+ * set, but it still waits until the request is completed.
+ *
+ * @param cookie opaque cookie identifying the stream,
+ *               returned from mpv_stream_cb_open_fn
+ * @param buf buffer to read data into
+ * @param size of the buffer
+ * @param req request handle, to be passed to mpv_stream_cb_read_complete()
+ * @return 0 if the request was started
+ * @return -1 on error (mpv_stream_cb_read_complete() must not be called)
+ */
+typedef int (*mpv_stream_cb_read_async_fn)(void *cookie, char *buf,
+                                           uint64_t nbytes,
+                                           mpv_stream_cb_read_request *req);
+
+/**
+ * Cancel callback used with mpv_stream_cb_read_async_fn. It is called if mpv
+ * wants to abort the outstanding read request, and the user should complete
+ * it as soon as possible (e.g. with an error). This is called from a mpv
+ * internal thread, and must not block.
+ *
+ * This callback can be NULL.
+ *
+ * @param cookie opaque cookie identifying the stream,
+ *               returned from mpv_stream_cb_open_fn
+ */
+typedef void (*mpv_stream_cb_cancel_fn)(void *cookie);
+
+/**
+ * Complete a read request started with mpv_stream_cb_read_async_fn. This must
+ * be called exactly once for each request. The request handle is invalid
+ * after this call.
+ *
+ * @param req the request handle passed to mpv_stream_cb_read_async_fn
+ * @param result number of bytes read into the buffer, 0 on EOF, -1 on error
+ */
+void mpv_stream_cb_read_complete(mpv_stream_cb_read_request *req,
+                                 int64_t result);
+
 /**
  * See mpv_stream_cb_open_ro_fn callback.
  */
@@ -170,12 +228,19 @@ typedef struct mpv_stream_cb_info {
      * Callbacks set by the user in the mpv_stream_cb_open_ro_fn callback. Some
      * of them are optional, and can be left unset.
      *
-     * The following callbacks are mandatory: read_fn, close_fn
+     * The following callbacks are mandatory: read_fn (or read_async_fn),
+     * close_fn
      */
     mpv_stream_cb_read_fn read_fn;
     mpv_stream_cb_seek_fn seek_fn;
     mpv_stream_cb_size_fn size_fn;
     mpv_stream_cb_close_fn close_fn;
+
+    /**
+     * If set, this is used instead of read_fn. (Since API version 1.26.)
+     */
+    mpv_stream_cb_read_async_fn read_async_fn;
+    mpv_stream_cb_cancel_fn cancel_fn;
 } mpv_stream_cb_info;
 
 /**
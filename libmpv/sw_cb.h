@@ -0,0 +1,175 @@
+/* Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Note: the client API is licensed under ISC (see above) to ease
+ * interoperability with other licenses. But keep in mind that the
+ * mpv core is still mostly GPLv2+. It's up to lawyers to decide
+ * whether applications using this API are affected by the GPL.
+ * One argument against this is that proprietary applications
+ * using mplayer in slave mode is apparently tolerated, and this
+ * API is basically equivalent to slave mode.
+ */
+
+#ifndef MPV_CLIENT_API_SW_CB_H_
+#define MPV_CLIENT_API_SW_CB_H_
+
+#include <stddef.h>
+
+#include "client.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Warning: this API is not stable yet.
+ *
+ * Overview
+ * --------
+ *
+ * This API can be used to make mpv render video and OSD into memory owned by
+ * the API user, without any GPU involvement. It's meant for headless use, or
+ * for toolkits which can display a pixel buffer, but have no OpenGL. It's the
+ * software equivalent of opengl_cb.h, and works the same way: the renderer is
+ * enabled with mpv_sw_cb_init(), video is drawn with mpv_sw_cb_draw(), and
+ * the user is notified of new frames with mpv_sw_cb_set_update_callback().
+ * Set the "vo" option to "sw-cb" to use it.
+ *
+ * Video is converted with libswscale directly into the target buffer (using
+ * multiple threads if the "sws-threads" option allows it), and the OSD and
+ * subtitles are blended on top. There is no intermediate copy.
+ *
+ * Threading
+ * ---------
+ *
+ * The mpv_sw_cb_* functions can be called from any thread, under the
+ * following conditions:
+ *  - only one of the mpv_sw_cb_* functions can be called at the same time
+ *    (unless they belong to different mpv cores created by mpv_create())
+ *  - never can be called from within the callbacks set with
+ *    mpv_set_wakeup_callback() or mpv_sw_cb_set_update_callback()
+ *
+ * Context and handle lifecycle
+ * ----------------------------
+ *
+ * Video initialization will fail if the renderer was not initialized yet
+ * (with mpv_sw_cb_init()). Likewise, mpv_sw_cb_uninit() will disable video.
+ *
+ * When the mpv core is destroyed (e.g. via mpv_terminate_destroy()), the
+ * renderer must have been uninitialized. If this doesn't happen, undefined
+ * behavior will result.
+ *
+ * Hardware decoding
+ * -----------------
+ *
+ * Only hardware decoding modes which copy the video back to system RAM (such
+ * as "vaapi-copy") can be used.
+ */
+
+/**
+ * Opaque context, returned by mpv_get_sub_api(MPV_SUB_API_SW_CB).
+ *
+ * A context is bound to the mpv_handle it was retrieved from. The context
+ * will always be the same (for the same mpv_handle), and is valid until the
+ * mpv_handle it belongs to is released.
+ */
+typedef struct mpv_sw_cb_context mpv_sw_cb_context;
+
+typedef void (*mpv_sw_cb_update_fn)(void *cb_ctx);
+
+/**
+ * Set the callback that notifies you when a new video frame is available, or
+ * if the video display configuration somehow changed and requires a redraw.
+ * Similar to mpv_set_wakeup_callback(), you must not call any mpv API from
+ * the callback.
+ *
+ * @param callback callback(callback_ctx) is called if the frame should be
+ *                 redrawn
+ * @param callback_ctx opaque argument to the callback
+ */
+void mpv_sw_cb_set_update_callback(mpv_sw_cb_context *ctx,
+                                   mpv_sw_cb_update_fn callback,
+                                   void *callback_ctx);
+
+/**
+ * Enable the software renderer. Video output with the "sw-cb" VO fails until
+ * this is called.
+ *
+ * You must call mpv_sw_cb_uninit() at some point.
+ *
+ * @return error code (same as normal mpv_* API), including but not limited to:
+ *      MPV_ERROR_INVALID_PARAMETER: the renderer was already initialized
+ */
+int mpv_sw_cb_init(mpv_sw_cb_context *ctx);
+
+/**
+ * Render video and OSD into the given buffer.
+ *
+ * The video will use the full provided buffer. Options like "panscan" are
+ * applied to determine which part of the video should be visible and how the
+ * video should be scaled, and the remaining area is filled with black. You
+ * can change these options at runtime by using the mpv property API.
+ *
+ * This function implicitly pulls a video frame from the internal queue and
+ * renders it. If no new frame is available, the previous frame is redrawn.
+ * The update callback set with mpv_sw_cb_set_update_callback() notifies you
+ * when a new frame was added.
+ *
+ * The buffer doesn't need to be the same between calls, but keeping format
+ * and size the same avoids reinitializing the scaler.
+ *
+ * @param format Pixel format of the buffer, using mpv's names for them. Only
+ *               packed RGB formats are supported, such as "rgb0", "bgr0",
+ *               "0rgb", "rgba", "bgra", or "rgb24".
+ * @param w Width of the buffer in pixels.
+ * @param h Height of the buffer in pixels.
+ * @param stride Size of a line in bytes. Must be at least w multiplied by the
+ *               pixel size. Aligning it to 16 bytes is recommended, because
+ *               libswscale uses slower code paths otherwise.
+ * @param pixels Pointer to the first pixel of the top line.
+ * @return error code, including but not limited to:
+ *      MPV_ERROR_INVALID_PARAMETER: unsupported format, or invalid buffer
+ */
+int mpv_sw_cb_draw(mpv_sw_cb_context *ctx, const char *format, int w, int h,
+                   size_t stride, void *pixels);
+
+/**
+ * Tell the renderer that a frame was presented at the given time. This is
+ * optional, but can help the player to achieve better timing. See
+ * mpv_opengl_cb_report_flip() for details; the semantics are the same.
+ *
+ * @param time The mpv time (using mpv_get_time_us()) at which the frame was
+ *             shown. If 0 is passed, mpv_get_time_us() is used instead.
+ *             Currently, this parameter is ignored.
+ * @return error code
+ */
+int mpv_sw_cb_report_flip(mpv_sw_cb_context *ctx, int64_t time);
+
+/**
+ * Disable the software renderer.
+ *
+ * If video is still active (e.g. a file playing), video will be disabled
+ * forcefully.
+ *
+ * Calling this multiple times is ok.
+ *
+ * @return error code
+ */
+int mpv_sw_cb_uninit(mpv_sw_cb_context *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -26,6 +26,8 @@
 
 #include "config.h"
 
+#include "mpv_talloc.h"
+#include "common/common.h"
 #include "common/msg.h"
 
 #if HAVE_ENCA
@@ -111,8 +113,93 @@ static const char *ms_bom_guess(bstr buf)
     return NULL;
 }
 
+// Number of chunks mp_charset_guess_sampled() takes after the prefix.
+#define SAMPLE_CHUNKS 4
+
+static bool bstr_is_ascii(bstr s)
+{
+    for (int n = 0; n < s.len; n++) {
+        if (s.start[n] & 0x80)
+            return false;
+    }
+    return true;
+}
+
+static bool is_space(unsigned char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static bool is_utf8_continuation(unsigned char c)
+{
+    return (c & 0xC0) == 0x80;
+}
+
+// Return the complete lines within buf[start, start + len). This avoids
+// cutting multibyte characters, which would confuse the detectors. If the
+// range contains no line break (e.g. files with very long lines), cut after
+// whitespace, and if there's none either, at a UTF-8 character boundary.
+static bstr get_lines(bstr buf, size_t start, size_t len)
+{
+    bstr s = bstr_splice(buf, start, MPMIN(start + len, buf.len));
+    if (start > 0) {
+        int pos = bstrchr(s, '\n');
+        for (int n = 0; n < s.len && pos < 0; n++) {
+            if (is_space(s.start[n]))
+                pos = n;
+        }
+        if (pos < 0) {
+            pos = -1;
+            while (pos + 1 < s.len && is_utf8_continuation(s.start[pos + 1]))
+                pos++;
+        }
+        s = bstr_cut(s, pos + 1);
+    }
+    if (s.start + s.len < buf.start + buf.len) {
+        // s.start[s.len] is the first byte after s, and still within buf.
+        int pos = bstrrchr(s, '\n');
+        for (int n = s.len - 1; n >= 0 && pos < 0; n--) {
+            if (is_space(s.start[n]))
+                pos = n;
+        }
+        if (pos < 0) {
+            pos = s.len - 1;
+            while (pos >= 0 && is_utf8_continuation(s.start[pos + 1]))
+                pos--;
+        }
+        s = bstr_splice(s, 0, pos + 1);
+    }
+    return s;
+}
+
+// Return the data the charset detectors look at. If buf is larger than
+// probe_size, this is a prefix of half that size. If the prefix is pure ASCII
+// (which is common, e.g. for SRT numbering and ASS headers), it tells nothing
+// about the charset, so chunks spread over the rest of buf are added.
+// The result is either a slice of buf, or allocated under talloc_ctx.
+bstr mp_charset_guess_sample(void *talloc_ctx, bstr buf, size_t probe_size)
+{
+    if (!probe_size || buf.len <= probe_size)
+        return buf;
+
+    bstr prefix = get_lines(buf, 0, probe_size / 2);
+    if (!bstr_is_ascii(prefix))
+        return prefix;
+
+    bstr res = {0};
+    bstr_xappend(talloc_ctx, &res, prefix);
+    size_t chunk = (probe_size - prefix.len) / SAMPLE_CHUNKS;
+    size_t rest = buf.len - prefix.len - chunk;
+    for (int n = 1; n <= SAMPLE_CHUNKS; n++) {
+        size_t pos = prefix.len + rest * n / SAMPLE_CHUNKS;
+        bstr_xappend(talloc_ctx, &res, get_lines(buf, pos, chunk));
+    }
+    return res;
+}
+
 #if HAVE_ENCA
-static const char *enca_guess(struct mp_log *log, bstr buf, const char *language)
+static const char *enca_guess(struct mp_log *log, bstr buf, bstr sample,
+                              const char *language)
 {
     // Do our own UTF-8 detection, because ENCA seems to get it wrong sometimes
     // (suggested by divVerent). Explicitly allow cut-off UTF-8.
@@ -127,7 +214,8 @@ static const char *enca_guess(struct mp_log *log, bstr buf, const char *language
     EncaAnalyser analyser = enca_analyser_alloc(language);
     if (analyser) {
         enca_set_termination_strictness(analyser, 0);
-        EncaEncoding enc = enca_analyse_const(analyser, buf.start, buf.len);
+        EncaEncoding enc = enca_analyse_const(analyser, sample.start,
+                                              sample.len);
         const char *tmp = enca_charset_name(enc.charset, ENCA_NAME_STYLE_ICONV);
         if (tmp && enc.charset != ENCA_CS_UNKNOWN)
             detected_cp = tmp;
@@ -163,12 +251,13 @@ static const char *libguess_guess(struct mp_log *log, bstr buf,
 #endif
 
 #if HAVE_UCHARDET
-static const char *mp_uchardet(void *talloc_ctx, struct mp_log *log, bstr buf)
+static const char *mp_uchardet(void *talloc_ctx, struct mp_log *log, bstr buf,
+                               bstr sample)
 {
     uchardet_t det = uchardet_new();
     if (!det)
         return NULL;
-    if (uchardet_handle_data(det, buf.start, buf.len) != 0) {
+    if (uchardet_handle_data(det, sample.start, sample.len) != 0) {
         uchardet_delete(det);
         return NULL;
     }
@@ -201,6 +290,16 @@ static const char *mp_uchardet(void *talloc_ctx, struct mp_log *log, bstr buf)
 // The return value may (but doesn't have to) be allocated under talloc_ctx.
 const char *mp_charset_guess(void *talloc_ctx, struct mp_log *log, bstr buf,
                              const char *user_cp, int flags)
+{
+    return mp_charset_guess_sampled(talloc_ctx, log, buf, user_cp, flags, 0);
+}
+
+// Like mp_charset_guess(), but if probe_size is not 0, the detection libraries
+// look at no more than about probe_size bytes of buf. (UTF-8 validation, which
+// is cheap, still checks all of buf.)
+const char *mp_charset_guess_sampled(void *talloc_ctx, struct mp_log *log,
+                                     bstr buf, const char *user_cp, int flags,
+                                     size_t probe_size)
 {
     if (!mp_charset_requires_guess(user_cp))
         return user_cp;
@@ -232,19 +331,28 @@ const char *mp_charset_guess(void *talloc_ctx, struct mp_log *log, bstr buf,
             type = bstr0("auto");
     }
 
+    void *tmp = talloc_new(NULL);
+    bstr sample = mp_charset_guess_sample(tmp, buf, probe_size);
+    if (sample.len < buf.len) {
+        mp_dbg(log, "Detecting charset from %zu of %zu bytes.\n",
+               (size_t)sample.len, (size_t)buf.len);
+    }
+
 #if HAVE_ENCA
     if (bstrcasecmp0(type, "enca") == 0)
-        res = enca_guess(log, buf, lang);
+        res = enca_guess(log, buf, sample, lang);
 #endif
 #if HAVE_LIBGUESS
     if (bstrcasecmp0(type, "guess") == 0)
-        res = libguess_guess(log, buf, lang);
+        res = libguess_guess(log, sample, lang);
 #endif
 #if HAVE_UCHARDET
     if (bstrcasecmp0(type, "uchardet") == 0)
-        res = mp_uchardet(talloc_ctx, log, buf);
+        res = mp_uchardet(talloc_ctx, log, buf, sample);
 #endif
 
+    talloc_free(tmp);
+
     if (bstrcasecmp0(type, "utf8") == 0 || bstrcasecmp0(type, "utf-8") == 0) {
         if (!fallback)
             fallback = params[1].start; // must be already 0-terminated
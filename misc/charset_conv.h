@@ -17,6 +17,10 @@ bool mp_charset_is_utf16(const char *user_cp);
 bool mp_charset_requires_guess(const char *user_cp);
 const char *mp_charset_guess(void *talloc_ctx, struct mp_log *log, bstr buf,
                              const char *user_cp, int flags);
+const char *mp_charset_guess_sampled(void *talloc_ctx, struct mp_log *log,
+                                     bstr buf, const char *user_cp, int flags,
+                                     size_t probe_size);
+bstr mp_charset_guess_sample(void *talloc_ctx, bstr buf, size_t probe_size);
 bstr mp_iconv_to_utf8(struct mp_log *log, bstr buf, const char *cp, int flags);
 
 #endif
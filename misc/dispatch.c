@@ -24,8 +24,21 @@
 
 #include "dispatch.h"
 
+// Items are run in priority order. Synchronous requests (mp_dispatch_run() and
+// mp_dispatch_lock()) have a thread blocked on them, so they go before the
+// asynchronous items, which are often just notifications or property reads.
+enum {
+    PRIO_ASYNC,     // mp_dispatch_enqueue()
+    PRIO_SYNC,      // mp_dispatch_run()
+    NUM_PRIOS
+};
+
+// Maximum number of synchronous requests served in a row while asynchronous
+// items are waiting. Then an asynchronous item is run, so they can't starve.
+#define MAX_SYNC_STREAK 8
+
 struct mp_dispatch_queue {
-    struct mp_dispatch_item *head, *tail;
+    struct mp_dispatch_item *head[NUM_PRIOS], *tail[NUM_PRIOS];
     pthread_mutex_t lock;
     pthread_cond_t cond;
     int suspend_requested;
@@ -41,6 +54,11 @@ struct mp_dispatch_queue {
     // must be >0 (unless mp_dispatch_queue_process() locks it). In particular,
     // suspend mode must not be left while the lock is held.
     pthread_mutex_t exclusive_lock;
+    // Number of threads waiting for exclusive_lock in mp_dispatch_lock().
+    // While >0, mp_dispatch_queue_process() doesn't start asynchronous items.
+    int lock_requests;
+    // Synchronous requests served while asynchronous items were waiting.
+    int sync_streak;
 };
 
 struct mp_dispatch_item {
@@ -48,13 +66,15 @@ struct mp_dispatch_item {
     void *fn_data;
     bool asynchronous;
     bool completed;
+    int priority;
     struct mp_dispatch_item *next;
 };
 
 static void queue_dtor(void *p)
 {
     struct mp_dispatch_queue *queue = p;
-    assert(!queue->head);
+    for (int n = 0; n < NUM_PRIOS; n++)
+        assert(!queue->head[n]);
     assert(!queue->suspend_requested);
     assert(!queue->suspended);
     pthread_cond_destroy(&queue->cond);
@@ -101,13 +121,14 @@ void mp_dispatch_set_wakeup_fn(struct mp_dispatch_queue *queue,
 static void mp_dispatch_append(struct mp_dispatch_queue *queue,
                                struct mp_dispatch_item *item)
 {
+    int prio = item->priority;
     pthread_mutex_lock(&queue->lock);
-    if (queue->tail) {
-        queue->tail->next = item;
+    if (queue->tail[prio]) {
+        queue->tail[prio]->next = item;
     } else {
-        queue->head = item;
+        queue->head[prio] = item;
     }
-    queue->tail = item;
+    queue->tail[prio] = item;
     // Wake up the main thread; note that other threads might wait on this
     // condition for reasons, so broadcast the condition.
     pthread_cond_broadcast(&queue->cond);
@@ -160,6 +181,7 @@ void mp_dispatch_run(struct mp_dispatch_queue *queue,
     struct mp_dispatch_item item = {
         .fn = fn,
         .fn_data = fn_data,
+        .priority = PRIO_SYNC,
     };
     mp_dispatch_append(queue, &item);
 
@@ -169,6 +191,52 @@ void mp_dispatch_run(struct mp_dispatch_queue *queue,
     pthread_mutex_unlock(&queue->lock);
 }
 
+static bool queue_has_items(struct mp_dispatch_queue *queue)
+{
+    for (int n = 0; n < NUM_PRIOS; n++) {
+        if (queue->head[n])
+            return true;
+    }
+    return false;
+}
+
+static struct mp_dispatch_item *pop_item(struct mp_dispatch_queue *queue,
+                                         int prio)
+{
+    struct mp_dispatch_item *item = queue->head[prio];
+    queue->head[prio] = item->next;
+    if (!queue->head[prio])
+        queue->tail[prio] = NULL;
+    item->next = NULL;
+    return item;
+}
+
+// Return the next item to run, or NULL if nothing should be run right now.
+// A synchronous request that has waited long enough is passed over in favor
+// of the asynchronous items (see MAX_SYNC_STREAK).
+static struct mp_dispatch_item *pick_item(struct mp_dispatch_queue *queue)
+{
+    bool async_waiting = queue->head[PRIO_ASYNC];
+    bool starving = async_waiting && queue->sync_streak >= MAX_SYNC_STREAK;
+
+    if (queue->head[PRIO_SYNC] && !starving) {
+        if (async_waiting)
+            queue->sync_streak++;
+        return pop_item(queue, PRIO_SYNC);
+    }
+
+    // Let the thread in mp_dispatch_lock() get exclusive_lock first.
+    if (queue->lock_requests && !starving)
+        return NULL;
+
+    if (async_waiting) {
+        queue->sync_streak = 0;
+        return pop_item(queue, PRIO_ASYNC);
+    }
+
+    return NULL;
+}
+
 // Process any outstanding dispatch items in the queue. This also handles
 // suspending or locking the target thread.
 // The timeout specifies the minimum wait time. The actual time spent in this
@@ -186,13 +254,9 @@ void mp_dispatch_queue_process(struct mp_dispatch_queue *queue, double timeout)
     queue->suspended = true;
     // Wake up thread which called mp_dispatch_suspend().
     pthread_cond_broadcast(&queue->cond);
-    while (queue->head || queue->suspend_requested || wait > 0) {
-        if (queue->head) {
-            struct mp_dispatch_item *item = queue->head;
-            queue->head = item->next;
-            if (!queue->head)
-                queue->tail = NULL;
-            item->next = NULL;
+    while (queue_has_items(queue) || queue->suspend_requested || wait > 0) {
+        struct mp_dispatch_item *item = pick_item(queue);
+        if (item) {
             // Unlock, because we want to allow other threads to queue items
             // while the dispatch item is processed.
             // At the same time, exclusive_lock must be held to protect the
@@ -265,8 +329,20 @@ void mp_dispatch_resume(struct mp_dispatch_queue *queue)
 // and the mutex behavior applies to this function only.
 void mp_dispatch_lock(struct mp_dispatch_queue *queue)
 {
+    pthread_mutex_lock(&queue->lock);
+    queue->lock_requests++;
+    pthread_mutex_unlock(&queue->lock);
+
     mp_dispatch_suspend(queue);
     pthread_mutex_lock(&queue->exclusive_lock);
+
+    pthread_mutex_lock(&queue->lock);
+    queue->lock_requests--;
+    if (queue->head[PRIO_ASYNC])
+        queue->sync_streak++;
+    // The target thread might be waiting for this request to be served.
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->lock);
 }
 
 // Undo mp_dispatch_lock().
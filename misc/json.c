@@ -63,8 +63,9 @@ static bool eat_c(char **s, char c)
 static void eat_ws(char **src)
 {
     while (1) {
-        char c = **src;
-        if (c != ' ' && c != '\t' && c != '\n' && c != '\r')
+        unsigned char c = **src;
+        // All whitespace characters are <= ' ', so this is the common exit.
+        if (c > ' ' || (c != ' ' && c != '\t' && c != '\n' && c != '\r'))
             return;
         *src += 1;
     }
@@ -82,13 +83,15 @@ static int read_str(void *ta_parent, struct mpv_node *dst, char **src)
     char *str = *src;
     char *cur = str;
     bool has_escapes = false;
-    while (cur[0] && cur[0] != '"') {
-        if (cur[0] == '\\') {
-            has_escapes = true;
-            // skip >\"< and >\\< (latter to handle >\\"< correctly)
-            if (cur[1] == '"' || cur[1] == '\\')
-                cur++;
-        }
+    while (1) {
+        // Skip plain characters in bulk (libc's strcspn() is vectorized).
+        cur += strcspn(cur, "\"\\");
+        if (cur[0] != '\\')
+            break;
+        has_escapes = true;
+        // skip >\"< and >\\< (latter to handle >\\"< correctly)
+        if (cur[1] == '"' || cur[1] == '\\')
+            cur++;
         cur++;
     }
     if (cur[0] != '"')
@@ -189,6 +192,24 @@ int json_parse(void *ta_parent, struct mpv_node *dst, char **src, int max_depth)
     } else if (c == '-' || (c >= '0' && c <= '9')) {
         // The number could be either a float or an int. JSON doesn't make a
         // difference, but the client API does.
+        // Fast path for plain decimal integers, which strtod() would parse
+        // the same way, and for which strtoll() with base 0 means base 10.
+        char *end = *src + (c == '-');
+        char *digits = end;
+        while (*end >= '0' && *end <= '9')
+            end++;
+        if (end > digits && (!*end || !strchr(".eExX", *end)) &&
+            !(digits[0] == '0' && end - digits > 1))
+        {
+            errno = 0;
+            long long int numi = strtoll(*src, &end, 10);
+            if (!errno) {
+                *src = end;
+                dst->format = MPV_FORMAT_INT64;
+                dst->u.int64 = numi;
+                return 0;
+            }
+        }
         char *nsrci = *src, *nsrcf = *src;
         errno = 0;
         long long int numi = strtoll(*src, &nsrci, 0);
@@ -218,23 +239,44 @@ int json_parse(void *ta_parent, struct mpv_node *dst, char **src, int max_depth)
 
 #define APPEND(b, s) bstr_xappend(NULL, (b), bstr0(s))
 
+static bool needs_escape(unsigned char c)
+{
+    return c < 32 || c == '"' || c == '\\';
+}
+
 static void write_json_str(bstr *b, unsigned char *str)
 {
     APPEND(b, "\"");
     while (1) {
         unsigned char *cur = str;
-        while (cur[0] && cur[0] >= 32 && cur[0] != '"' && cur[0] != '\\')
+        while (cur[0] && !needs_escape(cur[0]))
             cur++;
+        bstr_xappend(NULL, b, (bstr){str, cur - str});
         if (!cur[0])
             break;
-        bstr_xappend(NULL, b, (bstr){str, cur - str});
-        bstr_xappend_asprintf(NULL, b, "\\u%04x", (unsigned char)cur[0]);
+        static const char hex[] = "0123456789abcdef";
+        unsigned char esc[6] = {'\\', 'u', '0', '0', hex[cur[0] >> 4], hex[cur[0] & 15]};
+        bstr_xappend(NULL, b, (bstr){esc, sizeof(esc)});
         str = cur + 1;
     }
-    APPEND(b, str);
     APPEND(b, "\"");
 }
 
+static void write_json_int(bstr *b, int64_t v)
+{
+    unsigned char buf[24];
+    unsigned char *end = buf + sizeof(buf), *p = end;
+    // Negate as unsigned, which works for INT64_MIN too.
+    uint64_t u = v < 0 ? -(uint64_t)v : v;
+    do {
+        *--p = '0' + u % 10;
+        u /= 10;
+    } while (u);
+    if (v < 0)
+        *--p = '-';
+    bstr_xappend(NULL, b, (bstr){p, end - p});
+}
+
 static int json_append(bstr *b, const struct mpv_node *src)
 {
     switch (src->format) {
@@ -245,7 +287,7 @@ static int json_append(bstr *b, const struct mpv_node *src)
         APPEND(b, src->u.flag ? "true" : "false");
         return 0;
     case MPV_FORMAT_INT64:
-        bstr_xappend_asprintf(NULL, b, "%"PRId64, src->u.int64);
+        write_json_int(b, src->u.int64);
         return 0;
     case MPV_FORMAT_DOUBLE:
         bstr_xappend_asprintf(NULL, b, "%f", src->u.double_);
@@ -265,7 +307,8 @@ static int json_append(bstr *b, const struct mpv_node *src)
                 write_json_str(b, list->keys[n]);
                 APPEND(b, ":");
             }
-            json_append(b, &list->values[n]);
+            if (json_append(b, &list->values[n]) < 0)
+                return -1;
         }
         APPEND(b, is_obj ? "}" : "]");
         return 0;
@@ -274,15 +317,58 @@ static int json_append(bstr *b, const struct mpv_node *src)
     return -1; // unknown format
 }
 
+static size_t json_str_size(unsigned char *str)
+{
+    size_t size = 2;
+    for (; str[0]; str++)
+        size += needs_escape(str[0]) ? 6 : 1;
+    return size;
+}
+
+// Estimate the size of the JSON output. This is exact, except for numbers,
+// for which a typical size is assumed.
+static size_t json_size(const struct mpv_node *src)
+{
+    switch (src->format) {
+    case MPV_FORMAT_STRING:
+        return json_str_size(src->u.string);
+    case MPV_FORMAT_NODE_ARRAY:
+    case MPV_FORMAT_NODE_MAP: {
+        struct mpv_node_list *list = src->u.list;
+        bool is_obj = src->format == MPV_FORMAT_NODE_MAP;
+        size_t size = 2 + list->num;
+        for (int n = 0; n < list->num; n++) {
+            if (is_obj)
+                size += json_str_size(list->keys[n]) + 1;
+            size += json_size(&list->values[n]);
+        }
+        return size;
+    }
+    default:
+        return 16;
+    }
+}
+
 /* Write the contents of *src as JSON, and append the JSON string to *dst.
  * This will use strlen() to determine the start offset, and ta_get_size()
  * and ta_realloc() to extend the memory allocation of *dst.
- * Returns: 0 on success, <0 on failure.
+ * Returns: 0 on success, <0 on failure. On failure, *dst keeps its previous
+ * contents (but might have been reallocated).
  */
 int json_write(char **dst, struct mpv_node *src)
 {
     bstr buffer = bstr0(*dst);
+    size_t len = buffer.len;
+    // Allocate the expected size up front, instead of growing the buffer
+    // while appending.
+    size_t size = len + json_size(src) + 1;
+    if (talloc_get_size(buffer.start) < size) {
+        buffer.start = talloc_realloc_size(NULL, buffer.start, size);
+        buffer.start[len] = '\0';
+    }
     int r = json_append(&buffer, src);
+    if (r < 0)
+        buffer.start[len] = '\0'; // drop partial output
     *dst = buffer.start;
     return r;
 }
@@ -0,0 +1,457 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* MessagePack parser and writer, mapping to mpv_node.
+ *
+ * Supports all types except extension types. Integers are mapped to
+ * MPV_FORMAT_INT64 (unsigned integers that don't fit are converted to
+ * MPV_FORMAT_DOUBLE), binary data to MPV_FORMAT_BYTE_ARRAY. Map keys must be
+ * strings. Strings must not contain '\0' bytes.
+ *
+ * Also see: https://github.com/msgpack/msgpack/blob/master/spec.md
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "common/common.h"
+#include "misc/bstr.h"
+
+#include "msgpack.h"
+
+enum value_type {
+    T_NIL,
+    T_BOOL,
+    T_INT,
+    T_UINT,
+    T_DOUBLE,
+    T_STR,
+    T_BIN,
+    T_ARRAY,
+    T_MAP,
+};
+
+struct header {
+    enum value_type type;
+    int64_t i;          // T_INT, T_BOOL
+    uint64_t u;         // T_UINT, T_STR/T_BIN/T_ARRAY/T_MAP (length)
+    double d;           // T_DOUBLE
+};
+
+struct reader {
+    unsigned char *buf;
+    size_t pos, size;
+    // The byte at saved_pos was overwritten with a string terminator (see
+    // read_str()); its original value is saved.
+    bool have_saved;
+    size_t saved_pos;
+    unsigned char saved;
+};
+
+static bool read_bytes(struct reader *r, unsigned char *out, size_t n)
+{
+    if (r->size - r->pos < n)
+        return false;
+    for (size_t i = 0; i < n; i++) {
+        size_t p = r->pos + i;
+        out[i] = r->have_saved && p == r->saved_pos ? r->saved : r->buf[p];
+    }
+    r->pos += n;
+    return true;
+}
+
+static bool read_uint(struct reader *r, int n, uint64_t *out)
+{
+    unsigned char b[8];
+    if (!read_bytes(r, b, n))
+        return false;
+    uint64_t v = 0;
+    for (int i = 0; i < n; i++)
+        v = (v << 8) | b[i];
+    *out = v;
+    return true;
+}
+
+// Returns: 1 on success, 0 if more data is needed, -1 on invalid data.
+static int read_header(struct reader *r, struct header *h)
+{
+    unsigned char c;
+    if (!read_bytes(r, &c, 1))
+        return 0;
+
+    *h = (struct header){0};
+    int n = 0; // size of the following integer/length field
+    if (c <= 0x7f) {
+        h->type = T_UINT;
+        h->u = c;
+    } else if (c <= 0x8f) {
+        h->type = T_MAP;
+        h->u = c & 0x0f;
+    } else if (c <= 0x9f) {
+        h->type = T_ARRAY;
+        h->u = c & 0x0f;
+    } else if (c <= 0xbf) {
+        h->type = T_STR;
+        h->u = c & 0x1f;
+    } else if (c >= 0xe0) {
+        h->type = T_INT;
+        h->i = (int8_t)c;
+    } else {
+        switch (c) {
+        case 0xc0: h->type = T_NIL; break;
+        case 0xc2: h->type = T_BOOL; h->i = 0; break;
+        case 0xc3: h->type = T_BOOL; h->i = 1; break;
+        case 0xc4: h->type = T_BIN; n = 1; break;
+        case 0xc5: h->type = T_BIN; n = 2; break;
+        case 0xc6: h->type = T_BIN; n = 4; break;
+        case 0xca: h->type = T_DOUBLE; n = 4; break;
+        case 0xcb: h->type = T_DOUBLE; n = 8; break;
+        case 0xcc: h->type = T_UINT; n = 1; break;
+        case 0xcd: h->type = T_UINT; n = 2; break;
+        case 0xce: h->type = T_UINT; n = 4; break;
+        case 0xcf: h->type = T_UINT; n = 8; break;
+        case 0xd0: h->type = T_INT; n = 1; break;
+        case 0xd1: h->type = T_INT; n = 2; break;
+        case 0xd2: h->type = T_INT; n = 4; break;
+        case 0xd3: h->type = T_INT; n = 8; break;
+        case 0xd9: h->type = T_STR; n = 1; break;
+        case 0xda: h->type = T_STR; n = 2; break;
+        case 0xdb: h->type = T_STR; n = 4; break;
+        case 0xdc: h->type = T_ARRAY; n = 2; break;
+        case 0xdd: h->type = T_ARRAY; n = 4; break;
+        case 0xde: h->type = T_MAP; n = 2; break;
+        case 0xdf: h->type = T_MAP; n = 4; break;
+        default:
+            return -1; // extension types, or never used
+        }
+    }
+
+    if (!n)
+        return 1;
+
+    uint64_t v;
+    if (!read_uint(r, n, &v))
+        return 0;
+
+    switch (h->type) {
+    case T_INT:
+        switch (n) {
+        case 1: h->i = (int8_t)v; break;
+        case 2: h->i = (int16_t)v; break;
+        case 4: h->i = (int32_t)v; break;
+        case 8: h->i = (int64_t)v; break;
+        }
+        break;
+    case T_DOUBLE:
+        if (n == 4) {
+            uint32_t v32 = v;
+            float f;
+            memcpy(&f, &v32, sizeof(f));
+            h->d = f;
+        } else {
+            memcpy(&h->d, &v, sizeof(h->d));
+        }
+        break;
+    default:
+        h->u = v;
+    }
+    return 1;
+}
+
+static int skip_value(struct reader *r, int max_depth)
+{
+    max_depth -= 1;
+    if (max_depth < 0)
+        return -1;
+
+    struct header h;
+    int res = read_header(r, &h);
+    if (res <= 0)
+        return res;
+
+    switch (h.type) {
+    case T_STR:
+    case T_BIN:
+        if (r->size - r->pos < h.u)
+            return 0;
+        r->pos += h.u;
+        return 1;
+    case T_ARRAY:
+    case T_MAP: {
+        uint64_t count = h.type == T_MAP ? h.u * 2 : h.u;
+        for (uint64_t n = 0; n < count; n++) {
+            res = skip_value(r, max_depth);
+            if (res <= 0)
+                return res;
+        }
+        return 1;
+    }
+    default:
+        return 1;
+    }
+}
+
+/* Check whether src starts with a complete MessagePack value.
+ * max_depth limits the tree depth (same as with msgpack_parse()).
+ * Returns:
+ *   1: success, *out_size is set to the size of the value in bytes
+ *   0: src ends before the value is complete
+ *  -1: invalid data, or the value is nested too deeply
+ */
+int msgpack_message_size(bstr src, int max_depth, size_t *out_size)
+{
+    struct reader r = { .buf = src.start, .size = src.len };
+    int res = skip_value(&r, max_depth);
+    if (res > 0)
+        *out_size = r.pos;
+    return res;
+}
+
+static int read_str(struct reader *r, uint64_t len, char **out)
+{
+    if (r->size - r->pos < len)
+        return -1;
+    char *str = (char *)r->buf + r->pos;
+    if (memchr(str, '\0', len))
+        return -1;
+    r->pos += len;
+    // Mutate the input so we have a null-terminated string, and can avoid
+    // allocating a copy. The overwritten byte belongs to the next value (or
+    // is the spare byte after the message), so remember it.
+    r->have_saved = true;
+    r->saved_pos = r->pos;
+    r->saved = r->buf[r->pos];
+    r->buf[r->pos] = '\0';
+    *out = str;
+    return 0;
+}
+
+static int parse_value(void *ta_parent, struct reader *r, struct mpv_node *dst,
+                       int max_depth)
+{
+    max_depth -= 1;
+    if (max_depth < 0)
+        return -1;
+
+    struct header h;
+    if (read_header(r, &h) <= 0)
+        return -1;
+
+    switch (h.type) {
+    case T_NIL:
+        dst->format = MPV_FORMAT_NONE;
+        return 0;
+    case T_BOOL:
+        dst->format = MPV_FORMAT_FLAG;
+        dst->u.flag = h.i;
+        return 0;
+    case T_INT:
+        dst->format = MPV_FORMAT_INT64;
+        dst->u.int64 = h.i;
+        return 0;
+    case T_UINT:
+        if (h.u > INT64_MAX) {
+            dst->format = MPV_FORMAT_DOUBLE;
+            dst->u.double_ = h.u;
+        } else {
+            dst->format = MPV_FORMAT_INT64;
+            dst->u.int64 = h.u;
+        }
+        return 0;
+    case T_DOUBLE:
+        dst->format = MPV_FORMAT_DOUBLE;
+        dst->u.double_ = h.d;
+        return 0;
+    case T_STR:
+        dst->format = MPV_FORMAT_STRING;
+        return read_str(r, h.u, &dst->u.string);
+    case T_BIN: {
+        if (r->size - r->pos < h.u)
+            return -1;
+        struct mpv_byte_array *ba = talloc_zero(ta_parent, struct mpv_byte_array);
+        ba->data = r->buf + r->pos;
+        ba->size = h.u;
+        r->pos += h.u;
+        dst->format = MPV_FORMAT_BYTE_ARRAY;
+        dst->u.ba = ba;
+        return 0;
+    }
+    case T_ARRAY:
+    case T_MAP: {
+        bool is_map = h.type == T_MAP;
+        // Each entry takes at least 1 byte, which also limits the allocation.
+        if (h.u > r->size - r->pos)
+            return -1;
+        struct mpv_node_list *list = talloc_zero(ta_parent, struct mpv_node_list);
+        list->values = talloc_array(list, struct mpv_node, h.u);
+        if (is_map)
+            list->keys = talloc_array(list, char *, h.u);
+        for (uint64_t n = 0; n < h.u; n++) {
+            if (is_map) {
+                struct header kh;
+                if (read_header(r, &kh) <= 0 || kh.type != T_STR)
+                    return -1; // key is not a string
+                if (read_str(r, kh.u, &list->keys[n]) < 0)
+                    return -1;
+            }
+            if (parse_value(ta_parent, r, &list->values[n], max_depth) < 0)
+                return -1;
+            list->num++;
+        }
+        dst->format = is_map ? MPV_FORMAT_NODE_MAP : MPV_FORMAT_NODE_ARRAY;
+        dst->u.list = list;
+        return 0;
+    }
+    }
+    return -1;
+}
+
+/* Parse a MessagePack value of the given size (as returned by
+ * msgpack_message_size()), and write the result into *dst.
+ * max_depth limits the recursion and tree depth.
+ * Warning: this overwrites the input, and src must have size + 1 bytes!
+ * Returns:
+ *   0: success, *dst is valid
+ *  -1: failure, *dst is invalid, there may be dead allocs under ta_parent
+ *      (ta_free_children(ta_parent) is the only way to free them)
+ * *dst might contain string and byte array elements, which point into the
+ * (mutated) input.
+ */
+int msgpack_parse(void *ta_parent, struct mpv_node *dst, unsigned char *src,
+                  size_t size, int max_depth)
+{
+    struct reader r = { .buf = src, .size = size };
+    if (parse_value(ta_parent, &r, dst, max_depth) < 0)
+        return -1;
+    return r.pos == size ? 0 : -1;
+}
+
+static void append_header(void *ta_parent, bstr *b, unsigned char c,
+                          uint64_t v, int n)
+{
+    unsigned char buf[9] = {c};
+    for (int i = 0; i < n; i++)
+        buf[1 + i] = v >> (8 * (n - 1 - i));
+    bstr_xappend(ta_parent, b, (bstr){buf, 1 + n});
+}
+
+// fix/fix_max: fixed-size encoding (0 if none)
+// c8/c16/c32: encodings with 8/16/32 bit length (c8 is 0 if none)
+static void append_length(void *ta_parent, bstr *b, uint64_t len,
+                          unsigned char fix, uint64_t fix_max,
+                          unsigned char c8, unsigned char c16, unsigned char c32)
+{
+    if (fix && len <= fix_max) {
+        append_header(ta_parent, b, fix | len, 0, 0);
+    } else if (c8 && len <= UINT8_MAX) {
+        append_header(ta_parent, b, c8, len, 1);
+    } else if (len <= UINT16_MAX) {
+        append_header(ta_parent, b, c16, len, 2);
+    } else {
+        append_header(ta_parent, b, c32, len, 4);
+    }
+}
+
+static void append_str(void *ta_parent, bstr *b, const char *s)
+{
+    size_t len = strlen(s);
+    append_length(ta_parent, b, len, 0xa0, 31, 0xd9, 0xda, 0xdb);
+    bstr_xappend(ta_parent, b, (bstr){(unsigned char *)s, len});
+}
+
+static void append_int(void *ta_parent, bstr *b, int64_t v)
+{
+    if (v >= 0) {
+        if (v <= 0x7f) {
+            append_header(ta_parent, b, v, 0, 0);
+        } else if (v <= UINT8_MAX) {
+            append_header(ta_parent, b, 0xcc, v, 1);
+        } else if (v <= UINT16_MAX) {
+            append_header(ta_parent, b, 0xcd, v, 2);
+        } else if (v <= UINT32_MAX) {
+            append_header(ta_parent, b, 0xce, v, 4);
+        } else {
+            append_header(ta_parent, b, 0xcf, v, 8);
+        }
+    } else {
+        if (v >= -32) {
+            append_header(ta_parent, b, (uint8_t)v, 0, 0);
+        } else if (v >= INT8_MIN) {
+            append_header(ta_parent, b, 0xd0, (uint64_t)v, 1);
+        } else if (v >= INT16_MIN) {
+            append_header(ta_parent, b, 0xd1, (uint64_t)v, 2);
+        } else if (v >= INT32_MIN) {
+            append_header(ta_parent, b, 0xd2, (uint64_t)v, 4);
+        } else {
+            append_header(ta_parent, b, 0xd3, (uint64_t)v, 8);
+        }
+    }
+}
+
+/* Append the contents of *src as MessagePack to *dst. dst->start is
+ * reallocated as needed, as talloc child of ta_parent.
+ * Returns: 0 on success, <0 on failure.
+ */
+int msgpack_write(void *ta_parent, bstr *dst, struct mpv_node *src)
+{
+    switch (src->format) {
+    case MPV_FORMAT_NONE:
+        append_header(ta_parent, dst, 0xc0, 0, 0);
+        return 0;
+    case MPV_FORMAT_FLAG:
+        append_header(ta_parent, dst, src->u.flag ? 0xc3 : 0xc2, 0, 0);
+        return 0;
+    case MPV_FORMAT_INT64:
+        append_int(ta_parent, dst, src->u.int64);
+        return 0;
+    case MPV_FORMAT_DOUBLE: {
+        uint64_t v;
+        memcpy(&v, &src->u.double_, sizeof(v));
+        append_header(ta_parent, dst, 0xcb, v, 8);
+        return 0;
+    }
+    case MPV_FORMAT_STRING:
+        append_str(ta_parent, dst, src->u.string);
+        return 0;
+    case MPV_FORMAT_BYTE_ARRAY: {
+        struct mpv_byte_array *ba = src->u.ba;
+        append_length(ta_parent, dst, ba->size, 0, 0, 0xc4, 0xc5, 0xc6);
+        bstr_xappend(ta_parent, dst, (bstr){ba->data, ba->size});
+        return 0;
+    }
+    case MPV_FORMAT_NODE_ARRAY:
+    case MPV_FORMAT_NODE_MAP: {
+        struct mpv_node_list *list = src->u.list;
+        bool is_map = src->format == MPV_FORMAT_NODE_MAP;
+        int num = list ? list->num : 0;
+        if (is_map) {
+            append_length(ta_parent, dst, num, 0x80, 15, 0, 0xde, 0xdf);
+        } else {
+            append_length(ta_parent, dst, num, 0x90, 15, 0, 0xdc, 0xdd);
+        }
+        for (int n = 0; n < num; n++) {
+            if (is_map)
+                append_str(ta_parent, dst, list->keys[n]);
+            if (msgpack_write(ta_parent, dst, &list->values[n]) < 0)
+                return -1;
+        }
+        return 0;
+    }
+    }
+    return -1; // unknown format
+}
@@ -0,0 +1,140 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <pthread.h>
+#include <stdbool.h>
+
+#include "common/common.h"
+#include "osdep/threads.h"
+#include "mpv_talloc.h"
+
+#include "thread_pool.h"
+
+struct mp_thread_pool {
+    pthread_mutex_t run_lock;   // serializes mp_thread_pool_run() calls
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    pthread_t *threads;
+    int num_threads;
+    bool terminate;
+
+    // Current job.
+    mp_thread_pool_fn fn;
+    void *ctx;
+    int count;
+    int next;       // next index to process
+    int finished;   // number of indexes processed
+};
+
+// Process entries of the current job until none are left. Must be called with
+// pool->lock held.
+static void work(struct mp_thread_pool *pool)
+{
+    while (pool->next < pool->count) {
+        int index = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+        pool->fn(pool->ctx, index);
+        pthread_mutex_lock(&pool->lock);
+        pool->finished++;
+        if (pool->finished == pool->count)
+            pthread_cond_broadcast(&pool->wakeup);
+    }
+}
+
+static void *worker_thread(void *arg)
+{
+    struct mp_thread_pool *pool = arg;
+    mpthread_set_name("worker");
+
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->terminate) {
+        if (pool->next < pool->count) {
+            work(pool);
+        } else {
+            pthread_cond_wait(&pool->wakeup, &pool->lock);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+static void thread_pool_destroy(void *ptr)
+{
+    struct mp_thread_pool *pool = ptr;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->terminate = true;
+    pthread_cond_broadcast(&pool->wakeup);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int n = 0; n < pool->num_threads; n++)
+        pthread_join(pool->threads[n], NULL);
+
+    pthread_cond_destroy(&pool->wakeup);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_mutex_destroy(&pool->run_lock);
+}
+
+// Create a pool with the given number of worker threads. The calling thread of
+// mp_thread_pool_run() participates in the work, so threads=0 is valid (and
+// runs everything on the caller). Free the pool with talloc_free().
+struct mp_thread_pool *mp_thread_pool_create(void *talloc_parent, int threads)
+{
+    struct mp_thread_pool *pool = talloc_zero(talloc_parent, struct mp_thread_pool);
+    pthread_mutex_init(&pool->run_lock, NULL);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wakeup, NULL);
+    talloc_set_destructor(pool, thread_pool_destroy);
+
+    pool->threads = talloc_zero_array(pool, pthread_t, MPMAX(threads, 1));
+    for (int n = 0; n < threads; n++) {
+        if (pthread_create(&pool->threads[n], NULL, worker_thread, pool))
+            break;
+        pool->num_threads++;
+    }
+
+    return pool;
+}
+
+// Call fn(ctx, index) for each index in [0, count), distributed over the pool
+// threads and the calling thread, and return once all calls have finished.
+// Can be called from any thread, but concurrent calls are serialized.
+void mp_thread_pool_run(struct mp_thread_pool *pool, mp_thread_pool_fn fn,
+                        void *ctx, int count)
+{
+    pthread_mutex_lock(&pool->run_lock);
+    pthread_mutex_lock(&pool->lock);
+
+    pool->fn = fn;
+    pool->ctx = ctx;
+    pool->count = count;
+    pool->next = 0;
+    pool->finished = 0;
+    pthread_cond_broadcast(&pool->wakeup);
+
+    work(pool);
+    while (pool->finished < pool->count)
+        pthread_cond_wait(&pool->wakeup, &pool->lock);
+
+    pool->fn = NULL;
+    pool->ctx = NULL;
+    pool->count = pool->next = pool->finished = 0;
+
+    pthread_mutex_unlock(&pool->lock);
+    pthread_mutex_unlock(&pool->run_lock);
+}
@@ -0,0 +1,30 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef MP_THREAD_POOL_H_
+#define MP_THREAD_POOL_H_
+
+struct mp_thread_pool;
+
+typedef void (*mp_thread_pool_fn)(void *ctx, int index);
+
+struct mp_thread_pool *mp_thread_pool_create(void *talloc_parent, int threads);
+void mp_thread_pool_run(struct mp_thread_pool *pool, mp_thread_pool_fn fn,
+                        void *ctx, int count);
+
+#endif
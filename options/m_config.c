@@ -27,6 +27,7 @@
 #include <strings.h>
 #include <assert.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "libmpv/client.h"
 
@@ -57,7 +58,6 @@ struct m_profile {
 
 // In the file local case, this contains the old global value.
 struct m_opt_backup {
-    struct m_opt_backup *next;
     struct m_config_option *co;
     void *backup;
 };
@@ -246,40 +246,64 @@ int m_config_apply_defaults(struct m_config *config, const char *name,
     return r;
 }
 
+// Binary search config->backup_opts for the entry with the given data
+// pointer. Returns its index, or the index it has to be inserted at.
+static int find_backup(struct m_config *config, void *data, bool *found)
+{
+    int lo = 0, hi = config->num_backup_opts;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        void *cur = config->backup_opts[mid]->co->data;
+        if (cur == data) {
+            *found = true;
+            return mid;
+        }
+        if ((uintptr_t)cur < (uintptr_t)data) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *found = false;
+    return lo;
+}
+
 static void ensure_backup(struct m_config *config, struct m_config_option *co)
 {
+    if (co->is_set_locally)
+        return;
     if (co->opt->type->flags & M_OPT_TYPE_HAS_CHILD)
         return;
     if (co->opt->flags & M_OPT_GLOBAL)
         return;
     if (!co->data)
         return;
-    for (struct m_opt_backup *cur = config->backup_opts; cur; cur = cur->next) {
-        if (cur->co->data == co->data) // comparing data ptr catches aliases
-            return;
-    }
+    bool found;
+    int index = find_backup(config, co->data, &found);
+    if (found) // comparing data ptr catches aliases
+        return;
     struct m_opt_backup *bc = talloc_ptrtype(NULL, bc);
     *bc = (struct m_opt_backup) {
         .co = co,
         .backup = talloc_zero_size(bc, co->opt->type->size),
     };
     m_option_copy(co->opt, bc->backup, co->data);
-    bc->next = config->backup_opts;
-    config->backup_opts = bc;
+    MP_TARRAY_INSERT_AT(config, config->backup_opts, config->num_backup_opts,
+                        index, bc);
     co->is_set_locally = true;
 }
 
 void m_config_restore_backups(struct m_config *config)
 {
-    while (config->backup_opts) {
-        struct m_opt_backup *bc = config->backup_opts;
-        config->backup_opts = bc->next;
+    for (int n = 0; n < config->num_backup_opts; n++) {
+        struct m_opt_backup *bc = config->backup_opts[n];
 
         m_option_copy(bc->co->opt, bc->co->data, bc->backup);
         m_option_free(bc->co->opt, bc->backup);
         bc->co->is_set_locally = false;
         talloc_free(bc);
     }
+    config->num_backup_opts = 0;
 }
 
 void m_config_backup_opt(struct m_config *config, const char *opt)
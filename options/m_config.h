@@ -67,7 +67,9 @@ typedef struct m_config {
     // Depth when recursively including profiles.
     int profile_depth;
 
-    struct m_opt_backup *backup_opts;
+    // Options with a backup (set per-file), sorted by m_config_option.data.
+    struct m_opt_backup **backup_opts;
+    int num_backup_opts;
 
     bool use_profiles;
     bool is_toplevel;
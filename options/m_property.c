@@ -36,17 +36,39 @@
 #include "common/msg.h"
 #include "common/common.h"
 
-struct m_property *m_property_list_find(const struct m_property *list,
+static int compare_property(const void *a, const void *b)
+{
+    const struct m_property *pa = a, *pb = b;
+    return strcmp(pa->name, pb->name);
+}
+
+void m_property_list_sort(struct m_property_list *list)
+{
+    qsort(list->entries, list->num_entries, sizeof(list->entries[0]),
+          compare_property);
+}
+
+struct m_property *m_property_list_find(const struct m_property_list *list,
                                         const char *name)
 {
-    for (int n = 0; list && list[n].name; n++) {
-        if (strcmp(list[n].name, name) == 0)
-            return (struct m_property *)&list[n];
+    if (!list)
+        return NULL;
+    int lo = 0, hi = list->num_entries;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        int c = strcmp(list->entries[mid].name, name);
+        if (c == 0)
+            return &list->entries[mid];
+        if (c < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
     }
     return NULL;
 }
 
-static int do_action(const struct m_property *prop_list, const char *name,
+static int do_action(const struct m_property_list *prop_list, const char *name,
                      int action, void *arg, void *ctx)
 {
     struct m_property *prop;
@@ -71,7 +93,7 @@ static int do_action(const struct m_property *prop_list, const char *name,
 }
 
 // (as a hack, log can be NULL on read-only paths)
-int m_property_do(struct mp_log *log, const struct m_property *prop_list,
+int m_property_do(struct mp_log *log, const struct m_property_list *prop_list,
                   const char *name, int action, void *arg, void *ctx)
 {
     union m_option_value val = {0};
@@ -194,8 +216,8 @@ static void m_property_unkey(int *action, void **arg)
     }
 }
 
-static int m_property_do_bstr(const struct m_property *prop_list, bstr name,
-                              int action, void *arg, void *ctx)
+static int m_property_do_bstr(const struct m_property_list *prop_list,
+                              bstr name, int action, void *arg, void *ctx)
 {
     char name0[64];
     if (name.len >= sizeof(name0))
@@ -212,8 +234,9 @@ static void append_str(char **s, int *len, bstr append)
     *len = *len + append.len;
 }
 
-static int expand_property(const struct m_property *prop_list, char **ret,
-                           int *ret_len, bstr prop, bool silent_error, void *ctx)
+static int expand_property(const struct m_property_list *prop_list,
+                           char **ret, int *ret_len, bstr prop,
+                           bool silent_error, void *ctx)
 {
     bool cond_yes = bstr_eatstart0(&prop, "?");
     bool cond_no = !cond_yes && bstr_eatstart0(&prop, "!");
@@ -243,7 +266,7 @@ static int expand_property(const struct m_property *prop_list, char **ret,
     return skip;
 }
 
-char *m_properties_expand_string(const struct m_property *prop_list,
+char *m_properties_expand_string(const struct m_property_list *prop_list,
                                  const char *str0, void *ctx)
 {
     char *ret = NULL;
@@ -300,17 +323,12 @@ char *m_properties_expand_string(const struct m_property *prop_list,
 }
 
 void m_properties_print_help_list(struct mp_log *log,
-                                  const struct m_property *list)
+                                  const struct m_property_list *list)
 {
-    int count = 0;
-
     mp_info(log, "Name\n\n");
-    for (int i = 0; list[i].name; i++) {
-        const struct m_property *p = &list[i];
-        mp_info(log, " %s\n", p->name);
-        count++;
-    }
-    mp_info(log, "\nTotal: %d properties\n", count);
+    for (int i = 0; i < list->num_entries; i++)
+        mp_info(log, " %s\n", list->entries[i].name);
+    mp_info(log, "\nTotal: %d properties\n", list->num_entries);
 }
 
 int m_property_flag_ro(int action, void* arg, int var)
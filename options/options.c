@@ -36,6 +36,7 @@
 #include "options.h"
 #include "m_config.h"
 #include "m_option.h"
+#include "common/benchmark.h"
 #include "common/common.h"
 #include "stream/stream.h"
 #include "video/csputils.h"
@@ -94,6 +95,7 @@ const struct m_opt_choice_alternatives mp_hwdec_names[] = {
     {"d3d11va-copy",HWDEC_D3D11VA_COPY},
     {"rpi",         HWDEC_RPI},
     {"mediacodec",  HWDEC_MEDIACODEC},
+    {"cuda",        HWDEC_CUDA},
     {0}
 };
 
@@ -137,6 +139,12 @@ static const m_option_t mp_vo_opt_list[] = {
     OPT_FLAG("fs-black-out-screens", fs_black_out_screens, 0),
     OPT_FLAG("keepaspect", keepaspect, 0),
     OPT_FLAG("keepaspect-window", keepaspect_window, 0),
+    OPT_CHOICE_OR_INT("video-queue-frames", queue_frames, 0, 0, 4,
+                      ({"auto", -1})),
+    OPT_CHOICE_OR_INT("video-render-ahead", render_ahead, 0, 0, 1000,
+                      ({"auto", -1})),
+    OPT_CHOICE_OR_INT("video-wait-spin", wait_spin, 0, 1, 10000,
+                      ({"no", 0})),
 #if HAVE_X11
     OPT_CHOICE("x11-netwm", x11_netwm, 0,
                ({"auto", 0}, {"no", -1}, {"yes", 1})),
@@ -161,6 +169,7 @@ static const struct m_sub_options vo_sub_opts = {
         .panscan = 0.0f,
         .keepaspect = 1,
         .keepaspect_window = 1,
+        .render_ahead = 50,
         .taskbar_progress = 1,
         .border = 1,
         .fit_border = 1,
@@ -200,6 +209,8 @@ const m_option_t mp_opts[] = {
     OPT_GENERAL(char**, "msg-level", msg_levels, CONF_PRE_PARSE | M_OPT_TERM,
                 .type = &m_option_type_msglevels),
     OPT_STRING("dump-stats", dump_stats, CONF_GLOBAL | CONF_PRE_PARSE),
+    OPT_CHOICE("dump-stats-format", dump_stats_format,
+               CONF_GLOBAL | CONF_PRE_PARSE, ({"text", 0}, {"trace", 1})),
     OPT_FLAG("msg-color", msg_color, CONF_PRE_PARSE | M_OPT_TERM),
     OPT_STRING("log-file", log_file, CONF_PRE_PARSE | M_OPT_FILE),
     OPT_FLAG("msg-module", msg_module, M_OPT_TERM),
@@ -214,6 +225,8 @@ const m_option_t mp_opts[] = {
                 {"belownormal", BELOW_NORMAL_PRIORITY_CLASS},
                 {"idle",        IDLE_PRIORITY_CLASS})),
 #endif
+    OPT_STRINGLIST("thread-realtime", thread_realtime, CONF_GLOBAL),
+    OPT_KEYVALUELIST("thread-affinity", thread_affinity, CONF_GLOBAL),
     OPT_FLAG("config", load_config, CONF_GLOBAL | CONF_PRE_PARSE),
     OPT_STRING("config-dir", force_configdir,
                CONF_GLOBAL | CONF_NOCFG | CONF_PRE_PARSE),
@@ -227,6 +240,8 @@ const m_option_t mp_opts[] = {
     OPT_STRING("ytdl-format", lua_ytdl_format, CONF_GLOBAL),
     OPT_KEYVALUELIST("ytdl-raw-options", lua_ytdl_raw_options, CONF_GLOBAL),
     OPT_FLAG("load-scripts", auto_load_scripts, CONF_GLOBAL),
+    OPT_INTRANGE("script-threads", script_threads, CONF_GLOBAL, 0, 64),
+    OPT_FLAG("script-init-concurrent", script_init_concurrent, CONF_GLOBAL),
 #endif
 
 // ------------------------- stream options --------------------
@@ -240,8 +255,16 @@ const m_option_t mp_opts[] = {
     OPT_INTRANGE("cache-initial", stream_cache.initial, 0, 0, 0x7fffffff),
     OPT_INTRANGE("cache-seek-min", stream_cache.seek_min, 0, 0, 0x7fffffff),
     OPT_INTRANGE("cache-backbuffer", stream_cache.back_buffer, 0, 0, 0x7fffffff),
+    OPT_INTRANGE("cache-connections", stream_cache.connections, 0, 1, 16),
+    OPT_INTRANGE("cache-sparse-size", stream_cache.sparse_size, 0, 0, 0x7fffffff),
+    OPT_INTRANGE("cache-adaptive-max", stream_cache.adaptive_max, 0, 0, 0x7fffffff),
     OPT_STRING("cache-file", stream_cache.file, M_OPT_FILE),
     OPT_INTRANGE("cache-file-size", stream_cache.file_max, 0, 0, 0x7fffffff),
+    OPT_INTRANGE("cache-file-total-size", stream_cache.file_total_max,
+                 0, 0, 0x7fffffff),
+    OPT_FLAG("cache-shared", stream_cache.shared, 0),
+    OPT_INTRANGE("cache-shared-size", stream_cache.shared_max,
+                 0, 0, 0x7fffffff),
 
 #if HAVE_DVDREAD || HAVE_DVDNAV
     OPT_STRING("dvd-device", dvd_device, M_OPT_FILE),
@@ -318,7 +341,8 @@ const m_option_t mp_opts[] = {
                ({"no", 0}, {"attachment", 1})),
 
     OPT_CHOICE_OR_INT("hls-bitrate", hls_bitrate, 0, 0, INT_MAX,
-                      ({"no", -1}, {"min", 0}, {"max", INT_MAX})),
+                      ({"no", -1}, {"min", 0}, {"max", INT_MAX},
+                       {"auto", HLS_BITRATE_AUTO})),
 
     OPT_STRINGLIST("display-tags*", display_tags, 0),
 
@@ -336,14 +360,29 @@ const m_option_t mp_opts[] = {
     OPT_DOUBLE("demuxer-readahead-secs", demuxer_min_secs, M_OPT_MIN, .min = 0),
     OPT_INTRANGE("demuxer-max-packets", demuxer_max_packs, 0, 0, INT_MAX),
     OPT_INTRANGE("demuxer-max-bytes", demuxer_max_bytes, 0, 0, INT_MAX),
+    OPT_INTRANGE("demuxer-max-back-bytes", demuxer_max_back_bytes, 0, 0, INT_MAX),
+    OPT_INTRANGE("demuxer-max-bytes-video", demuxer_max_bytes_video, 0, 0, INT_MAX),
+    OPT_INTRANGE("demuxer-max-bytes-audio", demuxer_max_bytes_audio, 0, 0, INT_MAX),
+    OPT_INTRANGE("demuxer-max-bytes-sub", demuxer_max_bytes_sub, 0, 0, INT_MAX),
+    OPT_INTRANGE("memory-budget", memory_budget, 0, 0, 1024 * 1024),
+    OPT_FLAG("demuxer-prefill-tracks", demuxer_prefill_tracks, 0),
+    OPT_FLAG("demuxer-fast-probe", demuxer_fast_probe, 0),
+    OPT_DOUBLE("demuxer-timeline-prefetch", demuxer_timeline_prefetch,
+               M_OPT_MIN, .min = 0),
+    OPT_INTRANGE("directory-scan-threads", directory_scan_threads, 0, 1, 64),
 
     OPT_FLAG("force-seekable", force_seekable, 0),
 
     OPT_DOUBLE("cache-secs", demuxer_min_secs_cache, M_OPT_MIN, .min = 0),
     OPT_FLAG("cache-pause", cache_pausing, 0),
+    OPT_CHOICE("cache-pause-mode", cache_pause_mode, 0,
+               ({"adaptive", 0}, {"predictive", 1})),
+    OPT_DOUBLE("cache-pause-horizon", cache_pause_horizon, M_OPT_MIN, .min = 0),
+    OPT_DOUBLE("latency-target", latency_target, M_OPT_MIN, .min = 0),
 
     OPT_DOUBLE("mf-fps", mf_fps, 0),
     OPT_STRING("mf-type", mf_type, 0),
+    OPT_INTRANGE("mf-prefetch", mf_prefetch, 0, 0, 64),
 #if HAVE_TV
     OPT_SUBSTRUCT("tv", tv_params, tv_params_conf, 0),
 #endif /* HAVE_TV */
@@ -385,6 +424,13 @@ const m_option_t mp_opts[] = {
 
     OPT_STRING("ad", audio_decoders, 0),
     OPT_STRING("vd", video_decoders, 0),
+    OPT_INTRANGE("vd-queue-frames", vd_queue_frames, 0, 0, 64),
+    OPT_FLAG("vd-auto-degrade", vd_auto_degrade, 0),
+    OPT_INTRANGE("ad-queue-frames", ad_queue_frames, 0, 0, 256),
+    OPT_CHOICE_OR_INT("video-pool-frames", video_pool_frames, 0, 1, 256,
+                      ({"no", 0}, {"auto", -1})),
+    OPT_FLAG("vf-pipeline", vf_pipeline, 0),
+    OPT_STRINGLIST("video-mirror", video_mirrors, 0),
 
     OPT_STRING("audio-spdif", audio_spdif, 0),
 
@@ -392,6 +438,7 @@ const m_option_t mp_opts[] = {
 
     OPT_CHOICE_C("hwdec", hwdec_api, 0, mp_hwdec_names),
     OPT_STRING("hwdec-codecs", hwdec_codecs, 0),
+    OPT_INTRANGE("hwdec-surface-cache", hwdec_surface_cache, 0, 0, 4096),
 #if HAVE_VIDEOTOOLBOX_HWACCEL
     OPT_IMAGEFORMAT("videotoolbox-format", videotoolbox_format, 0),
 #endif
@@ -421,6 +468,7 @@ const m_option_t mp_opts[] = {
     OPT_STRING_APPEND_LIST("external-file", external_files, M_OPT_FILE),
     OPT_FLAG("autoload-files", autoload_files, 0),
     OPT_STRING("sub-codepage", sub_cp, 0),
+    OPT_INTRANGE("sub-codepage-probe-size", sub_cp_probe_size, 0, 0, INT_MAX),
     OPT_FLOAT("sub-delay", sub_delay, 0),
     OPT_FLOAT("sub-fps", sub_fps, 0),
     OPT_FLOAT("sub-speed", sub_speed, 0),
@@ -465,6 +513,8 @@ const m_option_t mp_opts[] = {
     OPT_SUBSTRUCT("osd", osd_style, osd_style_conf, 0),
     OPT_SUBSTRUCT("sub-text", sub_text_style, sub_style_conf, 0),
     OPT_FLAG("sub-clear-on-seek", sub_clear_on_seek, 0),
+    OPT_FLAG("sub-index-external", sub_index_external, 0),
+    OPT_FLAG("sub-ass-render-ahead", sub_ass_render_ahead, 0),
 
 //---------------------- libao/libvo options ------------------------
     OPT_SETTINGSLIST("ao", audio_driver_list, 0, &ao_obj_list),
@@ -476,6 +526,7 @@ const m_option_t mp_opts[] = {
     OPT_FLOATRANGE("audio-wait-open", audio_wait_open, 0, 0, 60),
     OPT_CHOICE("force-window", force_vo, 0,
                ({"no", 0}, {"yes", 1}, {"immediate", 2})),
+    OPT_FLAG("vo-preinit", vo_preinit, 0),
 
     OPT_FLAG("window-dragging", allow_win_drag, CONF_GLOBAL),
 
@@ -497,6 +548,10 @@ const m_option_t mp_opts[] = {
                 {"weak", -1})),
     OPT_DOUBLE("audio-buffer", audio_buffer, M_OPT_MIN | M_OPT_MAX,
                .min = 0, .max = 10),
+    OPT_INTRANGE("audio-parallel-threshold", audio_parallel_threshold, 0,
+                 0, INT_MAX),
+    OPT_DOUBLE("audio-seek-cache", audio_seek_cache, M_OPT_MIN | M_OPT_MAX,
+               .min = 0, .max = 3600),
     OPT_FLOATRANGE("balance", balance, 0, -1, 1),
 
     OPT_STRING("title", wintitle, 0),
@@ -543,8 +598,17 @@ const m_option_t mp_opts[] = {
     OPT_DOUBLE("display-fps", frame_drop_fps, M_OPT_MIN, .min = 0),
 
     OPT_FLAG("untimed", untimed, 0),
+    OPT_STRING("benchmark", benchmark, CONF_GLOBAL | M_OPT_FILE),
+    OPT_CHOICE("benchmark-stage", benchmark_stage, CONF_GLOBAL,
+               ({"demux", MP_BENCHMARK_DEMUX},
+                {"decode", MP_BENCHMARK_DECODE},
+                {"filter", MP_BENCHMARK_FILTER},
+                {"render", MP_BENCHMARK_RENDER},
+                {"present", MP_BENCHMARK_PRESENT})),
 
     OPT_STRING("stream-capture", stream_capture, M_OPT_FILE),
+    OPT_FLAG("stream-mmap", stream_mmap, 0),
+    OPT_INTRANGE("stream-readahead-depth", stream_readahead_depth, 0, 0, 64),
     OPT_STRING("stream-dump", stream_dump, M_OPT_FILE),
 
     OPT_FLAG("stop-playback-on-init-failure", stop_playback_on_init_failure, 0),
@@ -573,6 +637,7 @@ const m_option_t mp_opts[] = {
 
     OPT_FLAG("load-unsafe-playlists", load_unsafe_playlists, 0),
     OPT_FLAG("merge-files", merge_files, 0),
+    OPT_FLAG("prefetch-playlist", prefetch_playlist, 0),
 
     // a-v sync stuff:
     OPT_FLAG("correct-pts", correct_pts, 0),
@@ -596,6 +661,7 @@ const m_option_t mp_opts[] = {
                ({"no", -1}, {"absolute", 0}, {"yes", 1}, {"always", 1})),
     OPT_FLOAT("hr-seek-demuxer-offset", hr_seek_demuxer_offset, 0),
     OPT_FLAG("hr-seek-framedrop", hr_seek_framedrop, 0),
+    OPT_FLAG("hr-seek-preview", hr_seek_preview, 0),
     OPT_CHOICE_OR_INT("autosync", autosync, 0, 0, 10000,
                       ({"no", -1})),
 
@@ -611,6 +677,8 @@ const m_option_t mp_opts[] = {
     OPT_STRING("osd-playing-msg", osd_playing_msg, 0),
     OPT_STRING("term-status-msg", status_msg, 0),
     OPT_STRING("osd-status-msg", osd_status_msg, 0),
+    OPT_DOUBLE("status-update-interval", status_update_interval, M_OPT_MIN,
+               .min = 0),
     OPT_STRING("osd-msg1", osd_msg[0], 0),
     OPT_STRING("osd-msg2", osd_msg[1], 0),
     OPT_STRING("osd-msg3", osd_msg[2], 0),
@@ -630,6 +698,7 @@ const m_option_t mp_opts[] = {
     OPT_SUBSTRUCT("screenshot", screenshot_image_opts, image_writer_conf, 0),
     OPT_STRING("screenshot-template", screenshot_template, 0),
     OPT_STRING("screenshot-directory", screenshot_directory, 0),
+    OPT_INTRANGE("screenshot-queue", screenshot_queue, 0, 0, 32),
 
     OPT_SUBSTRUCT("input", input_opts, input_config, 0),
 
@@ -651,7 +720,6 @@ const m_option_t mp_opts[] = {
     OPT_REMOVED("ass-bottom-margin", "use --vf=sub=bottom:top"),
     OPT_REPLACED("ass", "sub-ass"),
     OPT_REPLACED("audiofile", "audio-file"),
-    OPT_REMOVED("benchmark", "use --untimed (no stats)"),
     OPT_REMOVED("capture", "use --stream-capture=<filename>"),
     OPT_REMOVED("channels", "use --audio-channels (changed semantics)"),
     OPT_REPLACED("cursor-autohide-delay", "cursor-autohide"),
@@ -733,12 +801,14 @@ const struct MPOpts mp_default_opts = {
     .audio_decoders = "-spdif:*", // never select spdif by default
     .video_decoders = NULL,
     .deinterlace = -1,
+    .benchmark_stage = MP_BENCHMARK_PRESENT,
     .softvol = SOFTVOL_AUTO,
     .softvol_max = 130,
     .softvol_volume = 100,
     .softvol_mute = 0,
     .gapless_audio = -1,
     .audio_buffer = 0.2,
+    .audio_parallel_threshold = 6 * 48000,
     .audio_device = "auto",
     .audio_client_name = "mpv",
     .allow_win_drag = 1,
@@ -788,17 +858,22 @@ const struct MPOpts mp_default_opts = {
         .initial = 0,
         .seek_min = 500,
         .back_buffer = 75000,
+        .connections = 1,
         .file_max = 1024 * 1024,
+        .file_total_max = 10 * 1024 * 1024,
+        .shared_max = 128 * 1024,
     },
     .demuxer_max_packs = 16000,
     .demuxer_max_bytes = 400 * 1024 * 1024,
     .demuxer_thread = 1,
     .demuxer_min_secs = 1.0,
+    .directory_scan_threads = 1,
     .network_rtsp_transport = 2,
     .network_timeout = 0.0,
     .hls_bitrate = INT_MAX,
     .demuxer_min_secs_cache = 10.0,
     .cache_pausing = 1,
+    .cache_pause_horizon = 60,
     .chapterrange = {-1, -1},
     .ab_loop = {MP_NOPTS_VALUE, MP_NOPTS_VALUE},
     .edition_id = -1,
@@ -808,6 +883,7 @@ const struct MPOpts mp_default_opts = {
     .frame_dropping = 1,
     .term_osd = 2,
     .term_osd_bar_chars = "[-+-]",
+    .status_update_interval = 0.050,
     .consolecontrols = 1,
     .playlist_pos = -1,
     .play_frames = -1,
@@ -847,9 +923,12 @@ const struct MPOpts mp_default_opts = {
     .use_embedded_fonts = 1,
     .sub_fix_timing = 1,
     .sub_cp = "auto",
+    .sub_cp_probe_size = 256 * 1024,
     .screenshot_template = "mpv-shot%n",
+    .screenshot_queue = 4,
 
     .hwdec_codecs = "h264,vc1,wmv3,hevc,mpeg2video,vp9",
+    .hwdec_surface_cache = 128,
     .videotoolbox_format = IMGFMT_NV12,
 
     .index_mode = 1,
@@ -51,6 +51,10 @@ typedef struct mp_vo_opts {
     struct sws_opts *sws_opts;
     // vo_opengl, vo_opengl_cb
     int hwdec_preload_api;
+
+    int queue_frames;
+    int render_ahead;
+    int wait_spin;
 } mp_vo_opts;
 
 struct mp_cache_opts {
@@ -59,14 +63,21 @@ struct mp_cache_opts {
     int initial;
     int seek_min;
     int back_buffer;
+    int connections;
+    int sparse_size;
+    int adaptive_max;
     char *file;
     int file_max;
+    int file_total_max;
+    int shared;
+    int shared_max;
 };
 
 typedef struct MPOpts {
     int property_print_help;
     int use_terminal;
     char *dump_stats;
+    int dump_stats_format;
     int verbose;
     char **msg_levels;
     int msg_color;
@@ -83,6 +94,8 @@ typedef struct MPOpts {
     char **lua_ytdl_raw_options;
 
     int auto_load_scripts;
+    int script_threads;
+    int script_init_concurrent;
 
     struct m_obj_settings *audio_driver_list, *ao_defs;
     char *audio_device;
@@ -91,6 +104,7 @@ typedef struct MPOpts {
     int audio_stream_silence;
     float audio_wait_open;
     int force_vo;
+    int vo_preinit;
     int softvol;
     float softvol_volume;
     float balance;
@@ -98,6 +112,8 @@ typedef struct MPOpts {
     float softvol_max;
     int gapless_audio;
     double audio_buffer;
+    int audio_parallel_threshold;
+    double audio_seek_cache;
 
     mp_vo_opts *vo;
     int allow_win_drag;
@@ -123,6 +139,12 @@ typedef struct MPOpts {
 
     char *audio_decoders;
     char *video_decoders;
+    int vd_queue_frames;
+    int vd_auto_degrade;
+    int ad_queue_frames;
+    int video_pool_frames;
+    int vf_pipeline;
+    char **video_mirrors;
     char *audio_spdif;
 
     int osd_level;
@@ -131,7 +153,11 @@ typedef struct MPOpts {
     int video_osd;
 
     int untimed;
+    char *benchmark;
+    int benchmark_stage;
     char *stream_capture;
+    int stream_mmap;
+    int stream_readahead_depth;
     char *stream_dump;
     int stop_playback_on_init_failure;
     int loop_times;
@@ -144,12 +170,13 @@ typedef struct MPOpts {
     char *chapter_file;
     int load_unsafe_playlists;
     int merge_files;
+    int prefetch_playlist;
     int quiet;
     int load_config;
     char *force_configdir;
     int use_filedir_conf;
     int network_rtsp_transport;
-    int hls_bitrate;
+    int hls_bitrate;            // bits/s, -1 = no, or HLS_BITRATE_AUTO
     struct mp_cache_opts stream_cache;
     int chapterrange[2];
     int edition_id;
@@ -162,6 +189,7 @@ typedef struct MPOpts {
     int hr_seek;
     float hr_seek_demuxer_offset;
     int hr_seek_framedrop;
+    int hr_seek_preview;
     float audio_delay;
     float default_max_pts_correction;
     int autosync;
@@ -174,6 +202,7 @@ typedef struct MPOpts {
     char *osd_playing_msg;
     char *status_msg;
     char *osd_status_msg;
+    double status_update_interval;
     char *osd_msg[3];
     char *heartbeat_cmd;
     float heartbeat_interval;
@@ -211,11 +240,21 @@ typedef struct MPOpts {
 
     int sub_fix_timing;
     char *sub_cp;
+    int sub_cp_probe_size;
 
     char **audio_files;
     char *demuxer_name;
     int demuxer_max_packs;
     int demuxer_max_bytes;
+    int demuxer_max_back_bytes;
+    int demuxer_max_bytes_video;
+    int demuxer_max_bytes_audio;
+    int demuxer_max_bytes_sub;
+    int memory_budget;
+    int demuxer_prefill_tracks;
+    int demuxer_fast_probe;
+    double demuxer_timeline_prefetch;
+    int directory_scan_threads;
     int demuxer_thread;
     double demuxer_min_secs;
     char *audio_demuxer_name;
@@ -224,10 +263,14 @@ typedef struct MPOpts {
 
     double demuxer_min_secs_cache;
     int cache_pausing;
+    int cache_pause_mode;
+    double cache_pause_horizon;
+    double latency_target;
 
     struct image_writer_opts *screenshot_image_opts;
     char *screenshot_template;
     char *screenshot_directory;
+    int screenshot_queue;
 
     double force_fps;
     int index_mode;
@@ -281,12 +324,17 @@ typedef struct MPOpts {
     int ass_hinting;
     int ass_shaper;
     int sub_clear_on_seek;
+    int sub_index_external;
+    int sub_ass_render_ahead;
 
     int hwdec_api;
     char *hwdec_codecs;
+    int hwdec_surface_cache;
     int videotoolbox_format;
 
     int w32_priority;
+    char **thread_realtime;
+    char **thread_affinity;
 
     int network_cookies_enabled;
     char *network_cookies_file;
@@ -315,6 +363,7 @@ typedef struct MPOpts {
 
     double mf_fps;
     char *mf_type;
+    int mf_prefetch;
 
     struct demux_rawaudio_opts *demux_rawaudio;
     struct demux_rawvideo_opts *demux_rawvideo;
@@ -333,6 +382,8 @@ typedef struct MPOpts {
     char *input_file;
 } MPOpts;
 
+#define HLS_BITRATE_AUTO -2
+
 extern const m_option_t mp_opts[];
 extern const struct MPOpts mp_default_opts;
 
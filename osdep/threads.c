@@ -16,18 +16,64 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <pthread.h>
+#include <unistd.h>
+#include <time.h>
 
 #include "config.h"
 
+#if !HAVE_WIN32_INTERNAL_PTHREADS
+#include <sched.h>
+#endif
+
 #if HAVE_BSD_THREAD_NAME
 #include <pthread_np.h>
 #endif
 
+#if HAVE_OSX_THREAD_NAME
+#include <pthread/qos.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "common/common.h"
 #include "threads.h"
 #include "timer.h"
 
+#if defined(_POSIX_THREAD_CPUTIME) && _POSIX_THREAD_CPUTIME >= 0
+#define HAVE_THREAD_CPUTIME 1
+#else
+#define HAVE_THREAD_CPUTIME 0
+#endif
+
+#define MAX_POLICY_ENTRIES 16
+#define MAX_THREAD_ENTRIES 64
+
+struct affinity_entry {
+    char name[32];
+    unsigned long long mask;
+};
+
+struct thread_entry {
+    struct mpthread_stats stats;
+#if HAVE_THREAD_CPUTIME
+    clockid_t clock;
+#endif
+};
+
+static pthread_mutex_t policy_lock = PTHREAD_MUTEX_INITIALIZER;
+static char policy_realtime[MAX_POLICY_ENTRIES][32];
+static int num_policy_realtime;
+static struct affinity_entry policy_affinity[MAX_POLICY_ENTRIES];
+static int num_policy_affinity;
+static struct thread_entry threads[MAX_THREAD_ENTRIES];
+static int num_threads;
+
 int mpthread_mutex_init_recursive(pthread_mutex_t *mutex)
 {
     pthread_mutexattr_t attr;
@@ -38,6 +84,149 @@ int mpthread_mutex_init_recursive(pthread_mutex_t *mutex)
     return r;
 }
 
+#ifdef _WIN32
+static pthread_once_t avrt_load_once = PTHREAD_ONCE_INIT;
+static HANDLE (WINAPI *pAvSetMmThreadCharacteristicsW)(LPCWSTR, LPDWORD);
+
+// MMCSS; avrt.dll is not available on all Windows versions. It's loaded once
+// and never unloaded, since it must stay loaded while threads use MMCSS.
+static void avrt_load(void)
+{
+    HMODULE avrt = LoadLibraryW(L"avrt.dll");
+    if (avrt) {
+        pAvSetMmThreadCharacteristicsW =
+            (void *)GetProcAddress(avrt, "AvSetMmThreadCharacteristicsW");
+    }
+}
+#endif
+
+static bool set_realtime(const char *name)
+{
+#if HAVE_OSX_THREAD_NAME
+    return pthread_set_qos_class_self_np(QOS_CLASS_USER_INTERACTIVE, 0) == 0;
+#elif defined(_WIN32)
+    pthread_once(&avrt_load_once, avrt_load);
+    DWORD task_index = 0;
+    const wchar_t *task = strcmp(name, "ao") == 0 ? L"Pro Audio" : L"Playback";
+    return pAvSetMmThreadCharacteristicsW &&
+           pAvSetMmThreadCharacteristicsW(task, &task_index);
+#else
+    return mpthread_set_realtime();
+#endif
+}
+
+static bool set_affinity(unsigned long long mask)
+{
+#if HAVE_PTHREAD_SETAFFINITY
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int n = 0; n < 64 && n < CPU_SETSIZE; n++) {
+        if (mask & (1ULL << n))
+            CPU_SET(n, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)mask) != 0;
+#else
+    return false;
+#endif
+}
+
+// Apply the configured policy to the calling thread, and register it.
+static void apply_policy(const char *name)
+{
+    pthread_mutex_lock(&policy_lock);
+
+    struct mpthread_stats st = {0};
+    snprintf(st.name, sizeof(st.name), "%s", name);
+
+    for (int n = 0; n < num_policy_realtime; n++) {
+        if (strcmp(policy_realtime[n], st.name) == 0)
+            st.realtime = set_realtime(st.name);
+    }
+    for (int n = 0; n < num_policy_affinity; n++) {
+        if (strcmp(policy_affinity[n].name, st.name) == 0)
+            st.affinity = set_affinity(policy_affinity[n].mask);
+    }
+
+    struct thread_entry *e = NULL;
+    for (int n = 0; n < num_threads; n++) {
+        if (strcmp(threads[n].stats.name, st.name) == 0)
+            e = &threads[n];
+    }
+    if (!e && num_threads < MAX_THREAD_ENTRIES)
+        e = &threads[num_threads++];
+    if (e) {
+        e->stats = st;
+#if HAVE_THREAD_CPUTIME
+        if (pthread_getcpuclockid(pthread_self(), &e->clock))
+            e->clock = (clockid_t)-1;
+#endif
+    }
+
+    pthread_mutex_unlock(&policy_lock);
+}
+
+void mpthread_set_policy(char **realtime, char **affinity)
+{
+    pthread_mutex_lock(&policy_lock);
+
+    num_policy_realtime = 0;
+    for (int n = 0; realtime && realtime[n]; n++) {
+        if (num_policy_realtime >= MAX_POLICY_ENTRIES)
+            break;
+        snprintf(policy_realtime[num_policy_realtime++], 32, "%s", realtime[n]);
+    }
+
+    num_policy_affinity = 0;
+    for (int n = 0; affinity && affinity[n] && affinity[n + 1]; n += 2) {
+        if (num_policy_affinity >= MAX_POLICY_ENTRIES)
+            break;
+        struct affinity_entry *e = &policy_affinity[num_policy_affinity++];
+        snprintf(e->name, sizeof(e->name), "%s", affinity[n]);
+        e->mask = strtoull(affinity[n + 1], NULL, 0);
+    }
+
+    pthread_mutex_unlock(&policy_lock);
+}
+
+int mpthread_get_stats(struct mpthread_stats *stats, int max)
+{
+    int num = 0;
+    pthread_mutex_lock(&policy_lock);
+    for (int n = 0; n < num_threads && num < max; n++) {
+        struct mpthread_stats st = threads[n].stats;
+#if HAVE_THREAD_CPUTIME
+        struct timespec ts;
+        // Fails if the thread has exited in the meantime.
+        if (threads[n].clock == (clockid_t)-1 ||
+            clock_gettime(threads[n].clock, &ts))
+            continue;
+        st.cpu_time = ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+        stats[num++] = st;
+    }
+    pthread_mutex_unlock(&policy_lock);
+    return num;
+}
+
+int64_t mpthread_get_cpu_time_us(void)
+{
+#if HAVE_THREAD_CPUTIME
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+        return ts.tv_sec * (int64_t)1000000 + ts.tv_nsec / 1000;
+#elif defined(_WIN32)
+    FILETIME create, exit, kernel, user;
+    if (GetThreadTimes(GetCurrentThread(), &create, &exit, &kernel, &user)) {
+        uint64_t k = ((uint64_t)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+        uint64_t u = ((uint64_t)user.dwHighDateTime << 32) | user.dwLowDateTime;
+        return (k + u) / 10; // 100ns units
+    }
+#endif
+    return -1;
+}
+
 void mpthread_set_name(const char *name)
 {
     char tname[80];
@@ -53,5 +242,21 @@ void mpthread_set_name(const char *name)
     pthread_setname_np(pthread_self(), "%s", (void *)tname);
 #elif HAVE_OSX_THREAD_NAME
     pthread_setname_np(tname);
+#endif
+    apply_policy(name);
+}
+
+// Returns false if the OS does not support it, or if the process lacks the
+// permission (e.g. RLIMIT_RTPRIO on Linux).
+bool mpthread_set_realtime(void)
+{
+#if !HAVE_WIN32_INTERNAL_PTHREADS && defined(SCHED_FIFO)
+    int prio = sched_get_priority_min(SCHED_FIFO);
+    if (prio < 0)
+        return false;
+    struct sched_param param = { .sched_priority = prio };
+    return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+#else
+    return false;
 #endif
 }
@@ -3,11 +3,40 @@
 
 #include <pthread.h>
 #include <inttypes.h>
+#include <stdbool.h>
 
 // Helper to reduce boiler plate.
 int mpthread_mutex_init_recursive(pthread_mutex_t *mutex);
 
-// Set thread name (for debuggers).
+// Set thread name (for debuggers). This also applies the scheduling policy
+// configured with mpthread_set_policy() for this name, and registers the
+// thread for mpthread_get_stats().
 void mpthread_set_name(const char *name);
 
+// Try to switch the calling thread to realtime scheduling.
+bool mpthread_set_realtime(void);
+
+// Configure the policy for threads started after this call, by thread name
+// (as passed to mpthread_set_name()). Both are NULL terminated lists.
+//  realtime: names of threads which should get realtime priority
+//  affinity: pairs of name and CPU bit mask (as string, e.g. "0x3")
+// This is process-global state.
+void mpthread_set_policy(char **realtime, char **affinity);
+
+struct mpthread_stats {
+    char name[32];
+    double cpu_time;        // in seconds
+    bool realtime;          // realtime priority was successfully set
+    bool affinity;          // CPU affinity was successfully set
+};
+
+// Fill at most max entries with the stats of named threads which are still
+// running. If several threads share a name, only the one started last is
+// listed. Returns the number of entries written.
+int mpthread_get_stats(struct mpthread_stats *stats, int max);
+
+// CPU time used by the calling thread, in microseconds. Returns -1 if this is
+// not supported on the platform.
+int64_t mpthread_get_cpu_time_us(void);
+
 #endif
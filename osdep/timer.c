@@ -54,6 +54,11 @@ int64_t mp_time_us(void)
     return r;
 }
 
+int64_t mp_time_us_from_raw(uint64_t raw)
+{
+    return (int64_t)(raw - raw_time_offset);
+}
+
 double mp_time_sec(void)
 {
     return mp_time_us() / (double)(1000 * 1000);
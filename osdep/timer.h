@@ -30,6 +30,11 @@ int64_t mp_time_us(void);
 // be much worse when casted to float.
 double mp_time_sec(void);
 
+// Convert a timestamp in the mp_raw_time_us() time base (e.g. as returned by
+// the OS for presentation events) to mp_time_us(). The result can be 0 or
+// negative for timestamps that are older than the timer initialization.
+int64_t mp_time_us_from_raw(uint64_t raw);
+
 // Provided by OS specific functions (timer-linux.c)
 void mp_raw_time_init(void);
 uint64_t mp_raw_time_us(void);
@@ -20,6 +20,7 @@
 #include <inttypes.h>
 #include <limits.h>
 #include <math.h>
+#include <string.h>
 #include <assert.h>
 
 #include "config.h"
@@ -51,6 +52,10 @@ enum {
     AD_NO_PROGRESS = -5,
 };
 
+// Maximum difference between pts values computed at different times (e.g.
+// due to changing filter delay) that still counts as contiguous audio.
+#define SEEK_CACHE_TOLERANCE 0.05
+
 // Use pitch correction only for speed adjustments by the user, not minor sync
 // correction ones.
 static int get_speed_method(struct MPContext *mpctx)
@@ -59,6 +64,44 @@ static int get_speed_method(struct MPContext *mpctx)
         ? AF_CONTROL_SET_PLAYBACK_SPEED : AF_CONTROL_SET_PLAYBACK_SPEED_RESAMPLE;
 }
 
+// Return a filter that converts the sample rate anyway (so that it can apply a
+// small speed correction at no extra cost), or NULL.
+static struct af_instance *find_rate_converter(struct af_stream *afs)
+{
+    for (struct af_instance *af = afs->first; af; af = af->next) {
+        if (strcmp(af->info->name, "lavrresample") == 0 &&
+            af->fmt_in.rate != af->fmt_out.rate)
+            return af;
+    }
+    return NULL;
+}
+
+// Set speed on the pitch correcting filter. speed includes the display sync
+// correction factor, which changes the tempo filter's parameters on every video
+// frame. If a resampler converts the sample rate anyway, let it apply the
+// correction instead. (With --af=scaletempo at normal speed, this also keeps
+// scaletempo in passthrough mode.)
+static bool set_tempo_speed(struct MPContext *mpctx, double speed)
+{
+    struct af_stream *afs = mpctx->ao_chain->af;
+    double factor = mpctx->speed_factor_a;
+
+    struct af_instance *resampler = NULL;
+    if (factor != 1.0)
+        resampler = find_rate_converter(afs);
+    if (resampler) {
+        double tempo = speed / factor;
+        if (af_control_any_rev(afs, AF_CONTROL_SET_PLAYBACK_SPEED, &tempo)) {
+            if (resampler->control(resampler, AF_CONTROL_SET_PLAYBACK_SPEED_RESAMPLE,
+                                   &factor) == AF_OK)
+                return true;
+            af_control_all(afs, AF_CONTROL_SET_PLAYBACK_SPEED, &(double){1});
+        }
+    }
+
+    return !!af_control_any_rev(afs, AF_CONTROL_SET_PLAYBACK_SPEED, &speed);
+}
+
 // Try to reuse the existing filters to change playback speed. If it works,
 // return true; if filter recreation is needed, return false.
 static bool update_speed_filters(struct MPContext *mpctx)
@@ -79,11 +122,14 @@ static bool update_speed_filters(struct MPContext *mpctx)
 
     // Compatibility: if the user uses --af=scaletempo, always use this
     // filter to change speed. Don't insert a second filter (any) either.
-    if (!af_find_by_label(afs, "playback-speed") &&
-        af_control_any_rev(afs, AF_CONTROL_SET_PLAYBACK_SPEED, &speed))
+    if (!af_find_by_label(afs, "playback-speed") && set_tempo_speed(mpctx, speed))
         return true;
 
-    return !!af_control_any_rev(afs, get_speed_method(mpctx), &speed);
+    if (get_speed_method(mpctx) == AF_CONTROL_SET_PLAYBACK_SPEED)
+        return set_tempo_speed(mpctx, speed);
+
+    return !!af_control_any_rev(afs, AF_CONTROL_SET_PLAYBACK_SPEED_RESAMPLE,
+                                &speed);
 }
 
 // Update speed, and insert/remove filters if necessary.
@@ -237,8 +283,9 @@ int reinit_audio_filters(struct MPContext *mpctx)
 // Call this if opts->playback_speed or mpctx->speed_factor_* change.
 void update_playback_speed(struct MPContext *mpctx)
 {
-    mpctx->audio_speed = mpctx->opts->playback_speed * mpctx->speed_factor_a;
-    mpctx->video_speed = mpctx->opts->playback_speed * mpctx->speed_factor_v;
+    double speed = mpctx->opts->playback_speed * mpctx->latency_speed;
+    mpctx->audio_speed = speed * mpctx->speed_factor_a;
+    mpctx->video_speed = speed * mpctx->speed_factor_v;
 
     if (!mpctx->ao_chain || mpctx->ao_chain->af->initialized < 1)
         return;
@@ -247,6 +294,13 @@ void update_playback_speed(struct MPContext *mpctx)
         recreate_audio_filters(mpctx);
 }
 
+static void clear_seek_cache(struct ao_chain *ao_c)
+{
+    for (int n = 0; n < ao_c->num_seek_cache; n++)
+        talloc_free(ao_c->seek_cache[n]);
+    ao_c->num_seek_cache = 0;
+}
+
 static void ao_chain_reset_state(struct ao_chain *ao_c)
 {
     ao_c->pts = MP_NOPTS_VALUE;
@@ -255,6 +309,7 @@ static void ao_chain_reset_state(struct ao_chain *ao_c)
     ao_c->input_frame = NULL;
     af_seek_reset(ao_c->af);
     mp_audio_buffer_clear(ao_c->ao_buffer);
+    clear_seek_cache(ao_c);
 
     if (ao_c->audio_src)
         audio_reset_decoding(ao_c->audio_src);
@@ -301,6 +356,7 @@ static void ao_chain_uninit(struct ao_chain *ao_c)
         lavfi_set_connected(ao_c->filter_src, false);
 
     af_destroy(ao_c->af);
+    clear_seek_cache(ao_c);
     talloc_free(ao_c->input_frame);
     talloc_free(ao_c->ao_buffer);
     talloc_free(ao_c);
@@ -330,6 +386,7 @@ static void reinit_audio_filters_and_output(struct MPContext *mpctx)
         mp_audio_copy_config(&ao_c->input_format, ao_c->input_frame);
 
     struct mp_audio in_format = ao_c->input_format;
+    struct ao *old_ao = NULL;
 
     if (!mp_audio_config_valid(&in_format)) {
         // We don't know the audio format yet - so configure it later as we're
@@ -342,7 +399,18 @@ static void reinit_audio_filters_and_output(struct MPContext *mpctx)
     if (mpctx->ao_decoder_fmt && mpctx->ao && opts->gapless_audio < 0 &&
         !mp_audio_config_equals(mpctx->ao_decoder_fmt, &in_format))
     {
-        uninit_audio_out(mpctx);
+        if (af_fmt_is_pcm(mpctx->ao_decoder_fmt->format) &&
+            af_fmt_is_pcm(in_format.format))
+        {
+            // Try to switch the format of the AO below, instead of reopening.
+            ao_drain(mpctx->ao);
+            old_ao = mpctx->ao;
+            mpctx->ao = ao_c->ao = NULL;
+            talloc_free(mpctx->ao_decoder_fmt);
+            mpctx->ao_decoder_fmt = NULL;
+        } else {
+            uninit_audio_out(mpctx);
+        }
     }
 
     if (mpctx->ao && mp_audio_config_equals(&in_format, &afs->input))
@@ -394,9 +462,24 @@ static void reinit_audio_filters_and_output(struct MPContext *mpctx)
 
         mp_audio_set_channels(&afs->output, &afs->output.channels);
 
-        mpctx->ao = ao_init_best(mpctx->global, ao_flags, mpctx->input,
-                                 mpctx->encode_lavc_ctx, afs->output.rate,
-                                 afs->output.format, afs->output.channels);
+        if (old_ao) {
+            if (ao_reconfigure(old_ao, afs->output.rate, afs->output.format,
+                               afs->output.channels))
+            {
+                mpctx->ao = old_ao;
+            } else {
+                MP_VERBOSE(mpctx, "Reopening AO for format change.\n");
+                ao_uninit(old_ao);
+            }
+            old_ao = NULL;
+        }
+
+        if (!mpctx->ao) {
+            mpctx->ao = ao_init_best(mpctx->global, ao_flags, mpctx->input,
+                                     mpctx->encode_lavc_ctx, afs->output.rate,
+                                     afs->output.format, afs->output.channels);
+            mp_startup_trace(mpctx, "AO init");
+        }
         ao_c->ao = mpctx->ao;
 
         struct mp_audio fmt = {0};
@@ -460,6 +543,8 @@ static void reinit_audio_filters_and_output(struct MPContext *mpctx)
     return;
 
 init_error:
+    if (old_ao)
+        ao_uninit(old_ao);
     uninit_audio_chain(mpctx);
     uninit_audio_out(mpctx);
     error_on_track(mpctx, track);
@@ -484,6 +569,9 @@ int init_audio_decoder(struct MPContext *mpctx, struct track *track)
     if (!audio_init_best_codec(d_audio))
         goto init_error;
 
+    audio_start_thread(d_audio, d_audio->opts->ad_queue_frames,
+                       wakeup_playloop, mpctx);
+
     return 1;
 
 init_error:
@@ -726,6 +814,103 @@ static bool get_sync_samples(struct MPContext *mpctx, int *skip)
 }
 
 
+// Keep a frame that was just appended to the ao_buffer for audio_seek_cached().
+// Takes ownership of mpa.
+static void cache_audio_frame(struct MPContext *mpctx, struct mp_audio *mpa)
+{
+    struct ao_chain *ao_c = mpctx->ao_chain;
+    double max = mpctx->opts->audio_seek_cache;
+    double end = written_audio_pts(mpctx);
+
+    if (max <= 0 || end == MP_NOPTS_VALUE || mpa->samples < 1) {
+        clear_seek_cache(ao_c);
+        talloc_free(mpa);
+        return;
+    }
+
+    double len = mpa->samples / (double)mpa->rate * mpctx->audio_speed;
+    mpa->pts = end - len;
+
+    // Only contiguous audio of the same format can be replayed.
+    if (ao_c->num_seek_cache) {
+        struct mp_audio *last = ao_c->seek_cache[ao_c->num_seek_cache - 1];
+        if (!mp_audio_config_equals(last, mpa) ||
+            ao_c->seek_cache_speed != mpctx->audio_speed ||
+            fabs(mpa->pts - ao_c->seek_cache_end) > SEEK_CACHE_TOLERANCE)
+        {
+            clear_seek_cache(ao_c);
+        } else {
+            // written_audio_pts() only serves as sanity check: it jitters
+            // with the estimated filter delay. The audio is contiguous, so
+            // the frame starts exactly where the previous one ended.
+            mpa->pts = ao_c->seek_cache_end;
+        }
+    }
+
+    MP_TARRAY_APPEND(ao_c, ao_c->seek_cache, ao_c->num_seek_cache, mpa);
+    ao_c->seek_cache_end = mpa->pts + len;
+    ao_c->seek_cache_speed = mpctx->audio_speed;
+
+    while (ao_c->num_seek_cache > 1 &&
+           ao_c->seek_cache_end - ao_c->seek_cache[1]->pts > max)
+    {
+        talloc_free(ao_c->seek_cache[0]);
+        MP_TARRAY_REMOVE_AT(ao_c->seek_cache, ao_c->num_seek_cache, 0);
+    }
+}
+
+// Serve a seek to pts from the audio kept by cache_audio_frame(): the cached
+// audio following pts is put back into the ao_buffer, which is followed by
+// exactly the data the decoder and filters would output next anyway, so they
+// don't need to be reset. The caller must flush the AO. Returns false if the
+// cache doesn't cover pts, and nothing was changed.
+bool audio_seek_cached(struct MPContext *mpctx, double pts)
+{
+    struct ao_chain *ao_c = mpctx->ao_chain;
+    if (!ao_c || !ao_c->num_seek_cache || !ao_c->audio_src || !mpctx->ao ||
+        pts == MP_NOPTS_VALUE || ao_c->seek_cache_speed != mpctx->audio_speed)
+        return false;
+
+    // The cache must still end where the ao_buffer ends.
+    double end = written_audio_pts(mpctx);
+    if (end == MP_NOPTS_VALUE ||
+        fabs(end - ao_c->seek_cache_end) > SEEK_CACHE_TOLERANCE)
+        return false;
+
+    struct mp_audio fmt;
+    mp_audio_buffer_get_format(ao_c->ao_buffer, &fmt);
+    if (!mp_audio_config_equals(&fmt, ao_c->seek_cache[0]))
+        return false;
+
+    if (pts < ao_c->seek_cache[0]->pts || pts >= ao_c->seek_cache_end)
+        return false;
+
+    int first = ao_c->num_seek_cache - 1;
+    while (first > 0 && ao_c->seek_cache[first]->pts > pts)
+        first--;
+
+    mp_audio_buffer_clear(ao_c->ao_buffer);
+    for (int n = first; n < ao_c->num_seek_cache; n++) {
+        struct mp_audio mpa = *ao_c->seek_cache[n];
+        if (n == first) {
+            int align = af_format_sample_alignment(mpa.format);
+            int skip = (pts - mpa.pts) / mpctx->audio_speed * mpa.rate;
+            skip = MPCLAMP(skip / align * align, 0, mpa.samples);
+            mp_audio_skip_samples(&mpa, skip);
+        }
+        mp_audio_buffer_append(ao_c->ao_buffer, &mpa);
+    }
+
+    MP_VERBOSE(mpctx, "Seeking to %f from audio seek cache.\n", pts);
+
+    mpctx->audio_status = STATUS_FILLING;
+    mpctx->delay = 0;
+    mpctx->audio_drop_throttle = 0;
+    mpctx->audio_stat_start = 0;
+    mpctx->audio_allow_second_chance_seek = false;
+    return true;
+}
+
 static bool copy_output(struct MPContext *mpctx, struct mp_audio_buffer *outbuf,
                         int minsamples, double endpts, bool eof, bool *seteof)
 {
@@ -761,7 +946,7 @@ static bool copy_output(struct MPContext *mpctx, struct mp_audio_buffer *outbuf,
         }
 
         mp_audio_buffer_append(outbuf, mpa);
-        talloc_free(mpa);
+        cache_audio_frame(mpctx, mpa);
     }
     return true;
 }
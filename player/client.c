@@ -29,11 +29,13 @@
 #include "input/cmd_list.h"
 #include "misc/ctype.h"
 #include "misc/dispatch.h"
+#include "misc/node.h"
 #include "options/m_config.h"
 #include "options/m_option.h"
 #include "options/m_property.h"
 #include "options/path.h"
 #include "options/parse_configfile.h"
+#include "osdep/atomics.h"
 #include "osdep/threads.h"
 #include "osdep/timer.h"
 #include "osdep/io.h"
@@ -57,6 +59,32 @@
  *
  */
 
+// Frequently read properties, whose values are published by the playloop while
+// it sleeps, so that mpv_get_property() can return them without waiting for
+// the core (see mp_client_publish_properties()).
+static const char *const published_props[] = {
+    "time-pos",
+    "playback-time",
+    "percent-pos",
+    "time-remaining",
+    "duration",
+    "pause",
+    "core-idle",
+    "idle-active",
+    "eof-reached",
+    "seeking",
+    "paused-for-cache",
+    "cache-buffering-state",
+};
+
+#define NUM_PUBLISHED_PROPS MP_ARRAY_SIZE(published_props)
+
+struct published_prop {
+    bool valid;             // value was published (scalar property)
+    int status;             // as in getproperty_request.status
+    struct mpv_node value;  // valid if status >= 0, never allocated
+};
+
 struct mp_client_api {
     struct MPContext *mpctx;
 
@@ -70,6 +98,25 @@ struct mp_client_api {
 
     struct mp_custom_protocol *custom_protocols;
     int num_custom_protocols;
+
+    // -- protected by the core lock
+    // Values read for property observers since the last time anything could
+    // have changed them (see mp_client_invalidate_property_snapshots()).
+    struct prop_snapshot *snapshots;
+    int num_snapshots;
+
+    // Written by the core thread only; readers need published_lock.
+    // (published_lock is always the innermost lock.)
+    pthread_mutex_t published_lock;
+    bool published_valid;
+    struct published_prop published[NUM_PUBLISHED_PROPS];
+};
+
+struct prop_snapshot {
+    char *name;
+    mpv_format format;
+    int status;                 // as in getproperty_request.status
+    union m_option_value value; // valid if status >= 0
 };
 
 struct observe_property {
@@ -110,27 +157,43 @@ struct mpv_handle {
     void *wakeup_cb_ctx;
     int wakeup_pipe[2];
 
+    // -- event ringbuffer
+    // Entries are written by the core (serialized by event_lock, which the
+    // client never takes), and read by mpv_wait_event(). Sending an event
+    // thus never waits for the client.
+    pthread_mutex_t event_lock;
+    mpv_event *events;      // ringbuffer of max_events entries
+    int max_events;         // allocated number of entries in events
+    int first_event;        // events[first_event] is the first readable event
+                            // (accessed by the reader only)
+    int next_event;         // next entry to write (accessed by writers only)
+    atomic_int num_events;  // number of readable events
+    atomic_int used_events; // readable entries + entries reserved for replies
+    atomic_bool choked;     // recovering from queue overflow
+    atomic_bool tick_queued; // a MPV_EVENT_TICK is in the ringbuffer
+    // Event masks, written with lock held, read by the core without lock.
+    atomic_ullong event_mask;
+    atomic_ullong property_event_masks; // or-ed together event masks of all
+                                        // properties
+    // Events which affect property_event_masks, but weren't applied to the
+    // observed properties yet (done by mpv_wait_event()).
+    atomic_ullong pending_property_events;
+
     // -- protected by lock
 
-    uint64_t event_mask;
     bool queued_wakeup;
     int suspend_count;
 
-    mpv_event *events;      // ringbuffer of max_events entries
-    int max_events;         // allocated number of entries in events
-    int first_event;        // events[first_event] is the first readable event
-    int num_events;         // number of readable events
     int reserved_events;    // number of entries reserved for replies
-    bool choked;            // recovering from queue overflow
 
     struct observe_property **properties;
     int num_properties;
     int lowest_changed;     // attempt at making change processing incremental
     int properties_updating;
-    uint64_t property_event_masks; // or-ed together event masks of all properties
 
     bool fuzzy_initialized; // see scripting.c wait_loaded()
     struct mp_log_buffer *messages;
+    char **log_prefixes;    // see mpv_set_log_message_filter()
 };
 
 static bool gen_log_message_event(struct mpv_handle *ctx);
@@ -145,6 +208,7 @@ void mp_clients_init(struct MPContext *mpctx)
     };
     mpctx->global->client_api = mpctx->clients;
     pthread_mutex_init(&mpctx->clients->lock, NULL);
+    pthread_mutex_init(&mpctx->clients->published_lock, NULL);
 }
 
 void mp_clients_destroy(struct MPContext *mpctx)
@@ -152,6 +216,8 @@ void mp_clients_destroy(struct MPContext *mpctx)
     if (!mpctx->clients)
         return;
     assert(mpctx->clients->num_clients == 0);
+    mp_client_invalidate_property_snapshots(mpctx);
+    pthread_mutex_destroy(&mpctx->clients->published_lock);
     pthread_mutex_destroy(&mpctx->clients->lock);
     talloc_free(mpctx->clients);
     mpctx->clients = NULL;
@@ -237,10 +303,12 @@ struct mpv_handle *mp_new_client(struct mp_client_api *clients, const char *name
         .cur_event = talloc_zero(client, struct mpv_event),
         .events = talloc_array(client, mpv_event, num_events),
         .max_events = num_events,
-        .event_mask = (1ULL << INTERNAL_EVENT_BASE) - 1, // exclude internal events
+        // exclude internal events
+        .event_mask = ATOMIC_VAR_INIT((1ULL << INTERNAL_EVENT_BASE) - 1),
         .wakeup_pipe = {-1, -1},
     };
     pthread_mutex_init(&client->lock, NULL);
+    pthread_mutex_init(&client->event_lock, NULL);
     pthread_mutex_init(&client->wakeup_lock, NULL);
     pthread_cond_init(&client->wakeup, NULL);
 
@@ -365,6 +433,9 @@ void mp_resume_all(mpv_handle *ctx)
 static void lock_core(mpv_handle *ctx)
 {
     mp_dispatch_lock(ctx->mpctx->dispatch);
+    // The caller might change anything.
+    mp_client_invalidate_property_snapshots(ctx->mpctx);
+    mp_client_unpublish_properties(ctx->mpctx);
 }
 
 static void unlock_core(mpv_handle *ctx)
@@ -398,14 +469,15 @@ void mpv_detach_destroy(mpv_handle *ctx)
     for (int n = 0; n < clients->num_clients; n++) {
         if (clients->clients[n] == ctx) {
             MP_TARRAY_REMOVE_AT(clients->clients, clients->num_clients, n);
-            while (ctx->num_events) {
+            int num_events = atomic_load(&ctx->num_events);
+            for (int i = 0; i < num_events; i++) {
                 talloc_free(ctx->events[ctx->first_event].data);
                 ctx->first_event = (ctx->first_event + 1) % ctx->max_events;
-                ctx->num_events--;
             }
             mp_msg_log_buffer_destroy(ctx->messages);
             pthread_cond_destroy(&ctx->wakeup);
             pthread_mutex_destroy(&ctx->wakeup_lock);
+            pthread_mutex_destroy(&ctx->event_lock);
             pthread_mutex_destroy(&ctx->lock);
             if (ctx->wakeup_pipe[0] != -1) {
                 close(ctx->wakeup_pipe[0]);
@@ -563,6 +635,17 @@ static void dup_event_data(struct mpv_event *ev)
     }
 }
 
+// Claim a free entry in the ring buffer. Returns false if it's full.
+static bool claim_event(struct mpv_handle *ctx)
+{
+    int used = atomic_load(&ctx->used_events);
+    while (used < ctx->max_events) {
+        if (atomic_compare_exchange_strong(&ctx->used_events, &used, used + 1))
+            return true;
+    }
+    return false;
+}
+
 // Reserve an entry in the ring buffer. This can be used to guarantee that the
 // reply can be made, even if the buffer becomes congested _after_ sending
 // the request.
@@ -571,8 +654,7 @@ static int reserve_reply(struct mpv_handle *ctx)
 {
     int res = MPV_ERROR_EVENT_QUEUE_FULL;
     pthread_mutex_lock(&ctx->lock);
-    if (ctx->reserved_events + ctx->num_events < ctx->max_events && !ctx->choked)
-    {
+    if (!atomic_load(&ctx->choked) && claim_event(ctx)) {
         ctx->reserved_events++;
         res = 0;
     }
@@ -580,38 +662,46 @@ static int reserve_reply(struct mpv_handle *ctx)
     return res;
 }
 
-static int append_event(struct mpv_handle *ctx, struct mpv_event event, bool copy)
+// Write an event into an entry claimed with claim_event().
+static void append_event(struct mpv_handle *ctx, struct mpv_event event,
+                         bool copy)
 {
-    if (ctx->num_events + ctx->reserved_events >= ctx->max_events)
-        return -1;
     if (copy)
         dup_event_data(&event);
-    ctx->events[(ctx->first_event + ctx->num_events) % ctx->max_events] = event;
-    ctx->num_events++;
+    pthread_mutex_lock(&ctx->event_lock);
+    ctx->events[ctx->next_event] = event;
+    ctx->next_event = (ctx->next_event + 1) % ctx->max_events;
+    atomic_fetch_add(&ctx->num_events, 1);
+    pthread_mutex_unlock(&ctx->event_lock);
     wakeup_client(ctx);
-    return 0;
 }
 
 static int send_event(struct mpv_handle *ctx, struct mpv_event *event, bool copy)
 {
-    pthread_mutex_lock(&ctx->lock);
     uint64_t mask = 1ULL << event->event_id;
-    if (ctx->property_event_masks & mask)
-        notify_property_events(ctx, mask);
-    int r;
-    if (!(ctx->event_mask & mask)) {
-        r = 0;
-    } else if (ctx->choked) {
-        r = -1;
-    } else {
-        r = append_event(ctx, *event, copy);
-        if (r < 0) {
-            MP_ERR(ctx, "Too many events queued.\n");
-            ctx->choked = true;
-        }
+    if (atomic_load(&ctx->property_event_masks) & mask) {
+        // If the bit was already set, the client was woken up for it, and
+        // hasn't processed it yet.
+        if (!(atomic_fetch_or(&ctx->pending_property_events, mask) & mask))
+            wakeup_client(ctx);
     }
-    pthread_mutex_unlock(&ctx->lock);
-    return r;
+    if (!(atomic_load(&ctx->event_mask) & mask))
+        return 0;
+    // Ticks carry no data; one unread tick is as good as many.
+    bool tick = event->event_id == MPV_EVENT_TICK;
+    if (tick && atomic_load(&ctx->tick_queued))
+        return 0;
+    if (atomic_load(&ctx->choked))
+        return -1;
+    if (!claim_event(ctx)) {
+        MP_ERR(ctx, "Too many events queued.\n");
+        atomic_store(&ctx->choked, true);
+        return -1;
+    }
+    if (tick)
+        atomic_store(&ctx->tick_queued, true);
+    append_event(ctx, *event, copy);
+    return 0;
 }
 
 // Send a reply; the reply must have been previously reserved with
@@ -620,12 +710,13 @@ static void send_reply(struct mpv_handle *ctx, uint64_t userdata,
                        struct mpv_event *event)
 {
     event->reply_userdata = userdata;
+    // Holding the lock makes sure mpv_wait_async_requests() sees the update
+    // of reserved_events only after the reply was appended.
     pthread_mutex_lock(&ctx->lock);
     // If this fails, reserve_reply() probably wasn't called.
     assert(ctx->reserved_events > 0);
     ctx->reserved_events--;
-    if (append_event(ctx, *event, false) < 0)
-        abort(); // not reached
+    append_event(ctx, *event, false);
     pthread_mutex_unlock(&ctx->lock);
 }
 
@@ -650,9 +741,8 @@ bool mp_client_event_is_registered(struct MPContext *mpctx, int event)
     if (!clients->event_masks) { // lazy update
         for (int n = 0; n < clients->num_clients; n++) {
             struct mpv_handle *ctx = clients->clients[n];
-            pthread_mutex_lock(&ctx->lock);
-            clients->event_masks |= ctx->event_mask | ctx->property_event_masks;
-            pthread_mutex_unlock(&ctx->lock);
+            clients->event_masks |= atomic_load(&ctx->event_mask) |
+                                    atomic_load(&ctx->property_event_masks);
         }
     }
     bool r = clients->event_masks & (1ULL << event);
@@ -738,7 +828,8 @@ int mpv_request_event(mpv_handle *ctx, mpv_event_id event, int enable)
     assert(event < (int)INTERNAL_EVENT_BASE); // excluded above; they have no name
     pthread_mutex_lock(&ctx->lock);
     uint64_t bit = 1ULL << event;
-    ctx->event_mask = enable ? ctx->event_mask | bit : ctx->event_mask & ~bit;
+    uint64_t mask = atomic_load(&ctx->event_mask);
+    atomic_store(&ctx->event_mask, enable ? mask | bit : mask & ~bit);
     pthread_mutex_unlock(&ctx->lock);
     invalidate_global_event_mask(ctx);
     return 0;
@@ -766,8 +857,8 @@ mpv_event *mpv_wait_event(mpv_handle *ctx, double timeout)
         if (ctx->queued_wakeup)
             deadline = 0;
         // Recover from overflow.
-        if (ctx->choked && !ctx->num_events) {
-            ctx->choked = false;
+        if (atomic_load(&ctx->choked) && !atomic_load(&ctx->num_events)) {
+            atomic_store(&ctx->choked, false);
             event->event_id = MPV_EVENT_QUEUE_OVERFLOW;
             break;
         }
@@ -776,13 +867,19 @@ mpv_event *mpv_wait_event(mpv_handle *ctx, double timeout)
             MP_ERR(ctx, "attempting to wait while core is suspended");
             break;
         }
-        if (ctx->num_events) {
+        if (atomic_load(&ctx->num_events)) {
             *event = ctx->events[ctx->first_event];
             ctx->first_event = (ctx->first_event + 1) % ctx->max_events;
-            ctx->num_events--;
+            atomic_fetch_add(&ctx->num_events, -1);
+            atomic_fetch_add(&ctx->used_events, -1);
+            if (event->event_id == MPV_EVENT_TICK)
+                atomic_store(&ctx->tick_queued, false);
             talloc_steal(event, event->data);
             break;
         }
+        uint64_t pending = atomic_fetch_and(&ctx->pending_property_events, 0);
+        if (pending)
+            notify_property_events(ctx, pending);
         // If there's a changed property, generate change event (never queued).
         if (gen_property_change_event(ctx))
             break;
@@ -978,6 +1075,8 @@ struct cmd_request {
 static void cmd_fn(void *data)
 {
     struct cmd_request *req = data;
+    mp_client_invalidate_property_snapshots(req->mpctx);
+    mp_client_unpublish_properties(req->mpctx);
     int r = run_command(req->mpctx, req->cmd, req->res);
     req->status = r >= 0 ? 0 : MPV_ERROR_COMMAND;
     talloc_free(req->cmd);
@@ -1082,6 +1181,9 @@ static void setproperty_fn(void *arg)
     struct setproperty_request *req = arg;
     const struct m_option *type = get_mp_type(req->format);
 
+    mp_client_invalidate_property_snapshots(req->mpctx);
+    mp_client_unpublish_properties(req->mpctx);
+
     struct mpv_node *node;
     struct mpv_node tmp;
     if (req->format == MPV_FORMAT_NODE) {
@@ -1243,6 +1345,104 @@ static void getproperty_fn(void *arg)
     }
 }
 
+// Publish the values of published_props[]. Called by the playloop right before
+// it waits for events; the values stay valid until it wakes up again, or until
+// something might have changed them (see mp_client_unpublish_properties()).
+void mp_client_publish_properties(struct MPContext *mpctx)
+{
+    struct mp_client_api *clients = mpctx->clients;
+    struct published_prop values[NUM_PUBLISHED_PROPS];
+
+    // Nobody could read them.
+    pthread_mutex_lock(&clients->lock);
+    bool have_clients = clients->num_clients > 0;
+    pthread_mutex_unlock(&clients->lock);
+    if (!have_clients)
+        return;
+
+    for (int n = 0; n < NUM_PUBLISHED_PROPS; n++) {
+        struct published_prop *prop = &values[n];
+        *prop = (struct published_prop){0};
+        int err = mp_property_do(published_props[n], M_PROPERTY_GET_NODE,
+                                 &prop->value, mpctx);
+        if (err == M_PROPERTY_NOT_IMPLEMENTED)
+            continue;
+        prop->status = translate_property_error(err);
+        if (prop->status < 0) {
+            prop->valid = true;
+            continue;
+        }
+        switch (prop->value.format) {
+        case MPV_FORMAT_NONE:
+        case MPV_FORMAT_FLAG:
+        case MPV_FORMAT_INT64:
+        case MPV_FORMAT_DOUBLE:
+            prop->valid = true;
+            break;
+        default:
+            // Not a scalar; would need copying on every read.
+            mpv_free_node_contents(&prop->value);
+        }
+    }
+
+    pthread_mutex_lock(&clients->published_lock);
+    memcpy(clients->published, values, sizeof(values));
+    clients->published_valid = true;
+    pthread_mutex_unlock(&clients->published_lock);
+}
+
+// Make mpv_get_property() go through the core again for the published
+// properties, until the next mp_client_publish_properties() call. Must be
+// called with the core locked (or on the playloop thread) whenever something
+// outside of the playloop might change the player state.
+void mp_client_unpublish_properties(struct MPContext *mpctx)
+{
+    struct mp_client_api *clients = mpctx->clients;
+    pthread_mutex_lock(&clients->published_lock);
+    clients->published_valid = false;
+    pthread_mutex_unlock(&clients->published_lock);
+}
+
+// Try to read a property from the published values. Returns false if the
+// property has to be read from the core.
+static bool get_published_property(struct mp_client_api *clients,
+                                   struct getproperty_request *req)
+{
+    if (req->format != MPV_FORMAT_NODE && req->format != MPV_FORMAT_FLAG &&
+        req->format != MPV_FORMAT_INT64 && req->format != MPV_FORMAT_DOUBLE)
+        return false;
+
+    int index = -1;
+    for (int n = 0; n < NUM_PUBLISHED_PROPS; n++) {
+        if (strcmp(published_props[n], req->name) == 0) {
+            index = n;
+            break;
+        }
+    }
+    if (index < 0)
+        return false;
+
+    bool ok = false;
+    pthread_mutex_lock(&clients->published_lock);
+    struct published_prop *prop = &clients->published[index];
+    if (clients->published_valid && prop->valid) {
+        ok = true;
+        req->status = prop->status;
+        if (prop->status >= 0) {
+            if (req->format == MPV_FORMAT_NODE) {
+                *(struct mpv_node *)req->data = prop->value;
+            } else if (!conv_node_to_format(req->data, req->format,
+                                            &prop->value))
+            {
+                req->status =
+                    translate_property_error(M_PROPERTY_INVALID_FORMAT);
+            }
+        }
+    }
+    pthread_mutex_unlock(&clients->published_lock);
+    return ok;
+}
+
 int mpv_get_property(mpv_handle *ctx, const char *name, mpv_format format,
                      void *data)
 {
@@ -1257,10 +1457,78 @@ int mpv_get_property(mpv_handle *ctx, const char *name, mpv_format format,
         .format = format,
         .data = data,
     };
-    run_locked(ctx, getproperty_fn, &req);
+    if (!get_published_property(ctx->clients, &req))
+        run_locked(ctx, getproperty_fn, &req);
     return req.status;
 }
 
+struct getproperties_request {
+    struct MPContext *mpctx;
+    const char **names;
+    int num_names;
+    mpv_node *data;
+};
+
+// Make the node's allocations children of ta_parent (m_option_type_node rules).
+static void steal_node(void *ta_parent, struct mpv_node *node)
+{
+    switch (node->format) {
+    case MPV_FORMAT_STRING:
+        talloc_steal(ta_parent, node->u.string);
+        break;
+    case MPV_FORMAT_NODE_ARRAY:
+    case MPV_FORMAT_NODE_MAP:
+        talloc_steal(ta_parent, node->u.list);
+        break;
+    case MPV_FORMAT_BYTE_ARRAY:
+        talloc_steal(ta_parent, node->u.ba);
+        break;
+    }
+}
+
+static void getproperties_fn(void *arg)
+{
+    struct getproperties_request *req = arg;
+
+    node_init(req->data, MPV_FORMAT_NODE_MAP, NULL);
+    for (int n = 0; n < req->num_names; n++) {
+        struct mpv_node node = {0};
+        struct getproperty_request preq = {
+            .mpctx = req->mpctx,
+            .name = req->names[n],
+            .format = MPV_FORMAT_NODE,
+            .data = &node,
+        };
+        getproperty_fn(&preq);
+        struct mpv_node *entry =
+            node_map_add(req->data, req->names[n], MPV_FORMAT_NONE);
+        if (preq.status >= 0) {
+            *entry = node;
+            steal_node(req->data->u.list, entry);
+        }
+    }
+}
+
+int mpv_get_properties(mpv_handle *ctx, const char **names, int num_names,
+                       mpv_node *data)
+{
+    if (!data || num_names < 0 || (num_names && !names))
+        return MPV_ERROR_INVALID_PARAMETER;
+    for (int n = 0; n < num_names; n++) {
+        if (!names[n])
+            return MPV_ERROR_INVALID_PARAMETER;
+    }
+
+    struct getproperties_request req = {
+        .mpctx = ctx->mpctx,
+        .names = names,
+        .num_names = num_names,
+        .data = data,
+    };
+    run_locked(ctx, getproperties_fn, &req);
+    return 0;
+}
+
 char *mpv_get_property_string(mpv_handle *ctx, const char *name)
 {
     char *str = NULL;
@@ -1325,7 +1593,7 @@ int mpv_observe_property(mpv_handle *ctx, uint64_t userdata,
         .need_new_value = true,
     };
     MP_TARRAY_APPEND(ctx, ctx->properties, ctx->num_properties, prop);
-    ctx->property_event_masks |= prop->event_mask;
+    atomic_fetch_or(&ctx->property_event_masks, prop->event_mask);
     ctx->lowest_changed = 0;
     pthread_mutex_unlock(&ctx->lock);
     invalidate_global_event_mask(ctx);
@@ -1335,7 +1603,7 @@ int mpv_observe_property(mpv_handle *ctx, uint64_t userdata,
 int mpv_unobserve_property(mpv_handle *ctx, uint64_t userdata)
 {
     pthread_mutex_lock(&ctx->lock);
-    ctx->property_event_masks = 0;
+    uint64_t property_event_masks = 0;
     int count = 0;
     for (int n = ctx->num_properties - 1; n >= 0; n--) {
         struct observe_property *prop = ctx->properties[n];
@@ -1353,8 +1621,9 @@ int mpv_unobserve_property(mpv_handle *ctx, uint64_t userdata)
             count++;
         }
         if (!prop->dead)
-            ctx->property_event_masks |= prop->event_mask;
+            property_event_masks |= prop->event_mask;
     }
+    atomic_store(&ctx->property_event_masks, property_event_masks);
     ctx->lowest_changed = 0;
     pthread_mutex_unlock(&ctx->lock);
     invalidate_global_event_mask(ctx);
@@ -1406,6 +1675,50 @@ static void notify_property_events(struct mpv_handle *ctx, uint64_t event_mask)
         wakeup_client(ctx);
 }
 
+// Drop the values cached for update_prop(). Must be called with the core
+// locked (or on the playloop thread) whenever properties might have changed.
+void mp_client_invalidate_property_snapshots(struct MPContext *mpctx)
+{
+    struct mp_client_api *clients = mpctx->clients;
+    for (int n = 0; n < clients->num_snapshots; n++) {
+        struct prop_snapshot *snap = &clients->snapshots[n];
+        if (snap->status >= 0)
+            m_option_free(get_mp_type_get(snap->format), &snap->value);
+        talloc_free(snap->name);
+    }
+    clients->num_snapshots = 0;
+}
+
+// Read the property value for an observer. If another observer read the same
+// property (with the same format) before, reuse its value, instead of calling
+// into the property implementation again for each client.
+static void read_observed_prop(struct mp_client_api *clients,
+                               struct getproperty_request *req)
+{
+    const struct m_option *type = get_mp_type_get(req->format);
+
+    for (int n = 0; n < clients->num_snapshots; n++) {
+        struct prop_snapshot *snap = &clients->snapshots[n];
+        if (snap->format == req->format && strcmp(snap->name, req->name) == 0) {
+            req->status = snap->status;
+            if (snap->status >= 0)
+                m_option_copy(type, req->data, &snap->value);
+            return;
+        }
+    }
+
+    getproperty_fn(req);
+
+    struct prop_snapshot snap = {
+        .name = talloc_strdup(clients, req->name),
+        .format = req->format,
+        .status = req->status,
+    };
+    if (snap.status >= 0)
+        m_option_copy(type, &snap.value, req->data);
+    MP_TARRAY_APPEND(clients, clients->snapshots, clients->num_snapshots, snap);
+}
+
 static void update_prop(void *p)
 {
     struct observe_property *prop = p;
@@ -1421,7 +1734,7 @@ static void update_prop(void *p)
         .data = &val,
     };
 
-    getproperty_fn(&req);
+    read_observed_prop(ctx->clients, &req);
 
     pthread_mutex_lock(&ctx->lock);
     ctx->properties_updating--;
@@ -1524,11 +1837,35 @@ int mpv_request_log_messages(mpv_handle *ctx, const char *min_level)
         int size = level >= MSGL_V ? 10000 : 1000;
         ctx->messages = mp_msg_log_buffer_new(ctx->mpctx->global, size, level,
                                               msg_wakeup, ctx);
+        if (ctx->messages && ctx->log_prefixes)
+            mp_msg_log_buffer_set_prefixes(ctx->messages, ctx->log_prefixes);
     }
     pthread_mutex_unlock(&ctx->lock);
     return 0;
 }
 
+int mpv_set_log_message_filter(mpv_handle *ctx, const char **prefixes)
+{
+    pthread_mutex_lock(&ctx->lock);
+    talloc_free(ctx->log_prefixes);
+    ctx->log_prefixes = NULL;
+    int num = 0;
+    while (prefixes && prefixes[num])
+        num++;
+    if (num) {
+        ctx->log_prefixes = talloc_array(ctx, char *, num + 1);
+        for (int n = 0; n < num; n++) {
+            ctx->log_prefixes[n] =
+                talloc_strdup(ctx->log_prefixes, prefixes[n]);
+        }
+        ctx->log_prefixes[num] = NULL;
+    }
+    if (ctx->messages)
+        mp_msg_log_buffer_set_prefixes(ctx->messages, ctx->log_prefixes);
+    pthread_mutex_unlock(&ctx->lock);
+    return 0;
+}
+
 // Set ctx->cur_event to a generated log message event, if any available.
 static bool gen_log_message_event(struct mpv_handle *ctx)
 {
@@ -1652,7 +1989,7 @@ int64_t mpv_get_time_us(mpv_handle *ctx)
     return mp_time_us();
 }
 
-// Used by vo_opengl_cb to synchronously uninitialize video.
+// Used by vo_opengl_cb and vo_sw_cb to synchronously uninitialize video.
 void kill_video(struct mp_client_api *client_api)
 {
     struct MPContext *mpctx = client_api->mpctx;
@@ -1709,6 +2046,16 @@ int mpv_opengl_cb_render(mpv_opengl_cb_context *ctx, int fbo, int vp[4])
     return mpv_opengl_cb_draw(ctx, fbo, vp[2], vp[3]);
 }
 
+static struct mpv_sw_cb_context *sw_cb_get_context(mpv_handle *ctx)
+{
+    struct mpv_sw_cb_context *cb = ctx->mpctx->sw_cb_ctx;
+    if (!cb) {
+        cb = mp_sw_cb_create(ctx->mpctx->global, ctx->clients);
+        ctx->mpctx->sw_cb_ctx = cb;
+    }
+    return cb;
+}
+
 void *mpv_get_sub_api(mpv_handle *ctx, mpv_sub_api sub_api)
 {
     void *res = NULL;
@@ -1717,6 +2064,9 @@ void *mpv_get_sub_api(mpv_handle *ctx, mpv_sub_api sub_api)
     case MPV_SUB_API_OPENGL_CB:
         res = opengl_cb_get_context(ctx);
         break;
+    case MPV_SUB_API_SW_CB:
+        res = sw_cb_get_context(ctx);
+        break;
     default:;
     }
     unlock_core(ctx);
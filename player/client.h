@@ -28,6 +28,9 @@ int mp_client_send_event_dup(struct MPContext *mpctx, const char *client_name,
                              int event, void *data);
 bool mp_client_event_is_registered(struct MPContext *mpctx, int event);
 void mp_client_property_change(struct MPContext *mpctx, const char *name);
+void mp_client_invalidate_property_snapshots(struct MPContext *mpctx);
+void mp_client_publish_properties(struct MPContext *mpctx);
+void mp_client_unpublish_properties(struct MPContext *mpctx);
 
 struct mpv_handle *mp_new_client(struct mp_client_api *clients, const char *name);
 struct mp_log *mp_client_get_log(struct mpv_handle *ctx);
@@ -47,6 +50,11 @@ struct mpv_opengl_cb_context *mp_opengl_create(struct mpv_global *g,
                                                struct mp_client_api *client_api);
 void kill_video(struct mp_client_api *client_api);
 
+// vo_sw_cb.c
+struct mpv_sw_cb_context;
+struct mpv_sw_cb_context *mp_sw_cb_create(struct mpv_global *g,
+                                          struct mp_client_api *client_api);
+
 bool mp_streamcb_lookup(struct mpv_global *g, const char *protocol,
                         void **out_user_data, mpv_stream_cb_open_ro_fn *out_fn);
 
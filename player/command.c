@@ -39,6 +39,8 @@
 #include "command.h"
 #include "osdep/timer.h"
 #include "common/common.h"
+#include "common/global.h"
+#include "common/memgov.h"
 #include "input/input.h"
 #include "input/keycodes.h"
 #include "stream/stream.h"
@@ -51,6 +53,7 @@
 #include "options/m_property.h"
 #include "options/m_config.h"
 #include "video/filter/vf.h"
+#include "video/mp_image_pool.h"
 #include "video/decode/vd.h"
 #include "video/out/vo.h"
 #include "video/csputils.h"
@@ -62,15 +65,17 @@
 #include "video/out/bitmap_packer.h"
 #include "options/path.h"
 #include "screenshot.h"
+#include "thumbnail.h"
 
 #include "osdep/io.h"
 #include "osdep/subprocess.h"
+#include "osdep/threads.h"
 
 #include "core.h"
 
 struct command_ctx {
-    // All properties, terminated with a {0} item.
-    struct m_property *properties;
+    // All properties, sorted by name.
+    struct m_property_list properties;
 
     bool is_idle;
 
@@ -108,9 +113,14 @@ struct hook_handler {
     char *client;   // client API user name
     char *type;     // kind of hook, e.g. "on_load"
     char *user_id;  // numeric user-chosen ID, printed as string
+    char *run_id;   // identifies the handler in hook-ack
     int priority;   // priority for global hook order
     int64_t seq;    // unique ID (also age -> fixed order for equal priorities)
-    bool active;    // hook is currently in progress (only 1 at a time for now)
+    bool parallel;  // can run at the same time as adjacent parallel handlers
+    double timeout; // in seconds, 0 if none
+    bool pending;   // not run yet in the current hook chain
+    bool active;    // hook is currently in progress
+    double start;   // mp_time_sec() when it was run
 };
 
 // U+279C HEAVY ROUND-TIPPED RIGHTWARDS ARROW
@@ -134,22 +144,6 @@ static void hook_remove(struct MPContext *mpctx, int index)
     MP_TARRAY_REMOVE_AT(cmd->hooks, cmd->num_hooks, index);
 }
 
-bool mp_hook_test_completion(struct MPContext *mpctx, char *type)
-{
-    struct command_ctx *cmd = mpctx->command_ctx;
-    for (int n = 0; n < cmd->num_hooks; n++) {
-        struct hook_handler *h = cmd->hooks[n];
-        if (h->active && strcmp(h->type, type) == 0) {
-            if (!mp_client_exists(mpctx, h->client)) {
-                hook_remove(mpctx, n);
-                break;
-            }
-            return false;
-        }
-    }
-    return true;
-}
-
 static bool send_hook_msg(struct MPContext *mpctx, struct hook_handler *h,
                           char *cmd)
 {
@@ -157,7 +151,7 @@ static bool send_hook_msg(struct MPContext *mpctx, struct hook_handler *h,
     *m = (mpv_event_client_message){0};
     MP_TARRAY_APPEND(m, m->args, m->num_args, cmd);
     MP_TARRAY_APPEND(m, m->args, m->num_args, talloc_strdup(m, h->user_id));
-    MP_TARRAY_APPEND(m, m->args, m->num_args, talloc_strdup(m, h->type));
+    MP_TARRAY_APPEND(m, m->args, m->num_args, talloc_strdup(m, h->run_id));
     bool r =
         mp_client_send_event(mpctx, h->client, MPV_EVENT_CLIENT_MESSAGE, m) >= 0;
     if (!r)
@@ -165,33 +159,121 @@ static bool send_hook_msg(struct MPContext *mpctx, struct hook_handler *h,
     return r;
 }
 
-// client==NULL means start the hook chain
-void mp_hook_run(struct MPContext *mpctx, char *client, char *type)
+static void hook_finish(struct MPContext *mpctx, struct hook_handler *h,
+                        const char *reason)
+{
+    h->active = false;
+    MP_VERBOSE(mpctx, "Hook %s/%s %s after %.3f seconds.\n", h->client,
+               h->type, reason, mp_time_sec() - h->start);
+}
+
+// If no handler of the given type is active, run the next pending one. If it
+// is a parallel handler, all following parallel handlers are run with it.
+static void hook_continue(struct MPContext *mpctx, char *type)
 {
     struct command_ctx *cmd = mpctx->command_ctx;
-    bool found_current = !client;
-    int index = -1;
     for (int n = 0; n < cmd->num_hooks; n++) {
         struct hook_handler *h = cmd->hooks[n];
-        if (!found_current) {
-            if (h->active && strcmp(h->type, type) == 0) {
-                h->active = false;
-                found_current = true;
-            }
-        } else if (strcmp(h->type, type) == 0) {
-            index = n;
+        if (h->active && strcmp(h->type, type) == 0)
+            return;
+    }
+    bool started = false;
+    for (int n = 0; n < cmd->num_hooks; n++) {
+        struct hook_handler *h = cmd->hooks[n];
+        if (!h->pending || strcmp(h->type, type) != 0)
+            continue;
+        if (started && !h->parallel)
             break;
+        h->pending = false;
+        if (!send_hook_msg(mpctx, h, "hook_run")) {
+            hook_remove(mpctx, n);
+            n--;
+            continue;
         }
+        MP_VERBOSE(mpctx, "Running hook: %s/%s\n", h->client, type);
+        h->active = true;
+        h->start = mp_time_sec();
+        started = true;
+        if (!h->parallel)
+            break;
     }
-    if (index < 0)
-        return;
-    struct hook_handler *next = cmd->hooks[index];
-    MP_VERBOSE(mpctx, "Running hook: %s/%s\n", next->client, type);
-    next->active = true;
-    if (!send_hook_msg(mpctx, next, "hook_run")) {
-        hook_remove(mpctx, index);
-        mp_input_wakeup(mpctx->input); // repeat next iteration to finish
+}
+
+bool mp_hook_test_completion(struct MPContext *mpctx, char *type)
+{
+    struct command_ctx *cmd = mpctx->command_ctx;
+    double now = mp_time_sec();
+    bool changed = false;
+    for (int n = 0; n < cmd->num_hooks; n++) {
+        struct hook_handler *h = cmd->hooks[n];
+        if (!h->active || strcmp(h->type, type) != 0)
+            continue;
+        if (!mp_client_exists(mpctx, h->client)) {
+            hook_remove(mpctx, n);
+            n--;
+            changed = true;
+        } else if (h->timeout > 0 && now - h->start >= h->timeout) {
+            MP_WARN(mpctx, "Hook %s/%s timed out.\n", h->client, type);
+            hook_finish(mpctx, h, "timed out");
+            changed = true;
+        }
+    }
+    if (changed)
+        hook_continue(mpctx, type);
+
+    bool done = true;
+    for (int n = 0; n < cmd->num_hooks; n++) {
+        struct hook_handler *h = cmd->hooks[n];
+        if (strcmp(h->type, type) != 0)
+            continue;
+        if (h->active && h->timeout > 0) {
+            double left = h->start + h->timeout - now;
+            mpctx->sleeptime = MPMIN(mpctx->sleeptime, MPMAX(left, 0));
+        }
+        if (h->active || h->pending)
+            done = false;
     }
+    return done;
+}
+
+// Start the hook chain for the given type.
+void mp_hook_start(struct MPContext *mpctx, char *type)
+{
+    struct command_ctx *cmd = mpctx->command_ctx;
+    for (int n = 0; n < cmd->num_hooks; n++) {
+        struct hook_handler *h = cmd->hooks[n];
+        if (strcmp(h->type, type) == 0)
+            h->pending = true;
+    }
+    hook_continue(mpctx, type);
+}
+
+// Whether any client registered a handler for the given hook type.
+bool mp_hook_has_handlers(struct MPContext *mpctx, char *type)
+{
+    struct command_ctx *cmd = mpctx->command_ctx;
+    for (int n = 0; n < cmd->num_hooks; n++) {
+        if (strcmp(cmd->hooks[n]->type, type) == 0)
+            return true;
+    }
+    return false;
+}
+
+static void hook_ack(struct MPContext *mpctx, char *client, char *run_id)
+{
+    struct command_ctx *cmd = mpctx->command_ctx;
+    for (int n = 0; n < cmd->num_hooks; n++) {
+        struct hook_handler *h = cmd->hooks[n];
+        if (h->active && strcmp(h->client, client) == 0 &&
+            strcmp(h->run_id, run_id) == 0)
+        {
+            hook_finish(mpctx, h, "done");
+            hook_continue(mpctx, h->type);
+            return;
+        }
+    }
+    // Late replies to hooks which timed out end up here.
+    MP_VERBOSE(mpctx, "Ignoring hook-ack from %s.\n", client);
 }
 
 static int compare_hook(const void *pa, const void *pb)
@@ -204,7 +286,7 @@ static int compare_hook(const void *pa, const void *pb)
 }
 
 static void mp_hook_add(struct MPContext *mpctx, char *client, char *name,
-                        int id, int pri)
+                        int id, int pri, bool parallel, double timeout)
 {
     struct command_ctx *cmd = mpctx->command_ctx;
     struct hook_handler *h = talloc_ptrtype(cmd, h);
@@ -213,8 +295,11 @@ static void mp_hook_add(struct MPContext *mpctx, char *client, char *name,
         .client = talloc_strdup(h, client),
         .type = talloc_strdup(h, name),
         .user_id = talloc_asprintf(h, "%d", id),
+        .run_id = talloc_asprintf(h, "%s/%"PRId64, name, seq),
         .priority = pri,
         .seq = seq,
+        .parallel = parallel,
+        .timeout = MPMAX(timeout, 0),
     };
     MP_TARRAY_APPEND(cmd, cmd->hooks, cmd->num_hooks, h);
     qsort(cmd->hooks, cmd->num_hooks, sizeof(cmd->hooks[0]), compare_hook);
@@ -604,7 +689,8 @@ static int mp_property_drop_frame_cnt(void *ctx, struct m_property *prop,
     if (!mpctx->vo_chain)
         return M_PROPERTY_UNAVAILABLE;
 
-    return m_property_int_ro(action, arg, mpctx->vo_chain->video_src->dropped_frames);
+    int dropped = video_get_dropped_frames(mpctx->vo_chain->video_src);
+    return m_property_int_ro(action, arg, dropped);
 }
 
 static int mp_property_mistimed_frame_count(void *ctx, struct m_property *prop,
@@ -1496,6 +1582,18 @@ static int mp_property_cache_idle(void *ctx, struct m_property *prop,
     return m_property_flag_ro(action, arg, info.idle);
 }
 
+static int mp_property_cache_reconnects(void *ctx, struct m_property *prop,
+                                        int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    struct stream_cache_info info = {0};
+    if (mpctx->demuxer)
+        demux_stream_control(mpctx->demuxer, STREAM_CTRL_GET_CACHE_INFO, &info);
+    if (info.size <= 0)
+        return M_PROPERTY_UNAVAILABLE;
+    return m_property_int64_ro(action, arg, info.reconnects);
+}
+
 static int mp_property_demuxer_cache_duration(void *ctx, struct m_property *prop,
                                               int action, void *arg)
 {
@@ -1531,6 +1629,17 @@ static int mp_property_demuxer_cache_time(void *ctx, struct m_property *prop,
     return m_property_double_ro(action, arg, ts);
 }
 
+static int mp_property_pipeline_latency(void *ctx, struct m_property *prop,
+                                        int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    double latency = get_pipeline_latency(mpctx);
+    if (latency == MP_NOPTS_VALUE)
+        return M_PROPERTY_UNAVAILABLE;
+
+    return m_property_double_ro(action, arg, latency);
+}
+
 static int mp_property_demuxer_cache_idle(void *ctx, struct m_property *prop,
                                           int action, void *arg)
 {
@@ -1545,6 +1654,128 @@ static int mp_property_demuxer_cache_idle(void *ctx, struct m_property *prop,
     return m_property_flag_ro(action, arg, s.idle);
 }
 
+static int mp_property_demuxer_packet_pool(void *ctx, struct m_property *prop,
+                                           int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    struct demux_packet_pool_stats st;
+    if (!mpctx->demuxer || !demux_get_packet_pool_stats(mpctx->demuxer, &st))
+        return M_PROPERTY_UNAVAILABLE;
+
+    struct m_sub_property props[] = {
+        {"requests",        SUB_PROP_INT64(st.requests)},
+        {"reused",          SUB_PROP_INT64(st.reused)},
+        {"allocated",       SUB_PROP_INT64(st.allocated)},
+        {"unpooled",        SUB_PROP_INT64(st.unpooled)},
+        {"retained-bytes",  SUB_PROP_INT64(st.retained_bytes)},
+        {"outstanding",     SUB_PROP_INT64(st.outstanding)},
+        {0}
+    };
+
+    return m_property_read_sub(props, action, arg);
+}
+
+static int mp_property_hls_variant(void *ctx, struct m_property *prop,
+                                   int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    struct hls_adapt *h = &mpctx->hls;
+    struct track *track = NULL;
+    for (int type = STREAM_VIDEO; type <= STREAM_AUDIO && !track; type++) {
+        struct track *t = mpctx->current_track[0][type];
+        if (t && t->stream && t->stream->hls_bitrate > 0)
+            track = t;
+    }
+    if (!track)
+        return M_PROPERTY_UNAVAILABLE;
+
+    char *log = talloc_strdup(NULL, "");
+    for (int n = 0; n < h->num_log; n++)
+        log = talloc_asprintf_append_buffer(log, "%s\n", h->log[n]);
+
+    struct m_sub_property props[] = {
+        {"bitrate",     SUB_PROP_INT(track->stream->hls_bitrate)},
+        {"throughput",  SUB_PROP_INT64(h->throughput),
+                        .unavailable = h->throughput <= 0},
+        {"switches",    SUB_PROP_INT(h->num_switches)},
+        {"log",         SUB_PROP_STR(log)},
+        {0}
+    };
+
+    int r = m_property_read_sub(props, action, arg);
+    talloc_free(log);
+    return r;
+}
+
+static int get_demuxer_stream_stats_entry(int item, int action, void *arg,
+                                          void *ctx)
+{
+    struct demuxer *demuxer = ctx;
+    struct sh_stream *sh = demux_get_stream(demuxer, item);
+    struct demux_stream_stats st;
+    demux_get_stream_stats(sh, &st);
+
+    struct m_sub_property props[] = {
+        {"type",            SUB_PROP_STR(stream_type_name(sh->type))},
+        {"src-id",          SUB_PROP_INT(sh->demuxer_id)},
+        {"selected",        SUB_PROP_FLAG(st.selected)},
+        {"queued-secs",     SUB_PROP_DOUBLE(st.queued_secs),
+                            .unavailable = st.queued_secs < 0},
+        {"queued-bytes",    SUB_PROP_INT64(st.queued_bytes)},
+        {"queued-packets",  SUB_PROP_INT64(st.queued_packets)},
+        {"packets-in",      SUB_PROP_INT64(st.packets_in)},
+        {"packets-out",     SUB_PROP_INT64(st.packets_out)},
+        {"packets-in-rate", SUB_PROP_DOUBLE(st.packets_in_rate),
+                            .unavailable = st.packets_in_rate < 0},
+        {"packets-out-rate", SUB_PROP_DOUBLE(st.packets_out_rate),
+                            .unavailable = st.packets_out_rate < 0},
+        {"blocked-secs",    SUB_PROP_DOUBLE(st.blocked_secs)},
+        {"underruns",       SUB_PROP_INT64(st.underruns)},
+        {0}
+    };
+
+    return m_property_read_sub(props, action, arg);
+}
+
+static int mp_property_demuxer_stream_stats(void *ctx, struct m_property *prop,
+                                            int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    struct demuxer *demuxer = mpctx->demuxer;
+    if (!demuxer)
+        return M_PROPERTY_UNAVAILABLE;
+    return m_property_read_list(action, arg, demux_get_num_stream(demuxer),
+                                get_demuxer_stream_stats_entry, demuxer);
+}
+
+static int get_memory_usage_entry(int item, int action, void *arg, void *ctx)
+{
+    struct mp_memgov_stats *st = ctx;
+    struct mp_memgov_entry *e = &st->entries[item];
+
+    struct m_sub_property props[] = {
+        {"name",    SUB_PROP_STR(e->name)},
+        {"bytes",   SUB_PROP_INT64(e->usage)},
+        {"limit",   SUB_PROP_INT64(e->limit), .unavailable = !st->budget},
+        {0}
+    };
+
+    return m_property_read_sub(props, action, arg);
+}
+
+static int mp_property_memory_usage(void *ctx, struct m_property *prop,
+                                    int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    void *tmp = talloc_new(NULL);
+    struct mp_memgov_stats st;
+    mp_memgov_get_stats(mpctx->global->memgov, tmp, &st);
+    int r = m_property_read_list(action, arg, st.num_entries,
+                                 get_memory_usage_entry, &st);
+    talloc_free(tmp);
+    return r;
+}
+
 static int mp_property_paused_for_cache(void *ctx, struct m_property *prop,
                                         int action, void *arg)
 {
@@ -1564,6 +1795,15 @@ static int mp_property_cache_buffering(void *ctx, struct m_property *prop,
     return m_property_int_ro(action, arg, state);
 }
 
+static int mp_property_cache_underrun_time(void *ctx, struct m_property *prop,
+                                           int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->demuxer || mpctx->cache_underrun_time == MP_NOPTS_VALUE)
+        return M_PROPERTY_UNAVAILABLE;
+    return m_property_double_ro(action, arg, mpctx->cache_underrun_time);
+}
+
 static int mp_property_clock(void *ctx, struct m_property *prop,
                              int action, void *arg)
 {
@@ -1785,6 +2025,38 @@ static int mp_property_ao(void *ctx, struct m_property *p, int action, void *arg
                                     mpctx->ao ? ao_get_name(mpctx->ao) : NULL);
 }
 
+static int mp_property_audio_out_stats(void *ctx, struct m_property *prop,
+                                       int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->ao)
+        return M_PROPERTY_UNAVAILABLE;
+
+    struct ao_stats st;
+    ao_get_stats(mpctx->ao, &st);
+    double underrun_age = st.last_underrun ? mp_time_sec() - st.last_underrun
+                                           : -1;
+    struct m_sub_property props[] = {
+        {"buffered",            SUB_PROP_DOUBLE(st.buffered)},
+        {"device-delay",        SUB_PROP_DOUBLE(st.device_delay)},
+        {"underruns",           SUB_PROP_INT64(st.underruns)},
+        {"last-underrun-age",   SUB_PROP_DOUBLE(underrun_age),
+                                .unavailable = underrun_age < 0},
+        {"callback-interval",   SUB_PROP_DOUBLE(st.callback_interval),
+                                .unavailable = st.callback_interval < 0},
+        {"callback-jitter",     SUB_PROP_DOUBLE(st.callback_jitter),
+                                .unavailable = st.callback_jitter < 0},
+        {"wakeup-latency",      SUB_PROP_DOUBLE(st.wakeup_latency),
+                                .unavailable = st.wakeup_latency < 0},
+        {"wakeup-latency-max",  SUB_PROP_DOUBLE(st.wakeup_latency_max),
+                                .unavailable = st.wakeup_latency_max < 0},
+        {"xruns",               SUB_PROP_INT64(st.xruns),
+                                .unavailable = st.xruns < 0},
+        {0}
+    };
+    return m_property_read_sub(props, action, arg);
+}
+
 static int mp_property_ao_detected_device(void *ctx,struct m_property *prop,
                                           int action, void *arg)
 {
@@ -2268,6 +2540,51 @@ static int mp_property_hwdec_current(void *ctx, struct m_property *prop,
     return M_PROPERTY_NOT_IMPLEMENTED;
 }
 
+static int mp_property_decoder_thread_type(void *ctx, struct m_property *prop,
+                                           int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    struct track *track = mpctx->current_track[0][STREAM_VIDEO];
+    struct dec_video *vd = track ? track->d_video : NULL;
+
+    const char *type = NULL;
+    if (vd)
+        video_vd_control(vd, VDCTRL_GET_THREAD_TYPE, &type);
+    if (!type)
+        return M_PROPERTY_UNAVAILABLE;
+
+    return m_property_strdup_ro(action, arg, type);
+}
+
+static int mp_property_video_pool_stats(void *ctx, struct m_property *prop,
+                                        int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    struct vo_chain *vo_c = mpctx->vo_chain;
+    if (!vo_c || !vo_c->vf)
+        return M_PROPERTY_UNAVAILABLE;
+
+    struct mp_image_pool_stats st;
+    vf_get_pool_stats(vo_c->vf, &st);
+
+    struct m_sub_property props[] = {
+        {"images",          SUB_PROP_INT(st.images)},
+        {"used",            SUB_PROP_INT(st.used)},
+        {"bytes",           SUB_PROP_INT64(st.bytes)},
+        {"max-images",      SUB_PROP_INT(st.max_images)},
+        {0}
+    };
+
+    return m_property_read_sub(props, action, arg);
+}
+
+static int mp_property_thumbnails_generated(void *ctx, struct m_property *prop,
+                                            int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    return m_property_int_ro(action, arg, thumbnail_get_num_generated(mpctx));
+}
+
 static int mp_property_hwdec_interop(void *ctx, struct m_property *prop,
                                      int action, void *arg)
 {
@@ -2698,6 +3015,91 @@ static int mp_property_vsync_jitter(void *ctx, struct m_property *prop,
     return m_property_double_ro(action, arg, stddev);
 }
 
+static int mp_property_vo_wait_stats(void *ctx, struct m_property *prop,
+                                     int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    struct vo *vo = mpctx->video_out;
+    if (!vo)
+        return M_PROPERTY_UNAVAILABLE;
+
+    struct vo_wait_stats st;
+    vo_get_wait_stats(vo, &st);
+
+    struct m_sub_property props[] = {
+        {"count",       SUB_PROP_INT64(st.count)},
+        {"last",        SUB_PROP_INT64(st.last)},
+        {"avg",         SUB_PROP_INT64(st.avg)},
+        {"peak",        SUB_PROP_INT64(st.peak)},
+        {"os-avg",      SUB_PROP_INT64(st.os_avg)},
+        {"spin",        SUB_PROP_INT64(st.spin)},
+        {0}
+    };
+
+    return m_property_read_sub(props, action, arg);
+}
+
+static int mp_property_vo_frame_stats(void *ctx, struct m_property *prop,
+                                      int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    struct vo *vo = mpctx->video_out;
+    if (!vo)
+        return M_PROPERTY_UNAVAILABLE;
+
+    struct vo_frame_stats st;
+    vo_get_frame_stats(vo, &st);
+
+    struct m_sub_property props[] = {
+        {"drop-demux",      SUB_PROP_INT64(st.drops[VO_LATE_DEMUX])},
+        {"drop-decode",     SUB_PROP_INT64(st.drops[VO_LATE_DECODE])},
+        {"drop-filter",     SUB_PROP_INT64(st.drops[VO_LATE_FILTER])},
+        {"drop-render",     SUB_PROP_INT64(st.drops[VO_LATE_RENDER])},
+        {"drop-vsync",      SUB_PROP_INT64(st.drops[VO_LATE_VSYNC])},
+        {"delay-demux",     SUB_PROP_INT64(st.delays[VO_LATE_DEMUX])},
+        {"delay-decode",    SUB_PROP_INT64(st.delays[VO_LATE_DECODE])},
+        {"delay-filter",    SUB_PROP_INT64(st.delays[VO_LATE_FILTER])},
+        {"delay-render",    SUB_PROP_INT64(st.delays[VO_LATE_RENDER])},
+        {"delay-vsync",     SUB_PROP_INT64(st.delays[VO_LATE_VSYNC])},
+        {0}
+    };
+
+    return m_property_read_sub(props, action, arg);
+}
+
+static int get_frame_latency_entry(int item, int action, void *arg, void *ctx)
+{
+    struct vo_frame_stats *st = ctx;
+
+    struct m_sub_property props[] = {
+        {"max",         SUB_PROP_DOUBLE((1 << item) / 1000.0),
+                        .unavailable = item == VO_LATENCY_BUCKETS - 1},
+        {"demux",       SUB_PROP_INT64(st->latency[VO_LATENCY_DEMUX][item])},
+        {"decode",      SUB_PROP_INT64(st->latency[VO_LATENCY_DECODE][item])},
+        {"filter",      SUB_PROP_INT64(st->latency[VO_LATENCY_FILTER][item])},
+        {"queue",       SUB_PROP_INT64(st->latency[VO_LATENCY_QUEUE][item])},
+        {"present",     SUB_PROP_INT64(st->latency[VO_LATENCY_PRESENT][item])},
+        {"total",       SUB_PROP_INT64(st->latency[VO_LATENCY_TOTAL][item])},
+        {0}
+    };
+
+    return m_property_read_sub(props, action, arg);
+}
+
+static int mp_property_vo_frame_latency(void *ctx, struct m_property *prop,
+                                        int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    struct vo *vo = mpctx->video_out;
+    if (!vo)
+        return M_PROPERTY_UNAVAILABLE;
+
+    struct vo_frame_stats st;
+    vo_get_frame_stats(vo, &st);
+    return m_property_read_list(action, arg, VO_LATENCY_BUCKETS,
+                                get_frame_latency_entry, &st);
+}
+
 static int mp_property_display_names(void *ctx, struct m_property *prop,
                                      int action, void *arg)
 {
@@ -2763,6 +3165,45 @@ static int mp_property_vo_performance(void *ctx, struct m_property *prop,
     return m_property_read_sub(props, action, arg);
 }
 
+static int get_vo_pass_entry(int item, int action, void *arg, void *ctx)
+{
+    struct voctrl_pass_performance *data = ctx;
+    struct voctrl_performance_entry *perf = &data->passes[item].perf;
+    struct m_sub_property props[] = {
+        {"desc",    SUB_PROP_STR(data->passes[item].desc)},
+        {"last",    SUB_PROP_INT64(perf->last)},
+        {"avg",     SUB_PROP_INT64(perf->avg)},
+        {"peak",    SUB_PROP_INT64(perf->peak)},
+        {0}
+    };
+
+    return m_property_read_sub(props, action, arg);
+}
+
+static int mp_property_vo_passes(void *ctx, struct m_property *prop,
+                                 int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->video_out)
+        return M_PROPERTY_UNAVAILABLE;
+
+    // Return the type right away if requested, to avoid having to
+    // go through a completely unnecessary VOCTRL
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+
+    struct voctrl_pass_performance *data =
+        talloc_zero(NULL, struct voctrl_pass_performance);
+    int r = M_PROPERTY_UNAVAILABLE;
+    if (vo_control(mpctx->video_out, VOCTRL_PASS_PERFORMANCE_DATA, data) > 0)
+        r = m_property_read_list(action, arg, data->num_passes,
+                                 get_vo_pass_entry, data);
+    talloc_free(data);
+    return r;
+}
+
 static int mp_property_vo(void *ctx, struct m_property *p, int action, void *arg)
 {
     MPContext *mpctx = ctx;
@@ -3181,30 +3622,11 @@ static int mp_property_playlist_pos_1(void *ctx, struct m_property *prop,
     return mp_property_playlist_pos_x(ctx, prop, action, arg, 1);
 }
 
-struct get_playlist_ctx {
-    struct MPContext *mpctx;
-    int last_index;
-    struct playlist_entry *last_entry;
-};
-
 static int get_playlist_entry(int item, int action, void *arg, void *ctx)
 {
-    struct get_playlist_ctx *p = ctx;
-    struct MPContext *mpctx = p->mpctx;
-
-    struct playlist_entry *e;
-    // This is an optimization that prevents O(n^2) behaviour when the entire
-    // playlist is requested. If a request is made for the last requested entry
-    // or the entry immediately following it, it can be found without a full
-    // traversal of the linked list.
-    if (p->last_entry && item == p->last_index)
-        e = p->last_entry;
-    else if (p->last_entry && item == p->last_index + 1)
-        e = p->last_entry->next;
-    else
-        e = playlist_entry_from_index(mpctx->playlist, item);
-    p->last_index = item;
-    p->last_entry = e;
+    struct MPContext *mpctx = ctx;
+
+    struct playlist_entry *e = playlist_entry_from_index(mpctx->playlist, item);
     if (!e)
         return M_PROPERTY_ERROR;
 
@@ -3245,9 +3667,8 @@ static int mp_property_playlist(void *ctx, struct m_property *prop,
         return M_PROPERTY_OK;
     }
 
-    struct get_playlist_ctx p = { .mpctx = mpctx };
     return m_property_read_list(action, arg, playlist_entry_count(mpctx->playlist),
-                                get_playlist_entry, &p);
+                                get_playlist_entry, mpctx);
 }
 
 static char *print_obj_osd_list(struct m_obj_settings *list)
@@ -3296,6 +3717,103 @@ static int mp_property_af(void *ctx, struct m_property *prop,
     return property_filter(prop, action, arg, ctx, STREAM_AUDIO);
 }
 
+static int get_filter_metrics(int action, void *arg, const char *name,
+                              const char *label, int queued, int64_t calls,
+                              int64_t frames_in, int64_t frames_out,
+                              int64_t time_us, int64_t peak_us,
+                              int64_t allocs)
+{
+    struct m_sub_property props[] = {
+        {"name",        SUB_PROP_STR(name)},
+        {"label",       SUB_PROP_STR(label), .unavailable = !label},
+        {"calls",       SUB_PROP_INT64(calls)},
+        {"frames-in",   SUB_PROP_INT64(frames_in)},
+        {"frames-out",  SUB_PROP_INT64(frames_out)},
+        {"queued",      SUB_PROP_INT(queued)},
+        {"time",        SUB_PROP_DOUBLE(time_us / 1e6)},
+        {"peak-time",   SUB_PROP_DOUBLE(peak_us / 1e6)},
+        {"allocs",      SUB_PROP_INT64(allocs), .unavailable = allocs < 0},
+        {0}
+    };
+    return m_property_read_sub(props, action, arg);
+}
+
+static int get_vf_metrics_entry(int item, int action, void *arg, void *ctx)
+{
+    struct vf_instance *vf = ctx;
+    for (int n = 0; n < item; n++)
+        vf = vf->next;
+    struct vf_metrics m;
+    vf_get_metrics(vf, &m);
+    return get_filter_metrics(action, arg, vf->info->name, vf->label,
+                              vf->num_out_queued, m.calls, m.frames_in,
+                              m.frames_out, m.time_us, m.peak_us, -1);
+}
+
+static int mp_property_vf_metrics(void *ctx, struct m_property *prop,
+                                  int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    struct vo_chain *vo_c = mpctx->vo_chain;
+    if (!vo_c || !vo_c->vf || !vo_c->vf->first)
+        return M_PROPERTY_UNAVAILABLE;
+
+    int count = 0;
+    for (struct vf_instance *vf = vo_c->vf->first; vf; vf = vf->next)
+        count++;
+    return m_property_read_list(action, arg, count, get_vf_metrics_entry,
+                                vo_c->vf->first);
+}
+
+static int get_af_metrics_entry(int item, int action, void *arg, void *ctx)
+{
+    struct af_instance *af = ctx;
+    for (int n = 0; n < item; n++)
+        af = af->next;
+    struct af_metrics *m = &af->metrics;
+    return get_filter_metrics(action, arg, af->info->name, af->label,
+                              af->num_out_queued, m->calls, m->frames_in,
+                              m->frames_out, m->time_us, m->peak_us,
+                              m->allocs);
+}
+
+static int mp_property_af_metrics(void *ctx, struct m_property *prop,
+                                  int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    struct ao_chain *ao_c = mpctx->ao_chain;
+    if (!ao_c || !ao_c->af || !ao_c->af->first)
+        return M_PROPERTY_UNAVAILABLE;
+
+    int count = 0;
+    for (struct af_instance *af = ao_c->af->first; af; af = af->next)
+        count++;
+    return m_property_read_list(action, arg, count, get_af_metrics_entry,
+                                ao_c->af->first);
+}
+
+static int get_thread_stats_entry(int item, int action, void *arg, void *ctx)
+{
+    struct mpthread_stats *st = &((struct mpthread_stats *)ctx)[item];
+    struct m_sub_property props[] = {
+        {"name",        SUB_PROP_STR(st->name)},
+        {"cpu-time",    SUB_PROP_DOUBLE(st->cpu_time)},
+        {"realtime",    SUB_PROP_FLAG(st->realtime)},
+        {"affinity",    SUB_PROP_FLAG(st->affinity)},
+        {0}
+    };
+    return m_property_read_sub(props, action, arg);
+}
+
+static int mp_property_thread_stats(void *ctx, struct m_property *prop,
+                                    int action, void *arg)
+{
+    struct mpthread_stats stats[64];
+    int count = mpthread_get_stats(stats, MP_ARRAY_SIZE(stats));
+    return m_property_read_list(action, arg, count, get_thread_stats_entry,
+                                stats);
+}
+
 static int mp_property_ab_loop(void *ctx, struct m_property *prop,
                                int action, void *arg)
 {
@@ -3629,9 +4147,9 @@ static int mp_property_list(void *ctx, struct m_property *prop,
     case M_PROPERTY_GET: {
         char **list = NULL;
         int num = 0;
-        for (int n = 0; cmd->properties[n].name; n++) {
+        for (int n = 0; n < cmd->properties.num_entries; n++) {
             MP_TARRAY_APPEND(NULL, list, num,
-                                talloc_strdup(NULL, cmd->properties[n].name));
+                    talloc_strdup(NULL, cmd->properties.entries[n].name));
         }
         MP_TARRAY_APPEND(NULL, list, num, NULL);
         *(char ***)arg = list;
@@ -3724,10 +4242,17 @@ static const struct m_property mp_properties_base[] = {
     {"cache-size", mp_property_cache_size},
     {"cache-idle", mp_property_cache_idle},
     {"cache-speed", mp_property_cache_speed},
+    {"cache-reconnects", mp_property_cache_reconnects},
     {"demuxer-cache-duration", mp_property_demuxer_cache_duration},
     {"demuxer-cache-time", mp_property_demuxer_cache_time},
     {"demuxer-cache-idle", mp_property_demuxer_cache_idle},
+    {"pipeline-latency", mp_property_pipeline_latency},
+    {"demuxer-packet-pool", mp_property_demuxer_packet_pool},
+    {"hls-variant", mp_property_hls_variant},
+    {"demuxer-stream-stats", mp_property_demuxer_stream_stats},
+    {"memory-usage", mp_property_memory_usage},
     {"cache-buffering-state", mp_property_cache_buffering},
+    {"cache-underrun-time", mp_property_cache_underrun_time},
     {"paused-for-cache", mp_property_paused_for_cache},
     {"clock", mp_property_clock},
     {"seekable", mp_property_seekable},
@@ -3764,6 +4289,7 @@ static const struct m_property mp_properties_base[] = {
     {"audio-device", mp_property_audio_device},
     {"audio-device-list", mp_property_audio_devices},
     {"current-ao", mp_property_ao},
+    {"audio-out-stats", mp_property_audio_out_stats},
     {"audio-out-detected-device", mp_property_ao_detected_device},
 
     // Video
@@ -3800,6 +4326,7 @@ static const struct m_property mp_properties_base[] = {
     {"window-scale", mp_property_window_scale},
     {"vo-configured", mp_property_vo_configured},
     {"vo-performance", mp_property_vo_performance},
+    {"vo-passes", mp_property_vo_passes},
     {"current-vo", mp_property_vo},
     {"container-fps", mp_property_fps},
     M_PROPERTY_DEPRECATED_ALIAS("fps", "container-fps"), // conflicts with option
@@ -3809,6 +4336,9 @@ static const struct m_property mp_properties_base[] = {
     {"program", mp_property_program},
     {"hwdec", mp_property_hwdec},
     {"hwdec-current", mp_property_hwdec_current},
+    {"decoder-thread-type", mp_property_decoder_thread_type},
+    {"video-pool-stats", mp_property_video_pool_stats},
+    {"thumbnails-generated", mp_property_thumbnails_generated},
     {"hwdec-interop", mp_property_hwdec_interop},
 
     {"estimated-frame-count", mp_property_frame_count},
@@ -3837,6 +4367,9 @@ static const struct m_property mp_properties_base[] = {
 
     {"vf", mp_property_vf},
     {"af", mp_property_af},
+    {"vf-metrics", mp_property_vf_metrics},
+    {"af-metrics", mp_property_af_metrics},
+    {"thread-stats", mp_property_thread_stats},
 
     {"video-rotate", video_simple_refresh_property},
     {"video-stereo-mode", video_simple_refresh_property},
@@ -3880,6 +4413,9 @@ static const struct m_property mp_properties_base[] = {
     {"display-fps", mp_property_display_fps},
     {"estimated-display-fps", mp_property_estimated_display_fps},
     {"vsync-jitter", mp_property_vsync_jitter},
+    {"vo-wait-stats", mp_property_vo_wait_stats},
+    {"vo-frame-stats", mp_property_vo_frame_stats},
+    {"vo-frame-latency", mp_property_vo_frame_latency},
 
     {"working-directory", mp_property_cwd},
 
@@ -3946,7 +4482,8 @@ static const char *const *const mp_event_property_change[] = {
     E(MP_EVENT_CACHE_UPDATE, "cache", "cache-free", "cache-used", "cache-idle",
       "demuxer-cache-duration", "demuxer-cache-idle", "paused-for-cache",
       "demuxer-cache-time", "cache-buffering-state", "cache-speed",
-      "cache-percent"),
+      "cache-percent", "cache-reconnects", "hls-variant",
+      "cache-underrun-time"),
     E(MP_EVENT_WIN_RESIZE, "window-scale", "osd-width", "osd-height", "osd-par"),
     E(MP_EVENT_WIN_STATE, "window-minimized", "display-names", "display-fps",
       "fullscreen"),
@@ -3987,14 +4524,14 @@ uint64_t mp_get_property_event_mask(const char *name)
 
 // Return an ID for the property. It might not be unique, but is good enough
 // for property change handling. Return -1 if property unknown.
+// Sub-properties ("a/b") get the ID of the top-level property.
 int mp_get_property_id(struct MPContext *mpctx, const char *name)
 {
     struct command_ctx *ctx = mpctx->command_ctx;
-    for (int n = 0; ctx->properties[n].name; n++) {
-        if (match_property(ctx->properties[n].name, name))
-            return n;
-    }
-    return -1;
+    char base[128];
+    snprintf(base, sizeof(base), "%.*s", (int)strcspn(name, "/"), name);
+    struct m_property *prop = m_property_list_find(&ctx->properties, base);
+    return prop ? prop - ctx->properties.entries : -1;
 }
 
 static bool is_property_set(int action, void *val)
@@ -4018,7 +4555,7 @@ int mp_property_do(const char *name, int action, void *val,
                    struct MPContext *ctx)
 {
     struct command_ctx *cmd = ctx->command_ctx;
-    int r = m_property_do(ctx->log, cmd->properties, name, action, val, ctx);
+    int r = m_property_do(ctx->log, &cmd->properties, name, action, val, ctx);
     if (r == M_PROPERTY_OK && is_property_set(action, val))
         mp_notify_property(ctx, (char *)name);
     if (mp_msg_test(ctx->log, MSGL_V) && is_property_set(action, val)) {
@@ -4044,7 +4581,7 @@ int mp_property_do(const char *name, int action, void *val,
 char *mp_property_expand_string(struct MPContext *mpctx, const char *str)
 {
     struct command_ctx *ctx = mpctx->command_ctx;
-    return m_properties_expand_string(ctx->properties, str, mpctx);
+    return m_properties_expand_string(&ctx->properties, str, mpctx);
 }
 
 // Before expanding properties, parse C-style escapes like "\n"
@@ -4071,7 +4608,7 @@ char *mp_property_expand_escaped_string(struct MPContext *mpctx, const char *str
 void property_print_help(struct MPContext *mpctx)
 {
     struct command_ctx *ctx = mpctx->command_ctx;
-    m_properties_print_help_list(mpctx->log, ctx->properties);
+    m_properties_print_help_list(mpctx->log, &ctx->properties);
 }
 
 /* List of default ways to show a property on OSD.
@@ -5133,10 +5670,17 @@ int run_command(struct MPContext *mpctx, struct mp_cmd *cmd, struct mpv_node *re
         screenshot_to_file(mpctx, cmd->args[0].v.s, cmd->args[1].v.i, msg_osd);
         break;
 
-    case MP_CMD_SCREENSHOT_RAW: {
+    case MP_CMD_SCREENSHOT_RAW:
+    case MP_CMD_THUMBNAIL: {
         if (!res)
             return -1;
-        struct mp_image *img = screenshot_get_rgb(mpctx, cmd->args[0].v.i);
+        struct mp_image *img;
+        if (cmd->id == MP_CMD_THUMBNAIL) {
+            img = thumbnail_get(mpctx, cmd->args[0].v.d, cmd->args[1].v.i,
+                                cmd->args[2].v.i);
+        } else {
+            img = screenshot_get_rgb(mpctx, cmd->args[0].v.i);
+        }
         if (!img)
             return -1;
         struct mpv_node_list *info = talloc_zero(NULL, struct mpv_node_list);
@@ -5156,6 +5700,10 @@ int run_command(struct MPContext *mpctx, struct mp_cmd *cmd, struct mpv_node *re
         break;
     }
 
+    case MP_CMD_THUMBNAIL_CANCEL:
+        thumbnail_cancel(mpctx);
+        break;
+
     case MP_CMD_RUN: {
         char *args[MP_CMD_MAX_ARGS + 1] = {0};
         for (int n = 0; n < cmd->nargs; n++)
@@ -5326,14 +5874,14 @@ int run_command(struct MPContext *mpctx, struct mp_cmd *cmd, struct mpv_node *re
             return -1;
         }
         mp_hook_add(mpctx, cmd->sender, cmd->args[0].v.s, cmd->args[1].v.i,
-                    cmd->args[2].v.i);
+                    cmd->args[2].v.i, cmd->args[3].v.i, cmd->args[4].v.d);
         break;
     case MP_CMD_HOOK_ACK:
         if (!cmd->sender) {
             MP_ERR(mpctx, "Can be used from client API only.\n");
             return -1;
         }
-        mp_hook_run(mpctx, cmd->sender, cmd->args[0].v.s);
+        hook_ack(mpctx, cmd->sender, cmd->args[0].v.s);
         break;
 
     case MP_CMD_MOUSE: {
@@ -5409,9 +5957,15 @@ void command_init(struct MPContext *mpctx)
 
     int num_base = MP_ARRAY_SIZE(mp_properties_base);
     int num_opts = m_config_get_co_count(mpctx->mconfig);
-    ctx->properties =
-        talloc_zero_array(ctx, struct m_property, num_base + num_opts + 1);
-    memcpy(ctx->properties, mp_properties_base, sizeof(mp_properties_base));
+    struct m_property_list *props = &ctx->properties;
+    props->entries =
+        talloc_zero_array(ctx, struct m_property, num_base + num_opts);
+    memcpy(props->entries, mp_properties_base, sizeof(mp_properties_base));
+    props->num_entries = num_base;
+    m_property_list_sort(props);
+
+    // Manual properties, for looking up conflicts with options.
+    struct m_property_list base = *props;
 
     int count = num_base;
     for (int n = 0; n < num_opts; n++) {
@@ -5433,11 +5987,14 @@ void command_init(struct MPContext *mpctx)
         }
 
         // The option might be covered by a manual property already.
-        if (m_property_list_find(ctx->properties, prop.name))
+        if (m_property_list_find(&base, prop.name))
             continue;
 
-        ctx->properties[count++] = prop;
+        props->entries[count++] = prop;
     }
+
+    props->num_entries = count;
+    m_property_list_sort(props);
 }
 
 static void command_event(struct MPContext *mpctx, int event, void *arg)
@@ -5476,6 +6033,9 @@ void mp_notify(struct MPContext *mpctx, int event, void *arg)
     // The OSD can implicitly reference some properties.
     mpctx->osd_idle_update = true;
 
+    // Any event might go along with changed properties.
+    mp_client_unpublish_properties(mpctx);
+
     command_event(mpctx, event, arg);
 
     mp_client_broadcast_event(mpctx, event, arg);
@@ -55,7 +55,8 @@ enum {
 };
 
 bool mp_hook_test_completion(struct MPContext *mpctx, char *type);
-void mp_hook_run(struct MPContext *mpctx, char *client, char *type);
+void mp_hook_start(struct MPContext *mpctx, char *type);
+bool mp_hook_has_handlers(struct MPContext *mpctx, char *type);
 
 void mark_seek(struct MPContext *mpctx);
 
@@ -24,6 +24,7 @@
 #include "libmpv/client.h"
 
 #include "common/common.h"
+#include "osdep/atomics.h"
 #include "options/options.h"
 #include "sub/osd.h"
 #include "audio/audio.h"
@@ -155,6 +156,14 @@ struct track {
 };
 
 // Summarizes video filtering and output.
+// Hardware deinterlacing filters, for vo_chain.deint_failed.
+enum hw_deint {
+    HW_DEINT_VDPAU,     // vdpaupp
+    HW_DEINT_VAAPI,     // vavpp
+    HW_DEINT_D3D11,     // d3d11vpp
+    HW_DEINT_COUNT
+};
+
 struct vo_chain {
     struct mp_log *log;
 
@@ -169,6 +178,26 @@ struct vo_chain {
 
     // Last known input_mpi format (so vf can be reinitialized any time).
     struct mp_image_params input_format;
+    // Last known input_mpi hw frames context (AVHWFramesContext), if any.
+    struct AVBufferRef *input_hwframes;
+    // Timing of the last input_mpi sent to the filters.
+    struct mp_frame_timing input_timing;
+
+    // Hardware deinterlacing filters which failed to initialize, so they're
+    // not retried on every filter reconfig.
+    bool deint_failed[HW_DEINT_COUNT];
+
+    // State of the --vd-auto-degrade controller.
+    int degrade_level;
+    double degrade_next_check;
+    double degrade_last_change;
+    double degrade_last_recover;
+    double degrade_recover_time;    // seconds without load before recovering
+    int64_t degrade_drops;          // last total of decoder + VO drops
+    int degrade_good_checks;
+
+    // Filter out_pool share of --memory-budget.
+    struct mp_memgov_client *pool_memgov;
 
     struct track *track;
     struct lavfi_pad *filter_src;
@@ -198,6 +227,13 @@ struct ao_chain {
     // Last known input_mpi format (so vf can be reinitialized any time).
     struct mp_audio input_format;
 
+    // Recently filtered audio, for serving seeks without decoding (see
+    // audio_seek_cached()). Contiguous; frame pts fields are the start pts.
+    struct mp_audio **seek_cache;
+    int num_seek_cache;
+    double seek_cache_end;      // pts at end of the last cached frame
+    double seek_cache_speed;    // audio_speed the cached audio was made with
+
     struct track *track;
     struct lavfi_pad *filter_src;
     struct dec_audio *audio_src;
@@ -224,6 +260,9 @@ enum playback_status {
 typedef struct MPContext {
     bool initialized;
     bool autodetach;
+    // Startup trace (mp_startup_trace()); times in mp_time_us().
+    int64_t startup_time, startup_last;
+    bool startup_done;
     struct mpv_global *global;
     struct MPOpts *opts;
     struct mp_log *log;
@@ -232,6 +271,10 @@ typedef struct MPContext {
     struct mp_client_api *clients;
     struct mp_dispatch_queue *dispatch;
     struct mp_cancel *playback_abort;
+    // Set if the demuxer was opened with a different cancel handle (which
+    // happens if it was prefetched with --prefetch-playlist).
+    struct mp_cancel *demuxer_cancel;
+    struct playlist_prefetch *prefetch;
 
     struct mp_log *statusline;
     struct osd_state *osd;
@@ -249,6 +292,9 @@ typedef struct MPContext {
     double osd_msg_visible;
     double osd_msg_next_duration;
     double osd_last_update;
+    double osd_status_last_update;
+    char *osd_status_text;
+    int osd_status_level;
     bool osd_force_update, osd_idle_update;
     char *osd_msg_text;
     bool osd_show_pos;
@@ -300,6 +346,10 @@ typedef struct MPContext {
     struct vo_chain *vo_chain;
 
     struct vo *video_out;
+    // Secondary VOs, see --video-mirror. Entries whose VO failed to initialize
+    // are kept (with vo==NULL), so that this is done only once.
+    struct vo_mirror **video_mirrors;
+    int num_video_mirrors;
     // next_frame[0] is the next frame, next_frame[1] the one after that.
     // The +1 is for adding 1 additional frame in backstep mode.
     struct mp_image *next_frames[VO_MAX_REQ_FRAMES + 1];
@@ -311,6 +361,21 @@ typedef struct MPContext {
     // Factors to multiply with opts->playback_speed to get the total audio or
     // video speed (usually 1.0, but can be set to by the sync code).
     double speed_factor_v, speed_factor_a;
+    // Additional factor for both, set by the --latency-target catch-up code.
+    double latency_speed;
+    // State of the --hls-bitrate=auto variant switching.
+    struct hls_adapt {
+        double next_check, last_check;
+        double last_switch;
+        double last_ts;         // demuxer readahead end at the last check
+        bool last_idle;
+        double throughput;      // estimated bits/s (0 if unknown)
+        int good_checks;        // consecutive checks allowing a switch up
+        int bad_checks;         // consecutive checks requiring a switch down
+        int num_switches;
+        char **log;             // recent decisions, oldest first
+        int num_log;
+    } hls;
     // Redundant values set from opts->playback_speed and speed_factor_*.
     // update_playback_speed() updates them from the other fields.
     double audio_speed, video_speed;
@@ -327,6 +392,12 @@ typedef struct MPContext {
     bool hrseek_lastframe;  // drop everything until last frame reached
     bool hrseek_backstep;   // go to frame before seek target
     double hrseek_pts;
+    // --hr-seek-preview: the last seek was done as keyframe seek because the
+    // user was still seeking; the exact seek to this target is done later.
+    bool seek_preview_active;
+    double seek_preview_pts;
+    enum seek_precision seek_preview_exact;
+    double last_seek_time;  // mp_time_sec() of the last executed seek
     bool ab_loop_clip;      // clip to the "b" part of an A-B loop if available
     // AV sync: the next frame should be shown when the audio out has this
     // much (in seconds) buffered data left. Increased when more data is
@@ -366,6 +437,10 @@ typedef struct MPContext {
     double next_heartbeat;
     double last_idle_tick;
     double next_cache_update;
+    // Set by the demuxer thread when it wakes up the playloop. Lets
+    // handle_pause_on_low_cache() skip polling the cache state while nothing
+    // is going on.
+    atomic_int demux_woken;
 
     double sleeptime;      // number of seconds to sleep before next iteration
 
@@ -408,6 +483,10 @@ typedef struct MPContext {
 
     bool paused_for_cache;
     double cache_stop_time, cache_wait_time;
+    // For --cache-pause-mode=predictive (bytes/second, -1 if unknown).
+    double cache_media_rate, cache_fill_rate;
+    // Estimated seconds until underrun, -1 if none expected, or MP_NOPTS_VALUE.
+    double cache_underrun_time;
     int cache_buffer;
 
     // Set after showing warning about decoding being too slow for realtime
@@ -417,12 +496,15 @@ typedef struct MPContext {
     char *cached_watch_later_configdir;
 
     struct screenshot_ctx *screenshot_ctx;
+    struct thumbnailer *thumbnailer;
+    struct mp_dir_cache *dir_cache; // for autoload_external_files()
     struct command_ctx *command_ctx;
     struct encode_lavc_context *encode_lavc_ctx;
 
     struct mp_ipc_ctx *ipc_ctx;
 
     struct mpv_opengl_cb_context *gl_cb_ctx;
+    struct mpv_sw_cb_context *sw_cb_ctx;
 } MPContext;
 
 // audio.c
@@ -434,6 +516,7 @@ double playing_audio_pts(struct MPContext *mpctx);
 void fill_audio_out_buffers(struct MPContext *mpctx);
 double written_audio_pts(struct MPContext *mpctx);
 void clear_audio_output_buffers(struct MPContext *mpctx);
+bool audio_seek_cached(struct MPContext *mpctx, double pts);
 void update_playback_speed(struct MPContext *mpctx);
 void uninit_audio_out(struct MPContext *mpctx);
 void uninit_audio_chain(struct MPContext *mpctx);
@@ -469,6 +552,8 @@ struct playlist_entry *mp_next_file(struct MPContext *mpctx, int direction,
                                     bool force);
 void mp_set_playlist_entry(struct MPContext *mpctx, struct playlist_entry *e);
 void mp_play_files(struct MPContext *mpctx);
+void prefetch_next(struct MPContext *mpctx);
+void cancel_prefetch(struct MPContext *mpctx);
 void update_demuxer_properties(struct MPContext *mpctx);
 void print_track_list(struct MPContext *mpctx, const char *msg);
 void reselect_demux_stream(struct MPContext *mpctx, struct track *track);
@@ -483,6 +568,7 @@ struct MPContext *mp_create(void);
 void mp_destroy(struct MPContext *mpctx);
 void mp_print_version(struct mp_log *log, int always);
 void wakeup_playloop(void *ctx);
+void mp_startup_trace(struct MPContext *mpctx, const char *phase);
 
 // misc.c
 double rel_time_to_abs(struct MPContext *mpctx, struct m_rel_time t);
@@ -495,7 +581,8 @@ void update_window_title(struct MPContext *mpctx, bool force);
 void error_on_track(struct MPContext *mpctx, struct track *track);
 int stream_dump(struct MPContext *mpctx, const char *source_filename);
 int mpctx_run_reentrant(struct MPContext *mpctx, void (*thread_fn)(void *arg),
-                        void *thread_arg);
+                        void *thread_arg,
+                        void (*main_fn)(struct MPContext *mpctx));
 struct mpv_global *create_sub_global(struct MPContext *mpctx);
 double get_track_seek_offset(struct MPContext *mpctx, struct track *track);
 
@@ -522,6 +609,7 @@ void queue_seek(struct MPContext *mpctx, enum seek_type type, double amount,
 double get_time_length(struct MPContext *mpctx);
 double get_current_time(struct MPContext *mpctx);
 double get_playback_time(struct MPContext *mpctx);
+double get_pipeline_latency(struct MPContext *mpctx);
 int get_percent_pos(struct MPContext *mpctx);
 double get_current_pos_ratio(struct MPContext *mpctx, bool use_range);
 int get_current_chapter(struct MPContext *mpctx);
@@ -541,6 +629,18 @@ void seek_to_last_frame(struct MPContext *mpctx);
 struct mp_scripting {
     const char *file_ext;   // e.g. "lua"
     int (*load)(struct mpv_handle *client, const char *filename);
+    // Optional, used with --script-threads. start() loads the script, but
+    // doesn't enter its event loop. Returns NULL on failure. If *own_loop is
+    // set, the script replaced the default event loop, and run_loop() must be
+    // called on a separate thread. Otherwise, step() handles pending events
+    // and expired timers without waiting, and returns the time in seconds
+    // until the next timer. A negative return value means the script exited.
+    // run_loop() returns when the script exits. In both cases, the state is
+    // freed, but the client is not destroyed.
+    void *(*start)(struct mpv_handle *client, const char *filename,
+                   bool *own_loop);
+    double (*step)(void *state);
+    void (*run_loop)(void *state);
 };
 void mp_load_scripts(struct MPContext *mpctx);
 
@@ -565,6 +665,8 @@ int reinit_video_filters(struct MPContext *mpctx);
 void write_video(struct MPContext *mpctx);
 void mp_force_video_refresh(struct MPContext *mpctx);
 void uninit_video_out(struct MPContext *mpctx);
+void set_video_mirrors_paused(struct MPContext *mpctx, bool paused);
+void redraw_video_mirrors(struct MPContext *mpctx, bool force);
 void uninit_video_chain(struct MPContext *mpctx);
 double calc_average_frame_duration(struct MPContext *mpctx);
 int init_video_decoder(struct MPContext *mpctx, struct track *track);
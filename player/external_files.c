@@ -3,6 +3,7 @@
 #include <strings.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <time.h>
 
 #include "osdep/io.h"
 
@@ -85,7 +86,109 @@ static struct bstr guess_lang_from_filename(struct bstr name)
     return (struct bstr){name.start + i + 1, n};
 }
 
+// A directory listing, reduced to the entries that look like external files.
+struct dir_entry {
+    char *name;         // file name as returned by readdir()
+    bstr name_trim;     // lowercased, stripped name without extension
+    int type;           // STREAM_SUB or STREAM_AUDIO
+};
+
+struct dir_cache_entry {
+    char *path;
+    time_t mtime;       // st_mtime of the directory when it was listed
+    time_t list_time;   // wall clock time when it was listed
+    struct dir_entry *entries;
+    int num_entries;
+};
+
+// Loading a playlist of files from the same directory would otherwise run
+// readdir() on the whole directory for every file. Cache the filtered
+// listings of the most recently used directories, and invalidate them if the
+// directory's mtime changes.
+#define DIR_CACHE_SIZE 16
+
+struct mp_dir_cache {
+    struct dir_cache_entry *entries[DIR_CACHE_SIZE]; // most recently used first
+};
+
+// The cache is not thread-safe; it's meant to be owned by the player core.
+struct mp_dir_cache *mp_dir_cache_create(void *ta_parent)
+{
+    return talloc_zero(ta_parent, struct mp_dir_cache);
+}
+
+static struct dir_cache_entry *list_dir(void *ta_parent, const char *path,
+                                        time_t mtime)
+{
+    DIR *d = opendir(path);
+    if (!d)
+        return NULL;
+    struct dir_cache_entry *e = talloc_zero(ta_parent, struct dir_cache_entry);
+    e->path = talloc_strdup(e, path);
+    e->mtime = mtime;
+    e->list_time = time(NULL);
+    struct dirent *de;
+    while ((de = readdir(d))) {
+        struct bstr dename = bstr0(de->d_name);
+        int type = test_ext(bstr_get_ext(dename));
+        if (type < 0)
+            continue;
+        struct dir_entry entry = {
+            .name = talloc_strdup(e, de->d_name),
+            .type = type,
+        };
+        struct bstr noext = bstrdup(e, bstr_strip_ext(dename));
+        bstr_lower(noext);
+        entry.name_trim = bstr_strip(noext);
+        MP_TARRAY_APPEND(e, e->entries, e->num_entries, entry);
+    }
+    closedir(d);
+    return e;
+}
+
+// Return the (filtered) listing of the given directory. The result is owned
+// by the cache, and valid until the next call.
+static struct dir_cache_entry *get_dir_listing(struct mp_dir_cache *cache,
+                                               const char *path)
+{
+    struct dir_cache_entry **dir_cache = cache->entries;
+
+    struct stat st;
+    if (stat(path, &st) || !S_ISDIR(st.st_mode))
+        return NULL;
+
+    int slot = DIR_CACHE_SIZE - 1;
+    for (int n = 0; n < DIR_CACHE_SIZE; n++) {
+        struct dir_cache_entry *e = dir_cache[n];
+        if (!e) {
+            slot = n;
+            break;
+        }
+        if (strcmp(e->path, path) == 0) {
+            // A change within the same second as the listing wouldn't be
+            // visible in the mtime, so don't trust such listings.
+            if (e->mtime == st.st_mtime && e->list_time > e->mtime + 1) {
+                // Move to front (most recently used).
+                memmove(&dir_cache[1], &dir_cache[0], n * sizeof(dir_cache[0]));
+                dir_cache[0] = e;
+                return e;
+            }
+            slot = n;
+            break;
+        }
+    }
+
+    struct dir_cache_entry *e = list_dir(cache, path, st.st_mtime);
+    if (!e)
+        return NULL;
+    talloc_free(dir_cache[slot]);
+    memmove(&dir_cache[1], &dir_cache[0], slot * sizeof(dir_cache[0]));
+    dir_cache[0] = e;
+    return e;
+}
+
 static void append_dir_subtitles(struct mpv_global *global,
+                                 struct mp_dir_cache *cache,
                                  struct subfn **slist, int *nsub,
                                  struct bstr path, const char *fname,
                                  int limit_fuzziness, int limit_type)
@@ -107,23 +210,16 @@ static void append_dir_subtitles(struct mpv_global *global,
     // 2 = any sub file containing movie name
     // 3 = sub file containing movie name and the lang extension
     char *path0 = bstrdup0(tmpmem, path);
-    DIR *d = opendir(path0);
-    if (!d)
+    struct dir_cache_entry *dir = get_dir_listing(cache, path0);
+    if (!dir)
         goto out;
     mp_verbose(log, "Loading external files in %.*s\n", BSTR_P(path));
-    struct dirent *de;
-    while ((de = readdir(d))) {
-        struct bstr dename = bstr0(de->d_name);
-        void *tmpmem2 = talloc_new(tmpmem);
-
-        // retrieve various parts of the filename
-        struct bstr tmp_fname_noext = bstrdup(tmpmem2, bstr_strip_ext(dename));
-        bstr_lower(tmp_fname_noext);
-        struct bstr tmp_fname_ext = bstr_get_ext(dename);
-        struct bstr tmp_fname_trim = bstr_strip(tmp_fname_noext);
+    for (int i = 0; i < dir->num_entries; i++) {
+        struct dir_entry *de = &dir->entries[i];
+        struct bstr tmp_fname_trim = de->name_trim;
 
         // check what it is (most likely)
-        int type = test_ext(tmp_fname_ext);
+        int type = de->type;
         char **langs = NULL;
         int fuzz = -1;
         switch (type) {
@@ -138,7 +234,7 @@ static void append_dir_subtitles(struct mpv_global *global,
         }
 
         if (fuzz < 0 || (limit_type >= 0 && limit_type != type))
-            goto next_sub;
+            continue;
 
         // we have a (likely) subtitle file
         int prio = 0;
@@ -159,7 +255,7 @@ static void append_dir_subtitles(struct mpv_global *global,
         }
         if (!prio && bstrcmp(tmp_fname_trim, f_fname_trim) == 0)
             prio = 3; // matches the movie name
-        if (!prio && bstr_find(tmp_fname_trim, f_fname_trim) >= 0 && fuzz >= 1)
+        if (!prio && fuzz >= 1 && bstr_find(tmp_fname_trim, f_fname_trim) >= 0)
             prio = 2; // contains the movie name
         if (!prio) {
             // doesn't contain the movie name
@@ -170,11 +266,11 @@ static void append_dir_subtitles(struct mpv_global *global,
         }
 
         mp_dbg(log, "Potential external file: \"%s\"  Priority: %d\n",
-               de->d_name, prio);
+               de->name, prio);
 
         if (prio) {
             prio += prio;
-            char *subpath = mp_path_join_bstr(*slist, path, dename);
+            char *subpath = mp_path_join_bstr(*slist, path, bstr0(de->name));
             if (mp_path_exists(subpath)) {
                 MP_TARRAY_GROW(NULL, *slist, *nsub);
                 struct subfn *sub = *slist + (*nsub)++;
@@ -190,11 +286,7 @@ static void append_dir_subtitles(struct mpv_global *global,
             } else
                 talloc_free(subpath);
         }
-
-    next_sub:
-        talloc_free(tmpmem2);
     }
-    closedir(d);
 
  out:
     talloc_free(tmpmem);
@@ -227,45 +319,48 @@ static void filter_subidx(struct subfn **slist, int *nsub)
     }
 }
 
-static void load_paths(struct mpv_global *global, struct subfn **slist,
-                       int *nsubs, const char *fname, char **paths,
-                       char *cfg_path, int type)
+static void load_paths(struct mpv_global *global, struct mp_dir_cache *cache,
+                       struct subfn **slist, int *nsubs, const char *fname,
+                       char **paths, char *cfg_path, int type)
 {
     for (int i = 0; paths && paths[i]; i++) {
         char *path = mp_path_join_bstr(*slist, mp_dirname(fname),
                                        bstr0(paths[i]));
-        append_dir_subtitles(global, slist, nsubs, bstr0(path), fname, 0, type);
+        append_dir_subtitles(global, cache, slist, nsubs, bstr0(path), fname,
+                             0, type);
     }
 
     // Load subtitles in ~/.mpv/sub (or similar) limiting sub fuzziness
     char *mp_subdir = mp_find_config_file(NULL, global, cfg_path);
     if (mp_subdir) {
-        append_dir_subtitles(global, slist, nsubs, bstr0(mp_subdir), fname, 1,
-                             type);
+        append_dir_subtitles(global, cache, slist, nsubs, bstr0(mp_subdir),
+                             fname, 1, type);
     }
     talloc_free(mp_subdir);
 }
 
 // Return a list of subtitles and audio files found, sorted by priority.
 // Last element is terminated with a fname==NULL entry.
-struct subfn *find_external_files(struct mpv_global *global, const char *fname)
+struct subfn *find_external_files(struct mpv_global *global,
+                                  struct mp_dir_cache *cache, const char *fname)
 {
     struct MPOpts *opts = global->opts;
     struct subfn *slist = talloc_array_ptrtype(NULL, slist, 1);
     int n = 0;
 
     // Load subtitles from current media directory
-    append_dir_subtitles(global, &slist, &n, mp_dirname(fname), fname, 0, -1);
+    append_dir_subtitles(global, cache, &slist, &n, mp_dirname(fname), fname,
+                         0, -1);
 
     // Load subtitles in dirs specified by sub-paths option
     if (opts->sub_auto >= 0) {
-        load_paths(global, &slist, &n, fname, opts->sub_paths, "sub/",
-                   STREAM_SUB);
+        load_paths(global, cache, &slist, &n, fname, opts->sub_paths,
+                   "sub/", STREAM_SUB);
     }
 
     if (opts->audiofile_auto >= 0) {
-        load_paths(global, &slist, &n, fname, opts->audiofile_paths, "audio/",
-                   STREAM_AUDIO);
+        load_paths(global, cache, &slist, &n, fname, opts->audiofile_paths,
+                   "audio/", STREAM_AUDIO);
     }
 
     // Sort by name for filter_subidx()
@@ -28,7 +28,10 @@ struct subfn {
 };
 
 struct mpv_global;
-struct subfn *find_external_files(struct mpv_global *global, const char *fname);
+struct mp_dir_cache;
+struct mp_dir_cache *mp_dir_cache_create(void *ta_parent);
+struct subfn *find_external_files(struct mpv_global *global,
+                                  struct mp_dir_cache *cache, const char *fname);
 
 bool mp_might_be_subtitle_file(const char *filename);
 
@@ -22,6 +22,7 @@
 #include <inttypes.h>
 #include <stdarg.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <libavutil/avstring.h>
 #include <libavutil/mem.h>
@@ -32,9 +33,12 @@
 #include <libavfilter/buffersink.h>
 #include <libavfilter/buffersrc.h>
 
+#include "config.h"
+
 #include "common/common.h"
 #include "common/av_common.h"
 #include "common/msg.h"
+#include "osdep/threads.h"
 
 #include "audio/audio.h"
 #include "video/mp_image.h"
@@ -66,6 +70,25 @@ struct lavfi {
 
     struct lavfi_pad **pads;
     int num_pads;
+
+    // The graph is run on a worker thread. The fields below, and the caller_*
+    // and handoff_* fields in lavfi_pad, are protected by the lock. All other
+    // state is owned by the worker while busy is set, and by the lock holder
+    // otherwise.
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    bool terminate;
+    bool started;       // caller has finished setting up the pads
+    bool work;          // worker should run a pass
+    bool busy;          // worker is processing without holding the lock
+
+    void (*wakeup_cb)(void *ctx);
+    void *wakeup_ctx;
+
+    // Graph state, as last published by the worker.
+    bool caller_failed;
+    bool caller_all_waiting;
 };
 
 struct lavfi_pad {
@@ -101,8 +124,20 @@ struct lavfi_pad {
 
     // -- dir==LAVFI_OUT
 
-    bool output_needed; // caller has signaled it needs new output
+    bool output_needed; // worker wants new output
     bool output_eof;    // last filter output was EOF
+
+    // -- handoff between worker and caller (protected by lavfi.lock)
+
+    bool caller_connected;
+    // dir==LAVFI_IN: frame or status sent by the caller (status 0: none)
+    // dir==LAVFI_OUT: filtered frame ready for the caller
+    struct mp_image *handoff_v;
+    struct mp_audio *handoff_a;
+    int handoff_status;
+    bool caller_needs_input;    // dir==LAVFI_IN: input_needed was published,
+                                // and the caller hasn't sent anything yet
+    bool caller_eof;            // dir==LAVFI_OUT: published output_eof
 };
 
 static void add_pad(struct lavfi *c, enum lavfi_direction dir, AVFilterInOut *item)
@@ -162,6 +197,9 @@ static void precreate_graph(struct lavfi *c)
     c->graph = avfilter_graph_alloc();
     if (!c->graph)
         abort();
+    // Let filters supporting it use slice threads (0 means auto-detect).
+    c->graph->thread_type = AVFILTER_THREAD_SLICE;
+    c->graph->nb_threads = 0;
     AVFilterInOut *in = NULL, *out = NULL;
     if (avfilter_graph_parse2(c->graph, c->graph_string, &in, &out) < 0) {
         c->graph = NULL;
@@ -215,32 +253,209 @@ static void drop_pad_data(struct lavfi_pad *pad)
     pad->pending_v = NULL;
 }
 
+// Must be called with the lock held, and the worker not busy.
 static void clear_data(struct lavfi *c)
 {
-    for (int n = 0; n < c->num_pads; n++)
-        drop_pad_data(c->pads[n]);
+    for (int n = 0; n < c->num_pads; n++) {
+        struct lavfi_pad *pad = c->pads[n];
+        drop_pad_data(pad);
+        talloc_free(pad->handoff_a);
+        pad->handoff_a = NULL;
+        talloc_free(pad->handoff_v);
+        pad->handoff_v = NULL;
+        pad->handoff_status = 0;
+        pad->caller_needs_input = false;
+        pad->caller_eof = false;
+    }
+    c->caller_all_waiting = false;
+}
+
+static bool process_graph(struct lavfi *c);
+
+// Move what the caller sent since the last pass to the graph state.
+// Called by the worker with the lock held.
+static void transfer_in(struct lavfi *c)
+{
+    for (int n = 0; n < c->num_pads; n++) {
+        struct lavfi_pad *pad = c->pads[n];
+
+        pad->connected = pad->caller_connected;
+
+        if (pad->dir == LAVFI_OUT) {
+            if (!pad->connected) {
+                talloc_free(pad->handoff_a);
+                pad->handoff_a = NULL;
+                talloc_free(pad->handoff_v);
+                pad->handoff_v = NULL;
+            }
+            // Always keep one frame in flight, so the graph filters the next
+            // frame while the caller is busy with the previous one.
+            if (!pad->pending_a && !pad->pending_v)
+                pad->output_needed = true;
+            continue;
+        }
+
+        // Data arriving while the graph doesn't want it stays in the handoff
+        // fields until it does.
+        if (!pad->input_needed || pad->pending_a || pad->pending_v)
+            continue;
+
+        if (pad->handoff_a || pad->handoff_v) {
+            pad->pending_a = pad->handoff_a;
+            pad->pending_v = pad->handoff_v;
+            pad->handoff_a = NULL;
+            pad->handoff_v = NULL;
+            pad->input_waiting = pad->input_again = pad->input_eof = false;
+            pad->input_needed = false;
+        } else if (pad->handoff_status) {
+            int status = pad->handoff_status;
+            pad->handoff_status = 0;
+            pad->input_waiting = status == DATA_WAIT || status == DATA_EOF;
+            pad->input_again = status == DATA_AGAIN;
+            pad->input_eof = status == DATA_EOF;
+        }
+    }
+}
+
+// Make the graph state visible to the caller. Called by the worker with the
+// lock held. Returns whether anything changed.
+static bool publish(struct lavfi *c)
+{
+    bool changed = false;
+
+    for (int n = 0; n < c->num_pads; n++) {
+        struct lavfi_pad *pad = c->pads[n];
+
+        if (pad->dir == LAVFI_IN) {
+            // Only the caller clears the flag (when sending), so it can't go
+            // away between lavfi_needs_input() and lavfi_send_*(). If the graph
+            // stops wanting input in the meantime (e.g. while draining or
+            // recreating it), the sent data waits in the handoff fields.
+            bool needs = pad->input_needed && !pad->handoff_a &&
+                         !pad->handoff_v && !pad->handoff_status;
+            if (needs && !pad->caller_needs_input) {
+                pad->caller_needs_input = true;
+                changed = true;
+            }
+        } else {
+            if (!pad->handoff_a && !pad->handoff_v &&
+                (pad->pending_a || pad->pending_v))
+            {
+                pad->handoff_a = pad->pending_a;
+                pad->handoff_v = pad->pending_v;
+                pad->pending_a = NULL;
+                pad->pending_v = NULL;
+                changed = true;
+            }
+            bool eof = pad->output_eof && !pad->handoff_a && !pad->handoff_v;
+            changed |= eof != pad->caller_eof;
+            pad->caller_eof = eof;
+        }
+    }
+
+    changed |= c->failed != c->caller_failed;
+    c->caller_failed = c->failed;
+    changed |= c->all_waiting != c->caller_all_waiting;
+    c->caller_all_waiting = c->all_waiting;
+
+    return changed;
+}
+
+static void *lavfi_thread(void *p)
+{
+    struct lavfi *c = p;
+
+    mpthread_set_name("lavfi");
+
+    pthread_mutex_lock(&c->lock);
+    while (!c->terminate) {
+        if (!c->work) {
+            pthread_cond_wait(&c->wakeup, &c->lock);
+            continue;
+        }
+        c->work = false;
+
+        transfer_in(c);
+
+        c->busy = true;
+        pthread_mutex_unlock(&c->lock);
+        bool progress = process_graph(c);
+        pthread_mutex_lock(&c->lock);
+        c->busy = false;
+
+        // Repeat until the state settles; wake up the player on each change.
+        if (publish(c)) {
+            progress = true;
+            if (c->wakeup_cb)
+                c->wakeup_cb(c->wakeup_ctx);
+        }
+        c->work |= progress;
+        pthread_cond_broadcast(&c->wakeup);
+    }
+    pthread_mutex_unlock(&c->lock);
+
+    return NULL;
+}
+
+// Called with the lock held.
+static void wakeup_worker(struct lavfi *c)
+{
+    c->work = true;
+    pthread_cond_broadcast(&c->wakeup);
 }
 
 void lavfi_seek_reset(struct lavfi *c)
 {
+    pthread_mutex_lock(&c->lock);
+    while (c->busy)
+        pthread_cond_wait(&c->wakeup, &c->lock);
     free_graph(c);
     clear_data(c);
     precreate_graph(c);
+    c->caller_failed = c->failed;
+    if (c->started)
+        wakeup_worker(c);
+    pthread_mutex_unlock(&c->lock);
 }
 
-struct lavfi *lavfi_create(struct mp_log *log, char *graph_string)
+// wakeup_cb is called (from the worker thread) when new output is available,
+// or when the graph wants new input.
+struct lavfi *lavfi_create(struct mp_log *log, char *graph_string,
+                           void (*wakeup_cb)(void *ctx), void *wakeup_ctx)
 {
     struct lavfi *c = talloc_zero(NULL, struct lavfi);
     c->log = log;
     c->graph_string = graph_string;
+    c->wakeup_cb = wakeup_cb;
+    c->wakeup_ctx = wakeup_ctx;
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_cond_init(&c->wakeup, NULL);
     precreate_graph(c);
+    c->caller_failed = c->failed;
+    if (pthread_create(&c->thread, NULL, lavfi_thread, c)) {
+        pthread_cond_destroy(&c->wakeup);
+        pthread_mutex_destroy(&c->lock);
+        free_graph(c);
+        talloc_free(c);
+        return NULL;
+    }
     return c;
 }
 
 void lavfi_destroy(struct lavfi *c)
 {
+    if (!c)
+        return;
+    pthread_mutex_lock(&c->lock);
+    c->terminate = true;
+    pthread_cond_broadcast(&c->wakeup);
+    pthread_mutex_unlock(&c->lock);
+    pthread_join(c->thread, NULL);
+
     free_graph(c);
     clear_data(c);
+    pthread_cond_destroy(&c->wakeup);
+    pthread_mutex_destroy(&c->lock);
     talloc_free(c);
 }
 
@@ -265,12 +480,21 @@ enum stream_type lavfi_pad_type(struct lavfi_pad *pad)
 
 void lavfi_set_connected(struct lavfi_pad *pad, bool connected)
 {
-    pad->connected = connected;
+    struct lavfi *c = pad->main;
+    pthread_mutex_lock(&c->lock);
+    pad->caller_connected = connected;
+    if (c->started)
+        wakeup_worker(c);
+    pthread_mutex_unlock(&c->lock);
 }
 
 bool lavfi_get_connected(struct lavfi_pad *pad)
 {
-    return pad->connected;
+    struct lavfi *c = pad->main;
+    pthread_mutex_lock(&c->lock);
+    bool r = pad->caller_connected;
+    pthread_mutex_unlock(&c->lock);
+    return r;
 }
 
 // Ensure to send EOF to each input pad, so the graph can be drained properly.
@@ -423,6 +647,21 @@ static bool init_pads(struct lavfi *c)
                                              name, src_args, NULL, c->graph) < 0)
                 goto error;
 
+#if HAVE_AVFILTER_HWFRAMES
+            // Pass hardware surfaces through with their frames context.
+            struct mp_image *img = pad->pending_v;
+            if (img && IMGFMT_IS_HWACCEL(img->imgfmt) && img->hwctx) {
+                AVBufferSrcParameters *par = av_buffersrc_parameters_alloc();
+                if (!par)
+                    goto error;
+                par->hw_frames_ctx = img->hwctx; // referenced by the call below
+                int r = av_buffersrc_parameters_set(pad->buffer, par);
+                av_free(par);
+                if (r < 0)
+                    goto error;
+            }
+#endif
+
             if (avfilter_link(pad->buffer, 0, pad->filter, pad->filter_pad) < 0)
                 goto error;
         }
@@ -473,9 +712,11 @@ static void init_graph(struct lavfi *c)
     }
 }
 
-static void feed_input_pads(struct lavfi *c)
+// Returns whether any frame or EOF was sent to the graph.
+static bool feed_input_pads(struct lavfi *c)
 {
     assert(c->initialized);
+    bool fed = false;
 
     for (int n = 0; n < c->num_pads; n++) {
         struct lavfi_pad *pad = c->pads[n];
@@ -528,11 +769,14 @@ static void feed_input_pads(struct lavfi *c)
         if (av_buffersrc_add_frame(pad->buffer, frame) < 0)
             MP_FATAL(c, "could not pass frame to filter\n");
         av_frame_free(&frame);
+        fed = true;
 
         pad->input_again = false;
         pad->input_eof = eof;
         pad->input_waiting = eof; // input _might_ come again in the future
     }
+
+    return fed;
 }
 
 static void read_output_pads(struct lavfi *c)
@@ -593,24 +837,26 @@ static void read_output_pads(struct lavfi *c)
     }
 }
 
-// Process filter input and outputs. Return if progress was made (then the
-// caller should repeat). If it returns false, the caller should go to sleep
-// (as all inputs are asleep as well and no further output can be produced).
-bool lavfi_process(struct lavfi *c)
+// Process filter input and outputs. Run by the worker thread. Returns true if
+// the graph state changed in a way that requires another pass (new input was
+// fed, or the graph was (re)created), even if nothing changed for the caller.
+static bool process_graph(struct lavfi *c)
 {
+    bool progress = false;
+
     check_format_changes(c);
 
-    if (!c->initialized)
+    if (!c->initialized) {
         init_graph(c);
+        progress |= c->initialized;
+    }
 
     if (c->initialized) {
         read_output_pads(c);
-        feed_input_pads(c);
+        progress |= feed_input_pads(c);
     }
 
     bool all_waiting = true;
-    bool any_needs_input = false;
-    bool any_needs_output = false;
     bool all_lavfi_eof = true;
     bool all_input_eof = true;
 
@@ -620,11 +866,9 @@ bool lavfi_process(struct lavfi *c)
 
         if (pad->dir == LAVFI_IN) {
             all_waiting &= pad->input_waiting;
-            any_needs_input |= pad->input_needed;
             all_input_eof &= pad->input_eof;
         } else if (pad->dir == LAVFI_OUT) {
             all_lavfi_eof &= pad->buffer_is_eof;
-            any_needs_output |= pad->output_needed;
         }
     }
 
@@ -632,69 +876,105 @@ bool lavfi_process(struct lavfi *c)
         free_graph(c);
         precreate_graph(c);
         all_waiting = false;
-        any_needs_input = true;
+        progress = true;
     }
 
     c->all_waiting = all_waiting;
-    return (any_needs_input || any_needs_output) && !all_waiting;
+    return progress;
+}
+
+// Return whether the caller should feed input (i.e. call lavfi_needs_input()
+// on the input pads) without waiting. If it returns false, the caller can go
+// to sleep; the wakeup callback is invoked once the graph wants more input or
+// has produced new output.
+// The first call starts filtering, so all pads must be connected by then.
+bool lavfi_process(struct lavfi *c)
+{
+    pthread_mutex_lock(&c->lock);
+    if (!c->started) {
+        c->started = true;
+        wakeup_worker(c);
+    }
+    bool any_needs_input = false;
+    for (int n = 0; n < c->num_pads; n++) {
+        struct lavfi_pad *pad = c->pads[n];
+        if (pad->dir == LAVFI_IN)
+            any_needs_input |= pad->caller_needs_input;
+    }
+    bool r = any_needs_input && !c->caller_all_waiting;
+    pthread_mutex_unlock(&c->lock);
+    return r;
 }
 
 bool lavfi_has_failed(struct lavfi *c)
 {
-    return c->failed;
+    pthread_mutex_lock(&c->lock);
+    bool r = c->caller_failed;
+    pthread_mutex_unlock(&c->lock);
+    return r;
 }
 
 // Request an output frame on this output pad.
 // Returns req_status
-static int lavfi_request_frame(struct lavfi_pad *pad)
+static int lavfi_request_frame(struct lavfi_pad *pad,
+                               struct mp_audio **out_aframe,
+                               struct mp_image **out_vframe)
 {
+    struct lavfi *c = pad->main;
     assert(pad->dir == LAVFI_OUT);
 
-    if (pad->main->failed)
-        return DATA_EOF;
-
-    if (!(pad->pending_a || pad->pending_v)) {
-        pad->output_needed = true;
-        lavfi_process(pad->main);
-    }
-
-    if (pad->pending_a || pad->pending_v) {
-        return DATA_OK;
-    } else if (pad->output_eof) {
-        return DATA_EOF;
-    } else if (pad->main->all_waiting) {
-        return DATA_WAIT;
+    pthread_mutex_lock(&c->lock);
+    int r;
+    if (c->caller_failed) {
+        r = DATA_EOF;
+    } else if (pad->handoff_a || pad->handoff_v) {
+        *out_aframe = pad->handoff_a;
+        *out_vframe = pad->handoff_v;
+        pad->handoff_a = NULL;
+        pad->handoff_v = NULL;
+        wakeup_worker(c); // start filtering the next frame
+        r = DATA_OK;
+    } else if (pad->caller_eof) {
+        r = DATA_EOF;
+    } else {
+        // The worker calls the wakeup callback once there is new output.
+        r = DATA_WAIT;
     }
-    return DATA_AGAIN;
+    pthread_mutex_unlock(&c->lock);
+    return r;
 }
 
 // Try to read a new frame from an output pad. Returns one of the following:
 //      DATA_OK: a frame is returned
-//      DATA_AGAIN: needs more input data
-//      DATA_WAIT: needs more input data, and all inputs in LAVFI_WAIT state
+//      DATA_WAIT: no frame yet; the wakeup callback will be called
 //      DATA_EOF: no more data
 int lavfi_request_frame_a(struct lavfi_pad *pad, struct mp_audio **out_aframe)
 {
-    int r = lavfi_request_frame(pad);
-    *out_aframe = pad->pending_a;
-    pad->pending_a = NULL;
+    struct mp_image *vframe = NULL;
+    *out_aframe = NULL;
+    int r = lavfi_request_frame(pad, out_aframe, &vframe);
+    assert(!vframe);
     return r;
 }
 
 // See lavfi_request_frame_a() for remarks.
 int lavfi_request_frame_v(struct lavfi_pad *pad, struct mp_image **out_vframe)
 {
-    int r = lavfi_request_frame(pad);
-    *out_vframe = pad->pending_v;
-    pad->pending_v = NULL;
+    struct mp_audio *aframe = NULL;
+    *out_vframe = NULL;
+    int r = lavfi_request_frame(pad, &aframe, out_vframe);
+    assert(!aframe);
     return r;
 }
 
 bool lavfi_needs_input(struct lavfi_pad *pad)
 {
+    struct lavfi *c = pad->main;
     assert(pad->dir == LAVFI_IN);
-    lavfi_process(pad->main);
-    return pad->input_needed;
+    pthread_mutex_lock(&c->lock);
+    bool r = pad->caller_needs_input;
+    pthread_mutex_unlock(&c->lock);
+    return r;
 }
 
 // A filter user is supposed to call lavfi_needs_input(), and if that returns
@@ -707,40 +987,44 @@ bool lavfi_needs_input(struct lavfi_pad *pad)
 // allowed.
 void lavfi_send_status(struct lavfi_pad *pad, int status)
 {
+    struct lavfi *c = pad->main;
     assert(pad->dir == LAVFI_IN);
-    assert(pad->input_needed);
     assert(status != DATA_OK);
-    assert(!pad->pending_v && !pad->pending_a);
 
-    pad->input_waiting = status == DATA_WAIT || status == DATA_EOF;
-    pad->input_again = status == DATA_AGAIN;
-    pad->input_eof = status == DATA_EOF;
+    pthread_mutex_lock(&c->lock);
+    assert(pad->caller_needs_input);
+    pad->caller_needs_input = false;
+    pad->handoff_status = status;
+    wakeup_worker(c);
+    pthread_mutex_unlock(&c->lock);
 }
 
-static void lavfi_sent_frame(struct lavfi_pad *pad)
+static void lavfi_send_frame(struct lavfi_pad *pad, struct mp_audio *aframe,
+                             struct mp_image *vframe)
 {
+    struct lavfi *c = pad->main;
     assert(pad->dir == LAVFI_IN);
-    assert(pad->input_needed);
-    assert(pad->pending_a || pad->pending_v);
-    pad->input_waiting = pad->input_again = pad->input_eof = false;
-    pad->input_needed = false;
+
+    pthread_mutex_lock(&c->lock);
+    assert(pad->caller_needs_input);
+    assert(!pad->handoff_a && !pad->handoff_v);
+    pad->caller_needs_input = false;
+    pad->handoff_a = aframe;
+    pad->handoff_v = vframe;
+    wakeup_worker(c);
+    pthread_mutex_unlock(&c->lock);
 }
 
 // See lavfi_send_status() for remarks.
 void lavfi_send_frame_a(struct lavfi_pad *pad, struct mp_audio *aframe)
 {
     assert(pad->type == STREAM_AUDIO);
-    assert(!pad->pending_a);
-    pad->pending_a = aframe;
-    lavfi_sent_frame(pad);
+    lavfi_send_frame(pad, aframe, NULL);
 }
 
 // See lavfi_send_status() for remarks.
 void lavfi_send_frame_v(struct lavfi_pad *pad, struct mp_image *vframe)
 {
     assert(pad->type == STREAM_VIDEO);
-    assert(!pad->pending_v);
-    pad->pending_v = vframe;
-    lavfi_sent_frame(pad);
+    lavfi_send_frame(pad, NULL, vframe);
 }
-
@@ -20,6 +20,7 @@
 #include <strings.h>
 #include <inttypes.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <libavutil/avutil.h>
 
@@ -29,9 +30,11 @@
 #include "osdep/io.h"
 #include "osdep/terminal.h"
 #include "osdep/timer.h"
+#include "osdep/threads.h"
 
 #include "common/msg.h"
 #include "common/global.h"
+#include "common/memgov.h"
 #include "options/path.h"
 #include "options/m_config.h"
 #include "options/parse_configfile.h"
@@ -54,7 +57,9 @@
 #include "video/out/vo.h"
 
 #include "core.h"
+#include "client.h"
 #include "command.h"
+#include "thumbnail.h"
 #include "libmpv/client.h"
 
 static void uninit_demuxer(struct MPContext *mpctx)
@@ -80,6 +85,9 @@ static void uninit_demuxer(struct MPContext *mpctx)
 
     free_demuxer_and_stream(mpctx->demuxer);
     mpctx->demuxer = NULL;
+
+    talloc_free(mpctx->demuxer_cancel);
+    mpctx->demuxer_cancel = NULL;
 }
 
 #define APPEND(s, ...) mp_snprintf_cat(s, sizeof(s), __VA_ARGS__)
@@ -204,6 +212,7 @@ void reselect_demux_stream(struct MPContext *mpctx, struct track *track)
 static void wakeup_demux(void *pctx)
 {
     struct MPContext *mpctx = pctx;
+    atomic_store(&mpctx->demux_woken, 1);
     mp_input_wakeup(mpctx->input);
 }
 
@@ -313,11 +322,13 @@ static bool compare_track(struct track *t1, struct track *t2, char **langs,
         return t1->default_track;
     if (t1->attached_picture != t2->attached_picture)
         return !t1->attached_picture;
-    if (t1->stream && t2->stream && opts->hls_bitrate >= 0 &&
+    // With adaptive switching, start with the lowest bitrate.
+    int hls_bitrate = opts->hls_bitrate == HLS_BITRATE_AUTO ? 0 : opts->hls_bitrate;
+    if (t1->stream && t2->stream && hls_bitrate >= 0 &&
         t1->stream->hls_bitrate != t2->stream->hls_bitrate)
     {
-        bool t1_ok = t1->stream->hls_bitrate <= opts->hls_bitrate;
-        bool t2_ok = t2->stream->hls_bitrate <= opts->hls_bitrate;
+        bool t1_ok = t1->stream->hls_bitrate <= hls_bitrate;
+        bool t2_ok = t2->stream->hls_bitrate <= hls_bitrate;
         if (t1_ok != t2_ok)
             return t1_ok;
         if (t1_ok && t2_ok)
@@ -620,7 +631,10 @@ void autoload_external_files(struct MPContext *mpctx)
                                     &stream_filename) > 0)
             base_filename = talloc_steal(tmp, stream_filename);
     }
-    struct subfn *list = find_external_files(mpctx->global, base_filename);
+    if (!mpctx->dir_cache)
+        mpctx->dir_cache = mp_dir_cache_create(mpctx);
+    struct subfn *list = find_external_files(mpctx->global, mpctx->dir_cache,
+                                             base_filename);
     talloc_steal(tmp, list);
 
     int sc[STREAM_TYPE_COUNT] = {0};
@@ -700,7 +714,7 @@ static void transfer_playlist(struct MPContext *mpctx, struct playlist *pl)
 static int process_open_hooks(struct MPContext *mpctx)
 {
 
-    mp_hook_run(mpctx, NULL, "on_load");
+    mp_hook_start(mpctx, "on_load");
 
     while (!mp_hook_test_completion(mpctx, "on_load")) {
         mp_idle(mpctx);
@@ -717,7 +731,7 @@ static int process_open_hooks(struct MPContext *mpctx)
 
 static int process_preloaded_hooks(struct MPContext *mpctx)
 {
-    mp_hook_run(mpctx, NULL, "on_preloaded");
+    mp_hook_start(mpctx, "on_preloaded");
 
     while (!mp_hook_test_completion(mpctx, "on_preloaded")) {
         mp_idle(mpctx);
@@ -730,7 +744,7 @@ static int process_preloaded_hooks(struct MPContext *mpctx)
 
 static void process_unload_hooks(struct MPContext *mpctx)
 {
-    mp_hook_run(mpctx, NULL, "on_unload");
+    mp_hook_start(mpctx, "on_unload");
 
     while (!mp_hook_test_completion(mpctx, "on_unload"))
         mp_idle(mpctx);
@@ -806,6 +820,168 @@ static void open_demux_thread(void *pctx)
         demux_set_ts_offset(args->demux, -args->demux->start_time);
 }
 
+// Opening the next playlist entry in the background (--prefetch-playlist).
+struct playlist_prefetch {
+    struct MPContext *mpctx;
+    struct demux_open_args args;
+    struct mp_cancel *cancel;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    bool done;
+};
+
+static void *prefetch_thread(void *p)
+{
+    struct playlist_prefetch *pf = p;
+    mpthread_set_name("prefetch");
+    open_demux_thread(&pf->args);
+    pthread_mutex_lock(&pf->lock);
+    pf->done = true;
+    pthread_mutex_unlock(&pf->lock);
+    mp_input_wakeup(pf->mpctx->input); // this interrupts mp_idle()
+    return NULL;
+}
+
+// Start opening the playlist entry following the current one, if enabled.
+// Does nothing if a prefetch is already running.
+// Only the demuxer is opened. The VO and (with --gapless-audio) the AO are
+// kept across playlist entries anyway, so there is nothing to prepare there.
+void prefetch_next(struct MPContext *mpctx)
+{
+    struct MPOpts *opts = mpctx->opts;
+    if (!opts->prefetch_playlist || mpctx->prefetch ||
+        mpctx->playlist->current_was_replaced)
+        return;
+
+    struct playlist_entry *e = playlist_get_next(mpctx->playlist, +1);
+    // Per-file options would have to be applied before opening.
+    if (!e || e->num_params)
+        return;
+    // on_load hooks (such as ytdl_hook.lua) typically replace network URLs,
+    // and can't be run before the entry is actually played. Opening the
+    // original URL would be wasted effort.
+    if (mp_is_url(bstr0(e->filename)) && mp_hook_has_handlers(mpctx, "on_load"))
+        return;
+
+    struct playlist_prefetch *pf = talloc_zero(NULL, struct playlist_prefetch);
+    pf->mpctx = mpctx;
+    pf->cancel = mp_cancel_new(pf);
+    pf->args = (struct demux_open_args){
+        .global = create_sub_global(mpctx),
+        .cancel = pf->cancel,
+        .log = mpctx->log,
+        .stream_flags = e->stream_flags,
+        .url = talloc_strdup(pf, e->filename),
+    };
+    if (opts->load_unsafe_playlists)
+        pf->args.stream_flags = 0;
+    pthread_mutex_init(&pf->lock, NULL);
+    if (pthread_create(&pf->thread, NULL, prefetch_thread, pf)) {
+        pthread_mutex_destroy(&pf->lock);
+        talloc_free(pf->args.global);
+        talloc_free(pf);
+        return;
+    }
+    MP_VERBOSE(mpctx, "Prefetching '%s'.\n", pf->args.url);
+    mpctx->prefetch = pf;
+}
+
+// Wait for the prefetch thread and free the prefetch state. If discard is
+// false, the caller has taken over args.demux and args.global.
+static void free_prefetch(struct MPContext *mpctx, bool discard)
+{
+    struct playlist_prefetch *pf = mpctx->prefetch;
+    pthread_join(pf->thread, NULL);
+    pthread_mutex_destroy(&pf->lock);
+    if (discard) {
+        free_demuxer_and_stream(pf->args.demux);
+        talloc_free(pf->args.global);
+    }
+    talloc_free(pf);
+    mpctx->prefetch = NULL;
+}
+
+// Abort and discard a running or finished prefetch.
+void cancel_prefetch(struct MPContext *mpctx)
+{
+    struct playlist_prefetch *pf = mpctx->prefetch;
+    if (!pf)
+        return;
+    mp_cancel_trigger(pf->cancel);
+    free_prefetch(mpctx, true);
+}
+
+// With --vo-preinit, create the VO while the demuxer is being opened, so that
+// the (often slow) window and GPU context creation overlaps with network or
+// disk I/O. If the file turns out to have no video, handle_force_window()
+// destroys the VO again once loading has finished.
+static void preinit_video_out(struct MPContext *mpctx)
+{
+    struct MPOpts *opts = mpctx->opts;
+    if (!opts->vo_preinit || mpctx->video_out || mpctx->stop_play ||
+        opts->stream_id[0][STREAM_VIDEO] == -2)
+        return;
+    struct vo_extra ex = {
+        .input_ctx = mpctx->input,
+        .osd = mpctx->osd,
+        .encode_lavc_ctx = mpctx->encode_lavc_ctx,
+        .opengl_cb_context = mpctx->gl_cb_ctx,
+        .sw_cb_context = mpctx->sw_cb_ctx,
+    };
+    mpctx->video_out = init_best_video_out(mpctx->global, &ex);
+    if (mpctx->video_out) {
+        mpctx->mouse_cursor_visible = true;
+        mp_startup_trace(mpctx, "VO preinit");
+    }
+}
+
+// If the prefetched file matches args, wait for it to finish opening (while
+// processing input), and move the demuxer to args. Otherwise (or if opening
+// it failed), discard the prefetch and return false.
+static bool take_prefetched(struct MPContext *mpctx,
+                            struct demux_open_args *args)
+{
+    struct playlist_prefetch *pf = mpctx->prefetch;
+    if (!pf)
+        return false;
+    if (strcmp(pf->args.url, args->url) != 0 ||
+        pf->args.stream_flags != args->stream_flags)
+    {
+        MP_VERBOSE(mpctx, "Discarding prefetched '%s'.\n", pf->args.url);
+        cancel_prefetch(mpctx);
+        return false;
+    }
+
+    preinit_video_out(mpctx);
+
+    for (;;) {
+        pthread_mutex_lock(&pf->lock);
+        bool done = pf->done;
+        pthread_mutex_unlock(&pf->lock);
+        if (done)
+            break;
+
+        mp_idle(mpctx);
+
+        if (mpctx->stop_play)
+            mp_cancel_trigger(pf->cancel);
+    }
+
+    if (!pf->args.demux || mpctx->stop_play) {
+        cancel_prefetch(mpctx);
+        return false;
+    }
+
+    MP_VERBOSE(mpctx, "Using prefetched '%s'.\n", pf->args.url);
+    talloc_free(args->global);
+    args->global = pf->args.global;
+    args->demux = pf->args.demux;
+    // The stream keeps the cancel handle it was opened with.
+    mpctx->demuxer_cancel = talloc_steal(NULL, pf->cancel);
+    free_prefetch(mpctx, false);
+    return true;
+}
+
 static void open_demux_reentrant(struct MPContext *mpctx)
 {
     struct demux_open_args args = {
@@ -817,7 +993,10 @@ static void open_demux_reentrant(struct MPContext *mpctx)
     };
     if (mpctx->opts->load_unsafe_playlists)
         args.stream_flags = 0;
-    mpctx_run_reentrant(mpctx, open_demux_thread, &args);
+    if (!take_prefetched(mpctx, &args))
+        mpctx_run_reentrant(mpctx, open_demux_thread, &args,
+                            preinit_video_out);
+    mp_startup_trace(mpctx, "demuxer open");
     if (args.demux) {
         talloc_steal(args.demux, args.global);
         mpctx->demuxer = args.demux;
@@ -838,7 +1017,7 @@ static bool init_complex_filters(struct MPContext *mpctx)
     if (!graph || !graph[0])
         return true;
 
-    mpctx->lavfi = lavfi_create(mpctx->log, graph);
+    mpctx->lavfi = lavfi_create(mpctx->log, graph, wakeup_playloop, mpctx);
     if (!mpctx->lavfi)
         return false;
 
@@ -945,6 +1124,9 @@ static void play_current_file(struct MPContext *mpctx)
     struct MPOpts *opts = mpctx->opts;
     double playback_start = -1e100;
 
+    // The published values belong to the previous file.
+    mp_client_unpublish_properties(mpctx);
+
     mp_notify(mpctx, MPV_EVENT_START_FILE, NULL);
 
     mp_cancel_reset(mpctx->playback_abort);
@@ -961,13 +1143,19 @@ static void play_current_file(struct MPContext *mpctx)
     mpctx->paused = false;
     mpctx->paused_for_cache = false;
     mpctx->cache_buffer = -1;
+    mpctx->cache_media_rate = mpctx->cache_fill_rate = -1;
+    mpctx->cache_underrun_time = MP_NOPTS_VALUE;
     mpctx->playing_msg_shown = false;
     mpctx->max_frames = -1;
     mpctx->video_speed = mpctx->audio_speed = opts->playback_speed;
     mpctx->speed_factor_a = mpctx->speed_factor_v = 1.0;
+    mpctx->latency_speed = 1.0;
+    talloc_free(mpctx->hls.log);
+    mpctx->hls = (struct hls_adapt){.last_ts = MP_NOPTS_VALUE};
     mpctx->display_sync_error = 0.0;
     mpctx->display_sync_active = false;
     mpctx->seek = (struct seek_params){ 0 };
+    mpctx->seek_preview_active = false;
 
     reset_playback_state(mpctx);
 
@@ -1001,6 +1189,9 @@ static void play_current_file(struct MPContext *mpctx)
     load_per_file_options(mpctx->mconfig, mpctx->playing->params,
                           mpctx->playing->num_params);
 
+    mp_memgov_set_budget(mpctx->global->memgov,
+                         opts->memory_budget * 1024LL * 1024);
+
     mpctx->max_frames = opts->play_frames;
 
     handle_force_window(mpctx, false);
@@ -1156,6 +1347,8 @@ reopen_file:
 
 terminate_playback:
 
+    mp_client_unpublish_properties(mpctx);
+
     process_unload_hooks(mpctx);
 
     if (mpctx->stop_play == KEEP_PLAYING)
@@ -1168,8 +1361,11 @@ terminate_playback:
         opts->pause = 1;
 
     mp_cancel_trigger(mpctx->playback_abort);
+    if (mpctx->demuxer_cancel)
+        mp_cancel_trigger(mpctx->demuxer_cancel);
 
     // time to uninit all, except global stuff:
+    thumbnail_uninit(mpctx);
     uninit_complex_filters(mpctx);
     uninit_audio_chain(mpctx);
     uninit_video_chain(mpctx);
@@ -1321,6 +1517,8 @@ void mp_play_files(struct MPContext *mpctx)
         if (!mpctx->playlist->current && mpctx->opts->player_idle_mode < 2)
             break;
     }
+
+    cancel_prefetch(mpctx);
 }
 
 // Abort current playback and set the given entry to play next.
@@ -80,6 +80,10 @@ struct script_ctx {
     struct mp_log *log;
     struct mpv_handle *client;
     struct MPContext *mpctx;
+    bool pooled;        // don't enter the event loop after loading
+    bool own_loop;      // script replaced mp_event_loop (if pooled)
+    bool failed;        // script raised an error while loading
+    double next_timeout;
 };
 
 #if LUA_VERSION_NUM <= 501
@@ -254,6 +258,11 @@ static int load_scripts(lua_State *L)
 
     require(L, "mp.defaults");
 
+    if (ctx->pooled) {
+        lua_getglobal(L, "mp_event_loop"); // fn
+        lua_setfield(L, LUA_REGISTRYINDEX, "default_event_loop"); // -
+    }
+
     if (fname[0] == '@') {
         require(L, fname);
     } else {
@@ -263,6 +272,16 @@ static int load_scripts(lua_State *L)
     lua_getglobal(L, "mp_event_loop"); // fn
     if (lua_isnil(L, -1))
         luaL_error(L, "no event loop function\n");
+
+    if (ctx->pooled) {
+        // The caller runs the default event loop in steps; scripts with a
+        // custom event loop still need to be run as a whole.
+        lua_getfield(L, LUA_REGISTRYINDEX, "default_event_loop"); // fn def
+        ctx->own_loop = !lua_rawequal(L, -1, -2);
+        lua_pop(L, 2); // -
+        return 0;
+    }
+
     lua_call(L, 0, 0); // -
 
     return 0;
@@ -352,15 +371,27 @@ static int run_lua(lua_State *L)
     if (lua_pcall(L, 0, 0, -2)) { // errf [error]
         const char *e = lua_tostring(L, -1);
         MP_FATAL(ctx, "Lua error: %s\n", e ? e : "(unknown)");
+        ctx->failed = true;
     }
 
     return 0;
 }
 
-static int load_lua(struct mpv_handle *client, const char *fname)
+static void destroy_script(struct script_ctx *ctx)
+{
+    osd_set_external(ctx->mpctx->osd, ctx->client, 0, 0, NULL); // remove overlay
+    mp_resume_all(ctx->client);
+    if (ctx->state)
+        lua_close(ctx->state);
+    talloc_free(ctx);
+}
+
+// Load and run the script. If pooled is set, return after the main chunk
+// was run, instead of entering the event loop. Returns NULL on failure.
+static struct script_ctx *init_script(struct mpv_handle *client,
+                                      const char *fname, bool pooled)
 {
     struct MPContext *mpctx = mp_client_get_core(client);
-    int r = -1;
 
     struct script_ctx *ctx = talloc_ptrtype(NULL, ctx);
     *ctx = (struct script_ctx) {
@@ -369,6 +400,7 @@ static int load_lua(struct mpv_handle *client, const char *fname)
         .name = mpv_client_name(client),
         .log = mp_client_get_log(client),
         .filename = fname,
+        .pooled = pooled,
     };
 
     if (LUA_VERSION_NUM != 501 && LUA_VERSION_NUM != 502) {
@@ -388,15 +420,91 @@ static int load_lua(struct mpv_handle *client, const char *fname)
         goto error_out;
     }
 
-    r = 0;
+    return ctx;
 
 error_out:
-    osd_set_external(ctx->mpctx->osd, client, 0, 0, NULL); // remove overlay
-    mp_resume_all(client);
-    if (ctx->state)
-        lua_close(ctx->state);
-    talloc_free(ctx);
-    return r;
+    destroy_script(ctx);
+    return NULL;
+}
+
+static int load_lua(struct mpv_handle *client, const char *fname)
+{
+    struct script_ctx *ctx = init_script(client, fname, false);
+    if (!ctx)
+        return -1;
+    destroy_script(ctx);
+    return 0;
+}
+
+static void *start_lua(struct mpv_handle *client, const char *fname,
+                       bool *own_loop)
+{
+    struct script_ctx *ctx = init_script(client, fname, true);
+    if (ctx && ctx->failed) {
+        destroy_script(ctx);
+        ctx = NULL;
+    }
+    if (ctx)
+        *own_loop = ctx->own_loop;
+    return ctx;
+}
+
+// Call mp.dispatch_events() without allowing it to wait.
+static int dispatch_step(lua_State *L)
+{
+    struct script_ctx *ctx = lua_touserdata(L, -1);
+    lua_pop(L, 1); // -
+
+    lua_pushcfunction(L, error_handler); // errf
+    push_module_table(L, "mp"); // errf mp
+    lua_getfield(L, -1, "dispatch_events"); // errf mp fn
+    lua_remove(L, -2); // errf fn
+    lua_pushboolean(L, 0); // errf fn false
+    if (lua_pcall(L, 1, 1, -3)) { // errf error
+        const char *e = lua_tostring(L, -1);
+        MP_FATAL(ctx, "Lua error: %s\n", e ? e : "(unknown)");
+        ctx->next_timeout = -1;
+    } else { // errf res
+        // nil means the script wants to exit
+        ctx->next_timeout = lua_isnumber(L, -1) ? lua_tonumber(L, -1) : -1;
+    }
+    lua_pop(L, 2); // -
+    return 0;
+}
+
+static double step_lua(void *p)
+{
+    struct script_ctx *ctx = p;
+    if (mp_cpcall(ctx->state, dispatch_step, ctx)) {
+        MP_FATAL(ctx, "Lua error: unknown error\n");
+        ctx->next_timeout = -1;
+    }
+    double timeout = ctx->next_timeout;
+    if (timeout < 0)
+        destroy_script(ctx);
+    return timeout;
+}
+
+static int run_event_loop(lua_State *L)
+{
+    struct script_ctx *ctx = lua_touserdata(L, -1);
+    lua_pop(L, 1); // -
+
+    lua_pushcfunction(L, error_handler); // errf
+    lua_getglobal(L, "mp_event_loop"); // errf fn
+    if (lua_pcall(L, 0, 0, -2)) { // errf [error]
+        const char *e = lua_tostring(L, -1);
+        MP_FATAL(ctx, "Lua error: %s\n", e ? e : "(unknown)");
+    }
+    return 0;
+}
+
+static void run_loop_lua(void *p)
+{
+    struct script_ctx *ctx = p;
+    if (mp_cpcall(ctx->state, run_event_loop, ctx))
+        MP_FATAL(ctx, "Lua error: unknown error\n");
+    destroy_script(ctx);
 }
 
 static int check_loglevel(lua_State *L, int arg)
@@ -590,6 +698,19 @@ static int script_enable_messages(lua_State *L)
     return check_error(L, mpv_request_log_messages(ctx->client, level));
 }
 
+static int script_set_message_filter(lua_State *L)
+{
+    struct script_ctx *ctx = get_ctx(L);
+    const char *prefixes[64];
+    int num = lua_gettop(L);
+    if (num >= (int)MP_ARRAY_SIZE(prefixes))
+        luaL_error(L, "too many arguments");
+    for (int n = 0; n < num; n++)
+        prefixes[n] = luaL_checkstring(L, n + 1);
+    prefixes[num] = NULL;
+    return check_error(L, mpv_set_log_message_filter(ctx->client, prefixes));
+}
+
 static int script_command(lua_State *L)
 {
     struct script_ctx *ctx = get_ctx(L);
@@ -656,6 +777,9 @@ static int script_set_property_number(lua_State *L)
     return check_error(L, res);
 }
 
+// Convert the Lua value at stack index t to a mpv_node. All memory is
+// allocated from tmp, which can be NULL only if the value is not a string or
+// table.
 static void makenode(void *tmp, mpv_node *dst, lua_State *L, int t)
 {
     if (t < 0)
@@ -770,10 +894,14 @@ static int script_set_property_native(lua_State *L)
     struct script_ctx *ctx = get_ctx(L);
     const char *p = luaL_checkstring(L, 1);
     struct mpv_node node;
-    void *tmp = mp_lua_PITA(L);
+    // Only strings and tables need allocations.
+    int type = lua_type(L, 2);
+    bool need_tmp = type == LUA_TSTRING || type == LUA_TTABLE;
+    void *tmp = need_tmp ? mp_lua_PITA(L) : NULL;
     makenode(tmp, &node, L, 2);
     int res = mpv_set_property(ctx->client, p, MPV_FORMAT_NODE, &node);
-    talloc_free_children(tmp);
+    if (tmp)
+        talloc_free_children(tmp);
     return check_error(L, res);
 
 }
@@ -894,11 +1022,21 @@ static int script_get_property_native(lua_State *L)
     struct script_ctx *ctx = get_ctx(L);
     const char *name = luaL_checkstring(L, 1);
     mp_lua_optarg(L, 2);
-    void *tmp = mp_lua_PITA(L);
 
     mpv_node node;
     int err = mpv_get_property(ctx->client, name, MPV_FORMAT_NODE, &node);
     if (err >= 0) {
+        // Fast path for values without allocations (most properties).
+        switch (node.format) {
+        case MPV_FORMAT_NONE:
+        case MPV_FORMAT_FLAG:
+        case MPV_FORMAT_INT64:
+        case MPV_FORMAT_DOUBLE:
+            pushnode(L, &node);
+            return 1;
+        default: ;
+        }
+        void *tmp = mp_lua_PITA(L);
         auto_free_node(tmp, &node);
         pushnode(L, &node);
         talloc_free_children(tmp);
@@ -1259,6 +1397,7 @@ static const struct fn_entry main_fns[] = {
     FN_ENTRY(input_set_section_mouse_area),
     FN_ENTRY(format_time),
     FN_ENTRY(enable_messages),
+    FN_ENTRY(set_message_filter),
     FN_ENTRY(get_wakeup_pipe),
     {0}
 };
@@ -1308,4 +1447,7 @@ static void add_functions(struct script_ctx *ctx)
 const struct mp_scripting mp_scripting_lua = {
     .file_ext = "lua",
     .load = load_lua,
+    .start = start_lua,
+    .step = step_lua,
+    .run_loop = run_loop_lua,
 };
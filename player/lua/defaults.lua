@@ -463,7 +463,7 @@ function mp.dispatch_events(allow_wait)
         if wait > 0 then
             mp.resume_all()
             if allow_wait ~= true then
-                return
+                return wait
             end
         end
         local e = mp.wait_event(wait)
@@ -501,14 +501,16 @@ local function hook_run(id, cont)
     mp.commandv("hook-ack", cont)
 end
 
-function mp.add_hook(name, pri, cb)
+function mp.add_hook(name, pri, cb, opts)
     if not hook_registered then
         mp.register_script_message("hook_run", hook_run)
         hook_registered = true
     end
     local id = #hook_table + 1
     hook_table[id] = cb
-    mp.commandv("hook-add", name, id, pri)
+    opts = opts or {}
+    mp.commandv("hook-add", name, id, pri,
+                opts.parallel and "parallel" or "serial", opts.timeout or 0)
 end
 
 local mp_utils = package.loaded["mp.utils"]
@@ -1,11 +1,23 @@
 local utils = require 'mp.utils'
 local msg = require 'mp.msg'
+local options = require 'mp.options'
+
+local o = {
+    -- number of following playlist entries resolved while playing
+    prefetch = 1,
+    -- seconds for which a youtube-dl result is reused
+    cache_expiry = 1800,
+}
+options.read_options(o, "ytdl_hook")
 
 local ytdl = {
     path = "youtube-dl",
     searched = false
 }
 
+-- youtube-dl results, keyed by the full command line
+local cache = {}
+
 local function exec(args)
     local ret = utils.subprocess({args = args})
     return ret.status, ret.stdout, ret
@@ -57,80 +69,146 @@ local function edl_escape(url)
     return "%" .. string.len(url) .. "%" .. url
 end
 
+local function is_ytdl_url(url)
+    return (url:find("http://") == 1) or (url:find("https://") == 1)
+        or (url:find("ytdl://") == 1)
+end
 
-mp.add_hook("on_load", 10, function ()
-    local url = mp.get_property("stream-open-filename")
+local function build_command(url)
+    -- check for youtube-dl in mpv's config dir
+    if not (ytdl.searched) then
+        local ytdl_mcd = mp.find_config_file("youtube-dl")
+        if not (ytdl_mcd == nil) then
+            msg.verbose("found youtube-dl at: " .. ytdl_mcd)
+            ytdl.path = ytdl_mcd
+        end
+        ytdl.searched = true
+    end
 
-    if (url:find("http://") == 1) or (url:find("https://") == 1)
-        or (url:find("ytdl://") == 1) then
+    -- strip ytdl://
+    if (url:find("ytdl://") == 1) then
+        url = url:sub(8)
+    end
 
-        -- check for youtube-dl in mpv's config dir
-        if not (ytdl.searched) then
-            local ytdl_mcd = mp.find_config_file("youtube-dl")
-            if not (ytdl_mcd == nil) then
-                msg.verbose("found youtube-dl at: " .. ytdl_mcd)
-                ytdl.path = ytdl_mcd
-            end
-            ytdl.searched = true
-        end
+    local format = mp.get_property("options/ytdl-format")
+    local raw_options = mp.get_property_native("options/ytdl-raw-options")
+    local allsubs = true
 
-        -- strip ytdl://
-        if (url:find("ytdl://") == 1) then
-            url = url:sub(8)
-        end
+    local command = {
+        ytdl.path, "--no-warnings", "-J", "--flat-playlist",
+        "--sub-format", "ass/srt/best", "--no-playlist"
+    }
 
-        local format = mp.get_property("options/ytdl-format")
-        local raw_options = mp.get_property_native("options/ytdl-raw-options")
-        local allsubs = true
+    -- Checks if video option is "no", change format accordingly,
+    -- but only if user didn't explicitly set one
+    if (mp.get_property("options/vid") == "no")
+        and not option_was_set("ytdl-format") then
 
-        local command = {
-            ytdl.path, "--no-warnings", "-J", "--flat-playlist",
-            "--sub-format", "ass/srt/best", "--no-playlist"
-        }
+        format = "bestaudio/best"
+        msg.verbose("Video disabled. Only using audio")
+    end
 
-        -- Checks if video option is "no", change format accordingly,
-        -- but only if user didn't explicitly set one
-        if (mp.get_property("options/vid") == "no")
-            and not option_was_set("ytdl-format") then
+    if (format ~= "") then
+        table.insert(command, "--format")
+        table.insert(command, format)
+    end
 
-            format = "bestaudio/best"
-            msg.verbose("Video disabled. Only using audio")
+    for param, arg in pairs(raw_options) do
+        table.insert(command, "--" .. param)
+        if (arg ~= "") then
+            table.insert(command, arg)
         end
-
-        if (format ~= "") then
-            table.insert(command, "--format")
-            table.insert(command, format)
+        if (param == "sub-lang") and (arg ~= "") then
+            allsubs = false
         end
+    end
 
-        for param, arg in pairs(raw_options) do
-            table.insert(command, "--" .. param)
-            if (arg ~= "") then
-                table.insert(command, arg)
-            end
-            if (param == "sub-lang") and (arg ~= "") then
-                allsubs = false
-            end
+    if (allsubs == true) then
+        table.insert(command, "--all-subs")
+    end
+    table.insert(command, "--")
+    table.insert(command, url)
+    return command
+end
+
+-- Run youtube-dl on the URL, or reuse a recent result. Returns the parsed
+-- JSON, or nil and an error message (nil if the process was killed).
+local function resolve(url)
+    local command = build_command(url)
+    local key = table.concat(command, "\n")
+    local now = mp.get_time()
+
+    local cached = cache[key]
+    if cached and now - cached.time < o.cache_expiry then
+        msg.verbose("using cached youtube-dl result")
+        return cached.json
+    end
+
+    msg.debug("Running: " .. table.concat(command,' '))
+    local es, json, result = exec(command)
+
+    if (es < 0) or (json == nil) or (json == "") then
+        if result.killed_by_us then
+            return nil, nil
         end
+        return nil, "youtube-dl failed"
+    end
+
+    local json, err = utils.parse_json(json)
 
-        if (allsubs == true) then
-            table.insert(command, "--all-subs")
+    if (json == nil) then
+        return nil, "failed to parse JSON data: " .. err
+    end
+
+    -- drop expired entries, so the cache doesn't grow forever
+    for k, v in pairs(cache) do
+        if now - v.time >= o.cache_expiry then
+            cache[k] = nil
         end
-        table.insert(command, "--")
-        table.insert(command, url)
-        msg.debug("Running: " .. table.concat(command,' '))
-        local es, json, result = exec(command)
-
-        if (es < 0) or (json == nil) or (json == "") then
-            if not result.killed_by_us then
-                msg.warn("youtube-dl failed, trying to play URL directly ...")
+    end
+    cache[key] = {time = now, json = json}
+
+    return json
+end
+
+-- Resolve the next playlist entries, so that their on_load hook can use
+-- the cached result instead of waiting for youtube-dl.
+local function prefetch()
+    if o.prefetch < 1 or o.cache_expiry <= 0 then
+        return
+    end
+    local pos = mp.get_property_number("playlist-pos")
+    local playlist = mp.get_property_native("playlist")
+    if (pos == nil) or (playlist == nil) then
+        return
+    end
+    -- playlist-pos is 0-based, the Lua array 1-based
+    for i = pos + 2, math.min(pos + 1 + o.prefetch, #playlist) do
+        local url = playlist[i].filename
+        if is_ytdl_url(url) then
+            msg.verbose("prefetching " .. url)
+            local json, err = resolve(url)
+            if (json == nil) and err then
+                msg.verbose("prefetching failed: " .. err)
             end
-            return
         end
+    end
+end
+
+mp.register_event("file-loaded", prefetch)
 
-        local json, err = utils.parse_json(json)
+
+mp.add_hook("on_load", 10, function ()
+    local url = mp.get_property("stream-open-filename")
+
+    if is_ytdl_url(url) then
+
+        local json, err = resolve(url)
 
         if (json == nil) then
-            msg.error("failed to parse JSON data: " .. err)
+            if err then
+                msg.warn(err .. ", trying to play URL directly ...")
+            end
             return
         end
 
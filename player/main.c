@@ -25,15 +25,23 @@
 #include <signal.h>
 
 #include "config.h"
+
+#if HAVE_POSIX
+#include <sys/resource.h>
+#endif
 #include "mpv_talloc.h"
 
 #include "misc/dispatch.h"
+#include "misc/json.h"
+#include "misc/node.h"
 #include "osdep/io.h"
 #include "osdep/terminal.h"
 #include "osdep/timer.h"
 #include "osdep/main-fn.h"
+#include "osdep/threads.h"
 
 #include "common/av_log.h"
+#include "common/benchmark.h"
 #include "common/codecs.h"
 #include "common/encode.h"
 #include "options/m_config.h"
@@ -43,6 +51,7 @@
 #include "common/msg.h"
 #include "common/msg_control.h"
 #include "common/global.h"
+#include "common/memgov.h"
 #include "options/parse_configfile.h"
 #include "options/parse_commandline.h"
 #include "common/playlist.h"
@@ -107,6 +116,19 @@ static const char def_config[] =
     "idle=once\n"
     "screenshot-directory=~~desktop/\n"
     "\n"
+    "[low-latency]\n"
+    "audio-buffer=0\n"
+    "cache=no\n"
+    "cache-pause=no\n"
+    "demuxer-readahead-secs=0\n"
+    "demuxer-lavf-o=fflags=+nobuffer\n"
+    "demuxer-lavf-analyzeduration=0.1\n"
+    "vd-lavc-thread-type=slice\n"
+    "vd-queue-frames=0\n"
+    "video-queue-frames=0\n"
+    "interpolation=no\n"
+    "latency-target=0.5\n"
+    "\n"
     "[libmpv]\n"
     "config=no\n"
     "idle=yes\n"
@@ -121,6 +143,19 @@ static const char def_config[] =
     "input-media-keys=no\n"
     "input-app-events=no\n"
     "stop-playback-on-init-failure=yes\n"
+    "\n"
+    "[benchmark]\n"
+    "untimed=yes\n"
+    "aid=no\n"
+    "sid=no\n"
+    "framedrop=no\n"
+    "pause=no\n"
+    "keep-open=no\n"
+    "force-window=no\n"
+    "idle=no\n"
+    "resume-playback=no\n"
+    "load-scripts=no\n"
+    "osc=no\n"
 #if HAVE_ENCODING
     "\n"
     "[encoding]\n"
@@ -180,14 +215,72 @@ static void shutdown_clients(struct MPContext *mpctx)
     }
 }
 
+// Peak resident memory of the process in bytes, or -1 if unknown.
+static int64_t get_peak_memory(void)
+{
+#if HAVE_POSIX
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) == 0) {
+#ifdef __APPLE__
+        return ru.ru_maxrss;
+#else
+        return ru.ru_maxrss * (int64_t)1024;
+#endif
+    }
+#endif
+    return -1;
+}
+
+static void write_benchmark_report(struct MPContext *mpctx)
+{
+    struct MPOpts *opts = mpctx->opts;
+    if (!opts->benchmark || !opts->benchmark[0])
+        return;
+
+    bool demux_only = opts->benchmark_stage == MP_BENCHMARK_DEMUX;
+    struct mpv_node report;
+    if (!mp_msg_get_benchmark_report(mpctx->global,
+                                     demux_only ? "read packet" : "render",
+                                     &report))
+        return;
+
+    struct m_config_option *co =
+        m_config_get_co(mpctx->mconfig, bstr0("benchmark-stage"));
+    char *stage = m_option_print(co->opt, co->data);
+    node_map_add_string(&report, "stage", stage);
+    talloc_free(stage);
+    node_map_add_string(&report, "version", mpv_version);
+    node_map_add(&report, "peak-memory", MPV_FORMAT_INT64)->u.int64 =
+        get_peak_memory();
+
+    char *json = talloc_strdup(NULL, "");
+    json_write(&json, &report);
+
+    char *path = mp_get_user_path(NULL, mpctx->global, opts->benchmark);
+    FILE *f = strcmp(path, "-") == 0 ? stdout : fopen(path, "wb");
+    if (f) {
+        fprintf(f, "%s\n", json);
+        if (f != stdout)
+            fclose(f);
+    } else {
+        MP_ERR(mpctx, "Failed to write benchmark report to '%s'\n", path);
+    }
+
+    talloc_free(path);
+    talloc_free(json);
+    talloc_free(report.u.list);
+}
+
 void mp_destroy(struct MPContext *mpctx)
 {
+    shutdown_clients(mpctx);
+
 #if !defined(__MINGW32__)
     mp_uninit_ipc(mpctx->ipc_ctx);
     mpctx->ipc_ctx = NULL;
 #endif
 
-    shutdown_clients(mpctx);
+    screenshot_uninit(mpctx);
 
     uninit_audio_out(mpctx);
     uninit_video_out(mpctx);
@@ -205,6 +298,8 @@ void mp_destroy(struct MPContext *mpctx)
 
     talloc_free(mpctx->gl_cb_ctx);
     mpctx->gl_cb_ctx = NULL;
+    talloc_free(mpctx->sw_cb_ctx);
+    mpctx->sw_cb_ctx = NULL;
 
     osd_free(mpctx->osd);
 
@@ -222,6 +317,8 @@ void mp_destroy(struct MPContext *mpctx)
 
     uninit_libav(mpctx->global);
 
+    write_benchmark_report(mpctx);
+
     if (mpctx->autodetach)
         pthread_detach(pthread_self());
 
@@ -329,6 +426,19 @@ void wakeup_playloop(void *ctx)
     mp_input_wakeup(mpctx->input);
 }
 
+// Log how long the startup phase that just ended took. This stops after the
+// first file started playback, so the log shows the cold start only.
+void mp_startup_trace(struct MPContext *mpctx, const char *phase)
+{
+    if (mpctx->startup_done)
+        return;
+    int64_t now = mp_time_us();
+    MP_VERBOSE(mpctx, "startup: %s %.1f ms (total %.1f ms)\n", phase,
+               (now - mpctx->startup_last) / 1000.0,
+               (now - mpctx->startup_time) / 1000.0);
+    mpctx->startup_last = now;
+}
+
 struct MPContext *mp_create(void)
 {
     mp_time_init();
@@ -341,9 +451,12 @@ struct MPContext *mp_create(void)
         .playlist = talloc_struct(mpctx, struct playlist, {0}),
         .dispatch = mp_dispatch_create(mpctx),
         .playback_abort = mp_cancel_new(mpctx),
+        .startup_time = mp_time_us(),
     };
+    mpctx->startup_last = mpctx->startup_time;
 
     mpctx->global = talloc_zero(mpctx, struct mpv_global);
+    mpctx->global->memgov = mp_memgov_create(mpctx->global);
 
     // Nothing must call mp_msg*() and related before this
     mp_msg_init(mpctx->global);
@@ -424,6 +537,8 @@ int mp_initialize(struct MPContext *mpctx, char **options)
     if (handle_help_options(mpctx))
         return -2;
 
+    mp_startup_trace(mpctx, "config");
+
     if (!print_libav_versions(mp_null_log, 0)) {
         // Using mismatched libraries can be legitimate, but even then it's
         // a bad idea. We don't acknowledge its usefulness and stability.
@@ -437,15 +552,29 @@ int mp_initialize(struct MPContext *mpctx, char **options)
     }
 
     if (opts->dump_stats && opts->dump_stats[0]) {
-        if (mp_msg_open_stats_file(mpctx->global, opts->dump_stats) < 0)
+        if (mp_msg_open_stats_file(mpctx->global, opts->dump_stats,
+                                   opts->dump_stats_format == 1) < 0)
             MP_ERR(mpctx, "Failed to open stats file '%s'\n", opts->dump_stats);
     }
+
+    if (opts->benchmark && opts->benchmark[0]) {
+        // Options the user set explicitly take precedence over the profile.
+        m_config_set_profile(mpctx->mconfig, "benchmark",
+                             M_SETOPT_PRESERVE_CMDLINE);
+        // Earlier stages replace the parts of the pipeline they exclude.
+        if (opts->benchmark_stage <= MP_BENCHMARK_FILTER)
+            m_config_set_option0(mpctx->mconfig, "vo", "null");
+        if (opts->benchmark_stage <= MP_BENCHMARK_DECODE)
+            m_config_set_option0(mpctx->mconfig, "vf-clr", "");
+        mp_msg_enable_benchmark(mpctx->global);
+    }
     MP_STATS(mpctx, "start init");
 
     if (!mpctx->playlist->first && !opts->player_idle_mode)
         return -3;
 
     mp_input_load(mpctx->input);
+    mp_startup_trace(mpctx, "input");
 
 #if HAVE_ENCODING
     if (opts->encode_opts->file && opts->encode_opts->file[0]) {
@@ -468,11 +597,16 @@ int mp_initialize(struct MPContext *mpctx, char **options)
     // From this point on, all mpctx members are initialized.
     mpctx->initialized = true;
 
+    // Scanning the system fonts can take a while; overlap it with the rest of
+    // the startup instead of stalling on the first OSD message or subtitle.
+    osd_preload_fonts(mpctx->osd);
+
     mp_get_resume_defaults(mpctx);
 
     // Lua user scripts (etc.) can call arbitrary functions. Load them at a point
     // where this is safe.
     mp_load_scripts(mpctx);
+    mp_startup_trace(mpctx, "scripts");
 
     if (opts->consolecontrols && cas_terminal_owner(mpctx, mpctx))
         terminal_setup_getch(mpctx->input);
@@ -486,6 +620,7 @@ int mp_initialize(struct MPContext *mpctx, char **options)
     if (opts->w32_priority > 0)
         SetPriorityClass(GetCurrentProcess(), opts->w32_priority);
 #endif
+    mpthread_set_policy(opts->thread_realtime, opts->thread_affinity);
 #ifndef _WIN32
     // Deal with OpenSSL and GnuTLS not using MSG_NOSIGNAL.
     struct sigaction sa = { .sa_handler = SIG_IGN, .sa_flags = SA_RESTART };
@@ -496,6 +631,7 @@ int mp_initialize(struct MPContext *mpctx, char **options)
     prepare_playlist(mpctx, mpctx->playlist);
 
     MP_STATS(mpctx, "end init");
+    mp_startup_trace(mpctx, "init");
 
     return 0;
 }
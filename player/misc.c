@@ -263,6 +263,7 @@ struct mpv_global *create_sub_global(struct MPContext *mpctx)
         .log = mpctx->global->log,
         .opts = new_config->optstruct,
         .client_api = mpctx->clients,
+        .memgov = mpctx->global->memgov,
     };
     return new;
 }
@@ -289,8 +290,11 @@ static void *thread_wrapper(void *pctx)
 
 // Run the thread_fn in a new thread. Wait until the thread returns, but while
 // waiting, process input and input commands.
+// If main_fn is not NULL, it's called once on the main thread after thread_fn
+// was started, so that the caller can do other work while waiting.
 int mpctx_run_reentrant(struct MPContext *mpctx, void (*thread_fn)(void *arg),
-                        void *thread_arg)
+                        void *thread_arg,
+                        void (*main_fn)(struct MPContext *mpctx))
 {
     struct wrapper_args args = {mpctx, thread_fn, thread_arg};
     pthread_mutex_init(&args.mutex, NULL);
@@ -298,6 +302,8 @@ int mpctx_run_reentrant(struct MPContext *mpctx, void (*thread_fn)(void *arg),
     pthread_t thread;
     if (pthread_create(&thread, NULL, thread_wrapper, &args))
         goto done;
+    if (main_fn)
+        main_fn(mpctx);
     while (!success) {
         mp_idle(mpctx);
 
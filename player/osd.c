@@ -94,7 +94,7 @@ static void term_osd_update(struct MPContext *mpctx)
     char *s = join_lines(mpctx, parts, num_parts);
 
     if (strcmp(mpctx->term_osd_contents, s) == 0 &&
-        mp_msg_has_status_line(mpctx->global))
+        mp_msg_status_line_is_redundant(mpctx->global))
     {
         talloc_free(s);
     } else {
@@ -250,7 +250,8 @@ static void term_osd_print_status_lazy(struct MPContext *mpctx)
             }
             int64_t c = vo_get_drop_count(mpctx->video_out);
             struct dec_video *d_video = mpctx->vo_chain->video_src;
-            int dropped_frames = d_video ? d_video->dropped_frames : 0;
+            int dropped_frames =
+                d_video ? video_get_dropped_frames(d_video) : 0;
             if (c > 0 || dropped_frames > 0) {
                 saddf(&line, " Dropped: %"PRId64, c);
                 if (dropped_frames)
@@ -501,7 +502,7 @@ void update_osd_msg(struct MPContext *mpctx)
         if (!mpctx->osd_idle_update)
             return;
 
-        double delay = 0.050; // update the OSD at most this often
+        double delay = opts->status_update_interval;
         double diff = now - mpctx->osd_last_update;
         if (diff < delay) {
             mpctx->sleeptime = MPMIN(mpctx->sleeptime, delay - diff);
@@ -512,6 +513,22 @@ void update_osd_msg(struct MPContext *mpctx)
     mpctx->osd_idle_update = false;
     mpctx->osd_last_update = now;
 
+    // Forced updates happen on every video frame, but the status text (which
+    // is relatively expensive to build) is refreshed only at the configured
+    // rate. With --osd-fractions, the exact frame time is the point.
+    bool update_status = true;
+    if (!opts->osd_fractions) {
+        double diff = now - mpctx->osd_status_last_update;
+        if (diff >= 0 && diff < opts->status_update_interval) {
+            double sleep = opts->status_update_interval - diff;
+            mpctx->sleeptime = MPMIN(mpctx->sleeptime, sleep);
+            mpctx->osd_idle_update = true;
+            update_status = false;
+        }
+    }
+    if (update_status)
+        mpctx->osd_status_last_update = now;
+
     if (mpctx->osd_visible) {
         double sleep = mpctx->osd_visible - now;
         if (sleep > 0) {
@@ -563,7 +580,8 @@ void update_osd_msg(struct MPContext *mpctx)
     }
 
     term_osd_set_text_lazy(mpctx, mpctx->osd_msg_text);
-    term_osd_print_status_lazy(mpctx);
+    if (update_status)
+        term_osd_print_status_lazy(mpctx);
     term_osd_update(mpctx);
 
     if (!opts->video_osd)
@@ -573,8 +591,15 @@ void update_osd_msg(struct MPContext *mpctx)
     if (mpctx->osd_show_pos)
         osd_level = 3;
 
-    char *text = NULL;
-    sadd_osd_status(&text, mpctx, osd_level);
+    if (update_status || osd_level != mpctx->osd_status_level) {
+        talloc_free(mpctx->osd_status_text);
+        mpctx->osd_status_text = NULL;
+        sadd_osd_status(&mpctx->osd_status_text, mpctx, osd_level);
+        talloc_steal(mpctx, mpctx->osd_status_text);
+        mpctx->osd_status_level = osd_level;
+    }
+
+    char *text = talloc_strdup(NULL, mpctx->osd_status_text);
     if (mpctx->osd_msg_text && mpctx->osd_msg_text[0]) {
         text = talloc_asprintf_append(text, "%s%s", text ? "\n" : "",
                                       mpctx->osd_msg_text);
@@ -20,6 +20,7 @@
 #include <inttypes.h>
 #include <math.h>
 #include <assert.h>
+#include <stdarg.h>
 
 #include "config.h"
 #include "mpv_talloc.h"
@@ -44,11 +45,13 @@
 #include "sub/osd.h"
 #include "video/filter/vf.h"
 #include "video/decode/dec_video.h"
+#include "video/decode/vd.h"
 #include "video/out/vo.h"
 
 #include "core.h"
 #include "client.h"
 #include "command.h"
+#include "thumbnail.h"
 
 // Wait until mp_input_wakeup(mpctx->input) is called, since the last time
 // mp_wait_events() was called. (But see mp_process_input().)
@@ -61,6 +64,9 @@ void mp_wait_events(struct MPContext *mpctx, double sleeptime)
 // API threads. This also resets the "wakeup" flag used with mp_wait_events().
 void mp_process_input(struct MPContext *mpctx)
 {
+    // Property values shared between client property observers are valid only
+    // while the player state can't change.
+    mp_client_invalidate_property_snapshots(mpctx);
     mp_dispatch_queue_process(mpctx->dispatch, 0);
     for (;;) {
         mp_cmd_t *cmd = mp_input_read_cmd(mpctx->input);
@@ -68,6 +74,7 @@ void mp_process_input(struct MPContext *mpctx)
             break;
         run_command(mpctx, cmd, NULL);
         mp_cmd_free(cmd);
+        mp_client_invalidate_property_snapshots(mpctx);
         mp_dispatch_queue_process(mpctx->dispatch, 0);
     }
 }
@@ -100,15 +107,29 @@ void pause_player(struct MPContext *mpctx)
         ao_pause(mpctx->ao);
     if (mpctx->video_out)
         vo_set_paused(mpctx->video_out, true);
+    set_video_mirrors_paused(mpctx, true);
 
 end:
     mp_notify(mpctx, mpctx->opts->pause ? MPV_EVENT_PAUSE : MPV_EVENT_UNPAUSE, 0);
 }
 
+// Tell the decoder whether the user is stepping through frames, so that it
+// can prefer a threading mode with less latency.
+static void set_decoder_low_latency(struct MPContext *mpctx, bool low_latency)
+{
+    if (mpctx->vo_chain && mpctx->vo_chain->video_src) {
+        video_vd_control(mpctx->vo_chain->video_src, VDCTRL_SET_LOW_LATENCY,
+                         &(int){low_latency});
+    }
+}
+
 void unpause_player(struct MPContext *mpctx)
 {
     mpctx->opts->pause = 0;
 
+    if (!mpctx->step_frames)
+        set_decoder_low_latency(mpctx, false);
+
     if (mpctx->video_out && mpctx->opts->stop_screensaver)
         vo_control(mpctx->video_out, VOCTRL_KILL_SCREENSAVER, NULL);
 
@@ -125,6 +146,7 @@ void unpause_player(struct MPContext *mpctx)
         ao_resume(mpctx->ao);
     if (mpctx->video_out)
         vo_set_paused(mpctx->video_out, false);
+    set_video_mirrors_paused(mpctx, false);
 
     (void)get_relative_time(mpctx);     // ignore time that passed during pause
 
@@ -136,6 +158,7 @@ void add_step_frame(struct MPContext *mpctx, int dir)
 {
     if (!mpctx->vo_chain)
         return;
+    set_decoder_low_latency(mpctx, true);
     if (dir > 0) {
         mpctx->step_frames += 1;
         unpause_player(mpctx);
@@ -147,6 +170,24 @@ void add_step_frame(struct MPContext *mpctx, int dir)
     }
 }
 
+static void reset_seek_state(struct MPContext *mpctx)
+{
+    mpctx->hrseek_active = false;
+    mpctx->hrseek_framedrop = false;
+    mpctx->hrseek_lastframe = false;
+    mpctx->hrseek_backstep = false;
+    mpctx->playback_pts = MP_NOPTS_VALUE;
+    mpctx->last_seek_pts = MP_NOPTS_VALUE;
+    mpctx->cache_wait_time = 0;
+    mpctx->step_frames = 0;
+    mpctx->ab_loop_clip = true;
+    mpctx->restart_complete = false;
+
+#if HAVE_ENCODING
+    encode_lavc_discontinuity(mpctx->encode_lavc_ctx);
+#endif
+}
+
 // Clear some playback-related fields on file loading or after seeks.
 void reset_playback_state(struct MPContext *mpctx)
 {
@@ -163,21 +204,38 @@ void reset_playback_state(struct MPContext *mpctx)
     reset_video_state(mpctx);
     reset_audio_state(mpctx);
     reset_subtitle_state(mpctx);
+    reset_seek_state(mpctx);
+}
 
-    mpctx->hrseek_active = false;
-    mpctx->hrseek_framedrop = false;
-    mpctx->hrseek_lastframe = false;
-    mpctx->hrseek_backstep = false;
-    mpctx->playback_pts = MP_NOPTS_VALUE;
-    mpctx->last_seek_pts = MP_NOPTS_VALUE;
-    mpctx->cache_wait_time = 0;
-    mpctx->step_frames = 0;
-    mpctx->ab_loop_clip = true;
-    mpctx->restart_complete = false;
+// In audio-only playback, a seek into recently played audio can be served
+// from the audio seek cache, without touching demuxer, decoder or filters.
+static bool seek_from_audio_cache(struct MPContext *mpctx, double pts, int flags)
+{
+    if ((flags & MPSEEK_FLAG_NOFLUSH) || mpctx->lavfi ||
+        (mpctx->vo_chain && !mpctx->vo_chain->is_coverart))
+        return false;
+    for (int n = 0; n < NUM_PTRACKS; n++) {
+        if (mpctx->current_track[n][STREAM_SUB])
+            return false;
+    }
+    if (!audio_seek_cached(mpctx, pts))
+        return false;
 
-#if HAVE_ENCODING
-    encode_lavc_discontinuity(mpctx->encode_lavc_ctx);
-#endif
+    clear_audio_output_buffers(mpctx);
+    reset_seek_state(mpctx);
+    return true;
+}
+
+// With --hr-seek-preview, seeks this close to the previous seek are done as
+// keyframe seeks, and the exact seek is done once seeking stopped for this long.
+#define SEEK_PREVIEW_DELAY 0.3
+
+static void set_decoder_keyframes_only(struct MPContext *mpctx, bool enable)
+{
+    if (mpctx->vo_chain && mpctx->vo_chain->video_src) {
+        video_vd_control(mpctx->vo_chain->video_src, VDCTRL_SET_KEYFRAMES_ONLY,
+                         &(int){enable});
+    }
 }
 
 static void mp_seek(MPContext *mpctx, struct seek_params seek)
@@ -197,6 +255,10 @@ static void mp_seek(MPContext *mpctx, struct seek_params seek)
     double current_time = get_current_time(mpctx);
     if (current_time == MP_NOPTS_VALUE)
         current_time = 0;
+    // Relative seeks during preview are relative to the intended position,
+    // not to the keyframe being shown.
+    if (mpctx->seek_preview_active)
+        current_time = mpctx->seek_preview_pts;
     double seek_pts = MP_NOPTS_VALUE;
     int demux_flags = 0;
 
@@ -228,6 +290,20 @@ static void mp_seek(MPContext *mpctx, struct seek_params seek)
                   opts->hr_seek > 0 || seek.exact >= MPSEEK_EXACT) &&
                  seek_pts != MP_NOPTS_VALUE;
 
+    // While the user keeps seeking (e.g. dragging a seek bar), show keyframes
+    // only, and do the exact seek once seeking stops (handle_seek_preview()).
+    bool preview = hr_seek && opts->hr_seek_preview &&
+                   seek.type != MPSEEK_BACKSTEP &&
+                   (mpctx->seek_preview_active ||
+                    mp_time_sec() - mpctx->last_seek_time < SEEK_PREVIEW_DELAY);
+    if (preview) {
+        hr_seek = false;
+        mpctx->seek_preview_pts = seek_pts;
+        mpctx->seek_preview_exact = MPMAX(seek.exact, MPSEEK_EXACT);
+    }
+    mpctx->seek_preview_active = preview;
+    set_decoder_keyframes_only(mpctx, preview);
+
     if (seek.type == MPSEEK_FACTOR || seek.amount < 0 ||
         (seek.type == MPSEEK_ABSOLUTE && seek.amount < mpctx->last_chapter_pts))
         mpctx->last_chapter_seek = -2;
@@ -240,6 +316,15 @@ static void mp_seek(MPContext *mpctx, struct seek_params seek)
         demux_flags |= SEEK_FACTOR;
     }
 
+    if (seek_pts != MP_NOPTS_VALUE && !(demux_flags & SEEK_FACTOR) &&
+        seek_from_audio_cache(mpctx, seek_pts, seek.flags))
+    {
+        mpctx->last_seek_pts = seek_pts;
+        hr_seek = false;
+        demux_flags = 0;
+        goto done;
+    }
+
     if (hr_seek) {
         double hr_seek_offset = opts->hr_seek_demuxer_offset;
         // Always try to compensate for possibly bad demuxers in "special"
@@ -293,10 +378,12 @@ static void mp_seek(MPContext *mpctx, struct seek_params seek)
                    mpctx->hrseek_backstep ? " (backstep)" : "");
     }
 
+done:
     if (mpctx->stop_play == AT_END_OF_FILE)
         mpctx->stop_play = KEEP_PLAYING;
 
     mpctx->start_timestamp = mp_time_sec();
+    mpctx->last_seek_time = mpctx->start_timestamp;
     mpctx->sleeptime = 0;
 
     mp_notify(mpctx, MPV_EVENT_SEEK, NULL);
@@ -365,6 +452,24 @@ void execute_queued_seek(struct MPContext *mpctx)
     }
 }
 
+// Do the exact seek for a preview seek once the user stopped seeking.
+static void handle_seek_preview(struct MPContext *mpctx)
+{
+    if (!mpctx->seek_preview_active || mpctx->seek.type)
+        return;
+
+    double wait = mpctx->last_seek_time + SEEK_PREVIEW_DELAY - mp_time_sec();
+    if (wait > 0) {
+        mpctx->sleeptime = MPMIN(mpctx->sleeptime, wait);
+        return;
+    }
+
+    // Clear it first, so that mp_seek() does this as a normal seek.
+    mpctx->seek_preview_active = false;
+    queue_seek(mpctx, MPSEEK_ABSOLUTE, mpctx->seek_preview_pts,
+               mpctx->seek_preview_exact, 0);
+}
+
 // -1 if unknown
 double get_time_length(struct MPContext *mpctx)
 {
@@ -391,6 +496,25 @@ double get_current_time(struct MPContext *mpctx)
     return MP_NOPTS_VALUE;
 }
 
+// Time between the newest packet the demuxer has read and what is currently
+// being displayed (or heard). This includes the demuxer packet queue, the
+// decoders, filters and VO/AO buffers, but not data buffered without
+// timestamps (like the stream cache).
+double get_pipeline_latency(struct MPContext *mpctx)
+{
+    if (!mpctx->demuxer || mpctx->playback_pts == MP_NOPTS_VALUE)
+        return MP_NOPTS_VALUE;
+
+    struct demux_ctrl_reader_state s;
+    if (demux_control(mpctx->demuxer, DEMUXER_CTRL_GET_READER_STATE, &s) < 1)
+        return MP_NOPTS_VALUE;
+
+    if (s.ts_range[1] == MP_NOPTS_VALUE)
+        return MP_NOPTS_VALUE;
+
+    return MPMAX(s.ts_range[1] - mpctx->playback_pts, 0);
+}
+
 double get_playback_time(struct MPContext *mpctx)
 {
     double cur = get_current_time(mpctx);
@@ -523,14 +647,77 @@ static void handle_osd_redraw(struct MPContext *mpctx)
         mpctx->sleeptime = MPMIN(mpctx->sleeptime, 0.1);
         return;
     }
-    bool want_redraw = osd_query_and_reset_want_redraw(mpctx->osd) ||
-                       vo_want_redraw(mpctx->video_out);
+    bool osd_redraw = osd_query_and_reset_want_redraw(mpctx->osd);
+    redraw_video_mirrors(mpctx, osd_redraw);
+    bool want_redraw = osd_redraw || vo_want_redraw(mpctx->video_out);
     if (!want_redraw)
         return;
     vo_redraw(mpctx->video_out);
     mpctx->sleeptime = 0;
 }
 
+// Update the estimates of how fast playback consumes cached data (the media
+// bitrate of the selected streams), and how fast the cache fills. The last
+// valid value is kept while they can't be measured (e.g. the packet queues
+// are nearly empty during buffering, or the cache is full and idle).
+static void update_cache_rates(struct MPContext *mpctx,
+                               struct stream_cache_info *c)
+{
+    double media_rate = 0;
+    for (int n = 0; n < mpctx->num_tracks; n++) {
+        struct track *t = mpctx->tracks[n];
+        // Subtitles are sparse, and their queued duration says nothing about
+        // their bitrate.
+        if (!t->selected || !t->stream || t->demuxer != mpctx->demuxer ||
+            t->type == STREAM_SUB)
+            continue;
+        struct demux_stream_stats st;
+        demux_get_stream_stats(t->stream, &st);
+        if (st.queued_secs < 0)
+            continue; // duration unknown, can't contribute
+        // Too little queued for a meaningful rate; keep the old estimate.
+        if (st.queued_secs < 1.0) {
+            media_rate = 0;
+            break;
+        }
+        media_rate += st.queued_bytes / st.queued_secs;
+    }
+    if (media_rate > 0) {
+        mpctx->cache_media_rate = mpctx->cache_media_rate > 0
+            ? mpctx->cache_media_rate * 0.8 + media_rate * 0.2 : media_rate;
+    }
+
+    if (!c->idle && c->speed > 0) {
+        mpctx->cache_fill_rate = mpctx->cache_fill_rate > 0
+            ? mpctx->cache_fill_rate * 0.8 + c->speed * 0.2 : c->speed;
+    }
+}
+
+// For --cache-pause-mode=predictive: return how many seconds must be buffered
+// so that playback can continue until the end of the file (or for
+// --cache-pause-horizon seconds) without running out of data, assuming the
+// current rates. Returns -1 if this can't be estimated.
+static double get_predictive_cache_wait(struct MPContext *mpctx)
+{
+    struct MPOpts *opts = mpctx->opts;
+    double media = mpctx->cache_media_rate, fill = mpctx->cache_fill_rate;
+    if (media <= 0 || fill <= 0)
+        return -1;
+    double play_time = opts->cache_pause_horizon;
+    double len = get_time_length(mpctx), pos = get_current_time(mpctx);
+    if (len > 0 && pos != MP_NOPTS_VALUE)
+        play_time = MPMIN(play_time, MPMAX(len - pos, 0));
+    // Seconds of buffered media lost per second of playback.
+    double drain = MPMAX(1.0 - fill / media, 0);
+    // Still buffer a little, so that rate jitter doesn't cause an immediate
+    // stall if the link is just fast enough.
+    return MPMAX(play_time * drain, 1.0);
+}
+
+// With --prefetch-playlist, start opening the next file this many seconds
+// before the end of the current one.
+#define PREFETCH_REMAINING 10.0
+
 static void handle_pause_on_low_cache(struct MPContext *mpctx)
 {
     bool force_update = false;
@@ -540,19 +727,60 @@ static void handle_pause_on_low_cache(struct MPContext *mpctx)
 
     double now = mp_time_sec();
 
+    // While paused by the user, the cache state changes only if the demuxer
+    // thread does something (and then it wakes us up), or if the periodic
+    // update is due. Don't query the demuxer on other wakeups, such as
+    // client API requests.
+    bool demux_woken = atomic_fetch_and(&mpctx->demux_woken, 0);
+    if (mpctx->paused && !mpctx->paused_for_cache && mpctx->restart_complete &&
+        !demux_woken && mpctx->cache_buffer >= 0 &&
+        (mpctx->next_cache_update <= 0 || mpctx->next_cache_update > now))
+    {
+        if (mpctx->next_cache_update > 0) {
+            mpctx->sleeptime =
+                MPMIN(mpctx->sleeptime, mpctx->next_cache_update - now);
+        }
+        return;
+    }
+
     struct stream_cache_info c = {.idle = true};
     demux_stream_control(mpctx->demuxer, STREAM_CTRL_GET_CACHE_INFO, &c);
 
     struct demux_ctrl_reader_state s = {.idle = true, .ts_duration = -1};
     demux_control(mpctx->demuxer, DEMUXER_CTRL_GET_READER_STATE, &s);
 
+    // Open the next file shortly before this one ends. If the duration is
+    // unknown, wait until the demuxer has read everything.
+    double len = get_time_length(mpctx), pos = get_current_time(mpctx);
+    if (len > 0 && pos != MP_NOPTS_VALUE ? len - pos <= PREFETCH_REMAINING
+                                         : s.eof)
+        prefetch_next(mpctx);
+
     int cache_buffer = 100;
 
+    if (c.size > 0) {
+        update_cache_rates(mpctx, &c);
+        double media = mpctx->cache_media_rate, fill = mpctx->cache_fill_rate;
+        double underrun = MP_NOPTS_VALUE;
+        if (s.eof || (c.idle && s.idle)) {
+            underrun = -1; // everything that fits is buffered
+        } else if (s.ts_duration >= 0 && media > 0 && fill > 0) {
+            underrun = fill >= media ? -1 : s.ts_duration / (1.0 - fill / media);
+        }
+        mpctx->cache_underrun_time = underrun;
+    } else {
+        mpctx->cache_underrun_time = MP_NOPTS_VALUE;
+    }
+
     if (mpctx->restart_complete && c.size > 0) {
+        double wait_time = mpctx->cache_wait_time;
+        if (opts->cache_pause_mode == 1) {
+            double predicted = get_predictive_cache_wait(mpctx);
+            if (predicted >= 0)
+                wait_time = predicted;
+        }
         if (mpctx->paused && mpctx->paused_for_cache) {
-            if (!opts->cache_pausing || s.ts_duration >= mpctx->cache_wait_time
-                || s.idle)
-            {
+            if (!opts->cache_pausing || s.ts_duration >= wait_time || s.idle) {
                 double elapsed_time = now - mpctx->cache_stop_time;
                 if (elapsed_time > mpctx->cache_wait_time) {
                     mpctx->cache_wait_time *= 1.5 + 0.1;
@@ -576,10 +804,10 @@ static void handle_pause_on_low_cache(struct MPContext *mpctx)
             }
         }
         mpctx->cache_wait_time = MPCLAMP(mpctx->cache_wait_time, 1, 10);
-        if (mpctx->paused_for_cache) {
-            cache_buffer =
-                100 * MPCLAMP(s.ts_duration / mpctx->cache_wait_time, 0, 0.99);
-        }
+        if (opts->cache_pause_mode != 1)
+            wait_time = mpctx->cache_wait_time;
+        if (mpctx->paused_for_cache)
+            cache_buffer = 100 * MPCLAMP(s.ts_duration / wait_time, 0, 0.99);
     }
 
     // Also update cache properties.
@@ -814,6 +1042,7 @@ int handle_force_window(struct MPContext *mpctx, bool force)
             .osd = mpctx->osd,
             .encode_lavc_ctx = mpctx->encode_lavc_ctx,
             .opengl_cb_context = mpctx->gl_cb_ctx,
+            .sw_cb_context = mpctx->sw_cb_ctx,
         };
         mpctx->video_out = init_best_video_out(mpctx->global, &ex);
         if (!mpctx->video_out)
@@ -863,7 +1092,14 @@ static void handle_dummy_ticks(struct MPContext *mpctx)
     if (mpctx->video_status == STATUS_EOF || mpctx->paused) {
         if (mp_time_sec() - mpctx->last_idle_tick > 0.050) {
             mpctx->last_idle_tick = mp_time_sec();
-            mp_notify(mpctx, MPV_EVENT_TICK, NULL);
+            // Ticks are sent on every wakeup; avoid waking up clients (which
+            // often react by sending requests, which wake us up again) if
+            // nobody listens.
+            if (mp_client_event_is_registered(mpctx, MPV_EVENT_TICK)) {
+                mp_notify(mpctx, MPV_EVENT_TICK, NULL);
+            } else {
+                mpctx->osd_idle_update = true;
+            }
         }
     }
 }
@@ -883,6 +1119,191 @@ static void handle_playback_time(struct MPContext *mpctx)
     }
 }
 
+// Speed up playback slightly while the pipeline latency is above
+// --latency-target, until it has come back down to the target.
+static void handle_latency_catchup(struct MPContext *mpctx)
+{
+    struct MPOpts *opts = mpctx->opts;
+    double target = opts->latency_target;
+
+    double speed = 1.0;
+    if (target > 0 && mpctx->restart_complete && !mpctx->paused &&
+        !mpctx->paused_for_cache)
+    {
+        double latency = get_pipeline_latency(mpctx);
+        if (latency != MP_NOPTS_VALUE) {
+            // Hysteresis, so that the speed doesn't flip-flop around the target.
+            if (latency > target * 2) {
+                speed = 1.1;
+            } else if (latency > target * 1.25 ||
+                       (mpctx->latency_speed > 1.0 && latency > target))
+            {
+                speed = 1.05;
+            }
+        }
+    }
+
+    if (speed != mpctx->latency_speed) {
+        MP_VERBOSE(mpctx, "Latency catch-up speed: %.2f\n", speed);
+        mpctx->latency_speed = speed;
+        update_playback_speed(mpctx);
+    }
+}
+
+// Reference track for --hls-bitrate=auto: the selected HLS variant video
+// track, or audio track if there's no video.
+static struct track *get_hls_variant_track(struct MPContext *mpctx)
+{
+    for (int type = STREAM_VIDEO; type <= STREAM_AUDIO; type++) {
+        struct track *t = mpctx->current_track[0][type];
+        if (t && t->stream && !t->is_external && t->stream->hls_bitrate > 0)
+            return t;
+    }
+    return NULL;
+}
+
+static void hls_log(struct MPContext *mpctx, const char *fmt, ...)
+    PRINTF_ATTRIBUTE(2, 3);
+
+static void hls_log(struct MPContext *mpctx, const char *fmt, ...)
+{
+    struct hls_adapt *h = &mpctx->hls;
+    va_list ap;
+    va_start(ap, fmt);
+    char *msg = talloc_vasprintf(NULL, fmt, ap);
+    va_end(ap);
+    MP_INFO(mpctx, "HLS: %s\n", msg);
+    if (h->num_log >= 16) {
+        talloc_free(h->log[0]);
+        MP_TARRAY_REMOVE_AT(h->log, h->num_log, 0);
+    }
+    MP_TARRAY_APPEND(mpctx, h->log, h->num_log, msg);
+    talloc_steal(h->log, msg);
+}
+
+// Switch all selected HLS variant tracks to the variant with the given rate.
+static void switch_hls_variant(struct MPContext *mpctx, int rate)
+{
+    for (int type = STREAM_VIDEO; type <= STREAM_AUDIO; type++) {
+        struct track *cur = mpctx->current_track[0][type];
+        if (!cur || !cur->stream || cur->stream->hls_bitrate <= 0 ||
+            cur->stream->hls_bitrate == rate)
+            continue;
+        for (int n = 0; n < mpctx->num_tracks; n++) {
+            struct track *t = mpctx->tracks[n];
+            if (t->type == type && t->demuxer == cur->demuxer && t->stream &&
+                t->stream->hls_bitrate == rate)
+            {
+                mp_switch_track(mpctx, type, t, 0);
+                break;
+            }
+        }
+    }
+    mpctx->hls.last_switch = mp_time_sec();
+    mpctx->hls.last_ts = MP_NOPTS_VALUE;
+    mpctx->hls.good_checks = mpctx->hls.bad_checks = 0;
+    mpctx->hls.num_switches++;
+}
+
+// With --hls-bitrate=auto, switch between the HLS variants exposed as tracks
+// depending on the network throughput. The throughput is taken from the stream
+// cache if there is one. lavf's HLS demuxer does its own network I/O, so
+// usually it's estimated from how fast the demuxer reads ahead instead: media
+// duration demuxed per second of wall time, multiplied with the bitrate of the
+// current variant. Switching down happens quickly (or immediately on
+// underruns), switching up only if the throughput was sufficiently higher than
+// the next variant's bitrate for a while.
+static void handle_hls_adaptation(struct MPContext *mpctx)
+{
+    struct MPOpts *opts = mpctx->opts;
+    struct hls_adapt *h = &mpctx->hls;
+    if (opts->hls_bitrate != HLS_BITRATE_AUTO || !mpctx->demuxer ||
+        !mpctx->restart_complete || mpctx->paused)
+        return;
+
+    struct track *track = get_hls_variant_track(mpctx);
+    if (!track)
+        return;
+
+    double now = mp_time_sec();
+    if (h->next_check > now) {
+        mpctx->sleeptime = MPMIN(mpctx->sleeptime, h->next_check - now);
+        return;
+    }
+    h->next_check = now + 1.0;
+    mpctx->sleeptime = MPMIN(mpctx->sleeptime, 1.0);
+
+    int cur_rate = track->stream->hls_bitrate;
+
+    struct stream_cache_info c = {.idle = true};
+    demux_stream_control(mpctx->demuxer, STREAM_CTRL_GET_CACHE_INFO, &c);
+
+    struct demux_ctrl_reader_state s = {.idle = true, .ts_duration = -1};
+    demux_control(mpctx->demuxer, DEMUXER_CTRL_GET_READER_STATE, &s);
+
+    double ts = s.ts_range[1];
+    if (c.size > 0 && !c.idle && c.speed > 0) {
+        double bps = c.speed * 8.0;
+        h->throughput = h->throughput > 0 ? h->throughput * 0.7 + bps * 0.3 : bps;
+    } else if (h->last_ts != MP_NOPTS_VALUE && ts != MP_NOPTS_VALUE &&
+               now > h->last_check && ts >= h->last_ts &&
+               ts - h->last_ts < (now - h->last_check) * 20) // skip seeks
+    {
+        double bps = cur_rate * (ts - h->last_ts) / (now - h->last_check);
+        if (!h->last_idle && !s.idle) {
+            // Reading was never throttled by the readahead limit.
+            h->throughput =
+                h->throughput > 0 ? h->throughput * 0.7 + bps * 0.3 : bps;
+        } else {
+            // Only a lower bound.
+            h->throughput = MPMAX(h->throughput, bps);
+        }
+    }
+    h->last_ts = ts;
+    h->last_idle = s.idle;
+    h->last_check = now;
+    mp_notify(mpctx, MP_EVENT_CACHE_UPDATE, NULL);
+
+    if (s.eof || h->throughput <= 0)
+        return;
+
+    // Find the neighbouring variants.
+    int lower = 0, higher = 0, best_fit = 0, lowest = 0;
+    for (int n = 0; n < mpctx->num_tracks; n++) {
+        struct track *t = mpctx->tracks[n];
+        if (t->type != track->type || t->demuxer != track->demuxer ||
+            !t->stream || t->stream->hls_bitrate <= 0)
+            continue;
+        int rate = t->stream->hls_bitrate;
+        if (rate < cur_rate && rate > lower)
+            lower = rate;
+        if (rate > cur_rate && (!higher || rate < higher))
+            higher = rate;
+        if (rate <= h->throughput * 0.8 && rate > best_fit)
+            best_fit = rate;
+        if (!lowest || rate < lowest)
+            lowest = rate;
+    }
+
+    bool draining = !s.idle && h->throughput < cur_rate * 0.9;
+    h->bad_checks = draining ? h->bad_checks + 1 : 0;
+    h->good_checks = higher && h->throughput * 0.7 >= higher ?
+                     h->good_checks + 1 : 0;
+
+    double since_switch = now - h->last_switch;
+    if (lower && since_switch >= 3 && (s.underrun || h->bad_checks >= 3)) {
+        int target = MPMIN(best_fit ? best_fit : lowest, lower);
+        hls_log(mpctx, "switching down %d -> %d (%s, throughput %.0f)",
+                cur_rate, target, s.underrun ? "underrun" : "too slow",
+                h->throughput);
+        switch_hls_variant(mpctx, target);
+    } else if (higher && since_switch >= 10 && h->good_checks >= 5) {
+        hls_log(mpctx, "switching up %d -> %d (throughput %.0f)",
+                cur_rate, higher, h->throughput);
+        switch_hls_variant(mpctx, higher);
+    }
+}
+
 // We always make sure audio and video buffers are filled before actually
 // starting playback. This code handles starting them at the same time.
 static void handle_playback_restart(struct MPContext *mpctx)
@@ -915,6 +1336,8 @@ static void handle_playback_restart(struct MPContext *mpctx)
         mpctx->hrseek_active = false;
         mpctx->restart_complete = true;
         mpctx->audio_allow_second_chance_seek = false;
+        mp_startup_trace(mpctx, "playback start");
+        mpctx->startup_done = true;
         handle_playback_time(mpctx);
         mp_notify(mpctx, MPV_EVENT_PLAYBACK_RESTART, NULL);
         if (!mpctx->playing_msg_shown) {
@@ -1026,6 +1449,10 @@ void run_playloop(struct MPContext *mpctx)
 
     handle_playback_time(mpctx);
 
+    handle_latency_catchup(mpctx);
+
+    handle_hls_adaptation(mpctx);
+
     handle_dummy_ticks(mpctx);
 
     update_osd_msg(mpctx);
@@ -1048,7 +1475,9 @@ void run_playloop(struct MPContext *mpctx)
 
     handle_osd_redraw(mpctx);
 
+    mp_client_publish_properties(mpctx);
     mp_wait_events(mpctx, mpctx->sleeptime);
+    mp_client_unpublish_properties(mpctx);
     mpctx->sleeptime = 1e9; // infinite for all practical purposes
 
     handle_pause_on_low_cache(mpctx);
@@ -1059,13 +1488,19 @@ void run_playloop(struct MPContext *mpctx)
 
     handle_force_window(mpctx, false);
 
+    thumbnail_update(mpctx);
+
+    handle_seek_preview(mpctx);
+
     execute_queued_seek(mpctx);
 }
 
 void mp_idle(struct MPContext *mpctx)
 {
     handle_dummy_ticks(mpctx);
+    mp_client_publish_properties(mpctx);
     mp_wait_events(mpctx, mpctx->sleeptime);
+    mp_client_unpublish_properties(mpctx);
     mpctx->sleeptime = 100.0;
     mp_process_input(mpctx);
     handle_command_updates(mpctx);
@@ -18,6 +18,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <pthread.h>
 
 #include "config.h"
 
@@ -28,7 +29,9 @@
 #include "core.h"
 #include "command.h"
 #include "misc/bstr.h"
+#include "misc/dispatch.h"
 #include "common/msg.h"
+#include "osdep/threads.h"
 #include "options/path.h"
 #include "video/mp_image.h"
 #include "video/decode/dec_video.h"
@@ -41,6 +44,16 @@
 #define MODE_FULL_WINDOW 1
 #define MODE_SUBTITLES 2
 
+// A screenshot that is written by a worker thread.
+struct screenshot_job {
+    struct screenshot_ctx *ctx;
+    struct mp_image *image;
+    struct image_writer_opts opts;
+    char *filename;
+    bool osd;
+    bool ok;
+};
+
 typedef struct screenshot_ctx {
     struct MPContext *mpctx;
 
@@ -49,6 +62,22 @@ typedef struct screenshot_ctx {
     bool osd;
 
     int frameno;
+
+    // Filenames of jobs that have not been completed yet. Accessed by the
+    // core thread only.
+    char **pending;
+    int num_pending;
+
+    // --- protected by lock
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    struct screenshot_job **queue;  // jobs not yet picked up by a worker
+    int num_queue;
+    int num_busy;                   // queued jobs and jobs being written
+    pthread_t *threads;
+    int num_threads;
+    int num_idle;                   // workers waiting for a job
+    bool terminate;
 } screenshot_ctx;
 
 void screenshot_init(struct MPContext *mpctx)
@@ -58,6 +87,8 @@ void screenshot_init(struct MPContext *mpctx)
         .mpctx = mpctx,
         .frameno = 1,
     };
+    pthread_mutex_init(&mpctx->screenshot_ctx->lock, NULL);
+    pthread_cond_init(&mpctx->screenshot_ctx->wakeup, NULL);
 }
 
 #define SMSG_OK 0
@@ -264,6 +295,15 @@ error_exit:
     return NULL;
 }
 
+static bool is_pending(screenshot_ctx *ctx, const char *fname)
+{
+    for (int n = 0; n < ctx->num_pending; n++) {
+        if (strcmp(ctx->pending[n], fname) == 0)
+            return true;
+    }
+    return false;
+}
+
 static char *gen_fname(screenshot_ctx *ctx, const char *file_ext)
 {
     int sequence = 0;
@@ -293,7 +333,8 @@ static char *gen_fname(screenshot_ctx *ctx, const char *file_ext)
             talloc_free(t);
         }
 
-        if (!mp_path_exists(fname))
+        // Files still being written by a worker may not exist yet.
+        if (!mp_path_exists(fname) && !is_pending(ctx, fname))
             return fname;
 
         if (sequence == prev_sequence) {
@@ -314,6 +355,146 @@ static void add_subs(struct MPContext *mpctx, struct mp_image *image)
                       OSD_DRAW_SUB_ONLY, image);
 }
 
+// Called on the core thread when a job has been written.
+static void job_done(void *p)
+{
+    struct screenshot_job *job = p;
+    screenshot_ctx *ctx = job->ctx;
+
+    for (int n = 0; n < ctx->num_pending; n++) {
+        if (ctx->pending[n] == job->filename) {
+            MP_TARRAY_REMOVE_AT(ctx->pending, ctx->num_pending, n);
+            break;
+        }
+    }
+
+    bool old_osd = ctx->osd;
+    ctx->osd = job->osd;
+    if (job->ok) {
+        screenshot_msg(ctx, SMSG_OK, "Screenshot: '%s'", job->filename);
+    } else {
+        screenshot_msg(ctx, SMSG_ERR, "Error writing screenshot!");
+    }
+    ctx->osd = old_osd;
+
+    talloc_free(job);
+}
+
+static void *worker_thread(void *p)
+{
+    screenshot_ctx *ctx = p;
+    struct MPContext *mpctx = ctx->mpctx;
+
+    mpthread_set_name("screenshot");
+
+    pthread_mutex_lock(&ctx->lock);
+    while (1) {
+        if (ctx->num_queue) {
+            struct screenshot_job *job = ctx->queue[0];
+            MP_TARRAY_REMOVE_AT(ctx->queue, ctx->num_queue, 0);
+            pthread_mutex_unlock(&ctx->lock);
+
+            job->ok = write_image(job->image, &job->opts, job->filename,
+                                  mpctx->log);
+            // Release the frame before the job leaves the memory bound.
+            talloc_free(job->image);
+            job->image = NULL;
+            mp_dispatch_enqueue(mpctx->dispatch, job_done, job);
+
+            pthread_mutex_lock(&ctx->lock);
+            ctx->num_busy--;
+            pthread_cond_broadcast(&ctx->wakeup);
+            continue;
+        }
+        if (ctx->terminate)
+            break;
+        ctx->num_idle++;
+        pthread_cond_wait(&ctx->wakeup, &ctx->lock);
+        ctx->num_idle--;
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    return NULL;
+}
+
+// Write the image to the file, possibly asynchronously. Takes ownership of
+// the image.
+static void write_screenshot(screenshot_ctx *ctx, struct mp_image *image,
+                             const struct image_writer_opts *opts,
+                             const char *filename)
+{
+    struct MPContext *mpctx = ctx->mpctx;
+    int max_jobs = mpctx->opts->screenshot_queue;
+
+    struct screenshot_job *job = talloc_ptrtype(NULL, job);
+    *job = (struct screenshot_job){
+        .ctx = ctx,
+        .image = talloc_steal(job, image),
+        .opts = *opts,
+        .filename = talloc_strdup(job, filename),
+        .osd = ctx->osd,
+    };
+    job->opts.format = talloc_strdup(job, opts->format);
+
+    if (max_jobs < 1) {
+        job->ok = write_image(job->image, &job->opts, job->filename,
+                              mpctx->log);
+        job_done(job);
+        return;
+    }
+
+    MP_TARRAY_APPEND(ctx, ctx->pending, ctx->num_pending, job->filename);
+
+    pthread_mutex_lock(&ctx->lock);
+    // Bound the memory used by frames waiting to be written. This also
+    // throttles each-frame mode to the speed of the workers.
+    while (ctx->num_busy >= max_jobs)
+        pthread_cond_wait(&ctx->wakeup, &ctx->lock);
+    MP_TARRAY_APPEND(ctx, ctx->queue, ctx->num_queue, job);
+    ctx->num_busy++;
+    if (ctx->num_idle < ctx->num_queue && ctx->num_threads < max_jobs) {
+        pthread_t thread;
+        if (!pthread_create(&thread, NULL, worker_thread, ctx))
+            MP_TARRAY_APPEND(ctx, ctx->threads, ctx->num_threads, thread);
+    }
+    if (!ctx->num_threads) {
+        // Could not start a thread; write it on this thread instead.
+        MP_TARRAY_REMOVE_AT(ctx->queue, ctx->num_queue, ctx->num_queue - 1);
+        ctx->num_busy--;
+        pthread_mutex_unlock(&ctx->lock);
+        job->ok = write_image(job->image, &job->opts, job->filename,
+                              mpctx->log);
+        job_done(job);
+        return;
+    }
+    pthread_cond_broadcast(&ctx->wakeup);
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+// Wait until all queued screenshots are written, and stop the workers.
+void screenshot_uninit(struct MPContext *mpctx)
+{
+    screenshot_ctx *ctx = mpctx->screenshot_ctx;
+    if (!ctx)
+        return;
+
+    pthread_mutex_lock(&ctx->lock);
+    ctx->terminate = true;
+    pthread_cond_broadcast(&ctx->wakeup);
+    pthread_mutex_unlock(&ctx->lock);
+
+    for (int n = 0; n < ctx->num_threads; n++)
+        pthread_join(ctx->threads[n], NULL);
+    ctx->num_threads = 0;
+
+    // Report the completion of the last jobs.
+    mp_dispatch_queue_process(mpctx->dispatch, 0);
+
+    pthread_cond_destroy(&ctx->wakeup);
+    pthread_mutex_destroy(&ctx->lock);
+    talloc_free(ctx);
+    mpctx->screenshot_ctx = NULL;
+}
+
 static void screenshot_save(struct MPContext *mpctx, struct mp_image *image)
 {
     screenshot_ctx *ctx = mpctx->screenshot_ctx;
@@ -322,10 +503,10 @@ static void screenshot_save(struct MPContext *mpctx, struct mp_image *image)
 
     char *filename = gen_fname(ctx, image_writer_file_ext(opts));
     if (filename) {
-        screenshot_msg(ctx, SMSG_OK, "Screenshot: '%s'", filename);
-        if (!write_image(image, opts, filename, mpctx->log))
-            screenshot_msg(ctx, SMSG_ERR, "Error writing screenshot!");
+        write_screenshot(ctx, image, opts, filename);
         talloc_free(filename);
+    } else {
+        talloc_free(image);
     }
 }
 
@@ -390,10 +571,7 @@ void screenshot_to_file(struct MPContext *mpctx, const char *filename, int mode,
         screenshot_msg(ctx, SMSG_ERR, "Taking screenshot failed.");
         goto end;
     }
-    screenshot_msg(ctx, SMSG_OK, "Screenshot: '%s'", filename);
-    if (!write_image(image, &opts, filename, mpctx->log))
-        screenshot_msg(ctx, SMSG_ERR, "Error writing screenshot!");
-    talloc_free(image);
+    write_screenshot(ctx, image, &opts, filename);
 
 end:
     ctx->osd = old_osd;
@@ -425,8 +603,6 @@ void screenshot_request(struct MPContext *mpctx, int mode, bool each_frame,
     } else {
         screenshot_msg(ctx, SMSG_ERR, "Taking screenshot failed.");
     }
-
-    talloc_free(image);
 }
 
 void screenshot_flip(struct MPContext *mpctx)
@@ -25,6 +25,9 @@ struct MPContext;
 // One time initialization at program start.
 void screenshot_init(struct MPContext *mpctx);
 
+// Wait for screenshots still being written, and free the screenshot state.
+void screenshot_uninit(struct MPContext *mpctx);
+
 // Request a taking & saving a screenshot of the currently displayed frame.
 // mode: 0: -, 1: save the actual output window contents, 2: with subtitles.
 // each_frame: If set, this toggles per-frame screenshots, exactly like the
@@ -20,6 +20,9 @@
 #include <sys/types.h>
 #include <dirent.h>
 #include <math.h>
+#include <limits.h>
+#include <poll.h>
+#include <unistd.h>
 #include <pthread.h>
 #include <assert.h>
 
@@ -27,6 +30,7 @@
 
 #include "osdep/io.h"
 #include "osdep/threads.h"
+#include "osdep/timer.h"
 
 #include "common/common.h"
 #include "common/msg.h"
@@ -71,35 +75,241 @@ struct thread_arg {
     const struct mp_scripting *backend;
     mpv_handle *client;
     const char *fname;
+    // Used with --script-threads only.
+    void *state;
+    int wakeup_fd;
+    int64_t next_run;   // mp_time_us() time at which step() must be called
 };
 
-static void *script_thread(void *p)
-{
-    pthread_detach(pthread_self());
+// Runs a set of scripts with the backend's start/step callbacks. The worker
+// exits once it was closed and all of its scripts have exited.
+struct script_worker {
+    pthread_mutex_t lock;
+    int wakeup_pipe[2];
+    struct thread_arg **added;  // protected by lock
+    int num_added;
+    bool closed;                // protected by lock; no new scripts added
+    // Accessed by the worker thread only.
+    struct thread_arg **scripts;
+    int num_scripts;
+    struct pollfd *fds;
+    int num_fds;
+};
 
-    struct thread_arg *arg = p;
+struct script_pool {
+    struct script_worker **workers;
+    int num_workers;
+    int next_worker;
+};
 
+static void set_thread_name(struct thread_arg *arg)
+{
     char name[90];
     snprintf(name, sizeof(name), "lua (%s)", mpv_client_name(arg->client));
     mpthread_set_name(name);
+}
 
-    if (arg->backend->load(arg->client, arg->fname) < 0)
-        MP_ERR(arg, "Could not load script %s\n", arg->fname);
-
+static void finish_script(struct thread_arg *arg)
+{
     MP_VERBOSE(arg, "Exiting...\n");
 
     mpv_detach_destroy(arg->client);
     talloc_free(arg);
+}
+
+static void *script_thread(void *p)
+{
+    pthread_detach(pthread_self());
+
+    struct thread_arg *arg = p;
+    set_thread_name(arg);
+
+    if (arg->backend->load(arg->client, arg->fname) < 0)
+        MP_ERR(arg, "Could not load script %s\n", arg->fname);
+
+    finish_script(arg);
+    return NULL;
+}
+
+// For pooled scripts which can't be run in steps.
+static void *script_loop_thread(void *p)
+{
+    pthread_detach(pthread_self());
+
+    struct thread_arg *arg = p;
+    set_thread_name(arg);
+
+    arg->backend->run_loop(arg->state);
+
+    finish_script(arg);
+    return NULL;
+}
+
+static void worker_start_script(struct script_worker *w, struct thread_arg *arg)
+{
+    bool own_loop = false;
+    arg->state = arg->backend->start(arg->client, arg->fname, &own_loop);
+    if (!arg->state) {
+        MP_ERR(arg, "Could not load script %s\n", arg->fname);
+        finish_script(arg);
+        return;
+    }
+
+    arg->wakeup_fd = own_loop ? -1 : mpv_get_wakeup_pipe(arg->client);
+    if (arg->wakeup_fd < 0) {
+        MP_VERBOSE(arg, "Running script on its own thread.\n");
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, script_loop_thread, arg)) {
+            // Blocks the other scripts of this worker, but it's better
+            // than nothing.
+            arg->backend->run_loop(arg->state);
+            finish_script(arg);
+        }
+        return;
+    }
+
+    arg->next_run = 0; // run the first step immediately
+    MP_TARRAY_APPEND(w, w->scripts, w->num_scripts, arg);
+}
+
+static void *worker_thread(void *p)
+{
+    pthread_detach(pthread_self());
+
+    struct script_worker *w = p;
+    mpthread_set_name("script worker");
+
+    while (1) {
+        pthread_mutex_lock(&w->lock);
+        struct thread_arg **added = w->added;
+        int num_added = w->num_added;
+        bool closed = w->closed;
+        w->added = NULL;
+        w->num_added = 0;
+        pthread_mutex_unlock(&w->lock);
+
+        for (int n = 0; n < num_added; n++)
+            worker_start_script(w, added[n]);
+        talloc_free(added);
+
+        if (closed && !w->num_scripts)
+            break;
+
+        int64_t next = INT64_MAX;
+        w->num_fds = 0;
+        MP_TARRAY_APPEND(w, w->fds, w->num_fds,
+                         (struct pollfd){ .fd = w->wakeup_pipe[0],
+                                          .events = POLLIN });
+        for (int n = 0; n < w->num_scripts; n++) {
+            struct thread_arg *arg = w->scripts[n];
+            MP_TARRAY_APPEND(w, w->fds, w->num_fds,
+                             (struct pollfd){ .fd = arg->wakeup_fd,
+                                              .events = POLLIN });
+            next = MPMIN(next, arg->next_run);
+        }
+
+        int timeout = -1;
+        if (next != INT64_MAX) {
+            int64_t wait_ms = (next - mp_time_us() + 999) / 1000;
+            timeout = MPCLAMP(wait_ms, 0, INT_MAX);
+        }
+        poll(w->fds, w->num_fds, timeout);
+
+        if (w->fds[0].revents & POLLIN)
+            mp_flush_wakeup_pipe(w->wakeup_pipe[0]);
+
+        // Backwards, so removing a script doesn't shift unprocessed entries.
+        int64_t now = mp_time_us();
+        for (int n = w->num_scripts - 1; n >= 0; n--) {
+            struct thread_arg *arg = w->scripts[n];
+            bool woken = w->fds[n + 1].revents & POLLIN;
+            if (!woken && now < arg->next_run)
+                continue;
+            // Flush first, so that events added during the step wake us up.
+            if (woken)
+                mp_flush_wakeup_pipe(arg->wakeup_fd);
+            double wait = arg->backend->step(arg->state);
+            if (wait < 0) {
+                MP_TARRAY_REMOVE_AT(w->scripts, w->num_scripts, n);
+                finish_script(arg);
+            } else if (wait >= 1e6) {
+                arg->next_run = INT64_MAX;
+            } else {
+                arg->next_run = mp_time_us() + (int64_t)(wait * 1e6);
+            }
+        }
+    }
+
+    close(w->wakeup_pipe[0]);
+    close(w->wakeup_pipe[1]);
+    pthread_mutex_destroy(&w->lock);
+    talloc_free(w);
     return NULL;
 }
 
+static struct script_worker *create_worker(void)
+{
+    struct script_worker *w = talloc_zero(NULL, struct script_worker);
+    if (mp_make_wakeup_pipe(w->wakeup_pipe) < 0) {
+        talloc_free(w);
+        return NULL;
+    }
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, worker_thread, w)) {
+        close(w->wakeup_pipe[0]);
+        close(w->wakeup_pipe[1]);
+        pthread_mutex_destroy(&w->lock);
+        talloc_free(w);
+        return NULL;
+    }
+    return w;
+}
+
+static void worker_add_script(struct script_worker *w, struct thread_arg *arg)
+{
+    pthread_mutex_lock(&w->lock);
+    MP_TARRAY_APPEND(w, w->added, w->num_added, arg);
+    pthread_mutex_unlock(&w->lock);
+    (void)write(w->wakeup_pipe[1], &(char){0}, 1);
+}
+
+static void worker_close(struct script_worker *w)
+{
+    pthread_mutex_lock(&w->lock);
+    w->closed = true;
+    pthread_mutex_unlock(&w->lock);
+    (void)write(w->wakeup_pipe[1], &(char){0}, 1);
+}
+
+// Return the worker the next script should be run on, or NULL if scripts
+// should get their own thread.
+static struct script_worker *pool_get_worker(struct MPContext *mpctx,
+                                             struct script_pool *pool)
+{
+    int num = mpctx->opts->script_threads;
+    if (!pool || num < 1)
+        return NULL;
+    if (pool->num_workers < num) {
+        struct script_worker *w = create_worker();
+        if (!w) {
+            MP_ERR(mpctx, "Could not create script worker thread.\n");
+            return NULL;
+        }
+        MP_TARRAY_APPEND(NULL, pool->workers, pool->num_workers, w);
+        return w;
+    }
+    return pool->workers[pool->next_worker++ % pool->num_workers];
+}
+
 static void wait_loaded(struct MPContext *mpctx)
 {
     while (!mp_clients_all_initialized(mpctx))
         mp_idle(mpctx);
 }
 
-static void mp_load_script(struct MPContext *mpctx, const char *fname)
+static void mp_load_script(struct MPContext *mpctx, const char *fname,
+                           struct script_pool *pool)
 {
     char *ext = mp_splitext(fname, NULL);
     const struct mp_scripting *backend = NULL;
@@ -134,17 +344,23 @@ static void mp_load_script(struct MPContext *mpctx, const char *fname)
 
     MP_VERBOSE(arg, "Loading script %s...\n", fname);
 
-    pthread_t thread;
-    if (pthread_create(&thread, NULL, script_thread, arg)) {
-        mpv_detach_destroy(arg->client);
-        talloc_free(arg);
-        return;
+    struct script_worker *worker =
+        backend->start ? pool_get_worker(mpctx, pool) : NULL;
+    if (worker) {
+        worker_add_script(worker, arg);
+    } else {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, script_thread, arg)) {
+            mpv_detach_destroy(arg->client);
+            talloc_free(arg);
+            return;
+        }
     }
 
-    wait_loaded(mpctx);
-    MP_VERBOSE(mpctx, "Done loading %s.\n", fname);
-
-    return;
+    if (!mpctx->opts->script_init_concurrent) {
+        wait_loaded(mpctx);
+        MP_VERBOSE(mpctx, "Done loading %s.\n", fname);
+    }
 }
 
 static int compare_filename(const void *pa, const void *pb)
@@ -177,26 +393,42 @@ static char **list_script_files(void *talloc_ctx, char *path)
 
 void mp_load_scripts(struct MPContext *mpctx)
 {
+    struct script_pool pool = {0};
+
     // Load scripts from options
     if (mpctx->opts->lua_load_osc)
-        mp_load_script(mpctx, "@osc.lua");
+        mp_load_script(mpctx, "@osc.lua", &pool);
     if (mpctx->opts->lua_load_ytdl)
-        mp_load_script(mpctx, "@ytdl_hook.lua");
+        mp_load_script(mpctx, "@ytdl_hook.lua", &pool);
     char **files = mpctx->opts->script_files;
     for (int n = 0; files && files[n]; n++) {
         if (files[n][0])
-            mp_load_script(mpctx, files[n]);
+            mp_load_script(mpctx, files[n], &pool);
     }
-    if (!mpctx->opts->auto_load_scripts)
-        return;
 
-    // Load all scripts
-    void *tmp = talloc_new(NULL);
-    char **scriptsdir = mp_find_all_config_files(tmp, mpctx->global, "scripts");
-    for (int i = 0; scriptsdir && scriptsdir[i]; i++) {
-        files = list_script_files(tmp, scriptsdir[i]);
-        for (int n = 0; files && files[n]; n++)
-            mp_load_script(mpctx, files[n]);
+    if (mpctx->opts->auto_load_scripts) {
+        // Load all scripts
+        void *tmp = talloc_new(NULL);
+        char **scriptsdir =
+            mp_find_all_config_files(tmp, mpctx->global, "scripts");
+        for (int i = 0; scriptsdir && scriptsdir[i]; i++) {
+            files = list_script_files(tmp, scriptsdir[i]);
+            for (int n = 0; files && files[n]; n++)
+                mp_load_script(mpctx, files[n], &pool);
+        }
+        talloc_free(tmp);
+    }
+
+    // The workers free themselves once all their scripts have exited.
+    for (int n = 0; n < pool.num_workers; n++)
+        worker_close(pool.workers[n]);
+    talloc_free(pool.workers);
+
+    // With --script-init-concurrent, the scripts initialize concurrently. They
+    // must still be done before the first file is loaded, because they might
+    // register hooks (e.g. ytdl_hook.lua).
+    if (mpctx->opts->script_init_concurrent) {
+        wait_loaded(mpctx);
+        MP_VERBOSE(mpctx, "Done loading scripts.\n");
     }
-    talloc_free(tmp);
 }
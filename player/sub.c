@@ -105,6 +105,14 @@ static bool update_subtitle(struct MPContext *mpctx, double video_pts,
         sub_preload(dec_sub);
     }
 
+    if (track->is_external && sub_can_index(dec_sub)) {
+        // Same assumption as above, but only the packet timestamps are kept,
+        // and the payloads are read again as playback progresses.
+        demux_seek(track->demuxer, 0, 0);
+        sub_build_index(dec_sub);
+        demux_seek(track->demuxer, video_pts, SEEK_BACKWARD);
+    }
+
     if (!sub_read_packets(dec_sub, video_pts))
         return false;
 
@@ -0,0 +1,373 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Background thumbnail generation. This opens the current file a second time,
+// with its own demuxer and (software) video decoder, which decodes keyframes
+// only. This runs on its own thread, and never touches the main playback
+// pipeline.
+
+#include <math.h>
+#include <pthread.h>
+
+#include "mpv_talloc.h"
+
+#include "common/common.h"
+#include "common/global.h"
+#include "common/msg.h"
+#include "demux/demux.h"
+#include "input/input.h"
+#include "options/options.h"
+#include "osdep/threads.h"
+#include "osdep/timer.h"
+#include "stream/stream.h"
+#include "video/decode/dec_video.h"
+#include "video/decode/vd.h"
+#include "video/mp_image.h"
+#include "video/sws_utils.h"
+
+#include "core.h"
+#include "command.h"
+#include "thumbnail.h"
+
+// Number of generated thumbnails kept.
+#define MAX_CACHED 64
+
+// Minimum time between starting to generate two thumbnails; for rate limiting.
+#define MIN_INTERVAL 0.02
+
+// Give up on a thumbnail if no frame was decoded after this many steps.
+#define MAX_DECODE_STEPS 500
+
+struct thumb {
+    double pts;
+    int w, h;
+    struct mp_image *img;   // NULL if generating it failed
+};
+
+struct thumbnailer {
+    struct mpv_global *global;
+    struct mp_log *log;
+    struct input_ctx *input;
+    char *url;
+    struct mp_cancel *cancel;
+    int num_notified;       // main thread only
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    bool exit;
+    bool have_request;
+    struct thumb request;   // pending request
+    bool busy;
+    struct thumb current;   // request being generated (if busy)
+    bool abort;             // abort generating current
+    struct thumb *cache;    // newest entries last
+    int num_cache;
+    int num_generated;
+
+    // Thumbnailer thread only.
+    struct MPOpts *opts;
+    struct demuxer *demuxer;
+    struct dec_video *d_video;
+    bool open_failed;
+};
+
+static bool thumb_equal(struct thumb *a, struct thumb *b)
+{
+    return fabs(a->pts - b->pts) < 0.001 && a->w == b->w && a->h == b->h;
+}
+
+static bool open_file(struct thumbnailer *t)
+{
+    // Don't duplicate the potentially large stream cache.
+    struct demuxer_params params = { .disable_cache = true };
+    t->demuxer = demux_open_url(t->url, &params, t->cancel, t->global);
+    if (!t->demuxer) {
+        MP_ERR(t, "Could not open file.\n");
+        return false;
+    }
+    if (!t->demuxer->seekable) {
+        MP_ERR(t, "File is not seekable.\n");
+        return false;
+    }
+
+    struct sh_stream *sh = NULL;
+    for (int n = 0; n < demux_get_num_stream(t->demuxer); n++) {
+        struct sh_stream *s = demux_get_stream(t->demuxer, n);
+        if (s->type == STREAM_VIDEO && !s->attached_picture) {
+            sh = s;
+            break;
+        }
+    }
+    if (!sh) {
+        MP_ERR(t, "No video stream.\n");
+        return false;
+    }
+    demuxer_select_track(t->demuxer, sh, MP_NOPTS_VALUE, true);
+
+    struct dec_video *d_video = talloc_zero(NULL, struct dec_video);
+    d_video->global = t->global;
+    d_video->log = mp_log_new(d_video, t->log, "!vd");
+    d_video->opts = t->opts;
+    d_video->header = sh;
+    d_video->codec = sh->codec;
+    d_video->fps = sh->codec->fps;
+    t->d_video = d_video;
+
+    if (!video_init_best_codec(d_video))
+        return false;
+
+    video_vd_control(d_video, VDCTRL_SET_KEYFRAMES_ONLY, &(int){1});
+    video_vd_control(d_video, VDCTRL_SET_LOW_LATENCY, &(int){1});
+    return true;
+}
+
+static struct mp_image *scale_frame(struct mp_image *frame, int w, int h)
+{
+    int d_w, d_h;
+    mp_image_params_get_dsize(&frame->params, &d_w, &d_h);
+    if (d_w < 1 || d_h < 1)
+        return NULL;
+
+    double s = 1.0;
+    if (w > 0)
+        s = MPMIN(s, w / (double)d_w);
+    if (h > 0)
+        s = MPMIN(s, h / (double)d_h);
+    int o_w = MPMAX(lrint(d_w * s), 1);
+    int o_h = MPMAX(lrint(d_h * s), 1);
+
+    struct mp_image *dst = mp_image_alloc(IMGFMT_BGR0, o_w, o_h);
+    if (!dst)
+        return NULL;
+    mp_image_copy_attributes(dst, frame);
+    mp_image_params_set_dsize(&dst->params, o_w, o_h);
+
+    if (mp_image_swscale(dst, frame, mp_sws_fast_flags) < 0) {
+        talloc_free(dst);
+        return NULL;
+    }
+    return dst;
+}
+
+static struct mp_image *generate(struct thumbnailer *t, struct thumb *req)
+{
+    // Seeks to the keyframe at or before the target.
+    demux_seek(t->demuxer, req->pts, 0);
+    video_reset(t->d_video);
+
+    struct mp_image *frame = NULL;
+    for (int n = 0; n < MAX_DECODE_STEPS; n++) {
+        pthread_mutex_lock(&t->lock);
+        bool abort = t->abort || t->exit;
+        pthread_mutex_unlock(&t->lock);
+        if (abort)
+            break;
+
+        video_work(t->d_video);
+        int r = video_get_frame(t->d_video, &frame);
+        if (r == DATA_OK || r == DATA_EOF)
+            break;
+    }
+    if (!frame)
+        return NULL;
+
+    struct mp_image *img = scale_frame(frame, req->w, req->h);
+    talloc_free(frame);
+    if (!img)
+        MP_ERR(t, "Could not scale thumbnail.\n");
+    return img;
+}
+
+static void *thumbnail_thread(void *arg)
+{
+    struct thumbnailer *t = arg;
+    mpthread_set_name("thumbnail");
+
+    double next_time = 0;
+
+    pthread_mutex_lock(&t->lock);
+    while (!t->exit) {
+        if (!t->have_request) {
+            pthread_cond_wait(&t->wakeup, &t->lock);
+            continue;
+        }
+        double now = mp_time_sec();
+        if (now < next_time) {
+            struct timespec ts = mp_rel_time_to_timespec(next_time - now);
+            pthread_cond_timedwait(&t->wakeup, &t->lock, &ts);
+            continue;
+        }
+
+        struct thumb req = t->request;
+        t->have_request = false;
+        t->current = req;
+        t->busy = true;
+        t->abort = false;
+        pthread_mutex_unlock(&t->lock);
+
+        if (!t->demuxer && !t->open_failed)
+            t->open_failed = !open_file(t);
+        if (!t->open_failed)
+            req.img = generate(t, &req);
+
+        pthread_mutex_lock(&t->lock);
+        t->busy = false;
+        if (t->abort) {
+            talloc_free(req.img);
+        } else {
+            // Failures are cached too, so that clients don't retry forever.
+            if (t->num_cache == MAX_CACHED) {
+                talloc_free(t->cache[0].img);
+                MP_TARRAY_REMOVE_AT(t->cache, t->num_cache, 0);
+            }
+            MP_TARRAY_APPEND(t, t->cache, t->num_cache, req);
+            t->num_generated++;
+            mp_input_wakeup(t->input);
+        }
+        next_time = mp_time_sec() + MIN_INTERVAL;
+    }
+    pthread_mutex_unlock(&t->lock);
+    return NULL;
+}
+
+static void destroy_thumbnailer(void *p)
+{
+    struct thumbnailer *t = p;
+    for (int n = 0; n < t->num_cache; n++)
+        talloc_free(t->cache[n].img);
+    video_uninit(t->d_video);
+    free_demuxer_and_stream(t->demuxer);
+    pthread_cond_destroy(&t->wakeup);
+    pthread_mutex_destroy(&t->lock);
+}
+
+static struct thumbnailer *get_thumbnailer(struct MPContext *mpctx)
+{
+    if (mpctx->thumbnailer)
+        return mpctx->thumbnailer;
+    if (!mpctx->playing || !mpctx->stream_open_filename)
+        return NULL;
+
+    struct thumbnailer *t = talloc_zero(NULL, struct thumbnailer);
+    *t = (struct thumbnailer){
+        // The thread gets its own copy of the options, so that it neither
+        // races with option changes, nor affects the main player.
+        .global = talloc_steal(t, create_sub_global(mpctx)),
+        .log = mp_log_new(t, mpctx->log, "thumbnail"),
+        .input = mpctx->input,
+        .url = talloc_strdup(t, mpctx->stream_open_filename),
+        .cancel = mp_cancel_new(t),
+    };
+    t->opts = t->global->opts;
+    // Software decoding on the calling thread, and no other side effects.
+    t->opts->hwdec_api = HWDEC_NONE;
+    t->opts->vd_queue_frames = 0;
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_cond_init(&t->wakeup, NULL);
+    talloc_set_destructor(t, destroy_thumbnailer);
+
+    if (pthread_create(&t->thread, NULL, thumbnail_thread, t)) {
+        talloc_free(t);
+        return NULL;
+    }
+
+    mpctx->thumbnailer = t;
+    return t;
+}
+
+struct mp_image *thumbnail_get(struct MPContext *mpctx, double pts, int w, int h)
+{
+    struct thumbnailer *t = get_thumbnailer(mpctx);
+    if (!t)
+        return NULL;
+
+    struct thumb req = { .pts = pts, .w = w, .h = h };
+    struct mp_image *res = NULL;
+
+    pthread_mutex_lock(&t->lock);
+    for (int n = t->num_cache - 1; n >= 0; n--) {
+        if (thumb_equal(&t->cache[n], &req)) {
+            res = t->cache[n].img ? mp_image_new_ref(t->cache[n].img) : NULL;
+            goto done;
+        }
+    }
+    if (!(t->busy && !t->abort && thumb_equal(&t->current, &req))) {
+        // Only the most recent request is kept.
+        t->request = req;
+        t->have_request = true;
+        pthread_cond_signal(&t->wakeup);
+    }
+done:
+    pthread_mutex_unlock(&t->lock);
+    return res;
+}
+
+void thumbnail_cancel(struct MPContext *mpctx)
+{
+    struct thumbnailer *t = mpctx->thumbnailer;
+    if (!t)
+        return;
+
+    pthread_mutex_lock(&t->lock);
+    t->have_request = false;
+    t->abort = true;
+    pthread_mutex_unlock(&t->lock);
+}
+
+int thumbnail_get_num_generated(struct MPContext *mpctx)
+{
+    struct thumbnailer *t = mpctx->thumbnailer;
+    if (!t)
+        return 0;
+
+    pthread_mutex_lock(&t->lock);
+    int num = t->num_generated;
+    pthread_mutex_unlock(&t->lock);
+    return num;
+}
+
+void thumbnail_update(struct MPContext *mpctx)
+{
+    struct thumbnailer *t = mpctx->thumbnailer;
+    if (!t)
+        return;
+
+    int num = thumbnail_get_num_generated(mpctx);
+    if (num != t->num_notified) {
+        t->num_notified = num;
+        mp_notify_property(mpctx, "thumbnails-generated");
+    }
+}
+
+void thumbnail_uninit(struct MPContext *mpctx)
+{
+    struct thumbnailer *t = mpctx->thumbnailer;
+    if (!t)
+        return;
+
+    pthread_mutex_lock(&t->lock);
+    t->exit = true;
+    pthread_cond_signal(&t->wakeup);
+    pthread_mutex_unlock(&t->lock);
+    // Abort possibly blocking network I/O.
+    mp_cancel_trigger(t->cancel);
+    pthread_join(t->thread, NULL);
+
+    talloc_free(t);
+    mpctx->thumbnailer = NULL;
+}
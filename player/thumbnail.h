@@ -0,0 +1,42 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MPLAYER_THUMBNAIL_H
+#define MPLAYER_THUMBNAIL_H
+
+struct MPContext;
+
+// Return a bgr0 thumbnail of the keyframe at or before pts, scaled to fit into
+// w*h (keeping the aspect ratio; if one of them is 0, only the other is used
+// as limit). If the thumbnail wasn't generated yet, this requests it from the
+// background thumbnailer (replacing any older pending request), and returns
+// NULL. The "thumbnails-generated" property changes when a thumbnail is done.
+struct mp_image *thumbnail_get(struct MPContext *mpctx, double pts, int w, int h);
+
+// Drop the pending request and abort the one currently being generated.
+void thumbnail_cancel(struct MPContext *mpctx);
+
+// Number of thumbnails generated for the current file.
+int thumbnail_get_num_generated(struct MPContext *mpctx);
+
+// Called by the playloop to send property notifications.
+void thumbnail_update(struct MPContext *mpctx);
+
+// Stop the thumbnailer (when the current file is closed).
+void thumbnail_uninit(struct MPContext *mpctx);
+
+#endif /* MPLAYER_THUMBNAIL_H */
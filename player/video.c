@@ -21,6 +21,8 @@
 #include <math.h>
 #include <assert.h>
 
+#include <libavutil/buffer.h>
+
 #include "config.h"
 #include "mpv_talloc.h"
 
@@ -30,6 +32,8 @@
 #include "options/m_option.h"
 #include "common/common.h"
 #include "common/encode.h"
+#include "common/global.h"
+#include "common/memgov.h"
 #include "options/m_property.h"
 #include "osdep/timer.h"
 
@@ -38,6 +42,7 @@
 #include "stream/stream.h"
 #include "sub/osd.h"
 #include "video/hwdec.h"
+#include "video/mp_image_pool.h"
 #include "video/filter/vf.h"
 #include "video/decode/dec_video.h"
 #include "video/decode/vd.h"
@@ -160,6 +165,22 @@ static bool check_output_format(struct vo_chain *vo_c, int imgfmt)
     return vo_c->vf->output_params.imgfmt == imgfmt;
 }
 
+// Insert a hardware deinterlacer. Probing is done only once per filter; if
+// it fails, it's not attempted again for this vo_chain.
+static int try_hw_deint_filter(struct vo_chain *vo_c, enum hw_deint index,
+                               char *name, char **args)
+{
+    assert(index < MP_ARRAY_SIZE(vo_c->deint_failed));
+    if (vo_c->deint_failed[index])
+        return -1;
+    int r = try_filter(vo_c, name, VF_DEINTERLACE_LABEL, args);
+    if (r < 0) {
+        MP_WARN(vo_c, "Hardware deinterlacer '%s' not available.\n", name);
+        vo_c->deint_failed[index] = true;
+    }
+    return r;
+}
+
 static int probe_deint_filters(struct vo_chain *vo_c)
 {
     // Usually, we prefer inserting/removing deint filters. But If there's VO
@@ -182,13 +203,13 @@ static int probe_deint_filters(struct vo_chain *vo_c)
             args[3] = (char *)types[pref];
         }
 
-        return try_filter(vo_c, "vdpaupp", VF_DEINTERLACE_LABEL, args);
+        return try_hw_deint_filter(vo_c, HW_DEINT_VDPAU, "vdpaupp", args);
     }
     if (check_output_format(vo_c, IMGFMT_VAAPI))
-        return try_filter(vo_c, "vavpp", VF_DEINTERLACE_LABEL, NULL);
+        return try_hw_deint_filter(vo_c, HW_DEINT_VAAPI, "vavpp", NULL);
     if (check_output_format(vo_c, IMGFMT_D3D11VA) ||
         check_output_format(vo_c, IMGFMT_D3D11NV12))
-        return try_filter(vo_c, "d3d11vpp", VF_DEINTERLACE_LABEL, NULL);
+        return try_hw_deint_filter(vo_c, HW_DEINT_D3D11, "d3d11vpp", NULL);
     return try_filter(vo_c, "yadif", VF_DEINTERLACE_LABEL, NULL);
 }
 
@@ -283,13 +304,24 @@ static void recreate_video_filters(struct MPContext *mpctx)
     vf_destroy(vo_c->vf);
     vo_c->vf = vf_new(mpctx->global);
     vo_c->vf->hwdec_devs = vo_c->hwdec_devs;
+    vo_c->vf->in_hwframes_ref = vo_c->input_hwframes;
     vo_c->vf->wakeup_callback = wakeup_playloop;
     vo_c->vf->wakeup_callback_ctx = mpctx;
     vo_c->vf->container_fps = vo_c->container_fps;
     vo_control(vo_c->vo, VOCTRL_GET_DISPLAY_FPS, &vo_c->vf->display_fps);
+    vo_c->vf->vo_caps = vo_c->vo->driver->caps;
 
     vf_append_filter_list(vo_c->vf, opts->vf_settings);
 
+    int pool_frames = opts->video_pool_frames;
+    if (pool_frames < 0) {
+        // Frames queued by the VO and the player, plus the decoder queue, plus
+        // some slack for filters referencing past frames (deinterlacers etc.).
+        pool_frames = vo_get_num_req_frames(vo_c->vo) + 2 +
+                      opts->vd_queue_frames + 4;
+    }
+    vo_c->vf->pool_frames = pool_frames;
+
     // for vf_sub
     osd_set_render_subs_in_filter(mpctx->osd,
         vf_control_any(vo_c->vf, VFCTRL_INIT_OSD, mpctx->osd) > 0);
@@ -317,9 +349,171 @@ int reinit_video_filters(struct MPContext *mpctx)
     return vo_c->vf->initialized;
 }
 
+struct vo_mirror {
+    struct vo *vo;
+    struct m_geometry crop;
+    struct mp_rect rc;          // crop rectangle for the current video params
+    bool configured;
+};
+
+// Entries are "[<vo>/]<crop>[@<screen>]", e.g. "opengl/50%x100%+100%+0@1".
+static void init_video_mirrors(struct MPContext *mpctx)
+{
+    struct MPOpts *opts = mpctx->opts;
+    if (mpctx->num_video_mirrors || !opts->video_mirrors)
+        return;
+
+    const m_option_t geometry_opt = {.type = &m_option_type_geometry};
+
+    for (int n = 0; opts->video_mirrors[n]; n++) {
+        struct vo_mirror *m = talloc_zero(mpctx, struct vo_mirror);
+        MP_TARRAY_APPEND(mpctx, mpctx->video_mirrors, mpctx->num_video_mirrors,
+                         m);
+
+        bstr spec = bstr0(opts->video_mirrors[n]);
+        bstr driver = {0}, screen = {0};
+        int slash = bstrchr(spec, '/');
+        if (slash >= 0) {
+            driver = bstr_splice(spec, 0, slash);
+            spec = bstr_cut(spec, slash + 1);
+        }
+        int at = bstrchr(spec, '@');
+        if (at >= 0) {
+            screen = bstr_cut(spec, at + 1);
+            spec = bstr_splice(spec, 0, at);
+        }
+        if (m_option_parse(mpctx->log, &geometry_opt, bstr0("video-mirror"),
+                           spec, &m->crop) < 0)
+        {
+            MP_ERR(mpctx, "Invalid --video-mirror entry '%s'.\n",
+                   opts->video_mirrors[n]);
+            continue;
+        }
+
+        struct mp_vo_opts *vo_opts = talloc_memdup(m, opts->vo, sizeof(*opts->vo));
+        if (driver.len) {
+            vo_opts->video_driver_list = talloc_zero_array(m, struct m_obj_settings, 2);
+            vo_opts->video_driver_list[0].name = bstrto0(m, driver);
+        }
+        if (screen.len)
+            vo_opts->screen_id = vo_opts->fsscreen_id = bstrtoll(screen, NULL, 10);
+
+        struct vo_extra ex = {
+            .input_ctx = mpctx->input,
+            .osd = mpctx->osd,
+            .opts = vo_opts,
+        };
+        m->vo = init_best_video_out(mpctx->global, &ex);
+        if (!m->vo) {
+            MP_ERR(mpctx, "Could not initialize video mirror '%s'.\n",
+                   opts->video_mirrors[n]);
+            continue;
+        }
+        vo_set_paused(m->vo, mpctx->paused);
+    }
+}
+
+static void uninit_video_mirrors(struct MPContext *mpctx)
+{
+    for (int n = 0; n < mpctx->num_video_mirrors; n++) {
+        if (mpctx->video_mirrors[n]->vo)
+            vo_destroy(mpctx->video_mirrors[n]->vo);
+        talloc_free(mpctx->video_mirrors[n]);
+    }
+    TA_FREEP(&mpctx->video_mirrors);
+    mpctx->num_video_mirrors = 0;
+}
+
+static void reconfig_video_mirrors(struct MPContext *mpctx,
+                                   struct mp_image_params *params)
+{
+    for (int n = 0; n < mpctx->num_video_mirrors; n++) {
+        struct vo_mirror *m = mpctx->video_mirrors[n];
+        if (!m->vo)
+            continue;
+
+        struct mp_imgfmt_desc fmt = mp_imgfmt_get_desc(params->imgfmt);
+        int x = 0, y = 0, w = params->w, h = params->h;
+        m_geometry_apply(&x, &y, &w, &h, params->w, params->h, &m->crop);
+        x = MPCLAMP(x, 0, params->w);
+        y = MPCLAMP(y, 0, params->h);
+        if (fmt.align_x > 1)
+            x &= ~(fmt.align_x - 1);
+        if (fmt.align_y > 1)
+            y &= ~(fmt.align_y - 1);
+        m->rc = (struct mp_rect){x, y, MPMIN(x + w, params->w),
+                                       MPMIN(y + h, params->h)};
+        if (m->rc.x1 <= m->rc.x0 || m->rc.y1 <= m->rc.y0)
+            m->rc = (struct mp_rect){0, 0, params->w, params->h};
+
+        bool full = m->rc.x0 == 0 && m->rc.y0 == 0 &&
+                    m->rc.x1 == params->w && m->rc.y1 == params->h;
+        if (!full && (fmt.flags & MP_IMGFLAG_HWACCEL)) {
+            MP_WARN(mpctx, "Can't crop hardware decoded video for mirror %d.\n",
+                    n);
+            m->rc = (struct mp_rect){0, 0, params->w, params->h};
+        }
+
+        struct mp_image_params p = *params;
+        p.w = m->rc.x1 - m->rc.x0;
+        p.h = m->rc.y1 - m->rc.y0;
+        m->configured = vo_reconfig(m->vo, &p) >= 0;
+        if (!m->configured)
+            MP_ERR(mpctx, "Could not configure video mirror %d.\n", n);
+    }
+}
+
+// Queue a copy of the frame (cropped as needed) to all mirrors that are ready.
+// Mirrors that are still busy with the previous frame skip this one.
+static void queue_video_mirrors(struct MPContext *mpctx, struct vo_frame *frame)
+{
+    for (int n = 0; n < mpctx->num_video_mirrors; n++) {
+        struct vo_mirror *m = mpctx->video_mirrors[n];
+        if (!m->vo || !m->configured || !vo_is_ready_for_frame(m->vo, -1))
+            continue;
+
+        struct vo_frame *mframe = vo_frame_ref(frame);
+        for (int i = 0; i < mframe->num_frames; i++) {
+            struct mp_image *img = mframe->frames[i];
+            if (!(img->fmt.flags & MP_IMGFLAG_HWACCEL))
+                mp_image_crop_rc(img, m->rc);
+        }
+        // Mirrors have their own vsync; show each frame once at its time.
+        mframe->display_synced = false;
+        mframe->num_vsyncs = 1;
+        vo_queue_frame(m->vo, mframe);
+    }
+}
+
+static void reset_video_mirrors(struct MPContext *mpctx)
+{
+    for (int n = 0; n < mpctx->num_video_mirrors; n++) {
+        if (mpctx->video_mirrors[n]->vo)
+            vo_seek_reset(mpctx->video_mirrors[n]->vo);
+    }
+}
+
+void set_video_mirrors_paused(struct MPContext *mpctx, bool paused)
+{
+    for (int n = 0; n < mpctx->num_video_mirrors; n++) {
+        if (mpctx->video_mirrors[n]->vo)
+            vo_set_paused(mpctx->video_mirrors[n]->vo, paused);
+    }
+}
+
+void redraw_video_mirrors(struct MPContext *mpctx, bool force)
+{
+    for (int n = 0; n < mpctx->num_video_mirrors; n++) {
+        struct vo *vo = mpctx->video_mirrors[n]->vo;
+        if (vo && (force || vo_want_redraw(vo)))
+            vo_redraw(vo);
+    }
+}
+
 static void vo_chain_reset_state(struct vo_chain *vo_c)
 {
     mp_image_unrefp(&vo_c->input_mpi);
+    vo_c->input_timing = (struct mp_frame_timing){0};
     if (vo_c->vf->initialized == 1)
         vf_seek_reset(vo_c->vf);
     vo_seek_reset(vo_c->vo);
@@ -332,6 +526,7 @@ void reset_video_state(struct MPContext *mpctx)
 {
     if (mpctx->vo_chain)
         vo_chain_reset_state(mpctx->vo_chain);
+    reset_video_mirrors(mpctx);
 
     for (int n = 0; n < mpctx->num_next_frames; n++)
         mp_image_unrefp(&mpctx->next_frames[n]);
@@ -356,6 +551,7 @@ void reset_video_state(struct MPContext *mpctx)
 void uninit_video_out(struct MPContext *mpctx)
 {
     uninit_video_chain(mpctx);
+    uninit_video_mirrors(mpctx);
     if (mpctx->video_out) {
         vo_destroy(mpctx->video_out);
         mp_notify(mpctx, MPV_EVENT_VIDEO_RECONFIG, NULL);
@@ -379,6 +575,8 @@ static void vo_chain_uninit(struct vo_chain *vo_c)
 
     mp_image_unrefp(&vo_c->input_mpi);
     vf_destroy(vo_c->vf);
+    mp_memgov_unregister(vo_c->pool_memgov);
+    av_buffer_unref(&vo_c->input_hwframes);
     talloc_free(vo_c);
     // this does not free the VO
 }
@@ -410,8 +608,10 @@ int init_video_decoder(struct MPContext *mpctx, struct track *track)
     d_video->header = track->stream;
     d_video->codec = track->stream->codec;
     d_video->fps = d_video->header->codec->fps;
-    if (mpctx->vo_chain)
+    if (mpctx->vo_chain) {
         d_video->hwdec_devs = mpctx->vo_chain->hwdec_devs;
+        d_video->vo = mpctx->vo_chain->vo;
+    }
 
     MP_VERBOSE(d_video, "Container reported FPS: %f\n", d_video->fps);
 
@@ -424,6 +624,9 @@ int init_video_decoder(struct MPContext *mpctx, struct track *track)
     if (!video_init_best_codec(d_video))
         goto err_out;
 
+    video_start_thread(d_video, d_video->opts->vd_queue_frames,
+                       wakeup_playloop, mpctx);
+
     return 1;
 
 err_out:
@@ -462,6 +665,7 @@ int reinit_video_chain_src(struct MPContext *mpctx, struct lavfi_pad *src)
             .osd = mpctx->osd,
             .encode_lavc_ctx = mpctx->encode_lavc_ctx,
             .opengl_cb_context = mpctx->gl_cb_ctx,
+            .sw_cb_context = mpctx->sw_cb_ctx,
         };
         mpctx->video_out = init_best_video_out(mpctx->global, &ex);
         if (!mpctx->video_out) {
@@ -471,7 +675,9 @@ int reinit_video_chain_src(struct MPContext *mpctx, struct lavfi_pad *src)
             goto err_out;
         }
         mpctx->mouse_cursor_visible = true;
+        mp_startup_trace(mpctx, "VO init");
     }
+    init_video_mirrors(mpctx);
 
     update_window_title(mpctx, true);
 
@@ -480,6 +686,8 @@ int reinit_video_chain_src(struct MPContext *mpctx, struct lavfi_pad *src)
     vo_c->log = mpctx->log;
     vo_c->vo = mpctx->video_out;
     vo_c->vf = vf_new(mpctx->global);
+    vo_c->pool_memgov = mp_memgov_register(mpctx->global->memgov, "video-pool",
+                                           MP_MEMGOV_POOL, 0);
 
     vo_c->hwdec_devs = vo_c->vo->hwdec_devs;
 
@@ -561,8 +769,8 @@ static bool check_framedrop(struct MPContext *mpctx, struct vo_chain *vo_c)
         double frame_time = fps > 0 ? 1.0 / fps : 0;
         // we should avoid dropping too many frames in sequence unless we
         // are too late. and we allow 100ms A-V delay here:
-        int dropped_frames =
-            vo_c->video_src->dropped_frames - mpctx->dropped_frames_start;
+        int dropped_frames = video_get_dropped_frames(vo_c->video_src) -
+                             mpctx->dropped_frames_start;
         if (mpctx->last_av_difference - 0.100 > dropped_frames * frame_time)
             return !!(opts->frame_dropping & 2);
     }
@@ -625,6 +833,8 @@ static int video_filter(struct MPContext *mpctx, bool eof)
         // Drain the filter chain.
         if (vf_output_frame(vf, true) > 0)
             return VD_PROGRESS;
+        if (vf_is_busy(vf))
+            return VD_WAIT;
 
         // The filter chain is drained; execute the filter format change.
         vf->initialized = 0;
@@ -653,8 +863,15 @@ static int video_filter(struct MPContext *mpctx, bool eof)
         return VD_RECONFIG;
     }
 
+    // A filter running on a separate thread is still working, and doesn't
+    // want more input; it wakes us up when it's done.
+    if (vf_is_busy(vf) && vf_needs_input(vf) < 1)
+        return VD_WAIT;
+
     // If something was decoded, and the filter chain is ready, filter it.
     if (!need_vf_reconfig && vo_c->input_mpi) {
+        vo_c->input_mpi->timing.filter_start = mp_time_us();
+        vo_c->input_timing = vo_c->input_mpi->timing;
         vf_filter_frame(vf, vo_c->input_mpi);
         vo_c->input_mpi = NULL;
         return VD_PROGRESS;
@@ -663,6 +880,20 @@ static int video_filter(struct MPContext *mpctx, bool eof)
     return eof ? VD_EOF : VD_PROGRESS;
 }
 
+// Remember the hw frames context of decoded frames, for filters like vf_lavfi
+// which need it at init time to pass hardware surfaces through.
+static void update_input_hwframes(struct vo_chain *vo_c, struct mp_image *img)
+{
+    if (img->hwctx == vo_c->input_hwframes ||
+        (img->hwctx && vo_c->input_hwframes &&
+         img->hwctx->data == vo_c->input_hwframes->data))
+        return;
+    av_buffer_unref(&vo_c->input_hwframes);
+    if (img->hwctx)
+        vo_c->input_hwframes = av_buffer_ref(img->hwctx);
+    vo_c->vf->in_hwframes_ref = vo_c->input_hwframes;
+}
+
 // Make sure at least 1 filtered image is available, decode new video if needed.
 // returns VD_* code
 // A return value of VD_PROGRESS doesn't necessarily output a frame, but makes
@@ -681,8 +912,10 @@ static int video_decode_and_filter(struct MPContext *mpctx)
         if (r == VD_WAIT)
             return r;
     }
-    if (vo_c->input_mpi)
+    if (vo_c->input_mpi) {
         vo_c->input_format = vo_c->input_mpi->params;
+        update_input_hwframes(vo_c, vo_c->input_mpi);
+    }
 
     bool eof = !vo_c->input_mpi && (r == VD_EOF || r < 0);
     r = video_filter(mpctx, eof);
@@ -763,7 +996,7 @@ static void handle_new_frame(struct MPContext *mpctx)
     }
     struct dec_video *d_video = mpctx->vo_chain->video_src;
     if (d_video)
-        mpctx->dropped_frames_start = d_video->dropped_frames;
+        mpctx->dropped_frames_start = video_get_dropped_frames(d_video);
     MP_TRACE(mpctx, "frametime=%5.3f\n", frame_time);
 }
 
@@ -789,7 +1022,7 @@ static int get_req_frames(struct MPContext *mpctx, bool eof)
     if (mpctx->video_pts == MP_NOPTS_VALUE)
         return mpctx->opts->video_sync == VS_DEFAULT ? 1 : 2;
 
-    int req = vo_get_num_req_frames(mpctx->video_out);
+    int req = vo_get_queue_depth(mpctx->video_out);
     return MPCLAMP(req, 2, MP_ARRAY_SIZE(mpctx->next_frames) - 1);
 }
 
@@ -841,6 +1074,11 @@ static int video_output_image(struct MPContext *mpctx)
             return r; // error
         struct mp_image *img = vf_read_output_frame(vo_c->vf);
         if (img) {
+            // Filters which create new images drop the timing; assume the
+            // output belongs to the most recent input.
+            if (!img->timing.decoded)
+                img->timing = vo_c->input_timing;
+            img->timing.filtered = mp_time_us();
             double endpts = get_play_end_pts(mpctx);
             if ((endpts != MP_NOPTS_VALUE && img->pts >= endpts) ||
                 mpctx->max_frames == 0)
@@ -1326,6 +1564,97 @@ static void calculate_frame_duration(struct MPContext *mpctx)
     MP_STATS(mpctx, "value %f frame-duration-approx", MPMAX(0, approx_duration));
 }
 
+#define DEGRADE_MAX_LEVEL 3
+#define DEGRADE_CHECK_INTERVAL 0.5
+
+// --vd-auto-degrade: compare the time the decoder takes per frame with the
+// frame duration, and watch for dropped frames. If decoding can't keep up,
+// reduce the decoding quality one step at a time (see video_set_degrade()),
+// and go back up once there's enough headroom again. To avoid oscillating
+// between two levels, the time required before recovering doubles each time
+// the load returns shortly after a recovery.
+static void update_decoder_degrade(struct MPContext *mpctx)
+{
+    struct MPOpts *opts = mpctx->opts;
+    struct vo_chain *vo_c = mpctx->vo_chain;
+    struct dec_video *d_video = vo_c->video_src;
+    if (!opts->vd_auto_degrade || !d_video || vo_c->is_coverart)
+        return;
+
+    double now = mp_time_sec();
+    if (now < vo_c->degrade_next_check)
+        return;
+    vo_c->degrade_next_check = now + DEGRADE_CHECK_INTERVAL;
+    if (!vo_c->degrade_recover_time)
+        vo_c->degrade_recover_time = 3;
+
+    int64_t drops = video_get_dropped_frames(d_video) +
+                    vo_get_drop_count(vo_c->vo);
+    int64_t new_drops = drops - vo_c->degrade_drops;
+    vo_c->degrade_drops = drops;
+
+    double fps = vo_c->container_fps;
+    if (mpctx->video_status != STATUS_PLAYING || mpctx->paused || fps <= 0 ||
+        mpctx->video_speed <= 0)
+        return;
+    double frame_time = 1.0 / fps / mpctx->video_speed;
+    double load = video_get_decode_time(d_video) / frame_time;
+
+    int level = vo_c->degrade_level;
+    if ((load > 0.9 || new_drops > 0) && level < DEGRADE_MAX_LEVEL &&
+        now - vo_c->degrade_last_change >= 1.0)
+    {
+        // Load came back soon after recovering: wait longer next time.
+        if (now - vo_c->degrade_last_recover < 10) {
+            vo_c->degrade_recover_time =
+                MPMIN(vo_c->degrade_recover_time * 2, 60);
+        }
+        level++;
+    } else if (load < 0.6 && !new_drops && level > 0) {
+        vo_c->degrade_good_checks++;
+        if (vo_c->degrade_good_checks * DEGRADE_CHECK_INTERVAL >=
+            vo_c->degrade_recover_time)
+        {
+            level--;
+            vo_c->degrade_last_recover = now;
+        }
+    } else {
+        vo_c->degrade_good_checks = 0;
+    }
+
+    if (level != vo_c->degrade_level) {
+        MP_VERBOSE(mpctx, "Decoder load %.2f, %"PRId64" drops: degrade level "
+                   "%d -> %d\n", load, new_drops, vo_c->degrade_level, level);
+        vo_c->degrade_good_checks = 0;
+        vo_c->degrade_level = level;
+        vo_c->degrade_last_change = now;
+        video_set_degrade(d_video, level);
+    }
+}
+
+// Report the filter pools to the memory governor, and limit their size if
+// the --memory-budget requires it.
+static void update_pool_budget(struct vo_chain *vo_c)
+{
+    if (!vo_c->pool_memgov || vo_c->vf->pool_frames < 1)
+        return;
+
+    struct mp_image_pool_stats st;
+    vf_get_pool_stats(vo_c->vf, &st);
+    if (!st.images || !st.bytes)
+        return;
+
+    int64_t frame_size = st.bytes / st.images;
+    int64_t wanted = frame_size * vo_c->vf->pool_frames * st.pools;
+    mp_memgov_report(vo_c->pool_memgov, st.bytes, wanted);
+
+    int64_t limit = mp_memgov_get_limit(vo_c->pool_memgov);
+    int frames = MPCLAMP(limit / (frame_size * st.pools), 2,
+                         vo_c->vf->pool_frames);
+    if (frames * st.pools != st.max_images)
+        vf_set_pool_frames(vo_c->vf, frames);
+}
+
 void write_video(struct MPContext *mpctx)
 {
     struct MPOpts *opts = mpctx->opts;
@@ -1342,6 +1671,9 @@ void write_video(struct MPContext *mpctx)
     if (mpctx->paused && mpctx->video_status >= STATUS_READY)
         return;
 
+    update_decoder_degrade(mpctx);
+    update_pool_budget(mpctx->vo_chain);
+
     int r = video_output_image(mpctx);
     MP_TRACE(mpctx, "video_output_image: %d\n", r);
 
@@ -1412,6 +1744,7 @@ void write_video(struct MPContext *mpctx)
             mpctx->error_playing = MPV_ERROR_VO_INIT_FAILED;
             goto error;
         }
+        reconfig_video_mirrors(mpctx, &p);
         init_vo(mpctx);
     }
 
@@ -1447,6 +1780,8 @@ void write_video(struct MPContext *mpctx)
     };
     calculate_frame_duration(mpctx);
 
+    mpctx->next_frames[0]->timing.queued = mp_time_us();
+
     int req = vo_get_num_req_frames(mpctx->video_out);
     assert(req >= 1 && req <= VO_MAX_REQ_FRAMES);
     struct vo_frame dummy = {
@@ -1481,6 +1816,7 @@ void write_video(struct MPContext *mpctx)
     mpctx->osd_force_update = true;
     update_osd_msg(mpctx);
 
+    queue_video_mirrors(mpctx, frame);
     vo_queue_frame(vo, frame);
 
     // The frames were shifted down; "initialize" the new first entry.
@@ -32,6 +32,13 @@
 // the cache is active.
 #define CACHE_UPDATE_CONTROLS_TIME 2.0
 
+// Size of the byte ranges fetched by each connection if multiple connections
+// are used (--cache-connections).
+#define CACHE_CHUNK_SIZE (1024 * 1024)
+
+// Size of the blocks in the sparse cache (--cache-sparse-size).
+#define CACHE_BLOCK_SIZE (64 * 1024)
+
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -53,6 +60,8 @@
 #include "osdep/threads.h"
 
 #include "common/msg.h"
+#include "common/global.h"
+#include "common/memgov.h"
 #include "common/tags.h"
 #include "options/options.h"
 
@@ -60,6 +69,32 @@
 #include "common/common.h"
 
 
+// A byte range fetched by one of the extra connections.
+struct cache_chunk {
+    bool in_use;            // scheduled, or still busy after being discarded
+    bool busy;              // a connection thread is reading into it
+    bool done;              // reading finished (filled < size: error)
+    bool discard;           // was dropped from the pipeline while busy
+    int64_t pos;            // file position of the first byte
+    int64_t size;           // number of bytes requested
+    int64_t filled;         // number of bytes read so far
+    int64_t consumed;       // number of bytes copied to the ringbuffer
+    unsigned char *data;
+};
+
+// Data that was dropped from the ringbuffer, kept for later reuse.
+struct cache_block {
+    int64_t pos;            // file position, multiple of CACHE_BLOCK_SIZE
+    int64_t last_use;       // for LRU eviction
+    unsigned char *data;    // CACHE_BLOCK_SIZE bytes
+};
+
+struct cache_conn {
+    struct priv *s;
+    pthread_t thread;
+    stream_t *stream;       // opened on first use; owned by the thread
+};
+
 // Note: (struct priv*)(cache->priv)->cache == cache
 struct priv {
     pthread_t cache_thread;
@@ -77,6 +112,11 @@ struct priv {
 
     struct mp_log *log;
 
+    // Share of --memory-budget. want_size is the readahead size as configured
+    // (or requested with STREAM_CTRL_SET_CACHE_SIZE), before applying it.
+    struct mp_memgov_client *memgov;
+    int64_t want_size;
+
     // Owned by the main thread
     stream_t *cache;        // wrapper stream, used by demuxer etc.
 
@@ -118,6 +158,33 @@ struct priv {
     struct mp_tags *stream_metadata;
     double start_pts;
     bool has_avseek;
+
+    // Parallel fetching of upcoming chunks (--cache-connections).
+    int num_conns;
+    struct cache_conn *conns;
+    struct cache_chunk *chunks;     // pool of 2 * num_conns chunks
+    struct cache_chunk **pipeline;  // scheduled chunks, in file order
+    int num_pipeline;
+    int64_t pipeline_end;           // file position after the last chunk
+    bool conns_failed;              // fall back to the main stream
+    bool conns_quit;
+    bool chunk_wait;                // waiting for a connection to read data
+    struct mp_cancel *conn_cancel;
+    pthread_cond_t conn_wakeup;
+
+    // Reconnecting after a read error (the stream's own reconnect logic is
+    // disabled, because it would block the cache thread while waiting).
+    bool reconnecting;
+    int reconnect_retry;            // failed attempts in the current sequence
+    double reconnect_time;          // mp_time_sec() of the next attempt
+    double reconnect_wait;          // current backoff
+    int64_t reconnects;             // total number of attempts
+
+    // Sparse cache (only accessed by the cache thread).
+    struct cache_block *blocks;     // sorted by pos
+    int num_blocks;
+    int max_blocks;
+    int64_t block_use;              // LRU counter
 };
 
 enum {
@@ -137,7 +204,7 @@ enum {
 static bool cache_wakeup_and_wait(struct priv *s, double *retry_time)
 {
     double start = mp_time_sec();
-    if (*retry_time >= CACHE_WAIT_TIME) {
+    if (*retry_time >= CACHE_WAIT_TIME && !s->reconnecting) {
         MP_VERBOSE(s, "Cache is not responding - slow/stuck network connection?\n");
         *retry_time = -1; // do not warn again for this call
     }
@@ -204,6 +271,261 @@ static size_t read_buffer(struct priv *s, unsigned char *dst,
     return read;
 }
 
+// Return the index of the block which contains pos, or -1.
+static int find_block(struct priv *s, int64_t pos)
+{
+    int64_t bpos = pos - pos % CACHE_BLOCK_SIZE;
+    int lo = 0, hi = s->num_blocks;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (s->blocks[mid].pos < bpos) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < s->num_blocks && s->blocks[lo].pos == bpos ? lo : -1;
+}
+
+// Copy the complete blocks in the ringbuffer to the sparse cache, evicting
+// the least recently used blocks if needed. Blocks near the last read
+// position are preferred.
+static void save_blocks(struct priv *s)
+{
+    if (!s->max_blocks)
+        return;
+    int saved = 0;
+    int64_t first = s->min_filepos + CACHE_BLOCK_SIZE - 1;
+    first -= first % CACHE_BLOCK_SIZE;
+    int64_t pos = s->max_filepos - s->max_filepos % CACHE_BLOCK_SIZE;
+    while (pos - CACHE_BLOCK_SIZE >= first && saved < s->max_blocks) {
+        pos -= CACHE_BLOCK_SIZE;
+        saved++;
+        int idx = find_block(s, pos);
+        if (idx >= 0) {
+            s->blocks[idx].last_use = ++s->block_use;
+            continue;
+        }
+        unsigned char *data = NULL;
+        if (s->num_blocks == s->max_blocks) {
+            int lru = 0;
+            for (int n = 1; n < s->num_blocks; n++) {
+                if (s->blocks[n].last_use < s->blocks[lru].last_use)
+                    lru = n;
+            }
+            data = s->blocks[lru].data;
+            MP_TARRAY_REMOVE_AT(s->blocks, s->num_blocks, lru);
+        } else {
+            data = talloc_size(s, CACHE_BLOCK_SIZE);
+        }
+        read_buffer(s, data, CACHE_BLOCK_SIZE, pos);
+        struct cache_block b = {pos, ++s->block_use, data};
+        int at = 0;
+        while (at < s->num_blocks && s->blocks[at].pos < pos)
+            at++;
+        MP_TARRAY_INSERT_AT(s, s->blocks, s->num_blocks, at, b);
+    }
+    if (saved)
+        MP_VERBOSE(s, "Sparse cache: %d blocks.\n", s->num_blocks);
+}
+
+static void drop_blocks(struct priv *s)
+{
+    for (int n = 0; n < s->num_blocks; n++)
+        talloc_free(s->blocks[n].data);
+    s->num_blocks = 0;
+}
+
+// Copy data at max_filepos from the sparse cache. Return number of bytes.
+static int read_blocks(struct priv *s, unsigned char *dst, int64_t space)
+{
+    int idx = find_block(s, s->max_filepos);
+    if (idx < 0)
+        return 0;
+    struct cache_block *b = &s->blocks[idx];
+    int64_t offset = s->max_filepos - b->pos;
+    int64_t len = MPMIN(space, CACHE_BLOCK_SIZE - offset);
+    memcpy(dst, b->data + offset, len);
+    b->last_use = ++s->block_use;
+    return len;
+}
+
+static bool use_conns(struct priv *s)
+{
+    return s->num_conns && !s->conns_failed && s->max_filepos < s->stream_size;
+}
+
+// Drop all scheduled chunks. Busy chunks are freed by their connection thread.
+static void discard_chunks(struct priv *s)
+{
+    for (int n = 0; n < s->num_pipeline; n++) {
+        struct cache_chunk *c = s->pipeline[n];
+        if (c->busy) {
+            c->discard = true;
+        } else {
+            c->in_use = false;
+        }
+    }
+    s->num_pipeline = 0;
+}
+
+// Make sure num_conns chunks following max_filepos are scheduled.
+static void schedule_chunks(struct priv *s)
+{
+    if (s->num_pipeline) {
+        struct cache_chunk *c = s->pipeline[0];
+        if (c->pos + c->consumed != s->max_filepos)
+            discard_chunks(s);
+    }
+    if (!s->num_pipeline)
+        s->pipeline_end = s->max_filepos;
+
+    bool added = false;
+    while (s->num_pipeline < s->num_conns && s->pipeline_end < s->stream_size) {
+        struct cache_chunk *c = NULL;
+        for (int n = 0; n < s->num_conns * 2; n++) {
+            if (!s->chunks[n].in_use) {
+                c = &s->chunks[n];
+                break;
+            }
+        }
+        if (!c)
+            break;
+        *c = (struct cache_chunk){
+            .in_use = true,
+            .pos = s->pipeline_end,
+            .size = MPMIN(CACHE_CHUNK_SIZE, s->stream_size - s->pipeline_end),
+            .data = c->data,
+        };
+        s->pipeline[s->num_pipeline++] = c;
+        s->pipeline_end += c->size;
+        added = true;
+    }
+    if (added)
+        pthread_cond_broadcast(&s->conn_wakeup);
+}
+
+// Copy data fetched by the connections at max_filepos into dst. Returns the
+// number of bytes copied, 0 if the data is not available yet, and -1 if a
+// connection failed.
+static int read_chunks(struct priv *s, unsigned char *dst, int64_t space)
+{
+    schedule_chunks(s);
+    if (!s->num_pipeline)
+        return 0;
+
+    struct cache_chunk *c = s->pipeline[0];
+    int64_t len = MPMIN(space, c->filled - c->consumed);
+    memcpy(dst, c->data + c->consumed, len);
+    c->consumed += len;
+    if (c->consumed == c->size) {
+        c->in_use = false;
+        s->num_pipeline--;
+        memmove(&s->pipeline[0], &s->pipeline[1],
+                s->num_pipeline * sizeof(s->pipeline[0]));
+    } else if (!len && c->done) {
+        MP_WARN(s, "Connection failed, falling back to a single connection.\n");
+        s->conns_failed = true;
+        discard_chunks(s);
+        return -1;
+    }
+    return len;
+}
+
+static void *conn_thread(void *arg)
+{
+    struct cache_conn *conn = arg;
+    struct priv *s = conn->s;
+    mpthread_set_name("cache-conn");
+    pthread_mutex_lock(&s->mutex);
+    while (!s->conns_quit) {
+        struct cache_chunk *c = NULL;
+        for (int n = 0; n < s->num_pipeline; n++) {
+            if (!s->pipeline[n]->busy && !s->pipeline[n]->done) {
+                c = s->pipeline[n];
+                break;
+            }
+        }
+        if (!c) {
+            pthread_cond_wait(&s->conn_wakeup, &s->mutex);
+            continue;
+        }
+        c->busy = true;
+        int64_t pos = c->pos;
+        pthread_mutex_unlock(&s->mutex);
+
+        if (!conn->stream) {
+            conn->stream = stream_create(s->stream->url, STREAM_READ,
+                                         s->conn_cancel, s->stream->global);
+        }
+        bool ok = conn->stream && stream_seek(conn->stream, pos);
+
+        pthread_mutex_lock(&s->mutex);
+        while (ok && !c->discard && !s->conns_quit && c->filled < c->size) {
+            int64_t want = MPMIN(c->size - c->filled, 64 * 1024);
+            unsigned char *dst = c->data + c->filled;
+            // Only the consumer accesses data before c->filled.
+            pthread_mutex_unlock(&s->mutex);
+            int len = stream_read_partial(conn->stream, dst, want);
+            pthread_mutex_lock(&s->mutex);
+            if (len <= 0) {
+                ok = false;
+                break;
+            }
+            c->filled += len;
+            pthread_cond_broadcast(&s->wakeup);
+        }
+        c->busy = false;
+        c->done = true;
+        if (c->discard)
+            c->in_use = false;
+        if (!ok && conn->stream) {
+            // Reconnect on the next chunk.
+            pthread_mutex_unlock(&s->mutex);
+            free_stream(conn->stream);
+            conn->stream = NULL;
+            pthread_mutex_lock(&s->mutex);
+        }
+        pthread_cond_broadcast(&s->wakeup);
+    }
+    pthread_mutex_unlock(&s->mutex);
+    free_stream(conn->stream);
+    return NULL;
+}
+
+static void init_conns(struct priv *s, int num)
+{
+    s->conn_cancel = mp_cancel_new(s);
+    pthread_cond_init(&s->conn_wakeup, NULL);
+    s->conns = talloc_zero_array(s, struct cache_conn, num);
+    s->chunks = talloc_zero_array(s, struct cache_chunk, num * 2);
+    s->pipeline = talloc_zero_array(s, struct cache_chunk *, num);
+    for (int n = 0; n < num * 2; n++)
+        s->chunks[n].data = talloc_size(s->chunks, CACHE_CHUNK_SIZE);
+    for (int n = 0; n < num; n++) {
+        s->conns[n].s = s;
+        if (pthread_create(&s->conns[n].thread, NULL, conn_thread, &s->conns[n]))
+            break;
+        s->num_conns++;
+    }
+    if (s->num_conns)
+        MP_VERBOSE(s, "Using %d connections.\n", s->num_conns);
+}
+
+static void uninit_conns(struct priv *s)
+{
+    if (!s->conn_cancel)
+        return;
+    pthread_mutex_lock(&s->mutex);
+    s->conns_quit = true;
+    mp_cancel_trigger(s->conn_cancel);
+    pthread_cond_broadcast(&s->conn_wakeup);
+    pthread_mutex_unlock(&s->mutex);
+    for (int n = 0; n < s->num_conns; n++)
+        pthread_join(s->conns[n].thread, NULL);
+    pthread_cond_destroy(&s->conn_wakeup);
+}
+
 static bool cache_update_stream_position(struct priv *s)
 {
     int64_t read = s->read_filepos;
@@ -216,9 +538,14 @@ static bool cache_update_stream_position(struct priv *s)
         MP_VERBOSE(s, "Dropping cache at pos %"PRId64", "
                    "cached range: %"PRId64"-%"PRId64".\n", read,
                    s->min_filepos, s->max_filepos);
+        save_blocks(s);
         cache_drop_contents(s);
     }
 
+    // The next data comes from the sparse cache or the extra connections.
+    if (find_block(s, s->max_filepos) >= 0 || use_conns(s))
+        return true;
+
     if (stream_tell(s->stream) != s->max_filepos && s->seekable) {
         MP_VERBOSE(s, "Seeking underlying stream: %"PRId64" -> %"PRId64"\n",
                    stream_tell(s->stream), s->max_filepos);
@@ -229,6 +556,42 @@ static bool cache_update_stream_position(struct priv *s)
     return stream_tell(s->stream) == s->max_filepos;
 }
 
+// Whether a read error at max_filepos should be handled by reconnecting.
+static bool can_reconnect(struct priv *s)
+{
+    return s->stream->async_reconnect && s->stream->streaming && s->seekable &&
+           !s->eof && s->max_filepos != s->stream_size &&
+           !mp_cancel_test(s->cache->cancel);
+}
+
+// Attempt to reconnect if the backoff time has passed. Returns 1 on success,
+// 0 if it should be retried later, -1 if it failed for good.
+// Runs in the cache thread, drops the lock while reconnecting.
+static int cache_reconnect(struct priv *s)
+{
+    double now = mp_time_sec();
+    if (now < s->reconnect_time)
+        return 0;
+
+    s->reconnects++;
+    pthread_mutex_unlock(&s->mutex);
+    int r = stream_try_reconnect(s->stream);
+    pthread_mutex_lock(&s->mutex);
+
+    if (r > 0 || r < 0 || ++s->reconnect_retry >= STREAM_RECONNECT_RETRIES) {
+        s->reconnecting = false;
+        s->reconnect_retry = 0;
+        s->reconnect_wait = 0;
+        return r > 0 ? 1 : -1;
+    }
+
+    MP_WARN(s, "Connection lost! Attempting to reconnect (%d)...\n",
+            s->reconnect_retry);
+    s->reconnect_wait = MPMIN(MPMAX(s->reconnect_wait, 0.1) * 4, 10.0);
+    s->reconnect_time = mp_time_sec() + s->reconnect_wait;
+    return 0;
+}
+
 // Runs in the cache thread.
 static void cache_fill(struct priv *s)
 {
@@ -236,6 +599,16 @@ static void cache_fill(struct priv *s)
     bool read_attempted = false;
     int len = 0;
 
+    s->chunk_wait = false;
+
+    if (s->reconnecting) {
+        int r = cache_reconnect(s);
+        if (r < 0)
+            read_attempted = true; // EOF
+        if (r <= 0)
+            goto done;
+    }
+
     if (!cache_update_stream_position(s))
         goto done;
 
@@ -281,10 +654,34 @@ static void cache_fill(struct priv *s)
     if (s->min_filepos < (read - back2))
         s->min_filepos = read - back2;
 
-    // The read call might take a long time and block, so drop the lock.
-    pthread_mutex_unlock(&s->mutex);
-    len = stream_read_partial(s->stream, &s->buffer[pos], space);
-    pthread_mutex_lock(&s->mutex);
+    len = -1;
+    int block_len = read_blocks(s, &s->buffer[pos], space);
+    if (block_len > 0) {
+        len = block_len;
+    } else if (use_conns(s)) {
+        len = read_chunks(s, &s->buffer[pos], space);
+        if (len == 0) {
+            s->chunk_wait = true;
+            goto done;
+        }
+        // On failure, continue with the main stream.
+        if (len < 0 && !cache_update_stream_position(s))
+            goto done;
+    }
+
+    if (len < 0) {
+        // The read call might take a long time and block, so drop the lock.
+        pthread_mutex_unlock(&s->mutex);
+        len = stream_read_partial(s->stream, &s->buffer[pos], space);
+        pthread_mutex_lock(&s->mutex);
+
+        // Playback continues from the buffer while reconnecting.
+        if (len <= 0 && can_reconnect(s)) {
+            s->reconnecting = true;
+            s->reconnect_time = mp_time_sec();
+            goto done;
+        }
+    }
 
     // Do this after reading a block, because at least libdvdnav updates the
     // stream position only after actually reading something after a seek.
@@ -310,7 +707,7 @@ done: ;
         s->eof_pos = stream_tell(s->stream);
         MP_VERBOSE(s, "EOF reached.\n");
     }
-    s->idle = s->eof || !read_attempted;
+    s->idle = s->eof || (!read_attempted && !s->chunk_wait && !s->reconnecting);
     s->reads++;
 
     update_speed(s);
@@ -318,23 +715,28 @@ done: ;
     pthread_cond_signal(&s->wakeup);
 }
 
+#define MIN_CACHE_SIZE (FILL_LIMIT * 2)
+#define MAX_CACHE_SIZE ((int64_t)(((size_t)-1) / 8))
+
+// Set s->back_size for the given readahead size.
+static void update_back_size(struct priv *s, int64_t size)
+{
+    if (s->stream_size > 0 && size >= s->stream_size) {
+        MP_VERBOSE(s, "no backbuffer needed\n");
+        s->back_size = 0;
+    }
+    s->back_size = MPCLAMP(s->back_size, MIN_CACHE_SIZE, MAX_CACHE_SIZE);
+}
+
 // This is called both during init and at runtime.
 // The size argument is the readahead half only; s->back_size is the backbuffer.
 static int resize_cache(struct priv *s, int64_t size)
 {
-    int64_t min_size = FILL_LIMIT * 2;
-    int64_t max_size = ((size_t)-1) / 8;
-
-    if (s->stream_size > 0) {
+    if (s->stream_size > 0)
         size = MPMIN(size, s->stream_size);
-        if (size >= s->stream_size) {
-            MP_VERBOSE(s, "no backbuffer needed\n");
-            s->back_size = 0;
-        }
-    }
+    update_back_size(s, size);
 
-    int64_t buffer_size = MPCLAMP(size, min_size, max_size);
-    s->back_size = MPCLAMP(s->back_size, min_size, max_size);
+    int64_t buffer_size = MPCLAMP(size, MIN_CACHE_SIZE, MAX_CACHE_SIZE);
     buffer_size += s->back_size;
 
     unsigned char *buffer = malloc(buffer_size);
@@ -385,11 +787,34 @@ static int resize_cache(struct priv *s, int64_t size)
                (long long)(s->buffer_size / 1024),
                (long long)(s->back_size / 1024));
 
+    mp_memgov_report(s->memgov, s->buffer_size, s->want_size + s->back_size);
+
     assert(s->back_size < s->buffer_size);
 
     return STREAM_OK;
 }
 
+// Readahead size to use, given s->want_size and the memory budget.
+static int64_t budget_cache_size(struct priv *s)
+{
+    int64_t limit = mp_memgov_get_limit(s->memgov);
+    return MPMIN(s->want_size, MPMAX(limit - s->back_size, 0));
+}
+
+// Resize the cache if the memory budget changed significantly (to avoid
+// copying the buffer around all the time).
+static void update_memory_budget(struct priv *s)
+{
+    if (!s->memgov)
+        return;
+    int64_t size = budget_cache_size(s);
+    int64_t cur = s->buffer_size - s->back_size;
+    if (size < cur * 3 / 4 || (size > cur * 5 / 4 && cur < s->want_size)) {
+        MP_VERBOSE(s, "Resizing cache for memory budget.\n");
+        resize_cache(s, size);
+    }
+}
+
 static void update_cached_controls(struct priv *s)
 {
     int64_t i64;
@@ -420,6 +845,8 @@ static int cache_get_cached_control(stream_t *cache, int cmd, void *arg)
             .fill = s->max_filepos - s->read_filepos,
             .idle = s->idle,
             .speed = llrint(s->speed),
+            .reconnecting = s->reconnecting,
+            .reconnects = s->reconnects,
         };
         return STREAM_OK;
     case STREAM_CTRL_SET_READAHEAD:
@@ -483,7 +910,8 @@ static void cache_execute_control(struct priv *s)
 
     switch (s->control) {
     case STREAM_CTRL_SET_CACHE_SIZE:
-        s->control_res = resize_cache(s, *(int64_t *)s->control_arg);
+        s->want_size = *(int64_t *)s->control_arg;
+        s->control_res = resize_cache(s, budget_cache_size(s));
         break;
     default:
         s->control_res = stream_control(s->stream, s->control, s->control_arg);
@@ -500,6 +928,7 @@ static void cache_execute_control(struct priv *s)
         s->read_min = s->read_filepos;
         s->control_flush = true;
         cache_drop_contents(s);
+        drop_blocks(s);
     }
 
     update_cached_controls(s);
@@ -517,6 +946,7 @@ static void *cache_thread(void *arg)
     while (s->control != CACHE_CTRL_QUIT) {
         if (mp_time_sec() - last > CACHE_UPDATE_CONTROLS_TIME) {
             update_cached_controls(s);
+            update_memory_budget(s);
             last = mp_time_sec();
         }
         if (s->control > 0) {
@@ -532,8 +962,16 @@ static void *cache_thread(void *arg)
             pthread_cond_signal(&s->wakeup);
             s->control = CACHE_CTRL_NONE;
         }
-        if (s->idle && s->control == CACHE_CTRL_NONE) {
-            struct timespec ts = mp_rel_time_to_timespec(CACHE_IDLE_SLEEP_TIME);
+        if ((s->idle || s->chunk_wait || s->reconnecting) &&
+            s->control == CACHE_CTRL_NONE)
+        {
+            // (Connection threads signal new data with the same condition.)
+            double timeout = CACHE_IDLE_SLEEP_TIME;
+            if (s->reconnecting) {
+                timeout = MPCLAMP(s->reconnect_time - mp_time_sec(), 0.001,
+                                  CACHE_IDLE_SLEEP_TIME);
+            }
+            struct timespec ts = mp_rel_time_to_timespec(timeout);
             pthread_cond_timedwait(&s->wakeup, &s->mutex, &ts);
         }
     }
@@ -661,9 +1099,11 @@ static void cache_uninit(stream_t *cache)
         pthread_mutex_unlock(&s->mutex);
         pthread_join(s->cache_thread, NULL);
     }
+    uninit_conns(s);
     pthread_mutex_destroy(&s->mutex);
     pthread_cond_destroy(&s->wakeup);
     free(s->buffer);
+    mp_memgov_unregister(s->memgov);
     talloc_free(s);
 }
 
@@ -689,8 +1129,16 @@ int stream_cache_init(stream_t *cache, stream_t *stream,
 
     s->stream_size = stream_get_size(stream);
 
-    if (resize_cache(s, opts->size * 1024ULL) != STREAM_OK) {
+    s->want_size = opts->size * 1024LL;
+    // Register with the backbuffer size resize_cache() will actually use.
+    update_back_size(s, s->want_size);
+    s->memgov = mp_memgov_register(cache->global->memgov, "cache",
+                                   MP_MEMGOV_READAHEAD,
+                                   s->want_size + s->back_size);
+
+    if (resize_cache(s, budget_cache_size(s)) != STREAM_OK) {
         MP_ERR(s, "Failed to allocate cache buffer.\n");
+        mp_memgov_unregister(s->memgov);
         talloc_free(s);
         return -1;
     }
@@ -712,6 +1160,15 @@ int stream_cache_init(stream_t *cache, stream_t *stream,
         min = s->buffer_size - FILL_LIMIT;
 
     s->seekable = stream->seekable;
+    stream->async_reconnect = true;
+    if (s->seekable)
+        s->max_blocks = opts->sparse_size * 1024LL / CACHE_BLOCK_SIZE;
+
+    // Extra connections are useful only if the stream's throughput is limited
+    // by latency, and they require reopening the URL and range requests.
+    if (opts->connections > 1 && stream->is_network && s->seekable &&
+        s->stream_size > 0)
+        init_conns(s, opts->connections);
 
     if (pthread_create(&s->cache_thread, NULL, cache_thread, s) != 0) {
         MP_ERR(s, "Starting cache thread failed.\n");
@@ -16,7 +16,16 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <libavutil/mem.h>
+#include <libavutil/sha.h>
+#include <libavutil/intreadwrite.h>
 
 #include "osdep/io.h"
 
@@ -24,18 +33,28 @@
 #include "common/msg.h"
 
 #include "options/options.h"
+#include "options/path.h"
 
 #include "stream.h"
 
 #define BLOCK_SIZE 1024LL
 #define BLOCK_ALIGN(p) ((p) & ~(BLOCK_SIZE - 1))
 
+// For --cache-file=PERSIST. Each cached stream consists of a data file and a
+// ".bits" file, which contains the URL, the stream size, and block_bits.
+#define PERSIST_DIR "stream_cache"
+#define PERSIST_MAGIC "mpvfcch1"
+
 struct priv {
     struct stream *original;
     FILE *cache_file;
     uint8_t *block_bits;    // 1 bit for each BLOCK_SIZE, whether block was read
+    size_t block_bits_size;
     int64_t size;           // currently known size
     int64_t max_size;       // max. size for block_bits and cache_file
+    char *bits_filename;    // set if the cache is persistent
+    char *url;
+    int64_t stream_size;    // size on open (persistent cache only)
 };
 
 static bool test_bit(struct priv *p, int64_t pos)
@@ -112,11 +131,176 @@ static int control(stream_t *s, int cmd, void *arg)
     return stream_control(p->original, cmd, arg);
 }
 
+static void save_bits(struct stream *s, struct priv *p)
+{
+    FILE *f = fopen(p->bits_filename, "wb");
+    if (!f) {
+        MP_WARN(s, "Can't write '%s'.\n", p->bits_filename);
+        return;
+    }
+    uint8_t hdr[8 + 8 + 8 + 4];
+    memcpy(hdr, PERSIST_MAGIC, 8);
+    AV_WL64(hdr + 8, p->stream_size);
+    AV_WL64(hdr + 16, p->max_size);
+    AV_WL32(hdr + 24, strlen(p->url));
+    bool ok = fwrite(hdr, sizeof(hdr), 1, f) == 1 &&
+              fwrite(p->url, strlen(p->url), 1, f) == 1 &&
+              fwrite(p->block_bits, p->block_bits_size, 1, f) == 1;
+    if (fclose(f) || !ok) {
+        MP_WARN(s, "Error writing '%s'.\n", p->bits_filename);
+        remove(p->bits_filename);
+    }
+}
+
+// Load block_bits from the .bits file. Fails if it doesn't match the stream.
+static bool load_bits(struct stream *s, struct priv *p)
+{
+    FILE *f = fopen(p->bits_filename, "rb");
+    if (!f)
+        return false;
+    bool ok = false;
+    uint8_t hdr[8 + 8 + 8 + 4];
+    if (fread(hdr, sizeof(hdr), 1, f) != 1 || memcmp(hdr, PERSIST_MAGIC, 8))
+        goto done;
+    if (AV_RL64(hdr + 8) != p->stream_size || AV_RL64(hdr + 16) != p->max_size)
+        goto done;
+    size_t url_len = AV_RL32(hdr + 24);
+    if (url_len != strlen(p->url))
+        goto done;
+    char *url = talloc_size(NULL, url_len);
+    bool url_ok = fread(url, url_len, 1, f) == 1 &&
+                  memcmp(url, p->url, url_len) == 0;
+    talloc_free(url);
+    if (!url_ok)
+        goto done;
+    ok = fread(p->block_bits, p->block_bits_size, 1, f) == 1;
+done:
+    fclose(f);
+    if (!ok) {
+        MP_VERBOSE(s, "Discarding invalid '%s'.\n", p->bits_filename);
+        memset(p->block_bits, 0, p->block_bits_size);
+    }
+    return ok;
+}
+
+struct persist_entry {
+    char *data, *bits;
+    int64_t size;
+    time_t last_use;
+};
+
+static int cmp_last_use(const void *a, const void *b)
+{
+    const struct persist_entry *ea = a, *eb = b;
+    return ea->last_use < eb->last_use ? -1 : (ea->last_use > eb->last_use);
+}
+
+// Remove the least recently used cache files until the total size is below
+// max_size. The .bits file is rewritten on every close, so its mtime is the
+// last use time.
+static void evict_persistent(struct stream *s, char *dir, int64_t max_size)
+{
+    void *tmp = talloc_new(NULL);
+    struct persist_entry *entries = NULL;
+    int num_entries = 0;
+    int64_t total = 0;
+
+    DIR *d = opendir(dir);
+    if (!d)
+        goto done;
+    struct dirent *ep;
+    while ((ep = readdir(d))) {
+        bstr name = bstr0(ep->d_name);
+        if (!bstr_endswith0(name, ".bits"))
+            continue;
+        struct persist_entry e = {
+            .bits = mp_path_join(tmp, dir, ep->d_name),
+            .data = mp_path_join_bstr(tmp, bstr0(dir),
+                                      bstr_splice(name, 0, name.len - 5)),
+        };
+        struct stat st;
+        if (stat(e.bits, &st))
+            continue;
+        e.last_use = st.st_mtime;
+        if (stat(e.data, &st) == 0)
+            e.size = st.st_size;
+        total += e.size;
+        MP_TARRAY_APPEND(tmp, entries, num_entries, e);
+    }
+    closedir(d);
+
+    if (entries)
+        qsort(entries, num_entries, sizeof(entries[0]), cmp_last_use);
+    for (int n = 0; n < num_entries && total > max_size; n++) {
+        MP_VERBOSE(s, "Removing '%s' from the cache.\n", entries[n].data);
+        remove(entries[n].data);
+        remove(entries[n].bits);
+        total -= entries[n].size;
+    }
+
+done:
+    talloc_free(tmp);
+}
+
+// Open the cache file for the stream in the persistent cache directory. The
+// cache entry is found by the URL and the stream size.
+static FILE *open_persistent(struct stream *cache, struct stream *stream,
+                             struct priv *p, struct mp_cache_opts *opts)
+{
+    p->stream_size = stream_get_size(stream);
+    if (p->stream_size <= 0 || !stream->url) {
+        MP_ERR(cache, "persistent cache requires a stream with known size\n");
+        return NULL;
+    }
+
+    mp_mk_config_dir(stream->global, PERSIST_DIR);
+    char *dir = mp_find_user_config_file(p, stream->global, PERSIST_DIR);
+    if (!dir)
+        return NULL;
+
+    evict_persistent(cache, dir, opts->file_total_max * 1024LL);
+
+    struct AVSHA *sha = av_sha_alloc();
+    if (!sha)
+        return NULL;
+    uint8_t hash[32];
+    av_sha_init(sha, 256);
+    av_sha_update(sha, stream->url, strlen(stream->url));
+    av_sha_final(sha, hash);
+    av_free(sha);
+
+    char *name = talloc_strdup(p, "");
+    for (int n = 0; n < sizeof(hash); n++)
+        name = talloc_asprintf_append(name, "%02X", hash[n]);
+    name = talloc_asprintf_append(name, "-%"PRId64, p->stream_size);
+    char *filename = mp_path_join(p, dir, name);
+    p->bits_filename = talloc_asprintf(p, "%s.bits", filename);
+    p->url = talloc_strdup(p, stream->url);
+
+    FILE *file = NULL;
+    if (load_bits(cache, p)) {
+        file = fopen(filename, "rb+");
+        if (file)
+            MP_VERBOSE(cache, "Reusing cache file '%s'.\n", filename);
+    }
+    if (!file) {
+        memset(p->block_bits, 0, p->block_bits_size);
+        remove(p->bits_filename);
+        file = fopen(filename, "wb+");
+    }
+    if (!file)
+        MP_ERR(cache, "can't open cache file '%s'\n", filename);
+    return file;
+}
+
 static void s_close(stream_t *s)
 {
     struct priv *p = s->priv;
-    if (p->cache_file)
+    if (p->cache_file) {
         fclose(p->cache_file);
+        if (p->bits_filename)
+            save_bits(s, p);
+    }
     talloc_free(p);
 }
 
@@ -132,22 +316,34 @@ int stream_file_cache_init(stream_t *cache, stream_t *stream,
         return -1;
     }
 
-    bool use_anon_file = strcmp(opts->file, "TMP") == 0;
-    FILE *file = use_anon_file ? tmpfile() : fopen(opts->file, "wb+");
+    struct priv *p = talloc_zero(NULL, struct priv);
+    p->max_size = opts->file_max * 1024LL;
+
+    // file_max can be INT_MAX, so this is at most about 256MB
+    p->block_bits_size = (p->max_size / BLOCK_SIZE + 1) / 8 + 1;
+    p->block_bits = talloc_zero_size(p, p->block_bits_size);
+
+    FILE *file = NULL;
+    if (strcmp(opts->file, "TMP") == 0) {
+        file = tmpfile();
+    } else if (strcmp(opts->file, "PERSIST") == 0) {
+        file = open_persistent(cache, stream, p, opts);
+        if (!file) {
+            talloc_free(p);
+            return -1;
+        }
+    } else {
+        file = fopen(opts->file, "wb+");
+    }
     if (!file) {
         MP_ERR(cache, "can't open cache file '%s'\n", opts->file);
+        talloc_free(p);
         return -1;
     }
 
-    struct priv *p = talloc_zero(NULL, struct priv);
-
     cache->priv = p;
     p->original = stream;
     p->cache_file = file;
-    p->max_size = opts->file_max * 1024LL;
-
-    // file_max can be INT_MAX, so this is at most about 256MB
-    p->block_bits = talloc_zero_size(p, (p->max_size / BLOCK_SIZE + 1) / 8 + 1);
 
     cache->seek = seek;
     cache->fill_buffer = fill_buffer;
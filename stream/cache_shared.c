@@ -0,0 +1,364 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <libavutil/mem.h>
+#include <libavutil/sha.h>
+
+#include "osdep/atomics.h"
+#include "osdep/timer.h"
+
+#include "common/common.h"
+#include "common/msg.h"
+
+#include "options/options.h"
+
+#include "stream.h"
+
+// Shared cache for --cache-shared. The first part of the stream is mirrored in
+// a POSIX shared memory object, which is found by the URL and the stream size.
+// All mpv processes playing the same stream attach to it. Each block is
+// fetched by whichever process needs it first; the others wait for it and
+// then read it from shared memory, so every block is downloaded only once.
+//
+// Each block has an atomic state: BLOCK_EMPTY, BLOCK_VALID, or the PID of the
+// process fetching it. There are no locks: a block is claimed with a CAS, and
+// if the fetching process dies, another process takes the block over.
+//
+// The attached processes are recorded by PID as well. Slots of processes that
+// died are reused, and the object is removed once no live process is left, so
+// an object left behind by a crash is cleaned up when the stream is played
+// again.
+
+#define BLOCK_SIZE (64 * 1024LL)
+
+#define BLOCK_EMPTY 0
+#define BLOCK_VALID -1
+
+#define MAX_USERS 64
+
+struct shared_header {
+    int64_t stream_size;
+    int64_t data_size;      // number of bytes of the stream covered
+    uint8_t url_hash[32];
+    atomic_int ready;       // set by the creator once the fields above are set
+    atomic_int users[MAX_USERS]; // PIDs of attached processes, 0 if unused
+    // followed by atomic_int block_state[num_blocks], and the data
+};
+
+struct priv {
+    struct stream *original;
+    char *name;             // name of the shared memory object
+    struct shared_header *hdr;
+    size_t map_size;
+    atomic_int *block_state;
+    char *data;
+    int64_t data_size;
+};
+
+// Return whether the process is known to be gone.
+static bool process_dead(int pid)
+{
+    return kill(pid, 0) && errno == ESRCH;
+}
+
+static bool fetch_block(stream_t *s, int64_t block)
+{
+    struct priv *p = s->priv;
+    int64_t pos = block * BLOCK_SIZE;
+    int len = MPMIN(BLOCK_SIZE, p->data_size - pos);
+    if (stream_seek(p->original, pos) < 1)
+        return false;
+    int r = stream_read(p->original, p->data + pos, len);
+    if (r < len) {
+        MP_ERR(s, "unexpected EOF\n");
+        return false;
+    }
+    return true;
+}
+
+// Make sure the block is available in shared memory. Fetches it, unless
+// another process is doing so already, in which case this waits for it.
+static bool get_block(stream_t *s, int64_t block)
+{
+    struct priv *p = s->priv;
+    atomic_int *state = &p->block_state[block];
+    int pid = getpid();
+
+    while (1) {
+        int st = atomic_load(state);
+        if (st == BLOCK_VALID)
+            return true;
+        if (st == BLOCK_EMPTY) {
+            if (atomic_compare_exchange_strong(state, &st, pid)) {
+                bool ok = fetch_block(s, block);
+                atomic_store(state, ok ? BLOCK_VALID : BLOCK_EMPTY);
+                return ok;
+            }
+            continue;
+        }
+        if (process_dead(st)) {
+            MP_VERBOSE(s, "Process %d died while fetching, taking over.\n", st);
+            atomic_compare_exchange_strong(state, &st, BLOCK_EMPTY);
+            continue;
+        }
+        if (mp_cancel_test(s->cancel))
+            return false;
+        mp_sleep_us(1000);
+    }
+}
+
+static int fill_buffer(stream_t *s, char *buffer, int max_len)
+{
+    struct priv *p = s->priv;
+    if (s->pos < 0)
+        return -1;
+    if (s->pos >= p->data_size) {
+        if (stream_seek(p->original, s->pos) < 1)
+            return -1;
+        return stream_read(p->original, buffer, max_len);
+    }
+    int64_t block = s->pos / BLOCK_SIZE;
+    if (!get_block(s, block))
+        return -1;
+    int64_t block_end = MPMIN((block + 1) * BLOCK_SIZE, p->data_size);
+    int len = MPMIN(max_len, block_end - s->pos);
+    memcpy(buffer, p->data + s->pos, len);
+    return len;
+}
+
+static int seek(stream_t *s, int64_t newpos)
+{
+    return 1;
+}
+
+static int control(stream_t *s, int cmd, void *arg)
+{
+    struct priv *p = s->priv;
+    return stream_control(p->original, cmd, arg);
+}
+
+// Record the calling process as user. Returns false if all slots are taken.
+static bool add_user(struct shared_header *hdr)
+{
+    int pid = getpid();
+    for (int n = 0; n < MAX_USERS; n++) {
+        int cur = atomic_load(&hdr->users[n]);
+        if ((cur == 0 || process_dead(cur)) &&
+            atomic_compare_exchange_strong(&hdr->users[n], &cur, pid))
+            return true;
+    }
+    return false;
+}
+
+static bool has_live_users(struct shared_header *hdr)
+{
+    for (int n = 0; n < MAX_USERS; n++) {
+        int cur = atomic_load(&hdr->users[n]);
+        if (cur && !process_dead(cur))
+            return true;
+    }
+    return false;
+}
+
+static void remove_user(struct shared_header *hdr)
+{
+    int pid = getpid();
+    for (int n = 0; n < MAX_USERS; n++) {
+        int cur = pid;
+        if (atomic_compare_exchange_strong(&hdr->users[n], &cur, 0))
+            break;
+    }
+}
+
+static void s_close(stream_t *s)
+{
+    struct priv *p = s->priv;
+    remove_user(p->hdr);
+    if (!has_live_users(p->hdr))
+        shm_unlink(p->name);
+    munmap(p->hdr, p->map_size);
+    talloc_free(p);
+}
+
+// Wait until the process that created the object has set its size, and
+// finished initializing the header.
+static bool wait_ready(int fd, struct priv *p)
+{
+    for (int n = 0; n < 100; n++) {
+        struct stat st;
+        if (fstat(fd, &st))
+            return false;
+        if (st.st_size == p->map_size)
+            return true;
+        if (st.st_size != 0)
+            return false;
+        mp_sleep_us(10000);
+    }
+    return false;
+}
+
+// Create or attach to the shared memory object. Returns the mapping or NULL.
+static struct shared_header *open_shared(stream_t *cache, struct priv *p,
+                                         bool *out_created)
+{
+    int fd = shm_open(p->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    bool created = fd >= 0;
+    if (!created && errno == EEXIST)
+        fd = shm_open(p->name, O_RDWR, 0);
+    if (fd < 0) {
+        MP_ERR(cache, "can't open shared memory '%s': %s\n", p->name,
+               mp_strerror(errno));
+        return NULL;
+    }
+
+    bool ok;
+    if (created) {
+        // Reserve the memory now. With a plain ftruncate(), running out of
+        // shared memory later would raise SIGBUS on access.
+        int err = posix_fallocate(fd, 0, p->map_size);
+        if (err) {
+            MP_WARN(cache, "can't allocate %zu bytes of shared memory: %s\n",
+                    p->map_size, mp_strerror(err));
+        }
+        ok = !err;
+    } else {
+        ok = wait_ready(fd, p);
+    }
+    void *map = MAP_FAILED;
+    if (ok) {
+        map = mmap(NULL, p->map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+        MP_ERR(cache, "can't map shared memory '%s'\n", p->name);
+        // An object that doesn't get the expected size is assumed to be left
+        // over from a process that died while creating it.
+        if (created || !ok)
+            shm_unlink(p->name);
+        return NULL;
+    }
+
+    MP_VERBOSE(cache, "%s shared cache '%s'.\n",
+               created ? "Created" : "Attaching to", p->name);
+    *out_created = created;
+    return map;
+}
+
+// return 1 on success, 0 if disabled, -1 on error
+int stream_shared_cache_init(stream_t *cache, stream_t *stream,
+                             struct mp_cache_opts *opts)
+{
+    if (!opts->shared || opts->shared_max < 1)
+        return 0;
+
+    int64_t stream_size = stream_get_size(stream);
+    if (!stream->seekable || stream_size <= 0 || !stream->url) {
+        MP_WARN(cache, "shared cache requires a seekable stream with known "
+                "size\n");
+        return 0;
+    }
+
+    struct AVSHA *sha = av_sha_alloc();
+    if (!sha)
+        return -1;
+    uint8_t hash[32];
+    av_sha_init(sha, 256);
+    av_sha_update(sha, stream->url, strlen(stream->url));
+    av_sha_final(sha, hash);
+    av_free(sha);
+
+    struct priv *p = talloc_zero(NULL, struct priv);
+    p->original = stream;
+    p->data_size = MPMIN(stream_size, opts->shared_max * 1024LL);
+
+    int64_t num_blocks = (p->data_size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    size_t data_offset = MP_ALIGN_UP(sizeof(struct shared_header) +
+                                     num_blocks * sizeof(atomic_int), 4096);
+    p->map_size = data_offset + p->data_size;
+
+    // The object name includes the covered size, so processes with different
+    // --cache-shared-size values simply don't share.
+    p->name = talloc_strdup(p, "/mpv-cache-");
+    for (int n = 0; n < 16; n++)
+        p->name = talloc_asprintf_append(p->name, "%02X", hash[n]);
+    p->name = talloc_asprintf_append(p->name, "-%"PRId64"-%"PRId64,
+                                     stream_size, p->data_size);
+
+    bool created = false;
+    struct shared_header *hdr = open_shared(cache, p, &created);
+    if (!hdr) {
+        talloc_free(p);
+        return -1;
+    }
+    p->hdr = hdr;
+    p->block_state = (atomic_int *)(hdr + 1);
+    p->data = (char *)hdr + data_offset;
+
+    if (!add_user(hdr)) {
+        MP_ERR(cache, "too many processes use shared cache '%s'\n", p->name);
+        cache->priv = p;
+        s_close(cache);
+        cache->priv = NULL;
+        return -1;
+    }
+
+    if (created) {
+        // The memory is zero-initialized, which also marks all blocks as
+        // BLOCK_EMPTY.
+        hdr->stream_size = stream_size;
+        hdr->data_size = p->data_size;
+        memcpy(hdr->url_hash, hash, sizeof(hash));
+        atomic_store(&hdr->ready, 1);
+    }
+
+    for (int n = 0; n < 100 && !atomic_load(&hdr->ready); n++)
+        mp_sleep_us(10000);
+
+    // If the creator died before setting ready, this drops the last live
+    // user and removes the object, so the next attempt creates it anew.
+    if (!atomic_load(&hdr->ready) || hdr->stream_size != stream_size ||
+        hdr->data_size != p->data_size ||
+        memcmp(hdr->url_hash, hash, sizeof(hash)) != 0)
+    {
+        MP_ERR(cache, "shared cache '%s' doesn't match the stream\n", p->name);
+        cache->priv = p;
+        s_close(cache);
+        cache->priv = NULL;
+        return -1;
+    }
+
+    cache->priv = p;
+    cache->seek = seek;
+    cache->fill_buffer = fill_buffer;
+    cache->control = control;
+    cache->close = s_close;
+
+    return 1;
+}
@@ -120,6 +120,7 @@ typedef struct dvb_params {
     char *cfg_file;
 
     int cfg_full_transponder;
+    char **cfg_extra_progs;
 } dvb_priv_t;
 
 #define TUNER_SAT       1
@@ -397,24 +397,38 @@ stream_t *open_output_stream(const char *filename, struct mpv_global *global)
     return stream_create(filename, STREAM_WRITE, NULL, global);
 }
 
-static bool stream_reconnect(stream_t *s)
+// Make a single attempt to reconnect the stream, and to resume at the current
+// position. Returns 1 on success, 0 on failure, and -1 if reconnecting is
+// not possible at all.
+int stream_try_reconnect(stream_t *s)
 {
     if (!s->streaming || s->uncached_stream || !s->seekable || !s->cancel)
-        return false;
+        return -1;
 
     int64_t pos = s->pos;
+    int r = stream_control(s, STREAM_CTRL_RECONNECT, NULL);
+    if (r == STREAM_UNSUPPORTED)
+        return -1;
+    if (r == STREAM_OK && stream_seek_unbuffered(s, pos) && s->pos == pos) {
+        MP_WARN(s, "Reconnected successfully.\n");
+        return 1;
+    }
+    return 0;
+}
+
+static bool stream_reconnect(stream_t *s)
+{
+    if (s->async_reconnect)
+        return false;
+
     double sleep_secs = 0;
-    for (int retry = 0; retry < 6; retry++) {
-        if (mp_cancel_wait(s->cancel, sleep_secs))
+    for (int retry = 0; retry < STREAM_RECONNECT_RETRIES; retry++) {
+        if (s->cancel && mp_cancel_wait(s->cancel, sleep_secs))
             break;
 
-        int r = stream_control(s, STREAM_CTRL_RECONNECT, NULL);
-        if (r == STREAM_UNSUPPORTED)
-            break;
-        if (r == STREAM_OK && stream_seek_unbuffered(s, pos) && s->pos == pos) {
-            MP_WARN(s, "Reconnected successfully.\n");
-            return true;
-        }
+        int r = stream_try_reconnect(s);
+        if (r != 0)
+            return r > 0;
 
         MP_WARN(s, "Connection lost! Attempting to reconnect (%d)...\n", retry + 1);
 
@@ -491,8 +505,10 @@ static int stream_fill_buffer_by(stream_t *s, int64_t len)
 {
     len = MPMIN(len, s->read_chunk);
     len = MPMAX(len, STREAM_BUFFER_SIZE);
+    // s->buffer can't take more, whatever read_chunk the stream requests.
+    len = MPMIN(len, STREAM_MAX_BUFFER_SIZE);
     if (s->sector_size)
-        len = s->sector_size;
+        len = MPMAX(len / s->sector_size, 1) * s->sector_size;
     len = stream_read_unbuffered(s, s->buffer, len);
     s->buf_pos = 0;
     s->buf_len = len;
@@ -516,7 +532,8 @@ int stream_read_partial(stream_t *s, char *buf, int buf_size)
         // Also, small reads will be more efficient with buffering & copying
         if (!s->sector_size && buf_size >= STREAM_BUFFER_SIZE)
             return stream_read_unbuffered(s, buf, buf_size);
-        if (!stream_fill_buffer(s))
+        // Sector based streams can read multiple sectors at once.
+        if (!stream_fill_buffer_by(s, buf_size))
             return 0;
     }
     int len = FFMIN(buf_size, s->buf_len - s->buf_pos);
@@ -792,11 +809,23 @@ int stream_enable_cache(stream_t **stream, struct mp_cache_opts *opts)
     if (use_opts.size < 1)
         return 0;
 
-    stream_t *fcache = open_cache(orig, "file-cache");
-    if (stream_file_cache_init(fcache, orig, &use_opts) <= 0) {
+    stream_t *fcache = NULL;
+#if HAVE_SHARED_CACHE
+    fcache = open_cache(orig, "shared-cache");
+    if (stream_shared_cache_init(fcache, orig, &use_opts) <= 0) {
         fcache->uncached_stream = NULL; // don't free original stream
         free_stream(fcache);
-        fcache = orig;
+        fcache = NULL;
+    }
+#endif
+
+    if (!fcache) {
+        fcache = open_cache(orig, "file-cache");
+        if (stream_file_cache_init(fcache, orig, &use_opts) <= 0) {
+            fcache->uncached_stream = NULL; // don't free original stream
+            free_stream(fcache);
+            fcache = orig;
+        }
     }
 
     stream_t *cache = open_cache(fcache, "cache");
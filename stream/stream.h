@@ -125,6 +125,8 @@ struct stream_cache_info {
     int64_t fill;
     bool idle;
     int64_t speed;
+    bool reconnecting;
+    int64_t reconnects;     // number of reconnect attempts
 };
 
 struct stream_lang_req {
@@ -202,6 +204,7 @@ typedef struct stream {
     bool fast_skip : 1; // consider stream fast enough to fw-seek by skipping
     bool is_network : 1; // original stream_info_t.is_network flag
     bool allow_caching : 1; // stream cache makes sense
+    bool async_reconnect : 1; // user calls stream_try_reconnect() on errors
     struct mp_log *log;
     struct MPOpts *opts;
     struct mpv_global *global;
@@ -230,6 +233,8 @@ int stream_cache_init(stream_t *cache, stream_t *stream,
                       struct mp_cache_opts *opts);
 int stream_file_cache_init(stream_t *cache, stream_t *stream,
                            struct mp_cache_opts *opts);
+int stream_shared_cache_init(stream_t *cache, stream_t *stream,
+                             struct mp_cache_opts *opts);
 
 int stream_write_buffer(stream_t *s, unsigned char *buf, int len);
 
@@ -269,6 +274,8 @@ struct bstr stream_read_file(const char *filename, void *talloc_ctx,
                              struct mpv_global *global, int max_size);
 int stream_control(stream_t *s, int cmd, void *arg);
 void free_stream(stream_t *s);
+#define STREAM_RECONNECT_RETRIES 6
+int stream_try_reconnect(stream_t *s);
 struct stream *stream_create(const char *url, int flags,
                              struct mp_cancel *c, struct mpv_global *global);
 struct stream *stream_open(const char *filename, struct mpv_global *global);
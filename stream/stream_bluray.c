@@ -56,6 +56,7 @@
 #define BLURAY_DEFAULT_CHAPTER    0
 #define BLURAY_DEFAULT_TITLE     -2
 #define BLURAY_MENU_TITLE        -1
+#define BLURAY_LONGEST_TITLE     -3
 
 // 90khz ticks
 #define BD_TIMEBASE (90000)
@@ -98,7 +99,8 @@ static const struct bluray_priv_s bdnav_stream_priv_dflts = {
 #define OPT_BASE_STRUCT struct bluray_priv_s
 static const m_option_t bluray_stream_opts_fields[] = {
     OPT_CHOICE_OR_INT("title", cfg_title, 0, 0, 99999,
-                      ({"longest", BLURAY_DEFAULT_TITLE})),
+                      ({"main", BLURAY_DEFAULT_TITLE},
+                       {"longest", BLURAY_LONGEST_TITLE})),
     OPT_STRING("device", cfg_device, 0),
     {0}
 };
@@ -368,7 +370,8 @@ static void select_initial_title(stream_t *s, int title_guess) {
     struct bluray_priv_s *b = s->priv;
 
     int title = -1;
-    if (b->cfg_title != BLURAY_DEFAULT_TITLE )
+    if (b->cfg_title != BLURAY_DEFAULT_TITLE &&
+        b->cfg_title != BLURAY_LONGEST_TITLE)
         title = b->cfg_title;
     else
         title = title_guess;
@@ -425,26 +428,33 @@ static int bluray_stream_open(stream_t *s)
             return STREAM_UNSUPPORTED;
         }
 
-        MP_VERBOSE(s, "List of available titles:\n");
-
-        /* parse titles information */
-        uint64_t max_duration = 0;
-        for (int i = 0; i < b->num_titles; i++) {
-            BLURAY_TITLE_INFO *ti = bd_get_title_info(bd, i, 0);
-            if (!ti)
-                continue;
-
-            MP_VERBOSE(s, "idx: %3d duration: %s (playlist: %05d.mpls)\n",
-                       i + 1, mp_format_time(ti->duration / 90000, false),
-                       ti->playlist);
+        // libbluray picks the main title from the playlists it has parsed
+        // already. Fetching the info of each title would parse all clip info
+        // files, which takes a long time on discs with many playlists, so
+        // do that only for title=longest and the verbose title list.
+        bool longest = b->cfg_title == BLURAY_LONGEST_TITLE;
+        if (!longest)
+            title_guess = bd_get_main_title(bd);
+
+        if (longest || mp_msg_test(s->log, MSGL_V)) {
+            MP_VERBOSE(s, "List of available titles:\n");
+            uint64_t max_duration = 0;
+            for (int i = 0; i < b->num_titles; i++) {
+                BLURAY_TITLE_INFO *ti = bd_get_title_info(bd, i, 0);
+                if (!ti)
+                    continue;
+
+                MP_VERBOSE(s, "idx: %3d duration: %s (playlist: %05d.mpls)\n",
+                           i + 1, mp_format_time(ti->duration / 90000, false),
+                           ti->playlist);
+
+                if (longest && ti->duration > max_duration) {
+                    max_duration = ti->duration;
+                    title_guess = i;
+                }
 
-            /* try to guess which title may contain the main movie */
-            if (ti->duration > max_duration) {
-                max_duration = ti->duration;
-                title_guess = i;
+                bd_free_title_info(ti);
             }
-
-            bd_free_title_info(ti);
         }
     }
 
@@ -1,13 +1,16 @@
 #include "config.h"
 
 #include <stdio.h>
+#include <assert.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include "osdep/io.h"
+#include "osdep/timer.h"
 
 #include "common/common.h"
 #include "common/msg.h"
@@ -18,13 +21,72 @@
 #include "player/client.h"
 #include "libmpv/stream_cb.h"
 
+struct mpv_stream_cb_read_request {
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    bool done;
+    int64_t result;
+};
+
 struct priv {
     mpv_stream_cb_info info;
+    // Only one read is outstanding at a time, so this is reused.
+    struct mpv_stream_cb_read_request req;
 };
 
+void mpv_stream_cb_read_complete(mpv_stream_cb_read_request *req,
+                                 int64_t result)
+{
+    pthread_mutex_lock(&req->lock);
+    assert(!req->done);
+    req->result = result;
+    req->done = true;
+    pthread_cond_signal(&req->wakeup);
+    pthread_mutex_unlock(&req->lock);
+}
+
+static int read_async(stream_t *s, char *buffer, int max_len)
+{
+    struct priv *p = s->priv;
+    struct mpv_stream_cb_read_request *req = &p->req;
+
+    pthread_mutex_lock(&req->lock);
+    req->done = false;
+    req->result = -1;
+    pthread_mutex_unlock(&req->lock);
+
+    if (p->info.read_async_fn(p->info.cookie, buffer, max_len, req) < 0)
+        return -1;
+
+    // The buffer belongs to the user until the request is completed, so even
+    // if the stream is cancelled, we have to wait for it. The cancel callback
+    // gives the user a chance to complete it early.
+    bool cancel_sent = false;
+    pthread_mutex_lock(&req->lock);
+    while (!req->done) {
+        if (!cancel_sent && s->cancel && mp_cancel_test(s->cancel)) {
+            cancel_sent = true;
+            if (p->info.cancel_fn) {
+                pthread_mutex_unlock(&req->lock);
+                p->info.cancel_fn(p->info.cookie);
+                pthread_mutex_lock(&req->lock);
+                continue;
+            }
+        }
+        struct timespec ts = mp_rel_time_to_timespec(0.05);
+        pthread_cond_timedwait(&req->wakeup, &req->lock, &ts);
+    }
+    int64_t r = req->result;
+    pthread_mutex_unlock(&req->lock);
+
+    return r;
+}
+
 static int fill_buffer(stream_t *s, char *buffer, int max_len)
 {
     struct priv *p = s->priv;
+    if (p->info.read_async_fn)
+        return read_async(s, buffer, max_len);
     return (int)p->info.read_fn(p->info.cookie, buffer, (size_t)max_len);
 }
 
@@ -56,6 +118,8 @@ static void s_close(stream_t *s)
 {
     struct priv *p = s->priv;
     p->info.close_fn(p->info.cookie);
+    pthread_cond_destroy(&p->req.wakeup);
+    pthread_mutex_destroy(&p->req.lock);
 }
 
 static int open_cb(stream_t *stream)
@@ -81,12 +145,14 @@ static int open_cb(stream_t *stream)
         return STREAM_ERROR;
     }
 
-    if (!info.read_fn || !info.close_fn) {
+    if (!(info.read_fn || info.read_async_fn) || !info.close_fn) {
         MP_FATAL(stream, "required read_fn or close_fn callbacks not set.\n");
         return STREAM_ERROR;
     }
 
     p->info = info;
+    pthread_mutex_init(&p->req.lock, NULL);
+    pthread_cond_init(&p->req.wakeup, NULL);
 
     if (p->info.seek_fn && p->info.seek_fn(p->info.cookie, 0) >= 0) {
         stream->seek = seek;
@@ -52,6 +52,7 @@ typedef struct cdda_params {
     int sector;
     int start_sector;
     int end_sector;
+    int track;  // index of the track the last read sector belongs to
 
     // options
     int speed;
@@ -160,31 +161,45 @@ static void cdparanoia_callback(long int inpos, paranoia_cb_mode_t function)
 static int fill_buffer(stream_t *s, char *buffer, int max_len)
 {
     cdda_priv *p = (cdda_priv *)s->priv;
-    int16_t *buf;
-    int i;
+    int len = 0;
 
     if (max_len < CDIO_CD_FRAMESIZE_RAW)
         return -1;
 
-    if ((p->sector < p->start_sector) || (p->sector > p->end_sector)) {
-        return 0;
-    }
+    // Read as many sectors as fit, so that the cache thread has to call this
+    // less often.
+    while (max_len - len >= CDIO_CD_FRAMESIZE_RAW) {
+        if ((p->sector < p->start_sector) || (p->sector > p->end_sector))
+            break;
 
-    buf = paranoia_read(p->cdp, cdparanoia_callback);
-    if (!buf)
-        return 0;
+        int16_t *buf = paranoia_read(p->cdp, cdparanoia_callback);
+        if (!buf)
+            break;
 
-    p->sector++;
-    memcpy(buffer, buf, CDIO_CD_FRAMESIZE_RAW);
+        memcpy(buffer + len, buf, CDIO_CD_FRAMESIZE_RAW);
+        len += CDIO_CD_FRAMESIZE_RAW;
 
-    for (i = 0; i < p->cd->tracks; i++) {
-        if (p->cd->disc_toc[i].dwStartSector == p->sector - 1) {
-            print_track_info(s, i + 1);
-            break;
+        int next = p->track + 1;
+        if (next < p->cd->tracks &&
+            p->cd->disc_toc[next].dwStartSector == p->sector)
+        {
+            p->track = next;
+            print_track_info(s, next + 1);
         }
+
+        p->sector++;
     }
 
-    return CDIO_CD_FRAMESIZE_RAW;
+    return len;
+}
+
+static int get_track_by_sector(cdda_priv *p, unsigned int sector)
+{
+    int i;
+    for (i = p->cd->tracks; i >= 0; --i)
+        if (p->cd->disc_toc[i].dwStartSector <= sector)
+            break;
+    return i;
 }
 
 static int seek(stream_t *s, int64_t newpos)
@@ -218,6 +233,8 @@ static int seek(stream_t *s, int64_t newpos)
         print_track_info(s, seeked_track + 1);
 
     p->sector = sec;
+    // If the seek was to the start of a track, fill_buffer() prints it.
+    p->track = seek_to_track ? seeked_track - 1 : seeked_track;
 
     paranoia_seek(p->cdp, sec, SEEK_SET);
     return 1;
@@ -230,15 +247,6 @@ static void close_cdda(stream_t *s)
     cdda_close(p->cd);
 }
 
-static int get_track_by_sector(cdda_priv *p, unsigned int sector)
-{
-    int i;
-    for (i = p->cd->tracks; i >= 0; --i)
-        if (p->cd->disc_toc[i].dwStartSector <= sector)
-            break;
-    return i;
-}
-
 static int control(stream_t *stream, int cmd, void *arg)
 {
     cdda_priv *p = stream->priv;
@@ -374,9 +382,12 @@ static int open_cdda(stream_t *st)
 
     paranoia_seek(priv->cdp, priv->start_sector, SEEK_SET);
     priv->sector = priv->start_sector;
+    priv->track = get_track_by_sector(priv, priv->start_sector) - 1;
 
     st->priv = priv;
     st->sector_size = CDIO_CD_FRAMESIZE_RAW;
+    // Let the cache read ahead in larger chunks (about 0.2 seconds).
+    st->read_chunk = 16 * CDIO_CD_FRAMESIZE_RAW;
 
     st->fill_buffer = fill_buffer;
     st->seek = seek;
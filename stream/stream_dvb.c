@@ -80,6 +80,7 @@ const struct m_sub_options stream_dvb_conf = {
         OPT_INTRANGE("timeout", cfg_timeout, 0, 1, 30),
         OPT_STRING("file", cfg_file, M_OPT_FILE),
         OPT_FLAG("full-transponder", cfg_full_transponder, 0),
+        OPT_STRINGLIST("extra-progs", cfg_extra_progs, 0),
         {0}
     },
     .size = sizeof(struct dvb_params),
@@ -642,6 +643,102 @@ static int dvb_streaming_read(stream_t *stream, char *buffer, int size)
 
 static void dvbin_close(stream_t *stream);
 
+static void dvb_resolve_pmt(stream_t *stream, int card, dvb_channel_t *channel)
+{
+    dvb_priv_t *priv = stream->priv;
+
+    if (channel->service_id == -1)
+        return;
+
+    /* We need the PMT-PID in addition.
+       If it has not yet beem resolved, do it now. */
+    for (int i = 0; i < channel->pids_cnt; i++) {
+        if (channel->pids[i] == -1) {
+            MP_VERBOSE(stream, "DVB_SET_CHANNEL: PMT-PID for service %d "
+                       "not resolved yet, parsing PAT...\n",
+                       channel->service_id);
+            int pmt_pid = dvb_get_pmt_pid(priv, card, channel->service_id);
+            MP_VERBOSE(stream, "DVB_SET_CHANNEL: Found PMT-PID: %d\n",
+                       pmt_pid);
+            channel->pids[i] = pmt_pid;
+        }
+    }
+}
+
+// Append the channel's PIDs to pids[], skipping duplicates. Returns false if
+// not all PIDs fit into the demuxer filter limit.
+static bool dvb_add_pids(int *pids, int *pids_cnt, dvb_channel_t *channel)
+{
+    for (int i = 0; i < channel->pids_cnt; i++) {
+        int pid = channel->pids[i];
+        bool found = false;
+        for (int n = 0; n < *pids_cnt; n++)
+            found |= pids[n] == pid && pid != -1;
+        if (found)
+            continue;
+        if (*pids_cnt >= DMX_FILTER_SIZE)
+            return false;
+        pids[(*pids_cnt)++] = pid;
+    }
+    return true;
+}
+
+// Whether both channels can be received with the same tuning parameters. The
+// frequency alone is ambiguous: satellite channels also depend on the
+// polarization and the DiSEqC input, and DVB-S2/T2/C2 multistreams on the
+// stream ID.
+static bool dvb_same_transponder(dvb_channel_t *a, dvb_channel_t *b)
+{
+    return a->freq == b->freq && a->pol == b->pol && a->diseqc == b->diseqc &&
+           a->stream_id == b->stream_id;
+}
+
+// Add the PIDs of the --dvbin-extra-progs services, so that a single tuner
+// read delivers all of them in one TS. Only services on the same transponder
+// as the main channel can be received at the same time.
+static void dvb_add_extra_services(stream_t *stream, int card,
+                                   dvb_channels_list *list,
+                                   dvb_channel_t *channel,
+                                   int *pids, int *pids_cnt)
+{
+    dvb_priv_t *priv = stream->priv;
+
+    // PID 8192 already passes the full transponder.
+    if (channel->pids_cnt == 1 && channel->pids[0] == 8192)
+        return;
+
+    for (int n = 0; priv->cfg_extra_progs && priv->cfg_extra_progs[n]; n++) {
+        char *name = priv->cfg_extra_progs[n];
+        dvb_channel_t *extra = NULL;
+        for (int i = 0; i < list->NUM_CHANNELS; i++) {
+            if (!strcmp(list->channels[i].name, name)) {
+                extra = &list->channels[i];
+                break;
+            }
+        }
+        if (!extra) {
+            MP_WARN(stream, "Extra program \"%s\" not found.\n", name);
+            continue;
+        }
+        if (extra == channel)
+            continue;
+        if (!dvb_same_transponder(extra, channel)) {
+            MP_WARN(stream, "Extra program \"%s\" is on a different "
+                    "transponder, skipping it.\n", name);
+            continue;
+        }
+        dvb_resolve_pmt(stream, card, extra);
+        int old_cnt = *pids_cnt;
+        if (!dvb_add_pids(pids, pids_cnt, extra)) {
+            MP_WARN(stream, "Too many PIDs for extra program \"%s\", "
+                    "skipping it.\n", name);
+            *pids_cnt = old_cnt;
+            continue;
+        }
+        MP_VERBOSE(stream, "Added extra program \"%s\".\n", name);
+    }
+}
+
 int dvb_set_channel(stream_t *stream, int card, int n)
 {
     dvb_channels_list *new_list;
@@ -717,30 +814,24 @@ int dvb_set_channel(stream_t *stream, int card, int n)
     state->last_freq = channel->freq;
     state->is_on = 1;
 
-    if (channel->service_id != -1) {
-        /* We need the PMT-PID in addition.
-           If it has not yet beem resolved, do it now. */
-        for (i = 0; i < channel->pids_cnt; i++) {
-            if (channel->pids[i] == -1) {
-                MP_VERBOSE(stream, "DVB_SET_CHANNEL: PMT-PID for service %d "
-                           "not resolved yet, parsing PAT...\n",
-                           channel->service_id);
-                int pmt_pid = dvb_get_pmt_pid(priv, card, channel->service_id);
-                MP_VERBOSE(stream, "DVB_SET_CHANNEL: Found PMT-PID: %d\n",
-                           pmt_pid);
-                channel->pids[i] = pmt_pid;
-            }
-        }
-    }
+    dvb_resolve_pmt(stream, card, channel);
+
+    int pids[DMX_FILTER_SIZE];
+    int pids_cnt = 0;
+    dvb_add_pids(pids, &pids_cnt, channel);
+    dvb_add_extra_services(stream, card, new_list, channel, pids, &pids_cnt);
+
+    if (pids_cnt != state->demux_fds_cnt && !dvb_fix_demuxes(priv, pids_cnt))
+        return 0;
 
     // sets demux filters and restart the stream
-    for (i = 0; i < channel->pids_cnt; i++) {
-        if (channel->pids[i] == -1) {
+    for (i = 0; i < pids_cnt; i++) {
+        if (pids[i] == -1) {
             // In case PMT was not resolved, skip it here.
             MP_ERR(stream, "DVB_SET_CHANNEL: PMT-PID not found, "
                            "teletext-decoding may fail.\n");
         } else {
-            if (!dvb_set_ts_filt(priv, state->demux_fds[i], channel->pids[i],
+            if (!dvb_set_ts_filt(priv, state->demux_fds[i], pids[i],
                                  DMX_PES_OTHER))
                 return 0;
         }
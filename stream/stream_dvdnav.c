@@ -45,8 +45,19 @@
 #define TITLE_MENU -1
 #define TITLE_LONGEST -2
 
+// Chapters and duration of a title. Getting these parses IFO files, which is
+// slow on optical drives, so they're fetched only once.
+struct title_info {
+    bool probed;
+    uint64_t *parts;    // chapter start times (90khz); NULL if unavailable
+    int num_parts;
+    uint64_t duration;  // 90khz
+};
+
 struct priv {
     dvdnav_t *dvdnav;                   // handle to libdvdnav stuff
+    struct title_info *titles;          // cache, indexed by title - 1
+    int num_titles;
     char *filename;                     // path
     unsigned int duration;              // in milliseconds
     int mousex, mousey;
@@ -240,6 +251,39 @@ static int fill_buffer(stream_t *s, char *buf, int max_len)
     return 0;
 }
 
+// title is 1-based, as with libdvdnav. Returns NULL on failure.
+static struct title_info *get_title_info(stream_t *stream, int title)
+{
+    struct priv *priv = stream->priv;
+
+    if (!priv->titles) {
+        int32_t num_titles = 0;
+        if (dvdnav_get_number_of_titles(priv->dvdnav, &num_titles) != DVDNAV_STATUS_OK ||
+            num_titles < 1)
+            return NULL;
+        priv->titles = talloc_zero_array(priv, struct title_info, num_titles);
+        priv->num_titles = num_titles;
+    }
+
+    if (title < 1 || title > priv->num_titles)
+        return NULL;
+
+    struct title_info *ti = &priv->titles[title - 1];
+    if (!ti->probed) {
+        uint64_t *parts = NULL, duration = 0;
+        int n = dvdnav_describe_title_chapters(priv->dvdnav, title, &parts,
+                                               &duration);
+        if (parts) {
+            ti->parts = talloc_memdup(priv, parts, n * sizeof(parts[0]));
+            ti->num_parts = n;
+            ti->duration = duration;
+            free(parts);
+        }
+        ti->probed = true;
+    }
+    return ti->parts ? ti : NULL;
+}
+
 static int control(stream_t *stream, int cmd, void *arg)
 {
     struct priv *priv = stream->priv;
@@ -262,14 +306,12 @@ static int control(stream_t *stream, int cmd, void *arg)
         int chapter = *ch;
         if (dvdnav_current_title_info(dvdnav, &tit, &part) != DVDNAV_STATUS_OK)
             break;
-        uint64_t *parts = NULL, duration = 0;
-        int n = dvdnav_describe_title_chapters(dvdnav, tit, &parts, &duration);
-        if (!parts)
+        struct title_info *ti = get_title_info(stream, tit);
+        if (!ti)
             break;
-        if (chapter < 0 || chapter + 1 > n)
+        if (chapter < 0 || chapter + 1 > ti->num_parts)
             break;
-        *ch = chapter > 0 ? parts[chapter - 1] / 90000.0 : 0;
-        free(parts);
+        *ch = chapter > 0 ? ti->parts[chapter - 1] / 90000.0 : 0;
         return 1;
     }
     case STREAM_CTRL_GET_TIME_LENGTH: {
@@ -302,18 +344,10 @@ static int control(stream_t *stream, int cmd, void *arg)
     }
     case STREAM_CTRL_GET_TITLE_LENGTH: {
         int t = *(double *)arg;
-        int32_t num_titles = 0;
-        if (dvdnav_get_number_of_titles(dvdnav, &num_titles) != DVDNAV_STATUS_OK)
-            break;
-        if (t < 0 || t >= num_titles)
-            break;
-        uint64_t duration = 0;
-        uint64_t *parts = NULL;
-        dvdnav_describe_title_chapters(dvdnav, t + 1, &parts, &duration);
-        if (!parts)
+        struct title_info *ti = get_title_info(stream, t + 1);
+        if (!ti)
             break;
-        free(parts);
-        *(double *)arg = duration / 90000.0;
+        *(double *)arg = ti->duration / 90000.0;
         return STREAM_OK;
     }
     case STREAM_CTRL_GET_CURRENT_TITLE: {
@@ -477,20 +511,15 @@ static int open_s(stream_t *stream)
     }
 
     if (p->track == TITLE_LONGEST) { // longest
-        dvdnav_t *dvdnav = priv->dvdnav;
         uint64_t best_length = 0;
         int best_title = -1;
         int32_t num_titles;
-        if (dvdnav_get_number_of_titles(dvdnav, &num_titles) == DVDNAV_STATUS_OK) {
+        if (dvdnav_get_number_of_titles(priv->dvdnav, &num_titles) == DVDNAV_STATUS_OK) {
             for (int n = 1; n <= num_titles; n++) {
-                uint64_t *parts = NULL, duration = 0;
-                dvdnav_describe_title_chapters(dvdnav, n, &parts, &duration);
-                if (parts) {
-                    if (duration > best_length) {
-                        best_length = duration;
-                        best_title = n;
-                    }
-                    free(parts);
+                struct title_info *ti = get_title_info(stream, n);
+                if (ti && ti->duration > best_length) {
+                    best_length = ti->duration;
+                    best_title = n;
                 }
             }
         }
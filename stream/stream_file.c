@@ -25,9 +25,12 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <string.h>
+#include <stdint.h>
 
 #ifndef __MINGW32__
 #include <poll.h>
+#include <pthread.h>
 #endif
 
 #include "osdep/io.h"
@@ -36,7 +39,10 @@
 #include "common/msg.h"
 #include "stream.h"
 #include "options/m_option.h"
+#include "options/options.h"
 #include "options/path.h"
+#include "osdep/threads.h"
+#include "osdep/timer.h"
 
 #if HAVE_BSD_FSTATFS
 #include <sys/param.h>
@@ -57,16 +63,269 @@
 #endif
 #endif
 
+// Amount of data ahead of the read position the kernel is asked to prefetch
+// if the file is memory-mapped.
+#define MMAP_WILLNEED_SIZE (8 * 1024 * 1024)
+
+// Size and alignment of a single read issued by the readahead threads.
+#define RA_BLOCK_SIZE (1024 * 1024)
+
+enum {
+    RA_FREE,
+    RA_PENDING,     // queued, not picked up by a thread yet
+    RA_READING,     // a thread is reading into it
+    RA_DONE,        // data[0..len] is valid (len < RA_BLOCK_SIZE on EOF)
+};
+
+struct ra_block {
+    int64_t pos;
+    char *data;
+    int len;
+    int state;
+};
+
+// Readahead state (--stream-readahead-depth). The threads only access the
+// blocks with the lock held, except for the data of blocks in RA_READING
+// state, which are owned by the thread reading them.
+struct readahead {
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    bool exit;
+    int fd;
+    struct ra_block *blocks;
+    int num_blocks;
+    pthread_t *threads;
+    int num_threads;
+};
+
 struct priv {
     int fd;
     bool close;
     bool regular;
+
+    // Set if the file is memory-mapped (--stream-mmap).
+    char *map;
+    int64_t map_size;
+    int64_t pos;        // read position if mapped
+    int64_t advised;    // end of the last MADV_WILLNEED range
+    int64_t page_size;
+
+    // Set if reads go through the readahead threads. p->pos is used as well.
+    struct readahead *ra;
 };
 
+static void advise_readahead(struct priv *p)
+{
+#ifndef __MINGW32__
+    if (p->pos + MMAP_WILLNEED_SIZE / 2 < p->advised)
+        return;
+    int64_t start = p->pos & ~(p->page_size - 1);
+    int64_t end = MPMIN(p->pos + MMAP_WILLNEED_SIZE, p->map_size);
+    if (end > start)
+        madvise(p->map + start, end - start, MADV_WILLNEED);
+    p->advised = end;
+#endif
+}
+
+static int fill_buffer_mapped(stream_t *s, char *buffer, int max_len)
+{
+    struct priv *p = s->priv;
+    if (p->pos >= p->map_size) {
+        // The file might have grown since it was mapped.
+        if (lseek(p->fd, p->pos, SEEK_SET) == (off_t)-1)
+            return -1;
+        int r = read(p->fd, buffer, max_len);
+        if (r <= 0)
+            return -1;
+        p->pos += r;
+        return r;
+    }
+    advise_readahead(p);
+    int len = MPMIN(max_len, p->map_size - p->pos);
+    memcpy(buffer, p->map + p->pos, len);
+    p->pos += len;
+    return len;
+}
+
+#ifndef __MINGW32__
+static void *ra_thread(void *arg)
+{
+    struct readahead *ra = arg;
+    mpthread_set_name("stream-readahead");
+
+    pthread_mutex_lock(&ra->lock);
+    while (!ra->exit) {
+        struct ra_block *b = NULL;
+        for (int n = 0; n < ra->num_blocks; n++) {
+            struct ra_block *cur = &ra->blocks[n];
+            if (cur->state == RA_PENDING && (!b || cur->pos < b->pos))
+                b = cur;
+        }
+        if (!b) {
+            pthread_cond_wait(&ra->wakeup, &ra->lock);
+            continue;
+        }
+        b->state = RA_READING;
+        int64_t pos = b->pos;
+        pthread_mutex_unlock(&ra->lock);
+
+        int len = 0;
+        while (len < RA_BLOCK_SIZE) {
+            ssize_t r = pread(ra->fd, b->data + len, RA_BLOCK_SIZE - len,
+                              pos + len);
+            if (r < 0 && errno == EINTR)
+                continue;
+            if (r <= 0)
+                break;
+            len += r;
+        }
+
+        pthread_mutex_lock(&ra->lock);
+        b->len = len;
+        b->state = RA_DONE;
+        pthread_cond_broadcast(&ra->wakeup);
+    }
+    pthread_mutex_unlock(&ra->lock);
+    return NULL;
+}
+
+// Make sure the blocks following pos are queued. Blocks before pos or beyond
+// the readahead window are recycled. Must be called with ra->lock held.
+static void ra_schedule(struct readahead *ra, int64_t pos)
+{
+    int64_t start = pos & ~(int64_t)(RA_BLOCK_SIZE - 1);
+    int64_t end = start + ra->num_blocks * (int64_t)RA_BLOCK_SIZE;
+
+    for (int n = 0; n < ra->num_blocks; n++) {
+        struct ra_block *b = &ra->blocks[n];
+        if (b->state != RA_READING && (b->pos < start || b->pos >= end))
+            b->state = RA_FREE;
+    }
+
+    bool queued = false;
+    for (int64_t bpos = start; bpos < end; bpos += RA_BLOCK_SIZE) {
+        struct ra_block *free_b = NULL;
+        bool found = false;
+        for (int n = 0; n < ra->num_blocks; n++) {
+            struct ra_block *b = &ra->blocks[n];
+            if (b->state != RA_FREE && b->pos == bpos)
+                found = true;
+            if (b->state == RA_FREE && !free_b)
+                free_b = b;
+        }
+        if (found)
+            continue;
+        if (!free_b)
+            break; // stale blocks still being read
+        free_b->pos = bpos;
+        free_b->len = 0;
+        free_b->state = RA_PENDING;
+        queued = true;
+    }
+
+    if (queued)
+        pthread_cond_broadcast(&ra->wakeup);
+}
+
+static int fill_buffer_readahead(stream_t *s, char *buffer, int max_len)
+{
+    struct priv *p = s->priv;
+    struct readahead *ra = p->ra;
+    int res = -1;
+
+    pthread_mutex_lock(&ra->lock);
+    while (1) {
+        ra_schedule(ra, p->pos);
+        struct ra_block *b = NULL;
+        for (int n = 0; n < ra->num_blocks; n++) {
+            struct ra_block *cur = &ra->blocks[n];
+            if (cur->state != RA_FREE && cur->pos <= p->pos &&
+                cur->pos + RA_BLOCK_SIZE > p->pos)
+                b = cur;
+        }
+        if (b && b->state == RA_DONE) {
+            int offset = p->pos - b->pos;
+            if (offset >= b->len) {
+                // EOF or error. Drop the block, so that a retry (e.g. if the
+                // file is still growing) reads it again.
+                b->state = RA_FREE;
+                break;
+            }
+            res = MPMIN(max_len, b->len - offset);
+            memcpy(buffer, b->data + offset, res);
+            p->pos += res;
+            break;
+        }
+        if (mp_cancel_test(s->cancel))
+            break;
+        // The blocks are read quickly, so don't bother with waking up on
+        // cancellation; just poll it.
+        struct timespec ts = mp_rel_time_to_timespec(0.1);
+        pthread_cond_timedwait(&ra->wakeup, &ra->lock, &ts);
+    }
+    pthread_mutex_unlock(&ra->lock);
+
+    return res;
+}
+
+static void uninit_readahead(struct priv *p)
+{
+    struct readahead *ra = p->ra;
+    if (!ra)
+        return;
+    pthread_mutex_lock(&ra->lock);
+    ra->exit = true;
+    pthread_cond_broadcast(&ra->wakeup);
+    pthread_mutex_unlock(&ra->lock);
+    for (int n = 0; n < ra->num_threads; n++)
+        pthread_join(ra->threads[n], NULL);
+    pthread_cond_destroy(&ra->wakeup);
+    pthread_mutex_destroy(&ra->lock);
+    talloc_free(ra);
+    p->ra = NULL;
+}
+
+static void init_readahead(stream_t *s, int depth)
+{
+    struct priv *p = s->priv;
+    struct readahead *ra = talloc_zero(NULL, struct readahead);
+    ra->fd = p->fd;
+    pthread_mutex_init(&ra->lock, NULL);
+    pthread_cond_init(&ra->wakeup, NULL);
+    p->ra = ra;
+
+    ra->num_blocks = depth;
+    ra->blocks = talloc_zero_array(ra, struct ra_block, depth);
+    for (int n = 0; n < depth; n++)
+        ra->blocks[n].data = talloc_size(ra, RA_BLOCK_SIZE);
+
+    ra->threads = talloc_zero_array(ra, pthread_t, depth);
+    for (int n = 0; n < depth; n++) {
+        if (pthread_create(&ra->threads[n], NULL, ra_thread, ra))
+            break;
+        ra->num_threads++;
+    }
+    if (!ra->num_threads) {
+        MP_WARN(s, "Could not start readahead threads.\n");
+        uninit_readahead(p);
+        return;
+    }
+
+    p->pos = lseek(p->fd, 0, SEEK_CUR);
+    if (p->pos < 0)
+        p->pos = 0;
+    MP_VERBOSE(s, "Reading ahead with %d threads.\n", ra->num_threads);
+}
+#endif
+
 static int fill_buffer(stream_t *s, char *buffer, int max_len)
 {
     struct priv *p = s->priv;
+    if (p->map)
+        return fill_buffer_mapped(s, buffer, max_len);
 #ifndef __MINGW32__
+    if (p->ra)
+        return fill_buffer_readahead(s, buffer, max_len);
     if (!p->regular) {
         int c = s->cancel ? mp_cancel_get_fd(s->cancel) : -1;
         struct pollfd fds[2] = {
@@ -100,6 +359,16 @@ static int write_buffer(stream_t *s, char *buffer, int len)
 static int seek(stream_t *s, int64_t newpos)
 {
     struct priv *p = s->priv;
+    if (p->map) {
+        p->pos = newpos;
+        p->advised = 0;
+        return 1;
+    }
+    if (p->ra) {
+        // The threads never access p->pos; the next read reschedules.
+        p->pos = newpos;
+        return 1;
+    }
     return lseek(p->fd, newpos, SEEK_SET) != (off_t)-1;
 }
 
@@ -123,6 +392,11 @@ static int control(stream_t *s, int cmd, void *arg)
 static void s_close(stream_t *s)
 {
     struct priv *p = s->priv;
+#ifndef __MINGW32__
+    uninit_readahead(p);
+#endif
+    if (p->map)
+        munmap(p->map, p->map_size);
     if (p->close && p->fd >= 0)
         close(p->fd);
 }
@@ -227,6 +501,26 @@ static bool check_stream_network(int fd)
 }
 #endif
 
+static void map_file(stream_t *s, int64_t size)
+{
+    struct priv *p = s->priv;
+    void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, p->fd, 0);
+    if (map == MAP_FAILED) {
+        MP_VERBOSE(s, "Could not map file: %s\n", mp_strerror(errno));
+        return;
+    }
+    p->map = map;
+    p->map_size = size;
+    p->pos = 0;
+#ifndef __MINGW32__
+    p->page_size = sysconf(_SC_PAGESIZE);
+    if (p->page_size <= 0)
+        p->page_size = 4096;
+    madvise(p->map, p->map_size, MADV_SEQUENTIAL);
+#endif
+    MP_VERBOSE(s, "File is memory-mapped.\n");
+}
+
 static int open_f(stream_t *stream)
 {
     struct priv *p = talloc_ptrtype(stream, p);
@@ -316,6 +610,18 @@ static int open_f(stream_t *stream)
     if (check_stream_network(p->fd))
         stream->streaming = true;
 
+    // Network filesystems might not handle mmap well, and a file truncated
+    // while it's mapped would crash us.
+    if (stream->opts && stream->opts->stream_mmap && p->regular && !write &&
+        !stream->streaming && len > 0 && (uint64_t)len <= SIZE_MAX)
+        map_file(stream, len);
+
+#ifndef __MINGW32__
+    int depth = stream->opts ? stream->opts->stream_readahead_depth : 0;
+    if (depth > 0 && p->regular && !write && !p->map && stream->seekable)
+        init_readahead(stream, depth);
+#endif
+
     return STREAM_OK;
 }
 
@@ -308,8 +308,12 @@ struct priv {
     struct stream *src;
     int64_t entry_size;
     char *entry_name;
+    bool no_seek_data;  // archive_seek_data() is not supported for the entry
+    char *skip_buffer;
 };
 
+#define SKIP_BUFFER_SIZE (64 * 1024)
+
 static int reopen_archive(stream_t *s)
 {
     struct priv *p = s->priv;
@@ -351,8 +355,13 @@ static int archive_entry_seek(stream_t *s, int64_t newpos)
     struct priv *p = s->priv;
     if (!p->mpa)
         return -1;
-    if (archive_seek_data(p->mpa->arch, newpos, SEEK_SET) >= 0)
-        return 1;
+    if (!p->no_seek_data) {
+        if (archive_seek_data(p->mpa->arch, newpos, SEEK_SET) >= 0)
+            return 1;
+        // Don't try again; reopening the archive below resets the error.
+        p->no_seek_data = true;
+        MP_VERBOSE(s, "archive entry does not support direct seeking\n");
+    }
     // libarchive can't seek in most formats.
     if (newpos < s->pos) {
         // Hack seeking backwards into working by reopening the archive and
@@ -365,14 +374,17 @@ static int archive_entry_seek(stream_t *s, int64_t newpos)
     if (newpos > s->pos) {
         // For seeking forwards, just keep reading data (there's no libarchive
         // skip function either).
-        char buffer[4096];
+        if (!p->skip_buffer)
+            p->skip_buffer = talloc_size(p, SKIP_BUFFER_SIZE);
         while (newpos > s->pos) {
-            int size = MPMIN(newpos - s->pos, sizeof(buffer));
-            int r = archive_read_data(p->mpa->arch, buffer, size);
+            int size = MPMIN(newpos - s->pos, SKIP_BUFFER_SIZE);
+            int r = archive_read_data(p->mpa->arch, p->skip_buffer, size);
             if (r < 0) {
                 MP_ERR(s, "%s\n", archive_error_string(p->mpa->arch));
                 return -1;
             }
+            if (r == 0)
+                return -1; // EOF; avoid looping forever
             s->pos += r;
         }
     }
@@ -131,7 +131,11 @@ static int open_f (stream_t *stream)
   stream->write_buffer = write_buffer;
   stream->close = close_f;
   stream->control = control;
-  stream->read_chunk = 128 * 1024;
+  // libsmbclient splits large reads into multiple SMB requests, which it keeps
+  // in flight at the same time. This hides the round trip time much better
+  // than issuing small reads one after another. This is the largest read the
+  // stream buffer can take.
+  stream->read_chunk = STREAM_MAX_BUFFER_SIZE;
   stream->streaming = true;
 
   return STREAM_OK;
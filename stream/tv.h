@@ -173,6 +173,9 @@ typedef struct {
 #define TVI_CONTROL_VID_SET_GAIN        0x11f
 #define TVI_CONTROL_VID_GET_GAIN        0x120
 #define TVI_CONTROL_VID_SET_WIDTH_HEIGHT        0x121
+/* take the next captured frame as struct demux_packet** (NULL on timeout),
+ * instead of copying it with grab_video_frame() */
+#define TVI_CONTROL_VID_GRAB_PACKET     0x122
 
 /* TUNER controls */
 #define TVI_CONTROL_TUN_GET_FREQ        0x201
@@ -57,6 +57,7 @@ known issues:
 #include "common/common.h"
 #include "video/img_fourcc.h"
 #include "audio/format.h"
+#include "demux/packet.h"
 #include "tv.h"
 #include "audio_in.h"
 
@@ -94,7 +95,7 @@ struct map {
 
 /** video ringbuffer entry */
 typedef struct {
-    unsigned char               *data;     ///< frame contents
+    struct demux_packet         *packet;   ///< frame contents
     long long                   timestamp; ///< frame timestamp
     int                         framesize; ///< actual frame size
 } video_buffer_entry;
@@ -184,6 +185,7 @@ typedef struct tt_stream_props_s{
 
 static void *audio_grabber(void *data);
 static void *video_grabber(void *data);
+static struct demux_packet *grab_video_packet(priv_t *priv);
 
 /**********************************************************************\
 
@@ -684,6 +686,9 @@ static int do_control(priv_t *priv, int cmd, void *arg)
         return TVI_CONTROL_TRUE;
     case TVI_CONTROL_VID_CHK_WIDTH:
         return TVI_CONTROL_TRUE;
+    case TVI_CONTROL_VID_GRAB_PACKET:
+        *(struct demux_packet **)arg = grab_video_packet(priv);
+        return TVI_CONTROL_TRUE;
     case TVI_CONTROL_VID_SET_WIDTH_HEIGHT:
         if (getfmt(priv) < 0) return TVI_CONTROL_FALSE;
         priv->format.fmt.pix.width = ((int *)arg)[0];
@@ -1015,7 +1020,7 @@ static int uninit(priv_t *priv)
 
     if (priv->video_ringbuffer) {
         for (int n = 0; n < priv->video_buffer_size_current; n++) {
-            free(priv->video_ringbuffer[n].data);
+            free_demux_packet(priv->video_ringbuffer[n].packet);
         }
         free(priv->video_ringbuffer);
     }
@@ -1378,21 +1383,25 @@ static int start(priv_t *priv)
     return 1;
 }
 
-// copies a video frame
-static inline void copy_frame(priv_t *priv, video_buffer_entry *dest, unsigned char *source,int len)
+// copies a video frame straight into the packet that is passed to the demuxer
+static inline bool copy_frame(priv_t *priv, video_buffer_entry *dest, unsigned char *source,int len)
 {
+    dest->packet = new_demux_packet(len);
+    if (!dest->packet)
+        return false;
     dest->framesize=len;
     if(priv->tv_param->automute>0){
         if (v4l2_ioctl(priv->video_fd, VIDIOC_G_TUNER, &priv->tuner) >= 0) {
             if(priv->tv_param->automute<<8>priv->tuner.signal){
-                fill_blank_frame(dest->data,dest->framesize,fcc_vl2mp(priv->format.fmt.pix.pixelformat));
+                fill_blank_frame(dest->packet->buffer,dest->framesize,fcc_vl2mp(priv->format.fmt.pix.pixelformat));
                 set_mute(priv,1);
-                return;
+                return true;
             }
         }
         set_mute(priv,0);
     }
-    memcpy(dest->data, source, len);
+    memcpy(dest->packet->buffer, source, len);
+    return true;
 }
 
 // maximum skew change, in frames
@@ -1402,7 +1411,6 @@ static void *video_grabber(void *data)
     priv_t *priv = (priv_t*)data;
     long long skew, prev_skew, xskew, interval, prev_interval, delta;
     int i;
-    int framesize = priv->format.fmt.pix.sizeimage;
     fd_set rdset;
     struct timeval timeout;
     struct v4l2_buffer buf;
@@ -1525,18 +1533,15 @@ static void *video_grabber(void *data)
         prev_skew = skew;
         prev_interval = interval;
 
-        /* allocate a new buffer, if needed */
+        /* add a new ringbuffer slot, if needed */
         pthread_mutex_lock(&priv->video_buffer_mutex);
         if (priv->video_buffer_size_current < priv->video_buffer_size_max) {
             if (priv->video_cnt == priv->video_buffer_size_current) {
-                unsigned char *newbuf = malloc(framesize);
-                if (newbuf) {
-                    memmove(priv->video_ringbuffer+priv->video_tail+1, priv->video_ringbuffer+priv->video_tail,
-                            (priv->video_buffer_size_current-priv->video_tail)*sizeof(video_buffer_entry));
-                    priv->video_ringbuffer[priv->video_tail].data = newbuf;
-                    if ((priv->video_head >= priv->video_tail) && (priv->video_cnt > 0)) priv->video_head++;
-                    priv->video_buffer_size_current++;
-                }
+                memmove(priv->video_ringbuffer+priv->video_tail+1, priv->video_ringbuffer+priv->video_tail,
+                        (priv->video_buffer_size_current-priv->video_tail)*sizeof(video_buffer_entry));
+                priv->video_ringbuffer[priv->video_tail].packet = NULL;
+                if ((priv->video_head >= priv->video_tail) && (priv->video_cnt > 0)) priv->video_head++;
+                priv->video_buffer_size_current++;
             }
         }
         pthread_mutex_unlock(&priv->video_buffer_mutex);
@@ -1565,9 +1570,12 @@ static void *video_grabber(void *data)
                     pthread_mutex_unlock(&priv->audio_mutex);
                 }
             }
-            copy_frame(priv, priv->video_ringbuffer+priv->video_tail, priv->map[buf.index].addr,buf.bytesused);
-            priv->video_tail = (priv->video_tail+1)%priv->video_buffer_size_current;
-            priv->video_cnt++;
+            if (copy_frame(priv, priv->video_ringbuffer+priv->video_tail, priv->map[buf.index].addr,buf.bytesused)) {
+                pthread_mutex_lock(&priv->video_buffer_mutex);
+                priv->video_tail = (priv->video_tail+1)%priv->video_buffer_size_current;
+                priv->video_cnt++;
+                pthread_mutex_unlock(&priv->video_buffer_mutex);
+            }
         }
         if (v4l2_ioctl(priv->video_fd, VIDIOC_QBUF, &buf) < 0) {
             MP_ERR(priv, "ioctl queue buffer failed: %s\n", mp_strerror(errno));
@@ -1578,7 +1586,8 @@ static void *video_grabber(void *data)
 }
 
 #define MAX_LOOP 500
-static double grab_video_frame(priv_t *priv, char *buffer, int len)
+// Take the oldest frame from the ringbuffer, or return NULL on timeout.
+static struct demux_packet *grab_video_packet(priv_t *priv)
 {
     int loop_cnt = 0;
 
@@ -1589,17 +1598,31 @@ static double grab_video_frame(priv_t *priv, char *buffer, int len)
 
     while (priv->video_cnt == 0) {
         usleep(1000);
-        if (loop_cnt++ > MAX_LOOP) return 0;
+        if (loop_cnt++ > MAX_LOOP) return NULL;
     }
 
     pthread_mutex_lock(&priv->video_buffer_mutex);
-    long long interval = priv->video_ringbuffer[priv->video_head].timestamp;
-    memcpy(buffer, priv->video_ringbuffer[priv->video_head].data, len);
+    video_buffer_entry *entry = &priv->video_ringbuffer[priv->video_head];
+    struct demux_packet *dp = entry->packet;
+    entry->packet = NULL;
+    long long interval = entry->timestamp;
     priv->video_cnt--;
     priv->video_head = (priv->video_head+1)%priv->video_buffer_size_current;
     pthread_mutex_unlock(&priv->video_buffer_mutex);
 
-    return interval == -1 ? MP_NOPTS_VALUE : interval*1e-6;
+    dp->pts = interval == -1 ? MP_NOPTS_VALUE : interval*1e-6;
+    return dp;
+}
+
+static double grab_video_frame(priv_t *priv, char *buffer, int len)
+{
+    struct demux_packet *dp = grab_video_packet(priv);
+    if (!dp)
+        return 0;
+    memcpy(buffer, dp->buffer, MPMIN(len, dp->len));
+    double pts = dp->pts;
+    free_demux_packet(dp);
+    return pts;
 }
 
 static int get_video_framesize(priv_t *priv)
@@ -23,6 +23,7 @@
 #include <stdarg.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <ass/ass.h>
 #include <ass/ass_types.h>
@@ -30,7 +31,9 @@
 #include "common/common.h"
 #include "common/global.h"
 #include "common/msg.h"
+#include "demux/demux.h"
 #include "options/path.h"
+#include "osdep/threads.h"
 #include "ass_mp.h"
 #include "img_convert.h"
 #include "osd.h"
@@ -83,15 +86,104 @@ void mp_ass_set_style(ASS_Style *style, double res_y,
     style->Italic = opts->italic;
 }
 
+// State of the background font setup. This is process-wide, because the caches
+// it warms up (fontconfig's) are process-wide as well.
+static pthread_mutex_t font_preload_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t font_preload_thread;
+static bool font_preload_started;   // font_preload_thread needs to be joined
+static bool font_preload_done;      // never start it twice
+
+struct font_preload {
+    struct mp_log *log;
+    ASS_Library *library;
+    ASS_Renderer *render;
+    char *default_font;
+    char *family;
+    char *config;
+};
+
+static void get_font_files(void *ta_ctx, struct mpv_global *global,
+                           char **default_font, char **config)
+{
+    *default_font = mp_find_config_file(ta_ctx, global, "subfont.ttf");
+    *config       = mp_find_config_file(ta_ctx, global, "fonts.conf");
+
+    if (*default_font && !mp_path_exists(*default_font))
+        *default_font = NULL;
+}
+
+static void *font_preload_thread_fn(void *ptr)
+{
+    struct font_preload *fp = ptr;
+
+    mpthread_set_name("font-preload");
+
+    mp_verbose(fp->log, "Setting up fonts in the background...\n");
+    ass_set_fonts(fp->render, fp->default_font, fp->family, 1, fp->config, 1);
+    mp_verbose(fp->log, "Background font setup done.\n");
+
+    ass_renderer_done(fp->render);
+    ass_library_done(fp->library);
+    talloc_free(fp);
+    return NULL;
+}
+
+// Run the font provider setup (with fontconfig, a scan of all installed fonts
+// on the first run) once on a throwaway renderer on a background thread. The
+// caches it builds make the setup fast when subtitles or the OSD need fonts.
+void mp_ass_preload_fonts(struct mpv_global *global,
+                          struct osd_style_opts *opts, struct mp_log *log)
+{
+    pthread_mutex_lock(&font_preload_lock);
+    if (font_preload_done)
+        goto done;
+    font_preload_done = true;
+
+    struct font_preload *fp = talloc_zero(NULL, struct font_preload);
+    fp->log = mp_log_new(fp, log, "libass");
+    fp->library = mp_ass_init(global, fp->log);
+    fp->render = ass_renderer_init(fp->library);
+    if (!fp->render) {
+        ass_library_done(fp->library);
+        talloc_free(fp);
+        goto done;
+    }
+    get_font_files(fp, global, &fp->default_font, &fp->config);
+    fp->family = talloc_strdup(fp, opts->font);
+
+    if (pthread_create(&font_preload_thread, NULL, font_preload_thread_fn, fp)) {
+        ass_renderer_done(fp->render);
+        ass_library_done(fp->library);
+        talloc_free(fp);
+        goto done;
+    }
+    font_preload_started = true;
+
+done:
+    pthread_mutex_unlock(&font_preload_lock);
+}
+
+// Wait until the background setup started by mp_ass_preload_fonts() is done.
+// Must be called before the mp_log passed to it is destroyed.
+void mp_ass_wait_font_preload(void)
+{
+    pthread_mutex_lock(&font_preload_lock);
+    if (font_preload_started) {
+        pthread_join(font_preload_thread, NULL);
+        font_preload_started = false;
+    }
+    pthread_mutex_unlock(&font_preload_lock);
+}
+
 void mp_ass_configure_fonts(ASS_Renderer *priv, struct osd_style_opts *opts,
                             struct mpv_global *global, struct mp_log *log)
 {
     void *tmp = talloc_new(NULL);
-    char *default_font = mp_find_config_file(tmp, global, "subfont.ttf");
-    char *config       = mp_find_config_file(tmp, global, "fonts.conf");
+    char *default_font, *config;
+    get_font_files(tmp, global, &default_font, &config);
 
-    if (default_font && !mp_path_exists(default_font))
-        default_font = NULL;
+    // Don't scan the fonts a second time in parallel.
+    mp_ass_wait_font_preload();
 
     mp_verbose(log, "Setting up fonts...\n");
     ass_set_fonts(priv, default_font, opts->font, 1, config, 1);
@@ -136,6 +228,195 @@ ASS_Library *mp_ass_init(struct mpv_global *global, struct mp_log *log)
     return priv;
 }
 
+// Cache of ASS_Library instances with embedded fonts already added. libass
+// copies the font data into the library, so subtitle tracks carrying the same
+// fonts (different tracks of a file, or episodes of a series in a playlist)
+// share one library instead of each holding its own copy.
+// Entries are per mpv_global, because the library's log and fonts directory
+// are.
+#define MAX_UNUSED_LIBRARIES 2
+
+struct shared_library {
+    struct mpv_global *global;
+    uint64_t hash;          // of the fonts and style overrides
+    // Font names and sizes, and the style overrides, to rule out hash
+    // collisions. The font data is only covered by the hash.
+    char **font_names;
+    size_t *font_sizes;
+    int num_fonts;
+    char **style_overrides;
+    int num_style_overrides;
+    struct mp_log *log;
+    ASS_Library *library;
+    int refcount;
+    int64_t last_use;       // for evicting unused entries
+};
+
+static pthread_mutex_t shared_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct shared_library **shared_libs;
+static int num_shared_libs;
+static int64_t shared_use_counter;
+
+// FNV-1a
+static uint64_t hash_bytes(uint64_t h, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    for (size_t n = 0; n < len; n++) {
+        h ^= p[n];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static uint64_t hash_str(uint64_t h, const char *s)
+{
+    return hash_bytes(h, s, strlen(s) + 1);
+}
+
+static bool shared_library_matches(struct shared_library *e,
+                                   struct mpv_global *global, uint64_t hash,
+                                   struct demux_attachment **fonts,
+                                   int num_fonts, char **style_overrides)
+{
+    if (e->global != global || e->hash != hash || e->num_fonts != num_fonts)
+        return false;
+    for (int n = 0; n < num_fonts; n++) {
+        if (e->font_sizes[n] != fonts[n]->data_size ||
+            strcmp(e->font_names[n], fonts[n]->name) != 0)
+            return false;
+    }
+    int num_overrides = 0;
+    for (; style_overrides && style_overrides[num_overrides]; num_overrides++) {
+        if (num_overrides >= e->num_style_overrides ||
+            strcmp(e->style_overrides[num_overrides],
+                   style_overrides[num_overrides]) != 0)
+            return false;
+    }
+    return num_overrides == e->num_style_overrides;
+}
+
+static void free_shared_library(int index)
+{
+    struct shared_library *e = shared_libs[index];
+    assert(!e->refcount);
+    ass_library_done(e->library);
+    talloc_free(e);
+    MP_TARRAY_REMOVE_AT(shared_libs, num_shared_libs, index);
+}
+
+// Return a library with the given fonts added and the style overrides (a
+// NULL-terminated list, or NULL) set. It's shared with other callers, and must
+// not be changed; release it with mp_ass_release_library().
+ASS_Library *mp_ass_acquire_library(struct mpv_global *global,
+                                    struct demux_attachment **fonts,
+                                    int num_fonts, char **style_overrides)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (int n = 0; n < num_fonts; n++) {
+        struct demux_attachment *f = fonts[n];
+        hash = hash_str(hash, f->name);
+        hash = hash_bytes(hash, &f->data_size, sizeof(f->data_size));
+        hash = hash_bytes(hash, f->data, f->data_size);
+    }
+    hash = hash_bytes(hash, &num_fonts, sizeof(num_fonts));
+    for (int n = 0; style_overrides && style_overrides[n]; n++)
+        hash = hash_str(hash, style_overrides[n]);
+
+    pthread_mutex_lock(&shared_lock);
+
+    struct shared_library *e = NULL;
+    for (int n = 0; n < num_shared_libs; n++) {
+        if (shared_library_matches(shared_libs[n], global, hash, fonts,
+                                   num_fonts, style_overrides))
+        {
+            e = shared_libs[n];
+            break;
+        }
+    }
+
+    if (e) {
+        mp_verbose(e->log, "Reusing library with %d embedded fonts.\n",
+                   num_fonts);
+    } else {
+        e = talloc_zero(NULL, struct shared_library);
+        e->global = global;
+        e->hash = hash;
+        e->num_fonts = num_fonts;
+        e->font_names = talloc_array(e, char *, num_fonts);
+        e->font_sizes = talloc_array(e, size_t, num_fonts);
+        for (int n = 0; n < num_fonts; n++) {
+            e->font_names[n] = talloc_strdup(e, fonts[n]->name);
+            e->font_sizes[n] = fonts[n]->data_size;
+        }
+        for (int n = 0; style_overrides && style_overrides[n]; n++) {
+            MP_TARRAY_APPEND(e, e->style_overrides, e->num_style_overrides,
+                             talloc_strdup(e, style_overrides[n]));
+        }
+        e->log = mp_log_new(e, global->log, "libass");
+        e->library = mp_ass_init(global, e->log);
+        for (int n = 0; n < num_fonts; n++)
+            ass_add_font(e->library, fonts[n]->name, fonts[n]->data,
+                         fonts[n]->data_size);
+        if (style_overrides)
+            ass_set_style_overrides(e->library, style_overrides);
+        MP_TARRAY_APPEND(NULL, shared_libs, num_shared_libs, e);
+    }
+
+    e->refcount++;
+    ASS_Library *library = e->library;
+
+    pthread_mutex_unlock(&shared_lock);
+    return library;
+}
+
+void mp_ass_release_library(ASS_Library *library)
+{
+    pthread_mutex_lock(&shared_lock);
+
+    for (int n = 0; n < num_shared_libs; n++) {
+        struct shared_library *e = shared_libs[n];
+        if (e->library == library) {
+            assert(e->refcount > 0);
+            e->refcount--;
+            e->last_use = ++shared_use_counter;
+            break;
+        }
+    }
+
+    // Keep a few unused libraries around for the next playlist entry, and
+    // drop the least recently used ones beyond that.
+    while (1) {
+        int num_unused = 0, oldest = -1;
+        for (int n = 0; n < num_shared_libs; n++) {
+            struct shared_library *e = shared_libs[n];
+            if (e->refcount)
+                continue;
+            num_unused++;
+            if (oldest < 0 || e->last_use < shared_libs[oldest]->last_use)
+                oldest = n;
+        }
+        if (num_unused <= MAX_UNUSED_LIBRARIES)
+            break;
+        free_shared_library(oldest);
+    }
+
+    pthread_mutex_unlock(&shared_lock);
+}
+
+// Free all cached libraries of the given mpv_global. All libraries acquired
+// with it must have been released.
+void mp_ass_uninit_libraries(struct mpv_global *global)
+{
+    pthread_mutex_lock(&shared_lock);
+    for (int n = num_shared_libs - 1; n >= 0; n--) {
+        if (shared_libs[n]->global == global)
+            free_shared_library(n);
+    }
+    if (!num_shared_libs)
+        TA_FREEP(&shared_libs);
+    pthread_mutex_unlock(&shared_lock);
+}
+
 void mp_ass_flush_old_events(ASS_Track *track, long long ts)
 {
     int n = 0;
@@ -48,6 +48,16 @@ void mp_ass_set_style(ASS_Style *style, double res_y,
 void mp_ass_configure_fonts(ASS_Renderer *priv, struct osd_style_opts *opts,
                             struct mpv_global *global, struct mp_log *log);
 ASS_Library *mp_ass_init(struct mpv_global *global, struct mp_log *log);
+void mp_ass_preload_fonts(struct mpv_global *global,
+                          struct osd_style_opts *opts, struct mp_log *log);
+void mp_ass_wait_font_preload(void);
+
+struct demux_attachment;
+ASS_Library *mp_ass_acquire_library(struct mpv_global *global,
+                                    struct demux_attachment **fonts,
+                                    int num_fonts, char **style_overrides);
+void mp_ass_release_library(ASS_Library *library);
+void mp_ass_uninit_libraries(struct mpv_global *global);
 
 struct sub_bitmaps;
 struct mp_ass_packer;
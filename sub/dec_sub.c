@@ -54,6 +54,11 @@ struct dec_sub {
     struct sh_stream *sh;
     double last_pkt_pts;
     bool preload_attempted;
+    bool index_attempted;
+
+    // Sorted timestamps of all packets (--sub-index-external).
+    double *index;
+    int num_index;
 
     struct mp_codec_params *codec;
     double start, end;
@@ -198,6 +203,65 @@ void sub_preload(struct dec_sub *sub)
     pthread_mutex_unlock(&sub->lock);
 }
 
+bool sub_can_index(struct dec_sub *sub)
+{
+    bool r;
+    pthread_mutex_lock(&sub->lock);
+    r = sub->opts->sub_index_external && !sub->index_attempted &&
+        !sub->sd->driver->accept_packets_in_advance;
+    pthread_mutex_unlock(&sub->lock);
+    return r;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double da = *(const double *)a, db = *(const double *)b;
+    return da < db ? -1 : (da > db ? 1 : 0);
+}
+
+// Read all packets, but keep only their timestamps. The caller has to seek
+// the demuxer before and after this.
+void sub_build_index(struct dec_sub *sub)
+{
+    pthread_mutex_lock(&sub->lock);
+
+    sub->index_attempted = true;
+
+    for (;;) {
+        struct demux_packet *pkt = demux_read_packet(sub->sh);
+        if (!pkt)
+            break;
+        if (pkt->pts != MP_NOPTS_VALUE && !pkt->new_segment)
+            MP_TARRAY_APPEND(sub, sub->index, sub->num_index, pkt->pts);
+        talloc_free(pkt);
+    }
+
+    if (sub->index)
+        qsort(sub->index, sub->num_index, sizeof(sub->index[0]), cmp_double);
+
+    MP_VERBOSE(sub, "Indexed %d packets.\n", sub->num_index);
+
+    pthread_mutex_unlock(&sub->lock);
+}
+
+// Return false if the index says that no packet after the last read one
+// starts before video_pts. Called locked.
+static bool index_packet_due(struct dec_sub *sub, double video_pts)
+{
+    if (!sub->num_index || sub->last_pkt_pts == MP_NOPTS_VALUE)
+        return true;
+    int lo = 0, hi = sub->num_index;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (sub->index[mid] > sub->last_pkt_pts) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return lo < sub->num_index && sub->index[lo] <= video_pts;
+}
+
 // Read packets from the demuxer stream passed to sub_create(). Return true if
 // enough packets were read, false if the player should wait until the demuxer
 // signals new packets available (and then should retry).
@@ -228,9 +292,12 @@ bool sub_read_packets(struct dec_sub *sub, double video_pts)
         // seen (or the subtitle decoder's queue is full). This does not happen
         // for interleaved subtitle streams, which never return "wait" when
         // reading.
+        // If the stream was indexed, we also know whether the next packet is
+        // needed yet, without waiting for the demuxer to catch up.
         if (st <= 0) {
             r = st < 0 || (sub->last_pkt_pts != MP_NOPTS_VALUE &&
-                           sub->last_pkt_pts > video_pts);
+                           sub->last_pkt_pts > video_pts) ||
+                !index_packet_due(sub, video_pts);
             break;
         }
 
@@ -19,6 +19,7 @@ enum sd_ctrl {
     SD_CTRL_GET_RESOLUTION,
     SD_CTRL_SET_TOP,
     SD_CTRL_SET_VIDEO_DEF_FPS,
+    SD_CTRL_INVALIDATE_RENDER,
 };
 
 struct attachment_list {
@@ -34,6 +35,8 @@ void sub_unlock(struct dec_sub *sub);
 
 bool sub_can_preload(struct dec_sub *sub);
 void sub_preload(struct dec_sub *sub);
+bool sub_can_index(struct dec_sub *sub);
+void sub_build_index(struct dec_sub *sub);
 bool sub_read_packets(struct dec_sub *sub, double video_pts);
 void sub_get_bitmaps(struct dec_sub *sub, struct mp_osd_res dim, int format,
                      double pts, struct sub_bitmaps *res);
@@ -24,6 +24,10 @@
 #include <libswscale/swscale.h>
 #include <libavutil/common.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "common/common.h"
 #include "draw_bmp.h"
 #include "img_convert.h"
@@ -50,9 +54,18 @@ struct part {
     struct sub_cache *imgs;
 };
 
+// Bounding boxes of a sub_bitmaps, valid as long as change_id is the same.
+struct bb_cache {
+    bool valid;
+    int change_id;
+    int num_rc;
+    struct mp_rect rc_list[MP_SUB_BB_LIST_MAX];
+};
+
 struct mp_draw_sub_cache
 {
     struct part *parts[MAX_OSD_PARTS];
+    struct bb_cache bbs[MAX_OSD_PARTS];
     struct mp_image *upsample_img;
     struct mp_image upsample_temp;
 };
@@ -66,9 +79,98 @@ static bool get_sub_area(struct mp_rect bb, struct mp_image *temp,
 
 #define CONDITIONAL 1
 
+#ifdef __SSE2__
+// Compute x / 65025 for each 32 bit lane, for x < 2^24. (Exact.)
+static inline __m128i div_65025_sse2(__m128i x)
+{
+    const __m128i magic = _mm_set1_epi32(67636241); // ceil(2^42 / 65025)
+    __m128i even = _mm_srli_epi64(_mm_mul_epu32(x, magic), 42);
+    __m128i odd = _mm_srli_epi64(_mm_mul_epu32(_mm_srli_epi64(x, 32), magic), 42);
+    return _mm_or_si128(even, _mm_slli_epi64(odd, 32));
+}
+
+// 8 bit version of BLEND_CONST_ALPHA. Returns the number of pixels processed;
+// the caller does the rest. Produces the same results as the C code.
+static int blend_const_alpha_u8_sse2(uint8_t *dst_r, uint8_t *srca_r, int srcp,
+                                     uint8_t srcamul, int w)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i mul = _mm_set1_epi16(srcamul);
+    const __m128i full = _mm_set1_epi16((int16_t)65025);
+    const __m128i color = _mm_set1_epi16(srcp);
+    const __m128i round = _mm_set1_epi32(32512);
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        __m128i a8 = _mm_loadl_epi64((__m128i *)(srca_r + x));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(a8, zero)) == 0xFFFF)
+            continue;
+        __m128i a = _mm_mullo_epi16(_mm_unpacklo_epi8(a8, zero), mul);
+        __m128i ia = _mm_sub_epi16(full, a);
+        __m128i d = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *)(dst_r + x)),
+                                      zero);
+        // 32 bit products srcp * a and d * ia
+        __m128i p0_lo = _mm_mullo_epi16(color, a);
+        __m128i p0_hi = _mm_mulhi_epu16(color, a);
+        __m128i p1_lo = _mm_mullo_epi16(d, ia);
+        __m128i p1_hi = _mm_mulhi_epu16(d, ia);
+        __m128i s0 = _mm_add_epi32(_mm_unpacklo_epi16(p0_lo, p0_hi),
+                                   _mm_unpacklo_epi16(p1_lo, p1_hi));
+        __m128i s1 = _mm_add_epi32(_mm_unpackhi_epi16(p0_lo, p0_hi),
+                                   _mm_unpackhi_epi16(p1_lo, p1_hi));
+        s0 = div_65025_sse2(_mm_add_epi32(s0, round));
+        s1 = div_65025_sse2(_mm_add_epi32(s1, round));
+        __m128i r = _mm_packs_epi32(s0, s1);
+        _mm_storel_epi64((__m128i *)(dst_r + x), _mm_packus_epi16(r, r));
+    }
+    return x;
+}
+
+// 8 bit version of BLEND_SRC_ALPHA; see blend_const_alpha_u8_sse2().
+static int blend_src_alpha_u8_sse2(uint8_t *dst_r, uint8_t *src_r,
+                                   uint8_t *srca_r, int w)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i full = _mm_set1_epi16(255);
+    const __m128i round = _mm_set1_epi16(127);
+    const __m128i one = _mm_set1_epi16(1);
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        __m128i a8 = _mm_loadl_epi64((__m128i *)(srca_r + x));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(a8, zero)) == 0xFFFF)
+            continue;
+        __m128i a = _mm_unpacklo_epi8(a8, zero);
+        __m128i s = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *)(src_r + x)),
+                                      zero);
+        __m128i d = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *)(dst_r + x)),
+                                      zero);
+        // v <= 65152, so everything fits into 16 bit unsigned
+        __m128i v = _mm_add_epi16(_mm_mullo_epi16(s, a),
+                                  _mm_mullo_epi16(d, _mm_sub_epi16(full, a)));
+        v = _mm_add_epi16(v, round);
+        // v / 255 == (v + 1 + (v >> 8)) >> 8 for v < 65536
+        v = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(v, one),
+                                         _mm_srli_epi16(v, 8)), 8);
+        _mm_storel_epi64((__m128i *)(dst_r + x), _mm_packus_epi16(v, v));
+    }
+    return x;
+}
+#else
+static int blend_const_alpha_u8_sse2(uint8_t *dst_r, uint8_t *srca_r, int srcp,
+                                     uint8_t srcamul, int w)
+{
+    return 0;
+}
+
+static int blend_src_alpha_u8_sse2(uint8_t *dst_r, uint8_t *src_r,
+                                   uint8_t *srca_r, int w)
+{
+    return 0;
+}
+#endif
+
 #define BLEND_CONST_ALPHA(TYPE)                                                 \
     TYPE *dst_r = dst_rp;                                                       \
-    for (int x = 0; x < w; x++) {                                               \
+    for (int x = x0; x < w; x++) {                                              \
         uint32_t srcap = srca_r[x];                                             \
         if (CONDITIONAL && !srcap) continue;                                    \
         srcap *= srcamul; /* now 0..65025 */                                    \
@@ -86,8 +188,10 @@ static void blend_const_alpha(void *dst, int dst_stride, int srcp,
         void *dst_rp = (uint8_t *)dst + dst_stride * y;
         uint8_t *srca_r = srca + srca_stride * y;
         if (bytes == 2) {
+            int x0 = 0;
             BLEND_CONST_ALPHA(uint16_t)
         } else if (bytes == 1) {
+            int x0 = blend_const_alpha_u8_sse2(dst_rp, srca_r, srcp, srcamul, w);
             BLEND_CONST_ALPHA(uint8_t)
         }
     }
@@ -95,7 +199,7 @@ static void blend_const_alpha(void *dst, int dst_stride, int srcp,
 
 #define BLEND_SRC_ALPHA(TYPE)                                                   \
     TYPE *dst_r = dst_rp, *src_r = src_rp;                                      \
-    for (int x = 0; x < w; x++) {                                               \
+    for (int x = x0; x < w; x++) {                                              \
         uint32_t srcap = srca_r[x];                                             \
         if (CONDITIONAL && !srcap) continue;                                    \
         dst_r[x] = (src_r[x] * srcap + dst_r[x] * (255 - srcap) + 127) / 255;   \
@@ -111,8 +215,10 @@ static void blend_src_alpha(void *dst, int dst_stride, void *src,
         void *src_rp = (uint8_t *)src + src_stride * y;
         uint8_t *srca_r = srca + srca_stride * y;
         if (bytes == 2) {
+            int x0 = 0;
             BLEND_SRC_ALPHA(uint16_t)
         } else if (bytes == 1) {
+            int x0 = blend_src_alpha_u8_sse2(dst_rp, src_rp, srca_r, w);
             BLEND_SRC_ALPHA(uint8_t)
         }
     }
@@ -246,6 +352,82 @@ static void draw_rgba(struct mp_draw_sub_cache *cache, struct mp_rect bb,
     }
 }
 
+// Compute the alpha of a libass bitmap for 4:2:0 chroma, averaged over each
+// 2x2 block. (x_odd, y_odd) is the parity of the bitmap position.
+static struct mp_image *subsample_alpha_420(struct sub_bitmap *sb,
+                                            int x_odd, int y_odd)
+{
+    int cw = (x_odd + sb->dw + 1) >> 1;
+    int ch = (y_odd + sb->dh + 1) >> 1;
+    struct mp_image *img = mp_image_alloc(IMGFMT_Y8, cw, ch);
+    if (!img)
+        return NULL;
+
+    for (int cy = 0; cy < ch; cy++) {
+        int y0 = MPMAX(cy * 2 - y_odd, 0);
+        int y1 = MPMIN(cy * 2 + 2 - y_odd, sb->dh);
+        uint8_t *dst = img->planes[0] + cy * img->stride[0];
+        for (int cx = 0; cx < cw; cx++) {
+            int x0 = MPMAX(cx * 2 - x_odd, 0);
+            int x1 = MPMIN(cx * 2 + 2 - x_odd, sb->dw);
+            int sum = 0;
+            for (int y = y0; y < y1; y++) {
+                uint8_t *row = (uint8_t *)sb->bitmap + y * sb->stride;
+                for (int x = x0; x < x1; x++)
+                    sum += row[x];
+            }
+            dst[cx] = (sum + 2) / 4;
+        }
+    }
+    return img;
+}
+
+// Blend a libass bitmap directly into an 8 bit 4:2:0 image. Chroma is blended
+// using the alpha averaged over each 2x2 block, which is equivalent to
+// blending on point-upsampled chroma and area-downsampling it again, but
+// avoids converting the whole region with swscale. The subsampled alpha is
+// cached in part, so it's computed only once per change_id.
+static void draw_ass_420p(struct part *part, int i, struct mp_rect bb,
+                          struct mp_image *temp, struct sub_bitmap *sb,
+                          int color[3], int a)
+{
+    // coordinates are relative to the bbox (see get_sub_area())
+    struct mp_rect dst = {sb->x - bb.x0, sb->y - bb.y0};
+    dst.x1 = dst.x0 + sb->dw;
+    dst.y1 = dst.y0 + sb->dh;
+    // bb.x0/y0 are even, so this is the parity within the chroma grid too
+    int x_odd = dst.x0 & 1, y_odd = dst.y0 & 1;
+    // position of the subsampled alpha in the chroma planes
+    int cox = (dst.x0 - x_odd) / 2, coy = (dst.y0 - y_odd) / 2;
+    if (!mp_rect_intersection(&dst, &(struct mp_rect){0, 0, temp->w, temp->h}))
+        return;
+
+    int src_x = (dst.x0 - sb->x) + bb.x0;
+    int src_y = (dst.y0 - sb->y) + bb.y0;
+    uint8_t *alpha = (uint8_t *)sb->bitmap + src_y * sb->stride + src_x;
+
+    blend_const_alpha(temp->planes[0] + dst.y0 * temp->stride[0] + dst.x0,
+                      temp->stride[0], color[0], alpha, sb->stride, a,
+                      dst.x1 - dst.x0, dst.y1 - dst.y0, 1);
+
+    struct mp_image *ca = part->imgs[i].a;
+    if (!ca)
+        ca = part->imgs[i].a = talloc_steal(part, subsample_alpha_420(sb, x_odd, y_odd));
+    if (!ca)
+        return; // on OOM, skip chroma
+
+    int cx0 = dst.x0 >> 1, cx1 = MPMIN((dst.x1 + 1) >> 1, cox + ca->w);
+    int cy0 = dst.y0 >> 1, cy1 = MPMIN((dst.y1 + 1) >> 1, coy + ca->h);
+    if (cx1 <= cx0 || cy1 <= cy0)
+        return;
+    uint8_t *ca_p = ca->planes[0] + (cy0 - coy) * ca->stride[0] + (cx0 - cox);
+    for (int p = 1; p < 3; p++) {
+        blend_const_alpha(temp->planes[p] + cy0 * temp->stride[p] + cx0,
+                          temp->stride[p], color[p], ca_p, ca->stride[0], a,
+                          cx1 - cx0, cy1 - cy0, 1);
+    }
+}
+
 static void draw_ass(struct mp_draw_sub_cache *cache, struct mp_rect bb,
                      struct mp_image *temp, int bits, struct sub_bitmaps *sbs)
 {
@@ -255,6 +437,12 @@ static void draw_ass(struct mp_draw_sub_cache *cache, struct mp_rect bb,
     cspar.input_bits = bits;
     cspar.texture_bits = (bits + 7) / 8 * 8;
 
+    struct part *part = NULL;
+    if (temp->imgfmt == IMGFMT_420P) {
+        part = get_cache(cache, sbs, temp);
+        assert(part);
+    }
+
     struct mp_cmat yuv2rgb, rgb2yuv;
     bool need_conv = temp->fmt.flags & MP_IMGFLAG_YUV;
     if (need_conv) {
@@ -265,11 +453,6 @@ static void draw_ass(struct mp_draw_sub_cache *cache, struct mp_rect bb,
     for (int i = 0; i < sbs->num_parts; ++i) {
         struct sub_bitmap *sb = &sbs->parts[i];
 
-        struct mp_image dst;
-        int src_x, src_y;
-        if (!get_sub_area(bb, temp, sb, &dst, &src_x, &src_y))
-            continue;
-
         int r = (sb->libass.color >> 24) & 0xFF;
         int g = (sb->libass.color >> 16) & 0xFF;
         int b = (sb->libass.color >> 8) & 0xFF;
@@ -284,6 +467,16 @@ static void draw_ass(struct mp_draw_sub_cache *cache, struct mp_rect bb,
             color_yuv[2] = r;
         }
 
+        if (temp->imgfmt == IMGFMT_420P) {
+            draw_ass_420p(part, i, bb, temp, sb, color_yuv, a);
+            continue;
+        }
+
+        struct mp_image dst;
+        int src_x, src_y;
+        if (!get_sub_area(bb, temp, sb, &dst, &src_x, &src_y))
+            continue;
+
         int bytes = (bits + 7) / 8;
         uint8_t *alpha_p = (uint8_t *)sb->bitmap + src_y * sb->stride + src_x;
         for (int p = 0; p < (temp->num_planes > 2 ? 3 : 1); p++) {
@@ -360,7 +553,10 @@ static struct part *get_cache(struct mp_draw_sub_cache *cache,
 {
     struct part *part = NULL;
 
-    bool use_cache = sbs->format == SUBBITMAP_RGBA;
+    // RGBA: scaled bitmaps; libass: subsampled alpha (with 4:2:0 only)
+    bool use_cache = sbs->format == SUBBITMAP_RGBA ||
+                     (sbs->format == SUBBITMAP_LIBASS &&
+                      format->imgfmt == IMGFMT_420P);
     if (use_cache) {
         part = cache->parts[sbs->render_index];
         if (part) {
@@ -507,17 +703,29 @@ void mp_draw_sub_bitmaps(struct mp_draw_sub_cache **cache, struct mp_image *dst,
     int format, bits;
     get_closest_y444_format(dst->imgfmt, &format, &bits);
 
-    struct mp_rect rc_list[MP_SUB_BB_LIST_MAX];
-    int num_rc = mp_get_sub_bb_list(sbs, rc_list, MP_SUB_BB_LIST_MAX);
+    // The bounding boxes only depend on the bitmaps.
+    struct bb_cache *bbc = &cache_->bbs[sbs->render_index];
+    if (!bbc->valid || bbc->change_id != sbs->change_id) {
+        bbc->num_rc = mp_get_sub_bb_list(sbs, bbc->rc_list, MP_SUB_BB_LIST_MAX);
+        bbc->change_id = sbs->change_id;
+        bbc->valid = true;
+    }
 
-    for (int r = 0; r < num_rc; r++) {
-        struct mp_rect bb = rc_list[r];
+    for (int r = 0; r < bbc->num_rc; r++) {
+        struct mp_rect bb = bbc->rc_list[r];
 
         if (!align_bbox_for_swscale(dst, &bb))
             return;
 
         struct mp_image dst_region = *dst;
         mp_image_crop_rc(&dst_region, bb);
+
+        // libass bitmaps can be blended into 4:2:0 directly.
+        if (sbs->format == SUBBITMAP_LIBASS && dst->imgfmt == IMGFMT_420P) {
+            draw_ass(cache_, bb, &dst_region, bits, sbs);
+            continue;
+        }
+
         struct mp_image *temp = chroma_up(cache_, format, &dst_region);
         if (!temp)
             continue; // on OOM, skip region
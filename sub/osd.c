@@ -101,7 +101,7 @@ const struct m_sub_options sub_style_conf = {
     },
 };
 
-static bool osd_res_equals(struct mp_osd_res a, struct mp_osd_res b)
+bool osd_res_equals(struct mp_osd_res a, struct mp_osd_res b)
 {
     return a.w == b.w && a.h == b.h && a.ml == b.ml && a.mt == b.mt
         && a.mr == b.mr && a.mb == b.mb
@@ -249,6 +249,12 @@ static void render_object(struct osd_state *osd, struct osd_object *obj,
     if (!sub_formats[format] || opts->force_rgba_osd)
         format = SUBBITMAP_RGBA;
 
+    // Bitmap subtitles can be passed as palette indexes. The format is only a
+    // preference; libass subtitles are still returned as SUBBITMAP_LIBASS.
+    if (obj->is_sub && format == SUBBITMAP_LIBASS &&
+        sub_formats[SUBBITMAP_INDEXED])
+        format = SUBBITMAP_INDEXED;
+
     *out_imgs = (struct sub_bitmaps) {0};
 
     check_obj_resize(osd, res, obj);
@@ -258,6 +264,9 @@ static void render_object(struct osd_state *osd, struct osd_object *obj,
             double sub_pts = video_pts;
             if (sub_pts != MP_NOPTS_VALUE)
                 sub_pts -= opts->sub_delay;
+            // Subtitle options or the resolution changed.
+            if (obj->force_redraw)
+                sub_control(obj->sub, SD_CTRL_INVALIDATE_RENDER, NULL);
             sub_get_bitmaps(obj->sub, obj->vo_res, format, sub_pts, out_imgs);
         }
     } else if (obj->type == OSDTYPE_EXTERNAL2) {
@@ -29,10 +29,16 @@ enum sub_bitmap_format {
     SUBBITMAP_EMPTY = 0,// no bitmaps; always has num_parts==0
     SUBBITMAP_LIBASS,   // A8, with a per-surface blend color (libass.color)
     SUBBITMAP_RGBA,     // B8G8R8A8 (MSB=A, LSB=B), scaled, premultiplied alpha
+    SUBBITMAP_INDEXED,  // 8 bit palette indexes, with a palette per surface
+                        // (sub_bitmap.palette), scaled
 
     SUBBITMAP_COUNT
 };
 
+// Maximum number of surfaces (each with its own palette) in a
+// SUBBITMAP_INDEXED sub_bitmaps.
+#define MP_SUB_MAX_PALETTES 256
+
 struct sub_bitmap {
     void *bitmap;
     int stride;
@@ -50,6 +56,10 @@ struct sub_bitmap {
     struct {
         uint32_t color;
     } libass;
+
+    // SUBBITMAP_INDEXED only: 256 entries in the SUBBITMAP_RGBA pixel format.
+    // The bitmap is surrounded by 1 pixel of a transparent index.
+    uint32_t *palette;
 };
 
 struct sub_bitmaps {
@@ -66,6 +76,7 @@ struct sub_bitmaps {
     // correspond to packed->stride[0]).
     //  SUBBITMAP_RGBA: IMGFMT_BGRA (exact match)
     //  SUBBITMAP_LIBASS: IMGFMT_Y8 (not the same, but compatible layout)
+    //  SUBBITMAP_INDEXED: IMGFMT_Y8 (the indexes)
     // Other formats have this set to NULL.
     struct mp_image *packed;
 
@@ -191,6 +202,7 @@ void osd_resize(struct osd_state *osd, struct mp_osd_res res);
 
 struct mp_image_params;
 struct mp_osd_res osd_res_from_image_params(const struct mp_image_params *p);
+bool osd_res_equals(struct mp_osd_res a, struct mp_osd_res b);
 
 struct mp_osd_res osd_get_vo_res(struct osd_state *osd);
 
@@ -208,6 +220,9 @@ void osd_destroy_backend(struct osd_state *osd);
 void osd_set_external(struct osd_state *osd, void *id, int res_x, int res_y,
                       char *text);
 
+// Start the font provider setup in the background (optional).
+void osd_preload_fonts(struct osd_state *osd);
+
 // doesn't need locking
 void osd_get_function_sym(char *buffer, size_t buffer_size, int osd_function);
 
@@ -14,6 +14,10 @@ void osd_destroy_backend(struct osd_state *osd)
 {
 }
 
+void osd_preload_fonts(struct osd_state *osd)
+{
+}
+
 void osd_get_function_sym(char *buffer, size_t buffer_size, int osd_function)
 {
 }
@@ -43,6 +43,14 @@ static const char osd_font_pfb[] =
 
 void osd_init_backend(struct osd_state *osd)
 {
+    osd->tmp_arena = talloc_new_arena(osd);
+}
+
+void osd_preload_fonts(struct osd_state *osd)
+{
+    pthread_mutex_lock(&osd->lock);
+    mp_ass_preload_fonts(osd->global, osd->opts->osd_style, osd->log);
+    pthread_mutex_unlock(&osd->lock);
 }
 
 static void create_ass_renderer(struct osd_state *osd, struct ass_state *ass)
@@ -87,6 +95,9 @@ static void destroy_external(struct osd_external *ext)
 
 void osd_destroy_backend(struct osd_state *osd)
 {
+    mp_ass_wait_font_preload();
+    // All subtitle decoders are gone at this point.
+    mp_ass_uninit_libraries(osd->global);
     for (int n = 0; n < MAX_OSD_PARTS; n++) {
         struct osd_object *obj = osd->objs[n];
         destroy_ass_renderer(&obj->ass);
@@ -182,15 +193,15 @@ void osd_get_function_sym(char *buffer, size_t buffer_size, int osd_function)
     snprintf(buffer, buffer_size, "\xFF%c", osd_function);
 }
 
-static void mangle_ass(bstr *dst, const char *in)
+static void mangle_ass(void *ta_ctx, bstr *dst, const char *in)
 {
     bool escape_ass = true;
     while (*in) {
         // As used by osd_get_function_sym().
         if (in[0] == '\xFF' && in[1]) {
-            bstr_xappend(NULL, dst, bstr0(ASS_USE_OSD_FONT));
-            mp_append_utf8_bstr(NULL, dst, OSD_CODEPOINTS + in[1]);
-            bstr_xappend(NULL, dst, bstr0("{\\r}"));
+            bstr_xappend(ta_ctx, dst, bstr0(ASS_USE_OSD_FONT));
+            mp_append_utf8_bstr(ta_ctx, dst, OSD_CODEPOINTS + in[1]);
+            bstr_xappend(ta_ctx, dst, bstr0("{\\r}"));
             in += 2;
             continue;
         }
@@ -200,20 +211,21 @@ static void mangle_ass(bstr *dst, const char *in)
             continue;
         }
         if (escape_ass && *in == '{')
-            bstr_xappend(NULL, dst, bstr0("\\"));
-        bstr_xappend(NULL, dst, (bstr){(char *)in, 1});
+            bstr_xappend(ta_ctx, dst, bstr0("\\"));
+        bstr_xappend(ta_ctx, dst, (bstr){(char *)in, 1});
         // Break ASS escapes with U+2060 WORD JOINER
         if (escape_ass && *in == '\\')
-            mp_append_utf8_bstr(NULL, dst, 0x2060);
+            mp_append_utf8_bstr(ta_ctx, dst, 0x2060);
         in++;
     }
 }
 
-static ASS_Event *add_osd_ass_event_escaped(ASS_Track *track, const char *style,
+static ASS_Event *add_osd_ass_event_escaped(struct osd_state *osd,
+                                            ASS_Track *track, const char *style,
                                             const char *text)
 {
     bstr buf = {0};
-    mangle_ass(&buf, text);
+    mangle_ass(osd->tmp_arena, &buf, text);
     ASS_Event *e = add_osd_ass_event(track, style, buf.start);
     talloc_free(buf.start);
     return e;
@@ -237,7 +249,7 @@ static void update_osd_text(struct osd_state *osd, struct osd_object *obj)
         playresy *= 720.0 / obj->vo_res.h;
 
     mp_ass_set_style(get_style(&obj->ass, "OSD"), playresy, &font);
-    add_osd_ass_event_escaped(obj->ass.track, "OSD", obj->text);
+    add_osd_ass_event_escaped(osd, obj->ass.track, "OSD", obj->text);
 }
 
 // align: -1 .. +1
@@ -308,10 +320,10 @@ static void ass_draw_rect_cw(struct ass_draw *d, float x0, float y0,
     ass_draw_line_to(d, x0, y1);
 }
 
+// Clear the text, but keep the buffer for reuse.
 static void ass_draw_reset(struct ass_draw *d)
 {
-    talloc_free(d->text);
-    d->text = NULL;
+    d->text[0] = '\0';
 }
 
 static void get_osd_bar_box(struct osd_state *osd, struct osd_object *obj,
@@ -364,22 +376,26 @@ static void update_progbar(struct osd_state *osd, struct osd_object *obj)
     float sx = px - border * 2 - height / 4; // includes additional spacing
     float sy = py + height / 2;
 
-    bstr buf = bstr0(talloc_asprintf(NULL, "{\\an6\\pos(%f,%f)}", sx, sy));
+    void *tmp = osd->tmp_arena;
+    bstr buf = bstr0(talloc_asprintf(tmp, "{\\an6\\pos(%f,%f)}", sx, sy));
 
     if (obj->progbar_state.type == 0 || obj->progbar_state.type >= 256) {
         // no sym
     } else if (obj->progbar_state.type >= 32) {
-        mp_append_utf8_bstr(NULL, &buf, obj->progbar_state.type);
+        mp_append_utf8_bstr(tmp, &buf, obj->progbar_state.type);
     } else {
-        bstr_xappend(NULL, &buf, bstr0(ASS_USE_OSD_FONT));
-        mp_append_utf8_bstr(NULL, &buf, OSD_CODEPOINTS + obj->progbar_state.type);
-        bstr_xappend(NULL, &buf, bstr0("{\\r}"));
+        bstr_xappend(tmp, &buf, bstr0(ASS_USE_OSD_FONT));
+        mp_append_utf8_bstr(tmp, &buf, OSD_CODEPOINTS + obj->progbar_state.type);
+        bstr_xappend(tmp, &buf, bstr0("{\\r}"));
     }
 
     add_osd_ass_event(track, "progbar", buf.start);
     talloc_free(buf.start);
 
-    struct ass_draw *d = &(struct ass_draw) { .scale = 4 };
+    struct ass_draw *d = &(struct ass_draw) {
+        .scale = 4,
+        .text = talloc_strdup(tmp, ""),
+    };
     // filled area
     d->text = talloc_asprintf_append(d->text, "{\\bord0\\pos(%f,%f)}", px, py);
     ass_draw_start(d);
@@ -434,6 +450,7 @@ static void update_osd(struct osd_state *osd, struct osd_object *obj)
     clear_ass(&obj->ass);
     update_osd_text(osd, obj);
     update_progbar(osd, obj);
+    talloc_free_children(osd->tmp_arena);
 }
 
 static void update_external(struct osd_state *osd, struct osd_object *obj,
@@ -457,11 +474,12 @@ static void update_external(struct osd_state *osd, struct osd_object *obj,
         bstr line;
         bstr_split_tok(t, "\n", &line, &t);
         if (line.len) {
-            char *tmp = bstrdup0(NULL, line);
+            char *tmp = bstrdup0(osd->tmp_arena, line);
             add_osd_ass_event(ext->ass.track, "OSD", tmp);
             talloc_free(tmp);
         }
     }
+    talloc_free_children(osd->tmp_arena);
 }
 
 void osd_set_external(struct osd_state *osd, void *id, int res_x, int res_y,
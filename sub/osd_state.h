@@ -78,6 +78,9 @@ struct osd_state {
     struct mp_log *log;
 
     struct mp_draw_sub_cache *draw_cache;
+
+    // Backend scratch memory for building event text; reset after each use.
+    void *tmp_arena;
 };
 
 void osd_changed_unlocked(struct osd_state *osd, int obj);
@@ -20,6 +20,7 @@
 #include <string.h>
 #include <math.h>
 #include <limits.h>
+#include <pthread.h>
 
 #include <libavutil/common.h>
 #include <ass/ass.h>
@@ -30,14 +31,40 @@
 #include "common/common.h"
 #include "common/msg.h"
 #include "demux/demux.h"
+#include "osdep/threads.h"
 #include "video/csputils.h"
 #include "video/mp_image.h"
 #include "dec_sub.h"
 #include "ass_mp.h"
 #include "sd.h"
 
+// Number of video frames the render thread renders ahead.
+#define RENDER_AHEAD_FRAMES 3
+// Additionally, one slot for the frame currently displayed, and one for a
+// synchronous render on a cache miss.
+#define RENDER_SLOTS (RENDER_AHEAD_FRAMES + 2)
+
+struct render_slot {
+    bool valid;         // res contains the rendering for key/dim/format
+    bool busy;          // being rendered (not accessible without render_lock)
+    bool discard;       // invalidated while busy
+    long long key;      // see render_key()
+    struct mp_osd_res dim;
+    int format;
+    int content_id;
+    struct mp_ass_packer *packer;
+    struct sub_bitmap *bs;
+    struct sub_bitmaps res;
+};
+
+struct render_req {
+    double pts;
+    long long key;
+};
+
 struct sd_ass_priv {
     struct ass_library *ass_library;
+    bool shared_library; // ass_library from mp_ass_acquire_library()
     struct ass_renderer *ass_renderer;
     struct ass_track *ass_track;
     struct ass_track *shadow_track; // for --sub-ass=no rendering
@@ -53,10 +80,88 @@ struct sd_ass_priv {
     int64_t *seen_packets;
     int num_seen_packets;
     bool duration_unknown;
+    int content_id;     // incremented when libass reports a changed frame
+
+    // --sub-ass-render-ahead. render_lock protects the libass track and
+    // renderer (and everything render_frame() reads). lock protects the
+    // following fields.
+    bool render_ahead;
+    pthread_mutex_t render_lock;
+    pthread_t render_thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    bool terminate;
+    struct render_slot slots[RENDER_SLOTS];
+    int served;         // slot returned by the last get_bitmaps() call
+    int served_content_id;
+    int served_format;
+    double last_pts, frame_delta;
+    struct render_req ahead[RENDER_AHEAD_FRAMES];
+    int num_ahead;
+    struct mp_osd_res ahead_dim;
+    int ahead_format;
+
+    // The last frame rendered by get_bitmaps() without render-ahead. It is
+    // reused as long as the same non-animated events are visible. Protected
+    // by render_lock.
+    bool static_valid;
+    int *static_events;
+    int num_static_events;
+    struct mp_osd_res static_dim;
+    int static_format;
+    struct sub_bitmaps static_res;
+    int *active_events;
+    int num_active_events;
+
+    // Events of ass_track sorted by start time (as indexes into
+    // track->events), and the maximum end time of sorted_events[0..n].
+    // Protected by render_lock.
+    int *sorted_events;
+    long long *max_end;
+    int num_indexed;
+    int *text_events;
 };
 
 static void mangle_colors(struct sd *sd, struct sub_bitmaps *parts);
 static void fill_plaintext(struct sd *sd, double pts);
+static void start_render_ahead(struct sd *sd);
+
+// Without render-ahead, everything runs under the dec_sub lock.
+static void lock_track(struct sd_ass_priv *ctx)
+{
+    if (ctx->render_ahead)
+        pthread_mutex_lock(&ctx->render_lock);
+}
+
+static void unlock_track(struct sd_ass_priv *ctx)
+{
+    if (ctx->render_ahead)
+        pthread_mutex_unlock(&ctx->render_lock);
+}
+
+// Drop all rendered-ahead frames for subtitle times >= key.
+static void invalidate_ahead(struct sd_ass_priv *ctx, long long key)
+{
+    if (!ctx->render_ahead)
+        return;
+    pthread_mutex_lock(&ctx->lock);
+    for (int n = 0; n < RENDER_SLOTS; n++) {
+        struct render_slot *slot = &ctx->slots[n];
+        if (slot->key >= key) {
+            slot->valid = false;
+            slot->discard = slot->busy;
+        }
+    }
+    pthread_cond_broadcast(&ctx->wakeup);
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+// Drop all cached renderings (configuration or track changed).
+static void flush_render_caches(struct sd_ass_priv *ctx)
+{
+    ctx->static_valid = false;
+    invalidate_ahead(ctx, LLONG_MIN);
+}
 
 // Add default styles, if the track does not have any styles yet.
 // Apply style overrides if the user provides any.
@@ -114,17 +219,39 @@ static bool attachment_is_font(struct mp_log *log, struct demux_attachment *f)
     return false;
 }
 
-static void add_subtitle_fonts(struct sd *sd)
+static void init_library(struct sd *sd, char *extradata, int extradata_size)
 {
     struct sd_ass_priv *ctx = sd->priv;
     struct MPOpts *opts = sd->opts;
-    if (!opts->ass_enabled || !opts->use_embedded_fonts || !sd->attachments)
-        return;
-    for (int i = 0; i < sd->attachments->num_entries; i++) {
-        struct demux_attachment *f = &sd->attachments->entries[i];
-        if (attachment_is_font(sd->log, f))
-            ass_add_font(ctx->ass_library, f->name, f->data, f->data_size);
+    char **style_overrides =
+        opts->ass_style_override ? opts->ass_force_style_list : NULL;
+
+    struct demux_attachment **fonts = NULL;
+    int num_fonts = 0;
+    if (opts->ass_enabled && opts->use_embedded_fonts && sd->attachments) {
+        for (int i = 0; i < sd->attachments->num_entries; i++) {
+            struct demux_attachment *f = &sd->attachments->entries[i];
+            if (attachment_is_font(sd->log, f))
+                MP_TARRAY_APPEND(NULL, fonts, num_fonts, f);
+        }
+    }
+
+    // libass adds fonts from the [Fonts] section of the header to the library
+    // while parsing it, so such a library can't be shared with other tracks.
+    if (bstr_find0((bstr){extradata, extradata_size}, "[Fonts]") < 0) {
+        ctx->ass_library = mp_ass_acquire_library(sd->global, fonts, num_fonts,
+                                                  style_overrides);
+        ctx->shared_library = true;
+    } else {
+        ctx->ass_library = mp_ass_init(sd->global, sd->log);
+        for (int n = 0; n < num_fonts; n++)
+            ass_add_font(ctx->ass_library, fonts[n]->name, fonts[n]->data,
+                         fonts[n]->data_size);
+        if (style_overrides)
+            ass_set_style_overrides(ctx->ass_library, style_overrides);
     }
+
+    talloc_free(fonts);
 }
 
 static void enable_output(struct sd *sd, bool enable)
@@ -183,12 +310,7 @@ static int init(struct sd *sd)
             ctx->duration_unknown = 1;
     }
 
-    ctx->ass_library = mp_ass_init(sd->global, sd->log);
-
-    add_subtitle_fonts(sd);
-
-    if (opts->ass_style_override)
-        ass_set_style_overrides(ctx->ass_library, opts->ass_force_style_list);
+    init_library(sd, extradata, extradata_size);
 
     ctx->ass_track = ass_new_track(ctx->ass_library);
     if (!ctx->is_converted)
@@ -215,6 +337,10 @@ static int init(struct sd *sd)
 
     ctx->packer = mp_ass_packer_alloc(ctx);
 
+    // Converted text subtitles are cheap to render.
+    if (opts->sub_ass_render_ahead && !ctx->is_converted)
+        start_render_ahead(sd);
+
     return 0;
 }
 
@@ -262,6 +388,7 @@ static void decode(struct sd *sd, struct demux_packet *packet)
         for (int n = 0; r && r[n]; n++)
             ass_process_data(track, r[n], strlen(r[n]));
         if (ctx->duration_unknown) {
+            ctx->num_indexed = 0;
             for (int n = 0; n < track->n_events - 1; n++) {
                 if (track->events[n].Duration == UNKNOWN_DURATION * 1000) {
                     track->events[n].Duration = track->events[n + 1].Start -
@@ -272,9 +399,13 @@ static void decode(struct sd *sd, struct demux_packet *packet)
     } else {
         // Note that for this packet format, libass has an internal mechanism
         // for discarding duplicate (already seen) packets.
-        ass_process_chunk(track, packet->buffer, packet->len,
-                          llrint(packet->pts * 1000),
+        long long start = llrint(packet->pts * 1000);
+        lock_track(ctx);
+        ass_process_chunk(track, packet->buffer, packet->len, start,
                           llrint(packet->duration * 1000));
+        // The new event can also affect find_timestamp() slightly earlier.
+        invalidate_ahead(ctx, start - SUB_GAP_THRESHOLD * 1000);
+        unlock_track(ctx);
     }
 }
 
@@ -353,6 +484,84 @@ static bool has_overrides(char *s)
 
 #define END(ev) ((ev)->Start + (ev)->Duration)
 
+// Add events appended to ass_track since the last call to the index. Events
+// are normally added in order, so this is mostly appending. Anything that
+// removes or changes existing events must reset num_indexed to 0.
+static void update_event_index(struct sd_ass_priv *ctx)
+{
+    ASS_Track *track = ctx->ass_track;
+
+    if (ctx->num_indexed > track->n_events)
+        ctx->num_indexed = 0;
+    if (ctx->num_indexed == track->n_events)
+        return;
+
+    MP_TARRAY_GROW(ctx, ctx->sorted_events, track->n_events);
+    MP_TARRAY_GROW(ctx, ctx->max_end, track->n_events);
+
+    int first_changed = ctx->num_indexed;
+    for (int n = ctx->num_indexed; n < track->n_events; n++) {
+        long long start = track->events[n].Start;
+        // Insert after events with the same start time, to keep file order.
+        int a = 0;
+        int b = n;
+        while (a < b) {
+            int mid = a + (b - a) / 2;
+            if (track->events[ctx->sorted_events[mid]].Start <= start) {
+                a = mid + 1;
+            } else {
+                b = mid;
+            }
+        }
+        memmove(&ctx->sorted_events[a + 1], &ctx->sorted_events[a],
+                (n - a) * sizeof(ctx->sorted_events[0]));
+        ctx->sorted_events[a] = n;
+        first_changed = MPMIN(first_changed, a);
+    }
+
+    for (int n = first_changed; n < track->n_events; n++) {
+        long long end = END(&track->events[ctx->sorted_events[n]]);
+        ctx->max_end[n] = n > 0 ? MPMAX(ctx->max_end[n - 1], end) : end;
+    }
+
+    ctx->num_indexed = track->n_events;
+}
+
+// Set [*lo, *hi) to the range of sorted_events[] which contains all events
+// with start <= t1 and end >= t0. Not all events in the range necessarily
+// match; this is exact only if no event overlaps with many others.
+static void find_event_range(struct sd_ass_priv *ctx, long long t0,
+                             long long t1, int *lo, int *hi)
+{
+    ASS_Track *track = ctx->ass_track;
+
+    update_event_index(ctx);
+
+    // max_end[] is monotonic, so the first possible match can be bisected.
+    int a = 0;
+    int b = ctx->num_indexed;
+    while (a < b) {
+        int mid = a + (b - a) / 2;
+        if (ctx->max_end[mid] < t0) {
+            a = mid + 1;
+        } else {
+            b = mid;
+        }
+    }
+    *lo = a;
+
+    b = ctx->num_indexed;
+    while (a < b) {
+        int mid = a + (b - a) / 2;
+        if (track->events[ctx->sorted_events[mid]].Start <= t1) {
+            a = mid + 1;
+        } else {
+            b = mid;
+        }
+    }
+    *hi = a;
+}
+
 static long long find_timestamp(struct sd *sd, double pts)
 {
     struct sd_ass_priv *priv = sd->priv;
@@ -374,8 +583,10 @@ static long long find_timestamp(struct sd *sd, double pts)
     // Find the "current" event.
     ASS_Event *ev[2] = {0};
     int n_ev = 0;
-    for (int n = 0; n < track->n_events; n++) {
-        ASS_Event *event = &track->events[n];
+    int lo, hi;
+    find_event_range(priv, ts - threshold, ts + threshold, &lo, &hi);
+    for (int n = lo; n < hi; n++) {
+        ASS_Event *event = &track->events[priv->sorted_events[n]];
         if (ts >= event->Start - threshold && ts <= END(event) + threshold) {
             if (n_ev >= MP_ARRAY_SIZE(ev))
                 return ts; // multiple overlaps - give up (probably complex subs)
@@ -420,13 +631,24 @@ static long long find_timestamp(struct sd *sd, double pts)
 
 #undef END
 
-static void get_bitmaps(struct sd *sd, struct mp_osd_res dim, int format,
-                        double pts, struct sub_bitmaps *res)
+static bool uses_shadow_track(struct sd *sd)
 {
     struct sd_ass_priv *ctx = sd->priv;
     struct MPOpts *opts = sd->opts;
-    bool no_ass = !opts->ass_enabled || ctx->on_top ||
-                  opts->ass_style_override == 5;
+    return !opts->ass_enabled || ctx->on_top || opts->ass_style_override == 5;
+}
+
+// Render the subtitles at pts. With render-ahead, render_lock must be held.
+// The data in *res is owned by packer, and *bs is allocated under packer.
+// repack=true forces repacking, even if libass reports no change.
+static void render_frame(struct sd *sd, struct mp_osd_res dim, int format,
+                         double pts, struct mp_ass_packer *packer,
+                         struct sub_bitmap **bs, bool repack,
+                         struct sub_bitmaps *res)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    struct MPOpts *opts = sd->opts;
+    bool no_ass = uses_shadow_track(sd);
     bool converted = ctx->is_converted || no_ass;
     ASS_Track *track = no_ass ? ctx->shadow_track : ctx->ass_track;
     ASS_Renderer *renderer = ctx->ass_renderer;
@@ -455,6 +677,7 @@ static void get_bitmaps(struct sd *sd, struct mp_osd_res dim, int format,
     long long ts = find_timestamp(sd, pts);
     if (ctx->duration_unknown && pts != MP_NOPTS_VALUE) {
         mp_ass_flush_old_events(track, ts);
+        ctx->num_indexed = 0;
         ctx->num_seen_packets = 0;
         sd->preload_ok = false;
     }
@@ -464,18 +687,341 @@ static void get_bitmaps(struct sd *sd, struct mp_osd_res dim, int format,
 
     int changed;
     ASS_Image *imgs = ass_render_frame(renderer, track, ts, &changed);
-    mp_ass_packer_pack(ctx->packer, &imgs, 1, changed, format, res);
+    if (changed)
+        ctx->content_id++;
+    mp_ass_packer_pack(packer, &imgs, 1, changed || repack, format, res);
 
     if (!converted && res->num_parts > 0) {
         // mangle_colors() modifies the color field, so copy the thing.
-        MP_TARRAY_GROW(ctx, ctx->bs, res->num_parts);
-        memcpy(ctx->bs, res->parts, sizeof(ctx->bs[0]) * res->num_parts);
-        res->parts = ctx->bs;
+        MP_TARRAY_GROW(packer, *bs, res->num_parts);
+        memcpy(*bs, res->parts, sizeof((*bs)[0]) * res->num_parts);
+        res->parts = *bs;
 
         mangle_colors(sd, res);
     }
 }
 
+// Key for the render-ahead cache: the subtitle time in ms, as passed to
+// find_timestamp(), which is the granularity libass renders at anyway.
+static long long render_key(struct sd_ass_priv *ctx, double pts)
+{
+    return llrint(pts / ctx->sub_speed * 1000);
+}
+
+// Find a finished (or, with include_busy, a pending) slot. ctx->lock held.
+static struct render_slot *find_slot(struct sd_ass_priv *ctx, long long key,
+                                     struct mp_osd_res dim, int format,
+                                     bool include_busy)
+{
+    for (int n = 0; n < RENDER_SLOTS; n++) {
+        struct render_slot *slot = &ctx->slots[n];
+        if ((slot->valid || (include_busy && slot->busy)) &&
+            slot->key == key && slot->format == format &&
+            osd_res_equals(slot->dim, dim))
+            return slot;
+    }
+    return NULL;
+}
+
+static bool is_wanted(struct sd_ass_priv *ctx, long long key)
+{
+    for (int n = 0; n < ctx->num_ahead; n++) {
+        if (ctx->ahead[n].key == key)
+            return true;
+    }
+    return false;
+}
+
+// Pick a slot to render into, and mark it busy. Prefers empty slots, then
+// the oldest frame that is not requested anymore. Returns NULL if only
+// requested frames could be evicted, unless force is set. ctx->lock held.
+static struct render_slot *claim_slot(struct sd_ass_priv *ctx, long long key,
+                                      struct mp_osd_res dim, int format,
+                                      bool force)
+{
+    struct render_slot *best = NULL;
+    int best_score = 0;
+    for (int n = 0; n < RENDER_SLOTS; n++) {
+        struct render_slot *slot = &ctx->slots[n];
+        if (slot->busy || n == ctx->served)
+            continue;
+        int score = !slot->valid ? 3 : !is_wanted(ctx, slot->key) ? 2 : 1;
+        if (score > best_score || (score == best_score && score < 3 &&
+                                   slot->key < best->key))
+        {
+            best = slot;
+            best_score = score;
+        }
+    }
+    if (!best || (best_score < 2 && !force))
+        return NULL;
+    best->valid = false;
+    best->busy = true;
+    best->discard = false;
+    best->key = key;
+    best->dim = dim;
+    best->format = format;
+    return best;
+}
+
+// Render into a slot claimed with claim_slot(). ctx->lock held on entry and
+// return, but released during rendering.
+static void render_slot(struct sd *sd, struct render_slot *slot, double pts)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+
+    pthread_mutex_unlock(&ctx->lock);
+
+    pthread_mutex_lock(&ctx->render_lock);
+    slot->res = (struct sub_bitmaps){0};
+    render_frame(sd, slot->dim, slot->format, pts, slot->packer, &slot->bs,
+                 true, &slot->res);
+    slot->content_id = ctx->content_id;
+    pthread_mutex_unlock(&ctx->render_lock);
+
+    pthread_mutex_lock(&ctx->lock);
+    slot->busy = false;
+    slot->valid = !slot->discard;
+    pthread_cond_broadcast(&ctx->wakeup);
+}
+
+static void *render_thread(void *p)
+{
+    struct sd *sd = p;
+    struct sd_ass_priv *ctx = sd->priv;
+
+    mpthread_set_name("sub-render");
+
+    pthread_mutex_lock(&ctx->lock);
+    while (!ctx->terminate) {
+        struct render_slot *slot = NULL;
+        double pts = MP_NOPTS_VALUE;
+        if (!uses_shadow_track(sd)) {
+            for (int n = 0; n < ctx->num_ahead; n++) {
+                struct render_req *req = &ctx->ahead[n];
+                if (find_slot(ctx, req->key, ctx->ahead_dim, ctx->ahead_format,
+                              true))
+                    continue;
+                slot = claim_slot(ctx, req->key, ctx->ahead_dim,
+                                  ctx->ahead_format, false);
+                pts = req->pts;
+                break;
+            }
+        }
+        if (!slot) {
+            pthread_cond_wait(&ctx->wakeup, &ctx->lock);
+            continue;
+        }
+        render_slot(sd, slot, pts);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+
+    return NULL;
+}
+
+static void start_render_ahead(struct sd *sd)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+
+    pthread_mutex_init(&ctx->render_lock, NULL);
+    pthread_mutex_init(&ctx->lock, NULL);
+    pthread_cond_init(&ctx->wakeup, NULL);
+    for (int n = 0; n < RENDER_SLOTS; n++)
+        ctx->slots[n].packer = mp_ass_packer_alloc(ctx);
+    ctx->served = -1;
+    ctx->served_content_id = -1;
+    ctx->last_pts = MP_NOPTS_VALUE;
+
+    if (pthread_create(&ctx->render_thread, NULL, render_thread, sd)) {
+        MP_WARN(sd, "Could not start subtitle render thread.\n");
+        pthread_cond_destroy(&ctx->wakeup);
+        pthread_mutex_destroy(&ctx->lock);
+        pthread_mutex_destroy(&ctx->render_lock);
+        return;
+    }
+    ctx->render_ahead = true;
+}
+
+static void stop_render_ahead(struct sd *sd)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+
+    if (!ctx->render_ahead)
+        return;
+
+    pthread_mutex_lock(&ctx->lock);
+    ctx->terminate = true;
+    pthread_cond_broadcast(&ctx->wakeup);
+    pthread_mutex_unlock(&ctx->lock);
+    pthread_join(ctx->render_thread, NULL);
+
+    pthread_cond_destroy(&ctx->wakeup);
+    pthread_mutex_destroy(&ctx->lock);
+    pthread_mutex_destroy(&ctx->render_lock);
+    ctx->render_ahead = false;
+}
+
+// Return the frame from the render-ahead cache (rendering it synchronously
+// on a miss), and request the following frames from the render thread.
+static void get_bitmaps_ahead(struct sd *sd, struct mp_osd_res dim, int format,
+                              double pts, struct sub_bitmaps *res)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    long long key = render_key(ctx, pts);
+
+    pthread_mutex_lock(&ctx->lock);
+
+    // Predict the next frames from the distance to the previous call. Redraws
+    // of the same frame and seeks don't change the prediction.
+    if (ctx->last_pts != MP_NOPTS_VALUE) {
+        double delta = pts - ctx->last_pts;
+        if (delta > 0 && delta < 1.0)
+            ctx->frame_delta = delta;
+    }
+    ctx->last_pts = pts;
+
+    struct render_slot *slot;
+    while (1) {
+        slot = find_slot(ctx, key, dim, format, true);
+        if (!slot || !slot->busy)
+            break;
+        // Being rendered by the render thread; wait for it.
+        pthread_cond_wait(&ctx->wakeup, &ctx->lock);
+    }
+    if (!slot) {
+        slot = claim_slot(ctx, key, dim, format, true);
+        render_slot(sd, slot, pts);
+    }
+
+    *res = slot->res;
+    res->change_id = slot->content_id != ctx->served_content_id ||
+                     slot->format != ctx->served_format;
+    ctx->served = slot - ctx->slots;
+    ctx->served_content_id = slot->content_id;
+    ctx->served_format = slot->format;
+
+    ctx->num_ahead = 0;
+    if (ctx->frame_delta > 0) {
+        for (int n = 1; n <= RENDER_AHEAD_FRAMES; n++) {
+            double apts = pts + ctx->frame_delta * n;
+            ctx->ahead[ctx->num_ahead++] =
+                (struct render_req){apts, render_key(ctx, apts)};
+        }
+    }
+    ctx->ahead_dim = dim;
+    ctx->ahead_format = format;
+    pthread_cond_broadcast(&ctx->wakeup);
+
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+// Whether the event's rendering can change while it is visible.
+static bool is_animated(ASS_Event *event)
+{
+    char *s = event->Text;
+    if (event->Effect && event->Effect[0])
+        return true; // Banner, Scroll up/down
+    return s && (strstr(s, "\\t") || strstr(s, "\\move") ||
+                 strstr(s, "\\fad") || strstr(s, "\\k") ||
+                 strstr(s, "\\K"));
+}
+
+// Collect the events visible at pts into ctx->active_events. Returns false
+// if the frame can't be reused, because an event is animated.
+static bool get_active_events(struct sd *sd, double pts)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    ASS_Track *track = ctx->ass_track;
+    long long ts = find_timestamp(sd, pts);
+
+    ctx->num_active_events = 0;
+    int lo, hi;
+    find_event_range(ctx, ts, ts, &lo, &hi);
+    for (int i = lo; i < hi; i++) {
+        int n = ctx->sorted_events[i];
+        ASS_Event *event = &track->events[n];
+        if (ts >= event->Start && ts < event->Start + event->Duration) {
+            if (is_animated(event))
+                return false;
+            MP_TARRAY_APPEND(ctx, ctx->active_events, ctx->num_active_events, n);
+        }
+    }
+    return true;
+}
+
+static bool can_reuse_frames(struct sd *sd)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    // The shadow track is refilled on every frame, and mp_ass_flush_old_events()
+    // renumbers the events.
+    return !uses_shadow_track(sd) && !ctx->duration_unknown;
+}
+
+// Return the last frame again if nothing visible changed. The libass call
+// and mangle_colors() are skipped, and change_id stays 0, so that consumers
+// can skip their work for as long as a subtitle line is displayed.
+static bool get_static_frame(struct sd *sd, struct mp_osd_res dim, int format,
+                             double pts, struct sub_bitmaps *res)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+
+    if (!can_reuse_frames(sd) || !get_active_events(sd, pts)) {
+        ctx->num_active_events = -1;
+        return false;
+    }
+
+    if (!ctx->static_valid || ctx->static_format != format ||
+        !osd_res_equals(ctx->static_dim, dim) ||
+        ctx->num_static_events != ctx->num_active_events ||
+        memcmp(ctx->static_events, ctx->active_events,
+               sizeof(ctx->active_events[0]) * ctx->num_active_events) != 0)
+        return false;
+
+    *res = ctx->static_res;
+    res->change_id = 0;
+    return true;
+}
+
+// Remember the frame just rendered for get_static_frame().
+static void set_static_frame(struct sd *sd, struct mp_osd_res dim, int format,
+                             struct sub_bitmaps *res)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+
+    ctx->static_valid = ctx->num_active_events >= 0;
+    if (!ctx->static_valid)
+        return;
+
+    MP_TARRAY_GROW(ctx, ctx->static_events, ctx->num_active_events);
+    memcpy(ctx->static_events, ctx->active_events,
+           sizeof(ctx->active_events[0]) * ctx->num_active_events);
+    ctx->num_static_events = ctx->num_active_events;
+    ctx->static_dim = dim;
+    ctx->static_format = format;
+    ctx->static_res = *res;
+}
+
+static void get_bitmaps(struct sd *sd, struct mp_osd_res dim, int format,
+                        double pts, struct sub_bitmaps *res)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+
+    if (pts == MP_NOPTS_VALUE || !ctx->ass_renderer)
+        return;
+
+    if (ctx->render_ahead && !uses_shadow_track(sd)) {
+        get_bitmaps_ahead(sd, dim, format, pts, res);
+        return;
+    }
+
+    lock_track(ctx);
+    if (!get_static_frame(sd, dim, format, pts, res)) {
+        render_frame(sd, dim, format, pts, ctx->packer, &ctx->bs, false, res);
+        set_static_frame(sd, dim, format, res);
+    }
+    unlock_track(ctx);
+}
+
 struct buf {
     char *start;
     int size;
@@ -548,7 +1094,13 @@ static bool is_whitespace_only(char *s, int len)
     return true;
 }
 
-static char *get_text(struct sd *sd, double pts)
+static int cmp_int(const void *a, const void *b)
+{
+    int ia = *(const int *)a, ib = *(const int *)b;
+    return ia < ib ? -1 : ia > ib;
+}
+
+static char *get_text_unlocked(struct sd *sd, double pts)
 {
     struct sd_ass_priv *ctx = sd->priv;
     ASS_Track *track = ctx->ass_track;
@@ -559,17 +1111,26 @@ static char *get_text(struct sd *sd, double pts)
 
     struct buf b = {ctx->last_text, sizeof(ctx->last_text) - 1};
 
-    for (int i = 0; i < track->n_events; ++i) {
-        ASS_Event *event = track->events + i;
-        if (ipts >= event->Start && ipts < event->Start + event->Duration) {
-            if (event->Text) {
-                int start = b.len;
-                ass_to_plaintext(&b, event->Text);
-                if (is_whitespace_only(&b.start[start], b.len - start)) {
-                    b.len = start;
-                } else {
-                    append(&b, '\n');
-                }
+    // Output the text in file order, not in start time order.
+    int lo, hi, num_events = 0;
+    find_event_range(ctx, ipts, ipts, &lo, &hi);
+    for (int i = lo; i < hi; i++) {
+        int n = ctx->sorted_events[i];
+        ASS_Event *event = track->events + n;
+        if (ipts >= event->Start && ipts < event->Start + event->Duration)
+            MP_TARRAY_APPEND(ctx, ctx->text_events, num_events, n);
+    }
+    qsort(ctx->text_events, num_events, sizeof(ctx->text_events[0]), cmp_int);
+
+    for (int i = 0; i < num_events; ++i) {
+        ASS_Event *event = track->events + ctx->text_events[i];
+        if (event->Text) {
+            int start = b.len;
+            ass_to_plaintext(&b, event->Text);
+            if (is_whitespace_only(&b.start[start], b.len - start)) {
+                b.len = start;
+            } else {
+                append(&b, '\n');
             }
         }
     }
@@ -589,7 +1150,7 @@ static void fill_plaintext(struct sd *sd, double pts)
 
     ass_flush_events(track);
 
-    char *text = get_text(sd, pts);
+    char *text = get_text_unlocked(sd, pts);
     if (!text)
         return;
 
@@ -620,56 +1181,96 @@ static void fill_plaintext(struct sd *sd, double pts)
     talloc_free(dst.start);
 }
 
+static char *get_text(struct sd *sd, double pts)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    lock_track(ctx);
+    char *text = get_text_unlocked(sd, pts);
+    unlock_track(ctx);
+    return text;
+}
+
 static void reset(struct sd *sd)
 {
     struct sd_ass_priv *ctx = sd->priv;
+    lock_track(ctx);
     if (sd->opts->sub_clear_on_seek || ctx->duration_unknown) {
         ass_flush_events(ctx->ass_track);
+        ctx->num_indexed = 0;
         ctx->num_seen_packets = 0;
         sd->preload_ok = false;
     }
     if (ctx->converter)
         lavc_conv_reset(ctx->converter);
+    flush_render_caches(ctx);
+    unlock_track(ctx);
+}
+
+static void select_output(struct sd *sd, bool selected)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    lock_track(ctx);
+    enable_output(sd, selected);
+    flush_render_caches(ctx);
+    unlock_track(ctx);
 }
 
 static void uninit(struct sd *sd)
 {
     struct sd_ass_priv *ctx = sd->priv;
 
+    stop_render_ahead(sd);
     if (ctx->converter)
         lavc_conv_uninit(ctx->converter);
     ass_free_track(ctx->ass_track);
     ass_free_track(ctx->shadow_track);
     enable_output(sd, false);
-    ass_library_done(ctx->ass_library);
+    if (ctx->shared_library) {
+        mp_ass_release_library(ctx->ass_library);
+    } else {
+        ass_library_done(ctx->ass_library);
+    }
 }
 
 static int control(struct sd *sd, enum sd_ctrl cmd, void *arg)
 {
     struct sd_ass_priv *ctx = sd->priv;
+    int r = CONTROL_OK;
+    lock_track(ctx);
     switch (cmd) {
     case SD_CTRL_SUB_STEP: {
         double *a = arg;
         long long ts = llrint(a[0] * (1000.0 / ctx->sub_speed));
         long long res = ass_step_sub(ctx->ass_track, ts, a[1]);
-        if (!res)
-            return false;
+        if (!res) {
+            r = false;
+            break;
+        }
         a[0] = res / (1000.0 / ctx->sub_speed);
-        return true;
+        r = true;
+        break;
     }
     case SD_CTRL_SET_VIDEO_PARAMS:
         ctx->video_params = *(struct mp_image_params *)arg;
-        return CONTROL_OK;
+        flush_render_caches(ctx);
+        break;
     case SD_CTRL_SET_TOP:
         ctx->on_top = *(bool *)arg;
-        return CONTROL_OK;
+        flush_render_caches(ctx);
+        break;
     case SD_CTRL_SET_VIDEO_DEF_FPS:
         ctx->video_fps = *(double *)arg;
         update_subtitle_speed(sd);
-        return CONTROL_OK;
+        flush_render_caches(ctx);
+        break;
+    case SD_CTRL_INVALIDATE_RENDER:
+        flush_render_caches(ctx);
+        break;
     default:
-        return CONTROL_UNKNOWN;
+        r = CONTROL_UNKNOWN;
     }
+    unlock_track(ctx);
+    return r;
 }
 
 const struct sd_functions sd_ass = {
@@ -681,7 +1282,7 @@ const struct sd_functions sd_ass = {
     .get_text = get_text,
     .control = control,
     .reset = reset,
-    .select = enable_output,
+    .select = select_output,
     .uninit = uninit,
 };
 
@@ -41,9 +41,19 @@
 struct sub {
     bool valid;
     AVSubtitle avsub;
+    struct AVSubtitleRect **rects;
+    // Geometry of the bitmaps in the packed images (without blur extension).
     struct sub_bitmap *inbitmaps;
     int count;
-    struct mp_image *data;
+    int extend;
+    int alloc_w, alloc_h;
+    // The RGBA and indexed representations are created on demand.
+    bool rgba_ok, indexed_ok;
+    struct sub_bitmap *rgba_bitmaps;
+    struct mp_image *data;          // SUBBITMAP_RGBA (IMGFMT_BGRA)
+    struct sub_bitmap *indexed_bitmaps;
+    struct mp_image *idata;         // SUBBITMAP_INDEXED (IMGFMT_Y8)
+    uint32_t *palettes;             // 256 entries per bitmap
     int bound_w, bound_h;
     int src_w, src_h;
     double pts;
@@ -62,6 +72,7 @@ struct sd_lavc_priv {
     struct sub subs[MAX_QUEUE]; // most recent event first
     struct sub_bitmap *outbitmaps;
     int64_t displayed_id;
+    int displayed_format;
     int64_t new_id;
     struct mp_image_params video_params;
     double current_pts;
@@ -163,6 +174,8 @@ static void alloc_sub(struct sd_lavc_priv *priv)
     // clear only some fields; the memory allocs can be reused
     priv->subs[0].valid = false;
     priv->subs[0].count = 0;
+    priv->subs[0].rgba_ok = false;
+    priv->subs[0].indexed_ok = false;
     priv->subs[0].src_w = 0;
     priv->subs[0].src_h = 0;
     priv->subs[0].id = priv->new_id++;
@@ -186,7 +199,25 @@ static void convert_pal(uint32_t *colors, size_t count, bool gray)
     }
 }
 
-// Initialize sub from sub->avsub.
+// Get the palette of r as premultiplied BGRA.
+static void get_palette(struct sd *sd, struct AVSubtitleRect *r,
+                        uint32_t pal[256])
+{
+#if HAVE_AV_SUBTITLE_NOPICT
+    uint8_t **data = r->data;
+#else
+    uint8_t **data = r->pict.data;
+#endif
+    assert(r->nb_colors > 0);
+    assert(r->nb_colors <= 256);
+    memset(pal, 0, 256 * sizeof(pal[0]));
+    memcpy(pal, data[1], r->nb_colors * 4);
+    convert_pal(pal, 256, sd->opts->sub_gray);
+}
+
+// Initialize sub from sub->avsub. This only determines the layout of the
+// packed images; the pixel data is converted by make_rgba() or
+// make_indexed(), depending on what the VO wants.
 static void read_sub_bitmaps(struct sd *sd, struct sub *sub)
 {
     struct MPOpts *opts = sd->opts;
@@ -194,6 +225,7 @@ static void read_sub_bitmaps(struct sd *sd, struct sub *sub)
     AVSubtitle *avsub = &sub->avsub;
 
     MP_TARRAY_GROW(priv, sub->inbitmaps, avsub->num_rects);
+    MP_TARRAY_GROW(priv, sub->rects, avsub->num_rects);
 
     packer_set_size(priv->packer, avsub->num_rects);
 
@@ -212,7 +244,6 @@ static void read_sub_bitmaps(struct sd *sd, struct sub *sub)
 
     for (int i = 0; i < avsub->num_rects; i++) {
         struct AVSubtitleRect *r = avsub->rects[i];
-        struct sub_bitmap *b = &sub->inbitmaps[sub->count];
 
         if (r->type != SUBTITLE_BITMAP) {
             MP_ERR(sd, "unsupported subtitle type from libavcodec\n");
@@ -223,7 +254,7 @@ static void read_sub_bitmaps(struct sd *sd, struct sub *sub)
         if (r->w <= 0 || r->h <= 0)
             continue;
 
-        b->bitmap = r; // save for later (dumb hack to avoid more complexity)
+        sub->rects[sub->count] = r;
 
         priv->packer->in[sub->count] = (struct pos){r->w + (align - 1), r->h};
         sub->count++;
@@ -244,21 +275,59 @@ static void read_sub_bitmaps(struct sd *sd, struct sub *sub)
 
     sub->bound_w = bb[1].x;
     sub->bound_h = bb[1].y;
+    sub->alloc_w = priv->packer->w;
+    sub->alloc_h = priv->packer->h;
+    sub->extend = extend;
+
+    for (int i = 0; i < sub->count; i++) {
+        struct sub_bitmap *b = &sub->inbitmaps[i];
+        struct pos pos = priv->packer->result[i];
+        struct AVSubtitleRect *r = sub->rects[i];
+
+        *b = (struct sub_bitmap){
+            .w = r->w,
+            .h = r->h,
+            .x = r->x,
+            .y = r->y,
+        };
 
-    if (!sub->data || sub->data->w < sub->bound_w || sub->data->h < sub->bound_h) {
+        // Choose such that the extended start position is aligned.
+        pos.x = MP_ALIGN_UP(pos.x - extend, align) + extend;
+
+        b->src_x = pos.x;
+        b->src_y = pos.y;
+
+        sub->src_w = FFMAX(sub->src_w, b->x + b->w);
+        sub->src_h = FFMAX(sub->src_h, b->y + b->h);
+    }
+}
+
+// Expand the paletted bitmaps to sub->data.
+static bool make_rgba(struct sd *sd, struct sub *sub)
+{
+    struct MPOpts *opts = sd->opts;
+    struct sd_lavc_priv *priv = sd->priv;
+    int extend = sub->extend;
+    int padding = 1 + extend;
+
+    if (sub->rgba_ok)
+        return true;
+
+    if (!sub->data || sub->data->w < sub->alloc_w ||
+                      sub->data->h < sub->alloc_h)
+    {
         talloc_free(sub->data);
-        sub->data = mp_image_alloc(IMGFMT_BGRA, priv->packer->w, priv->packer->h);
-        if (!sub->data) {
-            sub->count = 0;
-            return;
-        }
+        sub->data = mp_image_alloc(IMGFMT_BGRA, sub->alloc_w, sub->alloc_h);
+        if (!sub->data)
+            return false;
         talloc_steal(priv, sub->data);
     }
 
+    MP_TARRAY_GROW(priv, sub->rgba_bitmaps, sub->count);
+
     for (int i = 0; i < sub->count; i++) {
-        struct sub_bitmap *b = &sub->inbitmaps[i];
-        struct pos pos = priv->packer->result[i];
-        struct AVSubtitleRect *r = b->bitmap;
+        struct sub_bitmap *b = &sub->rgba_bitmaps[i];
+        struct AVSubtitleRect *r = sub->rects[i];
 #if HAVE_AV_SUBTITLE_NOPICT
         uint8_t **data = r->data;
         int *linesize = r->linesize;
@@ -266,27 +335,12 @@ static void read_sub_bitmaps(struct sd *sd, struct sub *sub)
         uint8_t **data = r->pict.data;
         int *linesize = r->pict.linesize;
 #endif
-        b->w = r->w;
-        b->h = r->h;
-        b->x = r->x;
-        b->y = r->y;
-
-        // Choose such that the extended start position is aligned.
-        pos.x = MP_ALIGN_UP(pos.x - extend, align) + extend;
-
-        b->src_x = pos.x;
-        b->src_y = pos.y;
+        *b = sub->inbitmaps[i];
         b->stride = sub->data->stride[0];
-        b->bitmap = sub->data->planes[0] + pos.y * b->stride + pos.x * 4;
-
-        sub->src_w = FFMAX(sub->src_w, b->x + b->w);
-        sub->src_h = FFMAX(sub->src_h, b->y + b->h);
+        b->bitmap = sub->data->planes[0] + b->src_y * b->stride + b->src_x * 4;
 
-        assert(r->nb_colors > 0);
-        assert(r->nb_colors <= 256);
-        uint32_t pal[256] = {0};
-        memcpy(pal, data[1], r->nb_colors * 4);
-        convert_pal(pal, 256, opts->sub_gray);
+        uint32_t pal[256];
+        get_palette(sd, r, pal);
 
         for (int y = -padding; y < b->h + padding; y++) {
             uint32_t *out = (uint32_t*)((char*)b->bitmap + y * b->stride);
@@ -311,9 +365,82 @@ static void read_sub_bitmaps(struct sd *sd, struct sub *sub)
         b->w += extend * 2;
         b->h += extend * 2;
 
-        if (apply_blur)
+        if (extend)
             mp_blur_rgba_sub_bitmap(b, opts->sub_gauss);
     }
+
+    sub->rgba_ok = true;
+    return true;
+}
+
+// Copy the palette indexes to sub->idata, with a transparent index as
+// padding. The VO expands them with the palettes. Not possible with blur,
+// with more bitmaps than the VO has palette slots, or if a full palette has
+// no transparent entry.
+static bool make_indexed(struct sd *sd, struct sub *sub)
+{
+    struct sd_lavc_priv *priv = sd->priv;
+
+    if (sub->indexed_ok)
+        return true;
+    if (sub->extend || sub->count > MP_SUB_MAX_PALETTES)
+        return false;
+
+    MP_TARRAY_GROW(priv, sub->palettes, sub->count * 256);
+    for (int i = 0; i < sub->count; i++)
+        get_palette(sd, sub->rects[i], &sub->palettes[i * 256]);
+
+    if (!sub->idata || sub->idata->w < sub->alloc_w ||
+                       sub->idata->h < sub->alloc_h)
+    {
+        talloc_free(sub->idata);
+        sub->idata = mp_image_alloc(IMGFMT_Y8, sub->alloc_w, sub->alloc_h);
+        if (!sub->idata)
+            return false;
+        talloc_steal(priv, sub->idata);
+    }
+
+    MP_TARRAY_GROW(priv, sub->indexed_bitmaps, sub->count);
+
+    for (int i = 0; i < sub->count; i++) {
+        struct sub_bitmap *b = &sub->indexed_bitmaps[i];
+        struct AVSubtitleRect *r = sub->rects[i];
+        uint32_t *pal = &sub->palettes[i * 256];
+#if HAVE_AV_SUBTITLE_NOPICT
+        uint8_t **data = r->data;
+        int *linesize = r->linesize;
+#else
+        uint8_t **data = r->pict.data;
+        int *linesize = r->pict.linesize;
+#endif
+        int transparent = -1;
+        for (int n = 255; n >= 0; n--) {
+            if (!pal[n]) {
+                transparent = n;
+                break;
+            }
+        }
+        if (transparent < 0)
+            return false;
+
+        *b = sub->inbitmaps[i];
+        b->stride = sub->idata->stride[0];
+        b->bitmap = sub->idata->planes[0] + b->src_y * b->stride + b->src_x;
+        b->palette = pal;
+
+        for (int y = -1; y < b->h + 1; y++) {
+            uint8_t *out = (uint8_t *)b->bitmap + y * b->stride;
+            out[-1] = out[b->w] = transparent;
+            if (y >= 0 && y < b->h) {
+                memcpy(out, data[0] + y * linesize[0], b->w);
+            } else {
+                memset(out, transparent, b->w);
+            }
+        }
+    }
+
+    sub->indexed_ok = true;
+    return true;
 }
 
 static void decode(struct sd *sd, struct demux_packet *packet)
@@ -433,19 +560,26 @@ static void get_bitmaps(struct sd *sd, struct mp_osd_res d, int format,
     if (!current)
         return;
 
+    bool indexed = format == SUBBITMAP_INDEXED && make_indexed(sd, current);
+    if (!indexed && !make_rgba(sd, current))
+        return;
+
     MP_TARRAY_GROW(priv, priv->outbitmaps, current->count);
-    for (int n = 0; n < current->count; n++)
-        priv->outbitmaps[n] = current->inbitmaps[n];
+    for (int n = 0; n < current->count; n++) {
+        priv->outbitmaps[n] = indexed ? current->indexed_bitmaps[n]
+                                      : current->rgba_bitmaps[n];
+    }
 
     res->parts = priv->outbitmaps;
     res->num_parts = current->count;
-    if (priv->displayed_id != current->id)
+    if (priv->displayed_id != current->id || priv->displayed_format != format)
         res->change_id++;
     priv->displayed_id = current->id;
-    res->packed = current->data;
+    priv->displayed_format = format;
+    res->packed = indexed ? current->idata : current->data;
     res->packed_w = current->bound_w;
     res->packed_h = current->bound_h;
-    res->format = SUBBITMAP_RGBA;
+    res->format = indexed ? SUBBITMAP_INDEXED : SUBBITMAP_RGBA;
 
     double video_par = 0;
     if (priv->avctx->codec_id == AV_CODEC_ID_DVD_SUBTITLE &&
@@ -62,11 +62,40 @@ struct ta_ext_header {
     struct ta_header *header;  // points back to normal header
     struct ta_header children; // list of children, with this as sentinel
     void (*destructor)(void *);
+    // If this is an arena (created with ta_new_arena()), this points to the
+    // arena state in the allocation itself. If this is an allocation made
+    // from an arena, this points to that arena. NULL otherwise.
+    struct ta_arena *arena;
 };
 
 // ta_ext_header.children.size is set to this
 #define CHILDREN_SENTINEL ((size_t)-1)
 
+#define ALIGN_SIZE(s) (((s) + MIN_ALIGN - 1) & ~(size_t)(MIN_ALIGN - 1))
+
+// Allocations from an arena always have an ext header, placed right before the
+// normal header.
+#define ARENA_EXT_SIZE ALIGN_SIZE(sizeof(struct ta_ext_header))
+#define ARENA_HEADER_SIZE (ARENA_EXT_SIZE + sizeof(union aligned_header))
+
+// Default size of the memory chunks arenas allocate from.
+#define ARENA_CHUNK_SIZE (16 * 1024)
+
+struct ta_arena_chunk {
+    struct ta_arena_chunk *next;
+    size_t size;
+};
+
+#define ARENA_CHUNK_HEADER ALIGN_SIZE(sizeof(struct ta_arena_chunk))
+
+#define MAX_ARENA_ALLOC \
+    (MAX_ALLOC - ARENA_HEADER_SIZE - ARENA_CHUNK_HEADER - MIN_ALIGN)
+
+struct ta_arena {
+    struct ta_arena_chunk *chunks; // most recently allocated first
+    char *pos, *end;               // free space in chunks
+};
+
 static void ta_dbg_add(struct ta_header *h);
 static void ta_dbg_check_header(struct ta_header *h);
 static void ta_dbg_remove(struct ta_header *h);
@@ -78,6 +107,20 @@ static struct ta_header *get_header(void *ptr)
     return h;
 }
 
+static void init_ext_header(struct ta_ext_header *eh, struct ta_header *h)
+{
+    *eh = (struct ta_ext_header) {
+        .header = h,
+        .children = {
+            .next = &eh->children,
+            .prev = &eh->children,
+            // Needed by ta_find_parent():
+            .size = CHILDREN_SENTINEL,
+            .ext = eh,
+        },
+    };
+}
+
 static struct ta_ext_header *get_or_alloc_ext_header(void *ptr)
 {
     struct ta_header *h = get_header(ptr);
@@ -87,20 +130,85 @@ static struct ta_ext_header *get_or_alloc_ext_header(void *ptr)
         h->ext = malloc(sizeof(struct ta_ext_header));
         if (!h->ext)
             return NULL;
-        *h->ext = (struct ta_ext_header) {
-            .header = h,
-            .children = {
-                .next = &h->ext->children,
-                .prev = &h->ext->children,
-                // Needed by ta_find_parent():
-                .size = CHILDREN_SENTINEL,
-                .ext = h->ext,
-            },
-        };
+        init_ext_header(h->ext, h);
     }
     return h->ext;
 }
 
+// Whether h was allocated from an arena (as opposed to being an arena itself).
+static bool is_arena_alloc(struct ta_header *h)
+{
+    return h->ext && h->ext->arena && h->ext->arena != PTR_FROM_HEADER(h);
+}
+
+// Return the arena new children of ptr should be allocated from, or NULL.
+static struct ta_arena *get_arena(void *ptr)
+{
+    struct ta_header *h = get_header(ptr);
+    return h && h->ext ? h->ext->arena : NULL;
+}
+
+// Return whether h is the most recent allocation in the arena, i.e. whether
+// it can be resized in place or its memory can be given back.
+static bool arena_is_last(struct ta_arena *a, struct ta_header *h)
+{
+    return (char *)PTR_FROM_HEADER(h) + ALIGN_SIZE(h->size) == a->pos;
+}
+
+static void *arena_bump(struct ta_arena *a, size_t size)
+{
+    size = ALIGN_SIZE(size);
+    if (a->end - a->pos < size) {
+        size_t chunk_size = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+        struct ta_arena_chunk *c = malloc(ARENA_CHUNK_HEADER + chunk_size);
+        if (!c)
+            return NULL;
+        *c = (struct ta_arena_chunk){ .next = a->chunks, .size = chunk_size };
+        a->chunks = c;
+        a->pos = (char *)c + ARENA_CHUNK_HEADER;
+        a->end = a->pos + chunk_size;
+    }
+    void *ptr = a->pos;
+    a->pos += size;
+    return ptr;
+}
+
+static struct ta_header *arena_alloc_header(struct ta_arena *a, size_t size)
+{
+    if (size >= MAX_ARENA_ALLOC)
+        return NULL;
+    char *p = arena_bump(a, ARENA_HEADER_SIZE + size);
+    if (!p)
+        return NULL;
+    struct ta_ext_header *eh = (void *)p;
+    struct ta_header *h = (void *)(p + ARENA_EXT_SIZE);
+    *h = (struct ta_header) {.size = size, .ext = eh};
+    init_ext_header(eh, h);
+    eh->arena = a;
+    return h;
+}
+
+// Free all chunks, except the most recent one, which is kept for reuse.
+// Must be called only if no allocations from the arena are left.
+static void arena_reset(struct ta_arena *a, bool keep_chunk)
+{
+    struct ta_arena_chunk *c = a->chunks;
+    if (keep_chunk && c) {
+        a->pos = (char *)c + ARENA_CHUNK_HEADER;
+        a->end = a->pos + c->size;
+        c = c->next;
+        a->chunks->next = NULL;
+    } else {
+        a->chunks = NULL;
+        a->pos = a->end = NULL;
+    }
+    while (c) {
+        struct ta_arena_chunk *next = c->next;
+        free(c);
+        c = next;
+    }
+}
+
 /* Set the parent allocation of ptr. If parent==NULL, remove the parent.
  * Setting parent==NULL (with ptr!=NULL) always succeeds, and unsets the
  * parent of ptr. Operations ptr==NULL always succeed and do nothing.
@@ -118,6 +226,9 @@ bool ta_set_parent(void *ptr, void *ta_parent)
     struct ta_ext_header *parent_eh = get_or_alloc_ext_header(ta_parent);
     if (ta_parent && !parent_eh) // do nothing on OOM
         return false;
+    // Arena memory can't outlive the arena.
+    assert(!is_arena_alloc(ch) ||
+           (parent_eh && parent_eh->arena == ch->ext->arena));
     // Unlink from previous parent
     if (ch->next) {
         ch->next->prev = ch->prev;
@@ -144,10 +255,18 @@ void *ta_alloc_size(void *ta_parent, size_t size)
 {
     if (size >= MAX_ALLOC)
         return NULL;
-    struct ta_header *h = malloc(sizeof(union aligned_header) + size);
-    if (!h)
-        return NULL;
-    *h = (struct ta_header) {.size = size};
+    struct ta_arena *arena = get_arena(ta_parent);
+    struct ta_header *h;
+    if (arena) {
+        h = arena_alloc_header(arena, size);
+        if (!h)
+            return NULL;
+    } else {
+        h = malloc(sizeof(union aligned_header) + size);
+        if (!h)
+            return NULL;
+        *h = (struct ta_header) {.size = size};
+    }
     ta_dbg_add(h);
     void *ptr = PTR_FROM_HEADER(h);
     if (!ta_set_parent(ptr, ta_parent)) {
@@ -164,6 +283,12 @@ void *ta_zalloc_size(void *ta_parent, size_t size)
 {
     if (size >= MAX_ALLOC)
         return NULL;
+    if (get_arena(ta_parent)) {
+        void *ptr = ta_alloc_size(ta_parent, size);
+        if (ptr)
+            memset(ptr, 0, size);
+        return ptr;
+    }
     struct ta_header *h = calloc(1, sizeof(union aligned_header) + size);
     if (!h)
         return NULL;
@@ -177,6 +302,46 @@ void *ta_zalloc_size(void *ta_parent, size_t size)
     return ptr;
 }
 
+static void *arena_realloc(struct ta_header *h, size_t size)
+{
+    struct ta_arena *a = h->ext->arena;
+    char *ptr = PTR_FROM_HEADER(h);
+    if (arena_is_last(a, h) && size < MAX_ARENA_ALLOC &&
+        a->end - ptr >= ALIGN_SIZE(size))
+    {
+        a->pos = ptr + ALIGN_SIZE(size);
+        h->size = size;
+        return ptr;
+    }
+    if (size < h->size) {
+        h->size = size;
+        return ptr;
+    }
+    struct ta_header *nh = arena_alloc_header(a, size);
+    if (!nh)
+        return NULL;
+    memcpy(PTR_FROM_HEADER(nh), ptr, h->size);
+    // Take over the position in the sibling list, the children, and the
+    // destructor. The old memory is simply abandoned until the arena is reset.
+    if (h->next) {
+        nh->next = h->next;
+        nh->prev = h->prev;
+        nh->next->prev = nh;
+        nh->prev->next = nh;
+    }
+    struct ta_ext_header *eh = h->ext, *neh = nh->ext;
+    if (eh->children.next != &eh->children) {
+        neh->children.next = eh->children.next;
+        neh->children.prev = eh->children.prev;
+        neh->children.next->prev = &neh->children;
+        neh->children.prev->next = &neh->children;
+    }
+    neh->destructor = eh->destructor;
+    ta_dbg_remove(h);
+    ta_dbg_add(nh);
+    return PTR_FROM_HEADER(nh);
+}
+
 /* Reallocate the allocation given by ptr and return a new pointer. Much like
  * realloc(), the returned pointer can be different, and on OOM, NULL is
  * returned.
@@ -203,6 +368,8 @@ void *ta_realloc_size(void *ta_parent, void *ptr, size_t size)
     struct ta_header *old_h = h;
     if (h->size == size)
         return ptr;
+    if (is_arena_alloc(h))
+        return arena_realloc(h, size);
     ta_dbg_remove(h);
     h = realloc(h, sizeof(union aligned_header) + size);
     ta_dbg_add(h ? h : old_h);
@@ -246,6 +413,8 @@ void ta_free_children(void *ptr)
         return;
     while (eh->children.next != &eh->children)
         ta_free(PTR_FROM_HEADER(eh->children.next));
+    if (eh->arena == ptr)
+        arena_reset(eh->arena, true);
 }
 
 /* Free the given allocation, and all of its direct and indirect children.
@@ -263,11 +432,51 @@ void ta_free(void *ptr)
         h->next->prev = h->prev;
         h->prev->next = h->next;
     }
+    if (is_arena_alloc(h)) {
+        // The memory is released when the arena is reset, but the most recent
+        // allocation can be given back immediately.
+        struct ta_arena *a = h->ext->arena;
+        if (arena_is_last(a, h))
+            a->pos = (char *)h->ext;
+        ta_dbg_remove(h);
+        return;
+    }
+    if (h->ext && h->ext->arena)
+        arena_reset(h->ext->arena, false);
     ta_dbg_remove(h);
     free(h->ext);
     free(h);
 }
 
+/* Create an arena. This is an allocation that can be used as parent like any
+ * other, but all allocations that have it as direct or indirect parent are
+ * carved out of larger memory chunks owned by the arena, instead of being
+ * allocated with malloc() each.
+ *
+ * Allocations from an arena can be freed and reallocated as usual, but their
+ * memory is generally reclaimed only when the arena is freed, or when
+ * ta_free_children() is called on the arena (which keeps one chunk around, so
+ * that reusing the arena for the next batch of allocations is cheap). This
+ * makes arenas useful for many small, short-lived allocations.
+ *
+ * Allocations from an arena must not be moved to a parent outside of the
+ * arena with ta_set_parent(). Moving other allocations into it is fine.
+ *
+ * Returns NULL on OOM.
+ */
+void *ta_new_arena(void *ta_parent)
+{
+    // The arena itself is never allocated from another arena.
+    void *ptr = ta_zalloc_size(NULL, sizeof(struct ta_arena));
+    struct ta_ext_header *eh = get_or_alloc_ext_header(ptr);
+    if (!eh || !ta_set_parent(ptr, ta_parent)) {
+        ta_free(ptr);
+        return NULL;
+    }
+    eh->arena = ptr;
+    return ptr;
+}
+
 /* Set a destructor that is to be called when the given allocation is freed.
  * (Whether the allocation is directly freed with ta_free() or indirectly by
  * freeing its parent does not matter.) There is only one destructor. If an
@@ -33,6 +33,7 @@
 #define talloc_steal                    ta_xsteal
 #define talloc_realloc_size             ta_xrealloc_size
 #define talloc_new                      ta_xnew_context
+#define talloc_new_arena                ta_xnew_arena
 #define talloc_set_destructor           ta_xset_destructor
 #define talloc_parent                   ta_find_parent
 #define talloc_enable_leak_report       ta_enable_leak_report
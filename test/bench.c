@@ -0,0 +1,514 @@
+/*
+ * Microbenchmarks for some hot code paths. Run as:
+ *
+ *      build/test/bench [substring]
+ *
+ * Only benchmarks whose name contains the substring are run. Each benchmark is
+ * calibrated to run for about ROUND_TIME_US per round, and the time per
+ * operation of NUM_ROUNDS rounds is reported. Compare the median column
+ * between builds; min and max show how noisy the machine was.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "audio/audio.h"
+#include "audio/filter/af.h"
+#include "common/common.h"
+#include "common/global.h"
+#include "common/msg.h"
+#include "common/msg_control.h"
+#include "demux/demux.h"
+#include "demux/ebml.h"
+#include "demux/packet.h"
+#include "misc/json.h"
+#include "misc/node.h"
+#include "misc/ring.h"
+#include "options/m_config.h"
+#include "options/m_property.h"
+#include "options/options.h"
+#include "osdep/timer.h"
+#include "stream/stream.h"
+#include "sub/draw_bmp.h"
+#include "video/img_format.h"
+#include "video/mp_image.h"
+#include "video/out/filter_kernels.h"
+
+#if HAVE_SSE4_INTRINSICS
+#include "video/gpu_memcpy.h"
+#endif
+
+#define NUM_ROUNDS 11
+#define ROUND_TIME_US 50000
+
+struct run {
+    const char *name;
+    size_t bytes;           // bytes processed per operation, or 0
+    int64_t iters;          // operations per round
+    int64_t i;              // index of the current operation in the round
+    bool calibrating;
+    int round;
+    int64_t round_start;
+    double ns[NUM_ROUNDS];  // time per operation for each round
+};
+
+#define RUN_INIT(name_, bytes_) \
+    (struct run){ .name = (name_), .bytes = (bytes_), .iters = 1, \
+                  .calibrating = true, .round_start = mp_time_us() }
+
+static int cmp_double(const void *a, const void *b)
+{
+    double va = *(const double *)a, vb = *(const double *)b;
+    return va < vb ? -1 : (va > vb ? 1 : 0);
+}
+
+static void report(struct run *r)
+{
+    qsort(r->ns, NUM_ROUNDS, sizeof(r->ns[0]), cmp_double);
+    double median = r->ns[NUM_ROUNDS / 2];
+    printf("%-28s %10"PRId64" %12.1f %12.1f %12.1f", r->name, r->iters,
+           r->ns[0], median, r->ns[NUM_ROUNDS - 1]);
+    if (r->bytes)
+        printf(" %10.1f", r->bytes / median * 1e9 / (1024 * 1024));
+    printf("\n");
+    fflush(stdout);
+}
+
+// Use as "while (run_next(&r)) { ...one operation... }". r.i can be used to
+// vary the input between operations.
+static bool run_next(struct run *r)
+{
+    if (r->i++ < r->iters)
+        return true;
+
+    int64_t elapsed = MPMAX(mp_time_us() - r->round_start, 1);
+    if (r->calibrating) {
+        if (elapsed < ROUND_TIME_US / 8 && r->iters < (1LL << 40)) {
+            r->iters *= 2;
+        } else {
+            r->iters = MPMAX(1, r->iters * ROUND_TIME_US / elapsed);
+            r->calibrating = false;
+        }
+    } else {
+        r->ns[r->round++] = elapsed * 1000.0 / r->iters;
+        if (r->round == NUM_ROUNDS) {
+            report(r);
+            return false;
+        }
+    }
+
+    r->i = 1;
+    r->round_start = mp_time_us();
+    return true;
+}
+
+static struct mp_image *alloc_test_image(int imgfmt, int w, int h)
+{
+    struct mp_image *img = mp_image_alloc(imgfmt, w, h);
+    if (!img)
+        abort();
+    for (int p = 0; p < img->num_planes; p++) {
+        int ph = mp_image_plane_h(img, p);
+        for (int y = 0; y < ph; y++) {
+            uint8_t *line = img->planes[p] + y * (ptrdiff_t)img->stride[p];
+            for (int x = 0; x < img->stride[p]; x++)
+                line[x] = (x * 7 + y * 13 + p) & 0xFF;
+        }
+    }
+    return img;
+}
+
+static void bench_image_copy(struct mpv_global *global)
+{
+    struct mp_image *src = alloc_test_image(IMGFMT_420P, 1920, 1080);
+    struct mp_image *dst = alloc_test_image(IMGFMT_420P, 1920, 1080);
+
+    struct run r = RUN_INIT("mp_image_copy 1080p 420p", 1920 * 1080 * 3 / 2);
+    while (run_next(&r))
+        mp_image_copy(dst, src);
+
+    talloc_free(src);
+    talloc_free(dst);
+
+    // Large enough to be copied on the shared copy pool.
+    src = alloc_test_image(IMGFMT_444P16, 3840, 2160);
+    dst = alloc_test_image(IMGFMT_444P16, 3840, 2160);
+
+    r = RUN_INIT("mp_image_copy 2160p 444p16", 3840 * 2160 * 3 * 2);
+    while (run_next(&r))
+        mp_image_copy(dst, src);
+
+    talloc_free(src);
+    talloc_free(dst);
+}
+
+static void bench_gpu_memcpy(struct mpv_global *global)
+{
+#if HAVE_SSE4_INTRINSICS
+    struct mp_image *src = alloc_test_image(IMGFMT_Y8, 1920, 1080);
+    struct mp_image *dst = alloc_test_image(IMGFMT_Y8, 1920, 1080);
+    size_t size = src->stride[0] * (size_t)src->h;
+
+    struct run r = RUN_INIT("gpu_memcpy 1080p plane", size);
+    while (run_next(&r))
+        gpu_memcpy(dst->planes[0], src->planes[0], size);
+
+    talloc_free(src);
+    talloc_free(dst);
+#endif
+}
+
+static void bench_draw_bmp(struct mpv_global *global)
+{
+    struct mp_image *dst = alloc_test_image(IMGFMT_420P, 1920, 1080);
+    struct mp_image *osd = alloc_test_image(IMGFMT_BGRA, 1280, 160);
+
+    struct sub_bitmap part = {
+        .bitmap = osd->planes[0],
+        .stride = osd->stride[0],
+        .w = osd->w, .h = osd->h,
+        .x = 320, .y = 860,
+        .dw = osd->w, .dh = osd->h,
+    };
+    struct sub_bitmaps sbs = {
+        .format = SUBBITMAP_RGBA,
+        .parts = &part,
+        .num_parts = 1,
+        .packed = osd,
+        .packed_w = osd->w,
+        .packed_h = osd->h,
+        .change_id = 1,
+    };
+    struct mp_draw_sub_cache *cache = NULL;
+
+    struct run r = RUN_INIT("draw_bmp rgba on 420p", 0);
+    while (run_next(&r))
+        mp_draw_sub_bitmaps(&cache, dst, &sbs);
+
+    talloc_free(cache);
+    talloc_free(osd);
+    talloc_free(dst);
+}
+
+static struct mp_audio *alloc_test_audio(int rate, int samples)
+{
+    struct mp_audio *a = talloc_zero(NULL, struct mp_audio);
+    mp_audio_set_format(a, AF_FORMAT_FLOAT);
+    mp_audio_set_channels(a, &(struct mp_chmap)MP_CHMAP_INIT_STEREO);
+    a->rate = rate;
+    mp_audio_realloc(a, samples);
+    a->samples = samples;
+    float *data = a->planes[0];
+    for (int n = 0; n < samples * a->nch; n++)
+        data[n] = ((n * 37) % 200 - 100) / 100.0f;
+    return a;
+}
+
+// Run audio through the filter chain, which must have been set up already.
+static void run_af(struct af_stream *afs, const char *name)
+{
+    struct mp_audio *tmpl = alloc_test_audio(afs->input.rate, 1024);
+    struct mp_audio_pool *pool = mp_audio_pool_create(NULL);
+
+    struct run r = RUN_INIT(name, 1024 * sizeof(float) * 2);
+    while (run_next(&r)) {
+        struct mp_audio *in = mp_audio_pool_new_copy(pool, tmpl);
+        if (!in || af_filter_frame(afs, in) < 0 || af_output_frame(afs, false) < 0)
+            abort();
+        struct mp_audio *out;
+        while ((out = af_read_output_frame(afs)))
+            talloc_free(out);
+    }
+
+    talloc_free(pool);
+    talloc_free(tmpl);
+}
+
+static struct af_stream *create_af(struct mpv_global *global, int out_rate)
+{
+    struct af_stream *afs = af_new(global);
+    struct mp_audio *tmpl = alloc_test_audio(48000, 0);
+    mp_audio_copy_config(&afs->input, tmpl);
+    mp_audio_copy_config(&afs->output, tmpl);
+    afs->output.rate = out_rate;
+    talloc_free(tmpl);
+    if (af_init(afs) < 0)
+        abort();
+    return afs;
+}
+
+static void bench_af_lavrresample(struct mpv_global *global)
+{
+    struct af_stream *afs = create_af(global, 44100);
+    run_af(afs, "af_lavrresample 48k->44.1k");
+    af_destroy(afs);
+}
+
+static void bench_af_scaletempo(struct mpv_global *global)
+{
+    struct af_stream *afs = create_af(global, 48000);
+    double speed = 1.5;
+    if (!af_add(afs, "scaletempo", "playback-speed", NULL) ||
+        !af_control_any_rev(afs, AF_CONTROL_SET_PLAYBACK_SPEED, &speed))
+        abort();
+    run_af(afs, "af_scaletempo 1.5x");
+    af_destroy(afs);
+}
+
+static void bench_ring(struct mpv_global *global)
+{
+    struct mp_ring *ring = mp_ring_new(NULL, 64 * 1024);
+    unsigned char buf[4096] = {0};
+
+    // Writes of 4000 bytes wrap around the end of the buffer regularly.
+    struct run r = RUN_INIT("mp_ring write+read 4000", 4000);
+    while (run_next(&r)) {
+        mp_ring_write(ring, buf, 4000);
+        mp_ring_read(ring, buf, 4000);
+    }
+
+    talloc_free(ring);
+}
+
+static char *create_test_json(void)
+{
+    char *s = talloc_strdup(NULL, "[");
+    for (int n = 0; n < 200; n++) {
+        s = talloc_asprintf_append(s, "%s{\"id\":%d,\"name\":\"item \\\"%d\\\"\","
+                                   "\"value\":%f,\"flags\":[true,false,null]}",
+                                   n ? "," : "", n, n, n * 0.5);
+    }
+    return talloc_strdup_append(s, "]");
+}
+
+static void bench_json(struct mpv_global *global)
+{
+    char *text = create_test_json();
+    size_t len = strlen(text);
+    void *tmp = talloc_new(NULL);
+
+    struct run r = RUN_INIT("json_parse 200 objects", len);
+    while (run_next(&r)) {
+        // json_parse() mutates its input.
+        char *copy = talloc_memdup(tmp, text, len + 1);
+        struct mpv_node node;
+        if (json_parse(tmp, &node, &copy, 50) < 0)
+            abort();
+        talloc_free_children(tmp);
+    }
+
+    char *copy = talloc_strdup(tmp, text);
+    struct mpv_node node;
+    if (json_parse(tmp, &node, &copy, 50) < 0)
+        abort();
+
+    r = RUN_INIT("json_write 200 objects", len);
+    while (run_next(&r)) {
+        char *out = NULL;
+        json_write(&out, &node);
+        talloc_free(out);
+    }
+
+    talloc_free(tmp);
+    talloc_free(text);
+}
+
+static int prop_int(void *ctx, struct m_property *prop, int action, void *arg)
+{
+    return m_property_int_ro(action, arg, 42);
+}
+
+static void bench_property(struct mpv_global *global)
+{
+    // About as many properties as player/command.c has.
+    struct m_property_list list = {0};
+    void *tmp = talloc_new(NULL);
+    for (int n = 0; n < 300; n++) {
+        MP_TARRAY_APPEND(tmp, list.entries, list.num_entries, (struct m_property){
+            .name = talloc_asprintf(tmp, "property-%03d", n),
+            .call = prop_int,
+        });
+    }
+    m_property_list_sort(&list);
+
+    struct run r = RUN_INIT("m_property_do get", 0);
+    while (run_next(&r)) {
+        int val;
+        const char *name = list.entries[r.i % list.num_entries].name;
+        if (m_property_do(mp_null_log, &list, name, M_PROPERTY_GET, &val,
+                          NULL) != M_PROPERTY_OK)
+            abort();
+    }
+
+    talloc_free(tmp);
+}
+
+static void append_ebml_uint(bstr *buf, uint32_t id, int id_len, uint32_t v)
+{
+    for (int n = id_len - 1; n >= 0; n--)
+        bstr_xappend(NULL, buf, (bstr){(unsigned char[]){id >> (n * 8)}, 1});
+    unsigned char data[] = {0x84, v >> 24, v >> 16, v >> 8, v};
+    bstr_xappend(NULL, buf, (bstr){data, sizeof(data)});
+}
+
+static void append_ebml_master(bstr *buf, uint8_t id, bstr content)
+{
+    assert(content.len < 127);
+    bstr_xappend(NULL, buf, (bstr){(unsigned char[]){id, 0x80 | content.len}, 2});
+    bstr_xappend(NULL, buf, content);
+}
+
+// Contents of a Cues element with the given number of cue points, including
+// the element size, but not the element ID (like ebml_read_element() expects).
+static bstr create_test_cues(int num_points)
+{
+    bstr points = {0};
+    for (int n = 0; n < num_points; n++) {
+        bstr pos = {0}, point = {0};
+        append_ebml_uint(&pos, MATROSKA_ID_CUETRACK, 1, 1);
+        append_ebml_uint(&pos, MATROSKA_ID_CUECLUSTERPOSITION, 1, n * 100000);
+        append_ebml_uint(&point, MATROSKA_ID_CUETIME, 1, n * 1000);
+        append_ebml_master(&point, MATROSKA_ID_CUETRACKPOSITIONS, pos);
+        append_ebml_master(&points, MATROSKA_ID_CUEPOINT, point);
+        talloc_free(pos.start);
+        talloc_free(point.start);
+    }
+    // 8 byte EBML length
+    bstr res = {0};
+    unsigned char len[8] = {0x01};
+    for (int n = 0; n < 7; n++)
+        len[7 - n] = (uint64_t)points.len >> (n * 8);
+    bstr_xappend(NULL, &res, (bstr){len, 8});
+    bstr_xappend(NULL, &res, points);
+    talloc_free(points.start);
+    return res;
+}
+
+static void bench_ebml(struct mpv_global *global)
+{
+    bstr data = create_test_cues(2000);
+    struct stream *s = open_memory_stream(data.start, data.len);
+
+    struct run r = RUN_INIT("ebml_read_element cues", data.len);
+    while (run_next(&r)) {
+        stream_seek(s, 0);
+        struct ebml_cues cues = {0};
+        struct ebml_parse_ctx ctx = {mp_null_log};
+        if (ebml_read_element(s, &ctx, &cues, &ebml_cues_desc) < 0 ||
+            cues.n_cue_point != 2000)
+            abort();
+        talloc_free(ctx.talloc_ctx);
+    }
+
+    free_stream(s);
+    talloc_free(data.start);
+}
+
+static void bench_demux(struct mpv_global *global)
+{
+    // 16x16 I420 rawvideo frames (see main()).
+    int frame_size = 16 * 16 * 3 / 2;
+
+    size_t size = 8 * 1024 * 1024 / frame_size * frame_size;
+    void *data = talloc_zero_size(NULL, size);
+    struct stream *s = open_memory_stream(data, size);
+    struct demuxer_params params = { .force_format = "rawvideo" };
+    struct demuxer *demuxer = demux_open(s, &params, global);
+    if (!demuxer || demux_get_num_stream(demuxer) != 1)
+        abort();
+    struct sh_stream *sh = demux_get_stream(demuxer, 0);
+    demuxer_select_track(demuxer, sh, MP_NOPTS_VALUE, true);
+
+    // Every packet is read by the demuxer, goes through the packet queue, and
+    // is returned to the pool when freed. At EOF, start over.
+    struct run r = RUN_INIT("demux packet queue", frame_size);
+    while (run_next(&r)) {
+        struct demux_packet *pkt = demux_read_packet(sh);
+        if (!pkt) {
+            demux_seek(demuxer, 0, 0);
+            pkt = demux_read_packet(sh);
+            if (!pkt)
+                abort();
+        }
+        talloc_free(pkt);
+    }
+
+    free_demuxer_and_stream(demuxer);
+    talloc_free(data);
+}
+
+static void bench_compute_lut(struct mpv_global *global)
+{
+    static const int sizes[] = {2, 4, 6, 8, 12, 16, 20, 24, 28, 32, 36, 40,
+                                44, 48, 52, 56, 60, 64, 0};
+    struct filter_kernel k = *mp_find_filter_kernel("lanczos");
+    k.w = *mp_find_filter_window(k.window ? k.window : k.f.name);
+    if (!mp_init_filter(&k, sizes, 1.0))
+        abort();
+    float *weights = talloc_array(NULL, float, 64 * k.size);
+
+    // Changing blur defeats the LUT cache.
+    struct run r = RUN_INIT("mp_compute_lut lanczos", 0);
+    while (run_next(&r)) {
+        k.f.blur = 1.0 + (r.i % 1000) * 1e-9;
+        mp_compute_lut(&k, 64, weights);
+    }
+
+    k.f.blur = 1.0;
+    r = RUN_INIT("mp_compute_lut lanczos cached", 0);
+    while (run_next(&r))
+        mp_compute_lut(&k, 64, weights);
+
+    talloc_free(weights);
+}
+
+static const struct {
+    const char *name;
+    void (*fn)(struct mpv_global *global);
+} benchmarks[] = {
+    {"image_copy", bench_image_copy},
+    {"gpu_memcpy", bench_gpu_memcpy},
+    {"draw_bmp", bench_draw_bmp},
+    {"af_lavrresample", bench_af_lavrresample},
+    {"af_scaletempo", bench_af_scaletempo},
+    {"ring", bench_ring},
+    {"json", bench_json},
+    {"property", bench_property},
+    {"ebml", bench_ebml},
+    {"demux", bench_demux},
+    {"compute_lut", bench_compute_lut},
+};
+
+int main(int argc, char *argv[])
+{
+    const char *filter = argc > 1 ? argv[1] : "";
+
+    mp_time_init();
+
+    struct mpv_global *global = talloc_zero(NULL, struct mpv_global);
+    mp_msg_init(global);
+    struct m_config *config = m_config_new(global, global->log,
+                                           sizeof(struct MPOpts),
+                                           &mp_default_opts, mp_opts);
+    global->opts = config->optstruct;
+
+    // Tiny rawvideo frames for bench_demux(), so that the packet queue
+    // overhead dominates, and not the data copy.
+    m_config_set_option0(config, "demuxer-rawvideo-w", "16");
+    m_config_set_option0(config, "demuxer-rawvideo-h", "16");
+
+    printf("%-28s %10s %12s %12s %12s %10s\n", "benchmark", "ops/round",
+           "min ns/op", "median ns/op", "max ns/op", "MiB/s");
+    for (int n = 0; n < MP_ARRAY_SIZE(benchmarks); n++) {
+        if (strstr(benchmarks[n].name, filter))
+            benchmarks[n].fn(global);
+    }
+
+    talloc_free(config);
+    mp_msg_uninit(global);
+    talloc_free(global);
+    return 0;
+}
@@ -0,0 +1,99 @@
+#include <string.h>
+
+#include "test_helpers.h"
+#include "common/common.h"
+#include "misc/charset_conv.h"
+
+// Return whether s is a slice of buf, or consists of lines of buf.
+static bool all_lines_in(bstr s, bstr buf)
+{
+    while (s.len) {
+        bstr line = bstr_getline(s, &s);
+        if (bstr_find(buf, line) < 0)
+            return false;
+    }
+    return true;
+}
+
+static void test_small(void **state)
+{
+    bstr buf = bstr0("1\n00:00:01,000 --> 00:00:02,000\nh\xc3\xa9llo\n");
+
+    // Files not larger than the probe size are looked at completely.
+    bstr s = mp_charset_guess_sample(NULL, buf, 0);
+    assert_true(s.start == buf.start && s.len == buf.len);
+    s = mp_charset_guess_sample(NULL, buf, buf.len);
+    assert_true(s.start == buf.start && s.len == buf.len);
+}
+
+static void test_prefix(void **state)
+{
+    void *tmp = talloc_new(NULL);
+
+    // Non-ASCII in the prefix: only the prefix is used, cut at a line break.
+    bstr buf = {0};
+    for (int n = 0; n < 1000; n++)
+        bstr_xappend_asprintf(tmp, &buf, "%d: caf\xc3\xa9\n", n);
+    bstr s = mp_charset_guess_sample(tmp, buf, 1000);
+    assert_true(s.start == buf.start);
+    assert_true(s.len > 0 && s.len <= 500);
+    assert_int_equal(s.start[s.len - 1], '\n');
+
+    talloc_free(tmp);
+}
+
+static void test_chunks(void **state)
+{
+    void *tmp = talloc_new(NULL);
+
+    // ASCII prefix: chunks from the rest of the file are appended, each
+    // consisting of complete lines.
+    bstr buf = {0};
+    for (int n = 0; n < 1000; n++)
+        bstr_xappend_asprintf(tmp, &buf, "line %d\n", n);
+    for (int n = 0; n < 1000; n++)
+        bstr_xappend_asprintf(tmp, &buf, "\xc3\xa4\xc3\xb6 %d\n", n);
+    bstr s = mp_charset_guess_sample(tmp, buf, 2000);
+    assert_true(s.len > 1000 && s.len <= 2000);
+    assert_true(bstr_find0(s, "\xc3\xa4") >= 0);
+    assert_int_equal(s.start[s.len - 1], '\n');
+    assert_true(all_lines_in(s, buf));
+
+    talloc_free(tmp);
+}
+
+static void test_no_newlines(void **state)
+{
+    void *tmp = talloc_new(NULL);
+
+    // A single huge line must not result in an empty sample.
+    bstr buf = {0};
+    for (int n = 0; n < 1000; n++)
+        bstr_xappend(tmp, &buf, bstr0("word "));
+    for (int n = 0; n < 1000; n++)
+        bstr_xappend(tmp, &buf, bstr0("w\xc3\xb6rd "));
+    bstr s = mp_charset_guess_sample(tmp, buf, 2000);
+    assert_true(s.len > 1000);
+    assert_true(bstr_find0(s, "\xc3\xb6") >= 0);
+
+    // No whitespace either: cut at UTF-8 character boundaries, so that the
+    // sample is still valid UTF-8.
+    buf = (bstr){0};
+    for (int n = 0; n < 4000; n++)
+        bstr_xappend(tmp, &buf, n < 1000 ? bstr0("a") : bstr0("\xe2\x82\xac"));
+    s = mp_charset_guess_sample(tmp, buf, 2000);
+    assert_true(s.len > 1000);
+    assert_true(bstr_validate_utf8(s) == 0);
+
+    talloc_free(tmp);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_small),
+        cmocka_unit_test(test_prefix),
+        cmocka_unit_test(test_chunks),
+        cmocka_unit_test(test_no_newlines),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,182 @@
+#include <string.h>
+
+#include "test_helpers.h"
+#include "common/common.h"
+#include "misc/msgpack.h"
+#include "misc/node.h"
+#include "input/input.h"
+
+// Literal with embedded '\0' bytes.
+#define B(s) ((bstr){(unsigned char *)(s), sizeof(s) - 1})
+
+static bool nodes_equal(struct mpv_node *a, struct mpv_node *b)
+{
+    if (a->format != b->format)
+        return false;
+    switch (a->format) {
+    case MPV_FORMAT_NONE:
+        return true;
+    case MPV_FORMAT_FLAG:
+        return a->u.flag == b->u.flag;
+    case MPV_FORMAT_INT64:
+        return a->u.int64 == b->u.int64;
+    case MPV_FORMAT_DOUBLE:
+        return a->u.double_ == b->u.double_;
+    case MPV_FORMAT_STRING:
+        return strcmp(a->u.string, b->u.string) == 0;
+    case MPV_FORMAT_BYTE_ARRAY:
+        return a->u.ba->size == b->u.ba->size &&
+               memcmp(a->u.ba->data, b->u.ba->data, a->u.ba->size) == 0;
+    case MPV_FORMAT_NODE_ARRAY:
+    case MPV_FORMAT_NODE_MAP: {
+        struct mpv_node_list *la = a->u.list, *lb = b->u.list;
+        if (la->num != lb->num)
+            return false;
+        for (int n = 0; n < la->num; n++) {
+            if (a->format == MPV_FORMAT_NODE_MAP &&
+                strcmp(la->keys[n], lb->keys[n]) != 0)
+                return false;
+            if (!nodes_equal(&la->values[n], &lb->values[n]))
+                return false;
+        }
+        return true;
+    }
+    }
+    return false;
+}
+
+// Encode src, check that the size is detected correctly with any amount of
+// trailing data, and that decoding it gives the same tree.
+static void check_roundtrip(struct mpv_node *src)
+{
+    void *tmp = talloc_new(NULL);
+
+    bstr data = {0};
+    assert_int_equal(msgpack_write(tmp, &data, src), 0);
+
+    size_t size = 0;
+    for (size_t n = 0; n < data.len; n++) {
+        bstr part = {data.start, n};
+        assert_int_equal(msgpack_message_size(part, 4, &size), 0);
+    }
+    assert_int_equal(msgpack_message_size(data, 4, &size), 1);
+    assert_int_equal(size, data.len);
+
+    bstr_xappend(tmp, &data, bstr0("trailing"));
+    assert_int_equal(msgpack_message_size(data, 4, &size), 1);
+    assert_int_equal(size, data.len - 8);
+
+    // The parser needs a spare byte after the message.
+    struct mpv_node dst;
+    assert_int_equal(msgpack_parse(tmp, &dst, data.start, size, 4), 0);
+    assert_true(nodes_equal(src, &dst));
+
+    talloc_free(tmp);
+}
+
+static void test_scalars(void **state)
+{
+    int64_t ints[] = {0, 1, 127, 128, 255, 256, 65535, 65536, 4294967295LL,
+                      4294967296LL, INT64_MAX, -1, -32, -33, -128, -129,
+                      -32768, -32769, INT32_MIN, INT32_MIN - 1LL, INT64_MIN};
+    for (int n = 0; n < MP_ARRAY_SIZE(ints); n++) {
+        struct mpv_node node = {.format = MPV_FORMAT_INT64,
+                                .u.int64 = ints[n]};
+        check_roundtrip(&node);
+    }
+
+    struct mpv_node node = {.format = MPV_FORMAT_DOUBLE, .u.double_ = -0.5};
+    check_roundtrip(&node);
+    node = (struct mpv_node){.format = MPV_FORMAT_FLAG, .u.flag = 1};
+    check_roundtrip(&node);
+    node = (struct mpv_node){.format = MPV_FORMAT_NONE};
+    check_roundtrip(&node);
+
+    char long_str[70000];
+    int lengths[] = {0, 31, 32, 255, 256, 65535, 65536};
+    for (int n = 0; n < MP_ARRAY_SIZE(lengths); n++) {
+        memset(long_str, 'x', lengths[n]);
+        long_str[lengths[n]] = '\0';
+        node = (struct mpv_node){.format = MPV_FORMAT_STRING,
+                                 .u.string = long_str};
+        check_roundtrip(&node);
+
+        struct mpv_byte_array ba = {long_str, lengths[n]};
+        node = (struct mpv_node){.format = MPV_FORMAT_BYTE_ARRAY, .u.ba = &ba};
+        check_roundtrip(&node);
+    }
+}
+
+static void test_containers(void **state)
+{
+    struct mpv_node root;
+    node_init(&root, MPV_FORMAT_NODE_MAP, NULL);
+
+    struct mpv_node *cmd =
+        node_map_add(&root, "command", MPV_FORMAT_NODE_ARRAY);
+    for (int n = 0; n < 20; n++) {
+        struct mpv_node *entry = node_array_add(cmd, MPV_FORMAT_INT64);
+        entry->u.int64 = n * 1000;
+    }
+    node_map_add_string(&root, "name", "value");
+    node_map_add(&root, "empty", MPV_FORMAT_NODE_MAP);
+    check_roundtrip(&root);
+
+    // Maps with 16 or more entries need map 16.
+    for (int n = 0; n < 20; n++)
+        node_map_add(&root, "key", MPV_FORMAT_NONE);
+    check_roundtrip(&root);
+
+    talloc_free(root.u.list);
+}
+
+static void test_invalid(void **state)
+{
+    size_t size;
+
+    // Extension type.
+    assert_int_equal(msgpack_message_size(B("\xd4\x01\x02"), 4, &size), -1);
+
+    // Too deep: [[[[[]]]]]
+    assert_int_equal(msgpack_message_size(B("\x91\x91\x91\x91\x90"), 4,
+                                          &size), -1);
+
+    // Map with a non-string key: {1: 2}
+    void *tmp = talloc_new(NULL);
+    unsigned char map[] = {0x81, 0x01, 0x02, 0x00};
+    struct mpv_node dst;
+    assert_int_equal(msgpack_parse(tmp, &dst, map, 3, 4), -1);
+    talloc_free(tmp);
+}
+
+static void test_detect(void **state)
+{
+    // {"a": 1}
+    assert_int_equal(mp_ipc_is_msgpack(B("\x81\xa1" "a\x01")), 1);
+    assert_int_equal(mp_ipc_is_msgpack(B("\xde\x00\x01\xa1")), 1);
+    assert_int_equal(mp_ipc_is_msgpack(B("\xdf\x00\x00\x00\x01\xd9")), 1);
+
+    // Incomplete header.
+    assert_int_equal(mp_ipc_is_msgpack(B("\x81")), -1);
+    assert_int_equal(mp_ipc_is_msgpack(B("\xde\x80")), -1);
+
+    // Text and JSON commands, including ones starting with UTF-8 characters
+    // whose lead byte is a map 16 or map 32 header.
+    assert_int_equal(mp_ipc_is_msgpack(bstr0("{\"command\": []}\n")), 0);
+    assert_int_equal(mp_ipc_is_msgpack(bstr0("show-text x\n")), 0);
+    assert_int_equal(mp_ipc_is_msgpack(B("\xde\x80" "abc\n")), 0);
+    assert_int_equal(mp_ipc_is_msgpack(B("\xdf\xbf" "abcdef\n")), 0);
+
+    // Empty map.
+    assert_int_equal(mp_ipc_is_msgpack(B("\x80\n")), 0);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_scalars),
+        cmocka_unit_test(test_containers),
+        cmocka_unit_test(test_invalid),
+        cmocka_unit_test(test_detect),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,116 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "test_helpers.h"
+#include "ta/ta_talloc.h"
+
+static int destructor_calls;
+
+static void count_destructor(void *ptr)
+{
+    destructor_calls++;
+}
+
+static void test_alloc(void **state)
+{
+    void *arena = talloc_new_arena(NULL);
+
+    // Small allocations, with normal parent/child semantics.
+    char *a = talloc_size(arena, 3);
+    int64_t *b = talloc_zero(a, int64_t);
+    double *c = talloc(arena, double);
+    assert_int_equal((uintptr_t)b % sizeof(int64_t), 0);
+    assert_int_equal((uintptr_t)c % sizeof(double), 0);
+    assert_int_equal(*b, 0);
+    assert_true(talloc_parent(b) == a);
+    assert_int_equal(talloc_get_size(a), 3);
+
+    // Growing the most recent allocation is done in place.
+    char *s = talloc_strdup(arena, "abc");
+    char *s2 = talloc_strdup_append(s, "def");
+    assert_true(s2 == s);
+    assert_string_equal(s2, "abcdef");
+
+    // Growing an older allocation moves it, but keeps its children.
+    char *a2 = talloc_realloc_size(arena, a, 100);
+    assert_true(a2 != a);
+    assert_true(talloc_parent(b) == a2);
+
+    // Allocations larger than a chunk.
+    char *big = talloc_size(arena, 1024 * 1024);
+    memset(big, 1, 1024 * 1024);
+    assert_int_equal(talloc_get_size(big), 1024 * 1024);
+
+    // Freeing the arena frees everything, and runs all destructors.
+    destructor_calls = 0;
+    talloc_set_destructor(b, count_destructor);
+    talloc_set_destructor(big, count_destructor);
+    talloc_free(arena);
+    assert_int_equal(destructor_calls, 2);
+}
+
+static void test_reset(void **state)
+{
+    void *arena = talloc_new_arena(NULL);
+
+    destructor_calls = 0;
+    for (int n = 0; n < 10; n++) {
+        char *last = NULL;
+        for (int i = 0; i < 1000; i++) {
+            last = talloc_asprintf(arena, "%d/%d", n, i);
+            talloc_set_destructor(last, count_destructor);
+        }
+        char expect[20];
+        snprintf(expect, sizeof(expect), "%d/999", n);
+        assert_string_equal(last, expect);
+        talloc_free_children(arena);
+        assert_int_equal(destructor_calls, (n + 1) * 1000);
+    }
+
+    // The arena is still usable after a reset.
+    int *x = talloc_zero(arena, int);
+    assert_int_equal(*x, 0);
+
+    talloc_free(arena);
+}
+
+static void test_free(void **state)
+{
+    void *root = talloc_new(NULL);
+    void *arena = talloc_new_arena(root);
+
+    // Freeing the most recent allocation gives its memory back.
+    char *a = talloc_size(arena, 16);
+    talloc_free(a);
+    char *b = talloc_size(arena, 16);
+    assert_true(a == b);
+
+    // Freeing other allocations leaves the rest intact.
+    char *c = talloc_strdup(arena, "c");
+    talloc_free(b);
+    assert_string_equal(c, "c");
+
+    // Normal allocations can be moved into the arena, and are freed with it.
+    destructor_calls = 0;
+    char *d = talloc_strdup(NULL, "d");
+    talloc_set_destructor(d, count_destructor);
+    talloc_steal(arena, d);
+    talloc_free_children(arena);
+    assert_int_equal(destructor_calls, 1);
+
+    // Freeing the parent frees the arena.
+    char *e = talloc_strdup(arena, "e");
+    talloc_set_destructor(e, count_destructor);
+    talloc_free(root);
+    assert_int_equal(destructor_calls, 2);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_alloc),
+        cmocka_unit_test(test_reset),
+        cmocka_unit_test(test_free),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
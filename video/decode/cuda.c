@@ -0,0 +1,90 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/hwcontext.h>
+#include <libavutil/hwcontext_cuda.h>
+
+#include "lavc.h"
+#include "common/common.h"
+#include "video/fmt-conversion.h"
+#include "video/hwdec.h"
+
+// The decoding itself is done by the libavcodec cuvid wrappers (e.g.
+// "hevc_cuvid"), which use NVDEC. This only makes them use the CUDA context
+// the VO created, so that the VO can access the decoded surfaces directly.
+
+static int probe(struct lavc_ctx *ctx, struct vd_lavc_hwdec *hwdec,
+                 const char *codec)
+{
+    if (!hwdec_devices_load(ctx->hwdec_devs, HWDEC_CUDA))
+        return HWDEC_ERR_NO_CTX;
+    return 0;
+}
+
+static int init(struct lavc_ctx *ctx)
+{
+    CUcontext cuda_ctx = hwdec_devices_get(ctx->hwdec_devs, HWDEC_CUDA)->ctx;
+
+    AVBufferRef *device_ref = av_hwdevice_ctx_alloc(AV_HWDEVICE_TYPE_CUDA);
+    if (!device_ref)
+        return -1;
+    AVHWDeviceContext *device_ctx = (void *)device_ref->data;
+    AVCUDADeviceContext *device_hwctx = device_ctx->hwctx;
+    // Not owned by libavutil; it won't destroy the context when freed.
+    device_hwctx->cuda_ctx = cuda_ctx;
+    if (av_hwdevice_ctx_init(device_ref) < 0) {
+        MP_ERR(ctx, "Failed to initialize the CUDA device context.\n");
+        av_buffer_unref(&device_ref);
+        return -1;
+    }
+
+    // The cuvid decoders create the frames context from this, with the
+    // surface format matching the video (NV12 or P010).
+    ctx->avctx->hw_device_ctx = av_buffer_ref(device_ref);
+    ctx->hwdec_priv = device_ref;
+    if (!ctx->avctx->hw_device_ctx)
+        return -1;
+    return 0;
+}
+
+static void uninit(struct lavc_ctx *ctx)
+{
+    AVBufferRef *device_ref = ctx->hwdec_priv;
+    av_buffer_unref(&device_ref);
+    ctx->hwdec_priv = NULL;
+}
+
+static struct mp_image *process_image(struct lavc_ctx *ctx,
+                                      struct mp_image *img)
+{
+    if (img->imgfmt == IMGFMT_CUDA && img->hwctx) {
+        AVHWFramesContext *fctx = (void *)img->hwctx->data;
+        img->params.hw_subfmt = pixfmt2imgfmt(fctx->sw_format);
+    }
+    return img;
+}
+
+const struct vd_lavc_hwdec mp_vd_lavc_cuda = {
+    .type = HWDEC_CUDA,
+    .image_format = IMGFMT_CUDA,
+    .lavc_suffix = "_cuvid",
+    .probe = probe,
+    .init = init,
+    .uninit = uninit,
+    .process_image = process_image,
+};
@@ -255,7 +255,8 @@ BOOL is_clearvideo(const GUID *mode_guid)
 }
 
 void copy_nv12(struct mp_image *dest, uint8_t *src_bits,
-               unsigned src_pitch, unsigned surf_height)
+               unsigned src_pitch, unsigned surf_height,
+               struct mp_thread_pool *pool)
 {
     struct mp_image buf = {0};
     mp_image_setfmt(&buf, dest->imgfmt);
@@ -265,7 +266,7 @@ void copy_nv12(struct mp_image *dest, uint8_t *src_bits,
     buf.stride[0] = src_pitch;
     buf.planes[1] = src_bits + src_pitch * surf_height;
     buf.stride[1] = src_pitch;
-    mp_image_copy_gpu(dest, &buf);
+    mp_image_copy_gpu_threaded(dest, &buf, pool);
 }
 
 // Test if Direct3D11 can be used by us. Basically, this prevents trying to use
@@ -47,6 +47,7 @@ struct priv {
 
     struct d3d11va_decoder *decoder;
     struct mp_image_pool   *sw_pool;
+    struct mp_thread_pool  *copy_pool;
 };
 
 struct d3d11va_surface {
@@ -156,7 +157,8 @@ static struct mp_image *d3d11va_retrieve_image(struct lavc_ctx *s,
         talloc_free(sw_img);
         return img;
     }
-    copy_nv12(sw_img, lock.pData, lock.RowPitch, texture_desc.Height);
+    copy_nv12(sw_img, lock.pData, lock.RowPitch, texture_desc.Height,
+              p->copy_pool);
     ID3D11DeviceContext_Unmap(p->device_ctx, (ID3D11Resource *)staging, 0);
 
     mp_image_set_size(sw_img, img->w, img->h);
@@ -498,6 +500,7 @@ static int d3d11va_init(struct lavc_ctx *s)
     if (s->hwdec->type == HWDEC_D3D11VA_COPY) {
         mp_check_gpu_memcpy(p->log, NULL);
         p->sw_pool = talloc_steal(p, mp_image_pool_new(17));
+        p->copy_pool = mp_image_create_copy_pool(p);
     }
 
     p->device = hwdec_devices_load(s->hwdec_devs, s->hwdec->type);
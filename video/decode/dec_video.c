@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <libavutil/rational.h>
 
@@ -26,12 +27,14 @@
 #include "options/options.h"
 #include "common/msg.h"
 
+#include "osdep/threads.h"
 #include "osdep/timer.h"
 
 #include "stream/stream.h"
 #include "demux/demux.h"
 #include "demux/packet.h"
 
+#include "common/benchmark.h"
 #include "common/codecs.h"
 
 #include "video/out/vo.h"
@@ -56,9 +59,39 @@ const vd_functions_t * const mpcodecs_vd_drivers[] = {
     NULL
 };
 
-void video_reset(struct dec_video *d_video)
+// Decoding on a separate thread (--vd-queue-frames). While the thread is
+// running, it owns all "internal" fields of dec_video, as well as the decoder.
+// The user thread only accesses them with the lock held and busy unset.
+struct dec_queue {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    bool exit;
+    bool busy;          // thread is decoding without holding the lock
+    bool kick;          // video_work() was called (new packets may be there)
+    int state;          // DATA_AGAIN, or why the thread stopped decoding
+    double start_pts;   // copied to d_video before decoding
+    bool framedrop_enabled;
+    double decode_time; // copied from d_video after decoding
+    int dropped_frames; // copied from d_video after decoding
+    struct mp_image **frames;
+    int num_frames;
+    int max_frames;
+    void (*wakeup_cb)(void *ctx);
+    void *wakeup_cb_ctx;
+};
+
+static int vd_control(struct dec_video *d_video, int cmd, void *arg)
+{
+    const struct vd_functions *vd = d_video->vd_driver;
+    if (vd)
+        return vd->control(d_video, cmd, arg);
+    return CONTROL_UNKNOWN;
+}
+
+static void reset_decoder(struct dec_video *d_video)
 {
-    video_vd_control(d_video, VDCTRL_RESET, NULL);
+    vd_control(d_video, VDCTRL_RESET, NULL);
     d_video->first_packet_pdts = MP_NOPTS_VALUE;
     d_video->start_pts = MP_NOPTS_VALUE;
     d_video->decoded_pts = MP_NOPTS_VALUE;
@@ -66,6 +99,8 @@ void video_reset(struct dec_video *d_video)
     d_video->codec_dts = MP_NOPTS_VALUE;
     d_video->last_format = d_video->fixed_format = (struct mp_image_params){0};
     d_video->dropped_frames = 0;
+    d_video->demux_wait_start = 0;
+    d_video->demux_wait = 0;
     d_video->current_state = DATA_AGAIN;
     mp_image_unrefp(&d_video->current_mpi);
     talloc_free(d_video->packet);
@@ -75,18 +110,73 @@ void video_reset(struct dec_video *d_video)
     d_video->start = d_video->end = MP_NOPTS_VALUE;
 }
 
+// Get exclusive access to the decoder state. Must be paired with unlock_idle().
+static void lock_idle(struct dec_video *d_video)
+{
+    struct dec_queue *q = d_video->queue;
+    if (!q)
+        return;
+    pthread_mutex_lock(&q->lock);
+    while (q->busy)
+        pthread_cond_wait(&q->wakeup, &q->lock);
+}
+
+static void unlock_idle(struct dec_video *d_video)
+{
+    struct dec_queue *q = d_video->queue;
+    if (!q)
+        return;
+    pthread_cond_broadcast(&q->wakeup);
+    pthread_mutex_unlock(&q->lock);
+}
+
+void video_reset(struct dec_video *d_video)
+{
+    lock_idle(d_video);
+    reset_decoder(d_video);
+    struct dec_queue *q = d_video->queue;
+    if (q) {
+        for (int n = 0; n < q->num_frames; n++)
+            talloc_free(q->frames[n]);
+        q->num_frames = 0;
+        q->state = DATA_AGAIN;
+        q->start_pts = MP_NOPTS_VALUE;
+        q->dropped_frames = 0;
+    }
+    unlock_idle(d_video);
+}
+
 int video_vd_control(struct dec_video *d_video, int cmd, void *arg)
 {
-    const struct vd_functions *vd = d_video->vd_driver;
-    if (vd)
-        return vd->control(d_video, cmd, arg);
-    return CONTROL_UNKNOWN;
+    lock_idle(d_video);
+    int r = vd_control(d_video, cmd, arg);
+    unlock_idle(d_video);
+    return r;
+}
+
+static void stop_thread(struct dec_video *d_video)
+{
+    struct dec_queue *q = d_video->queue;
+    if (!q)
+        return;
+    pthread_mutex_lock(&q->lock);
+    q->exit = true;
+    pthread_cond_broadcast(&q->wakeup);
+    pthread_mutex_unlock(&q->lock);
+    pthread_join(q->thread, NULL);
+    for (int n = 0; n < q->num_frames; n++)
+        talloc_free(q->frames[n]);
+    pthread_cond_destroy(&q->wakeup);
+    pthread_mutex_destroy(&q->lock);
+    talloc_free(q);
+    d_video->queue = NULL;
 }
 
 void video_uninit(struct dec_video *d_video)
 {
     if (!d_video)
         return;
+    stop_thread(d_video);
     mp_image_unrefp(&d_video->current_mpi);
     mp_image_unrefp(&d_video->cover_art_mpi);
     if (d_video->vd_driver) {
@@ -138,7 +228,7 @@ bool video_init_best_codec(struct dec_video *d_video)
     struct MPOpts *opts = d_video->opts;
 
     assert(!d_video->vd_driver);
-    video_reset(d_video);
+    reset_decoder(d_video);
     d_video->has_broken_packet_pts = -10; // needs 10 packets to reach decision
 
     struct mp_decoder_entry *decoder = NULL;
@@ -252,6 +342,11 @@ static struct mp_image *decode_packet(struct dec_video *d_video,
     if (!d_video->vd_driver)
         return NULL;
 
+    // --benchmark-stage=demux: only the packet reads are measured.
+    if (opts->benchmark && opts->benchmark[0] &&
+        opts->benchmark_stage == MP_BENCHMARK_DEMUX)
+        return NULL;
+
     double pkt_pts = packet ? packet->pts : MP_NOPTS_VALUE;
     double pkt_dts = packet ? packet->dts : MP_NOPTS_VALUE;
 
@@ -264,7 +359,14 @@ static struct mp_image *decode_packet(struct dec_video *d_video,
 
     MP_STATS(d_video, "start decode video");
 
+    bool has_data = packet && packet->len > 0;
+    int64_t start = mp_time_us();
     struct mp_image *mpi = d_video->vd_driver->decode(d_video, packet, drop_frame);
+    if (has_data) {
+        double t = (mp_time_us() - start) / 1e6;
+        d_video->decode_time = d_video->decode_time > 0 ?
+                               d_video->decode_time * 0.9 + t * 0.1 : t;
+    }
 
     MP_STATS(d_video, "end decode video");
 
@@ -274,6 +376,11 @@ static struct mp_image *decode_packet(struct dec_video *d_video,
         return NULL;
     }
 
+    mpi->timing = (struct mp_frame_timing){
+        .decode_start = start,
+        .decoded = mp_time_us(),
+    };
+
     if (opts->field_dominance == 0) {
         mpi->fields |= MP_IMGFIELD_TOP_FIRST | MP_IMGFIELD_INTERLACED;
     } else if (opts->field_dominance == 1) {
@@ -334,7 +441,7 @@ static struct mp_image *decode_packet(struct dec_video *d_video,
         mpi->pts != MP_NOPTS_VALUE && d_video->fps > 0)
     {
         int delay = -1;
-        video_vd_control(d_video, VDCTRL_GET_BFRAMES, &delay);
+        vd_control(d_video, VDCTRL_GET_BFRAMES, &delay);
         mpi->pts -= MPMAX(delay, 0) / d_video->fps;
     }
 
@@ -343,21 +450,71 @@ static struct mp_image *decode_packet(struct dec_video *d_video,
 
 void video_reset_aspect(struct dec_video *d_video)
 {
+    lock_idle(d_video);
     d_video->last_format = (struct mp_image_params){0};
+    unlock_idle(d_video);
 }
 
 void video_set_framedrop(struct dec_video *d_video, bool enabled)
 {
+    struct dec_queue *q = d_video->queue;
+    if (q) {
+        pthread_mutex_lock(&q->lock);
+        q->framedrop_enabled = enabled;
+        pthread_mutex_unlock(&q->lock);
+        return;
+    }
     d_video->framedrop_enabled = enabled;
 }
 
+double video_get_decode_time(struct dec_video *d_video)
+{
+    struct dec_queue *q = d_video->queue;
+    if (q) {
+        pthread_mutex_lock(&q->lock);
+        double t = q->decode_time;
+        pthread_mutex_unlock(&q->lock);
+        return t;
+    }
+    return d_video->decode_time;
+}
+
+int video_get_dropped_frames(struct dec_video *d_video)
+{
+    struct dec_queue *q = d_video->queue;
+    if (q) {
+        pthread_mutex_lock(&q->lock);
+        int n = q->dropped_frames;
+        pthread_mutex_unlock(&q->lock);
+        return n;
+    }
+    return d_video->dropped_frames;
+}
+
+// Reduce decoding quality to save CPU time. Levels:
+//  0: normal decoding
+//  1: skip the loop filter on non-reference frames
+//  2: skip the loop filter on all frames
+//  3: additionally skip decoding non-reference frames
+void video_set_degrade(struct dec_video *d_video, int level)
+{
+    video_vd_control(d_video, VDCTRL_SET_DEGRADE, &level);
+}
+
 // Frames before the start timestamp can be dropped. (Used for hr-seek.)
 void video_set_start(struct dec_video *d_video, double start_pts)
 {
+    struct dec_queue *q = d_video->queue;
+    if (q) {
+        pthread_mutex_lock(&q->lock);
+        q->start_pts = start_pts;
+        pthread_mutex_unlock(&q->lock);
+        return;
+    }
     d_video->start_pts = start_pts;
 }
 
-void video_work(struct dec_video *d_video)
+static void decode_next(struct dec_video *d_video)
 {
     if (d_video->current_mpi)
         return;
@@ -378,11 +535,20 @@ void video_work(struct dec_video *d_video)
         return;
     }
 
-    if (!d_video->packet && !d_video->new_segment &&
-        demux_read_packet_async(d_video->header, &d_video->packet) == 0)
-    {
-        d_video->current_state = DATA_WAIT;
-        return;
+    if (!d_video->packet && !d_video->new_segment) {
+        int r = demux_read_packet_async(d_video->header, &d_video->packet);
+        int64_t now = mp_time_us();
+        if (r == 0) {
+            if (!d_video->demux_wait_start)
+                d_video->demux_wait_start = now;
+            d_video->current_state = DATA_WAIT;
+            return;
+        }
+        if (r > 0)
+            d_video->packet_time = now;
+        if (d_video->demux_wait_start)
+            d_video->demux_wait += now - d_video->demux_wait_start;
+        d_video->demux_wait_start = 0;
     }
 
     if (d_video->packet) {
@@ -417,6 +583,12 @@ void video_work(struct dec_video *d_video)
         d_video->packet = NULL;
     }
 
+    if (d_video->current_mpi) {
+        d_video->current_mpi->timing.demuxed = d_video->packet_time;
+        d_video->current_mpi->timing.demux_wait = d_video->demux_wait;
+        d_video->demux_wait = 0;
+    }
+
     d_video->current_state = DATA_OK;
     if (!d_video->current_mpi) {
         d_video->current_state = DATA_EOF;
@@ -462,12 +634,7 @@ void video_work(struct dec_video *d_video)
     }
 }
 
-// Fetch an image decoded with video_work(). Returns one of:
-//  DATA_OK:    *out_mpi is set to a new image
-//  DATA_WAIT:  waiting for demuxer; will receive a wakeup signal
-//  DATA_EOF:   end of file, no more frames to be expected
-//  DATA_AGAIN: dropped frame or something similar
-int video_get_frame(struct dec_video *d_video, struct mp_image **out_mpi)
+static int get_frame(struct dec_video *d_video, struct mp_image **out_mpi)
 {
     *out_mpi = NULL;
     if (d_video->current_mpi) {
@@ -479,3 +646,118 @@ int video_get_frame(struct dec_video *d_video, struct mp_image **out_mpi)
         return DATA_AGAIN;
     return d_video->current_state;
 }
+
+static void *dec_thread(void *arg)
+{
+    struct dec_video *d_video = arg;
+    struct dec_queue *q = d_video->queue;
+    mpthread_set_name("vd");
+
+    pthread_mutex_lock(&q->lock);
+    while (!q->exit) {
+        bool stopped = q->state == DATA_WAIT || q->state == DATA_EOF;
+        if (q->num_frames >= q->max_frames || (stopped && !q->kick)) {
+            pthread_cond_wait(&q->wakeup, &q->lock);
+            continue;
+        }
+        q->kick = false;
+        d_video->start_pts = q->start_pts;
+        d_video->framedrop_enabled = q->framedrop_enabled;
+        q->busy = true;
+        pthread_mutex_unlock(&q->lock);
+
+        struct mp_image *mpi = NULL;
+        decode_next(d_video);
+        int res = get_frame(d_video, &mpi);
+
+        pthread_mutex_lock(&q->lock);
+        q->busy = false;
+        q->decode_time = d_video->decode_time;
+        q->dropped_frames = d_video->dropped_frames;
+        pthread_cond_broadcast(&q->wakeup);
+        int old_state = q->state;
+        q->state = res == DATA_OK ? DATA_AGAIN : res;
+        if (mpi)
+            MP_TARRAY_APPEND(q, q->frames, q->num_frames, mpi);
+        // Don't wake up the player for repeated EOF/WAIT results, or the
+        // player and this thread would wake up each other forever.
+        if ((mpi || (q->state != DATA_AGAIN && q->state != old_state)) &&
+            q->wakeup_cb)
+            q->wakeup_cb(q->wakeup_cb_ctx);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return NULL;
+}
+
+// Decode on a separate thread from now on, keeping up to max_frames decoded
+// frames queued. wakeup_cb is called (on the decoder thread) if
+// video_get_frame() may return a different result. Does nothing for cover art.
+void video_start_thread(struct dec_video *d_video, int max_frames,
+                        void (*wakeup_cb)(void *ctx), void *wakeup_cb_ctx)
+{
+    if (d_video->queue || d_video->header->attached_picture || max_frames < 1)
+        return;
+
+    struct dec_queue *q = talloc_zero(NULL, struct dec_queue);
+    *q = (struct dec_queue){
+        .state = DATA_AGAIN,
+        .start_pts = d_video->start_pts,
+        .framedrop_enabled = d_video->framedrop_enabled,
+        .max_frames = max_frames,
+        .wakeup_cb = wakeup_cb,
+        .wakeup_cb_ctx = wakeup_cb_ctx,
+    };
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->wakeup, NULL);
+    d_video->queue = q;
+
+    if (pthread_create(&q->thread, NULL, dec_thread, d_video)) {
+        MP_ERR(d_video, "Could not start decoder thread.\n");
+        pthread_cond_destroy(&q->wakeup);
+        pthread_mutex_destroy(&q->lock);
+        talloc_free(q);
+        d_video->queue = NULL;
+        return;
+    }
+    MP_VERBOSE(d_video, "Decoding on a separate thread.\n");
+}
+
+void video_work(struct dec_video *d_video)
+{
+    struct dec_queue *q = d_video->queue;
+    if (q) {
+        pthread_mutex_lock(&q->lock);
+        q->kick = true;
+        pthread_cond_broadcast(&q->wakeup);
+        pthread_mutex_unlock(&q->lock);
+        return;
+    }
+    decode_next(d_video);
+}
+
+// Fetch an image decoded with video_work(). Returns one of:
+//  DATA_OK:    *out_mpi is set to a new image
+//  DATA_WAIT:  waiting for demuxer; will receive a wakeup signal
+//  DATA_EOF:   end of file, no more frames to be expected
+//  DATA_AGAIN: dropped frame or something similar
+int video_get_frame(struct dec_video *d_video, struct mp_image **out_mpi)
+{
+    struct dec_queue *q = d_video->queue;
+    if (!q)
+        return get_frame(d_video, out_mpi);
+
+    *out_mpi = NULL;
+    pthread_mutex_lock(&q->lock);
+    int res = q->state == DATA_EOF ? DATA_EOF : DATA_WAIT;
+    if (q->num_frames) {
+        *out_mpi = q->frames[0];
+        MP_TARRAY_REMOVE_AT(q->frames, q->num_frames, 0);
+        pthread_cond_broadcast(&q->wakeup);
+        res = DATA_OK;
+    } else if (q->state == DATA_AGAIN || q->busy) {
+        // Still decoding; the wakeup callback will be called.
+        res = DATA_WAIT;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return res;
+}
@@ -33,6 +33,7 @@ struct dec_video {
     struct MPOpts *opts;
     const struct vd_functions *vd_driver;
     struct mp_hwdec_devices *hwdec_devs; // video output hwdec handles
+    struct vo *vo; // for direct rendering (optional)
     struct sh_stream *header;
     struct mp_codec_params *codec;
 
@@ -40,7 +41,7 @@ struct dec_video {
 
     float fps;            // FPS from demuxer or from user override
 
-    int dropped_frames;
+    int dropped_frames; // use video_get_dropped_frames()
 
     // Internal (shared with vd_lavc.c).
 
@@ -73,9 +74,18 @@ struct dec_video {
     struct demux_packet *new_segment;
     struct demux_packet *packet;
     bool framedrop_enabled;
+    // Smoothed wall time of a decode call with a packet, in seconds.
+    double decode_time;
+    // For mp_image.timing: when the last packet was read, since when the
+    // decoder is waiting for a packet, and the waiting time since the last
+    // decoded frame.
+    int64_t packet_time;
+    int64_t demux_wait_start;
+    int64_t demux_wait;
     struct mp_image *cover_art_mpi;
     struct mp_image *current_mpi;
     int current_state;
+    struct dec_queue *queue;
 };
 
 struct mp_decoder_list *video_decoder_list(void);
@@ -83,11 +93,16 @@ struct mp_decoder_list *video_decoder_list(void);
 bool video_init_best_codec(struct dec_video *d_video);
 void video_uninit(struct dec_video *d_video);
 
+void video_start_thread(struct dec_video *d_video, int max_frames,
+                        void (*wakeup_cb)(void *ctx), void *wakeup_cb_ctx);
 void video_work(struct dec_video *d_video);
 int video_get_frame(struct dec_video *d_video, struct mp_image **out_mpi);
 
 void video_set_framedrop(struct dec_video *d_video, bool enabled);
 void video_set_start(struct dec_video *d_video, double start_pts);
+double video_get_decode_time(struct dec_video *d_video);
+int video_get_dropped_frames(struct dec_video *d_video);
+void video_set_degrade(struct dec_video *d_video, int level);
 
 int video_vd_control(struct dec_video *d_video, int cmd, void *arg);
 void video_reset(struct dec_video *d_video);
@@ -47,6 +47,7 @@ struct priv {
 
     struct mp_image_pool        *decoder_pool;
     struct mp_image_pool        *sw_pool;
+    struct mp_thread_pool       *copy_pool;
     int                          mpfmt_decoded;
 };
 
@@ -139,7 +140,8 @@ static struct mp_image *dxva2_retrieve_image(struct lavc_ctx *s,
         talloc_free(sw_img);
         return img;
     }
-    copy_nv12(sw_img, lock.pBits, lock.Pitch, surface_desc.Height);
+    copy_nv12(sw_img, lock.pBits, lock.Pitch, surface_desc.Height,
+              p->copy_pool);
     IDirect3DSurface9_UnlockRect(surface);
 
     mp_image_set_size(sw_img, img->w, img->h);
@@ -437,6 +439,7 @@ static int dxva2_init(struct lavc_ctx *s)
     if (s->hwdec->type == HWDEC_DXVA2_COPY) {
         mp_check_gpu_memcpy(p->log, NULL);
         p->sw_pool = talloc_steal(p, mp_image_pool_new(17));
+        p->copy_pool = mp_image_create_copy_pool(p);
     }
 
     p->device = hwdec_devices_load(s->hwdec_devs, s->hwdec->type);
@@ -2,6 +2,7 @@
 #define MPV_LAVC_H
 
 #include <stdbool.h>
+#include <pthread.h>
 
 #include <libavcodec/avcodec.h>
 
@@ -20,11 +21,18 @@ typedef struct lavc_ctx {
     AVRational codec_timebase;
     enum AVPixelFormat pix_fmt;
     enum AVDiscard skip_frame;
+    enum AVDiscard skip_loop_filter;
     bool flushing;
     const char *decoder;
     bool hwdec_failed;
     bool hwdec_notified;
 
+    // Set by VDCTRL_SET_LOW_LATENCY; and the value the decoder was opened with.
+    bool low_latency;
+    bool thread_low_latency;
+    bool keyframes_only;
+    int degrade;            // set by VDCTRL_SET_DEGRADE
+
     // For HDR side-data caching
     double cached_hdr_peak;
 
@@ -34,6 +42,11 @@ typedef struct lavc_ctx {
 
     // From VO
     struct mp_hwdec_devices *hwdec_devs;
+    struct vo *vo;
+
+    // Direct rendering (get_buffer2_direct())
+    pthread_mutex_t dr_lock;
+    bool dr_failed;
 
     // For free use by hwdec implementation
     void *hwdec_priv;
@@ -35,6 +35,7 @@
 #include "video/mp_image_pool.h"
 #include "video/hwdec.h"
 #include "video/filter/vf.h"
+#include "options/options.h"
 
 /*
  * The VAAPI decoder can work only with surfaces passed to the decoder at
@@ -62,6 +63,7 @@ struct priv {
     struct vaapi_context va_context_storage;
 
     struct mp_image_pool *pool;
+    int pool_w, pool_h;
     int rt_format;
 
     struct mp_image_pool *sw_pool;
@@ -225,7 +227,12 @@ static void destroy_decoder(struct lavc_ctx *ctx)
 
     va_unlock(p->ctx);
 
-    mp_image_pool_clear(p->pool);
+    if (p->pool) {
+        int64_t max_bytes = ctx->opts->hwdec_surface_cache * (int64_t)(1024 * 1024);
+        va_surface_cache_put(p->ctx, p->pool, p->rt_format, p->pool_w,
+                             p->pool_h, max_bytes);
+        p->pool = NULL;
+    }
 }
 
 static bool has_profile(VAProfile *va_profiles, int num_profiles, VAProfile p)
@@ -279,6 +286,16 @@ static int init_decoder(struct lavc_ctx *ctx, int w, int h)
         goto error;
     }
 
+    p->pool = va_surface_cache_get(p->ctx, p->rt_format, w, h, MAX_SURFACES);
+    p->pool_w = w;
+    p->pool_h = h;
+
+    // A reused pool can contain more surfaces than needed. The decoder must
+    // know all of them, because allocate_image() can return any of them.
+    struct mp_image_pool_stats st = {0};
+    mp_image_pool_add_stats(p->pool, &st);
+    num_surfaces = MPMAX(num_surfaces, st.images);
+
     VASurfaceID surfaces[MAX_SURFACES];
     if (!preallocate_surfaces(ctx, num_surfaces, w, h, surfaces)) {
         MP_ERR(p, "Could not allocate surfaces.\n");
@@ -332,7 +349,8 @@ static struct mp_image *allocate_image(struct lavc_ctx *ctx, int w, int h)
 {
     struct priv *p = ctx->hwdec_priv;
 
-    struct mp_image *img = mp_image_pool_get(p->pool, IMGFMT_VAAPI, w, h);
+    struct mp_image *img =
+        p->pool ? mp_image_pool_get(p->pool, IMGFMT_VAAPI, w, h) : NULL;
     if (!img)
         MP_ERR(p, "Failed to allocate additional VAAPI surface.\n");
     return img;
@@ -387,9 +405,6 @@ static void uninit(struct lavc_ctx *ctx)
 
     destroy_decoder(ctx);
 
-    talloc_free(p->pool);
-    p->pool = NULL;
-
     if (p->native_display_fns)
         destroy_va_dummy_ctx(p);
 
@@ -417,8 +432,6 @@ static int init(struct lavc_ctx *ctx, bool direct)
     }
 
     p->display = p->ctx->display;
-    p->pool = talloc_steal(p, mp_image_pool_new(MAX_SURFACES));
-    va_pool_set_allocator(p->pool, p->ctx, p->rt_format);
     p->sw_pool = talloc_steal(p, mp_image_pool_new(17));
 
     p->va_context->display = p->display;
@@ -46,6 +46,10 @@ enum vd_ctrl {
     VDCTRL_GET_HWDEC,
     VDCTRL_REINIT,
     VDCTRL_GET_BFRAMES,
+    VDCTRL_SET_LOW_LATENCY, // int*: 1 if decoding delay should be minimized
+    VDCTRL_GET_THREAD_TYPE, // const char**: "frame", "slice" or "no"
+    VDCTRL_SET_KEYFRAMES_ONLY, // int*: 1 if only keyframes should be decoded
+    VDCTRL_SET_DEGRADE, // int*: 0-3, see video_set_degrade()
 };
 
 #endif /* MPLAYER_VD_H */
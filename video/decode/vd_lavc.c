@@ -20,6 +20,8 @@
 #include <assert.h>
 #include <time.h>
 #include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
 #include <sys/types.h>
 
 #include <libavutil/common.h>
@@ -46,6 +48,7 @@
 #include "demux/packet.h"
 #include "video/csputils.h"
 #include "video/sws_utils.h"
+#include "video/out/vo.h"
 
 #if HAVE_AVUTIL_MASTERING_METADATA
 #include <libavutil/mastering_display_metadata.h>
@@ -64,6 +67,7 @@ static void init_avctx(struct dec_video *vd, const char *decoder,
 static void uninit_avctx(struct dec_video *vd);
 
 static int get_buffer2_hwdec(AVCodecContext *avctx, AVFrame *pic, int flags);
+static int get_buffer2_direct(AVCodecContext *avctx, AVFrame *pic, int flags);
 static enum AVPixelFormat get_format_hwdec(struct AVCodecContext *avctx,
                                            const enum AVPixelFormat *pix_fmt);
 
@@ -77,10 +81,12 @@ struct vd_lavc_params {
     int skip_frame;
     int framedrop;
     int threads;
+    int thread_type;
     int bitexact;
     int check_hw_profile;
     int software_fallback;
     char **avopts;
+    int dr;
 };
 
 static const struct m_opt_choice_alternatives discard_names[] = {
@@ -105,11 +111,16 @@ const struct m_sub_options vd_lavc_conf = {
         OPT_DISCARD("skipframe", skip_frame, 0),
         OPT_DISCARD("framedrop", framedrop, 0),
         OPT_INT("threads", threads, M_OPT_MIN, .min = 0),
+        OPT_CHOICE("thread-type", thread_type, 0,
+                   ({"auto", 0},
+                    {"frame", FF_THREAD_FRAME},
+                    {"slice", FF_THREAD_SLICE})),
         OPT_FLAG("bitexact", bitexact, 0),
         OPT_FLAG("check-hw-profile", check_hw_profile, 0),
         OPT_CHOICE_OR_INT("software-fallback", software_fallback, 0, 1, INT_MAX,
                           ({"no", INT_MAX}, {"yes", 1})),
         OPT_KEYVALUELIST("o", avopts, 0),
+        OPT_FLAG("dr", dr, 0),
         {0}
     },
     .size = sizeof(struct vd_lavc_params),
@@ -133,6 +144,7 @@ extern const struct vd_lavc_hwdec mp_vd_lavc_dxva2;
 extern const struct vd_lavc_hwdec mp_vd_lavc_dxva2_copy;
 extern const struct vd_lavc_hwdec mp_vd_lavc_d3d11va;
 extern const struct vd_lavc_hwdec mp_vd_lavc_d3d11va_copy;
+extern const struct vd_lavc_hwdec mp_vd_lavc_cuda;
 
 #if HAVE_RPI
 static const struct vd_lavc_hwdec mp_vd_lavc_rpi = {
@@ -173,6 +185,9 @@ static const struct vd_lavc_hwdec *const hwdec_list[] = {
 #endif
 #if HAVE_ANDROID
     &mp_vd_lavc_mediacodec,
+#endif
+#if HAVE_CUDA_HWACCEL
+    &mp_vd_lavc_cuda,
 #endif
     NULL
 };
@@ -287,13 +302,68 @@ static bool hwdec_is_wrapper(struct vd_lavc_hwdec *hwdec, const char *decoder)
     return bstr_endswith0(bstr0(decoder), hwdec->lavc_suffix);
 }
 
+// Failed probes of the copy-back hwdecs. These create their own device for
+// probing (which can take tens of milliseconds), and don't depend on the VO,
+// so the result is the same for the lifetime of the process. Successful
+// probes are not cached, because some have side effects (like loading the
+// VO's device for sharing).
+#define MAX_PROBE_CACHE 32
+
+struct probe_cache_entry {
+    enum hwdec_type type;
+    char codec[32];
+    int result;
+};
+
+static pthread_mutex_t probe_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct probe_cache_entry probe_cache[MAX_PROBE_CACHE];
+static int num_probe_cache;
+
+static bool probe_cache_lookup(enum hwdec_type type, const char *codec, int *r)
+{
+    bool found = false;
+    pthread_mutex_lock(&probe_cache_lock);
+    for (int n = 0; n < num_probe_cache; n++) {
+        struct probe_cache_entry *e = &probe_cache[n];
+        if (e->type == type && strcmp(e->codec, codec) == 0) {
+            *r = e->result;
+            found = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&probe_cache_lock);
+    return found;
+}
+
+static void probe_cache_add(enum hwdec_type type, const char *codec, int r)
+{
+    if (strlen(codec) >= sizeof(probe_cache[0].codec))
+        return;
+    pthread_mutex_lock(&probe_cache_lock);
+    if (num_probe_cache < MAX_PROBE_CACHE) {
+        struct probe_cache_entry *e = &probe_cache[num_probe_cache++];
+        e->type = type;
+        snprintf(e->codec, sizeof(e->codec), "%s", codec);
+        e->result = r;
+    }
+    pthread_mutex_unlock(&probe_cache_lock);
+}
+
 static int hwdec_probe(struct dec_video *vd, struct vd_lavc_hwdec *hwdec,
                        const char *codec)
 {
     vd_ffmpeg_ctx *ctx = vd->priv;
     int r = 0;
-    if (hwdec->probe)
-        r = hwdec->probe(ctx, hwdec, codec);
+    if (hwdec->probe) {
+        bool cacheable = hwdec->copying && codec;
+        if (cacheable && probe_cache_lookup(hwdec->type, codec, &r)) {
+            MP_VERBOSE(vd, "Not available (cached probe result).\n");
+        } else {
+            r = hwdec->probe(ctx, hwdec, codec);
+            if (cacheable && r < 0)
+                probe_cache_add(hwdec->type, codec, r);
+        }
+    }
     if (r >= 0) {
         if (hwdec->lavc_suffix && !hwdec_find_decoder(codec, hwdec->lavc_suffix))
             return HWDEC_ERR_NO_CODEC;
@@ -333,7 +403,10 @@ static struct vd_lavc_hwdec *probe_hwdec(struct dec_video *vd, bool autoprobe,
 
 static void uninit(struct dec_video *vd)
 {
+    vd_ffmpeg_ctx *ctx = vd->priv;
+
     uninit_avctx(vd);
+    pthread_mutex_destroy(&ctx->dr_lock);
     talloc_free(vd->priv);
 }
 
@@ -420,6 +493,8 @@ static int init(struct dec_video *vd, const char *decoder)
     ctx->opts = vd->opts;
     ctx->decoder = talloc_strdup(ctx, decoder);
     ctx->hwdec_devs = vd->hwdec_devs;
+    ctx->vo = vd->vo;
+    pthread_mutex_init(&ctx->dr_lock, NULL);
 
     reinit(vd);
 
@@ -430,6 +505,25 @@ static int init(struct dec_video *vd, const char *decoder)
     return 1;
 }
 
+// Pick the libavcodec threading mode. Frame threading scales best, but adds
+// a delay of one frame per thread, which hurts interactive use (frame
+// stepping, backstepping) and low latency playback.
+static int select_thread_type(struct dec_video *vd, AVCodec *codec)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
+    struct vd_lavc_params *lavc_param = vd->opts->vd_lavc_params;
+
+    if (lavc_param->thread_type)
+        return lavc_param->thread_type;
+    if (!(codec->capabilities & CODEC_CAP_SLICE_THREADS))
+        return FF_THREAD_FRAME;
+    if (!(codec->capabilities & CODEC_CAP_FRAME_THREADS))
+        return FF_THREAD_SLICE;
+    if (ctx->low_latency || vd->opts->untimed)
+        return FF_THREAD_SLICE;
+    return FF_THREAD_FRAME | FF_THREAD_SLICE;
+}
+
 static void init_avctx(struct dec_video *vd, const char *decoder,
                        struct vd_lavc_hwdec *hwdec)
 {
@@ -486,6 +580,17 @@ static void init_avctx(struct dec_video *vd, const char *decoder,
         ctx->max_delay_queue = ctx->hwdec->delay_queue;
     } else {
         mp_set_avcodec_threads(vd->log, avctx, lavc_param->threads);
+        avctx->thread_type = select_thread_type(vd, lavc_codec);
+        ctx->thread_low_latency = ctx->low_latency;
+
+        if (lavc_param->dr && ctx->vo &&
+            (lavc_codec->capabilities & CODEC_CAP_DR1))
+        {
+            avctx->get_buffer2 = get_buffer2_direct;
+            // get_buffer2_direct() can be called from any decoder thread.
+            avctx->thread_safe_callbacks = 1;
+            ctx->dr_failed = false;
+        }
     }
 
     avctx->flags |= lavc_param->bitexact ? CODEC_FLAG_BITEXACT : 0;
@@ -502,6 +607,7 @@ static void init_avctx(struct dec_video *vd, const char *decoder,
 
     // Do this after the above avopt handling in case it changes values
     ctx->skip_frame = avctx->skip_frame;
+    ctx->skip_loop_filter = avctx->skip_loop_filter;
 
     avctx->codec_tag = c->codec_tag;
     avctx->coded_width  = c->disp_w;
@@ -524,6 +630,13 @@ static void init_avctx(struct dec_video *vd, const char *decoder,
     if (avcodec_open2(avctx, lavc_codec, NULL) < 0)
         goto error;
 
+    if (avctx->active_thread_type) {
+        MP_VERBOSE(vd, "Using %s threading with %d threads.\n",
+                   avctx->active_thread_type == FF_THREAD_FRAME ? "frame"
+                                                                : "slice",
+                   avctx->thread_count);
+    }
+
     return;
 
 error:
@@ -724,6 +837,65 @@ static int get_buffer2_hwdec(AVCodecContext *avctx, AVFrame *pic, int flags)
     return 0;
 }
 
+// Let the decoder write directly into memory allocated by the VO (such as a
+// mapped GL buffer), which avoids copying the frame on upload.
+static int get_buffer2_direct(AVCodecContext *avctx, AVFrame *pic, int flags)
+{
+    struct dec_video *vd = avctx->opaque;
+    vd_ffmpeg_ctx *ctx = vd->priv;
+
+    int imgfmt = pixfmt2imgfmt(pic->format);
+
+    pthread_mutex_lock(&ctx->dr_lock);
+    bool failed = ctx->dr_failed;
+    pthread_mutex_unlock(&ctx->dr_lock);
+
+    if (!imgfmt || failed)
+        goto fallback;
+
+    int w = pic->width;
+    int h = pic->height;
+    int linesize_align[AV_NUM_DATA_POINTERS] = {0};
+    avcodec_align_dimensions2(avctx, &w, &h, linesize_align);
+
+    // Different alignments are powers of 2, so the highest one satisfies all.
+    int stride_align = SWS_MIN_BYTE_ALIGN;
+    for (int n = 0; n < AV_NUM_DATA_POINTERS; n++)
+        stride_align = MPMAX(stride_align, linesize_align[n]);
+
+    struct voctrl_get_image args = {
+        .imgfmt = imgfmt,
+        .w = w,
+        .h = h,
+        .stride_align = stride_align,
+    };
+    if (vo_control(ctx->vo, VOCTRL_GET_IMAGE, &args) != VO_TRUE) {
+        // The VO doesn't support it at all; don't ask again.
+        pthread_mutex_lock(&ctx->dr_lock);
+        if (!ctx->dr_failed)
+            MP_VERBOSE(vd, "VO does not support direct rendering.\n");
+        ctx->dr_failed = true;
+        pthread_mutex_unlock(&ctx->dr_lock);
+        goto fallback;
+    }
+    struct mp_image *img = args.res;
+    if (!img)
+        goto fallback;
+
+    for (int n = 0; n < 4; n++) {
+        pic->data[n] = img->planes[n];
+        pic->linesize[n] = img->stride[n];
+        pic->buf[n] = img->bufs[n];
+        img->bufs[n] = NULL;
+    }
+    talloc_free(img);
+
+    return 0;
+
+fallback:
+    return avcodec_default_get_buffer2(avctx, pic, flags);
+}
+
 static struct mp_image *read_output(struct dec_video *vd)
 {
     vd_ffmpeg_ctx *ctx = vd->priv;
@@ -754,14 +926,26 @@ static void decode(struct dec_video *vd, struct demux_packet *packet,
     if (!avctx)
         return;
 
-    if (flags) {
+    if (ctx->keyframes_only) {
+        // seek preview while the user is scrubbing
+        avctx->skip_frame = AVDISCARD_NONKEY;
+    } else if (flags) {
         // hr-seek framedrop vs. normal framedrop
         avctx->skip_frame = flags == 2 ? AVDISCARD_NONREF : opts->framedrop;
     } else {
         // normal playback
         avctx->skip_frame = ctx->skip_frame;
+        if (ctx->degrade >= 3)
+            avctx->skip_frame = MPMAX(avctx->skip_frame, AVDISCARD_NONREF);
     }
 
+    int skip_loop_filter = ctx->skip_loop_filter;
+    if (ctx->degrade >= 1)
+        skip_loop_filter = MPMAX(skip_loop_filter, AVDISCARD_NONREF);
+    if (ctx->degrade >= 2)
+        skip_loop_filter = MPMAX(skip_loop_filter, AVDISCARD_ALL);
+    avctx->skip_loop_filter = skip_loop_filter;
+
     mp_set_av_packet(&pkt, packet, &ctx->codec_timebase);
     ctx->flushing |= !pkt.data;
 
@@ -889,7 +1073,38 @@ static int control(struct dec_video *vd, int cmd, void *arg)
     switch (cmd) {
     case VDCTRL_RESET:
         flush_all(vd);
+        // A reset is a good point to switch the threading mode, because all
+        // decoder state is discarded anyway.
+        if (ctx->avctx && !ctx->hwdec &&
+            ctx->thread_low_latency != ctx->low_latency &&
+            !vd->opts->vd_lavc_params->thread_type)
+        {
+            MP_VERBOSE(vd, "Reopening decoder to switch threading mode.\n");
+            uninit_avctx(vd);
+            init_avctx(vd, ctx->decoder, NULL);
+        }
+        return CONTROL_TRUE;
+    case VDCTRL_SET_LOW_LATENCY:
+        ctx->low_latency = *(int *)arg;
         return CONTROL_TRUE;
+    case VDCTRL_SET_KEYFRAMES_ONLY:
+        ctx->keyframes_only = *(int *)arg;
+        return CONTROL_TRUE;
+    case VDCTRL_SET_DEGRADE:
+        ctx->degrade = *(int *)arg;
+        return CONTROL_TRUE;
+    case VDCTRL_GET_THREAD_TYPE: {
+        AVCodecContext *avctx = ctx->avctx;
+        if (!avctx)
+            break;
+        const char *type = "no";
+        if (avctx->active_thread_type == FF_THREAD_FRAME)
+            type = "frame";
+        if (avctx->active_thread_type == FF_THREAD_SLICE)
+            type = "slice";
+        *(const char **)arg = type;
+        return CONTROL_TRUE;
+    }
     case VDCTRL_GET_BFRAMES: {
         AVCodecContext *avctx = ctx->avctx;
         if (!avctx)
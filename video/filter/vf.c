@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <libavutil/common.h>
 #include <libavutil/mem.h>
@@ -32,12 +33,17 @@
 #include "options/m_config.h"
 
 #include "options/options.h"
+#include "osdep/threads.h"
+#include "osdep/timer.h"
 
 #include "video/img_format.h"
 #include "video/mp_image.h"
 #include "video/mp_image_pool.h"
 #include "vf.h"
 
+// Default number of images each filter output pool keeps around.
+#define DEFAULT_POOL_FRAMES 16
+
 extern const vf_info_t vf_info_crop;
 extern const vf_info_t vf_info_expand;
 extern const vf_info_t vf_info_scale;
@@ -107,6 +113,7 @@ static const vf_info_t *const filter_list[] = {
 };
 
 static void vf_uninit_filter(vf_instance_t *vf);
+static int call_control(struct vf_instance *vf, int cmd, void *arg);
 
 static bool get_desc(struct m_obj_desc *dst, int index)
 {
@@ -137,7 +144,7 @@ int vf_control_any(struct vf_chain *c, int cmd, void *arg)
 {
     for (struct vf_instance *cur = c->first; cur; cur = cur->next) {
         if (cur->control) {
-            int r = cur->control(cur, cmd, arg);
+            int r = call_control(cur, cmd, arg);
             if (r != CONTROL_UNKNOWN)
                 return r;
         }
@@ -151,7 +158,7 @@ int vf_control_by_label(struct vf_chain *c,int cmd, void *arg, bstr label)
     struct vf_instance *cur = vf_find_by_label(c, label_str);
     talloc_free(label_str);
     if (cur) {
-        return cur->control ? cur->control(cur, cmd, arg) : CONTROL_NA;
+        return cur->control ? call_control(cur, cmd, arg) : CONTROL_NA;
     } else {
         return CONTROL_UNKNOWN;
     }
@@ -161,7 +168,7 @@ static void vf_control_all(struct vf_chain *c, int cmd, void *arg)
 {
     for (struct vf_instance *cur = c->first; cur; cur = cur->next) {
         if (cur->control)
-            cur->control(cur, cmd, arg);
+            call_control(cur, cmd, arg);
     }
 }
 
@@ -232,9 +239,19 @@ void vf_print_filter_chain(struct vf_chain *c, int msglevel,
         mp_snprintf_cat(b, sizeof(b), "%s", mp_image_params_to_str(&f->fmt_out));
         if (f->autoinserted)
             mp_snprintf_cat(b, sizeof(b), " [a]");
+        if (f->async)
+            mp_snprintf_cat(b, sizeof(b), " [thread]");
         if (f == vf)
             mp_snprintf_cat(b, sizeof(b), "   <---");
         mp_msg(c->log, msglevel, "%s\n", b);
+        struct vf_metrics m;
+        vf_get_metrics(f, &m);
+        if (m.calls && mp_msg_test(c->log, MSGL_V)) {
+            mp_msg(c->log, msglevel, "      in=%"PRId64" out=%"PRId64
+                   " queued=%d calls=%"PRId64" time=%"PRId64"ms"
+                   " peak=%"PRId64"us\n", m.frames_in, m.frames_out,
+                   f->num_out_queued, m.calls, m.time_us / 1000, m.peak_us);
+        }
     }
 }
 
@@ -252,7 +269,7 @@ static struct vf_instance *vf_open(struct vf_chain *c, const char *name,
         .log = mp_log_new(vf, c->log, name),
         .hwdec_devs = c->hwdec_devs,
         .query_format = vf_default_query_format,
-        .out_pool = talloc_steal(vf, mp_image_pool_new(16)),
+        .out_pool = talloc_steal(vf, mp_image_pool_new(DEFAULT_POOL_FRAMES)),
         .chain = c,
     };
     struct m_config *config = m_config_from_obj_desc(vf, vf->log, &desc);
@@ -344,20 +361,283 @@ int vf_append_filter_list(struct vf_chain *c, struct m_obj_settings *list)
     return 0;
 }
 
+// Number of frames queued before and after an async filter (each).
+#define ASYNC_QUEUE 2
+
+// State for running a filter's callbacks on a worker thread ("pipeline" mode).
+// Frames are passed through bounded queues; the filter chain logic on the
+// caller's thread sees the filter like a filter with needs_input set.
+struct vf_async {
+    struct vf_instance *vf;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    // Held while the filter callbacks run. Serializes control calls and
+    // out_pool access with the worker.
+    pthread_mutex_t filter_lock;
+
+    // Protected by lock.
+    struct mp_image **in;
+    int num_in;
+    bool in_eof;            // EOF queued after the frames in in[]
+    struct mp_image **out;
+    int num_out;
+    bool busy;              // worker is running the filter
+    bool failed;            // filter returned an error
+    bool terminate;
+};
+
+// With an async filter, vf->metrics is updated by the worker thread, and is
+// protected by the async lock.
+static void lock_metrics(struct vf_instance *vf)
+{
+    if (vf->async)
+        pthread_mutex_lock(&vf->async->lock);
+}
+
+static void unlock_metrics(struct vf_instance *vf)
+{
+    if (vf->async)
+        pthread_mutex_unlock(&vf->async->lock);
+}
+
+// Return a consistent copy of the filter's metrics.
+void vf_get_metrics(struct vf_instance *vf, struct vf_metrics *m)
+{
+    lock_metrics(vf);
+    *m = vf->metrics;
+    unlock_metrics(vf);
+}
+
+static void async_add_output(struct vf_async *a, struct mp_image *img)
+{
+    pthread_mutex_lock(&a->lock);
+    MP_TARRAY_APPEND(a, a->out, a->num_out, img);
+    a->vf->metrics.frames_out++;
+    pthread_mutex_unlock(&a->lock);
+}
+
+static int vf_do_filter_sync(struct vf_instance *vf, struct mp_image *img);
+
 // Used by filters to add a filtered frame to the output queue.
 // Ownership of img is transferred from caller to the filter chain.
 void vf_add_output_frame(struct vf_instance *vf, struct mp_image *img)
 {
     if (img) {
         vf_fix_img_params(img, &vf->fmt_out);
-        MP_TARRAY_APPEND(vf, vf->out_queued, vf->num_out_queued, img);
+        if (vf->async) {
+            async_add_output(vf->async, img);
+        } else {
+            MP_TARRAY_APPEND(vf, vf->out_queued, vf->num_out_queued, img);
+            vf->metrics.frames_out++;
+        }
+    }
+}
+
+static void account_call(struct vf_instance *vf, int64_t start)
+{
+    int64_t end = mp_time_us();
+    int64_t t = end - start;
+    MP_STATS(vf, "range-timed %"PRId64" %"PRId64" filter %s", start, end,
+             vf->info->name);
+    lock_metrics(vf);
+    vf->metrics.calls++;
+    vf->metrics.time_us += t;
+    vf->metrics.peak_us = MPMAX(vf->metrics.peak_us, t);
+    unlock_metrics(vf);
+}
+
+static void *async_thread(void *p)
+{
+    struct vf_async *a = p;
+    struct vf_instance *vf = a->vf;
+    mpthread_set_name("vf");
+
+    pthread_mutex_lock(&a->lock);
+    while (!a->terminate) {
+        if (!a->num_in && !a->in_eof) {
+            pthread_cond_wait(&a->wakeup, &a->lock);
+            continue;
+        }
+        struct mp_image *img = NULL;
+        if (a->num_in) {
+            img = a->in[0];
+            MP_TARRAY_REMOVE_AT(a->in, a->num_in, 0);
+        } else {
+            a->in_eof = false;
+        }
+        a->busy = true;
+        pthread_mutex_unlock(&a->lock);
+
+        pthread_mutex_lock(&a->filter_lock);
+        int r = vf_do_filter_sync(vf, img);
+        // Read all output the filter can produce with this input. (With the
+        // synchronous chain, this is spread over vf_has_output_frame() calls.)
+        while (r >= 0 && vf->filter_out) {
+            int64_t frames = vf->metrics.frames_out;
+            int64_t start = mp_time_us();
+            r = vf->filter_out(vf);
+            account_call(vf, start);
+            if (r < 0)
+                MP_ERR(vf, "Error filtering frame.\n");
+            if (frames == vf->metrics.frames_out)
+                break;
+        }
+        pthread_mutex_unlock(&a->filter_lock);
+
+        pthread_mutex_lock(&a->lock);
+        a->busy = false;
+        a->failed |= r < 0;
+        pthread_cond_broadcast(&a->wakeup);
+        pthread_mutex_unlock(&a->lock);
+
+        // Make the core recheck the filter chain.
+        if (vf->chain->wakeup_callback)
+            vf->chain->wakeup_callback(vf->chain->wakeup_callback_ctx);
+
+        pthread_mutex_lock(&a->lock);
+    }
+    pthread_mutex_unlock(&a->lock);
+    return NULL;
+}
+
+// Move frames output by the worker to the filter's normal output queue.
+static void async_locked_collect(struct vf_async *a)
+{
+    struct vf_instance *vf = a->vf;
+    for (int n = 0; n < a->num_out; n++)
+        MP_TARRAY_APPEND(vf, vf->out_queued, vf->num_out_queued, a->out[n]);
+    a->num_out = 0;
+}
+
+static bool async_locked_pending(struct vf_async *a)
+{
+    return a->busy || a->num_in || a->in_eof;
+}
+
+// Callers check async_needs_input() first, so this never blocks.
+static int async_filter(struct vf_async *a, struct mp_image *img)
+{
+    pthread_mutex_lock(&a->lock);
+    if (img) {
+        MP_TARRAY_APPEND(a, a->in, a->num_in, img);
+    } else {
+        a->in_eof = true;
+    }
+    pthread_cond_broadcast(&a->wakeup);
+    async_locked_collect(a);
+    int r = a->failed ? -1 : 0;
+    a->failed = false;
+    pthread_mutex_unlock(&a->lock);
+    return r;
+}
+
+// Pick up the output the worker has produced so far. Doesn't wait for the
+// worker; it calls the chain's wakeup callback when it has done something.
+static bool async_has_output_frame(struct vf_async *a)
+{
+    struct vf_instance *vf = a->vf;
+    pthread_mutex_lock(&a->lock);
+    async_locked_collect(a);
+    pthread_mutex_unlock(&a->lock);
+    return vf->num_out_queued > 0;
+}
+
+// Whether the filter has no output yet, but is working on it.
+static bool async_is_busy(struct vf_instance *vf)
+{
+    struct vf_async *a = vf->async;
+    if (!a || vf->num_out_queued)
+        return false;
+    pthread_mutex_lock(&a->lock);
+    async_locked_collect(a);
+    bool r = !vf->num_out_queued && async_locked_pending(a);
+    pthread_mutex_unlock(&a->lock);
+    return r;
+}
+
+static bool async_needs_input(struct vf_instance *vf)
+{
+    struct vf_async *a = vf->async;
+    pthread_mutex_lock(&a->lock);
+    async_locked_collect(a);
+    bool r = a->num_in + a->busy < ASYNC_QUEUE &&
+             vf->num_out_queued < ASYNC_QUEUE && !a->in_eof;
+    pthread_mutex_unlock(&a->lock);
+    return r;
+}
+
+// Drop all queued frames, and wait until the worker is idle.
+static void async_flush(struct vf_async *a)
+{
+    pthread_mutex_lock(&a->lock);
+    for (int n = 0; n < a->num_in; n++)
+        talloc_free(a->in[n]);
+    a->num_in = 0;
+    a->in_eof = false;
+    while (a->busy)
+        pthread_cond_wait(&a->wakeup, &a->lock);
+    for (int n = 0; n < a->num_out; n++)
+        talloc_free(a->out[n]);
+    a->num_out = 0;
+    a->failed = false;
+    pthread_mutex_unlock(&a->lock);
+}
+
+static void async_destroy(struct vf_instance *vf)
+{
+    struct vf_async *a = vf->async;
+    if (!a)
+        return;
+    async_flush(a);
+    pthread_mutex_lock(&a->lock);
+    a->terminate = true;
+    pthread_cond_broadcast(&a->wakeup);
+    pthread_mutex_unlock(&a->lock);
+    pthread_join(a->thread, NULL);
+    pthread_cond_destroy(&a->wakeup);
+    pthread_mutex_destroy(&a->lock);
+    pthread_mutex_destroy(&a->filter_lock);
+    talloc_free(a);
+    vf->async = NULL;
+}
+
+static void async_create(struct vf_instance *vf)
+{
+    struct vf_async *a = talloc_zero(NULL, struct vf_async);
+    a->vf = vf;
+    pthread_mutex_init(&a->lock, NULL);
+    pthread_cond_init(&a->wakeup, NULL);
+    pthread_mutex_init(&a->filter_lock, NULL);
+    if (pthread_create(&a->thread, NULL, async_thread, a)) {
+        pthread_cond_destroy(&a->wakeup);
+        pthread_mutex_destroy(&a->lock);
+        pthread_mutex_destroy(&a->filter_lock);
+        talloc_free(a);
+        return;
     }
+    vf->async = a;
+}
+
+static int call_control(struct vf_instance *vf, int cmd, void *arg)
+{
+    if (!vf->async)
+        return vf->control(vf, cmd, arg);
+    pthread_mutex_lock(&vf->async->filter_lock);
+    int r = vf->control(vf, cmd, arg);
+    pthread_mutex_unlock(&vf->async->filter_lock);
+    return r;
 }
 
 static bool vf_has_output_frame(struct vf_instance *vf)
 {
+    if (vf->async)
+        return async_has_output_frame(vf->async);
     if (!vf->num_out_queued && vf->filter_out) {
-        if (vf->filter_out(vf) < 0)
+        int64_t start = mp_time_us();
+        int r = vf->filter_out(vf);
+        account_call(vf, start);
+        if (r < 0)
             MP_ERR(vf, "Error filtering frame.\n");
     }
     return vf->num_out_queued > 0;
@@ -379,8 +659,23 @@ static int vf_do_filter(struct vf_instance *vf, struct mp_image *img)
     if (img)
         assert(mp_image_params_equal(&img->params, &vf->fmt_in));
 
+    if (vf->async)
+        return async_filter(vf->async, img);
+    return vf_do_filter_sync(vf, img);
+}
+
+static int vf_do_filter_sync(struct vf_instance *vf, struct mp_image *img)
+{
+    if (img) {
+        lock_metrics(vf);
+        vf->metrics.frames_in++;
+        unlock_metrics(vf);
+    }
+
+    int64_t start = mp_time_us();
     if (vf->filter_ext) {
         int r = vf->filter_ext(vf, img);
+        account_call(vf, start);
         if (r < 0)
             MP_ERR(vf, "Error filtering frame.\n");
         return r;
@@ -388,6 +683,7 @@ static int vf_do_filter(struct vf_instance *vf, struct mp_image *img)
         if (img) {
             if (vf->filter)
                 img = vf->filter(vf, img);
+            account_call(vf, start);
             vf_add_output_frame(vf, img);
         }
         return 0;
@@ -418,16 +714,21 @@ static int vf_output_frame_until(struct vf_chain *c, struct vf_instance *until,
         return -1;
     while (1) {
         struct vf_instance *last = NULL;
+        bool busy = false;
         for (struct vf_instance * cur = c->first; cur; cur = cur->next) {
             // Flush remaining frames on EOF, but do that only if the previous
-            // filters have been flushed (i.e. they have no more output).
-            if (eof && !last) {
+            // filters have been flushed (i.e. they have no more output, and
+            // are not working on any).
+            if (eof && !last && !busy) {
                 int r = vf_do_filter(cur, NULL);
                 if (r < 0)
                     return r;
             }
-            if (vf_has_output_frame(cur))
+            if (vf_has_output_frame(cur)) {
                 last = cur;
+            } else if (async_is_busy(cur)) {
+                busy = true;
+            }
             if (cur == until)
                 break;
         }
@@ -435,12 +736,27 @@ static int vf_output_frame_until(struct vf_chain *c, struct vf_instance *until,
             return 0;
         if (last == until)
             return 1;
+        // Don't wait for an async filter to make room; it wakes us up.
+        if (last->next->async && !async_needs_input(last->next))
+            return 0;
         int r = vf_do_filter(last->next, vf_dequeue_output_frame(last));
         if (r < 0)
             return r;
     }
 }
 
+// Whether a filter running on a separate thread is still working on frames,
+// while the chain has no output yet. The chain's wakeup callback is called
+// when it is done.
+bool vf_is_busy(struct vf_chain *c)
+{
+    for (struct vf_instance *cur = c->first; cur; cur = cur->next) {
+        if (async_is_busy(cur))
+            return true;
+    }
+    return false;
+}
+
 // Output the next queued image (if any) from the full filter chain.
 // The frame can be retrieved with vf_read_output_frame().
 //  eof: if set, assume there's no more input i.e. vf_filter_frame() will
@@ -478,7 +794,12 @@ int vf_needs_input(struct vf_chain *c)
 {
     struct vf_instance *prev = c->first;
     for (struct vf_instance *cur = c->first; cur; cur = cur->next) {
-        while (cur->needs_input && cur->needs_input(cur)) {
+        while (cur->async ? async_needs_input(cur)
+                          : cur->needs_input && cur->needs_input(cur))
+        {
+            // Don't block on a preceding async filter; it will wake us up.
+            if (async_is_busy(prev))
+                break;
             // Get frames from preceding filters, or if there are none,
             // request new frames from decoder.
             int r = vf_output_frame_until(c, prev, false);
@@ -508,6 +829,10 @@ static void vf_chain_forget_frames(struct vf_chain *c)
 
 void vf_seek_reset(struct vf_chain *c)
 {
+    for (struct vf_instance *cur = c->first; cur; cur = cur->next) {
+        if (cur->async)
+            async_flush(cur->async);
+    }
     vf_control_all(c, VFCTRL_SEEK_RESET, NULL);
     vf_chain_forget_frames(c);
 }
@@ -630,9 +955,21 @@ static int vf_reconfig_wrapper(struct vf_instance *vf,
     return r;
 }
 
+// Whether running the filter on its own thread is possible and useful.
+static bool can_run_async(struct vf_chain *c, struct vf_instance *vf)
+{
+    // Filters with needs_input (vf_vapoursynth) are already asynchronous, and
+    // filters on hardware surfaces usually just submit work to the GPU.
+    return vf != c->first && vf != c->last && !vf->needs_input &&
+           !IMGFMT_IS_HWACCEL(vf->fmt_in.imgfmt) &&
+           !IMGFMT_IS_HWACCEL(vf->fmt_out.imgfmt);
+}
+
 int vf_reconfig(struct vf_chain *c, const struct mp_image_params *params)
 {
     int r = 0;
+    for (struct vf_instance *vf = c->first; vf; vf = vf->next)
+        async_destroy(vf);
     vf_seek_reset(c);
     for (struct vf_instance *vf = c->first; vf; ) {
         struct vf_instance *next = vf->next;
@@ -657,6 +994,13 @@ int vf_reconfig(struct vf_chain *c, const struct mp_image_params *params)
     }
     c->output_params = cur;
     c->initialized = r < 0 ? -1 : 1;
+    int pool_frames = c->pool_frames > 0 ? c->pool_frames : DEFAULT_POOL_FRAMES;
+    for (struct vf_instance *vf = c->first; vf; vf = vf->next) {
+        if (vf->out_pool)
+            mp_image_pool_set_max_count(vf->out_pool, pool_frames);
+        if (r >= 0 && c->opts->vf_pipeline && can_run_async(c, vf))
+            async_create(vf);
+    }
     int loglevel = r < 0 ? MSGL_WARN : MSGL_V;
     if (r == -2)
         MP_ERR(c, "Image formats incompatible or invalid.\n");
@@ -667,6 +1011,37 @@ int vf_reconfig(struct vf_chain *c, const struct mp_image_params *params)
     return r;
 }
 
+// Sum up the out_pool stats of all filters.
+void vf_get_pool_stats(struct vf_chain *c, struct mp_image_pool_stats *st)
+{
+    *st = (struct mp_image_pool_stats){0};
+    for (struct vf_instance *vf = c->first; vf; vf = vf->next) {
+        if (!vf->out_pool)
+            continue;
+        // The worker thread may allocate from the pool.
+        if (vf->async)
+            pthread_mutex_lock(&vf->async->filter_lock);
+        mp_image_pool_add_stats(vf->out_pool, st);
+        if (vf->async)
+            pthread_mutex_unlock(&vf->async->filter_lock);
+    }
+}
+
+// Change the maximum frame count of all filter out_pools (used to apply
+// --memory-budget). vf_reconfig() resets it to vf_chain.pool_frames.
+void vf_set_pool_frames(struct vf_chain *c, int frames)
+{
+    for (struct vf_instance *vf = c->first; vf; vf = vf->next) {
+        if (!vf->out_pool)
+            continue;
+        if (vf->async)
+            pthread_mutex_lock(&vf->async->filter_lock);
+        mp_image_pool_set_max_count(vf->out_pool, frames);
+        if (vf->async)
+            pthread_mutex_unlock(&vf->async->filter_lock);
+    }
+}
+
 struct vf_instance *vf_find_by_label(struct vf_chain *c, const char *label)
 {
     struct vf_instance *vf = c->first;
@@ -680,6 +1055,7 @@ struct vf_instance *vf_find_by_label(struct vf_chain *c, const char *label)
 
 static void vf_uninit_filter(vf_instance_t *vf)
 {
+    async_destroy(vf);
     if (vf->uninit)
         vf->uninit(vf);
     vf_forget_frames(vf);
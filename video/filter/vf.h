@@ -40,6 +40,15 @@ typedef struct vf_info {
     bool (*test_conversion)(int in, int out);
 } vf_info_t;
 
+// Per-filter accounting, updated by vf.c.
+struct vf_metrics {
+    int64_t calls;          // number of filter callback invocations
+    int64_t frames_in;
+    int64_t frames_out;
+    int64_t time_us;        // total time spent in the filter callbacks
+    int64_t peak_us;        // longest single callback invocation
+};
+
 typedef struct vf_instance {
     const vf_info_t *info;
 
@@ -98,6 +107,11 @@ typedef struct vf_instance {
     struct mp_image **out_queued;
     int num_out_queued;
 
+    struct vf_metrics metrics; // read with vf_get_metrics()
+
+    // If set, the filter callbacks run on a separate thread (internal).
+    struct vf_async *async;
+
     // Caches valid output formats.
     uint8_t last_outfmts[IMGFMT_END - IMGFMT_START];
 
@@ -118,6 +132,16 @@ struct vf_chain {
     double container_fps;
     double display_fps;
 
+    // Maximum number of images each filter's out_pool keeps (0: default).
+    int pool_frames;
+
+    // VO_CAP_* flags of the video output. Filters can use this to leave
+    // processing to the VO (only if they are the last filter).
+    int vo_caps;
+
+    // AVHWFramesContext of the input frames, if known (not owned).
+    struct AVBufferRef *in_hwframes_ref;
+
     struct mp_log *log;
     struct MPOpts *opts;
     struct mpv_global *global;
@@ -156,6 +180,7 @@ int vf_control_by_label(struct vf_chain *c, int cmd, void *arg, bstr label);
 int vf_filter_frame(struct vf_chain *c, struct mp_image *img);
 int vf_output_frame(struct vf_chain *c, bool eof);
 int vf_needs_input(struct vf_chain *c);
+bool vf_is_busy(struct vf_chain *c);
 struct mp_image *vf_read_output_frame(struct vf_chain *c);
 void vf_unread_output_frame(struct vf_chain *c, struct mp_image *img);
 void vf_seek_reset(struct vf_chain *c);
@@ -164,10 +189,14 @@ struct vf_instance *vf_append_filter(struct vf_chain *c, const char *name,
 void vf_remove_filter(struct vf_chain *c, struct vf_instance *vf);
 int vf_append_filter_list(struct vf_chain *c, struct m_obj_settings *list);
 struct vf_instance *vf_find_by_label(struct vf_chain *c, const char *label);
+void vf_get_metrics(struct vf_instance *vf, struct vf_metrics *m);
 void vf_print_filter_chain(struct vf_chain *c, int msglevel,
                            struct vf_instance *vf);
 
 int vf_send_command(struct vf_chain *c, char *label, char *cmd, char *arg);
+struct mp_image_pool_stats;
+void vf_get_pool_stats(struct vf_chain *c, struct mp_image_pool_stats *st);
+void vf_set_pool_frames(struct vf_chain *c, int frames);
 
 // Filter internal API
 struct mp_image *vf_alloc_out_image(struct vf_instance *vf);
@@ -380,9 +380,6 @@ static int reconfig(struct vf_instance *vf, struct mp_image_params *in,
     struct vf_priv_s *p = vf->priv;
 
     flush_frames(vf);
-    talloc_free(p->pool);
-    p->pool = NULL;
-
     destroy_video_proc(vf);
 
     *out = *in;
@@ -409,10 +406,6 @@ static int reconfig(struct vf_instance *vf, struct mp_image_params *in,
     p->params = *in;
     p->out_params = *out;
 
-    p->pool = mp_image_pool_new(20);
-    mp_image_pool_set_allocator(p->pool, alloc_pool, vf);
-    mp_image_pool_set_lru(p->pool);
-
     return 0;
 }
 
@@ -499,6 +492,12 @@ static int vf_open(vf_instance_t *vf)
 
     ID3D11Device_AddRef(p->vo_dev);
 
+    // Kept across reconfigs, so toggling deinterlacing doesn't reallocate
+    // all textures. The pool drops textures of the old size when full.
+    p->pool = mp_image_pool_new(20);
+    mp_image_pool_set_allocator(p->pool, alloc_pool, vf);
+    mp_image_pool_set_lru(p->pool);
+
     HRESULT hr;
 
     hr = ID3D11Device_QueryInterface(p->vo_dev, &IID_ID3D11VideoDevice,
@@ -69,10 +69,6 @@ typedef struct vf_priv_s {
   double        ggamma;
   double        bgamma;
 
-  unsigned      buf_w[3];
-  unsigned      buf_h[3];
-  unsigned char *buf[3];
-
   int gamma_i, contrast_i, brightness_i, saturation_i;
 
   double   par[8];
@@ -175,10 +171,7 @@ void apply_lut (eq2_param_t *par, unsigned char *dst, unsigned char *src,
 
 static struct mp_image *filter(struct vf_instance *vf, struct mp_image *src)
 {
-  vf_eq2_t      *eq2;
-  unsigned long img_n,img_c;
-
-  eq2 = vf->priv;
+  vf_eq2_t *eq2 = vf->priv;
 
   bool skip = true;
   for (int i = 0; i < 3; i++)
@@ -187,41 +180,36 @@ static struct mp_image *filter(struct vf_instance *vf, struct mp_image *src)
   if (skip)
       return src;
 
-  if ((eq2->buf_w[0] != src->w) || (eq2->buf_h[0] != src->h)) {
-    eq2->buf_w[0] = src->w;
-    eq2->buf_h[0] = src->h;
-      eq2->buf_w[1] = eq2->buf_w[2] = src->w >> src->fmt.chroma_xs;
-      eq2->buf_h[1] = eq2->buf_h[2] = src->h >> src->fmt.chroma_ys;
-    img_n = eq2->buf_w[0]*eq2->buf_h[0];
-    if(src->num_planes>1){
-      img_c = eq2->buf_w[1]*eq2->buf_h[1];
-      eq2->buf[0] = realloc (eq2->buf[0], img_n + 2*img_c);
-      eq2->buf[1] = eq2->buf[0] + img_n;
-      eq2->buf[2] = eq2->buf[1] + img_c;
-    } else
-      eq2->buf[0] = realloc (eq2->buf[0], img_n);
+  // If nothing else references the frame (e.g. the decoder dropped its
+  // reference already), apply the LUTs in place. Otherwise write the result
+  // directly to a new image, instead of making a writeable copy first.
+  struct mp_image *dst = src;
+  if (!mp_image_is_writeable(src)) {
+    dst = vf_alloc_out_image(vf);
+    if (!dst) {
+      talloc_free(src);
+      return NULL;
+    }
+    mp_image_copy_attributes(dst, src);
   }
 
-  struct mp_image dst = *src;
-
   for (int i = 0; i < ((src->num_planes>1)?3:1); i++) {
+    int w = mp_image_plane_w(src, i);
+    int h = mp_image_plane_h(src, i);
     if (eq2->param[i].adjust != NULL) {
-      dst.planes[i] = eq2->buf[i];
-      dst.stride[i] = eq2->buf_w[i];
-
-      eq2->param[i].adjust (&eq2->param[i], dst.planes[i], src->planes[i],
-        eq2->buf_w[i], eq2->buf_h[i], dst.stride[i], src->stride[i]);
+      eq2->param[i].adjust (&eq2->param[i], dst->planes[i], src->planes[i],
+        w, h, dst->stride[i], src->stride[i]);
+    } else if (dst != src) {
+      for (int y = 0; y < h; y++) {
+        memcpy(dst->planes[i] + y * (ptrdiff_t)dst->stride[i],
+               src->planes[i] + y * (ptrdiff_t)src->stride[i], w);
+      }
     }
   }
 
-  struct mp_image *new = vf_alloc_out_image(vf);
-  if (new) {
-    mp_image_copy(new, &dst);
-    mp_image_copy_attributes(new, &dst);
-  }
-
-  talloc_free(src);
-  return new;
+  if (dst != src)
+    talloc_free(src);
+  return dst;
 }
 
 static
@@ -375,14 +363,6 @@ int query_format (vf_instance_t *vf, unsigned fmt)
   return 0;
 }
 
-static
-void uninit (vf_instance_t *vf)
-{
-  if (vf->priv != NULL) {
-    free (vf->priv->buf[0]);
-  }
-}
-
 static
 int vf_open(vf_instance_t *vf)
 {
@@ -393,16 +373,11 @@ int vf_open(vf_instance_t *vf)
   vf->control = control;
   vf->query_format = query_format;
   vf->filter = filter;
-  vf->uninit = uninit;
 
   eq2 = vf->priv;
   eq2->log = vf->log;
 
   for (i = 0; i < 3; i++) {
-    eq2->buf[i] = NULL;
-    eq2->buf_w[i] = 0;
-    eq2->buf_h[i] = 0;
-
     eq2->param[i].adjust = NULL;
     eq2->param[i].c = 1.0;
     eq2->param[i].b = 0.0;
@@ -25,6 +25,8 @@
 #include <stdarg.h>
 #include <assert.h>
 
+#include "config.h"
+
 #include <libavutil/avstring.h>
 #include <libavutil/mem.h>
 #include <libavutil/mathematics.h>
@@ -38,7 +40,10 @@
 #include <libavfilter/buffersink.h>
 #include <libavfilter/buffersrc.h>
 
-#include "config.h"
+#if HAVE_AVFILTER_HWFRAMES
+#include <libavutil/hwcontext.h>
+#endif
+
 #include "common/av_common.h"
 #include "common/msg.h"
 #include "options/m_option.h"
@@ -84,6 +89,7 @@ struct vf_priv_s {
     char *cfg_graph;
     int64_t cfg_sws_flags;
     char **cfg_avopts;
+    int cfg_threads;
 };
 
 static const struct vf_priv_s vf_priv_dflt = {
@@ -104,6 +110,26 @@ static void destroy_graph(struct vf_instance *vf)
     p->eof = false;
 }
 
+// Return the frames context the input frames use, if the input is hardware
+// surfaces and the context is known.
+static struct AVBufferRef *get_in_hwframes(struct vf_instance *vf,
+                                           struct mp_image_params *fmt)
+{
+#if HAVE_AVFILTER_HWFRAMES
+    struct AVBufferRef *ref = vf->chain->in_hwframes_ref;
+    if (!IMGFMT_IS_HWACCEL(fmt->imgfmt) || !ref)
+        return NULL;
+    // Only valid if no filter before us changed the format.
+    AVHWFramesContext *fctx = (void *)ref->data;
+    if (fctx->format != imgfmt2pixfmt(fmt->imgfmt) ||
+        fctx->width < fmt->w || fctx->height < fmt->h)
+        return NULL;
+    return ref;
+#else
+    return NULL;
+#endif
+}
+
 static bool recreate_graph(struct vf_instance *vf, struct mp_image_params *fmt)
 {
     void *tmp = talloc_new(NULL);
@@ -122,6 +148,9 @@ static bool recreate_graph(struct vf_instance *vf, struct mp_image_params *fmt)
     if (!graph)
         goto error;
 
+    // Must be set before any filter is created. (0 lets libavfilter pick.)
+    graph->nb_threads = p->cfg_threads;
+
     if (mp_set_avopts(vf->log, graph, p->cfg_avopts) < 0)
         goto error;
 
@@ -157,6 +186,25 @@ static bool recreate_graph(struct vf_instance *vf, struct mp_image_params *fmt)
                                      "src", src_args, NULL, graph) < 0)
         goto error;
 
+    struct AVBufferRef *hw_frames = get_in_hwframes(vf, fmt);
+    if (IMGFMT_IS_HWACCEL(fmt->imgfmt) && !hw_frames) {
+        MP_FATAL(vf, "lavfi: hardware frames context of input not known.\n");
+        goto error;
+    }
+#if HAVE_AVFILTER_HWFRAMES
+    if (hw_frames) {
+        // Pass the surfaces through; lets GPU filters work on them directly.
+        AVBufferSrcParameters *par = av_buffersrc_parameters_alloc();
+        if (!par)
+            goto error;
+        par->hw_frames_ctx = hw_frames; // referenced by the call below
+        int r = av_buffersrc_parameters_set(in, par);
+        av_free(par);
+        if (r < 0)
+            goto error;
+    }
+#endif
+
     if (avfilter_graph_create_filter(&out, avfilter_get_by_name("buffersink"),
                                      "out", NULL, NULL, graph) < 0)
         goto error;
@@ -233,6 +281,13 @@ static int reconfig(struct vf_instance *vf, struct mp_image_params *in,
     out->p_w = l_out->sample_aspect_ratio.num;
     out->p_h = l_out->sample_aspect_ratio.den;
     out->imgfmt = pixfmt2imgfmt(l_out->format);
+    out->hw_subfmt = 0;
+#if HAVE_AVFILTER_HWFRAMES
+    if (IMGFMT_IS_HWACCEL(out->imgfmt) && l_out->hw_frames_ctx) {
+        AVHWFramesContext *fctx = (void *)l_out->hw_frames_ctx->data;
+        out->hw_subfmt = pixfmt2imgfmt(fctx->sw_format);
+    }
+#endif
     return 0;
 }
 
@@ -243,6 +298,10 @@ static int query_format(struct vf_instance *vf, unsigned int fmt)
     // allow us to do anything more sophisticated.
     // This breaks with filters which accept input pixel formats not
     // supported by libswscale.
+    // Hardware surfaces are passed through to the graph as they are (only for
+    // explicit lavfi graphs; the wrapped mpv filters are software filters).
+    if (HAVE_AVFILTER_HWFRAMES && IMGFMT_IS_HWACCEL(fmt) && !vf->priv->old_priv)
+        return imgfmt2pixfmt(fmt) != AV_PIX_FMT_NONE;
     return !!mp_sws_supported_format(fmt);
 }
 
@@ -435,6 +494,7 @@ const vf_info_t vf_info_lavfi = {
 struct vf_lw_opts {
     int64_t sws_flags;
     char **avopts;
+    int threads;
 };
 
 #undef OPT_BASE_STRUCT
@@ -443,6 +503,7 @@ const struct m_sub_options vf_lw_conf = {
     .opts = (const m_option_t[]) {
         OPT_INT64("lavfi-sws-flags", sws_flags, 0),
         OPT_KEYVALUELIST("lavfi-o", avopts, 0),
+        OPT_CHOICE_OR_INT("lavfi-threads", threads, 0, 1, 64, ({"auto", 0})),
         {0}
     },
     .defaults = &(const struct vf_lw_opts){
@@ -480,6 +541,7 @@ int vf_lw_set_graph(struct vf_instance *vf, struct vf_lw_opts *lavfi_opts,
     *p = vf_priv_dflt;
     p->cfg_sws_flags = lavfi_opts->sws_flags;
     p->cfg_avopts = lavfi_opts->avopts;
+    p->cfg_threads = lavfi_opts->threads;
     va_list ap;
     va_start(ap, opts);
     char *s = talloc_vasprintf(vf, opts, ap);
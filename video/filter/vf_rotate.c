@@ -24,6 +24,8 @@
 #include "common/msg.h"
 #include "options/m_option.h"
 
+#include "video/out/vo.h"
+#include "video/sws_utils.h"
 #include "vf.h"
 #include "vf_lavfi.h"
 
@@ -63,7 +65,7 @@ static int lavfi_reconfig(struct vf_instance *vf,
     return 0;
 }
 
-static int vf_open(vf_instance_t *vf)
+static int lavfi_open(struct vf_instance *vf)
 {
     struct vf_priv_s *p = vf->priv;
 
@@ -75,6 +77,58 @@ static int vf_open(vf_instance_t *vf)
     return 0;
 }
 
+// The VO can rotate in 90 degree steps, so the filter can just set
+// mp_image_params.rotate, and pass the frames through untouched. This works
+// only if no other filter follows, because these would see the unrotated
+// image.
+static bool can_use_vo(struct vf_instance *vf)
+{
+    return (vf->chain->vo_caps & VO_CAP_ROTATE90) &&
+           vf->next == vf->chain->last;
+}
+
+static int reconfig(struct vf_instance *vf, struct mp_image_params *in,
+                    struct mp_image_params *out)
+{
+    struct vf_priv_s *p = vf->priv;
+
+    int angle = p->angle == 4 ? 0 : p->angle * 90;
+    if (can_use_vo(vf) && in->rotate % 90 == 0) {
+        *out = *in;
+        out->rotate = (in->rotate + angle) % 360;
+        return 0;
+    }
+
+    // Fall back to rotating the image data. This replaces the filter with
+    // the libavfilter wrapper for good.
+    if (IMGFMT_IS_HWACCEL(in->imgfmt)) {
+        MP_ERR(vf, "Can't rotate hardware decoded video here.\n");
+        return -1;
+    }
+    if (!lavfi_open(vf))
+        return -1;
+    return vf->reconfig(vf, in, out);
+}
+
+static int query_format(struct vf_instance *vf, unsigned int fmt)
+{
+    if (!can_use_vo(vf) && !mp_sws_supported_format(fmt))
+        return 0;
+    return vf_next_query_format(vf, fmt);
+}
+
+static int vf_open(vf_instance_t *vf)
+{
+    if (vf->chain->vo_caps & VO_CAP_ROTATE90) {
+        // Decide in reconfig(), when the position in the chain is known.
+        vf->reconfig = reconfig;
+        vf->query_format = query_format;
+        return 1;
+    }
+
+    return lavfi_open(vf);
+}
+
 #define OPT_BASE_STRUCT struct vf_priv_s
 const vf_info_t vf_info_rotate = {
     .description = "rotate",
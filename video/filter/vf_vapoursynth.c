@@ -65,6 +65,8 @@ struct vf_priv_s {
     struct mp_image *next_image;// used to compute frame duration of oldest image
     struct mp_image **buffered; // oldest image first
     int num_buffered;
+    struct mp_image **pending;  // input not yet fitting into buffered[]
+    int num_pending;
     int in_frameno;             // frame number of buffered[0] (the oldest)
     int out_frameno;            // frame number of first requested/ready frame
     double out_pts;             // pts corresponding to first requested/ready frame
@@ -266,6 +268,23 @@ static bool locked_need_input(struct vf_instance *vf)
     return p->num_buffered < MP_TALLOC_AVAIL(p->buffered);
 }
 
+// Move pending input frames to buffered[], as far as there is space. This is
+// also called on VS threads, so that VS doesn't have to wait for the playloop.
+static void locked_feed_pending(struct vf_instance *vf)
+{
+    struct vf_priv_s *p = vf->priv;
+    bool fed = false;
+    while (p->num_pending && locked_need_input(vf)) {
+        p->frames_sent++;
+        p->buffered[p->num_buffered++] =
+            talloc_steal(p->buffered, p->pending[0]);
+        MP_TARRAY_REMOVE_AT(p->pending, p->num_pending, 0);
+        fed = true;
+    }
+    if (fed)
+        pthread_cond_broadcast(&p->wakeup);
+}
+
 // Return true if progress was made.
 static bool locked_read_output(struct vf_instance *vf)
 {
@@ -328,28 +347,25 @@ static int filter_ext(struct vf_instance *vf, struct mp_image *mpi)
         mpi->pts = p->next_image ? p->next_image->pts - mpi->pts : 0;
     }
 
-    // Try to get new frames until we get rid of the input mpi.
     pthread_mutex_lock(&p->lock);
+    if (mpi)
+        MP_TARRAY_APPEND(p, p->pending, p->num_pending, talloc_steal(p, mpi));
+    // Queue the input without waiting for VS, unless too much is pending (or
+    // all input has to be sent on EOF).
     while (1) {
         // Not sure what we do on errors, but at least don't deadlock.
         if (p->failed) {
             p->failed = false;
-            talloc_free(mpi);
             ret = -1;
             break;
         }
 
-        // Make the input frame available to infiltGetFrame().
-        if (mpi && locked_need_input(vf)) {
-            p->frames_sent++;
-            p->buffered[p->num_buffered++] = talloc_steal(p->buffered, mpi);
-            mpi = NULL;
-            pthread_cond_broadcast(&p->wakeup);
-        }
+        // Make input frames available to infiltGetFrame().
+        locked_feed_pending(vf);
 
         locked_read_output(vf);
 
-        if (!mpi) {
+        if (p->num_pending <= (eof ? 0 : p->max_requests)) {
             if (eof && p->frames_sent && !p->eof) {
                 MP_VERBOSE(vf, "input EOF\n");
                 p->eof = true;
@@ -374,11 +390,12 @@ static int filter_out(struct vf_instance *vf)
             ret = -1;
             break;
         }
+        locked_feed_pending(vf);
         if (locked_read_output(vf))
             break;
         // If the VS filter wants new input, there's no guarantee that we can
         // actually finish any time soon without feeding new input.
-        if (!p->eof && locked_need_input(vf))
+        if (!p->eof && !p->num_pending && locked_need_input(vf))
             break;
         pthread_cond_wait(&p->wakeup, &p->lock);
     }
@@ -391,8 +408,10 @@ static bool needs_input(struct vf_instance *vf)
     struct vf_priv_s *p = vf->priv;
     bool r = false;
     pthread_mutex_lock(&p->lock);
+    locked_feed_pending(vf);
     locked_read_output(vf);
-    r = vf->num_out_queued < p->max_requests && locked_need_input(vf);
+    r = vf->num_out_queued < p->max_requests && !p->num_pending &&
+        locked_need_input(vf);
     pthread_mutex_unlock(&p->lock);
     return r;
 }
@@ -471,6 +490,7 @@ static const VSFrameRef *VS_CC infiltGetFrame(int frameno, int activationReason,
             // queue new frames.
             if (p->num_buffered) {
                 drain_oldest_buffered_frame(p);
+                locked_feed_pending(vf);
                 pthread_cond_broadcast(&p->wakeup);
                 if (vf->chain->wakeup_callback)
                     vf->chain->wakeup_callback(vf->chain->wakeup_callback_ctx);
@@ -565,6 +585,9 @@ static void destroy_vs(struct vf_instance *vf)
     for (int n = 0; n < p->num_buffered; n++)
         talloc_free(p->buffered[n]);
     p->num_buffered = 0;
+    for (int n = 0; n < p->num_pending; n++)
+        talloc_free(p->pending[n]);
+    p->num_pending = 0;
     talloc_free(p->next_image);
     p->next_image = NULL;
     p->out_pts = MP_NOPTS_VALUE;
@@ -574,6 +597,33 @@ static void destroy_vs(struct vf_instance *vf)
     MP_DBG(vf, "uninitialized.\n");
 }
 
+// Size the request window (and the input buffer, which depends on it). With
+// concurrent-frames=auto, use as many frames as the VS core has threads, so
+// that heavy scripts can keep the VS thread pool busy.
+static void update_window(struct vf_instance *vf)
+{
+    struct vf_priv_s *p = vf->priv;
+    int num = p->cfg_maxrequests;
+    if (num < 0) {
+        const VSCoreInfo *info = p->vsapi->getCoreInfo(p->vscore);
+        num = info && info->numThreads > 0 ? info->numThreads : av_cpu_count();
+    }
+    num = MPMAX(num, 1);
+
+    pthread_mutex_lock(&p->lock);
+    // No requests or buffered frames exist at this point.
+    assert(!num_requested(p) && !p->num_buffered);
+    if (num != p->max_requests) {
+        talloc_free(p->requested);
+        talloc_free(p->buffered);
+        p->max_requests = num;
+        p->requested = talloc_zero_array(vf, struct mp_image *, num);
+        p->buffered = talloc_array(vf, struct mp_image *, p->cfg_maxbuffer * num);
+    }
+    pthread_mutex_unlock(&p->lock);
+    MP_VERBOSE(vf, "using %d concurrent requests.\n", p->max_requests);
+}
+
 static int reinit_vs(struct vf_instance *vf)
 {
     struct vf_priv_s *p = vf->priv;
@@ -629,6 +679,9 @@ static int reinit_vs(struct vf_instance *vf)
         goto error;
     }
 
+    // The script may have changed core.num_threads.
+    update_window(vf);
+
     pthread_mutex_lock(&p->lock);
     p->initializing = false;
     pthread_mutex_unlock(&p->lock);
@@ -724,10 +777,10 @@ static int vf_open(vf_instance_t *vf)
     vf->query_format = query_format;
     vf->control = control;
     vf->uninit = uninit;
+    // Initial guess; the actual value is determined by update_window().
     p->max_requests = p->cfg_maxrequests;
     if (p->max_requests < 0)
         p->max_requests = av_cpu_count();
-    MP_VERBOSE(vf, "using %d concurrent requests.\n", p->max_requests);
     int maxbuffer = p->cfg_maxbuffer * p->max_requests;
     p->buffered = talloc_array(vf, struct mp_image *, maxbuffer);
     p->requested = talloc_zero_array(vf, struct mp_image *, p->max_requests);
@@ -304,15 +304,9 @@ static int reconfig(struct vf_instance *vf, struct mp_image_params *in,
     struct vf_priv_s *p = vf->priv;
 
     flush_frames(vf);
-    talloc_free(p->pool);
-    p->pool = NULL;
 
     p->params = *in;
 
-    p->current_rt_format = VA_RT_FORMAT_YUV420;
-    p->pool = mp_image_pool_new(20);
-    va_pool_set_allocator(p->pool, p->va, p->current_rt_format);
-
     struct mp_image *probe = mp_image_pool_get(p->pool, IMGFMT_VAAPI, in->w, in->h);
     if (!probe)
         return -1;
@@ -460,6 +454,13 @@ static int vf_open(vf_instance_t *vf)
     if (!p->va)
         return 0;
     p->display = p->va->display;
+
+    // Kept across reconfigs, so toggling deinterlacing doesn't reallocate
+    // all surfaces. The pool drops surfaces of the old size when full.
+    p->current_rt_format = VA_RT_FORMAT_YUV420;
+    p->pool = mp_image_pool_new(20);
+    va_pool_set_allocator(p->pool, p->va, p->current_rt_format);
+
     if (initialize(vf))
         return true;
     uninit(vf);
@@ -21,6 +21,7 @@ enum hwdec_type {
     HWDEC_D3D11VA_COPY,
     HWDEC_RPI,
     HWDEC_MEDIACODEC,
+    HWDEC_CUDA,
 };
 
 #define HWDEC_IS_AUTO(x) ((x) == HWDEC_AUTO || (x) == HWDEC_AUTO_COPY)
@@ -39,6 +40,7 @@ struct mp_hwdec_ctx {
     //  HWDEC_D3D11VA:          ID3D11Device*
     //  HWDEC_DXVA2:            IDirect3DDevice9*
     //  HWDEC_DXVA2_COPY:       IDirect3DDevice9*
+    //  HWDEC_CUDA:             CUcontext
     void *ctx;
 
     // Optional.
@@ -26,6 +26,7 @@
 
 #include <libavutil/mem.h>
 #include <libavutil/common.h>
+#include <libavutil/cpu.h>
 #include <libavutil/bswap.h>
 #include <libavutil/rational.h>
 #include <libavcodec/avcodec.h>
@@ -37,14 +38,15 @@
 #include "sws_utils.h"
 #include "fmt-conversion.h"
 #include "gpu_memcpy.h"
+#include "misc/thread_pool.h"
 
 #include "video/filter/vf.h"
 
-static bool mp_image_alloc_planes(struct mp_image *mpi)
+// Set mpi->stride[] for the given stride alignment, and return the size of
+// each plane in plane_size[]. Returns false if the image can't be allocated.
+static bool mp_image_layout(struct mp_image *mpi, int stride_align,
+                            size_t plane_size[MP_MAX_PLANES])
 {
-    assert(!mpi->planes[0]);
-    assert(!mpi->bufs[0]);
-
     if (!mp_image_params_valid(&mpi->params) || mpi->fmt.flags & MP_IMGFLAG_HWACCEL)
         return false;
 
@@ -52,15 +54,34 @@ static bool mp_image_alloc_planes(struct mp_image *mpi)
     //       top/right border. This is needed for correct handling of such
     //       images in filter and VO code (e.g. vo_vdpau or vo_opengl).
 
-    size_t plane_size[MP_MAX_PLANES];
     for (int n = 0; n < MP_MAX_PLANES; n++) {
         int alloc_h = MP_ALIGN_UP(mpi->h, 32) >> mpi->fmt.ys[n];
         int line_bytes = (mp_image_plane_w(mpi, n) * mpi->fmt.bpp[n] + 7) / 8;
-        mpi->stride[n] = FFALIGN(line_bytes, SWS_MIN_BYTE_ALIGN);
+        mpi->stride[n] = FFALIGN(line_bytes, stride_align);
         plane_size[n] = mpi->stride[n] * alloc_h;
     }
     if (mpi->fmt.flags & MP_IMGFLAG_PAL)
         plane_size[1] = MP_PALETTE_SIZE;
+    return true;
+}
+
+static void mp_image_set_planes(struct mp_image *mpi, uint8_t *data,
+                                size_t plane_size[MP_MAX_PLANES])
+{
+    for (int n = 0; n < MP_MAX_PLANES; n++) {
+        mpi->planes[n] = plane_size[n] ? data : NULL;
+        data += plane_size[n];
+    }
+}
+
+static bool mp_image_alloc_planes(struct mp_image *mpi)
+{
+    assert(!mpi->planes[0]);
+    assert(!mpi->bufs[0]);
+
+    size_t plane_size[MP_MAX_PLANES];
+    if (!mp_image_layout(mpi, SWS_MIN_BYTE_ALIGN, plane_size))
+        return false;
 
     size_t sum = 0;
     for (int n = 0; n < MP_MAX_PLANES; n++)
@@ -71,11 +92,7 @@ static bool mp_image_alloc_planes(struct mp_image *mpi)
     if (!mpi->bufs[0])
         return false;
 
-    uint8_t *data = mpi->bufs[0]->data;
-    for (int n = 0; n < MP_MAX_PLANES; n++) {
-        mpi->planes[n] = plane_size[n] ? data : NULL;
-        data += plane_size[n];
-    }
+    mp_image_set_planes(mpi, mpi->bufs[0]->data, plane_size);
     return true;
 }
 
@@ -146,6 +163,63 @@ struct mp_image *mp_image_alloc(int imgfmt, int w, int h)
     return mpi;
 }
 
+// Return the number of bytes a buffer passed to mp_image_from_buffer() must
+// have for the given parameters, or -1 if the format can't be allocated.
+// stride_align must be a power of 2.
+int mp_image_get_alloc_size(int imgfmt, int w, int h, int stride_align)
+{
+    struct mp_image tmp = {0};
+    mp_image_setfmt(&tmp, imgfmt);
+    mp_image_set_size(&tmp, w, h);
+
+    size_t plane_size[MP_MAX_PLANES];
+    if (!mp_image_layout(&tmp, stride_align, plane_size))
+        return -1;
+
+    // Extra space to align the start of the buffer.
+    size_t sum = stride_align;
+    for (int n = 0; n < MP_MAX_PLANES; n++)
+        sum += plane_size[n];
+    return sum > INT_MAX ? -1 : sum;
+}
+
+// Create an image whose planes point into the given buffer, which must be at
+// least mp_image_get_alloc_size() bytes large. The data is not copied. When
+// the last reference to the image data is dropped, free(free_opaque, buffer)
+// is called; this can happen on any thread. Also calls it on failure.
+struct mp_image *mp_image_from_buffer(int imgfmt, int w, int h, int stride_align,
+                                      uint8_t *buffer, int buffer_size,
+                                      void *free_opaque,
+                                      void (*free)(void *opaque, uint8_t *data))
+{
+    struct mp_image *mpi = talloc_zero(NULL, struct mp_image);
+    talloc_set_destructor(mpi, mp_image_destructor);
+
+    mp_image_setfmt(mpi, imgfmt);
+    mp_image_set_size(mpi, w, h);
+
+    if (mp_image_get_alloc_size(imgfmt, w, h, stride_align) > buffer_size)
+        goto fail;
+
+    size_t plane_size[MP_MAX_PLANES];
+    if (!mp_image_layout(mpi, stride_align, plane_size))
+        goto fail;
+
+    uintptr_t start = MP_ALIGN_UP((uintptr_t)buffer, stride_align);
+    mp_image_set_planes(mpi, (uint8_t *)start, plane_size);
+
+    mpi->bufs[0] = av_buffer_create(buffer, buffer_size, free, free_opaque, 0);
+    if (!mpi->bufs[0])
+        goto fail;
+
+    return mpi;
+
+fail:
+    talloc_free(mpi);
+    free(free_opaque, buffer);
+    return NULL;
+}
+
 struct mp_image *mp_image_new_copy(struct mp_image *img)
 {
     struct mp_image *new = mp_image_alloc(img->imgfmt, img->w, img->h);
@@ -344,20 +418,151 @@ static void mp_image_copy_cb(struct mp_image *dst, struct mp_image *src,
         memcpy(dst->planes[1], src->planes[1], MP_PALETTE_SIZE);
 }
 
+#define MAX_COPY_STRIPES 16
+
+// Images at least this large are copied on the shared copy pool. Below this,
+// waking up the worker threads costs more than it gains.
+#define SHARED_COPY_MIN_BYTES (8 * 1024 * 1024)
+
+struct copy_stripe {
+    uint8_t *dst, *src;
+    int line_bytes, lines;
+    int dst_stride, src_stride;
+};
+
+struct copy_job {
+    memcpy_fn cpy;
+    struct copy_stripe stripes[MP_MAX_PLANES * MAX_COPY_STRIPES];
+    int num_stripes;
+};
+
+static void copy_stripe_cb(void *ctx, int index)
+{
+    struct copy_job *job = ctx;
+    struct copy_stripe *st = &job->stripes[index];
+    memcpy_pic_cb(st->dst, st->src, st->line_bytes, st->lines,
+                  st->dst_stride, st->src_stride, job->cpy);
+}
+
+// Split each plane into horizontal stripes, and copy them on the pool.
+static void mp_image_copy_pool_cb(struct mp_image *dst, struct mp_image *src,
+                                  memcpy_fn cpy, struct mp_thread_pool *pool)
+{
+    assert(dst->imgfmt == src->imgfmt);
+    assert(dst->w == src->w && dst->h == src->h);
+    assert(mp_image_is_writeable(dst));
+    assert(!(dst->fmt.flags & MP_IMGFLAG_PAL));
+
+    struct copy_job job = {.cpy = cpy};
+    for (int n = 0; n < dst->num_planes; n++) {
+        int line_bytes = (mp_image_plane_w(dst, n) * dst->fmt.bpp[n] + 7) / 8;
+        int plane_h = mp_image_plane_h(dst, n);
+        // Keep stripes reasonably large, so the overhead stays small.
+        int num = MPCLAMP(plane_h / 64, 1, MAX_COPY_STRIPES);
+        for (int i = 0; i < num; i++) {
+            int y0 = plane_h * i / num;
+            int y1 = plane_h * (i + 1) / num;
+            job.stripes[job.num_stripes++] = (struct copy_stripe){
+                .dst = dst->planes[n] + y0 * (ptrdiff_t)dst->stride[n],
+                .src = src->planes[n] + y0 * (ptrdiff_t)src->stride[n],
+                .line_bytes = line_bytes,
+                .lines = y1 - y0,
+                .dst_stride = dst->stride[n],
+                .src_stride = src->stride[n],
+            };
+        }
+    }
+
+    mp_thread_pool_run(pool, copy_stripe_cb, &job, job.num_stripes);
+}
+
+static pthread_once_t shared_copy_pool_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t shared_copy_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct mp_thread_pool *shared_copy_pool;
+
+static void create_shared_copy_pool(void)
+{
+    // Lives until process exit; the workers are idle between copies.
+    shared_copy_pool = mp_image_create_copy_pool(NULL);
+}
+
+static size_t image_copy_bytes(struct mp_image *img)
+{
+    size_t size = 0;
+    for (int n = 0; n < img->num_planes; n++) {
+        size += (size_t)((mp_image_plane_w(img, n) * img->fmt.bpp[n] + 7) / 8) *
+                mp_image_plane_h(img, n);
+    }
+    return size;
+}
+
+// Copy large images on the process-wide copy pool, everything else (or if
+// another thread is using the pool right now) on the calling thread.
+static void mp_image_copy_auto_cb(struct mp_image *dst, struct mp_image *src,
+                                  memcpy_fn cpy)
+{
+    if (!(dst->fmt.flags & MP_IMGFLAG_PAL) &&
+        image_copy_bytes(dst) >= SHARED_COPY_MIN_BYTES)
+    {
+        pthread_once(&shared_copy_pool_once, create_shared_copy_pool);
+        if (shared_copy_pool && pthread_mutex_trylock(&shared_copy_pool_lock) == 0) {
+            mp_image_copy_pool_cb(dst, src, cpy, shared_copy_pool);
+            pthread_mutex_unlock(&shared_copy_pool_lock);
+            return;
+        }
+    }
+    mp_image_copy_cb(dst, src, cpy);
+}
+
+// Large images are copied with multiple threads.
 void mp_image_copy(struct mp_image *dst, struct mp_image *src)
 {
-    mp_image_copy_cb(dst, src, memcpy);
+    mp_image_copy_auto_cb(dst, src, memcpy);
 }
 
-void mp_image_copy_gpu(struct mp_image *dst, struct mp_image *src)
+static memcpy_fn get_gpu_memcpy(void)
 {
 #if HAVE_SSE4_INTRINSICS
-    if (av_get_cpu_flags() & AV_CPU_FLAG_SSE4) {
-        mp_image_copy_cb(dst, src, gpu_memcpy);
+    if (av_get_cpu_flags() & AV_CPU_FLAG_SSE4)
+        return gpu_memcpy;
+#endif
+    return memcpy;
+}
+
+void mp_image_copy_gpu(struct mp_image *dst, struct mp_image *src)
+{
+    mp_image_copy_auto_cb(dst, src, get_gpu_memcpy());
+}
+
+// Like mp_image_copy_gpu(), but split each plane into horizontal stripes, and
+// copy them in parallel on the given pool. Reading back from uncached video
+// memory is latency bound, so several cores get considerably more throughput
+// than one. pool can be NULL, in which case this is the same as
+// mp_image_copy_gpu().
+void mp_image_copy_gpu_threaded(struct mp_image *dst, struct mp_image *src,
+                                struct mp_thread_pool *pool)
+{
+    assert(dst->imgfmt == src->imgfmt);
+    assert(dst->w == src->w && dst->h == src->h);
+    assert(mp_image_is_writeable(dst));
+
+    if (!pool || (dst->fmt.flags & MP_IMGFLAG_PAL)) {
+        mp_image_copy_gpu(dst, src);
         return;
     }
-#endif
-    mp_image_copy(dst, src);
+
+    mp_image_copy_pool_cb(dst, src, get_gpu_memcpy(), pool);
+}
+
+// Create a thread pool for mp_image_copy_gpu_threaded(). Returns NULL if there
+// are not enough cores to make this worthwhile. Few threads are enough to
+// saturate the bus; more would just take CPU time from the decoder.
+struct mp_thread_pool *mp_image_create_copy_pool(void *talloc_parent)
+{
+    int threads = MPMIN(av_cpu_count(), 4) - 1;
+    if (threads < 1)
+        return NULL;
+    return mp_thread_pool_create(talloc_parent, threads);
 }
 
 // Helper, only for outputting some log info.
@@ -386,6 +591,7 @@ void mp_image_copy_attributes(struct mp_image *dst, struct mp_image *src)
     dst->fields = src->fields;
     dst->pts = src->pts;
     dst->dts = src->dts;
+    dst->timing = src->timing;
     dst->params.rotate = src->params.rotate;
     dst->params.stereo_in = src->params.stereo_in;
     dst->params.stereo_out = src->params.stereo_out;
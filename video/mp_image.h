@@ -30,6 +30,8 @@
 
 #define MP_PALETTE_SIZE (256 * 4)
 
+struct mp_thread_pool;
+
 #define MP_IMGFIELD_TOP_FIRST 0x02
 #define MP_IMGFIELD_REPEAT_FIRST 0x04
 #define MP_IMGFIELD_INTERLACED 0x20
@@ -50,6 +52,18 @@ struct mp_image_params {
     enum mp_stereo3d_mode stereo_out;   // should be displayed with this mode
 };
 
+// Wall clock times (mp_time_us()) of a frame passing through the playback
+// pipeline, used for latency accounting. 0 means unknown.
+struct mp_frame_timing {
+    int64_t demuxed;        // decoder read the last packet before the frame
+    int64_t demux_wait;     // time the decoder waited for packets (us)
+    int64_t decode_start;   // decoder started decoding the packet
+    int64_t decoded;        // decoder returned the frame
+    int64_t filter_start;   // decoded frame was sent to the filter chain
+    int64_t filtered;       // frame left the filter chain
+    int64_t queued;         // frame was queued to the VO
+};
+
 /* Memory management:
  * - mp_image is a light-weight reference to the actual image data (pixels).
  *   The actual image data is reference counted and can outlive mp_image
@@ -86,6 +100,7 @@ typedef struct mp_image {
     double pts;
     /* only after decoder */
     double dts;
+    struct mp_frame_timing timing;
     /* for private use */
     void* priv;
 
@@ -103,8 +118,16 @@ typedef struct mp_image {
 int mp_chroma_div_up(int size, int shift);
 
 struct mp_image *mp_image_alloc(int fmt, int w, int h);
+int mp_image_get_alloc_size(int imgfmt, int w, int h, int stride_align);
+struct mp_image *mp_image_from_buffer(int imgfmt, int w, int h, int stride_align,
+                                      uint8_t *buffer, int buffer_size,
+                                      void *free_opaque,
+                                      void (*free)(void *opaque, uint8_t *data));
 void mp_image_copy(struct mp_image *dmpi, struct mp_image *mpi);
 void mp_image_copy_gpu(struct mp_image *dst, struct mp_image *src);
+void mp_image_copy_gpu_threaded(struct mp_image *dst, struct mp_image *src,
+                                struct mp_thread_pool *pool);
+struct mp_thread_pool *mp_image_create_copy_pool(void *talloc_parent);
 void mp_image_copy_attributes(struct mp_image *dmpi, struct mp_image *mpi);
 struct mp_image *mp_image_new_copy(struct mp_image *img);
 struct mp_image *mp_image_new_ref(struct mp_image *img);
@@ -94,6 +94,23 @@ void mp_image_pool_clear(struct mp_image_pool *pool)
     pool->num_images = 0;
 }
 
+// Remove all images that are currently in use from the pool. They are freed
+// when they are unreferenced, instead of being returned to the pool.
+void mp_image_pool_forget_used(struct mp_image_pool *pool)
+{
+    pool_lock();
+    for (int n = pool->num_images - 1; n >= 0; n--) {
+        struct mp_image *img = pool->images[n];
+        struct image_flags *it = img->priv;
+        assert(it->pool_alive);
+        if (it->referenced) {
+            it->pool_alive = false;
+            MP_TARRAY_REMOVE_AT(pool->images, pool->num_images, n);
+        }
+    }
+    pool_unlock();
+}
+
 // This is the only function that is allowed to run in a different thread.
 // (Consider passing an image to another thread, which frees it.)
 static void unref_image(void *opaque, uint8_t *data)
@@ -242,6 +259,34 @@ void mp_image_pool_set_allocator(struct mp_image_pool *pool,
     pool->allocator_ctx = cb_data;
 }
 
+// Change the maximum number of images kept by the pool. If more images are
+// needed at once, they are still allocated, but the pool forgets about all of
+// its images when this count is exceeded, so memory use is roughly bounded by
+// the number of images actually in use plus max_count.
+void mp_image_pool_set_max_count(struct mp_image_pool *pool, int max_count)
+{
+    pool->max_count = max_count;
+}
+
+// Add the current state of the pool to *st (so stats for multiple pools can be
+// summed up by calling this on each of them).
+void mp_image_pool_add_stats(struct mp_image_pool *pool,
+                             struct mp_image_pool_stats *st)
+{
+    pool_lock();
+    for (int n = 0; n < pool->num_images; n++) {
+        struct mp_image *img = pool->images[n];
+        struct image_flags *it = img->priv;
+        st->images += 1;
+        st->used += it->referenced;
+        if (img->bufs[0])
+            st->bytes += img->bufs[0]->size;
+    }
+    st->max_images += pool->max_count;
+    st->pools += 1;
+    pool_unlock();
+}
+
 // Put into LRU mode. (Likely better for hwaccel surfaces, but worse for memory.)
 void mp_image_pool_set_lru(struct mp_image_pool *pool)
 {
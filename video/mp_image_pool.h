@@ -2,9 +2,18 @@
 #define MPV_MP_IMAGE_POOL_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 struct mp_image_pool;
 
+struct mp_image_pool_stats {
+    int images;         // number of images owned by the pool
+    int used;           // number of these currently referenced
+    int64_t bytes;      // size of all images owned by the pool
+    int max_images;     // sum of configured maximum counts
+    int pools;          // number of pools summed up
+};
+
 struct mp_image_pool *mp_image_pool_new(int max_count);
 struct mp_image *mp_image_pool_get(struct mp_image_pool *pool, int fmt,
                                    int w, int h);
@@ -13,6 +22,10 @@ void mp_image_pool_add(struct mp_image_pool *pool, struct mp_image *new);
 void mp_image_pool_clear(struct mp_image_pool *pool);
 
 void mp_image_pool_set_lru(struct mp_image_pool *pool);
+void mp_image_pool_set_max_count(struct mp_image_pool *pool, int max_count);
+void mp_image_pool_forget_used(struct mp_image_pool *pool);
+void mp_image_pool_add_stats(struct mp_image_pool *pool,
+                             struct mp_image_pool_stats *st);
 
 struct mp_image *mp_image_pool_get_no_alloc(struct mp_image_pool *pool, int fmt,
                                             int w, int h);
@@ -27,6 +27,7 @@
 #include <string.h>
 #include <assert.h>
 #include <math.h>
+#include <pthread.h>
 
 #include <libavutil/lfg.h>
 
@@ -100,20 +101,15 @@ static void makegauss(struct ctx *k, unsigned int sizeb)
     }
 }
 
-static void setbit(struct ctx *k, index_t c)
+static index_t pickmin(struct ctx *k, index_t resnum)
 {
-    if (k->calcmat[c])
-        return;
-    k->calcmat[c] = true;
-    uint64_t *m = k->gaussmat;
-    uint64_t *me = k->gaussmat + k->size2;
-    uint64_t *g = k->gauss + WRAP_SIZE2(k, k->gauss_middle + k->size2 - c);
-    uint64_t *ge = k->gauss + k->size2;
-    while (g < ge)
-        *m++ += *g++;
-    g = k->gauss;
-    while (m < me)
-        *m++ += *g++;
+    if (resnum == 1)
+        return k->randomat[0];
+    if (resnum == k->size2)
+        return k->size2 / 2;
+    if (resnum == 0)
+        return 0;
+    return k->randomat[av_lfg_get(&k->avlfg) % resnum];
 }
 
 static index_t getmin(struct ctx *k)
@@ -133,26 +129,68 @@ static index_t getmin(struct ctx *k)
             k->randomat[resnum++] = c;
         }
     }
-    if (resnum == 1)
-        return k->randomat[0];
-    if (resnum == size2)
-        return size2 / 2;
-    return k->randomat[av_lfg_get(&k->avlfg) % resnum];
+    return pickmin(k, resnum);
+}
+
+// Set the bit c, and return the next minimum (same as calling getmin() after
+// setting the bit). Doing both in one pass halves the memory traffic, which
+// dominates the runtime for large matrices.
+static index_t setbit_getmin(struct ctx *k, index_t c)
+{
+    k->calcmat[c] = true;
+    uint64_t min = UINT64_MAX;
+    index_t resnum = 0;
+    unsigned int size2 = k->size2;
+    index_t g = WRAP_SIZE2(k, k->gauss_middle + size2 - c);
+    // The kernel is applied with wraparound, so go through it in two parts.
+    index_t m = 0;
+    for (int part = 0; part < 2; part++) {
+        index_t end = part ? size2 : size2 - g;
+        for (index_t gi = g; m < end; m++, gi++) {
+            uint64_t total = k->gaussmat[m] + k->gauss[gi];
+            k->gaussmat[m] = total;
+            if (total <= min && !k->calcmat[m]) {
+                if (total != min) {
+                    min = total;
+                    resnum = 0;
+                }
+                k->randomat[resnum++] = m;
+            }
+        }
+        g = 0;
+    }
+    return pickmin(k, resnum);
 }
 
 static void makeuniform(struct ctx *k)
 {
     unsigned int size2 = k->size2;
+    index_t r = getmin(k);
     for (index_t c = 0; c < size2; c++) {
-        index_t r = getmin(k);
-        setbit(k, r);
         k->unimat[r] = c;
+        r = setbit_getmin(k, r);
     }
 }
 
+// Generating large matrices is expensive, and the result depends only on the
+// size, so keep them around across VO reinits.
+static pthread_mutex_t fruit_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static float *fruit_cache[MAX_SIZEB + 1];
+
 // out_matrix is a reactangular tsize * tsize array, where tsize = (1 << size).
 void mp_make_fruit_dither_matrix(float *out_matrix, int size)
 {
+    assert(size >= 1 && size <= MAX_SIZEB);
+    size_t bytes = sizeof(float) << (size * 2);
+
+    pthread_mutex_lock(&fruit_cache_lock);
+    if (fruit_cache[size]) {
+        memcpy(out_matrix, fruit_cache[size], bytes);
+        pthread_mutex_unlock(&fruit_cache_lock);
+        return;
+    }
+    pthread_mutex_unlock(&fruit_cache_lock);
+
     struct ctx *k = talloc_zero(NULL, struct ctx);
     makegauss(k, size);
     makeuniform(k);
@@ -162,6 +200,11 @@ void mp_make_fruit_dither_matrix(float *out_matrix, int size)
             out_matrix[x + y * k->size] = k->unimat[XY(k, x, y)] / invscale;
     }
     talloc_free(k);
+
+    pthread_mutex_lock(&fruit_cache_lock);
+    if (!fruit_cache[size])
+        fruit_cache[size] = talloc_memdup(NULL, out_matrix, bytes);
+    pthread_mutex_unlock(&fruit_cache_lock);
 }
 
 void mp_make_ordered_dither_matrix(unsigned char *m, int size)
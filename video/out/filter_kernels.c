@@ -23,9 +23,11 @@
  */
 
 #include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "filter_kernels.h"
 
@@ -128,15 +130,92 @@ static void mp_compute_weights(struct filter_kernel *filter,
         out_w[n] /= sum;
 }
 
-// Fill the given array with weights for the range [0.0, 1.0]. The array is
-// interpreted as rectangular array of count * filter->size items.
-//
-// There will be slight sampling error if these weights are used in a OpenGL
-// texture as LUT directly. The sampling point of a texel is located at its
-// center, so out_array[0] will end up at 0.5 / count instead of 0.0.
-// Correct lookup requires a linear coordinate mapping from [0.0, 1.0] to
-// [0.5 / count, 1.0 - 0.5 / count].
-void mp_compute_lut(struct filter_kernel *filter, int count, float *out_array)
+// Computed LUTs are shared process-wide (between all scalers and all VO
+// instances). Since upscaling doesn't depend on the scale factor, this makes
+// resizing and zooming mostly free.
+#define LUT_CACHE_SIZE 16
+
+// Everything the LUT contents depend on. Must be zero-initialized, so that it
+// can be compared with memcmp().
+struct lut_key {
+    double (*f_weight)(struct filter_window *k, double x);
+    double (*w_weight)(struct filter_window *k, double x);
+    double f_radius, w_radius;
+    double f_params[2], w_params[2];
+    double f_blur, w_blur;
+    double inv_scale;
+    int size;
+    int count;
+    bool clamp, polar;
+};
+
+struct lut_cache_entry {
+    struct lut_key key;
+    float *data;                // malloc'ed, NULL if unused
+};
+
+static pthread_mutex_t lut_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct lut_cache_entry lut_cache[LUT_CACHE_SIZE];
+static int lut_cache_next;
+
+static void get_lut_key(struct filter_kernel *filter, int count,
+                        struct lut_key *key)
+{
+    memset(key, 0, sizeof(*key));
+    key->f_weight = filter->f.weight;
+    key->w_weight = filter->w.weight;
+    key->f_radius = filter->f.radius;
+    key->w_radius = filter->w.radius;
+    for (int n = 0; n < 2; n++) {
+        key->f_params[n] = filter->f.params[n];
+        key->w_params[n] = filter->w.params[n];
+    }
+    key->f_blur = filter->f.blur;
+    key->w_blur = filter->w.blur;
+    key->inv_scale = filter->inv_scale;
+    key->size = filter->size;
+    key->count = count;
+    key->clamp = filter->clamp;
+    key->polar = filter->polar;
+}
+
+static size_t lut_elems(struct filter_kernel *filter, int count)
+{
+    return filter->polar ? count : (size_t)count * filter->size;
+}
+
+static bool lut_cache_lookup(struct lut_key *key, size_t elems, float *out)
+{
+    bool found = false;
+    pthread_mutex_lock(&lut_cache_lock);
+    for (int n = 0; n < LUT_CACHE_SIZE; n++) {
+        struct lut_cache_entry *e = &lut_cache[n];
+        if (e->data && memcmp(&e->key, key, sizeof(*key)) == 0) {
+            memcpy(out, e->data, elems * sizeof(float));
+            found = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&lut_cache_lock);
+    return found;
+}
+
+static void lut_cache_add(struct lut_key *key, size_t elems, const float *data)
+{
+    float *copy = malloc(elems * sizeof(float));
+    if (!copy)
+        return;
+    memcpy(copy, data, elems * sizeof(float));
+    pthread_mutex_lock(&lut_cache_lock);
+    struct lut_cache_entry *e = &lut_cache[lut_cache_next];
+    free(e->data);
+    *e = (struct lut_cache_entry){ .key = *key, .data = copy };
+    lut_cache_next = (lut_cache_next + 1) % LUT_CACHE_SIZE;
+    pthread_mutex_unlock(&lut_cache_lock);
+}
+
+static void compute_lut(struct filter_kernel *filter, int count,
+                        float *out_array)
 {
     struct filter_window *window = &filter->w;
     if (filter->polar) {
@@ -154,6 +233,30 @@ void mp_compute_lut(struct filter_kernel *filter, int count, float *out_array)
     }
 }
 
+// Fill the given array with weights for the range [0.0, 1.0]. The array is
+// interpreted as rectangular array of count * filter->size items.
+//
+// There will be slight sampling error if these weights are used in a OpenGL
+// texture as LUT directly. The sampling point of a texel is located at its
+// center, so out_array[0] will end up at 0.5 / count instead of 0.0.
+// Correct lookup requires a linear coordinate mapping from [0.0, 1.0] to
+// [0.5 / count, 1.0 - 0.5 / count].
+//
+// This is thread-safe, and returns cached results if the same LUT was computed
+// recently.
+void mp_compute_lut(struct filter_kernel *filter, int count, float *out_array)
+{
+    struct lut_key key;
+    get_lut_key(filter, count, &key);
+    size_t elems = lut_elems(filter, count);
+
+    if (lut_cache_lookup(&key, elems, out_array))
+        return;
+
+    compute_lut(filter, count, out_array);
+    lut_cache_add(&key, elems, out_array);
+}
+
 typedef struct filter_window params;
 
 static double box(params *p, double x)
@@ -315,6 +315,83 @@ static const struct gl_functions gl_functions[] = {
             {0}
         },
     },
+    // textureGather() with component selection. Always used through the
+    // extension, because our GLSL version is capped below 400.
+    {
+        .extension = "GL_ARB_gpu_shader5",
+        .provides = MPGL_CAP_GATHER,
+        .ver_es_exclude = 1,
+    },
+    // Shader storage buffers, used in fragment shaders through the extension
+    // for the same reason.
+    {
+        .extension = "GL_ARB_shader_storage_buffer_object",
+        .provides = MPGL_CAP_SSBO,
+        .ver_es_exclude = 1,
+    },
+    // Persistent mapped buffers, used for texture uploads.
+    {
+        .ver_core = 440,
+        .extension = "GL_ARB_buffer_storage",
+        .functions = (const struct gl_function[]) {
+            DEF_FN(BufferStorage),
+            {0}
+        },
+    },
+    {
+        .extension = "GL_EXT_buffer_storage",
+        .functions = (const struct gl_function[]) {
+            DEF_FN_NAME(BufferStorage, "glBufferStorageEXT"),
+            {0}
+        },
+    },
+    // Compute shaders and image load/store (core only, as we need both).
+    {
+        .ver_core = 430,
+        .ver_es_core = 310,
+        .provides = MPGL_CAP_COMPUTE_SHADER,
+        .functions = (const struct gl_function[]) {
+            DEF_FN(DispatchCompute),
+            DEF_FN(BindImageTexture),
+            DEF_FN(MemoryBarrier),
+            {0}
+        },
+    },
+    // Program binaries, used for the on-disk shader cache.
+    {
+        .ver_core = 410,
+        .ver_es_core = 300,
+        .extension = "GL_ARB_get_program_binary",
+        .functions = (const struct gl_function[]) {
+            DEF_FN(GetProgramBinary),
+            DEF_FN(ProgramBinary),
+            {0}
+        },
+    },
+    {
+        .extension = "GL_OES_get_program_binary",
+        .functions = (const struct gl_function[]) {
+            DEF_FN_NAME(GetProgramBinary, "glGetProgramBinaryOES"),
+            DEF_FN_NAME(ProgramBinary, "glProgramBinaryOES"),
+            {0}
+        },
+    },
+    // Non-blocking shader compilation, used by the shader-async-compile option.
+    {
+        .extension = "GL_KHR_parallel_shader_compile",
+        .functions = (const struct gl_function[]) {
+            DEF_FN(MaxShaderCompilerThreadsKHR),
+            {0}
+        },
+    },
+    {
+        .extension = "GL_ARB_parallel_shader_compile",
+        .functions = (const struct gl_function[]) {
+            DEF_FN_NAME(MaxShaderCompilerThreadsKHR,
+                        "glMaxShaderCompilerThreadsARB"),
+            {0}
+        },
+    },
     // Swap control, always an OS specific extension
     // The OSX code loads this manually.
     {
@@ -63,6 +63,9 @@ enum {
     MPGL_CAP_EXT16              = (1 << 18),    // GL_EXT_texture_norm16
     MPGL_CAP_ARB_FLOAT          = (1 << 19),    // GL_ARB_texture_float
     MPGL_CAP_EXT_CR_HFLOAT      = (1 << 20),    // GL_EXT_color_buffer_half_float
+    MPGL_CAP_COMPUTE_SHADER     = (1 << 21),    // GL 4.3 / GLES 3.1 compute
+    MPGL_CAP_GATHER             = (1 << 22),    // GL_ARB_gpu_shader5 gathers
+    MPGL_CAP_SSBO               = (1 << 23),    // GL_ARB_shader_storage_buffer_object
 
     MPGL_CAP_SW                 = (1 << 30),    // indirect or sw renderer
 };
@@ -184,6 +187,20 @@ struct GL {
 
     void (GLAPIENTRY *InvalidateFramebuffer)(GLenum, GLsizei, const GLenum *);
 
+    void (GLAPIENTRY *GetProgramBinary)(GLuint, GLsizei, GLsizei *, GLenum *,
+                                        void *);
+    void (GLAPIENTRY *ProgramBinary)(GLuint, GLenum, const void *, GLsizei);
+
+    void (GLAPIENTRY *MaxShaderCompilerThreadsKHR)(GLuint);
+
+    void (GLAPIENTRY *BufferStorage)(GLenum, ptrdiff_t, const GLvoid *,
+                                     GLbitfield);
+
+    void (GLAPIENTRY *DispatchCompute)(GLuint, GLuint, GLuint);
+    void (GLAPIENTRY *BindImageTexture)(GLuint, GLuint, GLint, GLboolean,
+                                        GLint, GLenum, GLenum);
+    void (GLAPIENTRY *MemoryBarrier)(GLbitfield);
+
     GLsync (GLAPIENTRY *FenceSync)(GLenum, GLbitfield);
     GLenum (GLAPIENTRY *ClientWaitSync)(GLsync, GLbitfield, GLuint64);
     void (GLAPIENTRY *DeleteSync)(GLsync sync);
@@ -33,6 +33,7 @@ enum {
     VOFLAG_ALPHA        = 1 << 3,       // Hint to request alpha framebuffer
     VOFLAG_SW           = 1 << 4,       // Hint to accept a software GL renderer
     VOFLAG_ANGLE_DCOMP  = 1 << 5,       // Whether DirectComposition is allowed
+    VOFLAG_ANGLE_FLIP   = 1 << 6,       // Whether a DXGI flip-model swapchain is allowed
 };
 
 extern const int mpgl_preferred_gl_versions[];
@@ -58,6 +59,10 @@ struct mpgl_driver {
     // Return 0 on success, negative value (-1) on error.
     int (*reconfig)(struct MPGLContext *ctx);
 
+    // Called before rendering a frame. Can block until the backend is ready
+    // to accept a new frame. Optional.
+    void (*start_frame)(struct MPGLContext *ctx);
+
     // Present the frame.
     void (*swap_buffers)(struct MPGLContext *ctx);
 
@@ -96,6 +101,7 @@ MPGLContext *mpgl_init(struct vo *vo, const char *backend_name, int vo_flags);
 void mpgl_uninit(MPGLContext *ctx);
 int mpgl_reconfig_window(struct MPGLContext *ctx);
 int mpgl_control(struct MPGLContext *ctx, int *events, int request, void *arg);
+void mpgl_start_frame(struct MPGLContext *ctx);
 void mpgl_swap_buffers(struct MPGLContext *ctx);
 
 int mpgl_find_backend(const char *name);
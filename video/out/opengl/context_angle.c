@@ -20,11 +20,13 @@
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 #include <d3d11.h>
-#include <dxgi.h>
+#include <dxgi1_3.h>
 
 #include "angle_dynamic.h"
 
 #include "common/common.h"
+#include "osdep/timer.h"
+#include "osdep/windows_utils.h"
 #include "video/out/w32_common.h"
 #include "context.h"
 
@@ -34,18 +36,69 @@
 #define EGL_SURFACE_ORIENTATION_INVERT_Y_ANGLE 0x0002
 #endif
 
+#ifndef EGL_D3D_TEXTURE_ANGLE
+#define EGL_D3D_TEXTURE_ANGLE 0x33A3
+#endif
+
 // Windows 8 enum value, not present in mingw-w64 headers
 #define DXGI_ADAPTER_FLAG_SOFTWARE (2)
+// Windows 8.1 and Windows 10 enum values, not present in older mingw-w64
+// headers
+#define DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT (64)
+#define DXGI_SWAP_EFFECT_FLIP_DISCARD (4)
 
 struct priv {
     EGLDisplay egl_display;
     EGLContext egl_context;
     EGLSurface egl_surface;
+    EGLConfig egl_config;
     bool use_es2;
     bool sw_adapter_msg_shown;
     PFNEGLPOSTSUBBUFFERNVPROC eglPostSubBufferNV;
+
+    ID3D11Device *d3d11_device;
+    IDXGIFactory2 *dxgi_factory2;
+
+    // Only set if mpv presents through its own DXGI swapchain. In this case,
+    // egl_surface is a pbuffer wrapping the swapchain's backbuffer.
+    IDXGISwapChain1 *dxgi_swapchain;
+    HANDLE frame_latency_wait;
+    UINT swapchain_flags;
+    int sc_width, sc_height;
 };
 
+static void d3d11_backbuffer_release(MPGLContext *ctx)
+{
+    struct priv *p = ctx->priv;
+
+    if (p->egl_surface) {
+        eglMakeCurrent(p->egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                       EGL_NO_CONTEXT);
+        eglDestroySurface(p->egl_display, p->egl_surface);
+    }
+    p->egl_surface = EGL_NO_SURFACE;
+}
+
+static void d3d11_swapchain_uninit(MPGLContext *ctx)
+{
+    struct priv *p = ctx->priv;
+
+    if (p->dxgi_swapchain) {
+        d3d11_backbuffer_release(ctx);
+        IDXGISwapChain1_Release(p->dxgi_swapchain);
+    }
+    p->dxgi_swapchain = NULL;
+    if (p->frame_latency_wait)
+        CloseHandle(p->frame_latency_wait);
+    p->frame_latency_wait = NULL;
+    if (p->dxgi_factory2)
+        IDXGIFactory2_Release(p->dxgi_factory2);
+    p->dxgi_factory2 = NULL;
+    if (p->d3d11_device)
+        ID3D11Device_Release(p->d3d11_device);
+    p->d3d11_device = NULL;
+}
+
 static void angle_uninit(MPGLContext *ctx)
 {
     struct priv *p = ctx->priv;
@@ -56,6 +109,7 @@ static void angle_uninit(MPGLContext *ctx)
         eglDestroyContext(p->egl_display, p->egl_context);
     }
     p->egl_context = EGL_NO_CONTEXT;
+    d3d11_swapchain_uninit(ctx);
     if (p->egl_display)
         eglTerminate(p->egl_display);
     vo_w32_uninit(ctx->vo);
@@ -66,6 +120,7 @@ static EGLConfig select_fb_config_egl(struct MPGLContext *ctx)
     struct priv *p = ctx->priv;
 
     EGLint attributes[] = {
+        EGL_SURFACE_TYPE, EGL_WINDOW_BIT | EGL_PBUFFER_BIT,
         EGL_RED_SIZE, 8,
         EGL_GREEN_SIZE, 8,
         EGL_BLUE_SIZE, 8,
@@ -148,6 +203,8 @@ static void d3d_init(struct MPGLContext *ctx)
     EGLAttrib d3d11_dev_attr;
     if (eglQueryDeviceAttribEXT(dev, EGL_D3D11_DEVICE_ANGLE, &d3d11_dev_attr)) {
         ID3D11Device *d3d11_dev = (ID3D11Device*)d3d11_dev_attr;
+        ID3D11Device_AddRef(d3d11_dev);
+        p->d3d11_device = d3d11_dev;
 
         hr = ID3D11Device_QueryInterface(d3d11_dev, &IID_IDXGIDevice,
             (void**)&dxgi_dev);
@@ -195,6 +252,12 @@ static void d3d_init(struct MPGLContext *ctx)
         IDXGIFactory_MakeWindowAssociation(dxgi_factory, vo_w32_hwnd(vo),
             DXGI_MWA_NO_WINDOW_CHANGES | DXGI_MWA_NO_ALT_ENTER |
             DXGI_MWA_NO_PRINT_SCREEN);
+
+        // Needed for flip-model swapchains (Windows 8 and up)
+        hr = IDXGIFactory_QueryInterface(dxgi_factory, &IID_IDXGIFactory2,
+            (void**)&p->dxgi_factory2);
+        if (FAILED(hr))
+            p->dxgi_factory2 = NULL;
     }
 
 done:
@@ -208,6 +271,205 @@ done:
         IDXGIFactory_Release(dxgi_factory);
 }
 
+static bool window_surface_create(MPGLContext *ctx, int flags,
+                                  const char *exts)
+{
+    struct priv *p = ctx->priv;
+
+    int window_attribs_len = 0;
+    EGLint *window_attribs = NULL;
+
+    EGLint flip_val;
+    if (eglGetConfigAttrib(p->egl_display, p->egl_config,
+                           EGL_OPTIMAL_SURFACE_ORIENTATION_ANGLE, &flip_val))
+    {
+        if (flip_val == EGL_SURFACE_ORIENTATION_INVERT_Y_ANGLE) {
+            MP_TARRAY_APPEND(NULL, window_attribs, window_attribs_len,
+                EGL_SURFACE_ORIENTATION_ANGLE);
+            MP_TARRAY_APPEND(NULL, window_attribs, window_attribs_len,
+                EGL_SURFACE_ORIENTATION_INVERT_Y_ANGLE);
+            ctx->flip_v = true;
+            MP_VERBOSE(ctx->vo, "Rendering flipped.\n");
+        }
+    }
+
+    // EGL_DIRECT_COMPOSITION_ANGLE enables the use of flip-mode present, which
+    // avoids a copy of the video image and lowers vsync jitter, though the
+    // extension is only present on Windows 8 and up, and might have subpar
+    // behavior with some drivers (Intel? symptom - whole desktop is black for
+    // some seconds after spending some minutes in fullscreen and then leaving
+    // fullscreen).
+    if ((flags & VOFLAG_ANGLE_DCOMP) &&
+        strstr(exts, "EGL_ANGLE_direct_composition"))
+    {
+        MP_TARRAY_APPEND(NULL, window_attribs, window_attribs_len,
+            EGL_DIRECT_COMPOSITION_ANGLE);
+        MP_TARRAY_APPEND(NULL, window_attribs, window_attribs_len, EGL_TRUE);
+        MP_VERBOSE(ctx->vo, "Using DirectComposition.\n");
+    }
+
+    MP_TARRAY_APPEND(NULL, window_attribs, window_attribs_len, EGL_NONE);
+    p->egl_surface = eglCreateWindowSurface(p->egl_display, p->egl_config,
+                                            vo_w32_hwnd(ctx->vo), window_attribs);
+    talloc_free(window_attribs);
+    if (p->egl_surface == EGL_NO_SURFACE) {
+        MP_FATAL(ctx->vo, "Could not create EGL surface!\n");
+        return false;
+    }
+
+    return true;
+}
+
+static bool d3d11_backbuffer_get(MPGLContext *ctx)
+{
+    struct priv *p = ctx->priv;
+    HRESULT hr;
+
+    ID3D11Texture2D *backbuffer;
+    hr = IDXGISwapChain1_GetBuffer(p->dxgi_swapchain, 0, &IID_ID3D11Texture2D,
+                                   (void**)&backbuffer);
+    if (FAILED(hr)) {
+        MP_ERR(ctx->vo, "Couldn't get swapchain backbuffer: %s\n",
+               mp_HRESULT_to_str(hr));
+        return false;
+    }
+
+    // With flip-model swapchains, buffer 0 always refers to the current
+    // backbuffer, so the pbuffer only has to be recreated on resize. ANGLE
+    // keeps its own reference to the texture.
+    EGLint pbuffer_attributes[] = { EGL_NONE };
+    p->egl_surface = eglCreatePbufferFromClientBuffer(p->egl_display,
+        EGL_D3D_TEXTURE_ANGLE, (EGLClientBuffer)backbuffer, p->egl_config,
+        pbuffer_attributes);
+    ID3D11Texture2D_Release(backbuffer);
+    if (p->egl_surface == EGL_NO_SURFACE) {
+        MP_ERR(ctx->vo, "Couldn't create EGL pbuffer for backbuffer\n");
+        return false;
+    }
+
+    if (p->egl_context) {
+        eglMakeCurrent(p->egl_display, p->egl_surface, p->egl_surface,
+                       p->egl_context);
+    }
+    return true;
+}
+
+static void d3d11_swapchain_resize(MPGLContext *ctx)
+{
+    struct priv *p = ctx->priv;
+    int w = MPMAX(1, ctx->vo->dwidth), h = MPMAX(1, ctx->vo->dheight);
+
+    if (!p->dxgi_swapchain || (w == p->sc_width && h == p->sc_height))
+        return;
+
+    // All references to the backbuffer must be gone before ResizeBuffers
+    d3d11_backbuffer_release(ctx);
+
+    HRESULT hr = IDXGISwapChain1_ResizeBuffers(p->dxgi_swapchain, 0, w, h,
+        DXGI_FORMAT_UNKNOWN, p->swapchain_flags);
+    if (FAILED(hr)) {
+        MP_ERR(ctx->vo, "Couldn't resize swapchain: %s\n",
+               mp_HRESULT_to_str(hr));
+    } else {
+        p->sc_width = w;
+        p->sc_height = h;
+    }
+
+    d3d11_backbuffer_get(ctx);
+}
+
+static bool d3d11_swapchain_create(MPGLContext *ctx, const char *exts)
+{
+    struct priv *p = ctx->priv;
+    struct vo *vo = ctx->vo;
+    HRESULT hr = E_FAIL;
+
+    if (!p->d3d11_device || !p->dxgi_factory2)
+        return false;
+    if (!exts || !strstr(exts, "EGL_ANGLE_d3d_texture_client_buffer")) {
+        MP_VERBOSE(vo, "Missing EGL_ANGLE_d3d_texture_client_buffer\n");
+        return false;
+    }
+
+    // Try the best swap effect first. FLIP_DISCARD needs Windows 10,
+    // FLIP_SEQUENTIAL needs Windows 8, and the frame latency waitable object
+    // needs Windows 8.1.
+    static const struct {
+        DXGI_SWAP_EFFECT effect;
+        UINT flags;
+    } modes[] = {
+        {DXGI_SWAP_EFFECT_FLIP_DISCARD,
+         DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT},
+        {DXGI_SWAP_EFFECT_FLIP_SEQUENTIAL,
+         DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT},
+        {DXGI_SWAP_EFFECT_FLIP_SEQUENTIAL, 0},
+    };
+    for (int n = 0; n < MP_ARRAY_SIZE(modes); n++) {
+        DXGI_SWAP_CHAIN_DESC1 desc = {
+            // 0 means "use the window size"
+            .Width = 0,
+            .Height = 0,
+            .Format = DXGI_FORMAT_R8G8B8A8_UNORM,
+            .SampleDesc = { .Count = 1 },
+            .BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT,
+            .BufferCount = 2,
+            .SwapEffect = modes[n].effect,
+            .Flags = modes[n].flags,
+        };
+        hr = IDXGIFactory2_CreateSwapChainForHwnd(p->dxgi_factory2,
+            (IUnknown*)p->d3d11_device, vo_w32_hwnd(vo), &desc, NULL, NULL,
+            &p->dxgi_swapchain);
+        if (SUCCEEDED(hr)) {
+            p->swapchain_flags = modes[n].flags;
+            break;
+        }
+    }
+    if (FAILED(hr)) {
+        MP_VERBOSE(vo, "Couldn't create flip-model swapchain: %s\n",
+                   mp_HRESULT_to_str(hr));
+        p->dxgi_swapchain = NULL;
+        return false;
+    }
+
+    DXGI_SWAP_CHAIN_DESC1 desc;
+    hr = IDXGISwapChain1_GetDesc1(p->dxgi_swapchain, &desc);
+    if (SUCCEEDED(hr)) {
+        p->sc_width = desc.Width;
+        p->sc_height = desc.Height;
+    }
+
+    // Queue at most one frame, and let start_frame() block on the waitable
+    // object until it can queue the next one. This is what removes the extra
+    // frame of latency the blocking Present() of bitblt swapchains has.
+    if (p->swapchain_flags & DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT) {
+        IDXGISwapChain2 *swapchain2;
+        hr = IDXGISwapChain1_QueryInterface(p->dxgi_swapchain,
+            &IID_IDXGISwapChain2, (void**)&swapchain2);
+        if (SUCCEEDED(hr)) {
+            IDXGISwapChain2_SetMaximumFrameLatency(swapchain2, 1);
+            p->frame_latency_wait =
+                IDXGISwapChain2_GetFrameLatencyWaitableObject(swapchain2);
+            IDXGISwapChain2_Release(swapchain2);
+        }
+    }
+
+    if (!d3d11_backbuffer_get(ctx)) {
+        IDXGISwapChain1_Release(p->dxgi_swapchain);
+        p->dxgi_swapchain = NULL;
+        if (p->frame_latency_wait)
+            CloseHandle(p->frame_latency_wait);
+        p->frame_latency_wait = NULL;
+        return false;
+    }
+
+    // GL renders into the D3D texture upside down
+    ctx->flip_v = true;
+
+    MP_VERBOSE(vo, "Using DXGI flip-model swapchain%s.\n",
+               p->frame_latency_wait ? " with frame latency waitable object" : "");
+    return true;
+}
+
 static void *get_proc_address(const GLubyte *proc_name)
 {
     return eglGetProcAddress(proc_name);
@@ -287,46 +549,14 @@ static int angle_init(struct MPGLContext *ctx, int flags)
     if (!config)
         goto fail;
 
-    int window_attribs_len = 0;
-    EGLint *window_attribs = NULL;
+    p->egl_config = config;
 
-    EGLint flip_val;
-    if (eglGetConfigAttrib(p->egl_display, config,
-                           EGL_OPTIMAL_SURFACE_ORIENTATION_ANGLE, &flip_val))
-    {
-        if (flip_val == EGL_SURFACE_ORIENTATION_INVERT_Y_ANGLE) {
-            MP_TARRAY_APPEND(NULL, window_attribs, window_attribs_len,
-                EGL_SURFACE_ORIENTATION_ANGLE);
-            MP_TARRAY_APPEND(NULL, window_attribs, window_attribs_len,
-                EGL_SURFACE_ORIENTATION_INVERT_Y_ANGLE);
-            ctx->flip_v = true;
-            MP_VERBOSE(vo, "Rendering flipped.\n");
-        }
-    }
-
-    // EGL_DIRECT_COMPOSITION_ANGLE enables the use of flip-mode present, which
-    // avoids a copy of the video image and lowers vsync jitter, though the
-    // extension is only present on Windows 8 and up, and might have subpar
-    // behavior with some drivers (Intel? symptom - whole desktop is black for
-    // some seconds after spending some minutes in fullscreen and then leaving
-    // fullscreen).
-    if ((flags & VOFLAG_ANGLE_DCOMP) &&
-        strstr(exts, "EGL_ANGLE_direct_composition"))
-    {
-        MP_TARRAY_APPEND(NULL, window_attribs, window_attribs_len,
-            EGL_DIRECT_COMPOSITION_ANGLE);
-        MP_TARRAY_APPEND(NULL, window_attribs, window_attribs_len, EGL_TRUE);
-        MP_VERBOSE(vo, "Using DirectComposition.\n");
-    }
+    // Configure the underlying Direct3D device
+    d3d_init(ctx);
 
-    MP_TARRAY_APPEND(NULL, window_attribs, window_attribs_len, EGL_NONE);
-    p->egl_surface = eglCreateWindowSurface(p->egl_display, config,
-                                            vo_w32_hwnd(vo), window_attribs);
-    talloc_free(window_attribs);
-    if (p->egl_surface == EGL_NO_SURFACE) {
-        MP_FATAL(ctx->vo, "Could not create EGL surface!\n");
+    if (!((flags & VOFLAG_ANGLE_FLIP) && d3d11_swapchain_create(ctx, exts)) &&
+        !window_surface_create(ctx, flags, exts))
         goto fail;
-    }
 
     if (!(!p->use_es2 && create_context_egl(ctx, config, 3)) &&
         !create_context_egl(ctx, config, 2))
@@ -335,9 +565,6 @@ static int angle_init(struct MPGLContext *ctx, int flags)
         goto fail;
     }
 
-    // Configure the underlying Direct3D device
-    d3d_init(ctx);
-
     if (strstr(exts, "EGL_NV_post_sub_buffer")) {
         p->eglPostSubBufferNV =
             (PFNEGLPOSTSUBBUFFERNVPROC)eglGetProcAddress("eglPostSubBufferNV");
@@ -365,14 +592,49 @@ static int angle_init_es2(struct MPGLContext *ctx, int flags)
 static int angle_reconfig(struct MPGLContext *ctx)
 {
     vo_w32_config(ctx->vo);
+    d3d11_swapchain_resize(ctx);
     return 0;
 }
 
+static int d3d11_get_present_timing(MPGLContext *ctx,
+                                    struct voctrl_present_timing *t)
+{
+    struct priv *p = ctx->priv;
+    if (!p->dxgi_swapchain)
+        return VO_NOTAVAIL;
+
+    DXGI_FRAME_STATISTICS stats;
+    HRESULT hr = IDXGISwapChain1_GetFrameStatistics(p->dxgi_swapchain, &stats);
+    if (FAILED(hr) || !stats.SyncQPCTime.QuadPart)
+        return VO_NOTAVAIL;
+
+    // Same conversion as mp_raw_time_us() in timer-win2.c.
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    uint64_t qpc = stats.SyncQPCTime.QuadPart;
+    uint64_t us = qpc / freq.QuadPart * 1000000 +
+                  qpc % freq.QuadPart * 1000000 / freq.QuadPart;
+
+    t->time = mp_time_us_from_raw(us);
+    t->vsync_count = stats.SyncRefreshCount;
+    return VO_TRUE;
+}
+
 static int angle_control(MPGLContext *ctx, int *events, int request, void *arg)
 {
     struct priv *p = ctx->priv;
+
+    if (request == VOCTRL_GET_PRESENT_TIMING)
+        return d3d11_get_present_timing(ctx, arg);
+
     int r = vo_w32_control(ctx->vo, events, request, arg);
 
+    if (p->dxgi_swapchain) {
+        if (*events & VO_EVENT_RESIZE)
+            d3d11_swapchain_resize(ctx);
+        return r;
+    }
+
     // Calling eglPostSubBufferNV with a 0-sized region doesn't present a frame
     // or block, but it does update the swapchain to match the window size
     // See: https://groups.google.com/d/msg/angleproject/RvyVkjRCQGU/gfKfT64IAgAJ
@@ -385,7 +647,30 @@ static int angle_control(MPGLContext *ctx, int *events, int request, void *arg)
 static void angle_swap_buffers(MPGLContext *ctx)
 {
     struct priv *p = ctx->priv;
-    eglSwapBuffers(p->egl_display, p->egl_surface);
+
+    if (!p->dxgi_swapchain) {
+        eglSwapBuffers(p->egl_display, p->egl_surface);
+        return;
+    }
+
+    // ANGLE and the swapchain share the same immediate context, so flushing
+    // is enough to get the rendering in before the present.
+    ctx->gl->Flush();
+
+    HRESULT hr = IDXGISwapChain1_Present(p->dxgi_swapchain, 1, 0);
+    if (FAILED(hr))
+        MP_ERR(ctx->vo, "Failed to present: %s\n", mp_HRESULT_to_str(hr));
+}
+
+static void angle_start_frame(MPGLContext *ctx)
+{
+    struct priv *p = ctx->priv;
+
+    // Block until the swapchain can accept another frame, before rendering
+    // it. Waiting after Present() instead would render the frame early, and
+    // add the time spent waiting to the latency again.
+    if (p->frame_latency_wait)
+        WaitForSingleObjectEx(p->frame_latency_wait, 1000, TRUE);
 }
 
 const struct mpgl_driver mpgl_driver_angle = {
@@ -393,6 +678,7 @@ const struct mpgl_driver mpgl_driver_angle = {
     .priv_size      = sizeof(struct priv),
     .init           = angle_init,
     .reconfig       = angle_reconfig,
+    .start_frame    = angle_start_frame,
     .swap_buffers   = angle_swap_buffers,
     .control        = angle_control,
     .uninit         = angle_uninit,
@@ -403,6 +689,7 @@ const struct mpgl_driver mpgl_driver_angle_es2 = {
     .priv_size      = sizeof(struct priv),
     .init           = angle_init_es2,
     .reconfig       = angle_reconfig,
+    .start_frame    = angle_start_frame,
     .swap_buffers   = angle_swap_buffers,
     .control        = angle_control,
     .uninit         = angle_uninit,
@@ -20,6 +20,7 @@
 #include <initguid.h>
 #include <d3d9.h>
 #include <dwmapi.h>
+#include "osdep/timer.h"
 #include "osdep/windows_utils.h"
 #include "video/out/w32_common.h"
 #include "context.h"
@@ -593,9 +594,38 @@ static void dxinterop_swap_buffers(MPGLContext *ctx)
     }
 }
 
+// Only works with exclusive fullscreen (or flip-ex swap chains); fails with
+// D3DERR_INVALIDCALL otherwise.
+static int dxinterop_get_present_timing(MPGLContext *ctx,
+                                        struct voctrl_present_timing *t)
+{
+    struct priv *p = ctx->priv;
+    if (!p->swapchain || p->lost_device)
+        return VO_NOTAVAIL;
+
+    D3DPRESENTSTATS stats;
+    HRESULT hr = IDirect3DSwapChain9Ex_GetPresentStats(p->swapchain, &stats);
+    if (FAILED(hr) || !stats.SyncQPCTime.QuadPart)
+        return VO_NOTAVAIL;
+
+    // Same conversion as mp_raw_time_us() in timer-win2.c.
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    uint64_t qpc = stats.SyncQPCTime.QuadPart;
+    uint64_t us = qpc / freq.QuadPart * 1000000 +
+                  qpc % freq.QuadPart * 1000000 / freq.QuadPart;
+
+    t->time = mp_time_us_from_raw(us);
+    t->vsync_count = stats.SyncRefreshCount;
+    return VO_TRUE;
+}
+
 static int dxinterop_control(MPGLContext *ctx, int *events, int request,
                              void *arg)
 {
+    if (request == VOCTRL_GET_PRESENT_TIMING)
+        return dxinterop_get_present_timing(ctx, arg);
+
     int r = vo_w32_control(ctx->vo, events, request, arg);
     if (*events & VO_EVENT_RESIZE)
         dxinterop_reset(ctx);
@@ -16,6 +16,7 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "osdep/timer.h"
 #include "video/out/wayland_common.h"
 #include "context.h"
 
@@ -198,6 +199,9 @@ static void waylandgl_uninit(MPGLContext *ctx)
     vo_wayland_uninit(ctx->vo);
 }
 
+// Maximum time to wait for the frame callback of the previous frame.
+#define FRAME_CALLBACK_TIMEOUT_US (50 * 1000)
+
 static void waylandgl_swap_buffers(MPGLContext *ctx)
 {
     struct vo_wayland_state *wl = ctx->vo->wayland;
@@ -205,9 +209,19 @@ static void waylandgl_swap_buffers(MPGLContext *ctx)
     if (!wl->frame.callback)
         vo_wayland_request_frame(ctx->vo, NULL, NULL);
 
+    // Don't queue a new frame before the compositor has repainted since the
+    // last one. This paces rendering to the compositor (e.g. no frames are
+    // rendered at full rate while the window is hidden). The timeout keeps
+    // playback going if the compositor stops sending callbacks.
+    int64_t until = mp_time_us() + FRAME_CALLBACK_TIMEOUT_US;
+    while (wl->frame.pending && mp_time_us() < until)
+        vo_wayland_wait_events(ctx->vo, until);
+    wl->frame.pending = false;
+
     vo_wayland_wait_events(ctx->vo, 0);
 
     eglSwapBuffers(wl->egl_context.egl.dpy, wl->egl_context.egl_surface);
+    wl->frame.pending = true;
 }
 
 static int waylandgl_control(MPGLContext *ctx, int *events, int request,
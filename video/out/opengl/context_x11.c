@@ -21,13 +21,19 @@
 #define MP_GET_GLX_WORKAROUNDS
 #include "header_fixes.h"
 
+#include "osdep/timer.h"
 #include "video/out/x11_common.h"
 #include "context.h"
 
+// GLX_OML_sync_control
+typedef Bool (*glXGetSyncValuesOMLProc)(Display *, GLXDrawable,
+                                        int64_t *, int64_t *, int64_t *);
+
 struct glx_context {
     XVisualInfo *vinfo;
     GLXContext context;
     GLXFBConfig fbc;
+    glXGetSyncValuesOMLProc GetSyncValuesOML;
 };
 
 static void glx_uninit(MPGLContext *ctx)
@@ -271,6 +277,13 @@ static int glx_init(struct MPGLContext *ctx, int flags)
     if (!success)
         goto uninit;
 
+    const char *glxstr =
+        glXQueryExtensionsString(vo->x11->display, vo->x11->screen);
+    if (glxstr && strstr(glxstr, "GLX_OML_sync_control")) {
+        glx_ctx->GetSyncValuesOML = (glXGetSyncValuesOMLProc)
+            glXGetProcAddressARB((const GLubyte *)"glXGetSyncValuesOML");
+    }
+
     return 0;
 
 uninit:
@@ -297,9 +310,30 @@ static int glx_reconfig(struct MPGLContext *ctx)
     return 0;
 }
 
+// The UST is in microseconds, and on Linux uses CLOCK_MONOTONIC like our timer.
+// (vo.c rejects timestamps that are obviously from a different time base.)
+static int glx_get_present_timing(struct MPGLContext *ctx,
+                                  struct voctrl_present_timing *t)
+{
+    struct glx_context *glx_ctx = ctx->priv;
+    if (!glx_ctx->GetSyncValuesOML)
+        return VO_NOTIMPL;
+
+    int64_t ust, msc, sbc;
+    if (!glx_ctx->GetSyncValuesOML(ctx->vo->x11->display, ctx->vo->x11->window,
+                                   &ust, &msc, &sbc) || !ust)
+        return VO_NOTAVAIL;
+
+    t->time = mp_time_us_from_raw(ust);
+    t->vsync_count = msc;
+    return VO_TRUE;
+}
+
 static int glx_control(struct MPGLContext *ctx, int *events, int request,
                        void *arg)
 {
+    if (request == VOCTRL_GET_PRESENT_TIMING)
+        return glx_get_present_timing(ctx, arg);
     return vo_x11_control(ctx->vo, events, request, arg);
 }
 
@@ -0,0 +1,338 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * This hwdec implements an optimized output path using CUDA->OpenGL
+ * interop for frame data that is stored in CUDA device memory. The decoded
+ * surfaces are copied into GL textures on the GPU (device-to-array copies of
+ * the registered textures), so the frame data never touches system memory.
+ */
+
+#include <assert.h>
+
+#include <cuda.h>
+#include <cudaGL.h>
+
+#include "formats.h"
+#include "hwdec.h"
+#include "utils.h"
+#include "video/mp_image_pool.h"
+
+struct priv {
+    struct mp_hwdec_ctx hwctx;
+    struct mp_image layout;
+    GLuint gl_textures[2];
+    CUgraphicsResource cu_res[2];
+    bool mapped;
+
+    CUcontext cuda_ctx;
+};
+
+static int check_cu(struct gl_hwdec *hw, CUresult err, const char *func)
+{
+    const char *err_name;
+    const char *err_string;
+
+    MP_TRACE(hw, "Calling %s\n", func);
+
+    if (err == CUDA_SUCCESS)
+        return 0;
+
+    cuGetErrorName(err, &err_name);
+    cuGetErrorString(err, &err_string);
+
+    MP_ERR(hw, "%s failed", func);
+    if (err_name && err_string)
+        MP_ERR(hw, " -> %s: %s", err_name, err_string);
+    MP_ERR(hw, "\n");
+
+    return -1;
+}
+
+#define CHECK_CU(x) check_cu(hw, (x), #x)
+
+// Copy the NV12/P010 planes of a CUDA frame into host memory.
+static struct mp_image *download_image(struct mp_hwdec_ctx *ctx,
+                                       struct mp_image *hw_image,
+                                       struct mp_image_pool *swpool)
+{
+    CUcontext cuda_ctx = ctx->ctx;
+    CUcontext dummy;
+    CUresult err;
+
+    if (hw_image->imgfmt != IMGFMT_CUDA || !hw_image->params.hw_subfmt)
+        return NULL;
+
+    struct mp_image *out = mp_image_pool_get(swpool, hw_image->params.hw_subfmt,
+                                             hw_image->w, hw_image->h);
+    if (!out)
+        return NULL;
+
+    err = cuCtxPushCurrent(cuda_ctx);
+    if (err != CUDA_SUCCESS)
+        goto error;
+
+    for (int n = 0; n < out->num_planes; n++) {
+        CUDA_MEMCPY2D cpy = {
+            .srcMemoryType = CU_MEMORYTYPE_DEVICE,
+            .srcDevice     = (CUdeviceptr)hw_image->planes[n],
+            .srcPitch      = hw_image->stride[n],
+            .dstMemoryType = CU_MEMORYTYPE_HOST,
+            .dstHost       = out->planes[n],
+            .dstPitch      = out->stride[n],
+            .WidthInBytes  = mp_image_plane_w(out, n) * out->fmt.bytes[n],
+            .Height        = mp_image_plane_h(out, n),
+        };
+        err = cuMemcpy2D(&cpy);
+        if (err != CUDA_SUCCESS)
+            break;
+    }
+
+    cuCtxPopCurrent(&dummy);
+
+    if (err != CUDA_SUCCESS)
+        goto error;
+
+    mp_image_copy_attributes(out, hw_image);
+    return out;
+
+error:
+    talloc_free(out);
+    return NULL;
+}
+
+static int create(struct gl_hwdec *hw)
+{
+    GL *gl = hw->gl;
+    CUcontext cuda_ctx = NULL;
+    CUdevice device;
+    CUcontext dummy;
+    unsigned int device_count;
+    int ret = 0;
+
+    if (gl->version < 210 && gl->es < 300) {
+        MP_VERBOSE(hw, "need OpenGL >= 2.1 or OpenGL-ES >= 3.0\n");
+        return -1;
+    }
+
+    struct priv *p = talloc_zero(hw, struct priv);
+    hw->priv = p;
+
+    ret = CHECK_CU(cuInit(0));
+    if (ret < 0)
+        goto error;
+
+    // Allocate CUDA context on the device the GL context is running on.
+    ret = CHECK_CU(cuGLGetDevices(&device_count, &device, 1,
+                                  CU_GL_DEVICE_LIST_ALL));
+    if (ret < 0)
+        goto error;
+    if (device_count < 1) {
+        MP_VERBOSE(hw, "no CUDA device is associated with the GL context\n");
+        goto error;
+    }
+
+    ret = CHECK_CU(cuCtxCreate(&cuda_ctx, CU_CTX_SCHED_BLOCKING_SYNC, device));
+    if (ret < 0)
+        goto error;
+
+    p->cuda_ctx = cuda_ctx;
+
+    p->hwctx = (struct mp_hwdec_ctx){
+        .type = HWDEC_CUDA,
+        .ctx = cuda_ctx,
+        .download_image = download_image,
+    };
+    p->hwctx.driver_name = hw->driver->name;
+    hwdec_devices_add(hw->devs, &p->hwctx);
+
+    CHECK_CU(cuCtxPopCurrent(&dummy));
+
+    return 0;
+
+error:
+    if (cuda_ctx) {
+        cuCtxPopCurrent(&dummy);
+        cuCtxDestroy(cuda_ctx);
+    }
+    p->cuda_ctx = NULL;
+    return -1;
+}
+
+static void destroy_objects(struct gl_hwdec *hw)
+{
+    struct priv *p = hw->priv;
+    GL *gl = hw->gl;
+    CUcontext dummy;
+
+    if (p->cuda_ctx && !CHECK_CU(cuCtxPushCurrent(p->cuda_ctx))) {
+        for (int n = 0; n < 2; n++) {
+            if (p->cu_res[n])
+                CHECK_CU(cuGraphicsUnregisterResource(p->cu_res[n]));
+            p->cu_res[n] = NULL;
+        }
+        CHECK_CU(cuCtxPopCurrent(&dummy));
+    }
+
+    gl->DeleteTextures(2, p->gl_textures);
+    for (int n = 0; n < 2; n++)
+        p->gl_textures[n] = 0;
+}
+
+static int reinit(struct gl_hwdec *hw, struct mp_image_params *params)
+{
+    struct priv *p = hw->priv;
+    GL *gl = hw->gl;
+    CUcontext dummy;
+    int ret = 0;
+
+    assert(params->imgfmt == hw->driver->imgfmt);
+
+    // The cuvid decoders only output these formats.
+    int comp_bytes;
+    switch (params->hw_subfmt) {
+    case IMGFMT_NV12: comp_bytes = 1; break;
+    case IMGFMT_P010: comp_bytes = 2; break;
+    default:
+        MP_ERR(hw, "Unsupported CUDA surface format %s.\n",
+               mp_imgfmt_to_name(params->hw_subfmt));
+        return -1;
+    }
+
+    params->imgfmt = params->hw_subfmt;
+    params->hw_subfmt = 0;
+
+    destroy_objects(hw);
+
+    mp_image_set_params(&p->layout, params);
+
+    ret = CHECK_CU(cuCtxPushCurrent(p->cuda_ctx));
+    if (ret < 0)
+        return ret;
+
+    gl->GenTextures(2, p->gl_textures);
+    for (int n = 0; n < 2; n++) {
+        const struct gl_format *fmt = gl_find_unorm_format(gl, comp_bytes, n + 1);
+        if (!fmt) {
+            MP_ERR(hw, "No GL texture format for %d-byte components.\n",
+                   comp_bytes);
+            ret = -1;
+            goto done;
+        }
+
+        gl->BindTexture(GL_TEXTURE_2D, p->gl_textures[n]);
+        gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        gl->TexImage2D(GL_TEXTURE_2D, 0, fmt->internal_format,
+                       mp_image_plane_w(&p->layout, n),
+                       mp_image_plane_h(&p->layout, n),
+                       0, fmt->format, fmt->type, NULL);
+        gl->BindTexture(GL_TEXTURE_2D, 0);
+
+        ret = CHECK_CU(cuGraphicsGLRegisterImage(&p->cu_res[n], p->gl_textures[n],
+                                                 GL_TEXTURE_2D,
+                                                 CU_GRAPHICS_REGISTER_FLAGS_WRITE_DISCARD));
+        if (ret < 0)
+            goto done;
+    }
+
+done:
+    CHECK_CU(cuCtxPopCurrent(&dummy));
+    gl_check_error(gl, hw->log, "After initializing CUDA interop");
+    return ret;
+}
+
+static void destroy(struct gl_hwdec *hw)
+{
+    struct priv *p = hw->priv;
+
+    destroy_objects(hw);
+
+    if (p->cuda_ctx)
+        CHECK_CU(cuCtxDestroy(p->cuda_ctx));
+    p->cuda_ctx = NULL;
+
+    hwdec_devices_remove(hw->devs, &p->hwctx);
+}
+
+static int map_frame(struct gl_hwdec *hw, struct mp_image *hw_image,
+                     struct gl_hwdec_frame *out_frame)
+{
+    struct priv *p = hw->priv;
+    CUcontext dummy;
+    CUarray array;
+    int ret = 0;
+
+    ret = CHECK_CU(cuCtxPushCurrent(p->cuda_ctx));
+    if (ret < 0)
+        return ret;
+
+    ret = CHECK_CU(cuGraphicsMapResources(2, p->cu_res, 0));
+    if (ret < 0)
+        goto error;
+    p->mapped = true;
+
+    *out_frame = (struct gl_hwdec_frame) { 0 };
+
+    for (int n = 0; n < 2; n++) {
+        ret = CHECK_CU(cuGraphicsSubResourceGetMappedArray(&array, p->cu_res[n],
+                                                           0, 0));
+        if (ret < 0)
+            goto error;
+
+        CUDA_MEMCPY2D cpy = {
+            .srcMemoryType = CU_MEMORYTYPE_DEVICE,
+            .srcDevice     = (CUdeviceptr)hw_image->planes[n],
+            .srcPitch      = hw_image->stride[n],
+            .dstMemoryType = CU_MEMORYTYPE_ARRAY,
+            .dstArray      = array,
+            .WidthInBytes  = mp_image_plane_w(&p->layout, n) *
+                             p->layout.fmt.bytes[n],
+            .Height        = mp_image_plane_h(&p->layout, n),
+        };
+        ret = CHECK_CU(cuMemcpy2D(&cpy));
+        if (ret < 0)
+            goto error;
+
+        out_frame->planes[n] = (struct gl_hwdec_plane){
+            .gl_texture = p->gl_textures[n],
+            .gl_target = GL_TEXTURE_2D,
+            .tex_w = mp_image_plane_w(&p->layout, n),
+            .tex_h = mp_image_plane_h(&p->layout, n),
+        };
+    }
+
+error:
+    if (p->mapped)
+        CHECK_CU(cuGraphicsUnmapResources(2, p->cu_res, 0));
+    p->mapped = false;
+    CHECK_CU(cuCtxPopCurrent(&dummy));
+
+    return ret;
+}
+
+const struct gl_hwdec_driver gl_hwdec_cuda = {
+    .name = "cuda",
+    .api = HWDEC_CUDA,
+    .imgfmt = IMGFMT_CUDA,
+    .create = create,
+    .reinit = reinit,
+    .map_frame = map_frame,
+    .destroy = destroy,
+};
@@ -17,6 +17,7 @@
 
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
 
 #include "mpv_talloc.h"
 
@@ -29,6 +30,9 @@
 #include "options/m_config.h"
 #include "options/m_option.h"
 #include "options/path.h"
+#include "misc/thread_pool.h"
+#include "osdep/atomics.h"
+#include "osdep/threads.h"
 #include "video/csputils.h"
 #include "lcms.h"
 
@@ -39,6 +43,46 @@
 #include <lcms2.h>
 #include <libavutil/sha.h>
 #include <libavutil/mem.h>
+#include <libavutil/cpu.h>
+
+// Number of generated LUTs kept in memory, so that switching between e.g. SDR
+// and HDR content doesn't regenerate them.
+#define LUT_CACHE_SIZE 4
+
+// The newest LUT is always kept, the others only while the total size is below
+// this. (A 256x256x256 LUT takes 96 MB.)
+#define LUT_CACHE_MAX_BYTES (256 * 1024 * 1024)
+
+struct lut_entry {
+    enum mp_csp_prim prim;
+    enum mp_csp_trc trc;
+    struct lut3d *lut;
+};
+
+// A LUT generated on the background thread. All fields are immutable while
+// the thread is running, except the ones noted.
+struct lut_job {
+    struct mp_log *log;
+    struct mpv_global *global;
+    struct mp_thread_pool *pool;
+    struct gl_lcms *owner;
+    int generation;
+    void *icc_data;
+    size_t icc_size;
+    char *cache_dir;
+    int intent, contrast;
+    int size[3];
+    enum mp_csp_prim prim;
+    enum mp_csp_trc trc;
+
+    // Used by the slice workers.
+    cmsHTRANSFORM trafo;
+    uint16_t *output;
+
+    // Result (set by the thread).
+    struct lut3d *lut;      // NULL on failure
+    bool done;              // protected by owner->lock
+};
 
 struct gl_lcms {
     void *icc_data;
@@ -51,6 +95,26 @@ struct gl_lcms {
     struct mp_log *log;
     struct mpv_global *global;
     struct mp_icc_opts *opts;
+
+    // Incremented whenever the profile or options change; LUTs generated with
+    // older values are discarded.
+    int generation;
+    struct lut_entry *cache;    // newest entries last
+    int num_cache;
+    // Whether the last failed job was for these parameters (don't retry).
+    bool failed;
+    int failed_generation;
+    enum mp_csp_prim failed_prim;
+    enum mp_csp_trc failed_trc;
+
+    struct mp_thread_pool *pool;
+    pthread_mutex_t lock;
+    pthread_t thread;
+    struct lut_job *job;    // if non-NULL, the thread must be joined
+    atomic_bool abort;      // abort the running job
+
+    void (*wakeup_cb)(void *ctx);
+    void *wakeup_ctx;
 };
 
 static bool parse_3dlut_size(const char *arg, int *p1, int *p2, int *p3)
@@ -97,8 +161,8 @@ const struct m_sub_options mp_icc_conf = {
 static void lcms2_error_handler(cmsContext ctx, cmsUInt32Number code,
                                 const char *msg)
 {
-    struct gl_lcms *p = cmsGetContextUserData(ctx);
-    MP_ERR(p, "lcms2: %s\n", msg);
+    struct lut_job *job = cmsGetContextUserData(ctx);
+    MP_ERR(job, "lcms2: %s\n", msg);
 }
 
 static void load_profile(struct gl_lcms *p)
@@ -125,6 +189,64 @@ static void load_profile(struct gl_lcms *p)
     p->icc_size = iccdata.len;
 }
 
+// Wait for the background thread, and add its LUT to the cache. If block is
+// false, this does nothing if the job is still running.
+static void collect_job(struct gl_lcms *p, bool block)
+{
+    struct lut_job *job = p->job;
+    if (!job)
+        return;
+
+    pthread_mutex_lock(&p->lock);
+    bool done = job->done;
+    pthread_mutex_unlock(&p->lock);
+    if (!done && !block)
+        return;
+
+    pthread_join(p->thread, NULL);
+    p->job = NULL;
+
+    if (job->generation == p->generation) {
+        if (job->lut) {
+            if (p->num_cache == LUT_CACHE_SIZE) {
+                talloc_free(p->cache[0].lut);
+                MP_TARRAY_REMOVE_AT(p->cache, p->num_cache, 0);
+            }
+            struct lut_entry e = {
+                .prim = job->prim,
+                .trc = job->trc,
+                .lut = talloc_steal(p, job->lut),
+            };
+            MP_TARRAY_APPEND(p, p->cache, p->num_cache, e);
+        } else {
+            p->failed = true;
+            p->failed_generation = job->generation;
+            p->failed_prim = job->prim;
+            p->failed_trc = job->trc;
+        }
+    }
+
+    talloc_free(job);
+}
+
+static void invalidate_luts(struct gl_lcms *p)
+{
+    p->generation++;
+    atomic_store(&p->abort, true);
+    for (int n = 0; n < p->num_cache; n++)
+        talloc_free(p->cache[n].lut);
+    p->num_cache = 0;
+    p->failed = false;
+}
+
+static void gl_lcms_destroy(void *ptr)
+{
+    struct gl_lcms *p = ptr;
+    atomic_store(&p->abort, true);
+    collect_job(p, true);
+    pthread_mutex_destroy(&p->lock);
+}
+
 struct gl_lcms *gl_lcms_init(void *talloc_ctx, struct mp_log *log,
                              struct mpv_global *global)
 {
@@ -135,9 +257,21 @@ struct gl_lcms *gl_lcms_init(void *talloc_ctx, struct mp_log *log,
         .changed = true,
         .opts = m_sub_options_copy(p, &mp_icc_conf, mp_icc_conf.defaults),
     };
+    pthread_mutex_init(&p->lock, NULL);
+    talloc_set_destructor(p, gl_lcms_destroy);
     return p;
 }
 
+// cb is called from the LUT generation thread when a LUT is ready. It must not
+// call back into gl_lcms.
+void gl_lcms_set_wakeup(struct gl_lcms *p, void (*cb)(void *ctx), void *ctx)
+{
+    pthread_mutex_lock(&p->lock);
+    p->wakeup_cb = cb;
+    p->wakeup_ctx = ctx;
+    pthread_mutex_unlock(&p->lock);
+}
+
 void gl_lcms_set_options(struct gl_lcms *p, struct mp_icc_opts *opts)
 {
     struct mp_icc_opts *old_opts = p->opts;
@@ -150,6 +284,7 @@ void gl_lcms_set_options(struct gl_lcms *p, struct mp_icc_opts *opts)
     }
 
     p->changed = true; // probably
+    invalidate_luts(p);
 
     talloc_free(old_opts);
 }
@@ -175,6 +310,7 @@ bool gl_lcms_set_memory_profile(struct gl_lcms *p, bstr profile)
 
     p->changed = true;
     p->using_memory_profile = true;
+    invalidate_luts(p);
 
     talloc_free(p->icc_data);
 
@@ -203,7 +339,7 @@ bool gl_lcms_has_profile(struct gl_lcms *p)
     return p->icc_size > 0;
 }
 
-static cmsHPROFILE get_vid_profile(struct gl_lcms *p, cmsContext cms,
+static cmsHPROFILE get_vid_profile(struct lut_job *p, cmsContext cms,
                                    cmsHPROFILE disp_profile,
                                    enum mp_csp_prim prim, enum mp_csp_trc trc)
 {
@@ -265,9 +401,9 @@ static cmsHPROFILE get_vid_profile(struct gl_lcms *p, cmsContext cms,
         cmsDeleteTransform(xyz2src);
 
         // Contrast limiting
-        if (p->opts->contrast > 0) {
+        if (p->contrast > 0) {
             for (int i = 0; i < 3; i++)
-                src_black[i] = MPMAX(src_black[i], 1.0 / p->opts->contrast);
+                src_black[i] = MPMAX(src_black[i], 1.0 / p->contrast);
         }
 
         // Built-in contrast failsafe
@@ -309,17 +445,33 @@ static cmsHPROFILE get_vid_profile(struct gl_lcms *p, cmsContext cms,
     return vid_profile;
 }
 
-bool gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **result_lut3d,
-                       enum mp_csp_prim prim, enum mp_csp_trc trc)
+// Transform one (s_r)x(s_g) slice of the (s_r)x(s_g)x(s_b) cube, with 3
+// components per channel.
+static void lut_slice(void *ctx, int b)
 {
-    int s_r, s_g, s_b;
-    bool result = false;
+    struct lut_job *job = ctx;
+    int s_r = job->size[0], s_g = job->size[1], s_b = job->size[2];
 
-    if (!parse_3dlut_size(p->opts->size_str, &s_r, &s_g, &s_b))
-        return false;
+    if (atomic_load(&job->owner->abort))
+        return;
 
-    if (!gl_lcms_has_profile(p))
-        return false;
+    uint16_t input[512 * 3];
+    for (int g = 0; g < s_g; g++) {
+        for (int r = 0; r < s_r; r++) {
+            input[r * 3 + 0] = r * 65535 / (s_r - 1);
+            input[r * 3 + 1] = g * 65535 / (s_g - 1);
+            input[r * 3 + 2] = b * 65535 / (s_b - 1);
+        }
+        size_t base = (b * s_r * s_g + g * s_r) * 3;
+        cmsDoTransform(job->trafo, input, job->output + base, s_r);
+    }
+}
+
+static struct lut3d *generate_lut(struct lut_job *job)
+{
+    int s_r = job->size[0], s_g = job->size[1], s_b = job->size[2];
+    enum mp_csp_prim prim = job->prim;
+    enum mp_csp_trc trc = job->trc;
 
     void *tmp = talloc_new(NULL);
     uint16_t *output = talloc_array(tmp, uint16_t, s_r * s_g * s_b * 3);
@@ -327,14 +479,14 @@ bool gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **result_lut3d,
     cmsContext cms = NULL;
 
     char *cache_file = NULL;
-    if (p->opts->cache_dir && p->opts->cache_dir[0]) {
+    if (job->cache_dir && job->cache_dir[0]) {
         // Gamma is included in the header to help uniquely identify it,
         // because we may change the parameter in the future or make it
         // customizable, same for the primaries.
         char *cache_info = talloc_asprintf(tmp,
                 "ver=1.3, intent=%d, size=%dx%dx%d, prim=%d, trc=%d, "
                 "contrast=%d\n",
-                p->opts->intent, s_r, s_g, s_b, prim, trc, p->opts->contrast);
+                job->intent, s_r, s_g, s_b, prim, trc, job->contrast);
 
         uint8_t hash[32];
         struct AVSHA *sha = av_sha_alloc();
@@ -342,11 +494,11 @@ bool gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **result_lut3d,
             abort();
         av_sha_init(sha, 256);
         av_sha_update(sha, cache_info, strlen(cache_info));
-        av_sha_update(sha, p->icc_data, p->icc_size);
+        av_sha_update(sha, job->icc_data, job->icc_size);
         av_sha_final(sha, hash);
         av_free(sha);
 
-        char *cache_dir = mp_get_user_path(tmp, p->global, p->opts->cache_dir);
+        char *cache_dir = mp_get_user_path(tmp, job->global, job->cache_dir);
         cache_file = talloc_strdup(tmp, "");
         for (int i = 0; i < sizeof(hash); i++)
             cache_file = talloc_asprintf_append(cache_file, "%02X", hash[i]);
@@ -357,28 +509,28 @@ bool gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **result_lut3d,
 
     // check cache
     if (cache_file && stat(cache_file, &(struct stat){0}) == 0) {
-        MP_VERBOSE(p, "Opening 3D LUT cache in file '%s'.\n", cache_file);
-        struct bstr cachedata = stream_read_file(cache_file, tmp, p->global,
+        MP_VERBOSE(job, "Opening 3D LUT cache in file '%s'.\n", cache_file);
+        struct bstr cachedata = stream_read_file(cache_file, tmp, job->global,
                                                  1000000000); // 1 GB
         if (cachedata.len == talloc_get_size(output)) {
             memcpy(output, cachedata.start, cachedata.len);
             goto done;
         } else {
-            MP_WARN(p, "3D LUT cache invalid!\n");
+            MP_WARN(job, "3D LUT cache invalid!\n");
         }
     }
 
-    cms = cmsCreateContext(NULL, p);
+    cms = cmsCreateContext(NULL, job);
     if (!cms)
         goto error_exit;
     cmsSetLogErrorHandlerTHR(cms, lcms2_error_handler);
 
     cmsHPROFILE profile =
-        cmsOpenProfileFromMemTHR(cms, p->icc_data, p->icc_size);
+        cmsOpenProfileFromMemTHR(cms, job->icc_data, job->icc_size);
     if (!profile)
         goto error_exit;
 
-    cmsHPROFILE vid_profile = get_vid_profile(p, cms, profile, prim, trc);
+    cmsHPROFILE vid_profile = get_vid_profile(job, cms, profile, prim, trc);
     if (!vid_profile) {
         cmsCloseProfile(profile);
         goto error_exit;
@@ -386,7 +538,7 @@ bool gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **result_lut3d,
 
     cmsHTRANSFORM trafo = cmsCreateTransformTHR(cms, vid_profile, TYPE_RGB_16,
                                                 profile, TYPE_RGB_16,
-                                                p->opts->intent,
+                                                job->intent,
                                                 cmsFLAGS_HIGHRESPRECALC |
                                                 cmsFLAGS_BLACKPOINTCOMPENSATION);
     cmsCloseProfile(profile);
@@ -395,22 +547,17 @@ bool gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **result_lut3d,
     if (!trafo)
         goto error_exit;
 
-    // transform a (s_r)x(s_g)x(s_b) cube, with 3 components per channel
-    uint16_t *input = talloc_array(tmp, uint16_t, s_r * 3);
-    for (int b = 0; b < s_b; b++) {
-        for (int g = 0; g < s_g; g++) {
-            for (int r = 0; r < s_r; r++) {
-                input[r * 3 + 0] = r * 65535 / (s_r - 1);
-                input[r * 3 + 1] = g * 65535 / (s_g - 1);
-                input[r * 3 + 2] = b * 65535 / (s_b - 1);
-            }
-            size_t base = (b * s_r * s_g + g * s_r) * 3;
-            cmsDoTransform(trafo, input, output + base, s_r);
-        }
-    }
+    // cmsDoTransform() is thread-safe, so each b slice can be done in parallel.
+    job->trafo = trafo;
+    job->output = output;
+    mp_thread_pool_run(job->pool, lut_slice, job, s_b);
 
     cmsDeleteTransform(trafo);
 
+    // Don't write a partially computed LUT to the cache.
+    if (atomic_load(&job->owner->abort))
+        goto error_exit;
+
     if (cache_file) {
         FILE *out = fopen(cache_file, "wb");
         if (out) {
@@ -427,19 +574,119 @@ done: ;
         .size = {s_r, s_g, s_b},
     };
 
-    *result_lut3d = lut;
-    result = true;
-
 error_exit:
 
     if (cms)
         cmsDeleteContext(cms);
 
-    if (!lut)
-        MP_FATAL(p, "Error loading ICC profile.\n");
+    if (!lut && !atomic_load(&job->owner->abort))
+        MP_FATAL(job, "Error loading ICC profile.\n");
 
     talloc_free(tmp);
-    return result;
+    return lut;
+}
+
+static void *lut_thread(void *arg)
+{
+    struct lut_job *job = arg;
+    struct gl_lcms *p = job->owner;
+    mpthread_set_name("lut3d");
+
+    job->lut = generate_lut(job);
+
+    pthread_mutex_lock(&p->lock);
+    job->done = true;
+    void (*cb)(void *ctx) = p->wakeup_cb;
+    void *cb_ctx = p->wakeup_ctx;
+    pthread_mutex_unlock(&p->lock);
+
+    if (cb)
+        cb(cb_ctx);
+    return NULL;
+}
+
+static void start_job(struct gl_lcms *p, int size[3], enum mp_csp_prim prim,
+                      enum mp_csp_trc trc)
+{
+    if (!p->pool)
+        p->pool = mp_thread_pool_create(p, av_cpu_count() - 1);
+
+    struct lut_job *job = talloc_ptrtype(NULL, job);
+    *job = (struct lut_job) {
+        .log = p->log,
+        .global = p->global,
+        .pool = p->pool,
+        .owner = p,
+        .generation = p->generation,
+        .icc_data = talloc_memdup(job, p->icc_data, p->icc_size),
+        .icc_size = p->icc_size,
+        .cache_dir = talloc_strdup(job, p->opts->cache_dir),
+        .intent = p->opts->intent,
+        .contrast = p->opts->contrast,
+        .size = {size[0], size[1], size[2]},
+        .prim = prim,
+        .trc = trc,
+    };
+
+    atomic_store(&p->abort, false);
+    p->job = job;
+    if (pthread_create(&p->thread, NULL, lut_thread, job)) {
+        p->job = NULL;
+        talloc_free(job);
+        p->failed = true;
+        p->failed_generation = p->generation;
+        p->failed_prim = prim;
+        p->failed_trc = trc;
+    }
+}
+
+// Returns 1 and sets *result_lut3d if the LUT is available. The LUT is owned
+// by p, and valid until the next call. Returns 0 if the LUT is being generated
+// in the background (call it again later), and -1 on failure.
+int gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **result_lut3d,
+                      enum mp_csp_prim prim, enum mp_csp_trc trc)
+{
+    int size[3];
+
+    if (!parse_3dlut_size(p->opts->size_str, &size[0], &size[1], &size[2]))
+        return -1;
+
+    if (!gl_lcms_has_profile(p))
+        return -1;
+
+    collect_job(p, false);
+
+    for (int n = p->num_cache - 1; n >= 0; n--) {
+        struct lut_entry e = p->cache[n];
+        if (e.prim == prim && e.trc == trc) {
+            MP_TARRAY_REMOVE_AT(p->cache, p->num_cache, n);
+            MP_TARRAY_APPEND(p, p->cache, p->num_cache, e);
+            *result_lut3d = e.lut;
+            goto done;
+        }
+    }
+
+    if (p->failed && p->failed_generation == p->generation &&
+        p->failed_prim == prim && p->failed_trc == trc)
+        return -1;
+
+    // A running job for other parameters is left alone; its result will be
+    // cached, and this request is started when it's done.
+    if (!p->job)
+        start_job(p, size, prim, trc);
+    return p->job ? 0 : -1;
+
+done: ;
+    // Drop the least recently used LUTs if they take too much memory.
+    size_t total = 0;
+    for (int n = 0; n < p->num_cache; n++)
+        total += talloc_get_size(p->cache[n].lut->data);
+    while (p->num_cache > 1 && total > LUT_CACHE_MAX_BYTES) {
+        total -= talloc_get_size(p->cache[0].lut->data);
+        talloc_free(p->cache[0].lut);
+        MP_TARRAY_REMOVE_AT(p->cache, p->num_cache, 0);
+    }
+    return 1;
 }
 
 #else /* HAVE_LCMS2 */
@@ -471,10 +718,14 @@ bool gl_lcms_has_profile(struct gl_lcms *p)
     return false;
 }
 
-bool gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **result_lut3d,
-                       enum mp_csp_prim prim, enum mp_csp_trc trc)
+void gl_lcms_set_wakeup(struct gl_lcms *p, void (*cb)(void *ctx), void *ctx)
 {
-    return false;
+}
+
+int gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **result_lut3d,
+                      enum mp_csp_prim prim, enum mp_csp_trc trc)
+{
+    return -1;
 }
 
 #endif
@@ -27,11 +27,12 @@ struct gl_lcms;
 
 struct gl_lcms *gl_lcms_init(void *talloc_ctx, struct mp_log *log,
                              struct mpv_global *global);
+void gl_lcms_set_wakeup(struct gl_lcms *p, void (*cb)(void *ctx), void *ctx);
 void gl_lcms_set_options(struct gl_lcms *p, struct mp_icc_opts *opts);
 bool gl_lcms_set_memory_profile(struct gl_lcms *p, bstr profile);
 bool gl_lcms_has_profile(struct gl_lcms *p);
-bool gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **,
-                       enum mp_csp_prim prim, enum mp_csp_trc trc);
+int gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **,
+                      enum mp_csp_prim prim, enum mp_csp_trc trc);
 bool gl_lcms_has_changed(struct gl_lcms *p, enum mp_csp_prim prim,
                          enum mp_csp_trc trc);
 
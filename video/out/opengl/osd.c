@@ -16,6 +16,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <limits.h>
 
@@ -31,6 +32,8 @@ static const int blend_factors[SUBBITMAP_COUNT][4] = {
                           GL_ONE,       GL_ONE_MINUS_SRC_ALPHA},
     [SUBBITMAP_RGBA] =   {GL_ONE,       GL_ONE_MINUS_SRC_ALPHA,
                           GL_ONE,       GL_ONE_MINUS_SRC_ALPHA},
+    [SUBBITMAP_INDEXED] = {GL_ONE,      GL_ONE_MINUS_SRC_ALPHA,
+                          GL_ONE,       GL_ONE_MINUS_SRC_ALPHA},
 };
 
 struct vertex {
@@ -46,16 +49,80 @@ static const struct gl_vao_entry vertex_vao[] = {
     {0}
 };
 
+// A sub-bitmap stored in the atlas texture (SUBBITMAP_LIBASS only).
+struct atlas_entry {
+    uint64_t hash;          // of the bitmap contents
+    int w, h;
+    int x, y;               // position in the texture
+};
+
+// Entries are allocated left to right on shelves of fixed height.
+struct atlas_shelf {
+    int y, h;
+    int used_w;
+};
+
+// Persistent atlas shared by all SUBBITMAP_LIBASS parts, so that they can be
+// drawn with a single draw call. Entries are never removed individually; if
+// the texture is full, the atlas is cleared and the bitmaps are uploaded again.
+struct osd_atlas {
+    GLuint texture;
+    int w, h;
+    int generation;         // incremented on every clear
+    struct atlas_entry *entries;
+    int num_entries;
+    int *table;             // hash table, entries index + 1 (0 = free slot)
+    int table_size;         // power of 2
+    struct atlas_shelf *shelves;
+    int num_shelves;
+    int shelves_h;          // total height used by the shelves
+    bool used;              // referenced by a part of the current frame
+    bool fresh;             // cleared during the current frame
+    bool reset_pending;     // clear it at the start of the next frame
+    int req_w, req_h;       // minimum size after the next clear
+};
+
+// With --blend-subtitles, subtitles and OSD are generated in separate passes
+// (with OSD_DRAW_SUB_ONLY and OSD_DRAW_OSD_ONLY) for every frame. Each pass
+// shows a different set of parts, so part visibility is tracked per pass.
+#define NUM_OSD_PASSES 4
+#define OSD_PASS(draw_flags) \
+    (((draw_flags) & (OSD_DRAW_SUB_ONLY | OSD_DRAW_OSD_ONLY)) >> 1)
+
+// Part of the vertex cache key; if it's the same as on the last draw, the
+// vertex data is still in the VBO.
+struct verts_key {
+    int pass;
+    int64_t change_counter;     // mpgl_osd.pass_change_counter[pass]
+    int vp_w, vp_h;
+    int stereo_mode;
+    struct mp_osd_res res;
+};
+
 struct mpgl_osd_part {
     enum sub_bitmap_format format;
     int change_id;
+    // Own texture, used if the part is not in the atlas.
+    enum sub_bitmap_format tex_format;
     GLuint texture;
     int w, h;
     struct gl_pbo_upload pbo;
+    // SUBBITMAP_INDEXED: one 256 entry palette per row.
+    GLuint palette_texture;
+    int palette_h;
+    bool upload_ok;         // last upload succeeded (subparts can be drawn)
+    bool in_atlas;          // uploaded to ctx->atlas (instead of texture)
+    int atlas_generation;   // ctx->atlas.generation at upload time
+    bool batched;           // drawn together with a previous part
     int num_subparts;
-    int prev_num_subparts;
+    int prev_num_subparts[NUM_OSD_PASSES];
     struct sub_bitmap *subparts;
+    int *part_entry;        // subparts[n] => atlas.entries[part_entry[n]]
+    // Vertices for this part and all parts batched with it.
+    struct gl_vao vao;
     struct vertex *vertices;
+    int num_vertices;
+    struct verts_key verts_key;
 };
 
 struct mpgl_osd {
@@ -66,8 +133,13 @@ struct mpgl_osd {
     struct mpgl_osd_part *parts[MAX_OSD_PARTS];
     const struct gl_format *fmt_table[SUBBITMAP_COUNT];
     bool formats[SUBBITMAP_COUNT];
+    struct osd_atlas atlas;
     struct gl_vao vao;
     int64_t change_counter;
+    // Like change_counter, but only incremented for changes that affect the
+    // vertices of the given pass.
+    int64_t pass_change_counter[NUM_OSD_PASSES];
+    int pass;               // OSD_PASS() of the current mpgl_osd_generate()
     // temporary
     int stereo_mode;
     struct mp_osd_res osd_res;
@@ -86,13 +158,21 @@ struct mpgl_osd *mpgl_osd_init(GL *gl, struct mp_log *log, struct osd_state *osd
 
     ctx->fmt_table[SUBBITMAP_LIBASS] = gl_find_unorm_format(gl, 1, 1);
     ctx->fmt_table[SUBBITMAP_RGBA]   = gl_find_unorm_format(gl, 1, 4);
+    // The palettes are stored in the SUBBITMAP_RGBA format.
+    if (ctx->fmt_table[SUBBITMAP_RGBA])
+        ctx->fmt_table[SUBBITMAP_INDEXED] = gl_find_unorm_format(gl, 1, 1);
 
-    for (int n = 0; n < MAX_OSD_PARTS; n++)
-        ctx->parts[n] = talloc_zero(ctx, struct mpgl_osd_part);
+    for (int n = 0; n < MAX_OSD_PARTS; n++) {
+        struct mpgl_osd_part *part = talloc_zero(ctx, struct mpgl_osd_part);
+        gl_vao_init(&part->vao, gl, sizeof(struct vertex), vertex_vao);
+        ctx->parts[n] = part;
+    }
 
     for (int n = 0; n < SUBBITMAP_COUNT; n++)
         ctx->formats[n] = !!ctx->fmt_table[n];
 
+    // Only describes the vertex layout for the shader; every part draws from
+    // its own VBO.
     gl_vao_init(&ctx->vao, gl, sizeof(struct vertex), vertex_vao);
 
     return ctx;
@@ -110,8 +190,11 @@ void mpgl_osd_destroy(struct mpgl_osd *ctx)
     for (int n = 0; n < MAX_OSD_PARTS; n++) {
         struct mpgl_osd_part *p = ctx->parts[n];
         gl->DeleteTextures(1, &p->texture);
+        gl->DeleteTextures(1, &p->palette_texture);
         gl_pbo_upload_uninit(&p->pbo);
+        gl_vao_uninit(&p->vao);
     }
+    gl->DeleteTextures(1, &ctx->atlas.texture);
     talloc_free(ctx);
 }
 
@@ -129,6 +212,33 @@ static int next_pow2(int v)
     return INT_MAX;
 }
 
+// (Re)allocate the currently bound texture.
+static bool realloc_texture(struct mpgl_osd *ctx, const struct gl_format *fmt,
+                            int w, int h)
+{
+    GL *gl = ctx->gl;
+
+    MP_VERBOSE(ctx, "Reallocating OSD texture to %dx%d.\n", w, h);
+
+    GLint max_wh;
+    gl->GetIntegerv(GL_MAX_TEXTURE_SIZE, &max_wh);
+
+    if (w > max_wh || h > max_wh) {
+        MP_ERR(ctx, "OSD bitmaps do not fit on a surface with the maximum "
+               "supported size %dx%d.\n", max_wh, max_wh);
+        return false;
+    }
+
+    gl->TexImage2D(GL_TEXTURE_2D, 0, fmt->internal_format, w, h,
+                   0, fmt->format, fmt->type, NULL);
+
+    gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return true;
+}
+
 static bool upload_osd(struct mpgl_osd *ctx, struct mpgl_osd_part *osd,
                        struct sub_bitmaps *imgs)
 {
@@ -148,35 +258,271 @@ static bool upload_osd(struct mpgl_osd *ctx, struct mpgl_osd_part *osd,
 
     gl->BindTexture(GL_TEXTURE_2D, osd->texture);
 
-    if (req_w > osd->w || req_h > osd->h || osd->format != imgs->format) {
-        osd->format = imgs->format;
-        osd->w = FFMAX(32, req_w);
-        osd->h = FFMAX(32, req_h);
+    if (req_w > osd->w || req_h > osd->h || osd->tex_format != imgs->format) {
+        int w = FFMAX(32, req_w), h = FFMAX(32, req_h);
+        osd->tex_format = imgs->format;
+        osd->w = osd->h = 0;
+        if (!realloc_texture(ctx, fmt, w, h))
+            goto done;
+        // Indexes can't be interpolated; the shader filters after the lookup.
+        if (imgs->format == SUBBITMAP_INDEXED) {
+            gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        }
+        osd->w = w;
+        osd->h = h;
+    }
+
+    gl_pbo_upload_tex(&osd->pbo, gl, ctx->use_pbo, GL_TEXTURE_2D, fmt->format,
+                      fmt->type, osd->w, osd->h, imgs->packed->planes[0],
+                      imgs->packed->stride[0], 0, 0,
+                      imgs->packed_w, imgs->packed_h);
+    ok = true;
 
-        MP_VERBOSE(ctx, "Reallocating OSD texture to %dx%d.\n", osd->w, osd->h);
+done:
+    gl->BindTexture(GL_TEXTURE_2D, 0);
+    return ok;
+}
 
-        GLint max_wh;
-        gl->GetIntegerv(GL_MAX_TEXTURE_SIZE, &max_wh);
+// Upload the palettes of a SUBBITMAP_INDEXED part, one texture row each.
+static bool upload_palettes(struct mpgl_osd *ctx, struct mpgl_osd_part *osd,
+                            struct sub_bitmaps *imgs)
+{
+    GL *gl = ctx->gl;
+    const struct gl_format *fmt = ctx->fmt_table[SUBBITMAP_RGBA];
 
-        if (osd->w > max_wh || osd->h > max_wh) {
-            MP_ERR(ctx, "OSD bitmaps do not fit on a surface with the maximum "
-                   "supported size %dx%d.\n", max_wh, max_wh);
-            goto done;
-        }
+    assert(imgs->num_parts <= MP_SUB_MAX_PALETTES);
 
-        gl->TexImage2D(GL_TEXTURE_2D, 0, fmt->internal_format, osd->w, osd->h,
-                       0, fmt->format, fmt->type, NULL);
+    if (!osd->palette_texture)
+        gl->GenTextures(1, &osd->palette_texture);
 
-        gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    gl->BindTexture(GL_TEXTURE_2D, osd->palette_texture);
+
+    if (imgs->num_parts > osd->palette_h) {
+        int h = FFMAX(4, next_pow2(imgs->num_parts));
+        gl->TexImage2D(GL_TEXTURE_2D, 0, fmt->internal_format, 256, h,
+                       0, fmt->format, fmt->type, NULL);
+        gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
         gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        osd->palette_h = h;
+    }
+
+    for (int n = 0; n < imgs->num_parts; n++) {
+        gl_upload_tex(gl, GL_TEXTURE_2D, fmt->format, fmt->type,
+                      imgs->parts[n].palette, 256 * 4, 0, n, 256, 1);
+    }
+
+    gl->BindTexture(GL_TEXTURE_2D, 0);
+    return true;
+}
+
+static void atlas_reset(struct osd_atlas *a)
+{
+    a->num_entries = 0;
+    a->num_shelves = 0;
+    a->shelves_h = 0;
+    if (a->table)
+        memset(a->table, 0, a->table_size * sizeof(a->table[0]));
+    a->generation++;
+    a->fresh = true;
+}
+
+// FNV-1a variant working on 8 byte words.
+static uint64_t hash_bitmap(struct sub_bitmap *b)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (int y = 0; y < b->h; y++) {
+        const uint8_t *line = (uint8_t *)b->bitmap + y * b->stride;
+        int x = 0;
+        for (; x + 8 <= b->w; x += 8) {
+            uint64_t v;
+            memcpy(&v, line + x, 8);
+            h = (h ^ v) * 1099511628211ULL;
+        }
+        for (; x < b->w; x++)
+            h = (h ^ line[x]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+static int atlas_find(struct osd_atlas *a, uint64_t hash, int w, int h)
+{
+    if (!a->table_size)
+        return -1;
+    int mask = a->table_size - 1;
+    for (int i = hash & mask; a->table[i]; i = (i + 1) & mask) {
+        int idx = a->table[i] - 1;
+        struct atlas_entry *e = &a->entries[idx];
+        if (e->hash == hash && e->w == w && e->h == h)
+            return idx;
+    }
+    return -1;
+}
+
+static void atlas_insert(struct mpgl_osd *ctx, struct atlas_entry e)
+{
+    struct osd_atlas *a = &ctx->atlas;
+
+    MP_TARRAY_APPEND(ctx, a->entries, a->num_entries, e);
+
+    // Keep the load factor below 1/2.
+    if (a->num_entries * 2 > a->table_size) {
+        a->table_size = FFMAX(a->table_size * 2, 256);
+        talloc_free(a->table);
+        a->table = talloc_zero_array(ctx, int, a->table_size);
+        for (int n = 0; n < a->num_entries - 1; n++) {
+            int i = a->entries[n].hash & (a->table_size - 1);
+            while (a->table[i])
+                i = (i + 1) & (a->table_size - 1);
+            a->table[i] = n + 1;
+        }
+    }
+
+    int mask = a->table_size - 1;
+    int i = e.hash & mask;
+    while (a->table[i])
+        i = (i + 1) & mask;
+    a->table[i] = a->num_entries;
+}
+
+// Find space for a w*h bitmap. Returns false if the texture is full.
+static bool atlas_alloc(struct mpgl_osd *ctx, int w, int h,
+                        int *out_x, int *out_y)
+{
+    struct osd_atlas *a = &ctx->atlas;
+
+    if (w > a->w)
+        return false;
+
+    // Use the lowest shelf the bitmap fits on without wasting too much space.
+    struct atlas_shelf *best = NULL;
+    for (int n = 0; n < a->num_shelves; n++) {
+        struct atlas_shelf *s = &a->shelves[n];
+        if (s->h >= h && s->h <= h * 2 && s->used_w + w <= a->w &&
+            (!best || s->h < best->h))
+            best = s;
+    }
+
+    if (!best) {
+        int shelf_h = MP_ALIGN_UP(h, 4);
+        if (a->shelves_h + shelf_h > a->h)
+            return false;
+        struct atlas_shelf s = { .y = a->shelves_h, .h = shelf_h };
+        MP_TARRAY_APPEND(ctx, a->shelves, a->num_shelves, s);
+        a->shelves_h += shelf_h;
+        best = &a->shelves[a->num_shelves - 1];
+    }
+
+    *out_x = best->used_w;
+    *out_y = best->y;
+    best->used_w += w;
+    return true;
+}
+
+// Upload the bitmaps of osd not already in the atlas. Returns false if they
+// don't fit into the atlas.
+static bool atlas_update(struct mpgl_osd *ctx, struct mpgl_osd_part *osd)
+{
+    GL *gl = ctx->gl;
+    struct osd_atlas *a = &ctx->atlas;
+    const struct gl_format *fmt = ctx->fmt_table[SUBBITMAP_LIBASS];
+
+    MP_TARRAY_GROW(osd, osd->part_entry, osd->num_subparts);
+
+    for (int n = 0; n < osd->num_subparts; n++) {
+        struct sub_bitmap *b = &osd->subparts[n];
+        uint64_t hash = hash_bitmap(b);
+        int idx = atlas_find(a, hash, b->w, b->h);
+        if (idx < 0) {
+            struct atlas_entry e = { .hash = hash, .w = b->w, .h = b->h };
+            if (!atlas_alloc(ctx, b->w, b->h, &e.x, &e.y))
+                return false;
+            // Many small uploads; a PBO wouldn't help here.
+            gl_upload_tex(gl, GL_TEXTURE_2D, fmt->format, fmt->type,
+                          b->bitmap, b->stride, e.x, e.y, e.w, e.h);
+            atlas_insert(ctx, e);
+            idx = a->num_entries - 1;
+        }
+        osd->part_entry[n] = idx;
+    }
+
+    return true;
+}
+
+static bool atlas_realloc(struct mpgl_osd *ctx, int w, int h)
+{
+    struct osd_atlas *a = &ctx->atlas;
+    if (!realloc_texture(ctx, ctx->fmt_table[SUBBITMAP_LIBASS], w, h))
+        return false;
+    a->w = w;
+    a->h = h;
+    return true;
+}
+
+// Clearing or resizing the atlas destroys the bitmaps other parts of the
+// current frame might reference, so only the first part using the atlas in a
+// frame may do it. Other parts fall back to their own texture, and the atlas
+// is cleared at the start of the next frame.
+static bool upload_atlas(struct mpgl_osd *ctx, struct mpgl_osd_part *osd,
+                         struct sub_bitmaps *imgs)
+{
+    GL *gl = ctx->gl;
+    struct osd_atlas *a = &ctx->atlas;
+    bool can_reset = !a->used;
+    bool ok = false;
+
+    if (!a->texture)
+        gl->GenTextures(1, &a->texture);
+
+    gl->BindTexture(GL_TEXTURE_2D, a->texture);
+
+    // Allocate with some slack, because the shelves pack less tightly.
+    int req_w = FFMAX(next_pow2(imgs->packed_w), a->req_w);
+    int req_h = FFMAX(next_pow2(imgs->packed_h * 2), a->req_h);
+
+    if (req_w > a->w || req_h > a->h) {
+        if (!can_reset) {
+            a->req_w = FFMAX(a->req_w, req_w);
+            a->req_h = FFMAX(a->req_h, req_h);
+            a->reset_pending = true;
+            goto done;
+        }
+        atlas_reset(a);
+        a->req_w = a->req_h = 0;
+        if (!atlas_realloc(ctx, FFMAX(256, FFMAX(a->w, req_w)),
+                           FFMAX(256, FFMAX(a->h, req_h))))
+            goto done;
+    }
+
+    bool cleared = false;
+    while (!atlas_update(ctx, osd)) {
+        if (!can_reset) {
+            // If even the bitmaps of a single frame don't fit, make it larger.
+            if (a->fresh) {
+                a->req_w = a->w <= a->h ? a->w * 2 : a->w;
+                a->req_h = a->w <= a->h ? a->h : a->h * 2;
+            }
+            a->reset_pending = true;
+            goto done;
+        }
+        if (cleared) {
+            // Doesn't fit even into an empty atlas.
+            int w = a->w, h = a->h;
+            if (w <= h) {
+                w *= 2;
+            } else {
+                h *= 2;
+            }
+            if (!atlas_realloc(ctx, w, h))
+                goto done;
+        }
+        MP_DBG(ctx, "OSD atlas full, clearing it.\n");
+        atlas_reset(a);
+        cleared = true;
     }
 
-    gl_pbo_upload_tex(&osd->pbo, gl, ctx->use_pbo, GL_TEXTURE_2D, fmt->format,
-                      fmt->type, osd->w, osd->h, imgs->packed->planes[0],
-                      imgs->packed->stride[0], 0, 0,
-                      imgs->packed_w, imgs->packed_h);
     ok = true;
 
 done:
@@ -184,28 +530,59 @@ done:
     return ok;
 }
 
+// Bitmaps changed; this invalidates the vertices of all passes.
+static void bitmaps_changed(struct mpgl_osd *ctx)
+{
+    ctx->change_counter += 1;
+    for (int n = 0; n < NUM_OSD_PASSES; n++)
+        ctx->pass_change_counter[n] += 1;
+}
+
 static void gen_osd_cb(void *pctx, struct sub_bitmaps *imgs)
 {
     struct mpgl_osd *ctx = pctx;
+    struct osd_atlas *a = &ctx->atlas;
 
     if (imgs->num_parts == 0 || !ctx->formats[imgs->format])
         return;
 
     struct mpgl_osd_part *osd = ctx->parts[imgs->render_index];
 
-    bool ok = true;
-    if (imgs->change_id != osd->change_id) {
-        if (!upload_osd(ctx, osd, imgs))
-            ok = false;
+    // libass bitmaps are never scaled, and are stored in the persistent atlas.
+    // Other bitmaps can be scaled and need the padding provided by the packed
+    // image, so they are always uploaded as a whole.
+    bool use_atlas = imgs->format == SUBBITMAP_LIBASS;
+
+    MP_TARRAY_GROW(osd, osd->subparts, imgs->num_parts);
+    memcpy(osd->subparts, imgs->parts,
+           imgs->num_parts * sizeof(osd->subparts[0]));
+    osd->num_subparts = imgs->num_parts;
+    osd->format = imgs->format;
+
+    // Parts not in the atlas yet, or uploaded before it was cleared, retry.
+    bool reupload = use_atlas &&
+        (!osd->in_atlas || osd->atlas_generation != a->generation);
+
+    if (imgs->change_id != osd->change_id || reupload) {
+        osd->in_atlas = use_atlas && upload_atlas(ctx, osd, imgs);
+        osd->upload_ok = osd->in_atlas || upload_osd(ctx, osd, imgs);
+        if (osd->upload_ok && imgs->format == SUBBITMAP_INDEXED)
+            osd->upload_ok = upload_palettes(ctx, osd, imgs);
+        osd->atlas_generation = a->generation;
 
         osd->change_id = imgs->change_id;
-        ctx->change_counter += 1;
+        bitmaps_changed(ctx);
+    }
+    osd->num_subparts = osd->upload_ok ? imgs->num_parts : 0;
+
+    if (osd->in_atlas && osd->num_subparts) {
+        a->used = true;
+        for (int n = 0; n < osd->num_subparts; n++) {
+            struct atlas_entry *e = &a->entries[osd->part_entry[n]];
+            osd->subparts[n].src_x = e->x;
+            osd->subparts[n].src_y = e->y;
+        }
     }
-    osd->num_subparts = ok ? imgs->num_parts : 0;
-
-    MP_TARRAY_GROW(osd, osd->subparts, osd->num_subparts);
-    memcpy(osd->subparts, imgs->parts,
-           osd->num_subparts * sizeof(osd->subparts[0]));
 }
 
 static void write_quad(struct vertex *va, struct gl_transform t,
@@ -226,49 +603,32 @@ static void write_quad(struct vertex *va, struct gl_transform t,
 #undef COLOR_INIT
 }
 
-static int generate_verts(struct mpgl_osd_part *part, struct gl_transform t)
+// Append the quads of part to the vertices of dst.
+static void append_verts(struct mpgl_osd_part *dst, struct mpgl_osd_part *part,
+                         struct gl_transform t, int tex_w, int tex_h)
 {
-    int num_vertices = part->num_subparts * 6;
-    MP_TARRAY_GROW(part, part->vertices, num_vertices);
+    MP_TARRAY_GROW(dst, dst->vertices,
+                   dst->num_vertices + part->num_subparts * 6);
 
     for (int n = 0; n < part->num_subparts; n++) {
         struct sub_bitmap *b = &part->subparts[n];
-        struct vertex *va = part->vertices;
+        struct vertex *va = &dst->vertices[dst->num_vertices];
 
         // NOTE: the blend color is used with SUBBITMAP_LIBASS only, so it
         //       doesn't matter that we upload garbage for the other formats
         uint32_t c = b->libass.color;
         uint8_t color[4] = { c >> 24, (c >> 16) & 0xff,
                             (c >> 8) & 0xff, 255 - (c & 0xff) };
+        // SUBBITMAP_INDEXED: the palette row instead.
+        if (part->format == SUBBITMAP_INDEXED)
+            color[0] = n;
 
-        write_quad(&va[n * 6], t,
+        write_quad(va, t,
                    b->x, b->y, b->x + b->dw, b->y + b->dh,
                    b->src_x, b->src_y, b->src_x + b->w, b->src_y + b->h,
-                   part->w, part->h, color);
+                   tex_w, tex_h, color);
+        dst->num_vertices += 6;
     }
-
-    return num_vertices;
-}
-
-static void draw_part(struct mpgl_osd *ctx, int index, struct gl_transform t)
-{
-    GL *gl = ctx->gl;
-    struct mpgl_osd_part *part = ctx->parts[index];
-
-    int num_vertices = generate_verts(part, t);
-    if (!num_vertices)
-        return;
-
-    gl->Enable(GL_BLEND);
-    gl->BindTexture(GL_TEXTURE_2D, part->texture);
-
-    const int *factors = &blend_factors[part->format][0];
-    gl->BlendFuncSeparate(factors[0], factors[1], factors[2], factors[3]);
-
-    gl_vao_draw_data(&ctx->vao, GL_TRIANGLES, part->vertices, num_vertices);
-
-    gl->BindTexture(GL_TEXTURE_2D, 0);
-    gl->Disable(GL_BLEND);
 }
 
 // number of screen divisions per axis (x=0, y=1) for the current 3D mode
@@ -283,12 +643,16 @@ static void get_3d_side_by_side(int stereo_mode, int div[2])
     }
 }
 
-void mpgl_osd_draw_part(struct mpgl_osd *ctx, int vp_w, int vp_h, int index)
+// Generate the vertices for the part at index, and all parts batched with it,
+// for every 3D view.
+static void generate_verts(struct mpgl_osd *ctx, int index, int vp_w, int vp_h)
 {
+    struct mpgl_osd_part *part = ctx->parts[index];
+
     int div[2];
     get_3d_side_by_side(ctx->stereo_mode, div);
 
-    ctx->gl->Viewport(0, 0, vp_w, abs(vp_h));
+    part->num_vertices = 0;
 
     for (int x = 0; x < div[0]; x++) {
         for (int y = 0; y < div[1]; y++) {
@@ -300,15 +664,91 @@ void mpgl_osd_draw_part(struct mpgl_osd *ctx, int vp_w, int vp_h, int index)
             t.t[0] += a_x * t.m[0][0] + a_y * t.m[1][0];
             t.t[1] += a_x * t.m[0][1] + a_y * t.m[1][1];
 
-            draw_part(ctx, index, t);
+            if (!part->in_atlas) {
+                append_verts(part, part, t, part->w, part->h);
+                continue;
+            }
+            for (int n = index; n < MAX_OSD_PARTS; n++) {
+                struct mpgl_osd_part *other = ctx->parts[n];
+                if (n == index || other->batched)
+                    append_verts(part, other, t, ctx->atlas.w, ctx->atlas.h);
+            }
         }
     }
 }
 
+void mpgl_osd_draw_part(struct mpgl_osd *ctx, int vp_w, int vp_h, int index)
+{
+    GL *gl = ctx->gl;
+    struct mpgl_osd_part *part = ctx->parts[index];
+
+    if (!part->num_subparts || part->batched)
+        return;
+
+    // The vertices depend only on the bitmaps and the parts visible in this
+    // pass (any change to them increments the pass's change counter) and the
+    // target geometry.
+    struct verts_key key;
+    memset(&key, 0, sizeof(key));
+    key.pass = ctx->pass;
+    key.change_counter = ctx->pass_change_counter[ctx->pass];
+    key.vp_w = vp_w;
+    key.vp_h = vp_h;
+    key.stereo_mode = ctx->stereo_mode;
+    key.res = ctx->osd_res;
+
+    bool upload = memcmp(&key, &part->verts_key, sizeof(key)) != 0;
+    if (upload) {
+        generate_verts(ctx, index, vp_w, vp_h);
+        part->verts_key = key;
+    }
+
+    if (!part->num_vertices)
+        return;
+
+    gl->Viewport(0, 0, vp_w, abs(vp_h));
+
+    gl->Enable(GL_BLEND);
+    gl->BindTexture(GL_TEXTURE_2D,
+                    part->in_atlas ? ctx->atlas.texture : part->texture);
+    if (part->format == SUBBITMAP_INDEXED) {
+        gl->ActiveTexture(GL_TEXTURE1);
+        gl->BindTexture(GL_TEXTURE_2D, part->palette_texture);
+        gl->ActiveTexture(GL_TEXTURE0);
+    }
+
+    const int *factors = &blend_factors[part->format][0];
+    gl->BlendFuncSeparate(factors[0], factors[1], factors[2], factors[3]);
+
+    gl_vao_draw_data(&part->vao, GL_TRIANGLES,
+                     upload ? part->vertices : NULL, part->num_vertices);
+
+    if (part->format == SUBBITMAP_INDEXED) {
+        gl->ActiveTexture(GL_TEXTURE1);
+        gl->BindTexture(GL_TEXTURE_2D, 0);
+        gl->ActiveTexture(GL_TEXTURE0);
+    }
+    gl->BindTexture(GL_TEXTURE_2D, 0);
+    gl->Disable(GL_BLEND);
+}
+
+// Returns 0 if nothing needs to be drawn for this part (even if it's visible,
+// it might be drawn as part of another part).
 enum sub_bitmap_format mpgl_osd_get_part_format(struct mpgl_osd *ctx, int index)
 {
     assert(index >= 0 && index < MAX_OSD_PARTS);
-    return ctx->parts[index]->format;
+    struct mpgl_osd_part *part = ctx->parts[index];
+    return part->num_subparts && !part->batched ? part->format : 0;
+}
+
+// Set the uniforms the SUBBITMAP_INDEXED shader in pass_draw_osd() needs.
+void mpgl_osd_set_indexed_uniforms(struct mpgl_osd *ctx,
+                                   struct gl_shader_cache *sc, int index)
+{
+    struct mpgl_osd_part *part = ctx->parts[index];
+    gl_sc_uniform_sampler(sc, "osdpal", GL_TEXTURE_2D, 1);
+    gl_sc_uniform_vec2(sc, "osdtex_size", (GLfloat[2]){part->w, part->h});
+    gl_sc_uniform_f(sc, "osdpal_h", part->palette_h);
 }
 
 struct gl_vao *mpgl_osd_get_vao(struct mpgl_osd *ctx)
@@ -329,21 +769,48 @@ static void set_res(struct mpgl_osd *ctx, struct mp_osd_res res, int stereo_mode
 void mpgl_osd_generate(struct mpgl_osd *ctx, struct mp_osd_res res, double pts,
                        int stereo_mode, int draw_flags)
 {
+    struct osd_atlas *a = &ctx->atlas;
+
     for (int n = 0; n < MAX_OSD_PARTS; n++)
         ctx->parts[n]->num_subparts = 0;
 
+    a->used = false;
+    a->fresh = false;
+    if (a->reset_pending) {
+        MP_DBG(ctx, "OSD atlas full, clearing it.\n");
+        atlas_reset(a);
+        a->reset_pending = false;
+    }
+
     set_res(ctx, res, stereo_mode);
 
+    ctx->pass = OSD_PASS(draw_flags);
     osd_draw(ctx->osd, ctx->osd_res, pts, draw_flags, ctx->formats, gen_osd_cb, ctx);
     ctx->stereo_mode = stereo_mode;
 
     // Parts going away does not necessarily result in gen_osd_cb() being called
-    // (not even with num_parts==0), so check this separately.
+    // (not even with num_parts==0), so check this separately. Compare with the
+    // previous generation of the same pass, as the other passes show different
+    // parts.
     for (int n = 0; n < MAX_OSD_PARTS; n++) {
         struct mpgl_osd_part *part = ctx->parts[n];
-        if (part->num_subparts !=  part->prev_num_subparts)
+        if (part->num_subparts != part->prev_num_subparts[ctx->pass]) {
             ctx->change_counter += 1;
-        part->prev_num_subparts = part->num_subparts;
+            ctx->pass_change_counter[ctx->pass] += 1;
+        }
+        part->prev_num_subparts[ctx->pass] = part->num_subparts;
+    }
+
+    // All parts in the atlas share texture, format and blend mode, so they are
+    // drawn with the first of them.
+    bool have_atlas_part = false;
+    for (int n = 0; n < MAX_OSD_PARTS; n++) {
+        struct mpgl_osd_part *part = ctx->parts[n];
+        part->batched = false;
+        if (part->num_subparts && part->in_atlas) {
+            part->batched = have_atlas_part;
+            have_atlas_part = true;
+        }
     }
 }
 
@@ -0,0 +1,154 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_GL_RA_H_
+#define MP_GL_RA_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common/common.h"
+
+// Rendering API abstraction. This sits below gl_video, and is meant to allow
+// implementing the renderer with other graphics APIs than OpenGL. It is
+// deliberately low level: textures and buffers, with explicit synchronization
+// of buffers that are shared with the host.
+struct ra {
+    const struct ra_fns *fns;
+    void *priv;
+    struct mp_log *log;
+
+    // RA_CAP_* bit field.
+    int caps;
+
+    // Texture formats the backend supports. Formats which are not listed here
+    // can't be used at all.
+    const struct ra_format **formats;
+    int num_formats;
+};
+
+enum {
+    RA_CAP_TEX_1D           = 1 << 0,   // 1D textures
+    RA_CAP_TEX_3D           = 1 << 1,   // 3D textures
+    RA_CAP_TEX_RECT         = 1 << 2,   // non-normalized texture coordinates
+    RA_CAP_BUF_HOST_MAPPED  = 1 << 3,   // ra_buf_params.host_mapped
+};
+
+enum ra_ctype {
+    RA_CTYPE_UNKNOWN = 0,   // also used for inconsistent multi-component formats
+    RA_CTYPE_UNORM,         // unsigned normalized integer (fixed point) formats
+    RA_CTYPE_UINT,          // full integer formats
+    RA_CTYPE_FLOAT,         // float formats (any bit size)
+};
+
+struct ra_format {
+    const char *name;       // symbolic name for user interaction/debugging
+    void *priv;
+    enum ra_ctype ctype;    // data type of each component
+    int num_components;     // component count, 0 if not applicable
+    int component_size[4];  // in bits, all entries 0 if not applicable
+    int pixel_size;         // in bytes
+    bool luminance_alpha;   // pseudo-format for GL_LUMINANCE_ALPHA
+    bool linear_filter;     // linear filtering is available
+    bool renderable;        // can be used as render target
+};
+
+struct ra_tex_params {
+    int dimensions;         // 1-3 for 1D-3D textures
+    int w, h, d;            // dimensions, all >= 1; unused ones must be 1
+    const struct ra_format *format;
+    bool src_linear;        // if false, use nearest sampling
+    bool non_normalized;    // use non-normalized texture coordinates
+                            // (only with RA_CAP_TEX_RECT and dimensions==2)
+    // If non-NULL, the texture is created with these contents. The data is
+    // tightly packed (no padding between rows).
+    const void *initial_data;
+};
+
+struct ra_tex {
+    // All fields are read-only after creation.
+    struct ra_tex_params params;
+    void *priv;
+};
+
+struct ra_buf_params {
+    size_t size;
+    // Keep the buffer persistently mapped into host memory (see ra_buf.data).
+    // Requires RA_CAP_BUF_HOST_MAPPED.
+    bool host_mapped;
+    // If non-NULL, the buffer is created with these contents (size bytes).
+    const void *initial_data;
+};
+
+// A buffer to upload texture data from, e.g. one the decoder writes into.
+struct ra_buf {
+    struct ra_buf_params params;
+    // If params.host_mapped is set, the host can access the buffer memory
+    // directly through this pointer. It must not be written while the GPU
+    // still reads from it (see ra_fns.buf_poll()).
+    void *data;
+    void *priv;
+};
+
+struct ra_tex_upload_params {
+    struct ra_tex *tex;
+    // Rectangle to update, or NULL for the whole texture. For 1D/3D textures,
+    // this is ignored, and the whole texture is always updated.
+    struct mp_rect *rc;
+    ptrdiff_t stride;       // in bytes; tightly packed for 1D/3D textures
+    // Exactly one of these is set: host memory, or an offset into buf.
+    const void *src;
+    struct ra_buf *buf;
+    size_t buf_offset;
+};
+
+struct ra_fns {
+    void (*destroy)(struct ra *ra);
+
+    // Create a texture. Returns NULL on failure. The contents are undefined,
+    // unless params->initial_data is set.
+    struct ra_tex *(*tex_create)(struct ra *ra,
+                                 const struct ra_tex_params *params);
+
+    void (*tex_destroy)(struct ra *ra, struct ra_tex *tex);
+
+    // Copy data into a texture. The upload is ordered against all rendering
+    // commands, i.e. passes issued before still see the old contents. If the
+    // data comes from a ra_buf, the buffer is in use until buf_poll() says
+    // otherwise.
+    void (*tex_upload)(struct ra *ra, const struct ra_tex_upload_params *params);
+
+    // Create a buffer. Returns NULL on failure.
+    struct ra_buf *(*buf_create)(struct ra *ra,
+                                 const struct ra_buf_params *params);
+
+    void (*buf_destroy)(struct ra *ra, struct ra_buf *buf);
+
+    // Return whether the GPU is done with all operations on the buffer, and
+    // it can be written by the host again. If timeout_ns is > 0, wait at most
+    // this long before returning false.
+    bool (*buf_poll)(struct ra *ra, struct ra_buf *buf, uint64_t timeout_ns);
+};
+
+// Convenience wrappers. The *_free() functions are no-ops for NULL, and set
+// the pointer to NULL.
+void ra_tex_free(struct ra *ra, struct ra_tex **tex);
+void ra_buf_free(struct ra *ra, struct ra_buf **buf);
+void ra_free(struct ra **ra);
+
+#endif
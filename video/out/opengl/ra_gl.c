@@ -0,0 +1,384 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common/msg.h"
+
+#include "ra_gl.h"
+#include "utils.h"
+
+static const struct ra_fns ra_fns_gl;
+
+struct ra_gl {
+    GL *gl;
+    bool use_pbo;
+};
+
+struct ra_tex_gl {
+    GLenum target;
+    GLint internal_format;
+    GLenum format;
+    GLenum type;
+    GLuint texture;
+    struct gl_pbo_upload pbo;
+};
+
+struct ra_buf_gl {
+    GLuint buffer;
+    GLsync fence;       // set after the last upload from this buffer
+};
+
+// Allocated as child of fmt.
+static const char *format_name(struct ra_format *fmt,
+                               const struct gl_format *gl_fmt)
+{
+    if (!fmt->component_size[0])
+        return talloc_asprintf(fmt, "gl_0x%x", (unsigned)gl_fmt->type);
+    const char *comps = fmt->luminance_alpha ? "la" :
+                        gl_fmt->format == GL_LUMINANCE ? "l" : "rgba";
+    const char *suffix = fmt->ctype == RA_CTYPE_FLOAT ? "f" :
+                         fmt->ctype == RA_CTYPE_UINT ? "ui" : "";
+    int bits = fmt->component_size[0];
+    if (gl_fmt->flags & F_F16)
+        bits = 16;
+    return talloc_asprintf(fmt, "%.*s%d%s", fmt->num_components, comps,
+                           bits, suffix);
+}
+
+static void add_formats(struct ra *ra, GL *gl)
+{
+    int features = gl_format_feature_flags(gl);
+    for (int n = 0; gl_formats[n].type; n++) {
+        const struct gl_format *gl_fmt = &gl_formats[n];
+        if (!(gl_fmt->flags & features))
+            continue;
+
+        struct ra_format *fmt = talloc_zero(ra, struct ra_format);
+        *fmt = (struct ra_format){
+            .priv = (void *)gl_fmt,
+            .num_components = gl_format_components(gl_fmt->format),
+            .pixel_size = gl_bytes_per_pixel(gl_fmt->format, gl_fmt->type),
+            .luminance_alpha = gl_fmt->format == GL_LUMINANCE_ALPHA,
+            .linear_filter = gl_fmt->flags & F_TF,
+            .renderable = gl_fmt->flags & F_CR,
+        };
+
+        int csize = gl_component_size(gl_fmt->type) * 8;
+        if (csize) {
+            for (int i = 0; i < fmt->num_components; i++)
+                fmt->component_size[i] = csize;
+            switch (gl_format_type(gl_fmt)) {
+            case MPGL_TYPE_UNORM: fmt->ctype = RA_CTYPE_UNORM; break;
+            case MPGL_TYPE_UINT:  fmt->ctype = RA_CTYPE_UINT;  break;
+            case MPGL_TYPE_FLOAT: fmt->ctype = RA_CTYPE_FLOAT; break;
+            }
+        }
+        fmt->name = format_name(fmt, gl_fmt);
+
+        MP_TARRAY_APPEND(ra, ra->formats, ra->num_formats, fmt);
+    }
+}
+
+struct ra *ra_create_gl(GL *gl, struct mp_log *log)
+{
+    struct ra *ra = talloc_zero(NULL, struct ra);
+    ra->fns = &ra_fns_gl;
+    ra->log = log;
+    struct ra_gl *p = ra->priv = talloc_zero(ra, struct ra_gl);
+    p->gl = gl;
+
+    if (gl->mpgl_caps & MPGL_CAP_1D_TEX)
+        ra->caps |= RA_CAP_TEX_1D;
+    if (gl->mpgl_caps & MPGL_CAP_3D_TEX)
+        ra->caps |= RA_CAP_TEX_3D;
+    if (!gl->es)
+        ra->caps |= RA_CAP_TEX_RECT;
+    if (gl->BufferStorage && gl->FenceSync)
+        ra->caps |= RA_CAP_BUF_HOST_MAPPED;
+
+    add_formats(ra, gl);
+
+    return ra;
+}
+
+static void gl_destroy(struct ra *ra)
+{
+    talloc_free(ra);
+}
+
+void ra_gl_set_pbo(struct ra *ra, bool use_pbo)
+{
+    struct ra_gl *p = ra->priv;
+    p->use_pbo = use_pbo;
+}
+
+const struct ra_format *ra_gl_get_format(struct ra *ra,
+                                         const struct gl_format *gl_fmt)
+{
+    for (int n = 0; n < ra->num_formats; n++) {
+        if (ra->formats[n]->priv == gl_fmt)
+            return ra->formats[n];
+    }
+    return NULL;
+}
+
+GLuint ra_gl_tex_id(struct ra_tex *tex)
+{
+    struct ra_tex_gl *tex_gl = tex->priv;
+    return tex_gl->texture;
+}
+
+GLenum ra_gl_tex_target(struct ra_tex *tex)
+{
+    struct ra_tex_gl *tex_gl = tex->priv;
+    return tex_gl->target;
+}
+
+static void gl_tex_destroy(struct ra *ra, struct ra_tex *tex)
+{
+    struct ra_gl *p = ra->priv;
+    struct ra_tex_gl *tex_gl = tex->priv;
+
+    p->gl->DeleteTextures(1, &tex_gl->texture);
+    gl_pbo_upload_uninit(&tex_gl->pbo);
+    talloc_free(tex);
+}
+
+static struct ra_tex *gl_tex_create(struct ra *ra,
+                                    const struct ra_tex_params *params)
+{
+    struct ra_gl *p = ra->priv;
+    GL *gl = p->gl;
+    const struct gl_format *gl_fmt = params->format->priv;
+
+    struct ra_tex *tex = talloc_zero(NULL, struct ra_tex);
+    tex->params = *params;
+    tex->params.initial_data = NULL;
+
+    struct ra_tex_gl *tex_gl = tex->priv = talloc_zero(tex, struct ra_tex_gl);
+    tex_gl->internal_format = gl_fmt->internal_format;
+    tex_gl->format = gl_fmt->format;
+    tex_gl->type = gl_fmt->type;
+
+    switch (params->dimensions) {
+    case 1:
+        assert(ra->caps & RA_CAP_TEX_1D);
+        tex_gl->target = GL_TEXTURE_1D;
+        break;
+    case 2:
+        assert(!params->non_normalized || (ra->caps & RA_CAP_TEX_RECT));
+        tex_gl->target = params->non_normalized ? GL_TEXTURE_RECTANGLE
+                                                : GL_TEXTURE_2D;
+        break;
+    case 3:
+        assert(ra->caps & RA_CAP_TEX_3D);
+        tex_gl->target = GL_TEXTURE_3D;
+        break;
+    default:
+        abort();
+    }
+    GLenum target = tex_gl->target;
+
+    gl->GenTextures(1, &tex_gl->texture);
+    gl->BindTexture(target, tex_gl->texture);
+
+    GLint filter = params->src_linear ? GL_LINEAR : GL_NEAREST;
+    gl->TexParameteri(target, GL_TEXTURE_MIN_FILTER, filter);
+    gl->TexParameteri(target, GL_TEXTURE_MAG_FILTER, filter);
+    gl->TexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    if (params->dimensions > 1)
+        gl->TexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    if (params->dimensions > 2)
+        gl->TexParameteri(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+    gl->PixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    switch (params->dimensions) {
+    case 1:
+        gl->TexImage1D(target, 0, tex_gl->internal_format, params->w, 0,
+                       tex_gl->format, tex_gl->type, params->initial_data);
+        break;
+    case 2:
+        gl->TexImage2D(target, 0, tex_gl->internal_format, params->w,
+                       params->h, 0, tex_gl->format, tex_gl->type,
+                       params->initial_data);
+        break;
+    case 3:
+        gl->TexImage3D(target, 0, tex_gl->internal_format, params->w,
+                       params->h, params->d, 0, tex_gl->format, tex_gl->type,
+                       params->initial_data);
+        break;
+    }
+    gl->PixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    gl->BindTexture(target, 0);
+
+    gl_check_error(gl, ra->log, "after creating texture");
+
+    return tex;
+}
+
+static void gl_tex_upload(struct ra *ra,
+                          const struct ra_tex_upload_params *params)
+{
+    struct ra_gl *p = ra->priv;
+    GL *gl = p->gl;
+    struct ra_tex *tex = params->tex;
+    struct ra_tex_gl *tex_gl = tex->priv;
+    struct ra_buf *buf = params->buf;
+    GLenum target = tex_gl->target;
+
+    const void *src = params->src;
+    if (buf) {
+        struct ra_buf_gl *buf_gl = buf->priv;
+        gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, buf_gl->buffer);
+        src = (void *)params->buf_offset;
+    }
+
+    gl->BindTexture(target, tex_gl->texture);
+
+    switch (tex->params.dimensions) {
+    case 1:
+        gl->PixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        gl->TexImage1D(target, 0, tex_gl->internal_format, tex->params.w, 0,
+                       tex_gl->format, tex_gl->type, src);
+        gl->PixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        break;
+    case 2: {
+        struct mp_rect rc = {0, 0, tex->params.w, tex->params.h};
+        if (params->rc)
+            rc = *params->rc;
+        if (buf) {
+            gl_upload_tex(gl, target, tex_gl->format, tex_gl->type, src,
+                          params->stride, rc.x0, rc.y0, rc.x1 - rc.x0,
+                          rc.y1 - rc.y0);
+        } else {
+            gl_pbo_upload_tex(&tex_gl->pbo, gl, p->use_pbo, target,
+                              tex_gl->format, tex_gl->type, tex->params.w,
+                              tex->params.h, src, params->stride, rc.x0, rc.y0,
+                              rc.x1 - rc.x0, rc.y1 - rc.y0);
+        }
+        break;
+    }
+    case 3:
+        gl->PixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        gl->TexImage3D(target, 0, tex_gl->internal_format, tex->params.w,
+                       tex->params.h, tex->params.d, 0, tex_gl->format,
+                       tex_gl->type, src);
+        gl->PixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        break;
+    }
+
+    gl->BindTexture(target, 0);
+
+    if (buf) {
+        struct ra_buf_gl *buf_gl = buf->priv;
+        gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        // Make sure the buffer is not reused before the GPU is done with it.
+        if (gl->FenceSync) {
+            if (buf_gl->fence)
+                gl->DeleteSync(buf_gl->fence);
+            buf_gl->fence = gl->FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+    }
+}
+
+static void gl_buf_destroy(struct ra *ra, struct ra_buf *buf)
+{
+    struct ra_gl *p = ra->priv;
+    GL *gl = p->gl;
+    struct ra_buf_gl *buf_gl = buf->priv;
+
+    if (buf_gl->fence)
+        gl->DeleteSync(buf_gl->fence);
+    if (buf->data) {
+        gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, buf_gl->buffer);
+        gl->UnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    gl->DeleteBuffers(1, &buf_gl->buffer);
+    talloc_free(buf);
+}
+
+static struct ra_buf *gl_buf_create(struct ra *ra,
+                                    const struct ra_buf_params *params)
+{
+    struct ra_gl *p = ra->priv;
+    GL *gl = p->gl;
+
+    if (params->host_mapped && !(ra->caps & RA_CAP_BUF_HOST_MAPPED))
+        return NULL;
+
+    struct ra_buf *buf = talloc_zero(NULL, struct ra_buf);
+    buf->params = *params;
+    buf->params.initial_data = NULL;
+
+    struct ra_buf_gl *buf_gl = buf->priv = talloc_zero(buf, struct ra_buf_gl);
+    gl->GenBuffers(1, &buf_gl->buffer);
+    gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, buf_gl->buffer);
+
+    if (params->host_mapped) {
+        GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_WRITE_BIT |
+                           GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        // Writers such as decoders read back what they wrote (e.g. reference
+        // frames), so ask for memory that is cached on the CPU side.
+        GLbitfield storage_flags = flags | GL_CLIENT_STORAGE_BIT;
+        gl->BufferStorage(GL_PIXEL_UNPACK_BUFFER, params->size,
+                          params->initial_data, storage_flags);
+        buf->data = gl->MapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, params->size,
+                                       flags);
+    } else {
+        gl->BufferData(GL_PIXEL_UNPACK_BUFFER, params->size,
+                       params->initial_data, GL_STREAM_DRAW);
+    }
+
+    gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    if (params->host_mapped && !buf->data) {
+        gl_buf_destroy(ra, buf);
+        return NULL;
+    }
+
+    return buf;
+}
+
+static bool gl_buf_poll(struct ra *ra, struct ra_buf *buf, uint64_t timeout_ns)
+{
+    struct ra_gl *p = ra->priv;
+    GL *gl = p->gl;
+    struct ra_buf_gl *buf_gl = buf->priv;
+
+    if (!buf_gl->fence)
+        return true;
+
+    GLbitfield flags = timeout_ns ? GL_SYNC_FLUSH_COMMANDS_BIT : 0;
+    GLenum res = gl->ClientWaitSync(buf_gl->fence, flags, timeout_ns);
+    if (res == GL_ALREADY_SIGNALED || res == GL_CONDITION_SATISFIED) {
+        gl->DeleteSync(buf_gl->fence);
+        buf_gl->fence = NULL;
+        return true;
+    }
+    return false;
+}
+
+static const struct ra_fns ra_fns_gl = {
+    .destroy            = gl_destroy,
+    .tex_create         = gl_tex_create,
+    .tex_destroy        = gl_tex_destroy,
+    .tex_upload         = gl_tex_upload,
+    .buf_create         = gl_buf_create,
+    .buf_destroy        = gl_buf_destroy,
+    .buf_poll           = gl_buf_poll,
+};
@@ -0,0 +1,38 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_GL_RA_GL_H_
+#define MP_GL_RA_GL_H_
+
+#include "common.h"
+#include "formats.h"
+#include "ra.h"
+
+struct ra *ra_create_gl(GL *gl, struct mp_log *log);
+
+// Upload from host memory through PBOs (see gl_pbo_upload_tex()).
+void ra_gl_set_pbo(struct ra *ra, bool use_pbo);
+
+// The ra_format for a gl_formats[] entry, or NULL if unsupported.
+const struct ra_format *ra_gl_get_format(struct ra *ra,
+                                         const struct gl_format *gl_fmt);
+
+// For code that isn't ported to ra yet.
+GLuint ra_gl_tex_id(struct ra_tex *tex);
+GLenum ra_gl_tex_target(struct ra_tex *tex);
+
+#endif
@@ -22,11 +22,20 @@
 #include <string.h>
 #include <stdarg.h>
 #include <assert.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include <libavutil/sha.h>
+#include <libavutil/mem.h>
 
 #include "common/common.h"
+#include "options/path.h"
+#include "stream/stream.h"
 #include "formats.h"
 #include "utils.h"
 
+#include "osdep/io.h"
+
 // GLU has this as gluErrorString (we don't use GLU, as it is legacy-OpenGL)
 static const char *gl_error_to_string(GLenum error)
 {
@@ -426,6 +435,12 @@ void gl_set_debug_logger(GL *gl, struct mp_log *log)
 // Force cache flush if more than this number of shaders is created.
 #define SC_MAX_ENTRIES 48
 
+// Size of the hash table for looking up entries (power of 2, and larger than
+// SC_MAX_ENTRIES, so open addressing always finds a free slot).
+#define SC_TABLE_SIZE 128
+
+#define SC_HASH_INIT 14695981039346656037ULL
+
 enum uniform_type {
     UT_invalid,
     UT_i,
@@ -448,17 +463,39 @@ struct sc_uniform {
 };
 
 struct sc_cached_uniform {
+    char *name;
+    const char *glsl_type;
     GLint loc;
     union uniform_val v;
 };
 
+// State for a program that is still being compiled by the driver (with
+// GL_KHR_parallel_shader_compile). Checking the results is deferred until the
+// driver reports completion.
+struct sc_pending {
+    GLuint shaders[2];
+    GLenum types[2];
+    char *sources[2];
+    int num_shaders;
+    char *cache_name;       // save the program binary under this name (or NULL)
+    char *cache_file;       // and to this file (or NULL)
+};
+
+// The generated shader text depends only on the fields stored here (plus
+// things that are constant for the lifetime of the cache, like the GLSL
+// version), so they are compared instead of the full shader text.
 struct sc_entry {
     GLuint gl_shader;
+    struct sc_pending *pending; // if non-NULL, gl_shader can't be used yet
     struct sc_cached_uniform *uniforms;
     int num_uniforms;
-    bstr frag;
-    bstr vert;
+    uint64_t hash;
+    bstr prelude;
+    bstr header;
+    bstr text;
+    int num_exts;
     struct gl_vao *vao;
+    int compute_w, compute_h;
 };
 
 struct gl_shader_cache {
@@ -473,16 +510,27 @@ struct gl_shader_cache {
     bstr prelude_text;
     bstr header_text;
     bstr text;
+    uint64_t header_hash;   // hash of header_text, updated when appending
+    uint64_t text_hash;     // same for text
     struct gl_vao *vao;
+    int compute_w, compute_h; // work group size, or 0 for vertex/fragment
 
     struct sc_entry *entries;
     int num_entries;
+    int table[SC_TABLE_SIZE]; // index+1 into entries, 0 for unused slots
 
     struct sc_uniform *uniforms;
     int num_uniforms;
 
     bool error_state; // true if an error occurred
 
+    bool async;       // compile new programs in the background
+    bool skipped;     // a program was skipped, because it was still compiling
+
+    // For the on-disk program binary cache (NULL if disabled)
+    struct mpv_global *global;
+    char *cache_dir;
+
     // temporary buffers (avoids frequent reallocations)
     bstr tmp[5];
 };
@@ -493,15 +541,36 @@ struct gl_shader_cache *gl_sc_create(GL *gl, struct mp_log *log)
     *sc = (struct gl_shader_cache){
         .gl = gl,
         .log = log,
+        .header_hash = SC_HASH_INIT,
+        .text_hash = SC_HASH_INIT,
     };
     return sc;
 }
 
+// FNV-1a; can be computed incrementally while text is appended.
+static uint64_t hash_bytes(uint64_t h, const void *data, size_t len)
+{
+    const unsigned char *d = data;
+    for (size_t n = 0; n < len; n++) {
+        h ^= d[n];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static uint64_t hash_str(uint64_t h, const char *s)
+{
+    return hash_bytes(h, s, strlen(s) + 1);
+}
+
 void gl_sc_reset(struct gl_shader_cache *sc)
 {
     sc->prelude_text.len = 0;
     sc->header_text.len = 0;
     sc->text.len = 0;
+    sc->header_hash = SC_HASH_INIT;
+    sc->text_hash = SC_HASH_INIT;
+    sc->compute_w = sc->compute_h = 0;
     for (int n = 0; n < sc->num_uniforms; n++)
         talloc_free(sc->uniforms[n].name);
     sc->num_uniforms = 0;
@@ -513,12 +582,50 @@ static void sc_flush_cache(struct gl_shader_cache *sc)
 
     for (int n = 0; n < sc->num_entries; n++) {
         struct sc_entry *e = &sc->entries[n];
+        if (e->pending) {
+            for (int i = 0; i < e->pending->num_shaders; i++)
+                sc->gl->DeleteShader(e->pending->shaders[i]);
+            talloc_free(e->pending);
+        }
         sc->gl->DeleteProgram(e->gl_shader);
-        talloc_free(e->vert.start);
-        talloc_free(e->frag.start);
+        talloc_free(e->prelude.start);
+        talloc_free(e->header.start);
+        talloc_free(e->text.start);
         talloc_free(e->uniforms);
     }
     sc->num_entries = 0;
+    memset(sc->table, 0, sizeof(sc->table));
+}
+
+// Load and save linked program binaries in this directory, if the GL supports
+// it. dir can be NULL or "" to disable this.
+void gl_sc_set_cache_dir(struct gl_shader_cache *sc, struct mpv_global *global,
+                         const char *dir)
+{
+    talloc_free(sc->cache_dir);
+    sc->cache_dir = NULL;
+    sc->global = global;
+    if (dir && dir[0] && sc->gl->ProgramBinary)
+        sc->cache_dir = mp_get_user_path(sc, global, dir);
+}
+
+// Compile new programs without blocking, if the GL supports it. As long as a
+// program is not ready, gl_sc_gen_shader_and_reset() returns false, and the
+// caller must skip the draw call.
+void gl_sc_set_async_compile(struct gl_shader_cache *sc, bool enable)
+{
+    sc->async = enable && sc->gl->MaxShaderCompilerThreadsKHR;
+    if (sc->async)
+        sc->gl->MaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+}
+
+// Return and reset whether gl_sc_gen_shader_and_reset() returned false since
+// the last call.
+bool gl_sc_take_skipped(struct gl_shader_cache *sc)
+{
+    bool r = sc->skipped;
+    sc->skipped = false;
+    return r;
 }
 
 void gl_sc_destroy(struct gl_shader_cache *sc)
@@ -551,35 +658,61 @@ void gl_sc_enable_extension(struct gl_shader_cache *sc, char *name)
 
 #define bstr_xappend0(sc, b, s) bstr_xappend(sc, b, bstr0(s))
 
+// Hash the text appended to b since it had length pos.
+static void hash_appended(uint64_t *hash, bstr *b, size_t pos)
+{
+    *hash = hash_bytes(*hash, b->start + pos, b->len - pos);
+}
+
 void gl_sc_add(struct gl_shader_cache *sc, const char *text)
 {
+    size_t pos = sc->text.len;
     bstr_xappend0(sc, &sc->text, text);
+    hash_appended(&sc->text_hash, &sc->text, pos);
 }
 
 void gl_sc_addf(struct gl_shader_cache *sc, const char *textf, ...)
 {
+    size_t pos = sc->text.len;
     va_list ap;
     va_start(ap, textf);
     bstr_xappend_vasprintf(sc, &sc->text, textf, ap);
     va_end(ap);
+    hash_appended(&sc->text_hash, &sc->text, pos);
+}
+
+// Add text to the start of the shader, right after the #version and #extension
+// lines of the cache. Mainly for per-shader #extension directives.
+void gl_sc_paddf(struct gl_shader_cache *sc, const char *textf, ...)
+{
+    va_list ap;
+    va_start(ap, textf);
+    bstr_xappend_vasprintf(sc, &sc->prelude_text, textf, ap);
+    va_end(ap);
 }
 
 void gl_sc_hadd(struct gl_shader_cache *sc, const char *text)
 {
+    size_t pos = sc->header_text.len;
     bstr_xappend0(sc, &sc->header_text, text);
+    hash_appended(&sc->header_hash, &sc->header_text, pos);
 }
 
 void gl_sc_haddf(struct gl_shader_cache *sc, const char *textf, ...)
 {
+    size_t pos = sc->header_text.len;
     va_list ap;
     va_start(ap, textf);
     bstr_xappend_vasprintf(sc, &sc->header_text, textf, ap);
     va_end(ap);
+    hash_appended(&sc->header_hash, &sc->header_text, pos);
 }
 
 void gl_sc_hadd_bstr(struct gl_shader_cache *sc, struct bstr text)
 {
+    size_t pos = sc->header_text.len;
     bstr_xappend(sc, &sc->header_text, text);
+    hash_appended(&sc->header_hash, &sc->header_text, pos);
 }
 
 static struct sc_uniform *find_uniform(struct gl_shader_cache *sc,
@@ -717,6 +850,16 @@ void gl_sc_set_vao(struct gl_shader_cache *sc, struct gl_vao *vao)
     sc->vao = vao;
 }
 
+// Make the next shader program a compute shader with the given work group
+// size, instead of a vertex/fragment shader pair. The text added with
+// gl_sc_add() becomes the body of main(), and the caller has to write the
+// result (e.g. with imageStore()). Requires MPGL_CAP_COMPUTE_SHADER.
+void gl_sc_set_compute(struct gl_shader_cache *sc, int w, int h)
+{
+    sc->compute_w = w;
+    sc->compute_h = h;
+}
+
 static const char *vao_glsl_type(const struct gl_vao_entry *e)
 {
     // pretty dumb... too dumb, but works for us
@@ -772,21 +915,20 @@ static void update_uniform(GL *gl, struct sc_entry *e, struct sc_uniform *u, int
     }
 }
 
-static void compile_attach_shader(struct gl_shader_cache *sc, GLuint program,
-                                  GLenum type, const char *source)
+// Check the compile status, and log the source and compile log if needed.
+static void check_shader(struct gl_shader_cache *sc, GLuint shader,
+                         GLenum type, const char *source)
 {
     GL *gl = sc->gl;
 
-    GLuint shader = gl->CreateShader(type);
-    gl->ShaderSource(shader, 1, &source, NULL);
-    gl->CompileShader(shader);
     GLint status;
     gl->GetShaderiv(shader, GL_COMPILE_STATUS, &status);
     GLint log_length;
     gl->GetShaderiv(shader, GL_INFO_LOG_LENGTH, &log_length);
 
     int pri = status ? (log_length > 1 ? MSGL_V : MSGL_DEBUG) : MSGL_ERR;
-    const char *typestr = type == GL_VERTEX_SHADER ? "vertex" : "fragment";
+    const char *typestr = type == GL_VERTEX_SHADER ? "vertex" :
+                          type == GL_COMPUTE_SHADER ? "compute" : "fragment";
     if (mp_msg_test(sc->log, pri)) {
         MP_MSG(sc, pri, "%s shader source:\n", typestr);
         mp_log_source(sc->log, pri, source);
@@ -809,17 +951,38 @@ static void compile_attach_shader(struct gl_shader_cache *sc, GLuint program,
         }
     }
 
-    gl->AttachShader(program, shader);
-    gl->DeleteShader(shader);
-
     if (!status)
         sc->error_state = true;
 }
 
-static void link_shader(struct gl_shader_cache *sc, GLuint program)
+// If pending is set, the compile status is not checked (see finish_pending()).
+static void compile_attach_shader(struct gl_shader_cache *sc, GLuint program,
+                                  GLenum type, const char *source,
+                                  struct sc_pending *pending)
+{
+    GL *gl = sc->gl;
+
+    GLuint shader = gl->CreateShader(type);
+    gl->ShaderSource(shader, 1, &source, NULL);
+    gl->CompileShader(shader);
+    gl->AttachShader(program, shader);
+
+    if (pending) {
+        int n = pending->num_shaders++;
+        assert(n < MP_ARRAY_SIZE(pending->shaders));
+        pending->shaders[n] = shader;
+        pending->types[n] = type;
+        pending->sources[n] = talloc_strdup(pending, source);
+        return;
+    }
+
+    check_shader(sc, shader, type, source);
+    gl->DeleteShader(shader);
+}
+
+static void check_link(struct gl_shader_cache *sc, GLuint program)
 {
     GL *gl = sc->gl;
-    gl->LinkProgram(program);
     GLint status;
     gl->GetProgramiv(program, GL_LINK_STATUS, &status);
     GLint log_length;
@@ -837,8 +1000,16 @@ static void link_shader(struct gl_shader_cache *sc, GLuint program)
         sc->error_state = true;
 }
 
-static GLuint create_program(struct gl_shader_cache *sc, const char *vertex,
-                             const char *frag)
+static void link_shader(struct gl_shader_cache *sc, GLuint program,
+                        struct sc_pending *pending)
+{
+    sc->gl->LinkProgram(program);
+    if (!pending)
+        check_link(sc, program);
+}
+
+static GLuint compile_program(struct gl_shader_cache *sc, const char *vertex,
+                              const char *frag, struct sc_pending *pending)
 {
     GL *gl = sc->gl;
     MP_VERBOSE(sc, "recompiling a shader program:\n");
@@ -850,32 +1021,285 @@ static GLuint create_program(struct gl_shader_cache *sc, const char *vertex,
     if (sc->text.len)
         mp_log_source(sc->log, MSGL_V, sc->text.start);
     GLuint prog = gl->CreateProgram();
-    compile_attach_shader(sc, prog, GL_VERTEX_SHADER, vertex);
-    compile_attach_shader(sc, prog, GL_FRAGMENT_SHADER, frag);
+    if (!vertex) {
+        // compute shader (passed as frag)
+        compile_attach_shader(sc, prog, GL_COMPUTE_SHADER, frag, pending);
+        link_shader(sc, prog, pending);
+        return prog;
+    }
+    compile_attach_shader(sc, prog, GL_VERTEX_SHADER, vertex, pending);
+    compile_attach_shader(sc, prog, GL_FRAGMENT_SHADER, frag, pending);
     for (int n = 0; sc->vao->entries[n].name; n++) {
         char vname[80];
         snprintf(vname, sizeof(vname), "vertex_%s", sc->vao->entries[n].name);
         gl->BindAttribLocation(prog, n, vname);
     }
-    link_shader(sc, prog);
+    link_shader(sc, prog, pending);
+    return prog;
+}
+
+// Program binaries are also kept in memory for the lifetime of the process,
+// so that gl_video instances rendering into the same GL context (e.g. several
+// libmpv instances using opengl-cb) and VO reinits don't compile the same
+// shaders again. This doesn't depend on the on-disk cache being enabled.
+#define PROGRAM_CACHE_SIZE 128
+
+struct program_cache_entry {
+    char *name;                 // as returned by get_cache_name()
+    GLenum format;
+    struct bstr data;
+};
+
+static pthread_mutex_t program_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct program_cache_entry program_cache[PROGRAM_CACHE_SIZE];
+static int program_cache_next;
+
+// The cache name is the hash of the shader text and the GL implementation, as
+// any driver update can invalidate program binaries.
+static char *get_cache_name(struct gl_shader_cache *sc, void *ta_ctx,
+                            const char *vertex, const char *frag)
+{
+    GL *gl = sc->gl;
+    const char *strings[] = {
+        "ver=1\n", vertex, frag,
+        (const char *)gl->GetString(GL_VENDOR),
+        (const char *)gl->GetString(GL_RENDERER),
+        (const char *)gl->GetString(GL_VERSION),
+    };
+
+    uint8_t hash[32];
+    struct AVSHA *sha = av_sha_alloc();
+    if (!sha)
+        abort();
+    av_sha_init(sha, 256);
+    for (int n = 0; n < MP_ARRAY_SIZE(strings); n++) {
+        const char *s = strings[n] ? strings[n] : "";
+        av_sha_update(sha, s, strlen(s) + 1);
+    }
+    av_sha_final(sha, hash);
+    av_free(sha);
+
+    char *name = talloc_strdup(ta_ctx, "");
+    for (int i = 0; i < sizeof(hash); i++)
+        name = talloc_asprintf_append(name, "%02X", hash[i]);
+    return name;
+}
+
+static GLuint program_from_binary(struct gl_shader_cache *sc, GLenum format,
+                                  struct bstr data, const char *name)
+{
+    GL *gl = sc->gl;
+    GLuint prog = gl->CreateProgram();
+    gl->ProgramBinary(prog, format, data.start, data.len);
+    GLint status = 0;
+    gl->GetProgramiv(prog, GL_LINK_STATUS, &status);
+    // Failure is normal if the driver was updated.
+    if (!status) {
+        MP_VERBOSE(sc, "Cached program binary '%s' rejected.\n", name);
+        gl->DeleteProgram(prog);
+        prog = 0;
+    }
+    // The failed ProgramBinary call might have set an error.
+    while (gl->GetError() != GL_NO_ERROR) {}
+    return prog;
+}
+
+// Return the binary of a linked program, allocated with ta_ctx.
+static struct bstr get_program_binary(struct gl_shader_cache *sc, void *ta_ctx,
+                                      GLuint prog, GLenum *format)
+{
+    GL *gl = sc->gl;
+
+    GLint size = 0;
+    gl->GetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH, &size);
+    if (size <= 0)
+        return (struct bstr){0};
+
+    uint8_t *data = talloc_size(ta_ctx, size);
+    GLsizei len = 0;
+    *format = 0;
+    gl->GetProgramBinary(prog, size, &len, format, data);
+    return (struct bstr){data, MPMAX(len, 0)};
+}
+
+static GLuint load_memory_program(struct gl_shader_cache *sc, const char *name)
+{
+    GLuint prog = 0;
+    pthread_mutex_lock(&program_cache_lock);
+    for (int n = 0; n < PROGRAM_CACHE_SIZE; n++) {
+        struct program_cache_entry *e = &program_cache[n];
+        if (e->name && strcmp(e->name, name) == 0) {
+            prog = program_from_binary(sc, e->format, e->data, name);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&program_cache_lock);
+    return prog;
+}
+
+static void save_memory_program(GLenum format, struct bstr data,
+                                const char *name)
+{
+    if (!data.len)
+        return;
+    pthread_mutex_lock(&program_cache_lock);
+    struct program_cache_entry *e = &program_cache[program_cache_next];
+    program_cache_next = (program_cache_next + 1) % PROGRAM_CACHE_SIZE;
+    free(e->name);
+    free(e->data.start);
+    *e = (struct program_cache_entry){
+        .name = strdup(name),
+        .format = format,
+        .data = {malloc(data.len), data.len},
+    };
+    if (!e->name || !e->data.start) {
+        free(e->name);
+        free(e->data.start);
+        *e = (struct program_cache_entry){0};
+    } else {
+        memcpy(e->data.start, data.start, data.len);
+    }
+    pthread_mutex_unlock(&program_cache_lock);
+}
+
+// Cache files contain the GLenum binary format, followed by the binary.
+static GLuint load_cached_program(struct gl_shader_cache *sc, const char *file,
+                                  const char *name)
+{
+    GLuint prog = 0;
+
+    if (stat(file, &(struct stat){0}) != 0)
+        return 0;
+
+    void *tmp = talloc_new(NULL);
+    struct bstr data = stream_read_file(file, tmp, sc->global, 100000000);
+    GLenum format;
+    if (data.len > sizeof(format)) {
+        memcpy(&format, data.start, sizeof(format));
+        struct bstr bin = bstr_cut(data, sizeof(format));
+        prog = program_from_binary(sc, format, bin, file);
+        if (prog) {
+            MP_VERBOSE(sc, "Loaded cached program binary '%s'.\n", file);
+            save_memory_program(format, bin, name);
+        }
+    }
+    talloc_free(tmp);
+    return prog;
+}
+
+static void save_program(struct gl_shader_cache *sc, GLenum format,
+                         struct bstr data, const char *file)
+{
+    if (!data.len)
+        return;
+
+    mp_mkdirp(sc->cache_dir);
+    FILE *out = fopen(file, "wb");
+    if (out) {
+        fwrite(&format, sizeof(format), 1, out);
+        fwrite(data.start, data.len, 1, out);
+        fclose(out);
+    } else {
+        MP_WARN(sc, "Could not write shader cache file '%s'.\n", file);
+    }
+}
+
+// Add a successfully linked program to the in-memory cache, and to the
+// on-disk cache if file is not NULL.
+static void store_program(struct gl_shader_cache *sc, GLuint prog,
+                          const char *name, const char *file)
+{
+    void *tmp = talloc_new(NULL);
+    GLenum format = 0;
+    struct bstr data = get_program_binary(sc, tmp, prog, &format);
+    save_memory_program(format, data, name);
+    if (file)
+        save_program(sc, format, data, file);
+    talloc_free(tmp);
+}
+
+// pending: if not NULL, compile in the background (if the program is not
+//          loaded from the cache)
+static GLuint create_program(struct gl_shader_cache *sc, const char *vertex,
+                             const char *frag, struct sc_pending *pending)
+{
+    if (!sc->gl->ProgramBinary)
+        return compile_program(sc, vertex, frag, pending);
+
+    void *tmp = talloc_new(NULL);
+    char *name = get_cache_name(sc, tmp, vertex, frag);
+    char *file = sc->cache_dir ? mp_path_join(tmp, sc->cache_dir, name) : NULL;
+    GLuint prog = load_memory_program(sc, name);
+    if (!prog && file)
+        prog = load_cached_program(sc, file, name);
+    if (!prog && pending) {
+        // The binary can be retrieved only once linking is done; this is
+        // done in finish_pending().
+        prog = compile_program(sc, vertex, frag, pending);
+        pending->cache_name = talloc_strdup(pending, name);
+        pending->cache_file = talloc_strdup(pending, file);
+    } else if (!prog) {
+        bool error = sc->error_state;
+        sc->error_state = false;
+        prog = compile_program(sc, vertex, frag, NULL);
+        if (!sc->error_state)
+            store_program(sc, prog, name, file);
+        sc->error_state |= error;
+    }
+    talloc_free(tmp);
     return prog;
 }
 
 #define ADD(x, ...) bstr_xappend_asprintf(sc, (x), __VA_ARGS__)
 #define ADD_BSTR(x, s) bstr_xappend(sc, (x), (s))
 
-// 1. Generate vertex and fragment shaders from the fragment shader text added
-//    with gl_sc_add(). The generated shader program is cached (based on the
-//    text), so actual compilation happens only the first time.
-// 2. Update the uniforms set with gl_sc_uniform_*.
-// 3. Make the new shader program current (glUseProgram()).
-// 4. Reset the sc state and prepare for a new shader program. (All uniforms
-//    and fragment operations needed for the next program have to be re-added.)
-void gl_sc_gen_shader_and_reset(struct gl_shader_cache *sc)
+// Generate the full compute shader text, and create the program.
+static GLuint create_compute_program(struct gl_shader_cache *sc,
+                                     struct sc_pending *pending)
 {
     GL *gl = sc->gl;
 
-    assert(sc->vao);
+    bstr *comp = &sc->tmp[0];
+    comp->len = 0;
+    // The GLSL version used for the other shaders is usually too low.
+    ADD(comp, "#version %s\n", gl->es ? "310 es" : "430");
+    for (int n = 0; n < sc->num_exts; n++)
+        ADD(comp, "#extension %s : enable\n", sc->exts[n]);
+    if (gl->es) {
+        ADD(comp, "precision highp float;\n");
+        ADD(comp, "precision mediump sampler2D;\n");
+        if (gl->mpgl_caps & MPGL_CAP_3D_TEX)
+            ADD(comp, "precision mediump sampler3D;\n");
+    }
+    ADD_BSTR(comp, sc->prelude_text);
+    ADD(comp, "#define texture1D texture\n");
+    ADD(comp, "#define texture3D texture\n");
+    ADD(comp, "layout (local_size_x = %d, local_size_y = %d) in;\n",
+        sc->compute_w, sc->compute_h);
+    for (int n = 0; n < sc->num_uniforms; n++) {
+        struct sc_uniform *u = &sc->uniforms[n];
+        ADD(comp, "uniform %s %s;\n", u->glsl_type, u->name);
+    }
+    ADD(comp, "#define LUT_POS(x, lut_size)"
+              " mix(0.5 / (lut_size), 1.0 - 0.5 / (lut_size), (x))\n");
+    if (sc->header_text.len) {
+        ADD(comp, "// header\n");
+        ADD_BSTR(comp, sc->header_text);
+        ADD(comp, "// body\n");
+    }
+    ADD(comp, "void main() {\n");
+    ADD(comp, "vec4 color = vec4(0.0, 0.0, 0.0, 1.0);\n");
+    ADD_BSTR(comp, sc->text);
+    ADD(comp, "}\n");
+
+    return create_program(sc, NULL, comp->start, pending);
+}
+
+// Generate the full vertex and fragment shader text, and create the program.
+static GLuint create_graphics_program(struct gl_shader_cache *sc,
+                                      struct sc_pending *pending)
+{
+    GL *gl = sc->gl;
 
     for (int n = 0; n < MP_ARRAY_SIZE(sc->tmp); n++)
         sc->tmp[n].len = 0;
@@ -959,10 +1383,136 @@ void gl_sc_gen_shader_and_reset(struct gl_shader_cache *sc)
     }
     ADD(frag, "}\n");
 
+    return create_program(sc, vert->start, frag->start, pending);
+}
+
+// Querying the uniform locations blocks until the program is linked.
+static void get_uniform_locations(struct gl_shader_cache *sc,
+                                  struct sc_entry *entry)
+{
+    for (int n = 0; n < entry->num_uniforms; n++) {
+        struct sc_cached_uniform *un = &entry->uniforms[n];
+        un->loc = sc->gl->GetUniformLocation(entry->gl_shader, un->name);
+    }
+}
+
+// Create the program for a new cache entry.
+static void create_entry_program(struct gl_shader_cache *sc,
+                                 struct sc_entry *entry)
+{
+    if (sc->async)
+        entry->pending = talloc_zero(NULL, struct sc_pending);
+
+    entry->gl_shader = sc->compute_w ? create_compute_program(sc, entry->pending)
+                                     : create_graphics_program(sc, entry->pending);
+
+    // Loaded from the program binary cache.
+    if (entry->pending && !entry->pending->num_shaders)
+        TA_FREEP(&entry->pending);
+
+    for (int n = 0; n < sc->num_uniforms; n++) {
+        struct sc_cached_uniform un = {
+            .name = talloc_strdup(NULL, sc->uniforms[n].name),
+            .glsl_type = sc->uniforms[n].glsl_type,
+            .loc = -1,
+        };
+        MP_TARRAY_APPEND(NULL, entry->uniforms, entry->num_uniforms, un);
+        talloc_steal(entry->uniforms, un.name);
+    }
+
+    if (!entry->pending)
+        get_uniform_locations(sc, entry);
+}
+
+// Return whether the background compilation of the entry's program is done.
+// If it is, check the results (like compile_program() does for synchronous
+// compilation), and make the entry usable.
+static bool finish_pending(struct gl_shader_cache *sc, struct sc_entry *entry)
+{
+    GL *gl = sc->gl;
+    struct sc_pending *pending = entry->pending;
+
+    GLint done = 0;
+    gl->GetProgramiv(entry->gl_shader, GL_COMPLETION_STATUS_KHR, &done);
+    if (!done)
+        return false;
+
+    bool error = sc->error_state;
+    sc->error_state = false;
+    for (int n = 0; n < pending->num_shaders; n++) {
+        check_shader(sc, pending->shaders[n], pending->types[n],
+                     pending->sources[n]);
+        gl->DeleteShader(pending->shaders[n]);
+    }
+    check_link(sc, entry->gl_shader);
+    if (!sc->error_state && pending->cache_name)
+        store_program(sc, entry->gl_shader, pending->cache_name,
+                      pending->cache_file);
+    sc->error_state |= error;
+
+    TA_FREEP(&entry->pending);
+    get_uniform_locations(sc, entry);
+    return true;
+}
+
+static uint64_t sc_hash(struct gl_shader_cache *sc)
+{
+    uint64_t h = sc->text_hash;
+    h = hash_bytes(h, &sc->header_hash, sizeof(sc->header_hash));
+    h = hash_bytes(h, sc->prelude_text.start, sc->prelude_text.len);
+    h = hash_bytes(h, &sc->num_exts, sizeof(sc->num_exts));
+    h = hash_bytes(h, &sc->vao, sizeof(sc->vao));
+    h = hash_bytes(h, &sc->compute_w, sizeof(sc->compute_w));
+    h = hash_bytes(h, &sc->compute_h, sizeof(sc->compute_h));
+    for (int n = 0; n < sc->num_uniforms; n++) {
+        h = hash_str(h, sc->uniforms[n].name);
+        h = hash_str(h, sc->uniforms[n].glsl_type);
+    }
+    return h;
+}
+
+static bool sc_entry_matches(struct gl_shader_cache *sc, struct sc_entry *e)
+{
+    if (e->vao != sc->vao || e->num_exts != sc->num_exts ||
+        e->compute_w != sc->compute_w || e->compute_h != sc->compute_h ||
+        e->num_uniforms != sc->num_uniforms ||
+        !bstr_equals(e->text, sc->text) ||
+        !bstr_equals(e->header, sc->header_text) ||
+        !bstr_equals(e->prelude, sc->prelude_text))
+        return false;
+    for (int n = 0; n < sc->num_uniforms; n++) {
+        if (strcmp(e->uniforms[n].name, sc->uniforms[n].name) != 0 ||
+            strcmp(e->uniforms[n].glsl_type, sc->uniforms[n].glsl_type) != 0)
+            return false;
+    }
+    return true;
+}
+
+// 1. Generate vertex and fragment shaders from the fragment shader text added
+//    with gl_sc_add(). The generated shader program is cached (based on a hash
+//    of the inputs, which are compared in full on a hash hit), so generating
+//    the text and compilation happen only the first time.
+// 2. Update the uniforms set with gl_sc_uniform_*.
+// 3. Make the new shader program current (glUseProgram()).
+// 4. Reset the sc state and prepare for a new shader program. (All uniforms
+//    and fragment operations needed for the next program have to be re-added.)
+// Returns false if the program is still being compiled in the background (see
+// gl_sc_set_async_compile()); then 2. and 3. are skipped, and the caller must
+// not draw anything with it.
+bool gl_sc_gen_shader_and_reset(struct gl_shader_cache *sc)
+{
+    GL *gl = sc->gl;
+
+    assert(sc->vao || sc->compute_w);
+
+    uint64_t hash = sc_hash(sc);
     struct sc_entry *entry = NULL;
-    for (int n = 0; n < sc->num_entries; n++) {
-        struct sc_entry *cur = &sc->entries[n];
-        if (bstr_equals(cur->frag, *frag) && bstr_equals(cur->vert, *vert)) {
+    for (unsigned int i = hash; ; i++) {
+        int idx = sc->table[i & (SC_TABLE_SIZE - 1)];
+        if (!idx)
+            break;
+        struct sc_entry *cur = &sc->entries[idx - 1];
+        if (cur->hash == hash && sc_entry_matches(sc, cur)) {
             entry = cur;
             break;
         }
@@ -973,30 +1523,36 @@ void gl_sc_gen_shader_and_reset(struct gl_shader_cache *sc)
         MP_TARRAY_GROW(sc, sc->entries, sc->num_entries);
         entry = &sc->entries[sc->num_entries++];
         *entry = (struct sc_entry){
-            .vert = bstrdup(NULL, *vert),
-            .frag = bstrdup(NULL, *frag),
+            .hash = hash,
+            .prelude = bstrdup(NULL, sc->prelude_text),
+            .header = bstrdup(NULL, sc->header_text),
+            .text = bstrdup(NULL, sc->text),
+            .num_exts = sc->num_exts,
+            .vao = sc->vao,
+            .compute_w = sc->compute_w,
+            .compute_h = sc->compute_h,
         };
-    }
-    // build vertex shader from vao and cache the locations of the uniform variables
-    if (!entry->gl_shader) {
-        entry->gl_shader = create_program(sc, vert->start, frag->start);
-        for (int n = 0; n < sc->num_uniforms; n++) {
-            struct sc_cached_uniform un = {
-                .loc = gl->GetUniformLocation(entry->gl_shader,
-                                              sc->uniforms[n].name),
-            };
-            MP_TARRAY_APPEND(sc, entry->uniforms, entry->num_uniforms, un);
-        }
+        unsigned int i = hash;
+        while (sc->table[i & (SC_TABLE_SIZE - 1)])
+            i++;
+        sc->table[i & (SC_TABLE_SIZE - 1)] = sc->num_entries;
+        create_entry_program(sc, entry);
     }
 
-    gl->UseProgram(entry->gl_shader);
+    bool ready = !entry->pending || finish_pending(sc, entry);
+    if (ready) {
+        gl->UseProgram(entry->gl_shader);
 
-    assert(sc->num_uniforms == entry->num_uniforms);
+        assert(sc->num_uniforms == entry->num_uniforms);
 
-    for (int n = 0; n < sc->num_uniforms; n++)
-        update_uniform(gl, entry, &sc->uniforms[n], n);
+        for (int n = 0; n < sc->num_uniforms; n++)
+            update_uniform(gl, entry, &sc->uniforms[n], n);
+    } else {
+        sc->skipped = true;
+    }
 
     gl_sc_reset(sc);
+    return ready;
 }
 
 // Maximum number of simultaneous query objects to keep around. Reducing this
@@ -1008,10 +1564,13 @@ void gl_sc_gen_shader_and_reset(struct gl_shader_cache *sc)
 // calculations. This corresponds to a few seconds (exact time variable)
 #define QUERY_SAMPLE_SIZE 256
 
+// Timers are measured with a pair of timestamp queries, rather than with
+// GL_TIME_ELAPSED queries, because the latter can't be nested.
 struct gl_timer {
     GL *gl;
-    GLuint query[QUERY_OBJECT_NUM];
+    GLuint query[QUERY_OBJECT_NUM][2]; // start/end timestamps
     int query_idx;
+    int active;     // index of the query pair being recorded, or -1
 
     GLuint64 samples[QUERY_SAMPLE_SIZE];
     int sample_idx;
@@ -1047,10 +1606,10 @@ uint64_t gl_timer_peak_us(struct gl_timer *timer)
 struct gl_timer *gl_timer_create(GL *gl)
 {
     struct gl_timer *timer = talloc_ptrtype(NULL, timer);
-    *timer = (struct gl_timer){ .gl = gl };
+    *timer = (struct gl_timer){ .gl = gl, .active = -1 };
 
     if (gl->GenQueries)
-        gl->GenQueries(QUERY_OBJECT_NUM, timer->query);
+        gl->GenQueries(QUERY_OBJECT_NUM * 2, &timer->query[0][0]);
 
     return timer;
 }
@@ -1063,7 +1622,7 @@ void gl_timer_free(struct gl_timer *timer)
     GL *gl = timer->gl;
     if (gl && gl->DeleteQueries) {
         // this is a no-op on already uninitialized queries
-        gl->DeleteQueries(QUERY_OBJECT_NUM, timer->query);
+        gl->DeleteQueries(QUERY_OBJECT_NUM * 2, &timer->query[0][0]);
     }
 
     talloc_free(timer);
@@ -1095,34 +1654,92 @@ static void gl_timer_record(struct gl_timer *timer, GLuint64 new)
 
 // If no free query is available, this can block. Shouldn't ever happen in
 // practice, though. (If it does, consider increasing QUERY_OBJECT_NUM)
-// IMPORTANT: only one gl_timer object may ever be active at a single time.
-// The caling code *MUST* ensure this
+// Timers can be nested, but a single timer can't be started again before it
+// was stopped.
 void gl_timer_start(struct gl_timer *timer)
 {
     GL *gl = timer->gl;
-    if (!gl->BeginQuery)
+    if (!gl->QueryCounter)
         return;
 
-    // Get the next query object
-    GLuint id = timer->query[timer->query_idx++];
+    // Get the next query objects
+    int idx = timer->query_idx++;
     timer->query_idx %= QUERY_OBJECT_NUM;
+    GLuint *ids = timer->query[idx];
 
-    // If this query object already holds a result, we need to get and
+    // If these query objects already hold a result, we need to get and
     // record it first
-    if (gl->IsQuery(id)) {
-        GLuint64 elapsed;
-        gl->GetQueryObjectui64v(id, GL_QUERY_RESULT, &elapsed);
-        gl_timer_record(timer, elapsed);
+    if (gl->IsQuery(ids[1])) {
+        GLuint64 start, end;
+        gl->GetQueryObjectui64v(ids[0], GL_QUERY_RESULT, &start);
+        gl->GetQueryObjectui64v(ids[1], GL_QUERY_RESULT, &end);
+        gl_timer_record(timer, end > start ? end - start : 0);
     }
 
-    gl->BeginQuery(GL_TIME_ELAPSED, id);
+    gl->QueryCounter(ids[0], GL_TIMESTAMP);
+    timer->active = idx;
 }
 
 void gl_timer_stop(struct gl_timer *timer)
 {
     GL *gl = timer->gl;
-    if (gl->EndQuery)
-        gl->EndQuery(GL_TIME_ELAPSED);
+    if (!gl->QueryCounter || timer->active < 0)
+        return;
+
+    gl->QueryCounter(timer->query[timer->active][1], GL_TIMESTAMP);
+    timer->active = -1;
+}
+
+static bool pbo_ring_init(struct gl_pbo_upload *pbo, GL *gl)
+{
+    size_t size = pbo->buffer_size * PBO_RING_SIZE;
+    GLbitfield flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    gl->GenBuffers(1, &pbo->ring);
+    gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo->ring);
+    gl->BufferStorage(GL_PIXEL_UNPACK_BUFFER, size, NULL, flags);
+    pbo->ring_map = gl->MapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+    gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (!pbo->ring_map) {
+        gl->DeleteBuffers(1, &pbo->ring);
+        pbo->ring = 0;
+        return false;
+    }
+    return true;
+}
+
+// Upload through the persistent ring. The memcpy goes straight to memory
+// visible to the GPU, and the texture upload from it is asynchronous. A
+// fence per slot makes sure it isn't overwritten while still in use.
+static bool pbo_ring_upload(struct gl_pbo_upload *pbo, GL *gl, GLenum target,
+                            GLenum format, GLenum type, const void *dataptr,
+                            int stride, int x, int y, int w, int h)
+{
+    size_t pix_stride = gl_bytes_per_pixel(format, type);
+
+    pbo->index = (pbo->index + 1) % PBO_RING_SIZE;
+    GLsync *fence = &pbo->ring_fences[pbo->index];
+    if (*fence) {
+        GLenum res = gl->ClientWaitSync(*fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                        1000000000); // 1 second
+        gl->DeleteSync(*fence);
+        *fence = NULL;
+        if (res == GL_TIMEOUT_EXPIRED || res == GL_WAIT_FAILED)
+            return false;
+    }
+
+    size_t offset = pbo->index * pbo->buffer_size;
+    memcpy_pic(pbo->ring_map + offset, dataptr, pix_stride * w, h,
+               pix_stride * w, stride);
+
+    gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo->ring);
+    gl_upload_tex(gl, target, format, type, (void *)(uintptr_t)offset,
+                  pix_stride * w, x, y, w, h);
+    gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    *fence = gl->FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    return true;
 }
 
 // Upload a texture, going through a PBO. PBO supposedly can facilitate
@@ -1152,6 +1769,17 @@ void gl_pbo_upload_tex(struct gl_pbo_upload *pbo, GL *gl, bool use_pbo,
     if (buffer_size != pbo->buffer_size)
         gl_pbo_upload_uninit(pbo);
 
+    if (gl->BufferStorage && gl->FenceSync && !pbo->ring_failed) {
+        if (!pbo->ring) {
+            pbo->gl = gl;
+            pbo->buffer_size = buffer_size;
+            pbo->ring_failed = !pbo_ring_init(pbo, gl);
+        }
+        if (pbo->ring && pbo_ring_upload(pbo, gl, target, format, type,
+                                         dataptr, stride, x, y, w, h))
+            return;
+    }
+
     if (!pbo->buffers[0]) {
         pbo->gl = gl;
         pbo->buffer_size = buffer_size;
@@ -1190,7 +1818,19 @@ no_pbo:
 
 void gl_pbo_upload_uninit(struct gl_pbo_upload *pbo)
 {
-    if (pbo->gl)
-        pbo->gl->DeleteBuffers(2, &pbo->buffers[0]);
+    GL *gl = pbo->gl;
+    if (gl) {
+        gl->DeleteBuffers(2, &pbo->buffers[0]);
+        for (int n = 0; n < PBO_RING_SIZE; n++) {
+            if (pbo->ring_fences[n])
+                gl->DeleteSync(pbo->ring_fences[n]);
+        }
+        if (pbo->ring) {
+            gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo->ring);
+            gl->UnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            gl->DeleteBuffers(1, &pbo->ring);
+        }
+    }
     *pbo = (struct gl_pbo_upload){0};
 }
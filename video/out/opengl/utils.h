@@ -23,6 +23,7 @@
 #include "math.h"
 
 struct mp_log;
+struct mpv_global;
 
 void gl_check_error(GL *gl, struct mp_log *log, const char *info);
 
@@ -147,10 +148,15 @@ struct gl_shader_cache;
 
 struct gl_shader_cache *gl_sc_create(GL *gl, struct mp_log *log);
 void gl_sc_destroy(struct gl_shader_cache *sc);
+void gl_sc_set_cache_dir(struct gl_shader_cache *sc, struct mpv_global *global,
+                         const char *dir);
+void gl_sc_set_async_compile(struct gl_shader_cache *sc, bool enable);
+bool gl_sc_take_skipped(struct gl_shader_cache *sc);
 bool gl_sc_error_state(struct gl_shader_cache *sc);
 void gl_sc_reset_error(struct gl_shader_cache *sc);
 void gl_sc_add(struct gl_shader_cache *sc, const char *text);
 void gl_sc_addf(struct gl_shader_cache *sc, const char *textf, ...);
+void gl_sc_paddf(struct gl_shader_cache *sc, const char *textf, ...);
 void gl_sc_hadd(struct gl_shader_cache *sc, const char *text);
 void gl_sc_haddf(struct gl_shader_cache *sc, const char *textf, ...);
 void gl_sc_hadd_bstr(struct gl_shader_cache *sc, struct bstr text);
@@ -166,8 +172,9 @@ void gl_sc_uniform_mat2(struct gl_shader_cache *sc, char *name,
 void gl_sc_uniform_mat3(struct gl_shader_cache *sc, char *name,
                         bool transpose, GLfloat *v);
 void gl_sc_set_vao(struct gl_shader_cache *sc, struct gl_vao *vao);
+void gl_sc_set_compute(struct gl_shader_cache *sc, int w, int h);
 void gl_sc_enable_extension(struct gl_shader_cache *sc, char *name);
-void gl_sc_gen_shader_and_reset(struct gl_shader_cache *sc);
+bool gl_sc_gen_shader_and_reset(struct gl_shader_cache *sc);
 void gl_sc_reset(struct gl_shader_cache *sc);
 
 struct gl_timer;
@@ -182,11 +189,19 @@ uint64_t gl_timer_last_us(struct gl_timer *timer);
 uint64_t gl_timer_avg_us(struct gl_timer *timer);
 uint64_t gl_timer_peak_us(struct gl_timer *timer);
 
+#define PBO_RING_SIZE 3
+
 struct gl_pbo_upload {
     GL *gl;
     int index;
     GLuint buffers[2];
     size_t buffer_size;
+    // Persistently mapped ring of PBO_RING_SIZE * buffer_size bytes, used
+    // instead of buffers[] if the GL supports it.
+    GLuint ring;
+    uint8_t *ring_map;
+    GLsync ring_fences[PBO_RING_SIZE];
+    bool ring_failed;
 };
 
 void gl_pbo_upload_tex(struct gl_pbo_upload *pbo, GL *gl, bool use_pbo,
@@ -17,11 +17,13 @@
 
 #include <assert.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <string.h>
 #include <assert.h>
 
+#include <libavutil/buffer.h>
 #include <libavutil/common.h>
 #include <libavutil/lfg.h>
 
@@ -33,6 +35,7 @@
 #include "options/options.h"
 #include "common.h"
 #include "formats.h"
+#include "ra_gl.h"
 #include "utils.h"
 #include "hwdec.h"
 #include "osd.h"
@@ -95,10 +98,11 @@ struct texplane {
     bool use_integer;
     GLenum gl_format;
     GLenum gl_type;
+    const struct ra_format *format;
+    struct ra_tex *tex;         // NULL with hwdec
     GLuint gl_texture;
     char swizzle[5];
     bool flipped;
-    struct gl_pbo_upload pbo;
 };
 
 struct video_image {
@@ -151,9 +155,19 @@ struct tex_hook {
     bool (*cond)(struct gl_video *p, struct img_tex tex, void *priv);
 };
 
+// A texture name referenced by the hooks, and the hooks that hook it (in
+// order). This is built once when the hooks are set up, so that rendering
+// each frame doesn't need to search all hooks for each hook point.
+struct hook_point {
+    const char *name;
+    int hooks[MAX_TEXTURE_HOOKS];   // indexes into gl_video.tex_hooks
+    int num_hooks;
+};
+
 struct fbosurface {
     struct fbotex fbotex;
     double pts;
+    int components;
 };
 
 #define FBOSURFACES_MAX 10
@@ -163,8 +177,27 @@ struct cached_file {
     struct bstr body;
 };
 
+// GPU timer for a render pass, identified by its description.
+struct pass_info {
+    char desc[64];
+    struct gl_timer *timer;
+};
+
+// Entry of the FBO pool. Only valid until the next frame is rendered.
+struct pooled_fbo {
+    struct fbotex fbo;
+    int last_frame;     // p->fbo_pool_frame when it was last handed out
+};
+
+// Persistently mapped buffer handed out to the decoder for direct rendering.
+struct dr_buffer {
+    struct ra_buf *buf;
+    bool in_use;        // referenced by an mp_image (protected by dr_lock)
+};
+
 struct gl_video {
     GL *gl;
+    struct ra *ra;
 
     struct mpv_global *global;
     struct mp_log *log;
@@ -184,8 +217,12 @@ struct gl_video {
     struct mpgl_osd *osd;
     double osd_pts;
 
+    void (*redraw_cb)(void *ctx);
+    void *redraw_cb_ctx;
+
     GLuint lut_3d_texture;
     bool use_lut_3d;
+    bool lut_3d_pending;        // LUT is being generated in the background
     int lut_3d_size[3];
 
     GLuint dither_texture;
@@ -195,6 +232,12 @@ struct gl_video {
     struct gl_timer *render_timer;
     struct gl_timer *present_timer;
 
+    // per-pass timers, in the order the passes of a frame are run
+    struct pass_info pass_info[VO_PASS_PERF_MAX];
+    int pass_idx;               // number of passes run in the current frame
+    int last_num_passes;        // same for the last complete frame
+    char pass_desc[64];         // description for the next pass
+
     struct mp_image_params real_image_params;   // configured format
     struct mp_image_params image_params;        // texture format (mind hwdec case)
     struct mp_imgfmt_desc image_desc;
@@ -209,18 +252,30 @@ struct gl_video {
 
     bool dumb_mode;
     bool forced_dumb_mode;
+    GLint max_compute_shmem;    // GL_MAX_COMPUTE_SHARED_MEMORY_SIZE
+    bool use_gather;            // textureGather() in scalers
+    bool use_peak_detect;       // hdr-compute-peak is usable
+
+    // FBO format for intermediate passes (either opts.fbo_format, or one of
+    // the formats below with fbo-format-adaptive)
+    GLenum fbo_format;
+    GLenum fbo_format_8;        // usable 32 bit formats (0 if unavailable)
+    GLenum fbo_format_10;
+    GLuint peak_detect_ssbo;    // state of the HDR peak detection
+
+    // Intermediate FBOs, shared by all passes (see get_pooled_fbo())
+    struct pooled_fbo **fbo_pool;
+    int num_fbo_pool;
+    int fbo_pool_frame;
 
-    struct fbotex merge_fbo[4];
-    struct fbotex scale_fbo[4];
-    struct fbotex integer_fbo[4];
-    struct fbotex indirect_fbo;
-    struct fbotex blend_subs_fbo;
     struct fbotex output_fbo;
     struct fbosurface surfaces[FBOSURFACES_MAX];
     struct fbotex vdpau_deinterleave_fbo[2];
 
     int surface_idx;
     int surface_now;
+    int num_surfaces;       // ring size in use (<= FBOSURFACES_MAX)
+    bool surfaces_native;   // surfaces contain unscaled frames
     int frames_drawn;
     bool is_interpolated;
     bool output_fbo_valid;
@@ -249,8 +304,8 @@ struct gl_video {
     int saved_tex_num;
     struct tex_hook tex_hooks[MAX_TEXTURE_HOOKS];
     int tex_hook_num;
-    struct fbotex hook_fbos[MAX_SAVED_TEXTURES];
-    int hook_fbo_num;
+    struct hook_point *hook_points;
+    int num_hook_points;
 
     int frames_uploaded;
     int frames_rendered;
@@ -268,6 +323,12 @@ struct gl_video {
 
     bool dsi_warned;
     bool broken_frame; // temporary error state
+
+    // Only the VO thread adds or removes entries; the lock is needed for
+    // in_use, which is cleared when the decoder frees an image.
+    pthread_mutex_t dr_lock;
+    struct dr_buffer *dr_buffers;
+    int num_dr_buffers;
 };
 
 struct packed_fmt_entry {
@@ -387,6 +448,7 @@ const struct m_sub_options gl_video_conf = {
                     {"gamma",    TONE_MAPPING_GAMMA},
                     {"linear",   TONE_MAPPING_LINEAR})),
         OPT_FLOAT("tone-mapping-param", tone_mapping_param, 0),
+        OPT_FLAG("hdr-compute-peak", hdr_compute_peak, 0),
         OPT_FLAG("pbo", pbo, 0),
         SCALER_OPTS("scale",  SCALER_SCALE),
         SCALER_OPTS("dscale", SCALER_DSCALE),
@@ -412,6 +474,7 @@ const struct m_sub_options gl_video_conf = {
                     {"rgba16f", GL_RGBA16F},
                     {"rgba32f", GL_RGBA32F},
                     {"auto",   0})),
+        OPT_FLAG("fbo-format-adaptive", fbo_format_adaptive, 0),
         OPT_CHOICE_OR_INT("dither-depth", dither_depth, 0, -1, 16,
                           ({"no", -1}, {"auto", 0})),
         OPT_CHOICE("dither", dither_algo, 0,
@@ -430,11 +493,15 @@ const struct m_sub_options gl_video_conf = {
         OPT_COLOR("background", background, 0),
         OPT_FLAG("interpolation", interpolation, 0),
         OPT_FLOAT("interpolation-threshold", interpolation_threshold, 0),
+        OPT_FLAG("interpolation-compact", interpolation_compact, 0),
         OPT_CHOICE("blend-subtitles", blend_subs, 0,
                    ({"no", BLEND_SUBS_NO},
                     {"yes", BLEND_SUBS_YES},
                     {"video", BLEND_SUBS_VIDEO})),
         OPT_STRINGLIST("user-shaders", user_shaders, 0),
+        OPT_STRING("shader-cache-dir", shader_cache_dir, 0),
+        OPT_FLAG("shader-async-compile", shader_async_compile, 0),
+        OPT_FLAG("compute-scalers", compute_scalers, 0),
         OPT_FLAG("deband", deband, 0),
         OPT_SUBSTRUCT("deband", deband_opts, deband_conf, 0),
         OPT_FLOAT("sharpen", unsharp, 0),
@@ -542,12 +609,50 @@ static void gl_video_reset_hooks(struct gl_video *p)
     }
 
     p->tex_hook_num = 0;
+    p->num_hook_points = 0;
 }
 
-static inline int fbosurface_wrap(int id)
+static struct hook_point *find_hook_point(struct gl_video *p, const char *name)
 {
-    id = id % FBOSURFACES_MAX;
-    return id < 0 ? id + FBOSURFACES_MAX : id;
+    for (int n = 0; n < p->num_hook_points; n++) {
+        struct hook_point *hp = &p->hook_points[n];
+        if (hp->name == name || strcmp(hp->name, name) == 0)
+            return hp;
+    }
+    return NULL;
+}
+
+static struct hook_point *add_hook_point(struct gl_video *p, const char *name)
+{
+    struct hook_point *hp = find_hook_point(p, name);
+    if (!hp) {
+        MP_TARRAY_APPEND(p, p->hook_points, p->num_hook_points,
+                         (struct hook_point){ .name = name });
+        hp = &p->hook_points[p->num_hook_points - 1];
+    }
+    return hp;
+}
+
+// Build the hook_points table from the current tex_hooks.
+static void build_hook_points(struct gl_video *p)
+{
+    p->num_hook_points = 0;
+    for (int i = 0; i < p->tex_hook_num; i++) {
+        struct tex_hook *hook = &p->tex_hooks[i];
+        struct hook_point *hp = add_hook_point(p, hook->hook_tex);
+        hp->hooks[hp->num_hooks++] = i;
+        for (int b = 0; b < TEXUNIT_VIDEO_NUM; b++) {
+            const char *bind = hook->bind_tex[b];
+            if (bind && strcmp(bind, "HOOKED") != 0)
+                add_hook_point(p, bind);
+        }
+    }
+}
+
+static inline int fbosurface_wrap(struct gl_video *p, int id)
+{
+    id = id % p->num_surfaces;
+    return id < 0 ? id + p->num_surfaces : id;
 }
 
 static void reinit_osd(struct gl_video *p)
@@ -570,21 +675,19 @@ static void uninit_rendering(struct gl_video *p)
     gl->DeleteTextures(1, &p->dither_texture);
     p->dither_texture = 0;
 
-    for (int n = 0; n < 4; n++) {
-        fbotex_uninit(&p->merge_fbo[n]);
-        fbotex_uninit(&p->scale_fbo[n]);
-        fbotex_uninit(&p->integer_fbo[n]);
-    }
+    if (gl->DeleteBuffers)
+        gl->DeleteBuffers(1, &p->peak_detect_ssbo);
+    p->peak_detect_ssbo = 0;
 
-    fbotex_uninit(&p->indirect_fbo);
-    fbotex_uninit(&p->blend_subs_fbo);
+    for (int n = 0; n < p->num_fbo_pool; n++) {
+        fbotex_uninit(&p->fbo_pool[n]->fbo);
+        talloc_free(p->fbo_pool[n]);
+    }
+    p->num_fbo_pool = 0;
 
     for (int n = 0; n < FBOSURFACES_MAX; n++)
         fbotex_uninit(&p->surfaces[n].fbotex);
 
-    for (int n = 0; n < MAX_SAVED_TEXTURES; n++)
-        fbotex_uninit(&p->hook_fbos[n]);
-
     for (int n = 0; n < 2; n++)
         fbotex_uninit(&p->vdpau_deinterleave_fbo[n]);
 
@@ -602,6 +705,16 @@ void gl_video_set_icc_profile(struct gl_video *p, bstr icc_data)
         reinit_from_options(p);
 }
 
+// cb is called from a background thread when a redraw would render something
+// different, e.g. when a 3D LUT finished generating.
+void gl_video_set_redraw_cb(struct gl_video *p, void (*cb)(void *ctx),
+                            void *ctx)
+{
+    p->redraw_cb = cb;
+    p->redraw_cb_ctx = ctx;
+    gl_lcms_set_wakeup(p->cms, cb, ctx);
+}
+
 bool gl_video_icc_auto_enabled(struct gl_video *p)
 {
     return p->opts.icc_opts ? p->opts.icc_opts->profile_auto : false;
@@ -615,11 +728,17 @@ static bool gl_video_get_lut3d(struct gl_video *p, enum mp_csp_prim prim,
     if (!p->use_lut_3d)
         return false;
 
-    if (p->lut_3d_texture && !gl_lcms_has_changed(p->cms, prim, trc))
+    if (p->lut_3d_texture && !p->lut_3d_pending &&
+        !gl_lcms_has_changed(p->cms, prim, trc))
         return true;
 
+    // Until the LUT is ready, render without it (non-ICC path).
     struct lut3d *lut3d = NULL;
-    if (!gl_lcms_get_lut3d(p->cms, &lut3d, prim, trc) || !lut3d) {
+    int r = gl_lcms_get_lut3d(p->cms, &lut3d, prim, trc);
+    p->lut_3d_pending = r == 0;
+    if (r == 0)
+        return false;
+    if (r < 0 || !lut3d) {
         p->use_lut_3d = false;
         return false;
     }
@@ -645,8 +764,6 @@ static bool gl_video_get_lut3d(struct gl_video *p, enum mp_csp_prim prim,
     for (int i = 0; i < 3; i++)
         p->lut_3d_size[i] = lut3d->size[i];
 
-    talloc_free(lut3d);
-
     return true;
 }
 
@@ -778,8 +895,6 @@ static void pass_get_img_tex(struct gl_video *p, struct video_image *vimg,
 
 static void init_video(struct gl_video *p)
 {
-    GL *gl = p->gl;
-
     if (p->hwdec && p->hwdec->driver->imgfmt == p->image_params.imgfmt) {
         if (p->hwdec->driver->reinit(p->hwdec, &p->image_params) < 0)
             MP_ERR(p, "Initializing texture for hardware decoding failed.\n");
@@ -811,8 +926,8 @@ static void init_video(struct gl_video *p)
     if (!p->hwdec_active) {
         struct video_image *vimg = &p->image;
 
-        GLenum gl_target =
-            p->opts.use_rectangle ? GL_TEXTURE_RECTANGLE : GL_TEXTURE_2D;
+        bool use_rect = p->opts.use_rectangle &&
+                        (p->ra->caps & RA_CAP_TEX_RECT);
 
         struct mp_image layout = {0};
         mp_image_set_params(&layout, &p->image_params);
@@ -820,28 +935,29 @@ static void init_video(struct gl_video *p)
         for (int n = 0; n < p->plane_count; n++) {
             struct texplane *plane = &vimg->planes[n];
 
-            plane->gl_target = gl_target;
-
             plane->w = plane->tex_w = mp_image_plane_w(&layout, n);
             plane->h = plane->tex_h = mp_image_plane_h(&layout, n);
 
-            gl->ActiveTexture(GL_TEXTURE0 + n);
-            gl->GenTextures(1, &plane->gl_texture);
-            gl->BindTexture(gl_target, plane->gl_texture);
-
-            gl->TexImage2D(gl_target, 0, plane->gl_internal_format,
-                           plane->w, plane->h, 0,
-                           plane->gl_format, plane->gl_type, NULL);
-
-            int filter = plane->use_integer ? GL_NEAREST : GL_LINEAR;
-            gl->TexParameteri(gl_target, GL_TEXTURE_MIN_FILTER, filter);
-            gl->TexParameteri(gl_target, GL_TEXTURE_MAG_FILTER, filter);
-            gl->TexParameteri(gl_target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            gl->TexParameteri(gl_target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            struct ra_tex_params params = {
+                .dimensions = 2,
+                .w = plane->w,
+                .h = plane->h,
+                .d = 1,
+                .format = plane->format,
+                .src_linear = !plane->use_integer,
+                .non_normalized = use_rect,
+            };
+            plane->tex = p->ra->fns->tex_create(p->ra, &params);
+            if (!plane->tex) {
+                MP_ERR(p, "Failed to create texture for plane %d.\n", n);
+                continue;
+            }
+            plane->gl_texture = ra_gl_tex_id(plane->tex);
+            plane->gl_target = ra_gl_tex_target(plane->tex);
 
-            MP_VERBOSE(p, "Texture for plane %d: %dx%d\n", n, plane->w, plane->h);
+            MP_VERBOSE(p, "Texture for plane %d: %dx%d (%s)\n", n, plane->w,
+                       plane->h, plane->format->name);
         }
-        gl->ActiveTexture(GL_TEXTURE0);
     }
 
     debug_check_gl(p, "after video texture creation");
@@ -871,20 +987,14 @@ static void unref_current_image(struct gl_video *p)
 
 static void uninit_video(struct gl_video *p)
 {
-    GL *gl = p->gl;
-
     uninit_rendering(p);
 
     struct video_image *vimg = &p->image;
 
     unref_current_image(p);
 
-    for (int n = 0; n < p->plane_count; n++) {
-        struct texplane *plane = &vimg->planes[n];
-
-        gl->DeleteTextures(1, &plane->gl_texture);
-        gl_pbo_upload_uninit(&plane->pbo);
-    }
+    for (int n = 0; n < p->plane_count; n++)
+        ra_tex_free(p->ra, &vimg->planes[n].tex);
     *vimg = (struct video_image){0};
 
     // Invalidate image_params to ensure that gl_video_config() will call
@@ -971,14 +1081,68 @@ static void render_pass_quad(struct gl_video *p, int vp_w, int vp_h,
     debug_check_gl(p, "after rendering");
 }
 
+// Set the description of the next pass, as reported by the per-pass timers.
+// If none is set, the pass is reported as "(unknown)".
+PRINTF_ATTRIBUTE(2, 3)
+static void pass_describe(struct gl_video *p, const char *textf, ...)
+{
+    va_list ap;
+    va_start(ap, textf);
+    vsnprintf(p->pass_desc, sizeof(p->pass_desc), textf, ap);
+    va_end(ap);
+}
+
+// Start the GPU timer of the pass that is about to be run.
+static struct gl_timer *pass_timer_start(struct gl_video *p)
+{
+    const char *desc = p->pass_desc[0] ? p->pass_desc : "(unknown)";
+    if (p->pass_idx >= VO_PASS_PERF_MAX)
+        goto done;
+
+    // If passes were added or removed, look for the timer this pass used
+    // before, so that its statistics are kept.
+    struct pass_info *pass = &p->pass_info[p->pass_idx];
+    for (int n = p->pass_idx; n < VO_PASS_PERF_MAX; n++) {
+        if (strcmp(p->pass_info[n].desc, desc) == 0) {
+            MPSWAP(struct pass_info, *pass, p->pass_info[n]);
+            break;
+        }
+    }
+    if (strcmp(pass->desc, desc) != 0) {
+        gl_timer_free(pass->timer);
+        pass->timer = NULL;
+        snprintf(pass->desc, sizeof(pass->desc), "%s", desc);
+    }
+    if (!pass->timer)
+        pass->timer = gl_timer_create(p->gl);
+    p->pass_idx++;
+
+    p->pass_desc[0] = '\0';
+    gl_timer_start(pass->timer);
+    return pass->timer;
+
+done:
+    p->pass_desc[0] = '\0';
+    return NULL;
+}
+
+static void pass_timer_stop(struct gl_timer *timer)
+{
+    if (timer)
+        gl_timer_stop(timer);
+}
+
 static void finish_pass_direct(struct gl_video *p, GLint fbo, int vp_w, int vp_h,
                                const struct mp_rect *dst)
 {
     GL *gl = p->gl;
     pass_prepare_src_tex(p);
     gl->BindFramebuffer(GL_FRAMEBUFFER, fbo);
-    gl_sc_gen_shader_and_reset(p->sc);
-    render_pass_quad(p, vp_w, vp_h, dst);
+    if (gl_sc_gen_shader_and_reset(p->sc)) {
+        struct gl_timer *timer = pass_timer_start(p);
+        render_pass_quad(p, vp_w, vp_h, dst);
+        pass_timer_stop(timer);
+    }
     gl->BindFramebuffer(GL_FRAMEBUFFER, 0);
     memset(&p->pass_tex, 0, sizeof(p->pass_tex));
     p->pass_tex_num = 0;
@@ -993,12 +1157,128 @@ static void finish_pass_direct(struct gl_video *p, GLint fbo, int vp_w, int vp_h
 static void finish_pass_fbo(struct gl_video *p, struct fbotex *dst_fbo,
                             int w, int h, int flags)
 {
-    fbotex_change(dst_fbo, p->gl, p->log, w, h, p->opts.fbo_format, flags);
+    fbotex_change(dst_fbo, p->gl, p->log, w, h, p->fbo_format, flags);
 
     finish_pass_direct(p, dst_fbo->fbo, dst_fbo->rw, dst_fbo->rh,
                        &(struct mp_rect){0, 0, w, h});
 }
 
+// Pool entries not used for this many frames are freed.
+#define FBO_POOL_MAX_AGE 10
+
+// Start a new frame: all pool entries become available again.
+static void fbo_pool_new_frame(struct gl_video *p)
+{
+    p->fbo_pool_frame++;
+    for (int n = p->num_fbo_pool - 1; n >= 0; n--) {
+        struct pooled_fbo *e = p->fbo_pool[n];
+        if (p->fbo_pool_frame - e->last_frame > FBO_POOL_MAX_AGE) {
+            fbotex_uninit(&e->fbo);
+            talloc_free(e);
+            MP_TARRAY_REMOVE_AT(p->fbo_pool, p->num_fbo_pool, n);
+        }
+    }
+}
+
+// Return a FBO that has the given size and p->fbo_format, and is not used
+// yet by any other pass of the current frame. It stays reserved until the
+// next fbo_pool_new_frame() call. flags are as in fbotex_change().
+static struct fbotex *get_pooled_fbo(struct gl_video *p, int w, int h,
+                                     int flags)
+{
+    GLenum iformat = p->fbo_format;
+    struct pooled_fbo *match = NULL, *unused = NULL;
+
+    for (int n = 0; n < p->num_fbo_pool; n++) {
+        struct pooled_fbo *e = p->fbo_pool[n];
+        if (e->last_frame == p->fbo_pool_frame)
+            continue;
+        struct fbotex *fbo = &e->fbo;
+        bool w_ok = (flags & FBOTEX_FUZZY_W) ? fbo->rw >= w : fbo->rw == w;
+        bool h_ok = (flags & FBOTEX_FUZZY_H) ? fbo->rh >= h : fbo->rh == h;
+        if (w_ok && h_ok && fbo->iformat == iformat) {
+            match = e;
+            break;
+        }
+        if (!unused || e->last_frame < unused->last_frame)
+            unused = e;
+    }
+
+    // Reallocate the least recently used one rather than adding a new one,
+    // so that a size change doesn't leave the old textures around.
+    if (!match)
+        match = unused;
+    if (!match) {
+        match = talloc_zero(NULL, struct pooled_fbo);
+        MP_TARRAY_APPEND(p, p->fbo_pool, p->num_fbo_pool, match);
+    }
+
+    match->last_frame = p->fbo_pool_frame;
+    fbotex_change(&match->fbo, p->gl, p->log, w, h, iformat, flags);
+    return &match->fbo;
+}
+
+// Like finish_pass_fbo(), but render to a FBO from the pool.
+static struct fbotex *finish_pass_pooled(struct gl_video *p, int w, int h,
+                                         int flags)
+{
+    struct fbotex *fbo = get_pooled_fbo(p, w, h, flags);
+    finish_pass_fbo(p, fbo, w, h, flags);
+    return fbo;
+}
+
+// Work group size for compute shader passes.
+#define COMPUTE_BW 16
+#define COMPUTE_BH 8
+
+// Run the current pass as compute shader with COMPUTE_BW*COMPUTE_BH work
+// groups, writing to dst_fbo's texture (w*h pixels) as image unit 0. If
+// dst_fbo is NULL, the shader only writes to shader storage buffers.
+static void finish_pass_compute(struct gl_video *p, struct fbotex *dst_fbo,
+                                int w, int h)
+{
+    GL *gl = p->gl;
+    pass_prepare_src_tex(p);
+    if (gl_sc_gen_shader_and_reset(p->sc)) {
+        if (dst_fbo) {
+            gl->BindImageTexture(0, dst_fbo->texture, 0, GL_FALSE, 0,
+                                 GL_WRITE_ONLY, dst_fbo->iformat);
+        }
+        struct gl_timer *timer = pass_timer_start(p);
+        gl->DispatchCompute((w + COMPUTE_BW - 1) / COMPUTE_BW,
+                            (h + COMPUTE_BH - 1) / COMPUTE_BH, 1);
+        pass_timer_stop(timer);
+        // Make the result visible to the following passes.
+        if (dst_fbo) {
+            gl->MemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+            gl->BindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY,
+                                 dst_fbo->iformat);
+        } else {
+            gl->MemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        }
+    }
+    memset(&p->pass_tex, 0, sizeof(p->pass_tex));
+    p->pass_tex_num = 0;
+    debug_check_gl(p, "after compute pass");
+}
+
+// GLSL image format qualifier for a FBO format, or NULL if unsupported.
+static const char *image_format_qualifier(GL *gl, GLenum iformat)
+{
+    switch (iformat) {
+    case GL_RGBA16F:    return "rgba16f";
+    case GL_RGBA32F:    return "rgba32f";
+    case GL_RGBA8:      return "rgba8";
+    }
+    if (!gl->es) {
+        switch (iformat) {
+        case GL_RGBA16:     return "rgba16";
+        case GL_RGB10_A2:   return "rgb10_a2";
+        }
+    }
+    return NULL;
+}
+
 // Copy a texture to the vec4 color, while increasing offset. Also applies
 // the texture multiplier to the sampled color
 static void copy_img_tex(struct gl_video *p, int *offset, struct img_tex img)
@@ -1036,7 +1316,7 @@ static void skip_unused(struct gl_video *p, int num_components)
 static void uninit_scaler(struct gl_video *p, struct scaler *scaler)
 {
     GL *gl = p->gl;
-    fbotex_uninit(&scaler->sep_fbo);
+    fbotex_uninit(&scaler->compute_fbo);
     gl->DeleteTextures(1, &scaler->gl_lut);
     scaler->gl_lut = 0;
     scaler->kernel = NULL;
@@ -1113,12 +1393,13 @@ static struct img_tex pass_hook(struct gl_video *p, const char *name,
 
     saved_tex_store(p, name, tex);
 
-    MP_DBG(p, "Running hooks for %s\n", name);
-    for (int i = 0; i < p->tex_hook_num; i++) {
-        struct tex_hook *hook = &p->tex_hooks[i];
+    struct hook_point *hp = find_hook_point(p, name);
+    if (!hp)
+        return tex;
 
-        if (strcmp(hook->hook_tex, name) != 0)
-            continue;
+    MP_DBG(p, "Running hooks for %s\n", name);
+    for (int i = 0; i < hp->num_hooks; i++) {
+        struct tex_hook *hook = &p->tex_hooks[hp->hooks[i]];
 
         // Check the hook's condition
         if (hook->cond && !hook->cond(p, tex, hook->priv)) {
@@ -1167,11 +1448,10 @@ static struct img_tex pass_hook(struct gl_video *p, const char *name,
         int w = lroundf(fabs(sz.x1 - sz.x0));
         int h = lroundf(fabs(sz.y1 - sz.y0));
 
-        assert(p->hook_fbo_num < MAX_SAVED_TEXTURES);
-        struct fbotex *fbo = &p->hook_fbos[p->hook_fbo_num++];
-        finish_pass_fbo(p, fbo, w, h, 0);
-
         const char *store_name = hook->save_tex ? hook->save_tex : name;
+
+        pass_describe(p, "hook %s -> %s", name, store_name);
+        struct fbotex *fbo = finish_pass_pooled(p, w, h, 0);
         struct img_tex saved_tex = img_tex_fbo(fbo, tex.type, comps);
 
         // If the texture we're saving overwrites the "current" texture, also
@@ -1205,28 +1485,12 @@ next_hook: ;
 static void pass_opt_hook_point(struct gl_video *p, const char *name,
                                 struct gl_transform *tex_trans)
 {
-    if (!name)
-        return;
-
-    for (int i = 0; i < p->tex_hook_num; i++) {
-        struct tex_hook *hook = &p->tex_hooks[i];
-
-        if (strcmp(hook->hook_tex, name) == 0)
-            goto found;
-
-        for (int b = 0; b < TEXUNIT_VIDEO_NUM; b++) {
-            if (hook->bind_tex[b] && strcmp(hook->bind_tex[b], name) == 0)
-                goto found;
-        }
-    }
-
     // Nothing uses this texture, don't bother storing it
-    return;
+    if (!name || !find_hook_point(p, name))
+        return;
 
-found:
-    assert(p->hook_fbo_num < MAX_SAVED_TEXTURES);
-    struct fbotex *fbo = &p->hook_fbos[p->hook_fbo_num++];
-    finish_pass_fbo(p, fbo, p->texture_w, p->texture_h, 0);
+    pass_describe(p, "hook point %s", name);
+    struct fbotex *fbo = finish_pass_pooled(p, p->texture_w, p->texture_h, 0);
 
     struct img_tex img = img_tex_fbo(fbo, PLANE_RGB, p->components);
     img = pass_hook(p, name, img, tex_trans);
@@ -1403,10 +1667,11 @@ static void pass_sample_separated(struct gl_video *p, struct img_tex src,
     GLSLF("// pass 1\n");
     pass_sample_separated_gen(p->sc, scaler, 0, 1);
     GLSLF("color *= %f;\n", src.multiplier);
-    finish_pass_fbo(p, &scaler->sep_fbo, src.w, h, FBOTEX_FUZZY_H);
+    pass_describe(p, "%s (vertical)", scaler->conf.kernel.name);
+    struct fbotex *fbo = finish_pass_pooled(p, src.w, h, FBOTEX_FUZZY_H);
 
     // Second pass (scale only in the x dir)
-    src = img_tex_fbo(&scaler->sep_fbo, src.type, src.components);
+    src = img_tex_fbo(fbo, src.type, src.components);
     src.transform = t_x;
     sampler_prelude(p->sc, pass_bind(p, src));
     GLSLF("// pass 2\n");
@@ -1441,7 +1706,9 @@ static void pass_sample(struct gl_video *p, struct img_tex tex,
     } else if (strcmp(name, "oversample") == 0) {
         pass_sample_oversample(p->sc, scaler, w, h);
     } else if (scaler->kernel && scaler->kernel->polar) {
-        pass_sample_polar(p->sc, scaler);
+        bool gather = p->use_gather && !tex.use_integer &&
+                      tex.gl_target != GL_TEXTURE_EXTERNAL_OES;
+        pass_sample_polar(p->sc, scaler, tex.components, gather);
     } else if (scaler->kernel) {
         pass_sample_separated(p, tex, scaler, w, h);
     } else {
@@ -1458,6 +1725,78 @@ static void pass_sample(struct gl_video *p, struct img_tex tex,
     skip_unused(p, tex.components);
 }
 
+// Like pass_sample(), but use a compute shader for polar scalers, which
+// reuses the fetched texels between neighbouring outputs. The current pass
+// must be empty. The scaled result is rendered to scaler->compute_fbo, and
+// then read into "color" of a new pass. Returns false (without doing
+// anything) if this is not possible, and pass_sample() should be used.
+static bool pass_sample_compute(struct gl_video *p, struct img_tex tex,
+                                struct scaler *scaler,
+                                const struct scaler_config *conf,
+                                double scale_factor, int w, int h)
+{
+    GL *gl = p->gl;
+
+    if (!p->opts.compute_scalers || !(gl->mpgl_caps & MPGL_CAP_COMPUTE_SHADER))
+        return false;
+
+    reinit_scaler(p, scaler, conf, scale_factor, filter_sizes);
+    if (!scaler->kernel || !scaler->kernel->polar ||
+        tex.gl_target != GL_TEXTURE_2D || tex.use_integer)
+        return false;
+
+    const char *qualifier = image_format_qualifier(gl, p->fbo_format);
+    if (!qualifier)
+        return false;
+
+    // Texture coordinates of the centers of output pixels (0,0), (1,0) and
+    // (0,1), computed like the vertex attributes in render_pass_quad().
+    float pos[3][2] = {{0.5, 0.5}, {1.5, 0.5}, {0.5, 1.5}};
+    for (int n = 0; n < 3; n++) {
+        pos[n][0] = pos[n][0] / w * tex.w;
+        pos[n][1] = pos[n][1] / h * tex.h;
+        gl_transform_vec(tex.transform, &pos[n][0], &pos[n][1]);
+        pos[n][0] /= tex.tex_w;
+        pos[n][1] /= tex.tex_h;
+    }
+    // The shared memory neighbourhood assumes there is no rotation.
+    if (fabs(pos[1][1] - pos[0][1]) > 1e-6 || fabs(pos[2][0] - pos[0][0]) > 1e-6)
+        return false;
+    float dpos[2] = {pos[1][0] - pos[0][0], pos[2][1] - pos[0][1]};
+
+    int in_w, in_h;
+    pass_compute_polar_size(scaler, COMPUTE_BW, COMPUTE_BH,
+                            dpos[0] * tex.tex_w, dpos[1] * tex.tex_h,
+                            &in_w, &in_h);
+    // Strong downscaling needs too large neighbourhoods.
+    if (in_w * in_h * 4 * sizeof(float) > p->max_compute_shmem)
+        return false;
+
+    if (!fbotex_change(&scaler->compute_fbo, gl, p->log, w, h,
+                       p->fbo_format, 0))
+        return false;
+
+    gl_sc_set_compute(p->sc, COMPUTE_BW, COMPUTE_BH);
+    GLSLHF("layout(%s, binding = 0) writeonly uniform highp image2D out_image;\n",
+           qualifier);
+    gl_sc_uniform_vec2(p->sc, "out_pos0", pos[0]);
+    gl_sc_uniform_vec2(p->sc, "out_dpos", dpos);
+    gl_sc_uniform_vec2(p->sc, "out_size", (GLfloat[]){w, h});
+    pass_compute_polar(p->sc, scaler, pass_bind(p, tex), COMPUTE_BW, COMPUTE_BH,
+                       in_w, in_h);
+    GLSLF("color *= %f;\n", tex.multiplier);
+    GLSL(if (all(lessThan(vec2(gl_GlobalInvocationID.xy), out_size)))
+             imageStore(out_image, ivec2(gl_GlobalInvocationID.xy), color);)
+    pass_describe(p, "%s (compute)", scaler->conf.kernel.name);
+    finish_pass_compute(p, &scaler->compute_fbo, w, h);
+
+    struct img_tex res = img_tex_fbo(&scaler->compute_fbo, tex.type,
+                                     tex.components);
+    copy_img_tex(p, &(int){0}, res);
+    skip_unused(p, tex.components);
+    return true;
+}
+
 // Returns true if two img_texs are semantically equivalent (same metadata)
 static bool img_tex_equiv(struct img_tex a, struct img_tex b)
 {
@@ -1641,6 +1980,8 @@ static void gl_video_setup_hooks(struct gl_video *p)
     }
 
     pass_hook_user_shaders(p, p->opts.user_shaders);
+
+    build_hook_points(p);
 }
 
 // sample from video textures, set "color" variable to yuv value
@@ -1678,8 +2019,9 @@ static void pass_read_video(struct gl_video *p)
         if (num > 0) {
             GLSLF("// merging plane %d ... into %d\n", n, first);
             copy_img_tex(p, &num, tex[n]);
-            finish_pass_fbo(p, &p->merge_fbo[n], tex[n].w, tex[n].h, 0);
-            tex[first] = img_tex_fbo(&p->merge_fbo[n], tex[n].type, num);
+            pass_describe(p, "merging planes");
+            struct fbotex *fbo = finish_pass_pooled(p, tex[n].w, tex[n].h, 0);
+            tex[first] = img_tex_fbo(fbo, tex[n].type, num);
             memset(&tex[n], 0, sizeof(tex[n]));
         }
     }
@@ -1691,9 +2033,9 @@ static void pass_read_video(struct gl_video *p)
             GLSLF("// use_integer fix for plane %d\n", n);
 
             copy_img_tex(p, &(int){0}, tex[n]);
-            finish_pass_fbo(p, &p->integer_fbo[n], tex[n].w, tex[n].h, 0);
-            tex[n] = img_tex_fbo(&p->integer_fbo[n], tex[n].type,
-                                 tex[n].components);
+            pass_describe(p, "integer conversion (plane %d)", n);
+            struct fbotex *fbo = finish_pass_pooled(p, tex[n].w, tex[n].h, 0);
+            tex[n] = img_tex_fbo(fbo, tex[n].type, tex[n].components);
         }
     }
 
@@ -1812,9 +2154,10 @@ static void pass_read_video(struct gl_video *p)
         if (strcmp(conf->kernel.name, "bilinear") != 0) {
             GLSLF("// upscaling plane %d\n", n);
             pass_sample(p, tex[n], scaler, conf, 1.0, p->texture_w, p->texture_h);
-            finish_pass_fbo(p, &p->scale_fbo[n], p->texture_w, p->texture_h,
-                            FBOTEX_FUZZY);
-            tex[n] = img_tex_fbo(&p->scale_fbo[n], tex[n].type, tex[n].components);
+            pass_describe(p, "upscaling plane %d (%s)", n, conf->kernel.name);
+            struct fbotex *fbo = finish_pass_pooled(p, p->texture_w,
+                                                    p->texture_h, FBOTEX_FUZZY);
+            tex[n] = img_tex_fbo(fbo, tex[n].type, tex[n].components);
         }
 
         // Run any post-scaling hooks
@@ -2014,10 +2357,13 @@ static void pass_scale_main(struct gl_video *p)
     compute_src_transform(p, &transform);
 
     GLSLF("// main scaling\n");
-    finish_pass_fbo(p, &p->indirect_fbo, p->texture_w, p->texture_h, 0);
-    struct img_tex src = img_tex_fbo(&p->indirect_fbo, PLANE_RGB, p->components);
+    pass_describe(p, "before main scaling");
+    struct fbotex *fbo = finish_pass_pooled(p, p->texture_w, p->texture_h, 0);
+    struct img_tex src = img_tex_fbo(fbo, PLANE_RGB, p->components);
     gl_transform_trans(transform, &src.transform);
-    pass_sample(p, src, scaler, &scaler_conf, scale_factor, vp_w, vp_h);
+    if (!pass_sample_compute(p, src, scaler, &scaler_conf, scale_factor,
+                             vp_w, vp_h))
+        pass_sample(p, src, scaler, &scaler_conf, scale_factor, vp_w, vp_h);
 
     // Changes the texture size to display size after main scaler.
     p->texture_w = vp_w;
@@ -2033,6 +2379,45 @@ static void pass_scale_main(struct gl_video *p)
     }
 }
 
+// Render the current pass to a FBO, and measure its brightness with a compute
+// shader (see pass_compute_peak()). The pass continues with the FBO contents.
+static bool pass_detect_peak(struct gl_video *p, struct mp_colorspace src,
+                             float scale)
+{
+    GL *gl = p->gl;
+    int w = p->dst_rect.x1 - p->dst_rect.x0,
+        h = p->dst_rect.y1 - p->dst_rect.y0;
+    if (w < 1 || h < 1)
+        return false;
+
+    if (!p->peak_detect_ssbo) {
+        // frame_max, frame_sum, wg_done, peak, avg
+        static const uint32_t zero[5] = {0};
+        gl->GenBuffers(1, &p->peak_detect_ssbo);
+        gl->BindBuffer(GL_SHADER_STORAGE_BUFFER, p->peak_detect_ssbo);
+        gl->BufferData(GL_SHADER_STORAGE_BUFFER, sizeof(zero), zero,
+                       GL_DYNAMIC_COPY);
+        gl->BindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+    // Stays bound until the end of the frame (pass_draw_to_screen()).
+    gl->BindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, p->peak_detect_ssbo);
+
+    pass_describe(p, "before HDR peak detection");
+    struct fbotex *fbo = finish_pass_pooled(p, w, h, FBOTEX_FUZZY);
+
+    int id = pass_bind(p, img_tex_fbo(fbo, PLANE_RGB, p->components));
+    int num_wg = ((w + COMPUTE_BW - 1) / COMPUTE_BW) *
+                 ((h + COMPUTE_BH - 1) / COMPUTE_BH);
+    gl_sc_set_compute(p->sc, COMPUTE_BW, COMPUTE_BH);
+    pass_compute_peak(p->sc, id, w, h, COMPUTE_BW, COMPUTE_BH, num_wg,
+                      src.gamma, scale);
+    pass_describe(p, "HDR peak detection");
+    finish_pass_compute(p, NULL, w, h);
+
+    pass_read_fbo(p, fbo);
+    return true;
+}
+
 // Adapts the colors to the right output color space. (Final pass during
 // rendering)
 // If OSD is true, ignore any changes that may have been made to the video
@@ -2052,6 +2437,7 @@ static void pass_colormanage(struct gl_video *p, struct mp_colorspace src, bool
         .nom_peak = mp_csp_trc_nom_peak(p->opts.target_trc, p->opts.target_brightness),
     };
 
+    bool use_lut_3d = false;
     if (p->use_lut_3d) {
         // The 3DLUT is always generated against the video's original source
         // space, *not* the reference space. (To avoid having to regenerate
@@ -2070,7 +2456,8 @@ static void pass_colormanage(struct gl_video *p, struct mp_colorspace src, bool
             trc_orig = MP_CSP_TRC_GAMMA22;
         }
 
-        if (gl_video_get_lut3d(p, prim_orig, trc_orig)) {
+        use_lut_3d = gl_video_get_lut3d(p, prim_orig, trc_orig);
+        if (use_lut_3d) {
             dst.primaries = prim_orig;
             dst.gamma = trc_orig;
         }
@@ -2128,11 +2515,15 @@ static void pass_colormanage(struct gl_video *p, struct mp_colorspace src, bool
     MP_DBG(p, "HDR src nom: %f sig: %f, dst: %f\n",
            src.nom_peak, src.sig_peak, dst.nom_peak);
 
+    bool detect_peak = p->use_peak_detect && !p->dumb_mode && !osd &&
+                       src.sig_peak > dst.nom_peak &&
+                       pass_detect_peak(p, src, src.nom_peak / dst.nom_peak);
+
     // Adapt from src to dst as necessary
     pass_color_map(p->sc, src, dst, p->opts.hdr_tone_mapping,
-                   p->opts.tone_mapping_param);
+                   p->opts.tone_mapping_param, detect_peak);
 
-    if (p->use_lut_3d) {
+    if (use_lut_3d) {
         gl_sc_uniform_sampler(p->sc, "lut_3d", GL_TEXTURE_3D, TEXUNIT_3DLUT);
         GLSL(vec3 cpos;)
         for (int i = 0; i < 3; i++)
@@ -2271,6 +2662,26 @@ static void pass_draw_osd(struct gl_video *p, int draw_flags, double pts,
                 vec4(ass_color.rgb, ass_color.a * texture(osdtex, texcoord).r);)
             break;
         }
+        case SUBBITMAP_INDEXED: {
+            GLSLF("// OSD (indexed)\n");
+            mpgl_osd_set_indexed_uniforms(p->osd, p->sc, n);
+            // Look up the 4 nearest texels, and filter bilinearly.
+            GLSL(vec2 pal_pos = texcoord * osdtex_size - vec2(0.5);)
+            GLSL(vec2 pal_fcoord = fract(pal_pos);)
+            GLSL(vec2 pal_base = (pal_pos - pal_fcoord + vec2(0.5)) / osdtex_size;)
+            GLSL(vec2 pal_pt = vec2(1.0) / osdtex_size;)
+            GLSL(float pal_row = (ass_color.r * 255.0 + 0.5) / osdpal_h;)
+            for (int i = 0; i < 4; i++) {
+                GLSLF("vec4 pal_c%d = texture(osdpal, vec2("
+                      "texture(osdtex, pal_base + pal_pt * vec2(%d.0, %d.0)).r"
+                      " * (255.0 / 256.0) + 0.5 / 256.0, pal_row));\n",
+                      i, i & 1, i >> 1);
+            }
+            GLSL(color = mix(mix(pal_c0, pal_c1, pal_fcoord.x),
+                             mix(pal_c2, pal_c3, pal_fcoord.x),
+                             pal_fcoord.y).bgra;)
+            break;
+        }
         default:
             abort();
         }
@@ -2285,8 +2696,8 @@ static void pass_draw_osd(struct gl_video *p, int draw_flags, double pts,
             pass_colormanage(p, csp_srgb, true);
         }
         gl_sc_set_vao(p->sc, mpgl_osd_get_vao(p->osd));
-        gl_sc_gen_shader_and_reset(p->sc);
-        mpgl_osd_draw_part(p->osd, vp_w, vp_h, n);
+        if (gl_sc_gen_shader_and_reset(p->sc))
+            mpgl_osd_draw_part(p->osd, vp_w, vp_h, n);
     }
     gl_sc_set_vao(p->sc, &p->vao);
 }
@@ -2316,30 +2727,56 @@ static void pass_render_frame_dumb(struct gl_video *p, int fbo)
     pass_convert_yuv(p);
 }
 
-// The main rendering function, takes care of everything up to and including
-// upscaling. p->image is rendered.
-static void pass_render_frame(struct gl_video *p)
+// With fbo-format-adaptive, use a 32 bit format for the intermediate passes if
+// that keeps the precision of the source. Linear light and sigmoidization need
+// more than that, and user shaders might store anything.
+static void update_fbo_format(struct gl_video *p)
 {
-    // initialize the texture parameters
+    struct gl_video_opts *o = &p->opts;
+    int bits = p->image_desc.component_bits;
+    GLenum fmt = o->fbo_format;
+
+    if (o->fbo_format_adaptive && !o->linear_scaling && !o->sigmoid_upscaling &&
+        !(o->user_shaders && o->user_shaders[0]) && bits > 0)
+    {
+        if (bits <= 8 && p->has_alpha) {
+            fmt = p->fbo_format_8 ? p->fbo_format_8 : fmt;
+        } else if (bits <= 10 && !p->has_alpha) {
+            // RGB10_A2 costs the same as RGBA8, so prefer it for 8 bit too.
+            if (p->fbo_format_10) {
+                fmt = p->fbo_format_10;
+            } else if (bits <= 8 && p->fbo_format_8) {
+                fmt = p->fbo_format_8;
+            }
+        }
+    }
+
+    if (fmt != p->fbo_format) {
+        MP_VERBOSE(p, "Using FBO format 0x%x for intermediate passes "
+                   "(%d bit source).\n", (unsigned)fmt, bits);
+    }
+    p->fbo_format = fmt;
+}
+
+// Reset the texture parameters to the unscaled video size.
+static void pass_render_frame_init(struct gl_video *p)
+{
+    update_fbo_format(p);
     p->texture_w = p->image_params.w;
     p->texture_h = p->image_params.h;
     p->texture_offset = identity_trans;
     p->components = 0;
     p->saved_tex_num = 0;
-    p->hook_fbo_num = 0;
+    fbo_pool_new_frame(p);
 
     if (p->image_params.rotate % 180 == 90)
         MPSWAP(int, p->texture_w, p->texture_h);
+}
 
-    if (p->dumb_mode)
-        return;
-
-    // start the render timer here. it will continue to the end of this
-    // function, to render the time needed to draw (excluding screen
-    // presentation)
-    gl_timer_start(p->render_timer);
-
-    p->use_linear = p->opts.linear_scaling || p->opts.sigmoid_upscaling;
+// Render the current video image up to (and including) the MAIN hook, i.e.
+// at video resolution.
+static void pass_render_frame_native(struct gl_video *p)
+{
     pass_read_video(p);
     pass_opt_hook_point(p, "NATIVE", &p->texture_offset);
     pass_convert_yuv(p);
@@ -2357,19 +2794,29 @@ static void pass_render_frame(struct gl_video *p)
             .w = p->texture_w, .h = p->texture_h,
             .display_par = scale[1] / scale[0], // counter compensate scaling
         };
-        finish_pass_fbo(p, &p->blend_subs_fbo, rect.w, rect.h, 0);
+        pass_describe(p, "before subtitle blending");
+        struct fbotex *fbo = finish_pass_pooled(p, rect.w, rect.h, 0);
         pass_draw_osd(p, OSD_DRAW_SUB_ONLY, vpts, rect,
-                      rect.w, rect.h, p->blend_subs_fbo.fbo, false);
+                      rect.w, rect.h, fbo->fbo, false);
         GLSL(color = texture(texture0, texcoord0);)
-        pass_read_fbo(p, &p->blend_subs_fbo);
+        pass_read_fbo(p, fbo);
     }
     pass_opt_hook_point(p, "MAIN", &p->texture_offset);
+}
+
+// Scale the result of pass_render_frame_native() to the output size.
+static void pass_render_frame_scaled(struct gl_video *p)
+{
+    p->use_linear = p->opts.linear_scaling || p->opts.sigmoid_upscaling;
 
     pass_scale_main(p);
 
     int vp_w = p->dst_rect.x1 - p->dst_rect.x0,
         vp_h = p->dst_rect.y1 - p->dst_rect.y0;
     if (p->osd && p->opts.blend_subs == BLEND_SUBS_YES) {
+        double vpts = p->image.mpi->pts;
+        if (vpts == MP_NOPTS_VALUE)
+            vpts = p->osd_pts;
         // Recreate the real video size from the src/dst rects
         struct mp_osd_res rect = {
             .w = vp_w, .h = vp_h,
@@ -2387,14 +2834,33 @@ static void pass_render_frame(struct gl_video *p)
             pass_delinearize(p->sc, p->image_params.color.gamma);
             p->use_linear = false;
         }
-        finish_pass_fbo(p, &p->blend_subs_fbo, p->texture_w, p->texture_h,
-                        FBOTEX_FUZZY);
+        pass_describe(p, "before subtitle blending");
+        struct fbotex *fbo = finish_pass_pooled(p, p->texture_w, p->texture_h,
+                                                FBOTEX_FUZZY);
         pass_draw_osd(p, OSD_DRAW_SUB_ONLY, vpts, rect,
-                      p->texture_w, p->texture_h, p->blend_subs_fbo.fbo, false);
-        pass_read_fbo(p, &p->blend_subs_fbo);
+                      p->texture_w, p->texture_h, fbo->fbo, false);
+        pass_read_fbo(p, fbo);
     }
 
     pass_opt_hook_point(p, "SCALED", NULL);
+}
+
+// The main rendering function, takes care of everything up to and including
+// upscaling. p->image is rendered.
+static void pass_render_frame(struct gl_video *p)
+{
+    pass_render_frame_init(p);
+
+    if (p->dumb_mode)
+        return;
+
+    // start the render timer here. it will continue to the end of this
+    // function, to render the time needed to draw (excluding screen
+    // presentation)
+    gl_timer_start(p->render_timer);
+
+    pass_render_frame_native(p);
+    pass_render_frame_scaled(p);
 
     gl_timer_stop(p->render_timer);
 }
@@ -2426,17 +2892,85 @@ static void pass_draw_to_screen(struct gl_video *p, int fbo)
     pass_opt_hook_point(p, "OUTPUT", NULL);
 
     pass_dither(p);
+    pass_describe(p, "output to screen");
     finish_pass_direct(p, fbo, p->vp_w, p->vp_h, &p->dst_rect);
 
+    if (p->peak_detect_ssbo)
+        p->gl->BindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+
     gl_timer_stop(p->present_timer);
 }
 
+// Whether the interpolation surfaces can store the video at its native
+// resolution, deferring scaling until after the frames are blended. User
+// shaders could change the image size or offset, and subtitles blended after
+// scaling would no longer be part of each frame.
+static bool interpolate_native(struct gl_video *p)
+{
+    return p->opts.interpolation_compact && p->tex_hook_num == 0 &&
+           p->opts.blend_subs != BLEND_SUBS_YES && !p->dumb_mode;
+}
+
+// Render the current image into an interpolation surface.
+static void pass_render_surface(struct gl_video *p, struct fbosurface *surf)
+{
+    int w = p->dst_rect.x1 - p->dst_rect.x0,
+        h = p->dst_rect.y1 - p->dst_rect.y0;
+
+    if (p->surfaces_native) {
+        pass_render_frame_init(p);
+        gl_timer_start(p->render_timer);
+        pass_render_frame_native(p);
+        gl_timer_stop(p->render_timer);
+        w = p->texture_w;
+        h = p->texture_h;
+    } else {
+        pass_render_frame(p);
+    }
+
+    pass_describe(p, "render to interpolation surface");
+    finish_pass_fbo(p, &surf->fbotex, w, h, FBOTEX_FUZZY);
+    surf->pts = p->image.mpi->pts;
+    surf->components = p->components;
+}
+
 // Draws an interpolate frame to fbo, based on the frame timing in t
 static void gl_video_interpolate_frame(struct gl_video *p, struct vo_frame *t,
                                        int fbo)
 {
-    int vp_w = p->dst_rect.x1 - p->dst_rect.x0,
-        vp_h = p->dst_rect.y1 - p->dst_rect.y0;
+    // Figure out the queue size. For illustration, a filter radius of 2 would
+    // look like this: _ A [B] C D _
+    // A is surface_bse, B is surface_now, C is surface_now+1 and D is
+    // surface_end.
+    struct scaler *tscale = &p->scaler[SCALER_TSCALE];
+    reinit_scaler(p, tscale, &p->opts.scaler[SCALER_TSCALE], 1, tscale_sizes);
+    bool oversample = strcmp(tscale->conf.kernel.name, "oversample") == 0;
+    bool linear = strcmp(tscale->conf.kernel.name, "linear") == 0;
+    int size;
+
+    if (oversample || linear) {
+        size = 2;
+    } else {
+        assert(tscale->kernel && !tscale->kernel->polar);
+        size = ceil(tscale->kernel->size);
+        assert(size <= TEXUNIT_VIDEO_NUM);
+    }
+
+    // In compact mode, keep only the surfaces the kernel needs, plus the one
+    // before surface_bse (for mix < 0) and one for rendering ahead.
+    int num_surfaces = FBOSURFACES_MAX;
+    bool native = false;
+    if (p->opts.interpolation_compact) {
+        num_surfaces = MPMIN(size + 2, FBOSURFACES_MAX);
+        native = interpolate_native(p);
+    }
+    if (num_surfaces != p->num_surfaces || native != p->surfaces_native) {
+        for (int n = num_surfaces; n < FBOSURFACES_MAX; n++)
+            fbotex_uninit(&p->surfaces[n].fbotex);
+        p->num_surfaces = num_surfaces;
+        p->surfaces_native = native;
+        gl_video_reset_surfaces(p);
+    }
 
     // Reset the queue completely if this is a still image, to avoid any
     // interpolation artifacts from surrounding frames when unpausing or
@@ -2449,57 +2983,36 @@ static void gl_video_interpolate_frame(struct gl_video *p, struct vo_frame *t,
     if (p->surfaces[p->surface_now].pts == MP_NOPTS_VALUE) {
         if (!gl_video_upload_image(p, t->current))
             return;
-        pass_render_frame(p);
-        finish_pass_fbo(p, &p->surfaces[p->surface_now].fbotex,
-                        vp_w, vp_h, FBOTEX_FUZZY);
-        p->surfaces[p->surface_now].pts = p->image.mpi->pts;
+        pass_render_surface(p, &p->surfaces[p->surface_now]);
         p->surface_idx = p->surface_now;
     }
 
     // Find the right frame for this instant
     if (t->current && t->current->pts != MP_NOPTS_VALUE) {
-        int next = fbosurface_wrap(p->surface_now + 1);
+        int next = fbosurface_wrap(p, p->surface_now + 1);
         while (p->surfaces[next].pts != MP_NOPTS_VALUE &&
                p->surfaces[next].pts > p->surfaces[p->surface_now].pts &&
                p->surfaces[p->surface_now].pts < t->current->pts)
         {
             p->surface_now = next;
-            next = fbosurface_wrap(next + 1);
+            next = fbosurface_wrap(p, next + 1);
         }
     }
 
-    // Figure out the queue size. For illustration, a filter radius of 2 would
-    // look like this: _ A [B] C D _
-    // A is surface_bse, B is surface_now, C is surface_now+1 and D is
-    // surface_end.
-    struct scaler *tscale = &p->scaler[SCALER_TSCALE];
-    reinit_scaler(p, tscale, &p->opts.scaler[SCALER_TSCALE], 1, tscale_sizes);
-    bool oversample = strcmp(tscale->conf.kernel.name, "oversample") == 0;
-    bool linear = strcmp(tscale->conf.kernel.name, "linear") == 0;
-    int size;
-
-    if (oversample || linear) {
-        size = 2;
-    } else {
-        assert(tscale->kernel && !tscale->kernel->polar);
-        size = ceil(tscale->kernel->size);
-        assert(size <= TEXUNIT_VIDEO_NUM);
-    }
-
     int radius = size/2;
     int surface_now = p->surface_now;
-    int surface_bse = fbosurface_wrap(surface_now - (radius-1));
-    int surface_end = fbosurface_wrap(surface_now + radius);
-    assert(fbosurface_wrap(surface_bse + size-1) == surface_end);
+    int surface_bse = fbosurface_wrap(p, surface_now - (radius-1));
+    int surface_end = fbosurface_wrap(p, surface_now + radius);
+    assert(fbosurface_wrap(p, surface_bse + size-1) == surface_end);
 
     // Render new frames while there's room in the queue. Note that technically,
     // this should be done before the step where we find the right frame, but
     // it only barely matters at the very beginning of playback, and this way
     // makes the code much more linear.
-    int surface_dst = fbosurface_wrap(p->surface_idx + 1);
+    int surface_dst = fbosurface_wrap(p, p->surface_idx + 1);
     for (int i = 0; i < t->num_frames; i++) {
         // Avoid overwriting data we might still need
-        if (surface_dst == surface_bse - 1)
+        if (surface_dst == fbosurface_wrap(p, surface_bse - 1))
             break;
 
         struct mp_image *f = t->frames[i];
@@ -2510,12 +3023,9 @@ static void gl_video_interpolate_frame(struct gl_video *p, struct vo_frame *t,
         if (f->pts > p->surfaces[p->surface_idx].pts) {
             if (!gl_video_upload_image(p, f))
                 return;
-            pass_render_frame(p);
-            finish_pass_fbo(p, &p->surfaces[surface_dst].fbotex,
-                            vp_w, vp_h, FBOTEX_FUZZY);
-            p->surfaces[surface_dst].pts = f->pts;
+            pass_render_surface(p, &p->surfaces[surface_dst]);
             p->surface_idx = surface_dst;
-            surface_dst = fbosurface_wrap(surface_dst + 1);
+            surface_dst = fbosurface_wrap(p, surface_dst + 1);
         }
     }
 
@@ -2526,7 +3036,7 @@ static void gl_video_interpolate_frame(struct gl_video *p, struct vo_frame *t,
     // end of playback or start of playback.
     bool valid = true;
     for (int i = surface_bse, ii; valid && i != surface_end; i = ii) {
-        ii = fbosurface_wrap(i + 1);
+        ii = fbosurface_wrap(p, i + 1);
         if (p->surfaces[i].pts == MP_NOPTS_VALUE ||
             p->surfaces[ii].pts == MP_NOPTS_VALUE)
         {
@@ -2540,6 +3050,11 @@ static void gl_video_interpolate_frame(struct gl_video *p, struct vo_frame *t,
     // Update OSD PTS to synchronize subtitles with the displayed frame
     p->osd_pts = p->surfaces[surface_now].pts;
 
+    if (p->surfaces_native) {
+        pass_render_frame_init(p);
+        p->components = p->surfaces[surface_now].components;
+    }
+
     // Finally, draw the right mix of frames to the screen.
     if (!valid || t->still) {
         // surface_now is guaranteed to be valid, so we can safely use it.
@@ -2551,7 +3066,7 @@ static void gl_video_interpolate_frame(struct gl_video *p, struct vo_frame *t,
         // so we try to adjust by using the previous set of N frames instead
         // (which requires some extra checking to make sure it's valid)
         if (mix < 0.0) {
-            int prev = fbosurface_wrap(surface_bse - 1);
+            int prev = fbosurface_wrap(p, surface_bse - 1);
             if (p->surfaces[prev].pts != MP_NOPTS_VALUE &&
                 p->surfaces[prev].pts < p->surfaces[surface_bse].pts)
             {
@@ -2588,9 +3103,9 @@ static void gl_video_interpolate_frame(struct gl_video *p, struct vo_frame *t,
 
         // Load all the required frames
         for (int i = 0; i < size; i++) {
-            struct img_tex img =
-                img_tex_fbo(&p->surfaces[fbosurface_wrap(surface_bse+i)].fbotex,
-                            PLANE_RGB, p->components);
+            int id_surf = fbosurface_wrap(p, surface_bse + i);
+            struct img_tex img = img_tex_fbo(&p->surfaces[id_surf].fbotex,
+                                             PLANE_RGB, p->components);
             // Since the code in pass_sample_separated currently assumes
             // the textures are bound in-order and starting at 0, we just
             // assert to make sure this is the case (which it should always be)
@@ -2602,6 +3117,13 @@ static void gl_video_interpolate_frame(struct gl_video *p, struct vo_frame *t,
                t->ideal_frame_duration, t->vsync_interval, mix);
         p->is_interpolated = true;
     }
+
+    if (p->surfaces_native) {
+        gl_timer_start(p->render_timer);
+        pass_render_frame_scaled(p);
+        gl_timer_stop(p->render_timer);
+    }
+
     pass_draw_to_screen(p, fbo);
 
     p->frames_drawn += 1;
@@ -2617,6 +3139,32 @@ static void timer_dbg(struct gl_video *p, const char *name, struct gl_timer *t)
     }
 }
 
+// With shader-async-compile, some passes were skipped because their programs
+// are still compiling. Draw the frame again with the dumb mode pipeline, whose
+// few simple shaders are compiled synchronously.
+static void render_fallback_frame(struct gl_video *p, int fbo)
+{
+    if (!p->image.mpi)
+        return;
+
+    MP_DBG(p, "Shaders still compiling, rendering a fallback frame.\n");
+
+    bool dumb_mode = p->dumb_mode;
+    p->dumb_mode = true;
+    gl_sc_set_async_compile(p->sc, false);
+
+    pass_render_frame(p);
+    pass_draw_to_screen(p, fbo);
+
+    gl_sc_set_async_compile(p->sc, p->opts.shader_async_compile);
+    p->dumb_mode = dumb_mode;
+
+    // The cached output and interpolation surfaces can contain incomplete
+    // results.
+    p->output_fbo_valid = false;
+    gl_video_reset_surfaces(p);
+}
+
 // (fbo==0 makes BindFramebuffer select the screen backbuffer)
 void gl_video_render_frame(struct gl_video *p, struct vo_frame *frame, int fbo)
 {
@@ -2629,6 +3177,8 @@ void gl_video_render_frame(struct gl_video *p, struct vo_frame *frame, int fbo)
     }
 
     p->broken_frame = false;
+    p->pass_idx = 0;
+    bool skipped = false;
 
     gl->BindFramebuffer(GL_FRAMEBUFFER, fbo);
 
@@ -2665,10 +3215,14 @@ void gl_video_render_frame(struct gl_video *p, struct vo_frame *frame, int fbo)
                 pass_render_frame(p);
 
                 // For the non-interpolation case, we draw to a single "cache"
-                // FBO to speed up subsequent re-draws (if any exist)
+                // FBO to speed up subsequent re-draws (if any exist). This
+                // includes redraws while paused, which usually happen only to
+                // update the OSD (unless subs are part of the video).
                 int dest_fbo = fbo;
-                if (frame->num_vsyncs > 1 && frame->display_synced &&
-                    !p->dumb_mode && gl->BlitFramebuffer)
+                bool repeats = frame->num_vsyncs > 1 && frame->display_synced;
+                bool redraws = (frame->still || frame->redraw) &&
+                               !p->opts.blend_subs;
+                if ((repeats || redraws) && !p->dumb_mode && gl->BlitFramebuffer)
                 {
                     fbotex_change(&p->output_fbo, p->gl, p->log,
                                   p->vp_w, abs(p->vp_h),
@@ -2697,6 +3251,10 @@ void gl_video_render_frame(struct gl_video *p, struct vo_frame *frame, int fbo)
         }
     }
 
+    skipped = gl_sc_take_skipped(p->sc);
+    if (skipped)
+        render_fallback_frame(p, fbo);
+
 done:
 
     unmap_current_image(p);
@@ -2728,6 +3286,16 @@ done:
 
     p->frames_rendered++;
 
+    // Nothing tells us when pending shaders are ready; keep redrawing until
+    // they are.
+    skipped |= gl_sc_take_skipped(p->sc);
+    if (skipped && p->redraw_cb)
+        p->redraw_cb(p->redraw_cb_ctx);
+
+    // Redraws from the output FBO run no passes; keep the previous results.
+    if (p->pass_idx)
+        p->last_num_passes = p->pass_idx;
+
     // Report performance metrics
     timer_dbg(p, "upload", p->upload_timer);
     timer_dbg(p, "render", p->render_timer);
@@ -2771,6 +3339,18 @@ struct voctrl_performance_data gl_video_perfdata(struct gl_video *p)
     };
 }
 
+void gl_video_pass_perfdata(struct gl_video *p,
+                            struct voctrl_pass_performance *out)
+{
+    out->num_passes = p->last_num_passes;
+    for (int n = 0; n < p->last_num_passes; n++) {
+        struct pass_info *pass = &p->pass_info[n];
+        snprintf(out->passes[n].desc, sizeof(out->passes[n].desc), "%s",
+                 pass->desc);
+        out->passes[n].perf = gl_video_perfentry(pass->timer);
+    }
+}
+
 // This assumes nv12, with textures set to GL_NEAREST filtering.
 static void reinterleave_vdpau(struct gl_video *p, struct gl_hwdec_frame *frame)
 {
@@ -2800,6 +3380,7 @@ static void reinterleave_vdpau(struct gl_video *p, struct gl_hwdec_frame *frame)
         GLSLF("      : texture(texture%d, texcoord%d);", ids[1], ids[1]);
 
         fbotex_change(fbo, p->gl, p->log, w, h * 2, n == 0 ? GL_R8 : GL_RG8, 0);
+        pass_describe(p, "vdpau deinterleaving");
 
         finish_pass_direct(p, fbo->fbo, fbo->rw, fbo->rh,
                            &(struct mp_rect){0, 0, w, h * 2});
@@ -2814,10 +3395,107 @@ static void reinterleave_vdpau(struct gl_video *p, struct gl_hwdec_frame *frame)
     *frame = res;
 }
 
+// Return the DR buffer mpi's data is in, or NULL if it's a normal image.
+static struct dr_buffer *find_dr_buffer(struct gl_video *p,
+                                        struct mp_image *mpi)
+{
+    if (!mpi->bufs[0])
+        return NULL;
+    for (int n = 0; n < p->num_dr_buffers; n++) {
+        struct dr_buffer *dr = &p->dr_buffers[n];
+        if (mpi->bufs[0]->data == dr->buf->data)
+            return dr;
+    }
+    return NULL;
+}
+
+static void destroy_dr_buffer(struct gl_video *p, int index)
+{
+    // Remove it first, as dr_buffer_unref() may look at it at any time.
+    pthread_mutex_lock(&p->dr_lock);
+    struct ra_buf *buf = p->dr_buffers[index].buf;
+    MP_TARRAY_REMOVE_AT(p->dr_buffers, p->num_dr_buffers, index);
+    pthread_mutex_unlock(&p->dr_lock);
+
+    ra_buf_free(p->ra, &buf);
+}
+
+// Called when the last reference to a DR image is dropped (any thread).
+static void dr_buffer_unref(void *opaque, uint8_t *data)
+{
+    struct gl_video *p = opaque;
+
+    pthread_mutex_lock(&p->dr_lock);
+    for (int n = 0; n < p->num_dr_buffers; n++) {
+        if (p->dr_buffers[n].buf->data == data) {
+            assert(p->dr_buffers[n].in_use);
+            p->dr_buffers[n].in_use = false;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&p->dr_lock);
+}
+
+// Allocate an image backed by a persistently mapped GPU buffer. The decoder
+// writes directly into it, so gl_video_upload_image() needs no copy.
+// Returns NULL if this is unsupported or failed.
+struct mp_image *gl_video_get_image(struct gl_video *p, int imgfmt, int w,
+                                    int h, int stride_align)
+{
+    if (!(p->ra->caps & RA_CAP_BUF_HOST_MAPPED) ||
+        !gl_video_check_format(p, imgfmt))
+        return NULL;
+
+    int size = mp_image_get_alloc_size(imgfmt, w, h, stride_align);
+    if (size < 0)
+        return NULL;
+
+    // Reuse an unused buffer of the same size, and free the others, which
+    // are most likely left over from a previous video format.
+    struct dr_buffer *dr = NULL;
+    pthread_mutex_lock(&p->dr_lock);
+    for (int n = p->num_dr_buffers - 1; n >= 0; n--) {
+        struct dr_buffer *cur = &p->dr_buffers[n];
+        if (cur->in_use)
+            continue;
+        if (cur->buf->params.size == size) {
+            dr = cur;
+            break;
+        }
+        pthread_mutex_unlock(&p->dr_lock);
+        destroy_dr_buffer(p, n);
+        pthread_mutex_lock(&p->dr_lock);
+    }
+    if (dr)
+        dr->in_use = true;
+    pthread_mutex_unlock(&p->dr_lock);
+
+    if (dr) {
+        // Don't let the decoder overwrite data the GPU still reads.
+        p->ra->fns->buf_poll(p->ra, dr->buf, 1000000000); // 1 second
+    } else {
+        struct ra_buf_params params = {
+            .size = size,
+            .host_mapped = true,
+        };
+        struct dr_buffer new = {.in_use = true};
+        new.buf = p->ra->fns->buf_create(p->ra, &params);
+        if (!new.buf)
+            return NULL;
+
+        pthread_mutex_lock(&p->dr_lock);
+        MP_TARRAY_APPEND(p, p->dr_buffers, p->num_dr_buffers, new);
+        dr = &p->dr_buffers[p->num_dr_buffers - 1];
+        pthread_mutex_unlock(&p->dr_lock);
+    }
+
+    return mp_image_from_buffer(imgfmt, w, h, stride_align, dr->buf->data,
+                                dr->buf->params.size, p, dr_buffer_unref);
+}
+
 // Returns false on failure.
 static bool gl_video_upload_image(struct gl_video *p, struct mp_image *mpi)
 {
-    GL *gl = p->gl;
     struct video_image *vimg = &p->image;
 
     unref_current_image(p);
@@ -2867,18 +3545,28 @@ static bool gl_video_upload_image(struct gl_video *p, struct mp_image *mpi)
 
     gl_timer_start(p->upload_timer);
 
+    struct dr_buffer *dr = find_dr_buffer(p, mpi);
+    ra_gl_set_pbo(p->ra, p->opts.pbo);
 
     for (int n = 0; n < p->plane_count; n++) {
         struct texplane *plane = &vimg->planes[n];
+        if (!plane->tex)
+            goto error;
 
         plane->flipped = mpi->stride[0] < 0;
 
-        gl->BindTexture(plane->gl_target, plane->gl_texture);
-        gl_pbo_upload_tex(&plane->pbo, gl, p->opts.pbo, plane->gl_target,
-                          plane->gl_format, plane->gl_type, plane->w, plane->h,
-                          mpi->planes[n], mpi->stride[n],
-                          0, 0, plane->w, plane->h);
-        gl->BindTexture(plane->gl_target, 0);
+        struct ra_tex_upload_params params = {
+            .tex = plane->tex,
+            .stride = mpi->stride[n],
+        };
+        if (dr) {
+            // The data is already in a GPU buffer; upload from it directly.
+            params.buf = dr->buf;
+            params.buf_offset = mpi->planes[n] - (uint8_t *)dr->buf->data;
+        } else {
+            params.src = mpi->planes[n];
+        }
+        p->ra->fns->tex_upload(p->ra, &params);
     }
 
     gl_timer_stop(p->upload_timer);
@@ -2960,6 +3648,32 @@ static void check_gl_features(struct gl_video *p)
             break;
         }
     }
+    p->fbo_format = p->opts.fbo_format;
+
+    p->fbo_format_8 = p->fbo_format_10 = 0;
+    if (p->opts.fbo_format_adaptive && have_fbo) {
+        if (test_fbo(p, GL_RGB10_A2))
+            p->fbo_format_10 = GL_RGB10_A2;
+        if (test_fbo(p, GL_RGBA8))
+            p->fbo_format_8 = GL_RGBA8;
+    }
+
+    p->use_gather = gl->mpgl_caps & MPGL_CAP_GATHER;
+    if (p->use_gather)
+        MP_VERBOSE(p, "Using textureGather() for polar scalers.\n");
+
+    p->max_compute_shmem = 0;
+    if (gl->mpgl_caps & MPGL_CAP_COMPUTE_SHADER)
+        gl->GetIntegerv(GL_MAX_COMPUTE_SHARED_MEMORY_SIZE, &p->max_compute_shmem);
+
+    // The fragment shaders need the extension to access the result.
+    p->use_peak_detect = false;
+    if (p->opts.hdr_compute_peak) {
+        int caps = MPGL_CAP_COMPUTE_SHADER | MPGL_CAP_SSBO;
+        p->use_peak_detect = (gl->mpgl_caps & caps) == caps;
+        if (!p->use_peak_detect)
+            MP_WARN(p, "Disabling HDR peak detection (no compute shaders or SSBOs).\n");
+    }
 
     if (!gl->MapBufferRange && p->opts.pbo) {
         p->opts.pbo = 0;
@@ -2977,6 +3691,7 @@ static void check_gl_features(struct gl_video *p)
         }
         p->dumb_mode = true;
         p->use_lut_3d = false;
+        p->use_peak_detect = false;
         // Most things don't work, so whitelist all options that still work.
         struct gl_video_opts new_opts = {
             .gamma = p->opts.gamma,
@@ -3130,8 +3845,17 @@ void gl_video_uninit(struct gl_video *p)
 
     uninit_video(p);
 
+    // All images must have been freed by now.
+    for (int n = 0; n < p->num_dr_buffers; n++)
+        assert(!p->dr_buffers[n].in_use);
+    while (p->num_dr_buffers)
+        destroy_dr_buffer(p, 0);
+    pthread_mutex_destroy(&p->dr_lock);
+
     gl_sc_destroy(p->sc);
 
+    ra_free(&p->ra);
+
     gl_vao_uninit(&p->vao);
 
     gl->DeleteTextures(1, &p->lut_3d_texture);
@@ -3139,6 +3863,8 @@ void gl_video_uninit(struct gl_video *p)
     gl_timer_free(p->upload_timer);
     gl_timer_free(p->render_timer);
     gl_timer_free(p->present_timer);
+    for (int n = 0; n < VO_PASS_PERF_MAX; n++)
+        gl_timer_free(p->pass_info[n].timer);
 
     mpgl_osd_destroy(p->osd);
 
@@ -3305,6 +4031,7 @@ supported:
             plane->gl_format = format->format;
             plane->gl_internal_format = format->internal_format;
             plane->gl_type = format->type;
+            plane->format = ra_gl_get_format(p->ra, format);
             plane->use_integer = use_integer;
             snprintf(plane->swizzle, sizeof(plane->swizzle), "rgba");
             if (packed_format)
@@ -3364,15 +4091,18 @@ struct gl_video *gl_video_init(GL *gl, struct mp_log *log, struct mpv_global *g)
     struct gl_video *p = talloc_ptrtype(NULL, p);
     *p = (struct gl_video) {
         .gl = gl,
+        .ra = ra_create_gl(gl, log),
         .global = g,
         .log = log,
         .cms = gl_lcms_init(p, log, g),
         .texture_16bit_depth = 16,
+        .num_surfaces = FBOSURFACES_MAX,
         .sc = gl_sc_create(gl, log),
     };
     set_options(p, NULL);
     for (int n = 0; n < SCALER_COUNT; n++)
         p->scaler[n] = (struct scaler){.index = n};
+    pthread_mutex_init(&p->dr_lock, NULL);
     gl_video_set_debug(p, true);
     init_gl(p);
     return p;
@@ -3404,12 +4134,93 @@ static void set_options(struct gl_video *p, struct gl_video_opts *src)
     p->opts = *p->opts_alloc;
 }
 
+// Parts of the renderer that need to be updated after an option change.
+enum {
+    OPTS_CHANGED_HOOKS  = 1 << 0,   // gl_video_setup_hooks()
+    OPTS_CHANGED_ICC    = 1 << 1,   // ICC profile handling
+    OPTS_CHANGED_ALL    = 1 << 2,   // reinit_from_options()
+};
+
+static bool str_eq(const char *a, const char *b)
+{
+    return bstr_equals(bstr0(a), bstr0(b));
+}
+
+static bool strlist_eq(char **a, char **b)
+{
+    for (int n = 0; ; n++) {
+        if (!(a && a[n]) || !(b && b[n]))
+            return !(a && a[n]) && !(b && b[n]);
+        if (strcmp(a[n], b[n]) != 0)
+            return false;
+    }
+}
+
+// Options not checked here only affect the generated shaders or their
+// uniforms (scalers reinit themselves in reinit_scaler() if needed), and are
+// picked up with the next frame.
+static int get_opts_changes(struct gl_video_opts *a, struct gl_video_opts *b)
+{
+    int changes = 0;
+
+    if (a->dumb_mode != b->dumb_mode ||
+        a->scaler_lut_size != b->scaler_lut_size ||
+        a->hdr_compute_peak != b->hdr_compute_peak ||
+        a->pbo != b->pbo ||
+        a->dither_depth != b->dither_depth ||
+        a->dither_algo != b->dither_algo ||
+        a->dither_size != b->dither_size ||
+        a->fbo_format != b->fbo_format ||
+        a->fbo_format_adaptive != b->fbo_format_adaptive ||
+        a->use_rectangle != b->use_rectangle ||
+        a->interpolation != b->interpolation ||
+        a->interpolation_compact != b->interpolation_compact ||
+        a->compute_scalers != b->compute_scalers ||
+        a->shader_async_compile != b->shader_async_compile ||
+        !str_eq(a->shader_cache_dir, b->shader_cache_dir))
+        changes |= OPTS_CHANGED_ALL;
+
+    if (a->deband != b->deband ||
+        (a->unsharp != 0.0) != (b->unsharp != 0.0) ||
+        !strlist_eq(a->user_shaders, b->user_shaders))
+        changes |= OPTS_CHANGED_HOOKS;
+
+    struct mp_icc_opts *ia = a->icc_opts, *ib = b->icc_opts;
+    if (!ia || !ib || !str_eq(ia->profile, ib->profile) ||
+        ia->profile_auto != ib->profile_auto ||
+        !str_eq(ia->cache_dir, ib->cache_dir) ||
+        !str_eq(ia->size_str, ib->size_str) ||
+        ia->intent != ib->intent || ia->contrast != ib->contrast)
+        changes |= OPTS_CHANGED_ICC;
+
+    return changes;
+}
+
 // Set the options, and possibly update the filter chain too.
 // Note: assumes all options are valid and verified by the option parser.
 void gl_video_set_options(struct gl_video *p, struct gl_video_opts *opts)
 {
+    int changes = OPTS_CHANGED_ALL;
+    if (p->opts_alloc && opts)
+        changes = get_opts_changes(p->opts_alloc, opts);
+
     set_options(p, opts);
-    reinit_from_options(p);
+
+    if (changes & OPTS_CHANGED_ALL) {
+        reinit_from_options(p);
+        return;
+    }
+
+    // Cheap path: keep FBOs, scaler LUTs and the dither texture.
+    if (changes & OPTS_CHANGED_ICC) {
+        gl_lcms_set_options(p->cms, p->opts.icc_opts);
+        p->use_lut_3d = gl_lcms_has_profile(p->cms);
+    }
+    check_gl_features(p);
+    if (changes & OPTS_CHANGED_HOOKS)
+        gl_video_setup_hooks(p);
+    // The cached output FBO was rendered with the old values.
+    p->output_fbo_valid = false;
 }
 
 static void reinit_from_options(struct gl_video *p)
@@ -3419,6 +4230,9 @@ static void reinit_from_options(struct gl_video *p)
     gl_lcms_set_options(p->cms, p->opts.icc_opts);
     p->use_lut_3d = gl_lcms_has_profile(p->cms);
 
+    gl_sc_set_cache_dir(p->sc, p->global, p->opts.shader_cache_dir);
+    gl_sc_set_async_compile(p->sc, p->opts.shader_async_compile);
+
     check_gl_features(p);
     uninit_rendering(p);
     gl_video_setup_hooks(p);
@@ -3461,6 +4275,8 @@ struct mp_csp_equalizer *gl_video_eq_ptr(struct gl_video *p)
 // Call when the mp_csp_equalizer returned by gl_video_eq_ptr() was changed.
 void gl_video_eq_update(struct gl_video *p)
 {
+    // The cached output FBO was rendered with the old values.
+    p->output_fbo_valid = false;
 }
 
 static int validate_scaler_opt(struct mp_log *log, const m_option_t *opt,
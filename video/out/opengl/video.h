@@ -57,7 +57,7 @@ struct scaler {
     struct filter_kernel *kernel;
     GLuint gl_lut;
     GLenum gl_target;
-    struct fbotex sep_fbo;
+    struct fbotex compute_fbo;
     bool insufficient;
     int lut_size;
 
@@ -111,6 +111,7 @@ struct gl_video_opts {
     int target_brightness;
     int hdr_tone_mapping;
     float tone_mapping_param;
+    int hdr_compute_peak;
     int linear_scaling;
     int correct_downscaling;
     int sigmoid_upscaling;
@@ -124,13 +125,18 @@ struct gl_video_opts {
     int temporal_dither;
     int temporal_dither_period;
     int fbo_format;
+    int fbo_format_adaptive;
     int alpha_mode;
     int use_rectangle;
     struct m_color background;
     int interpolation;
     float interpolation_threshold;
+    int interpolation_compact;
     int blend_subs;
     char **user_shaders;
+    char *shader_cache_dir;
+    int shader_async_compile;
+    int compute_scalers;
     int deband;
     struct deband_opts *deband_opts;
     float unsharp;
@@ -156,6 +162,9 @@ void gl_video_resize(struct gl_video *p, int vp_w, int vp_h,
                      struct mp_rect *src, struct mp_rect *dst,
                      struct mp_osd_res *osd);
 struct voctrl_performance_data gl_video_perfdata(struct gl_video *p);
+struct voctrl_pass_performance;
+void gl_video_pass_perfdata(struct gl_video *p,
+                            struct voctrl_pass_performance *out);
 struct mp_csp_equalizer;
 struct mp_csp_equalizer *gl_video_eq_ptr(struct gl_video *p);
 void gl_video_eq_update(struct gl_video *p);
@@ -166,6 +175,8 @@ float gl_video_scale_ambient_lux(float lmin, float lmax,
                                  float rmin, float rmax, float lux);
 void gl_video_set_ambient_lux(struct gl_video *p, int lux);
 void gl_video_set_icc_profile(struct gl_video *p, bstr icc_data);
+void gl_video_set_redraw_cb(struct gl_video *p, void (*cb)(void *ctx),
+                            void *ctx);
 bool gl_video_icc_auto_enabled(struct gl_video *p);
 
 void gl_video_set_gl_state(struct gl_video *p);
@@ -179,4 +190,7 @@ void gl_video_set_hwdec(struct gl_video *p, struct gl_hwdec *hwdec);
 struct vo;
 void gl_video_configure_queue(struct gl_video *p, struct vo *vo);
 
+struct mp_image *gl_video_get_image(struct gl_video *p, int imgfmt, int w,
+                                    int h, int stride_align);
+
 #endif
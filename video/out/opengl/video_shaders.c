@@ -106,15 +106,15 @@ void pass_sample_separated_gen(struct gl_shader_cache *sc, struct scaler *scaler
     GLSLF("}\n");
 }
 
-void pass_sample_polar(struct gl_shader_cache *sc, struct scaler *scaler)
+// Accumulate the polar scaler taps around fcoord into color. If in_w is 0, the
+// texels are sampled from tex relative to "base", otherwise they are read from
+// the shared memory array in_tex (with row length in_w) relative to "idx".
+static void polar_sample_taps(struct gl_shader_cache *sc, struct scaler *scaler,
+                              int in_w)
 {
     double radius = scaler->kernel->f.radius;
     int bound = (int)ceil(radius);
     bool use_ar = scaler->conf.antiring > 0;
-    GLSL(color = vec4(0.0);)
-    GLSLF("{\n");
-    GLSL(vec2 fcoord = fract(pos * size - vec2(0.5));)
-    GLSL(vec2 base = pos - fcoord * pt;)
     GLSL(vec4 c;)
     GLSLF("float w, d, wsum = 0.0;\n");
     if (use_ar) {
@@ -146,7 +146,11 @@ void pass_sample_polar(struct gl_shader_cache *sc, struct scaler *scaler)
                       scaler->lut_size);
             }
             GLSL(wsum += w;)
-            GLSLF("c = texture(tex, base + pt * vec2(%d.0, %d.0));\n", x, y);
+            if (in_w) {
+                GLSLF("c = in_tex[idx + %d];\n", y * in_w + x);
+            } else {
+                GLSLF("c = texture(tex, base + pt * vec2(%d.0, %d.0));\n", x, y);
+            }
             GLSL(color += vec4(w) * c;)
             if (use_ar && x >= 0 && y >= 0 && x <= 1 && y <= 1) {
                 GLSL(lo = min(lo, c);)
@@ -160,6 +164,154 @@ void pass_sample_polar(struct gl_shader_cache *sc, struct scaler *scaler)
     if (use_ar)
         GLSLF("color = mix(color, clamp(color, lo, hi), %f);\n",
               scaler->conf.antiring);
+}
+
+// Like polar_sample_taps(), but fetch 2x2 texel blocks with textureGather(),
+// one component at a time. This needs fewer fetches if there are less than
+// 4 components. Doesn't support anti-ringing.
+static void polar_sample_gather(struct gl_shader_cache *sc,
+                                struct scaler *scaler, int components)
+{
+    double radius = scaler->kernel->f.radius;
+    int bound = (int)ceil(radius);
+    GLSL(vec4 d;)
+    GLSL(vec4 w;)
+    GLSLF("float wsum = 0.0;\n");
+    gl_sc_uniform_sampler(sc, "lut", scaler->gl_target,
+                          TEXUNIT_SCALERS + scaler->index);
+    GLSLF("// scaler samples\n");
+    // 2*bound taps in each direction, so the blocks cover them exactly.
+    for (int y = 1-bound; y <= bound; y += 2) {
+        for (int x = 1-bound; x <= bound; x += 2) {
+            // Texel offsets in textureGather() component order
+            int ox[4] = {x, x + 1, x + 1, x};
+            int oy[4] = {y + 1, y + 1, y, y};
+            double dmax[4];
+            bool any = false;
+            for (int n = 0; n < 4; n++) {
+                // Worst case, as in polar_sample_taps()
+                int xx = ox[n] > 0 ? ox[n] - 1 : ox[n];
+                int yy = oy[n] > 0 ? oy[n] - 1 : oy[n];
+                dmax[n] = sqrt(xx*xx + yy*yy);
+                any |= dmax[n] < radius;
+            }
+            if (!any)
+                continue;
+            GLSLF("d = vec4(");
+            for (int n = 0; n < 4; n++) {
+                GLSLF("%slength(vec2(%d.0, %d.0) - fcoord)", n ? ", " : "",
+                      ox[n], oy[n]);
+            }
+            GLSLF(") / %f;\n", radius);
+            for (int n = 0; n < 4; n++) {
+                char c = "xyzw"[n];
+                if (dmax[n] >= radius) {
+                    GLSLF("w.%c = 0.0;\n", c);
+                    continue;
+                }
+                GLSLF("w.%c = ", c);
+                if (dmax[n] >= radius - M_SQRT2)
+                    GLSLF("d.%c >= 1.0 ? 0.0 : ", c);
+                if (scaler->gl_target == GL_TEXTURE_1D) {
+                    GLSLF("texture1D(lut, LUT_POS(d.%c, %d.0)).r;\n",
+                          c, scaler->lut_size);
+                } else {
+                    GLSLF("texture(lut, vec2(0.5, LUT_POS(d.%c, %d.0))).r;\n",
+                          c, scaler->lut_size);
+                }
+            }
+            GLSL(wsum += dot(w, vec4(1.0));)
+            for (int n = 0; n < components; n++) {
+                GLSLF("color.%c += dot(w, textureGather(tex, "
+                      "base + pt * vec2(%f, %f), %d));\n",
+                      "rgba"[n], x + 0.5, y + 0.5, n);
+            }
+        }
+    }
+    GLSL(color = color / vec4(wsum);)
+}
+
+// components: number of components of the sampled texture
+// use_gather: whether textureGather() can be used on this texture (see
+//             MPGL_CAP_GATHER); it's only used where it needs fewer fetches
+void pass_sample_polar(struct gl_shader_cache *sc, struct scaler *scaler,
+                       int components, bool use_gather)
+{
+    use_gather &= components < 4 && !(scaler->conf.antiring > 0);
+    if (use_gather)
+        gl_sc_paddf(sc, "#extension GL_ARB_gpu_shader5 : enable\n");
+    GLSL(color = vec4(0.0);)
+    GLSLF("{\n");
+    GLSL(vec2 fcoord = fract(pos * size - vec2(0.5));)
+    GLSL(vec2 base = pos - fcoord * pt;)
+    if (use_gather) {
+        polar_sample_gather(sc, scaler, components);
+    } else {
+        polar_sample_taps(sc, scaler, 0);
+    }
+    GLSLF("}\n");
+}
+
+// Size of the texel neighbourhood (in_w * in_h) needed by a work group of
+// bw * bh outputs for pass_compute_polar(). ratio_x/ratio_y are the source
+// texels per output pixel.
+void pass_compute_polar_size(struct scaler *scaler, int bw, int bh,
+                             float ratio_x, float ratio_y,
+                             int *in_w, int *in_h)
+{
+    int bound = (int)ceil(scaler->kernel->f.radius);
+    // +1 for the rounding of the base texel of the first/last output
+    *in_w = (int)ceil((bw - 1) * fabs(ratio_x)) + 1 + 2 * bound;
+    *in_h = (int)ceil((bh - 1) * fabs(ratio_y)) + 1 + 2 * bound;
+}
+
+// Compute shader version of pass_sample_polar(), sampling from texture unit
+// tex_num. Each work group first loads the texels needed by all its outputs
+// into shared memory, so neighbouring outputs don't fetch them again. The
+// position of the output pixel (x, y) in the source texture is given by the
+// uniforms as out_pos0 + vec2(x, y) * out_dpos. Sets "color" like the other
+// sampling functions, but the caller has to store it.
+void pass_compute_polar(struct gl_shader_cache *sc, struct scaler *scaler,
+                        int tex_num, int bw, int bh, int in_w, int in_h)
+{
+    int bound = (int)ceil(scaler->kernel->f.radius);
+
+    GLSLHF("shared vec4 in_tex[%d];\n", in_w * in_h);
+    gl_sc_uniform_sampler(sc, "lut", scaler->gl_target,
+                          TEXUNIT_SCALERS + scaler->index);
+
+    GLSL(color = vec4(0.0);)
+    GLSLF("{\n");
+    GLSLF("#undef tex\n");
+    GLSLF("#define tex texture%d\n", tex_num);
+    GLSLF("vec2 size = texture_size%d;\n", tex_num);
+    GLSLF("vec2 pt = pixel_size%d;\n", tex_num);
+
+    // Texel index of the top-left tap needed by the work group.
+    GLSL(vec2 wpos0 = out_pos0 + vec2(gl_WorkGroupID.xy * gl_WorkGroupSize.xy)
+                                 * out_dpos;)
+    GLSL(vec2 wpos1 = wpos0 + vec2(gl_WorkGroupSize.xy - uvec2(1)) * out_dpos;)
+    GLSLF("ivec2 wbase = ivec2(min(floor(wpos0 * size - vec2(0.5)),"
+                                  " floor(wpos1 * size - vec2(0.5))))"
+          " - ivec2(%d);\n", bound - 1);
+
+    // Load the neighbourhood cooperatively.
+    GLSLF("for (int y = int(gl_LocalInvocationID.y); y < %d; y += %d) {\n",
+          in_h, bh);
+    GLSLF("for (int x = int(gl_LocalInvocationID.x); x < %d; x += %d) {\n",
+          in_w, bw);
+    GLSLF("in_tex[y * %d + x] = "
+          "texture(tex, (vec2(wbase + ivec2(x, y)) + vec2(0.5)) * pt);\n", in_w);
+    GLSLF("}\n");
+    GLSLF("}\n");
+    GLSL(memoryBarrierShared();)
+    GLSL(barrier();)
+
+    GLSL(vec2 pos = out_pos0 + vec2(gl_GlobalInvocationID.xy) * out_dpos;)
+    GLSL(vec2 fcoord = fract(pos * size - vec2(0.5));)
+    GLSL(ivec2 rel = ivec2(floor(pos * size - vec2(0.5))) - wbase;)
+    GLSLF("int idx = rel.y * %d + rel.x;\n", in_w);
+    polar_sample_taps(sc, scaler, in_w);
     GLSLF("}\n");
 }
 
@@ -368,11 +520,102 @@ void pass_delinearize(struct gl_shader_cache *sc, enum mp_csp_trc trc)
     }
 }
 
-// Tone map from a known peak brightness to the range [0,1]
+// Fixed point scale of the luminance values accumulated by pass_compute_peak(),
+// and the maximum value (relative to the target peak) that is accumulated.
+#define PEAK_SCALE 100.0
+#define PEAK_MAX 100.0
+
+// Number of frames over which the detected peak is smoothed.
+#define PEAK_FRAMES 64
+
+// Declare the buffer holding the state of the peak detection. It's always
+// bound to shader storage buffer binding 0. qual is the memory qualifier.
+static void peak_detect_decl(struct gl_shader_cache *sc, const char *qual)
+{
+    gl_sc_paddf(sc, "#extension GL_ARB_shader_storage_buffer_object : enable\n");
+    GLSLHF("layout(std430) %s buffer PeakDetect {\n", qual);
+    GLSLH(uint hdr_frame_max;)   // maximum of the current frame
+    GLSLH(uint hdr_frame_sum;)   // sum of work group averages
+    GLSLH(uint hdr_wg_done;)     // work groups which finished
+    GLSLH(float hdr_peak;)       // smoothed peak (0 if none yet)
+    GLSLH(float hdr_avg;)        // smoothed average
+    GLSLHF("};\n");
+}
+
+// Measure the peak and average brightness of texture tex_num (w*h pixels), as
+// compute shader with bw*bh work groups, num_wg of them in total. The result
+// is smoothed over time and stays in the peak detection buffer, from where
+// pass_color_map() can use it without reading it back to the CPU. trc is the
+// transfer function of the texture, and scale the factor that normalizes the
+// linear light values to the target peak.
+void pass_compute_peak(struct gl_shader_cache *sc, int tex_num, int w, int h,
+                       int bw, int bh, int num_wg, enum mp_csp_trc trc,
+                       float scale)
+{
+    GLSLF("// HDR peak detection\n");
+    peak_detect_decl(sc, "coherent");
+    GLSLH(shared uint wg_max;)
+    GLSLH(shared uint wg_sum;)
+
+    GLSL(if (gl_LocalInvocationIndex == 0u) { wg_max = 0u; wg_sum = 0u; })
+    GLSL(memoryBarrierShared();)
+    GLSL(barrier();)
+
+    GLSL(ivec2 pos = ivec2(gl_GlobalInvocationID.xy);)
+    GLSLF("if (pos.x < %d && pos.y < %d) {\n", w, h);
+    GLSLF("color = texelFetch(texture%d, pos, 0);\n", tex_num);
+    pass_linearize(sc, trc);
+    GLSLF("float sig = max(max(color.r, color.g), color.b) * %f;\n", scale);
+    GLSLF("uint isig = uint(clamp(sig, 0.0, %f) * %f);\n", PEAK_MAX, PEAK_SCALE);
+    GLSL(atomicMax(wg_max, isig);)
+    GLSL(atomicAdd(wg_sum, isig);)
+    GLSLF("}\n");
+    GLSL(memoryBarrierShared();)
+    GLSL(barrier();)
+
+    // Accumulate the averages instead of the sums, to avoid overflows.
+    GLSLF("if (gl_LocalInvocationIndex == 0u) {\n");
+    GLSL(atomicMax(hdr_frame_max, wg_max);)
+    GLSLF("atomicAdd(hdr_frame_sum, wg_sum / %du);\n", bw * bh);
+    GLSL(memoryBarrierBuffer();)
+
+    // The last work group to finish computes the result for this frame.
+    GLSLF("if (atomicAdd(hdr_wg_done, 1u) == %du) {\n", num_wg - 1);
+    GLSLF("float cur_peak = float(atomicExchange(hdr_frame_max, 0u)) * %f;\n",
+          1.0 / PEAK_SCALE);
+    GLSLF("float cur_avg = float(atomicExchange(hdr_frame_sum, 0u)) * %f;\n",
+          bw * bh / (PEAK_SCALE * w * h));
+    GLSL(hdr_wg_done = 0u;)
+    // Jump to the new values on the first frame and on scene changes (the
+    // average brightness changes by more than factor 2), to avoid visibly
+    // adapting to the new scene.
+    GLSL(if (hdr_peak <= 0.0 ||
+             abs(log2(max(cur_avg, 1e-4) / max(hdr_avg, 1e-4))) > 1.0) {)
+    GLSL(hdr_peak = cur_peak;)
+    GLSL(hdr_avg = cur_avg;)
+    GLSL(} else {)
+    GLSLF("hdr_peak = mix(hdr_peak, cur_peak, %f);\n", 1.0 / PEAK_FRAMES);
+    GLSLF("hdr_avg = mix(hdr_avg, cur_avg, %f);\n", 1.0 / PEAK_FRAMES);
+    GLSL(})
+    GLSLF("}\n");
+    GLSLF("}\n");
+}
+
+// Tone map from a known peak brightness to the range [0,1]. If detect_peak is
+// set, the peak measured by pass_compute_peak() is used instead of ref_peak
+// (but limited to it).
 static void pass_tone_map(struct gl_shader_cache *sc, float ref_peak,
-                          enum tone_mapping algo, float param)
+                          bool detect_peak, enum tone_mapping algo, float param)
 {
     GLSLF("// HDR tone mapping\n");
+    GLSLF("{\n");
+
+    if (detect_peak) {
+        peak_detect_decl(sc, "readonly");
+        GLSLF("float sig_peak = clamp(hdr_peak, 1.0, %f);\n", ref_peak);
+    } else {
+        GLSLF("float sig_peak = %f;\n", ref_peak);
+    }
 
     switch (algo) {
     case TONE_MAPPING_CLIP:
@@ -383,7 +626,7 @@ static void pass_tone_map(struct gl_shader_cache *sc, float ref_peak,
         float contrast = isnan(param) ? 0.5 : param,
               offset = (1.0 - contrast) / contrast;
         GLSLF("color.rgb = color.rgb / (color.rgb + vec3(%f));\n", offset);
-        GLSLF("color.rgb *= vec3(%f);\n", (ref_peak + offset) / ref_peak);
+        GLSLF("color.rgb *= vec3((sig_peak + %f) / sig_peak);\n", offset);
         break;
     }
 
@@ -394,34 +637,38 @@ static void pass_tone_map(struct gl_shader_cache *sc, float ref_peak,
                A, C*B, D*E, A, B, D*F, E/F);
         GLSLHF("}\n");
 
-        GLSLF("color.rgb = hable(color.rgb) / hable(vec3(%f));\n", ref_peak);
+        GLSL(color.rgb = hable(color.rgb) / hable(vec3(sig_peak));)
         break;
     }
 
     case TONE_MAPPING_GAMMA: {
         float gamma = isnan(param) ? 1.8 : param;
-        GLSLF("color.rgb = pow(color.rgb / vec3(%f), vec3(%f));\n",
-              ref_peak, 1.0/gamma);
+        GLSLF("color.rgb = pow(color.rgb / vec3(sig_peak), vec3(%f));\n",
+              1.0/gamma);
         break;
     }
 
     case TONE_MAPPING_LINEAR: {
         float coeff = isnan(param) ? 1.0 : param;
-        GLSLF("color.rgb = vec3(%f) * color.rgb;\n", coeff / ref_peak);
+        GLSLF("color.rgb = vec3(%f / sig_peak) * color.rgb;\n", coeff);
         break;
     }
 
     default:
         abort();
     }
+
+    GLSLF("}\n");
 }
 
 // Map colors from one source space to another. These source spaces
 // must be known (i.e. not MP_CSP_*_AUTO), as this function won't perform
-// any auto-guessing.
+// any auto-guessing. If detect_peak is set, tone mapping uses the result of
+// pass_compute_peak() for the current frame.
 void pass_color_map(struct gl_shader_cache *sc,
                     struct mp_colorspace src, struct mp_colorspace dst,
-                    enum tone_mapping algo, float tone_mapping_param)
+                    enum tone_mapping algo, float tone_mapping_param,
+                    bool detect_peak)
 {
     GLSLF("// color mapping\n");
 
@@ -455,7 +702,8 @@ void pass_color_map(struct gl_shader_cache *sc,
     // Tone map to prevent clipping when the source signal peak exceeds the
     // encodable range.
     if (src.sig_peak > dst.nom_peak)
-        pass_tone_map(sc, src.sig_peak / dst.nom_peak, algo, tone_mapping_param);
+        pass_tone_map(sc, src.sig_peak / dst.nom_peak, detect_peak, algo,
+                      tone_mapping_param);
 
     // Adapt to the right colorspace if necessary
     if (src.primaries != dst.primaries) {
@@ -30,7 +30,13 @@ extern const struct m_sub_options deband_conf;
 void sampler_prelude(struct gl_shader_cache *sc, int tex_num);
 void pass_sample_separated_gen(struct gl_shader_cache *sc, struct scaler *scaler,
                                int d_x, int d_y);
-void pass_sample_polar(struct gl_shader_cache *sc, struct scaler *scaler);
+void pass_sample_polar(struct gl_shader_cache *sc, struct scaler *scaler,
+                       int components, bool use_gather);
+void pass_compute_polar_size(struct scaler *scaler, int bw, int bh,
+                             float ratio_x, float ratio_y,
+                             int *in_w, int *in_h);
+void pass_compute_polar(struct gl_shader_cache *sc, struct scaler *scaler,
+                        int tex_num, int bw, int bh, int in_w, int in_h);
 void pass_sample_bicubic_fast(struct gl_shader_cache *sc);
 void pass_sample_oversample(struct gl_shader_cache *sc, struct scaler *scaler,
                             int w, int h);
@@ -38,9 +44,13 @@ void pass_sample_oversample(struct gl_shader_cache *sc, struct scaler *scaler,
 void pass_linearize(struct gl_shader_cache *sc, enum mp_csp_trc trc);
 void pass_delinearize(struct gl_shader_cache *sc, enum mp_csp_trc trc);
 
+void pass_compute_peak(struct gl_shader_cache *sc, int tex_num, int w, int h,
+                       int bw, int bh, int num_wg, enum mp_csp_trc trc,
+                       float scale);
 void pass_color_map(struct gl_shader_cache *sc,
                     struct mp_colorspace src, struct mp_colorspace dst,
-                    enum tone_mapping algo, float tone_mapping_param);
+                    enum tone_mapping algo, float tone_mapping_param,
+                    bool detect_peak);
 
 void pass_sample_deband(struct gl_shader_cache *sc, struct deband_opts *opts,
                         AVLFG *lfg);
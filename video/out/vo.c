@@ -36,6 +36,7 @@
 #include "aspect.h"
 #include "input/input.h"
 #include "options/m_config.h"
+#include "common/benchmark.h"
 #include "common/msg.h"
 #include "common/global.h"
 #include "video/hwdec.h"
@@ -50,6 +51,7 @@ extern const struct vo_driver video_out_xv;
 extern const struct vo_driver video_out_opengl;
 extern const struct vo_driver video_out_opengl_hq;
 extern const struct vo_driver video_out_opengl_cb;
+extern const struct vo_driver video_out_sw_cb;
 extern const struct vo_driver video_out_null;
 extern const struct vo_driver video_out_image;
 extern const struct vo_driver video_out_lavc;
@@ -108,6 +110,7 @@ const struct vo_driver *const video_out_drivers[] =
     &video_out_opengl_hq,
     &video_out_opengl_cb,
 #endif
+    &video_out_sw_cb,
     NULL
 };
 
@@ -145,11 +148,16 @@ struct vo_internal {
     bool expecting_vsync;
     int64_t num_successive_vsyncs;
 
+    bool using_present_timing;      // last vsync sample used present timing
+    int64_t prev_present_count;     // voctrl_present_timing.vsync_count
+
     int64_t flip_queue_offset; // queue flip events at most this much in advance
 
     int64_t delayed_count;
     int64_t drop_count;
     bool dropped_frame;             // the previous frame was dropped
+    struct vo_frame_stats frame_stats;
+    int64_t last_render_time;       // render time of the last frame (us)
 
     struct vo_frame *current_frame; // last frame queued to the VO
 
@@ -159,7 +167,18 @@ struct vo_internal {
     struct vo_frame *frame_queued;  // should be drawn next
     int req_frames;                 // VO's requested value of num_frames
 
+    double render_time_avg;         // smoothed render time per frame (us)
+
+    // For --video-queue-frames=auto
+    int queue_extra;                // additional frames the player queues
+    int queue_frames_since_change;
+    int64_t queue_prev_drops;
+
     double display_fps;
+
+    // For wait_until() (see there). Only the VO thread writes these.
+    double os_oversleep_avg;        // smoothed timed wait oversleep (us)
+    struct vo_wait_stats wait_stats;
 };
 
 static void forget_frames(struct vo *vo);
@@ -176,7 +195,8 @@ static bool get_desc(struct m_obj_desc *dst, int index)
         .priv_size = vo->priv_size,
         .priv_defaults = vo->priv_defaults,
         .options = vo->options,
-        .hidden = vo->encode || !strcmp(vo->name, "opengl-cb"),
+        .hidden = vo->encode || !strcmp(vo->name, "opengl-cb") ||
+                  !strcmp(vo->name, "sw-cb"),
         .p = vo,
     };
     return true;
@@ -225,7 +245,7 @@ static struct vo *vo_create(bool probing, struct mpv_global *global,
     *vo = (struct vo) {
         .log = mp_log_new(vo, log, name),
         .driver = desc.p,
-        .opts = global->opts->vo,
+        .opts = ex->opts ? ex->opts : global->opts->vo,
         .global = global,
         .encode_lavc_ctx = ex->encode_lavc_ctx,
         .input_ctx = ex->input_ctx,
@@ -270,7 +290,8 @@ error:
 
 struct vo *init_best_video_out(struct mpv_global *global, struct vo_extra *ex)
 {
-    struct m_obj_settings *vo_list = global->opts->vo->video_driver_list;
+    struct mp_vo_opts *opts = ex->opts ? ex->opts : global->opts->vo;
+    struct m_obj_settings *vo_list = opts->video_driver_list;
     // first try the preferred drivers, with their optional subdevice param:
     if (vo_list && vo_list[0].name) {
         for (int n = 0; vo_list[n].name; n++) {
@@ -373,6 +394,57 @@ static void check_estimated_display_fps(struct vo *vo)
                                        : in->nominal_vsync_interval;
 }
 
+// Guess why a frame could not be shown in time: blame the stage that took
+// longer than the frame duration (budget, in us), or the vsync if none did.
+static enum vo_late_cause classify_late_frame(struct mp_image *img,
+                                              int64_t budget,
+                                              int64_t render_time)
+{
+    int64_t stages[VO_LATE_COUNT] = {[VO_LATE_RENDER] = render_time};
+    if (img) {
+        struct mp_frame_timing *t = &img->timing;
+        stages[VO_LATE_DEMUX] = t->demux_wait;
+        if (t->decode_start && t->decoded)
+            stages[VO_LATE_DECODE] = t->decoded - t->decode_start;
+        if (t->filter_start && t->filtered)
+            stages[VO_LATE_FILTER] = t->filtered - t->filter_start;
+    }
+    enum vo_late_cause cause = VO_LATE_VSYNC;
+    int64_t worst = MPMAX(budget, 0);
+    for (int n = 0; n < VO_LATE_COUNT; n++) {
+        if (stages[n] > worst) {
+            worst = stages[n];
+            cause = n;
+        }
+    }
+    return cause;
+}
+
+static void add_latency(struct vo_frame_stats *st, int stage, int64_t t0,
+                        int64_t t1)
+{
+    if (!t0 || !t1 || t1 < t0)
+        return;
+    int bucket = 0;
+    while (bucket < VO_LATENCY_BUCKETS - 1 && t1 - t0 >= (1000LL << bucket))
+        bucket++;
+    st->latency[stage][bucket] += 1;
+}
+
+// Called locked, after a new frame was presented.
+static void record_frame_latency(struct vo *vo, struct mp_image *img,
+                                 int64_t now)
+{
+    struct vo_frame_stats *st = &vo->in->frame_stats;
+    struct mp_frame_timing *t = &img->timing;
+    add_latency(st, VO_LATENCY_DEMUX, t->demuxed - t->demux_wait, t->demuxed);
+    add_latency(st, VO_LATENCY_DECODE, t->decode_start, t->decoded);
+    add_latency(st, VO_LATENCY_FILTER, t->filter_start, t->filtered);
+    add_latency(st, VO_LATENCY_QUEUE, t->filtered, t->queued);
+    add_latency(st, VO_LATENCY_PRESENT, t->queued, now);
+    add_latency(st, VO_LATENCY_TOTAL, t->demuxed, now);
+}
+
 // Attempt to detect vsyncs delayed/skipped by the driver. This tries to deal
 // with strong jitter too, because some drivers have crap vsync timing.
 static void vsync_skip_detection(struct vo *vo)
@@ -397,6 +469,11 @@ static void vsync_skip_detection(struct vo *vo)
         // to treat it differently.
         in->base_vsync = in->prev_vsync;
         in->delayed_count += 1;
+        struct vo_frame *frame = in->current_frame;
+        enum vo_late_cause cause =
+            classify_late_frame(frame ? frame->current : NULL,
+                                in->vsync_interval, in->last_render_time);
+        in->frame_stats.delays[cause] += 1;
         in->drop_point = 0;
         MP_STATS(vo, "vo-delayed");
     }
@@ -405,14 +482,44 @@ static void vsync_skip_detection(struct vo *vo)
 }
 
 // Always called locked.
-static void update_vsync_timing_after_swap(struct vo *vo)
+// Return whether the display's presentation timestamp can be used instead of
+// the time the VO returned from swapping. It has much less jitter, because it
+// is not affected by scheduling or compositor delays.
+static bool check_present_timing(struct vo *vo,
+                                 struct voctrl_present_timing *present,
+                                 int64_t now)
+{
+    struct vo_internal *in = vo->in;
+
+    int64_t prev_count = in->prev_present_count;
+    in->prev_present_count = present->vsync_count;
+
+    // The swap must have advanced the display by at least one vsync (i.e.
+    // it wasn't a non-blocking swap), and the timestamp must be in the same
+    // time base as ours (it's the vsync that just happened).
+    bool ok = prev_count && present->vsync_count > prev_count &&
+              present->time <= now + 1000 && now - present->time < 100 * 1000;
+
+    if (ok != in->using_present_timing) {
+        MP_VERBOSE(vo, "%s display presentation timestamps.\n",
+                   ok ? "Using" : "Not using");
+        in->using_present_timing = ok;
+    }
+    return ok;
+}
+
+static void update_vsync_timing_after_swap(struct vo *vo,
+                                           struct voctrl_present_timing *present)
 {
     struct vo_internal *in = vo->in;
 
     int64_t now = mp_time_us();
+    if (present && check_present_timing(vo, present, now))
+        now = present->time;
     int64_t prev_vsync = in->prev_vsync;
 
     in->prev_vsync = now;
+    MP_STATS(vo, "event-timed %"PRId64" vsync", now);
 
     if (!in->expecting_vsync) {
         reset_vsync_timings(vo);
@@ -449,6 +556,77 @@ static void update_vsync_timing_after_swap(struct vo *vo)
     MP_STATS(vo, "value %f vsync-diff", in->vsync_samples[0] / 1e6);
 }
 
+// Adjust the adaptive queue depth only after this many frames.
+#define QUEUE_ADJUST_FRAMES 60
+#define MAX_QUEUE_EXTRA 4
+
+static void update_render_time(struct vo *vo, int64_t render_time)
+{
+    struct vo_internal *in = vo->in;
+    in->render_time_avg = in->render_time_avg > 0
+        ? in->render_time_avg * 0.9 + render_time * 0.1 : render_time;
+}
+
+// How long before its display time a frame is handed to the VO for rendering.
+// With --video-render-ahead=auto, frames are rendered just in time, based on
+// the measured rendering time, plus a safety margin of a vsync interval.
+static int64_t get_render_ahead(struct vo *vo)
+{
+    struct vo_internal *in = vo->in;
+    int opt = vo->opts->render_ahead;
+    if (opt >= 0)
+        return opt * 1000LL;
+    if (in->render_time_avg <= 0)
+        return 50 * 1000;
+    int64_t margin = MPMAX(in->vsync_interval, 4 * 1000);
+    return MPCLAMP(2 * in->render_time_avg + margin, 8 * 1000, 50 * 1000);
+}
+
+// Always called locked. Decide how many frames the player should queue in
+// addition to the frames the VO requires: if rendering (plus the presentation
+// jitter) takes most of the frame time, or frames are being dropped or
+// delayed, queue deeper to absorb decoding hiccups. If there's plenty of time
+// left, queue less to reduce latency.
+static void update_queue_depth(struct vo *vo, int64_t render_time,
+                               int64_t duration)
+{
+    struct vo_internal *in = vo->in;
+    int opt = vo->opts->queue_frames;
+    if (opt >= 0) {
+        in->queue_extra = opt;
+        return;
+    }
+
+    if (++in->queue_frames_since_change < QUEUE_ADJUST_FRAMES)
+        return;
+
+    int64_t budget = in->vsync_interval > 1 ? in->vsync_interval : duration;
+    if (budget <= 0)
+        return;
+    double jitter = in->estimated_vsync_jitter * budget;
+    double load = (in->render_time_avg + 2 * jitter) / budget;
+    int64_t drops = in->drop_count + in->delayed_count;
+
+    int extra = in->queue_extra;
+    if (load > 0.75 || drops > in->queue_prev_drops) {
+        extra += 1;
+    } else if (load < 0.4) {
+        extra -= 1;
+    }
+    extra = MPCLAMP(extra, 0, MAX_QUEUE_EXTRA);
+    in->queue_prev_drops = drops;
+
+    if (extra != in->queue_extra) {
+        MP_VERBOSE(vo, "render load %.2f, queuing %d additional frames.\n",
+                   load, extra);
+        in->queue_extra = extra;
+        in->queue_frames_since_change = 0;
+    } else {
+        // Check again after a shorter time.
+        in->queue_frames_since_change = QUEUE_ADJUST_FRAMES / 2;
+    }
+}
+
 // to be called from VO thread only
 static void update_display_fps(struct vo *vo)
 {
@@ -581,6 +759,8 @@ static void forget_frames(struct vo *vo)
     in->hasframe_rendered = false;
     in->drop_count = 0;
     in->delayed_count = 0;
+    for (int n = 0; n < VO_LATE_COUNT; n++)
+        in->frame_stats.drops[n] = in->frame_stats.delays[n] = 0;
     talloc_free(in->frame_queued);
     in->frame_queued = NULL;
     // don't unref current_frame; we always want to be able to redraw it
@@ -658,8 +838,9 @@ bool vo_is_ready_for_frame(struct vo *vo, int64_t next_pts)
     if (r && next_pts >= 0) {
         // Don't show the frame too early - it would basically freeze the
         // display by disallowing OSD redrawing or VO interaction.
-        // Actually render the frame at earliest 50ms before target time.
-        next_pts -= (uint64_t)(0.050 * 1e6);
+        // Actually render the frame at earliest 50ms (or what is set with
+        // --video-render-ahead) before target time.
+        next_pts -= get_render_ahead(vo);
         next_pts -= in->flip_queue_offset;
         int64_t now = mp_time_us();
         if (next_pts > now)
@@ -684,6 +865,7 @@ void vo_queue_frame(struct vo *vo, struct vo_frame *frame)
     pthread_mutex_lock(&in->lock);
     assert(vo->config_ok && !in->frame_queued &&
            (!in->current_frame || in->current_frame->num_vsyncs < 1));
+    MP_STATS(vo, "queue frame");
     in->hasframe = true;
     in->frame_queued = frame;
     in->wakeup_pts = frame->display_synced
@@ -705,18 +887,52 @@ void vo_wait_frame(struct vo *vo)
 
 // Wait until realtime is >= ts
 // called without lock
+// The OS wakes up timed waits late by an amount that depends on the timer
+// granularity and the system load. So the timed wait ends early by the
+// measured average oversleep (limited by --video-wait-spin), and the rest is
+// spent spinning on the clock.
 static void wait_until(struct vo *vo, int64_t target)
 {
     struct vo_internal *in = vo->in;
-    struct timespec ts = mp_time_us_to_timespec(target);
+    int64_t max_spin = vo->opts->wait_spin;
+    if (target <= mp_time_us())
+        return;
     pthread_mutex_lock(&in->lock);
-    while (target > mp_time_us()) {
-        if (in->queued_events & VO_EVENT_LIVE_RESIZING)
+    int64_t spin = MPMIN(max_spin, (int64_t)(in->os_oversleep_avg * 1.5) + 50);
+    if (max_spin < 1)
+        spin = 0;
+    int64_t coarse = target - spin;
+    struct timespec ts = mp_time_us_to_timespec(coarse);
+    bool interrupted = false;
+    while (coarse > mp_time_us()) {
+        if (in->queued_events & VO_EVENT_LIVE_RESIZING) {
+            interrupted = true;
             break;
-        if (pthread_cond_timedwait(&in->wakeup, &in->lock, &ts))
+        }
+        if (pthread_cond_timedwait(&in->wakeup, &in->lock, &ts)) {
+            int64_t over = mp_time_us() - coarse;
+            in->os_oversleep_avg += (MPMAX(over, 0) - in->os_oversleep_avg) / 16;
             break;
+        }
     }
     pthread_mutex_unlock(&in->lock);
+
+    if (interrupted)
+        return;
+
+    // Busy wait for the remaining time (at most the spin margin).
+    while (target > mp_time_us()) {}
+
+    int64_t late = MPMAX(mp_time_us() - target, 0);
+    pthread_mutex_lock(&in->lock);
+    struct vo_wait_stats *st = &in->wait_stats;
+    st->count += 1;
+    st->last = late;
+    st->avg = st->count > 1 ? (st->avg * 15 + late) / 16 : late;
+    st->peak = MPMAX(st->peak, late);
+    st->os_avg = in->os_oversleep_avg;
+    st->spin = spin;
+    pthread_mutex_unlock(&in->lock);
 }
 
 static bool render_frame(struct vo *vo)
@@ -756,8 +972,10 @@ static bool render_frame(struct vo *vo)
     // Time at which we should flip_page on the VO.
     int64_t target = frame->display_synced ? 0 : pts - in->flip_queue_offset;
 
-    // "normal" strict drop threshold.
-    in->dropped_frame = duration >= 0 && end_time < now;
+    // "normal" strict drop threshold. Also skip frames that are predicted to
+    // be finished rendering only after they should have been replaced.
+    int64_t render_time = in->hasframe_rendered ? in->render_time_avg : 0;
+    in->dropped_frame = duration >= 0 && end_time < now + render_time;
 
     in->dropped_frame &= !frame->display_synced;
     in->dropped_frame &= !(vo->driver->caps & VO_CAP_FRAMEDROP);
@@ -784,6 +1002,11 @@ static bool render_frame(struct vo *vo)
 
     if (in->dropped_frame) {
         in->drop_count += 1;
+        int64_t budget = frame->display_synced
+                       ? frame->ideal_frame_duration * 1e6 : duration;
+        enum vo_late_cause cause =
+            classify_late_frame(frame->current, budget, render_time);
+        in->frame_stats.drops[cause] += 1;
     } else {
         in->rendering = true;
         in->hasframe_rendered = true;
@@ -793,15 +1016,43 @@ static bool render_frame(struct vo *vo)
 
         MP_STATS(vo, "start video");
 
+        MP_STATS(vo, "start render");
+        int64_t render_start = mp_time_us();
         if (vo->driver->draw_frame) {
             vo->driver->draw_frame(vo, frame);
         } else {
             vo->driver->draw_image(vo, mp_image_new_ref(frame->current));
         }
+        render_time = mp_time_us() - render_start;
+        MP_STATS(vo, "end render");
+
+        // GPU time is not included in the above with asynchronous rendering.
+        struct voctrl_performance_data perf = {0};
+        if (vo->driver->control &&
+            vo->driver->control(vo, VOCTRL_PERFORMANCE_DATA, &perf) > 0)
+        {
+            render_time = MPMAX(render_time,
+                                (int64_t)(perf.upload.last + perf.render.last));
+            MP_STATS(vo, "value %f gpu-upload", perf.upload.last / 1e6);
+            MP_STATS(vo, "value %f gpu-render", perf.render.last / 1e6);
+            MP_STATS(vo, "value %f gpu-present", perf.present.last / 1e6);
+        }
 
         wait_until(vo, target);
 
-        vo->driver->flip_page(vo);
+        // --benchmark-stage=render measures everything except the flip.
+        struct MPOpts *gopts = vo->global->opts;
+        if (!(gopts->benchmark && gopts->benchmark[0] &&
+              gopts->benchmark_stage == MP_BENCHMARK_RENDER))
+        {
+            MP_STATS(vo, "start flip");
+            vo->driver->flip_page(vo);
+            MP_STATS(vo, "end flip");
+        }
+
+        struct voctrl_present_timing present = {0};
+        bool have_present = use_vsync && vo->driver->control &&
+            vo->driver->control(vo, VOCTRL_GET_PRESENT_TIMING, &present) > 0;
 
         MP_STATS(vo, "end video");
         MP_STATS(vo, "video_end");
@@ -809,8 +1060,15 @@ static bool render_frame(struct vo *vo)
         pthread_mutex_lock(&in->lock);
         in->dropped_frame = prev_drop_count < vo->in->drop_count;
         in->rendering = false;
+        in->last_render_time = render_time;
+
+        if (frame->current && !frame->repeat && !frame->redraw &&
+            !in->dropped_frame)
+            record_frame_latency(vo, frame->current, mp_time_us());
 
-        update_vsync_timing_after_swap(vo);
+        update_vsync_timing_after_swap(vo, have_present ? &present : NULL);
+        update_render_time(vo, render_time);
+        update_queue_depth(vo, render_time, duration);
     }
 
     if (!in->dropped_frame) {
@@ -952,6 +1210,8 @@ void vo_increment_drop_count(struct vo *vo, int64_t n)
 {
     pthread_mutex_lock(&vo->in->lock);
     vo->in->drop_count += n;
+    // The VO failed to present the frame in time on its own.
+    vo->in->frame_stats.drops[VO_LATE_RENDER] += n;
     pthread_mutex_unlock(&vo->in->lock);
 }
 
@@ -1069,6 +1329,17 @@ int vo_get_num_req_frames(struct vo *vo)
     return res;
 }
 
+// Number of frames the player should queue ahead. This is at least
+// vo_get_num_req_frames(), plus what is set with --video-queue-frames.
+int vo_get_queue_depth(struct vo *vo)
+{
+    struct vo_internal *in = vo->in;
+    pthread_mutex_lock(&in->lock);
+    int res = MPMIN(in->req_frames + in->queue_extra, VO_MAX_REQ_FRAMES);
+    pthread_mutex_unlock(&in->lock);
+    return res;
+}
+
 int64_t vo_get_vsync_interval(struct vo *vo)
 {
     struct vo_internal *in = vo->in;
@@ -1097,6 +1368,22 @@ double vo_get_estimated_vsync_jitter(struct vo *vo)
     return res;
 }
 
+void vo_get_wait_stats(struct vo *vo, struct vo_wait_stats *st)
+{
+    struct vo_internal *in = vo->in;
+    pthread_mutex_lock(&in->lock);
+    *st = in->wait_stats;
+    pthread_mutex_unlock(&in->lock);
+}
+
+void vo_get_frame_stats(struct vo *vo, struct vo_frame_stats *st)
+{
+    struct vo_internal *in = vo->in;
+    pthread_mutex_lock(&in->lock);
+    *st = in->frame_stats;
+    pthread_mutex_unlock(&in->lock);
+}
+
 // Get the time in seconds at after which the currently rendering frame will
 // end. Returns positive values if the frame is yet to be finished, negative
 // values if it already finished.
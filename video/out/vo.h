@@ -78,6 +78,7 @@ enum mp_voctrl {
     VOCTRL_UPDATE_PLAYBACK_STATE,       // struct voctrl_playback_state*
 
     VOCTRL_PERFORMANCE_DATA,            // struct voctrl_performance_data*
+    VOCTRL_PASS_PERFORMANCE_DATA,       // struct voctrl_pass_performance*
 
     VOCTRL_SET_CURSOR_VISIBILITY,       // bool*
 
@@ -108,6 +109,12 @@ enum mp_voctrl {
     VOCTRL_GET_DISPLAY_FPS,             // double*
 
     VOCTRL_GET_PREF_DEINT,              // int*
+
+    VOCTRL_GET_PRESENT_TIMING,          // struct voctrl_present_timing*
+
+    // Allocate an image for direct rendering. Unlike other VOCTRLs, this can
+    // be called from any thread (e.g. libavcodec's decoder threads).
+    VOCTRL_GET_IMAGE,                   // struct voctrl_get_image*
 };
 
 // VOCTRL_SET_EQUALIZER
@@ -149,6 +156,38 @@ struct voctrl_performance_data {
     struct voctrl_performance_entry upload, render, present;
 };
 
+// VOCTRL_PASS_PERFORMANCE_DATA
+#define VO_PASS_PERF_MAX 64
+
+struct voctrl_pass_performance {
+    // Render passes of the most recently rendered frame, in order.
+    int num_passes;
+    struct {
+        char desc[64];
+        struct voctrl_performance_entry perf;
+    } passes[VO_PASS_PERF_MAX];
+};
+
+// VOCTRL_GET_PRESENT_TIMING
+struct voctrl_present_timing {
+    // mp_time_us() timestamp of the most recent vertical blank, as reported
+    // by the display (not the time the VO returned from swapping).
+    int64_t time;
+    // Number of vertical blanks up to the one above (monotonically increasing,
+    // arbitrary origin).
+    int64_t vsync_count;
+};
+
+// VOCTRL_GET_IMAGE
+struct voctrl_get_image {
+    // Input parameters. All plane strides must be aligned to stride_align
+    // (a power of 2).
+    int imgfmt, w, h, stride_align;
+    // Set by the VO to a new image with the requested parameters, or NULL
+    // if allocation failed. The image can be freed from any thread.
+    struct mp_image *res;
+};
+
 enum {
     // VO does handle mp_image_params.rotate in 90 degree steps
     VO_CAP_ROTATE90     = 1 << 0,
@@ -168,6 +207,9 @@ struct vo_extra {
     struct osd_state *osd;
     struct encode_lavc_context *encode_lavc_ctx;
     struct mpv_opengl_cb_context *opengl_cb_context;
+    struct mpv_sw_cb_context *sw_cb_context;
+    // If set, used instead of the global VO options (for --video-mirror).
+    struct mp_vo_opts *opts;
 };
 
 struct vo_frame {
@@ -362,9 +404,53 @@ int vo_query_and_reset_events(struct vo *vo, int events);
 struct mp_image *vo_get_current_frame(struct vo *vo);
 void vo_set_queue_params(struct vo *vo, int64_t offset_us, int num_req_frames);
 int vo_get_num_req_frames(struct vo *vo);
+int vo_get_queue_depth(struct vo *vo);
 int64_t vo_get_vsync_interval(struct vo *vo);
 double vo_get_estimated_vsync_interval(struct vo *vo);
 double vo_get_estimated_vsync_jitter(struct vo *vo);
+
+// Timing precision of waiting for the presentation deadline (microseconds).
+struct vo_wait_stats {
+    int64_t count;      // number of waits
+    int64_t last;       // lateness of the last wait
+    int64_t avg;        // smoothed lateness
+    int64_t peak;       // largest lateness
+    int64_t os_avg;     // smoothed oversleep of the OS timed wait
+    int64_t spin;       // current spin margin
+};
+void vo_get_wait_stats(struct vo *vo, struct vo_wait_stats *st);
+
+// Causes of dropped or delayed frames, as guessed by the VO.
+enum vo_late_cause {
+    VO_LATE_DEMUX,      // decoder was starved by the demuxer
+    VO_LATE_DECODE,     // decoding took longer than the frame duration
+    VO_LATE_FILTER,     // filtering took longer than the frame duration
+    VO_LATE_RENDER,     // rendering took longer than the frame duration
+    VO_LATE_VSYNC,      // missed vsync with no slow stage to blame
+    VO_LATE_COUNT
+};
+
+// Per-frame pipeline latencies (see struct mp_frame_timing).
+enum vo_latency_stage {
+    VO_LATENCY_DEMUX,   // decoder waiting for packets
+    VO_LATENCY_DECODE,  // decode call
+    VO_LATENCY_FILTER,  // filter chain
+    VO_LATENCY_QUEUE,   // waiting to be queued to the VO
+    VO_LATENCY_PRESENT, // queued to the VO until presented
+    VO_LATENCY_TOTAL,   // packet read until presented
+    VO_LATENCY_COUNT
+};
+
+// Histogram bucket n counts latencies below (1 << n) ms; the last bucket
+// counts everything else.
+#define VO_LATENCY_BUCKETS 10
+
+struct vo_frame_stats {
+    int64_t drops[VO_LATE_COUNT];   // sums up to vo_get_drop_count()
+    int64_t delays[VO_LATE_COUNT];  // sums up to vo_get_delayed_count()
+    int64_t latency[VO_LATENCY_COUNT][VO_LATENCY_BUCKETS];
+};
+void vo_get_frame_stats(struct vo *vo, struct vo_frame_stats *st);
 double vo_get_display_fps(struct vo *vo);
 double vo_get_delay(struct vo *vo);
 void vo_discard_timing_info(struct vo *vo);
@@ -24,6 +24,7 @@
 #include <unistd.h>
 
 #include <libswscale/swscale.h>
+#include <drm_fourcc.h>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 
@@ -57,6 +58,7 @@ struct priv {
     char *device_path;
     int connector_id;
     int mode_id;
+    int use_overlay;
 
     struct kms *kms;
     drmModeCrtc *old_crtc;
@@ -70,6 +72,15 @@ struct priv {
     bool active;
     bool pflip_happening;
 
+    // For the overlay plane mode: video is converted (not scaled) to NV12,
+    // and the display controller scales it. The primary plane shows the OSD.
+    uint32_t plane_id;          // 0 if no usable overlay plane
+    bool overlay_active;        // overlay mode used for current config
+    struct framebuffer video_bufs[BUF_COUNT];
+    int video_buf;              // next video_bufs[] entry to render to
+    bool video_pending;         // video_bufs[video_buf] needs to be shown
+    uint64_t osd_sig[BUF_COUNT]; // OSD state drawn into bufs[]
+
     int32_t device_w;
     int32_t device_h;
     struct mp_image *last_input;
@@ -96,6 +107,30 @@ static void fb_destroy(int fd, struct framebuffer *buf)
     }
 }
 
+static bool fb_map(struct vo *vo, int fd, struct framebuffer *buf)
+{
+    // prepare buffer for memory mapping
+    struct drm_mode_map_dumb mreq = {
+        .handle = buf->handle,
+    };
+    if (drmIoctl(fd, DRM_IOCTL_MODE_MAP_DUMB, &mreq)) {
+        MP_ERR(vo, "Cannot map dumb buffer: %s\n", mp_strerror(errno));
+        return false;
+    }
+
+    // perform actual memory mapping
+    buf->map = mmap(0, buf->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                    fd, mreq.offset);
+    if (buf->map == MAP_FAILED) {
+        MP_ERR(vo, "Cannot map dumb buffer: %s\n", mp_strerror(errno));
+        buf->map = NULL;
+        return false;
+    }
+
+    memset(buf->map, 0, buf->size);
+    return true;
+}
+
 static bool fb_setup_single(struct vo *vo, int fd, struct framebuffer *buf)
 {
     buf->handle = 0;
@@ -121,24 +156,46 @@ static bool fb_setup_single(struct vo *vo, int fd, struct framebuffer *buf)
         goto err;
     }
 
-    // prepare buffer for memory mapping
-    struct drm_mode_map_dumb mreq = {
-        .handle = buf->handle,
+    if (!fb_map(vo, fd, buf))
+        goto err;
+    return true;
+
+err:
+    fb_destroy(fd, buf);
+    return false;
+}
+
+// NV12 buffer for the overlay plane (both planes in one dumb buffer).
+static bool fb_setup_nv12(struct vo *vo, int fd, struct framebuffer *buf)
+{
+    buf->handle = 0;
+
+    uint32_t h = MP_ALIGN_UP(buf->height, 2);
+    struct drm_mode_create_dumb creq = {
+        .width = MP_ALIGN_UP(buf->width, 2),
+        .height = h * 3 / 2,
+        .bpp = 8,
     };
-    if (drmIoctl(fd, DRM_IOCTL_MODE_MAP_DUMB, &mreq)) {
-        MP_ERR(vo, "Cannot map dumb buffer: %s\n", mp_strerror(errno));
+    if (drmIoctl(fd, DRM_IOCTL_MODE_CREATE_DUMB, &creq) < 0) {
+        MP_ERR(vo, "Cannot create dumb buffer: %s\n", mp_strerror(errno));
         goto err;
     }
+    buf->stride = creq.pitch;
+    buf->size = creq.size;
+    buf->handle = creq.handle;
 
-    // perform actual memory mapping
-    buf->map = mmap(0, buf->size, PROT_READ | PROT_WRITE, MAP_SHARED,
-                    fd, mreq.offset);
-    if (buf->map == MAP_FAILED) {
-        MP_ERR(vo, "Cannot map dumb buffer: %s\n", mp_strerror(errno));
+    uint32_t handles[4] = {buf->handle, buf->handle};
+    uint32_t pitches[4] = {buf->stride, buf->stride};
+    uint32_t offsets[4] = {0, buf->stride * h};
+    if (drmModeAddFB2(fd, buf->width, buf->height, DRM_FORMAT_NV12, handles,
+                      pitches, offsets, &buf->fb, 0))
+    {
+        MP_ERR(vo, "Cannot create NV12 framebuffer: %s\n", mp_strerror(errno));
         goto err;
     }
 
-    memset(buf->map, 0, buf->size);
+    if (!fb_map(vo, fd, buf))
+        goto err;
     return true;
 
 err:
@@ -170,6 +227,159 @@ static bool fb_setup_double_buffering(struct vo *vo)
     return true;
 }
 
+// Find an overlay plane that can show NV12 on the CRTC we use. Without the
+// universal planes client cap, only overlay planes are listed.
+static uint32_t find_overlay_plane(struct vo *vo)
+{
+    struct priv *p = vo->priv;
+    int fd = p->kms->fd;
+    uint32_t plane_id = 0;
+
+    drmModeRes *res = drmModeGetResources(fd);
+    drmModePlaneRes *plane_res = drmModeGetPlaneResources(fd);
+    if (!res || !plane_res)
+        goto done;
+
+    int crtc_index = -1;
+    for (int n = 0; n < res->count_crtcs; n++) {
+        if (res->crtcs[n] == p->kms->crtc_id)
+            crtc_index = n;
+    }
+    if (crtc_index < 0)
+        goto done;
+
+    for (unsigned int n = 0; n < plane_res->count_planes && !plane_id; n++) {
+        drmModePlane *plane = drmModeGetPlane(fd, plane_res->planes[n]);
+        if (!plane)
+            continue;
+        if (plane->possible_crtcs & (1u << crtc_index)) {
+            for (unsigned int i = 0; i < plane->count_formats; i++) {
+                if (plane->formats[i] == DRM_FORMAT_NV12)
+                    plane_id = plane->plane_id;
+            }
+        }
+        drmModeFreePlane(plane);
+    }
+
+done:
+    if (plane_res)
+        drmModeFreePlaneResources(plane_res);
+    if (res)
+        drmModeFreeResources(res);
+    if (!plane_id)
+        MP_VERBOSE(vo, "No NV12 overlay plane found.\n");
+    return plane_id;
+}
+
+static void overlay_release(struct vo *vo)
+{
+    struct priv *p = vo->priv;
+
+    if (p->overlay_active && p->active) {
+        drmModeSetPlane(p->kms->fd, p->plane_id, p->kms->crtc_id, 0, 0,
+                        0, 0, 0, 0, 0, 0, 0, 0);
+    }
+    p->overlay_active = false;
+    p->video_pending = false;
+    for (unsigned int i = 0; i < BUF_COUNT; i++) {
+        fb_destroy(p->kms->fd, &p->video_bufs[i]);
+        p->video_bufs[i] = (struct framebuffer){0};
+    }
+}
+
+static bool overlay_setup(struct vo *vo, struct mp_image_params *params)
+{
+    struct priv *p = vo->priv;
+
+    for (unsigned int i = 0; i < BUF_COUNT; i++) {
+        p->video_bufs[i].width = params->w;
+        p->video_bufs[i].height = params->h;
+        if (!fb_setup_nv12(vo, p->kms->fd, &p->video_bufs[i])) {
+            overlay_release(vo);
+            return false;
+        }
+    }
+    p->video_buf = 0;
+    p->overlay_active = true;
+    return true;
+}
+
+// Wrap the mapped NV12 buffer as mp_image for the conversion.
+static void overlay_wrap_buf(struct priv *p, struct framebuffer *buf,
+                             struct mp_image *img)
+{
+    *img = (struct mp_image){0};
+    mp_image_set_params(img, &p->sws->dst);
+    img->planes[0] = buf->map;
+    img->stride[0] = buf->stride;
+    img->planes[1] = buf->map + buf->stride * MP_ALIGN_UP(buf->height, 2);
+    img->stride[1] = buf->stride;
+}
+
+static void show_overlay(struct vo *vo)
+{
+    struct priv *p = vo->priv;
+    struct framebuffer *buf = &p->video_bufs[p->video_buf];
+
+    // Source coordinates are in 16.16 fixed point. The display controller
+    // does the scaling to the destination rectangle.
+    int ret = drmModeSetPlane(p->kms->fd, p->plane_id, p->kms->crtc_id,
+                              buf->fb, 0,
+                              p->dst.x0, p->dst.y0,
+                              p->dst.x1 - p->dst.x0, p->dst.y1 - p->dst.y0,
+                              p->src.x0 << 16, p->src.y0 << 16,
+                              (p->src.x1 - p->src.x0) << 16,
+                              (p->src.y1 - p->src.y0) << 16);
+    if (ret) {
+        MP_WARN(vo, "Cannot set overlay plane: %s\n", mp_strerror(errno));
+    } else {
+        p->video_buf = (p->video_buf + 1) % BUF_COUNT;
+    }
+    p->video_pending = false;
+}
+
+struct osd_sig_ctx {
+    uint64_t sig;
+};
+
+static void osd_sig_cb(void *ctx, struct sub_bitmaps *imgs)
+{
+    struct osd_sig_ctx *c = ctx;
+    c->sig = c->sig * 31 + imgs->render_index;
+    c->sig = c->sig * 31 + imgs->change_id;
+    c->sig = c->sig * 31 + imgs->num_parts;
+}
+
+// Render the OSD into the primary plane buffer, unless it is unchanged.
+static void draw_osd_primary(struct vo *vo, double pts)
+{
+    struct priv *p = vo->priv;
+    struct framebuffer *buf = &p->bufs[p->front_buf];
+    struct mp_osd_res res = {
+        .w = p->device_w,
+        .h = p->device_h,
+        .display_par = 1,
+    };
+
+    static const bool formats[SUBBITMAP_COUNT] = {
+        [SUBBITMAP_LIBASS] = true,
+        [SUBBITMAP_RGBA] = true,
+    };
+    struct osd_sig_ctx c = { .sig = 1 };
+    osd_draw(vo->osd, res, pts, 0, formats, osd_sig_cb, &c);
+    if (c.sig == p->osd_sig[p->front_buf])
+        return;
+    p->osd_sig[p->front_buf] = c.sig;
+
+    struct mp_image img = {0};
+    mp_image_setfmt(&img, IMGFMT);
+    mp_image_set_size(&img, p->device_w, p->device_h);
+    img.planes[0] = buf->map;
+    img.stride[0] = buf->stride;
+    memset(buf->map, 0, buf->size);
+    osd_draw_on_image(vo->osd, res, pts, 0, &img);
+}
+
 static void page_flipped(int fd, unsigned int frame, unsigned int sec,
                                  unsigned int usec, void *data)
 {
@@ -182,6 +392,9 @@ static bool crtc_setup(struct vo *vo)
     struct priv *p = vo->priv;
     if (p->active)
         return true;
+    // The primary plane is reset, and has to be redrawn.
+    for (unsigned int i = 0; i < BUF_COUNT; i++)
+        p->osd_sig[i] = 0;
     p->old_crtc = drmModeGetCrtc(p->kms->fd, p->kms->crtc_id);
     int ret = drmModeSetCrtc(p->kms->fd, p->kms->crtc_id,
                              p->bufs[p->front_buf + BUF_COUNT - 1].fb,
@@ -200,6 +413,13 @@ static void crtc_release(struct vo *vo)
 
     if (!p->active)
         return;
+
+    if (p->overlay_active) {
+        drmModeSetPlane(p->kms->fd, p->plane_id, p->kms->crtc_id, 0, 0,
+                        0, 0, 0, 0, 0, 0, 0, 0);
+        // show it again on the next frame after VT switching back
+        p->video_pending = false;
+    }
     p->active = false;
 
     // wait for current page flip
@@ -291,8 +511,31 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
     p->osd.mr = MPMIN(0, p->osd.mr);
     p->osd.ml = MPMIN(0, p->osd.ml);
 
+    overlay_release(vo);
     mp_sws_set_from_cmdline(p->sws, vo->opts->sws_opts);
     p->sws->src = *params;
+
+    // Convert to NV12 at source size only; scaling is done by the plane.
+    if (p->plane_id && overlay_setup(vo, params)) {
+        p->sws->dst = (struct mp_image_params) {
+            .imgfmt = IMGFMT_NV12,
+            .w = params->w,
+            .h = params->h,
+            .p_w = params->p_w,
+            .p_h = params->p_h,
+        };
+        mp_image_params_guess_csp(&p->sws->dst);
+        for (unsigned int i = 0; i < BUF_COUNT; i++) {
+            memset(p->bufs[i].map, 0, p->bufs[i].size);
+            p->osd_sig[i] = 0;
+        }
+        if (mp_sws_reinit(p->sws) < 0)
+            return -1;
+        MP_VERBOSE(vo, "Using overlay plane %u.\n", p->plane_id);
+        vo->want_redraw = true;
+        return 0;
+    }
+
     p->sws->dst = (struct mp_image_params) {
         .imgfmt = IMGFMT,
         .w = w,
@@ -321,7 +564,15 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
 {
     struct priv *p = vo->priv;
 
-    if (p->active) {
+    if (p->active && p->overlay_active) {
+        if (mpi) {
+            struct mp_image dst;
+            overlay_wrap_buf(p, &p->video_bufs[p->video_buf], &dst);
+            mp_sws_scale(p->sws, &dst, mpi);
+            p->video_pending = true;
+        }
+        draw_osd_primary(vo, mpi ? mpi->pts : 0);
+    } else if (p->active) {
         if (mpi) {
             struct mp_image src = *mpi;
             struct mp_rect src_rc = p->src;
@@ -361,6 +612,11 @@ static void flip_page(struct vo *vo)
     if (!p->active || p->pflip_happening)
         return;
 
+    // The primary plane page flip below still provides vsync locking; the
+    // overlay update is latched by the driver on the same vblank.
+    if (p->video_pending)
+        show_overlay(vo);
+
     int ret = drmModePageFlip(p->kms->fd, p->kms->crtc_id,
                               p->bufs[p->front_buf].fb,
                               DRM_MODE_PAGE_FLIP_EVENT, p);
@@ -391,9 +647,13 @@ static void uninit(struct vo *vo)
 {
     struct priv *p = vo->priv;
 
+    if (p->kms)
+        overlay_release(vo);
     crtc_release(vo);
-    for (unsigned int i = 0; i < BUF_COUNT; i++)
-        fb_destroy(p->kms->fd, &p->bufs[i]);
+    if (p->kms) {
+        for (unsigned int i = 0; i < BUF_COUNT; i++)
+            fb_destroy(p->kms->fd, &p->bufs[i]);
+    }
 
     if (p->kms) {
         kms_destroy(p->kms);
@@ -447,6 +707,9 @@ static int preinit(struct vo *vo)
     p->device_w = p->bufs[0].width;
     p->device_h = p->bufs[0].height;
 
+    if (p->use_overlay)
+        p->plane_id = find_overlay_plane(vo);
+
     if (!crtc_setup(vo)) {
         MP_ERR(vo,
                "Cannot set CRTC for connector %u: %s\n",
@@ -472,6 +735,8 @@ static int control(struct vo *vo, uint32_t request, void *data)
     struct priv *p = vo->priv;
     switch (request) {
     case VOCTRL_SCREENSHOT_WIN:
+        if (p->overlay_active)
+            return VO_NOTIMPL;
         *(struct mp_image**)data = mp_image_new_copy(p->cur_frame);
         return VO_TRUE;
     case VOCTRL_REDRAW_FRAME:
@@ -506,6 +771,7 @@ const struct vo_driver video_out_drm = {
         OPT_STRING("devpath", device_path, 0),
         OPT_INT("connector", connector_id, 0),
         OPT_INT("mode", mode_id, 0),
+        OPT_FLAG("overlay", use_overlay, 0),
         {0},
     },
     .priv_defaults = &(const struct priv) {
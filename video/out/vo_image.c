@@ -23,9 +23,11 @@
 #include <sys/stat.h>
 
 #include <libswscale/swscale.h>
+#include <libavutil/cpu.h>
 
 #include "config.h"
 #include "misc/bstr.h"
+#include "misc/thread_pool.h"
 #include "osdep/io.h"
 #include "options/path.h"
 #include "mpv_talloc.h"
@@ -40,12 +42,28 @@
 #include "sub/osd.h"
 #include "options/m_option.h"
 
+#define MAX_THREADS 64
+
+struct image_job {
+    struct mp_image *image;
+    char *filename;
+};
+
 struct priv {
     struct image_writer_opts *opts;
     char *outdir;
+    int threads;
 
     struct mp_image *current;
     int frame;
+
+    // Frames waiting to be encoded. They're written concurrently once
+    // max_jobs frames are queued (or on uninit). The file names are assigned
+    // when queuing, so the numbering follows presentation order.
+    struct mp_thread_pool *pool;
+    struct image_job *jobs;
+    int num_jobs;
+    int max_jobs;
 };
 
 static bool checked_mkdir(struct vo *vo, const char *buf)
@@ -64,6 +82,28 @@ static bool checked_mkdir(struct vo *vo, const char *buf)
     return true;
 }
 
+static void write_job(void *ctx, int index)
+{
+    struct vo *vo = ctx;
+    struct priv *p = vo->priv;
+    struct image_job *job = &p->jobs[index];
+
+    write_image(job->image, p->opts, job->filename, vo->log);
+}
+
+static void flush_jobs(struct vo *vo)
+{
+    struct priv *p = vo->priv;
+
+    mp_thread_pool_run(p->pool, write_job, vo, p->num_jobs);
+
+    for (int n = 0; n < p->num_jobs; n++) {
+        talloc_free(p->jobs[n].image);
+        talloc_free(p->jobs[n].filename);
+    }
+    p->num_jobs = 0;
+}
+
 static int reconfig(struct vo *vo, struct mp_image_params *params)
 {
     struct priv *p = vo->priv;
@@ -90,18 +130,26 @@ static void flip_page(struct vo *vo)
 
     (p->frame)++;
 
-    void *t = talloc_new(NULL);
-    char *filename = talloc_asprintf(t, "%08d.%s", p->frame,
+    char *filename = talloc_asprintf(NULL, "%08d.%s", p->frame,
                                      image_writer_file_ext(p->opts));
 
-    if (p->outdir && strlen(p->outdir))
-        filename = mp_path_join(t, p->outdir, filename);
+    if (p->outdir && strlen(p->outdir)) {
+        char *path = mp_path_join(NULL, p->outdir, filename);
+        talloc_free(filename);
+        filename = path;
+    }
 
     MP_INFO(vo, "Saving %s\n", filename);
-    write_image(p->current, p->opts, filename, vo->log);
 
-    talloc_free(t);
-    mp_image_unrefp(&p->current);
+    struct image_job job = {
+        .image = p->current,
+        .filename = filename,
+    };
+    MP_TARRAY_APPEND(p, p->jobs, p->num_jobs, job);
+    p->current = NULL;
+
+    if (p->num_jobs >= p->max_jobs)
+        flush_jobs(vo);
 }
 
 static int query_format(struct vo *vo, int fmt)
@@ -115,6 +163,7 @@ static void uninit(struct vo *vo)
 {
     struct priv *p = vo->priv;
 
+    flush_jobs(vo);
     mp_image_unrefp(&p->current);
 }
 
@@ -123,6 +172,10 @@ static int preinit(struct vo *vo)
     struct priv *p = vo->priv;
     if (p->outdir && !checked_mkdir(vo, p->outdir))
         return -1;
+
+    int threads = p->threads ? p->threads : MPMIN(av_cpu_count(), MAX_THREADS);
+    p->pool = mp_thread_pool_create(p, threads - 1);
+    p->max_jobs = threads;
     return 0;
 }
 
@@ -142,6 +195,7 @@ const struct vo_driver video_out_image =
     .options = (const struct m_option[]) {
         OPT_SUBSTRUCT("", opts, image_writer_conf, 0),
         OPT_STRING("outdir", outdir, 0),
+        OPT_INTRANGE("threads", threads, 0, 0, MAX_THREADS),
         {0},
     },
     .preinit = preinit,
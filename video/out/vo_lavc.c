@@ -24,9 +24,16 @@
 #include <stdlib.h>
 
 #include "config.h"
+
+#if HAVE_CUDA_HWACCEL
+#include <libavutil/hwcontext.h>
+#include <libavutil/hwcontext_cuda.h>
+#endif
+
 #include "common/common.h"
 #include "options/options.h"
 #include "video/fmt-conversion.h"
+#include "video/hwdec.h"
 #include "video/mp_image.h"
 #include "mpv_talloc.h"
 #include "vo.h"
@@ -55,9 +62,72 @@ struct priv {
     AVRational worst_time_base;
     int worst_time_base_is_stream;
 
+    // Encoding from hardware surfaces: the encoder needs the frames context
+    // of the decoder's surfaces, so it is opened with the first frame.
+    bool hw_open_pending;
+    AVBufferRef *hw_device;
+    struct mp_hwdec_ctx hwctx;
+
     bool shutdown;
 };
 
+// Surfaces of these formats come with an AVHWFramesContext, and can be
+// passed to hardware encoders which accept the same pixel format.
+static bool is_hw_encodable(int imgfmt)
+{
+#if HAVE_CUDA_HWACCEL
+    return imgfmt == IMGFMT_CUDA;
+#else
+    return false;
+#endif
+}
+
+// If the encoder takes CUDA frames (NVENC), create a CUDA device for the
+// decoder, so that --hwdec=cuda decodes into surfaces the encoder can read
+// directly, instead of going through system memory.
+static void init_hw_device(struct vo *vo)
+{
+#if HAVE_CUDA_HWACCEL
+    struct priv *vc = vo->priv;
+    AVCodec *codec = vo->encode_lavc_ctx->vc;
+
+    if (!codec || !encode_lavc_supports_pixfmt(vo->encode_lavc_ctx,
+                                               AV_PIX_FMT_CUDA))
+        return;
+    if (!codec->pix_fmts)
+        return;
+
+    if (av_hwdevice_ctx_create(&vc->hw_device, AV_HWDEVICE_TYPE_CUDA,
+                               NULL, NULL, 0) < 0)
+    {
+        MP_VERBOSE(vo, "Could not create CUDA device for encoding.\n");
+        return;
+    }
+
+    AVHWDeviceContext *device_ctx = (void *)vc->hw_device->data;
+    AVCUDADeviceContext *device_hwctx = device_ctx->hwctx;
+    vc->hwctx = (struct mp_hwdec_ctx){
+        .type = HWDEC_CUDA,
+        .driver_name = "lavc",
+        .ctx = device_hwctx->cuda_ctx,
+    };
+    vo->hwdec_devs = hwdec_devices_create();
+    hwdec_devices_add(vo->hwdec_devs, &vc->hwctx);
+#endif
+}
+
+static void uninit_hw_device(struct vo *vo)
+{
+    struct priv *vc = vo->priv;
+
+    if (vo->hwdec_devs) {
+        hwdec_devices_remove(vo->hwdec_devs, &vc->hwctx);
+        hwdec_devices_destroy(vo->hwdec_devs);
+        vo->hwdec_devs = NULL;
+    }
+    av_buffer_unref(&vc->hw_device);
+}
+
 static int preinit(struct vo *vo)
 {
     struct priv *vc;
@@ -68,6 +138,10 @@ static int preinit(struct vo *vo)
     vo->priv = talloc_zero(vo, struct priv);
     vc = vo->priv;
     vc->harddup = vo->encode_lavc_ctx->options->harddup;
+
+    pthread_mutex_lock(&vo->encode_lavc_ctx->lock);
+    init_hw_device(vo);
+    pthread_mutex_unlock(&vo->encode_lavc_ctx->lock);
     return 0;
 }
 
@@ -87,6 +161,8 @@ static void uninit(struct vo *vo)
 
     pthread_mutex_unlock(&vo->encode_lavc_ctx->lock);
 
+    uninit_hw_device(vo);
+
     vc->shutdown = true;
 }
 
@@ -158,6 +234,12 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
     encode_lavc_set_csp(vo->encode_lavc_ctx, vc->codec, params->color.space);
     encode_lavc_set_csp_levels(vo->encode_lavc_ctx, vc->codec, params->color.levels);
 
+    if (IMGFMT_IS_HWACCEL(params->imgfmt)) {
+        vc->codec->sw_pix_fmt = imgfmt2pixfmt(params->hw_subfmt);
+        vc->hw_open_pending = true;
+        goto done;
+    }
+
     if (encode_lavc_open_codec(vo->encode_lavc_ctx, vc->codec) < 0)
         goto error;
 
@@ -177,6 +259,8 @@ static int query_format(struct vo *vo, int format)
 
     if (!vo->encode_lavc_ctx)
         return 0;
+    if (IMGFMT_IS_HWACCEL(format) && !is_hw_encodable(format))
+        return 0;
 
     pthread_mutex_lock(&vo->encode_lavc_ctx->lock);
     int flags = 0;
@@ -296,6 +380,26 @@ static void encode_video_and_write(struct vo *vo, AVFrame *frame)
 #endif
 }
 
+static bool open_hw_codec(struct vo *vo, struct mp_image *mpi)
+{
+    struct priv *vc = vo->priv;
+
+    if (!mpi->hwctx) {
+        encode_lavc_fail(vo->encode_lavc_ctx,
+                         "vo-lavc: hardware frames without frames context\n");
+        return false;
+    }
+
+    vc->codec->hw_frames_ctx = av_buffer_ref(mpi->hwctx);
+    if (!vc->codec->hw_frames_ctx)
+        return false;
+    if (encode_lavc_open_codec(vo->encode_lavc_ctx, vc->codec) < 0)
+        return false;
+
+    vc->hw_open_pending = false;
+    return true;
+}
+
 static void draw_image_unlocked(struct vo *vo, mp_image_t *mpi)
 {
     struct priv *vc = vo->priv;
@@ -308,6 +412,10 @@ static void draw_image_unlocked(struct vo *vo, mp_image_t *mpi)
 
     if (!vc || vc->shutdown)
         goto done;
+    if (vc->hw_open_pending && mpi && !open_hw_codec(vo, mpi)) {
+        vc->shutdown = true;
+        goto done;
+    }
     if (!encode_lavc_start(ectx)) {
         MP_WARN(vo, "NOTE: skipped initial video frame (probably because audio is not there yet)\n");
         goto done;
@@ -485,7 +593,9 @@ static void draw_image_unlocked(struct vo *vo, mp_image_t *mpi)
         }
     }
 
-    if (vc->lastimg && vc->lastimg_wants_osd && vo->params) {
+    if (vc->lastimg && vc->lastimg_wants_osd && vo->params &&
+        !IMGFMT_IS_HWACCEL(vc->lastimg->imgfmt))
+    {
         struct mp_osd_res dim = osd_res_from_image_params(vo->params);
 
         osd_draw_on_image(vo->osd, dim, vc->lastimg->pts, OSD_DRAW_SUB_ONLY,
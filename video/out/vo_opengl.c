@@ -71,6 +71,7 @@ struct gl_priv {
     int swap_interval;
     int dwm_flush;
     int allow_direct_composition;
+    int allow_dxgi_flip;
     int opt_vsync_fences;
 
     char *backend;
@@ -125,6 +126,8 @@ static void draw_frame(struct vo *vo, struct vo_frame *frame)
     struct gl_priv *p = vo->priv;
     GL *gl = p->gl;
 
+    mpgl_start_frame(p->glctx);
+
     if (gl->FenceSync && p->num_vsync_fences < p->opt_vsync_fences) {
         GLsync fence = gl->FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);;
         if (fence)
@@ -216,6 +219,11 @@ static void call_request_hwdec_api(void *ctx, enum hwdec_type type)
     vo_control(ctx, VOCTRL_LOAD_HWDEC_API, (void *)(intptr_t)type);
 }
 
+static void call_redraw(void *ctx)
+{
+    vo_redraw(ctx);
+}
+
 static void get_and_update_icc_profile(struct gl_priv *p)
 {
     if (gl_video_icc_auto_enabled(p->renderer)) {
@@ -335,6 +343,15 @@ static int control(struct vo *vo, uint32_t request, void *data)
     case VOCTRL_PERFORMANCE_DATA:
         *(struct voctrl_performance_data *)data = gl_video_perfdata(p->renderer);
         return true;
+    case VOCTRL_PASS_PERFORMANCE_DATA:
+        gl_video_pass_perfdata(p->renderer, data);
+        return true;
+    case VOCTRL_GET_IMAGE: {
+        struct voctrl_get_image *args = data;
+        args->res = gl_video_get_image(p->renderer, args->imgfmt, args->w,
+                                       args->h, args->stride_align);
+        return true;
+    }
     }
 
     int events = 0;
@@ -413,6 +430,9 @@ static int preinit(struct vo *vo)
     if (p->allow_direct_composition)
         vo_flags |= VOFLAG_ANGLE_DCOMP;
 
+    if (p->allow_dxgi_flip)
+        vo_flags |= VOFLAG_ANGLE_FLIP;
+
     p->glctx = mpgl_init(vo, p->backend, vo_flags);
     if (!p->glctx)
         goto err_out;
@@ -432,6 +452,7 @@ static int preinit(struct vo *vo)
     gl_video_set_osd_source(p->renderer, vo->osd);
     gl_video_set_options(p->renderer, p->renderer_opts);
     gl_video_configure_queue(p->renderer, vo);
+    gl_video_set_redraw_cb(p->renderer, call_redraw, vo);
 
     get_and_update_icc_profile(p);
 
@@ -465,6 +486,7 @@ static const struct m_option options[] = {
     OPT_CHOICE("dwmflush", dwm_flush, 0,
                ({"no", -1}, {"auto", 0}, {"windowed", 1}, {"yes", 2})),
     OPT_FLAG("dcomposition", allow_direct_composition, 0, OPTDEF_INT(1)),
+    OPT_FLAG("dxgi-flip", allow_dxgi_flip, 0, OPTDEF_INT(1)),
     OPT_FLAG("debug", use_gl_debug, 0),
     OPT_STRING_VALIDATE("backend", backend, 0, mpgl_validate_backend_opt),
     OPT_FLAG("sw", allow_sw, 0),
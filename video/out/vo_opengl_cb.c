@@ -53,6 +53,7 @@ struct vo_priv {
 
     // Immutable after VO init
     int use_gl_debug;
+    int use_async;
     struct gl_video_opts *renderer_opts;
 };
 
@@ -88,6 +89,7 @@ struct mpv_opengl_cb_context {
     struct mp_csp_equalizer eq;
     struct vo *active;
     int hwdec_api;
+    bool async;                     // VO doesn't wait for the host (see flip_page)
 
     // --- This is only mutable while initialized=false, during which nothing
     //     except the OpenGL context manager is allowed to access it.
@@ -322,6 +324,10 @@ int mpv_opengl_cb_draw(mpv_opengl_cb_context *ctx, int fbo, int vp_w, int vp_h)
     if (!frame)
         frame = &dummy;
 
+    // In async mode, the VO thread never waits for present_count.
+    if (ctx->async)
+        wait_present_count = 0;
+
     pthread_mutex_unlock(&ctx->lock);
 
     MP_STATS(ctx, "glcb-render");
@@ -364,6 +370,12 @@ static void draw_frame(struct vo *vo, struct vo_frame *frame)
     struct vo_priv *p = vo->priv;
 
     pthread_mutex_lock(&p->ctx->lock);
+    if (p->ctx->async && p->ctx->next_frame) {
+        // The host didn't render the previous frame in time; replace it.
+        talloc_free(p->ctx->next_frame);
+        p->ctx->next_frame = NULL;
+        vo_increment_drop_count(vo, 1);
+    }
     assert(!p->ctx->next_frame);
     p->ctx->next_frame = vo_frame_ref(frame);
     p->ctx->expected_flip_count = p->ctx->flip_count + 1;
@@ -379,6 +391,15 @@ static void flip_page(struct vo *vo)
 
     pthread_mutex_lock(&p->ctx->lock);
 
+    if (p->ctx->async) {
+        // The frame stays queued until the host renders it (or the next
+        // draw_frame() replaces it), so there is nothing to wait for.
+        p->ctx->present_count += 1;
+        pthread_cond_signal(&p->ctx->wakeup);
+        pthread_mutex_unlock(&p->ctx->lock);
+        return;
+    }
+
     // Wait until frame was rendered
     while (p->ctx->next_frame) {
         if (pthread_cond_timedwait(&p->ctx->wakeup, &p->ctx->lock, &ts)) {
@@ -540,6 +561,9 @@ static void uninit(struct vo *vo)
     p->ctx->img_params = (struct mp_image_params){0};
     p->ctx->reconfigured = true;
     p->ctx->active = NULL;
+    talloc_free(p->ctx->next_frame);
+    p->ctx->next_frame = NULL;
+    p->ctx->async = false;
     update(p);
     pthread_mutex_unlock(&p->ctx->lock);
 }
@@ -561,6 +585,7 @@ static int preinit(struct vo *vo)
         return -1;
     }
     p->ctx->active = vo;
+    p->ctx->async = p->use_async;
     p->ctx->reconfigured = true;
     p->ctx->update_new_opts = true;
     copy_vo_opts(vo);
@@ -576,6 +601,7 @@ static int preinit(struct vo *vo)
 #define OPT_BASE_STRUCT struct vo_priv
 static const struct m_option options[] = {
     OPT_FLAG("debug", use_gl_debug, 0),
+    OPT_FLAG("async", use_async, 0),
     OPT_SUBSTRUCT("", renderer_opts, gl_video_conf, 0),
     {0},
 };
@@ -28,6 +28,8 @@
 #include <interface/mmal/util/mmal_default_components.h>
 #include <interface/mmal/vc/mmal_vc_api.h>
 
+#include <libavutil/buffer.h>
+#include <libavutil/mem.h>
 #include <libavutil/rational.h>
 
 #include "common/common.h"
@@ -67,6 +69,8 @@ struct priv {
 
     // for RAM input
     MMAL_POOL_T *swpool;
+    // Buffer headers without payload, for sending directly rendered frames.
+    MMAL_POOL_T *hdrpool;
 
     pthread_mutex_t display_mutex;
     pthread_cond_t display_cond;
@@ -89,30 +93,38 @@ struct priv {
 
 static void recreate_renderer(struct vo *vo);
 
-// Make mpi point to buffer, assuming MMAL_ENCODING_I420.
-// buffer can be NULL.
+// Compute the plane offsets and strides of a MMAL_ENCODING_I420 buffer.
 // Return the required buffer space.
-static size_t layout_buffer(struct mp_image *mpi, MMAL_BUFFER_HEADER_T *buffer,
-                            struct mp_image_params *params)
+static size_t i420_layout(struct mp_image_params *params, size_t offset[3],
+                          int stride[3])
 {
     assert(params->imgfmt == IMGFMT_420P);
-    mp_image_set_params(mpi, params);
     int w = MP_ALIGN_UP(params->w, ALIGN_W);
     int h = MP_ALIGN_UP(params->h, ALIGN_H);
-    uint8_t *cur = buffer ? buffer->data : NULL;
     size_t size = 0;
     for (int i = 0; i < 3; i++) {
         int div = i ? 2 : 1;
-        mpi->planes[i] = cur;
-        mpi->stride[i] = w / div;
-        size_t plane_size = h / div * mpi->stride[i];
-        if (cur)
-            cur += plane_size;
-        size += plane_size;
+        offset[i] = size;
+        stride[i] = w / div;
+        size += h / div * stride[i];
     }
     return size;
 }
 
+// Make mpi point to buffer, assuming MMAL_ENCODING_I420.
+// buffer can be NULL.
+// Return the required buffer space.
+static size_t layout_buffer(struct mp_image *mpi, MMAL_BUFFER_HEADER_T *buffer,
+                            struct mp_image_params *params)
+{
+    mp_image_set_params(mpi, params);
+    size_t offset[3];
+    size_t size = i420_layout(params, offset, mpi->stride);
+    for (int i = 0; i < 3; i++)
+        mpi->planes[i] = buffer ? buffer->data + offset[i] : NULL;
+    return size;
+}
+
 #define GLSL(x) gl_sc_add(p->sc, #x "\n");
 #define GLSLF(...) gl_sc_addf(p->sc, __VA_ARGS__)
 
@@ -411,6 +423,92 @@ static void free_mmal_buffer(void *arg)
     mmal_buffer_header_release(buffer);
 }
 
+struct dr_frame {
+    MMAL_BUFFER_HEADER_T *buffer;
+    struct mp_image *image;
+};
+
+static void free_dr_frame(void *arg)
+{
+    struct dr_frame *f = arg;
+    mmal_buffer_header_release(f->buffer);
+    talloc_free(f->image);
+    talloc_free(f);
+}
+
+static void free_dr_buffer(void *opaque, uint8_t *data)
+{
+    av_free(data);
+}
+
+// Allocate an image with the memory layout of a MMAL I420 buffer, so that the
+// decoder can write into it, and draw_frame() can send it without a copy.
+static struct mp_image *get_image(struct vo *vo, int imgfmt, int w, int h,
+                                  int stride_align)
+{
+    struct priv *p = vo->priv;
+
+    if (imgfmt != IMGFMT_420P || !p->hdrpool || !vo->params ||
+        vo->params->imgfmt != IMGFMT_420P)
+        return NULL;
+
+    size_t offset[3];
+    int stride[3];
+    size_t size = i420_layout(vo->params, offset, stride);
+    // libavcodec adds 2 lines to the height of H.264 frames, because some
+    // chroma MC functions read (but never write) one line too much. Reading
+    // into the next plane is harmless, and the last plane has slack space.
+    if (w > stride[0] || h > MP_ALIGN_UP(vo->params->h, ALIGN_H) + 2)
+        return NULL;
+    for (int n = 0; n < 3; n++) {
+        if (stride[n] % stride_align)
+            return NULL;
+    }
+
+    int alloc_size = mp_image_get_alloc_size(imgfmt, w, h, stride_align);
+    if (alloc_size < 0)
+        return NULL;
+    alloc_size = MPMAX(alloc_size, (int)(size + stride[0] * 2));
+    uint8_t *data = av_malloc(alloc_size);
+    if (!data)
+        return NULL;
+
+    struct mp_image *mpi = mp_image_from_buffer(imgfmt, w, h, stride_align,
+                                                data, alloc_size, p,
+                                                free_dr_buffer);
+    if (!mpi)
+        return NULL;
+
+    for (int n = 0; n < 3; n++) {
+        mpi->planes[n] = data + offset[n];
+        mpi->stride[n] = stride[n];
+    }
+    return mpi;
+}
+
+// Return whether mpi was allocated by get_image() for the current format.
+static bool is_dr_image(struct vo *vo, struct mp_image *mpi)
+{
+    struct priv *p = vo->priv;
+
+    if (!p->hdrpool || mpi->imgfmt != IMGFMT_420P || !mpi->bufs[0] ||
+        av_buffer_get_opaque(mpi->bufs[0]) != p ||
+        vo->params->imgfmt != IMGFMT_420P)
+        return false;
+
+    size_t offset[3];
+    int stride[3];
+    size_t size = i420_layout(vo->params, offset, stride);
+    uint8_t *data = mpi->bufs[0]->data;
+    if (mpi->bufs[0]->size < size)
+        return false;
+    for (int n = 0; n < 3; n++) {
+        if (mpi->planes[n] != data + offset[n] || mpi->stride[n] != stride[n])
+            return false;
+    }
+    return true;
+}
+
 static void draw_frame(struct vo *vo, struct vo_frame *frame)
 {
     struct priv *p = vo->priv;
@@ -437,7 +535,33 @@ static void draw_frame(struct vo *vo, struct vo_frame *frame)
 
     p->display_synced = frame->display_synced;
 
-    if (mpi && mpi->imgfmt != IMGFMT_MMAL) {
+    if (mpi && is_dr_image(vo, mpi)) {
+        MMAL_BUFFER_HEADER_T *buffer = mmal_queue_wait(p->hdrpool->queue);
+        struct dr_frame *f = talloc_ptrtype(NULL, f);
+        struct mp_image *new_ref = NULL;
+        if (buffer && f) {
+            *f = (struct dr_frame){buffer, mpi};
+            new_ref = mp_image_new_custom_ref(NULL, f, free_dr_frame);
+        }
+        if (!new_ref) {
+            if (buffer)
+                mmal_buffer_header_release(buffer);
+            talloc_free(f);
+            talloc_free(mpi);
+            MP_ERR(vo, "Out of memory.\n");
+            return;
+        }
+        mmal_buffer_header_reset(buffer);
+        buffer->data = mpi->bufs[0]->data;
+        buffer->alloc_size = mpi->bufs[0]->size;
+        size_t offset[3];
+        int stride[3];
+        buffer->length = i420_layout(vo->params, offset, stride);
+
+        mp_image_setfmt(new_ref, IMGFMT_MMAL);
+        new_ref->planes[3] = (void *)buffer;
+        mpi = new_ref;
+    } else if (mpi && mpi->imgfmt != IMGFMT_MMAL) {
         MMAL_BUFFER_HEADER_T *buffer = mmal_queue_wait(p->swpool->queue);
         if (!buffer) {
             talloc_free(mpi);
@@ -510,6 +634,8 @@ static void disable_renderer(struct vo *vo)
     }
     mmal_pool_destroy(p->swpool);
     p->swpool = NULL;
+    mmal_pool_destroy(p->hdrpool);
+    p->hdrpool = NULL;
     p->renderer_enabled = false;
 }
 
@@ -547,7 +673,8 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
         }
 
         p->swpool = mmal_pool_create(input->buffer_num, input->buffer_size);
-        if (!p->swpool) {
+        p->hdrpool = mmal_pool_create(input->buffer_num, 0);
+        if (!p->swpool || !p->hdrpool) {
             MP_FATAL(vo, "Could not allocate buffer pool.\n");
             return -1;
         }
@@ -642,6 +769,12 @@ static int control(struct vo *vo, uint32_t request, void *data)
     case VOCTRL_GET_DISPLAY_FPS:
         *(double *)data = p->display_fps;
         return VO_TRUE;
+    case VOCTRL_GET_IMAGE: {
+        struct voctrl_get_image *args = data;
+        args->res = get_image(vo, args->imgfmt, args->w, args->h,
+                              args->stride_align);
+        return VO_TRUE;
+    }
     }
 
     return VO_NOTIMPL;
@@ -0,0 +1,499 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include <libswscale/swscale.h>
+
+#include "mpv_talloc.h"
+#include "common/common.h"
+#include "common/msg.h"
+#include "common/global.h"
+#include "misc/bstr.h"
+#include "options/options.h"
+#include "aspect.h"
+#include "vo.h"
+#include "video/mp_image.h"
+#include "video/fmt-conversion.h"
+#include "video/sws_utils.h"
+#include "sub/osd.h"
+#include "osdep/timer.h"
+
+#include "player/client.h"
+
+#include "libmpv/sw_cb.h"
+
+/*
+ * Software rendering into buffers owned by the libmpv user. This works like
+ * vo_opengl_cb.c (see there for the locking hierarchy), except that the
+ * "renderer" is libswscale plus the draw_bmp.c OSD blender, and both run on
+ * the thread calling mpv_sw_cb_draw().
+ */
+
+struct vo_priv {
+    struct vo *vo;
+    struct mpv_sw_cb_context *ctx;
+};
+
+struct mpv_sw_cb_context {
+    struct mp_log *log;
+    struct mpv_global *global;
+    struct mp_client_api *client_api;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+
+    // --- Protected by lock
+    bool initialized;
+    mpv_sw_cb_update_fn update_cb;
+    void *update_cb_ctx;
+    struct vo_frame *next_frame;    // next frame to draw
+    int64_t present_count;          // incremented when next frame can be shown
+    int64_t expected_flip_count;    // next vsync event for next_frame
+    bool redrawing;                 // next_frame was a redraw request
+    int64_t flip_count;
+    struct vo_frame *cur_frame;
+    struct mp_image_params img_params;
+    bool reconfigured;
+    bool force_update;
+    struct mp_vo_opts vo_opts;
+    struct mp_sws_context *new_sws; // set up by the VO, taken by the renderer
+    struct osd_state *osd;
+    struct vo *active;
+
+    // --- Only accessed by the thread calling mpv_sw_cb_draw().
+    struct mp_sws_context *sws;
+    struct mp_image_params dst_params;
+    struct mp_rect src, dst;
+    struct mp_osd_res osd_res;
+};
+
+static void forget_frames(struct mpv_sw_cb_context *ctx, bool all)
+{
+    pthread_cond_broadcast(&ctx->wakeup);
+    if (all) {
+        talloc_free(ctx->cur_frame);
+        ctx->cur_frame = NULL;
+    }
+}
+
+static void free_ctx(void *ptr)
+{
+    mpv_sw_cb_context *ctx = ptr;
+
+    // This can trigger if the client API user doesn't call
+    // mpv_sw_cb_uninit() properly.
+    assert(!ctx->initialized);
+
+    talloc_free(ctx->new_sws);
+    talloc_free(ctx->sws);
+    pthread_cond_destroy(&ctx->wakeup);
+    pthread_mutex_destroy(&ctx->lock);
+}
+
+struct mpv_sw_cb_context *mp_sw_cb_create(struct mpv_global *g,
+                                          struct mp_client_api *client_api)
+{
+    mpv_sw_cb_context *ctx = talloc_zero(NULL, mpv_sw_cb_context);
+    talloc_set_destructor(ctx, free_ctx);
+    pthread_mutex_init(&ctx->lock, NULL);
+    pthread_cond_init(&ctx->wakeup, NULL);
+
+    ctx->global = g;
+    ctx->log = mp_log_new(ctx, g->log, "sw-cb");
+    ctx->client_api = client_api;
+
+    return ctx;
+}
+
+// Called locked.
+static void update(struct mpv_sw_cb_context *ctx)
+{
+    if (ctx->update_cb)
+        ctx->update_cb(ctx->update_cb_ctx);
+}
+
+// To be called from VO thread, with p->ctx->lock held.
+static void copy_vo_opts(struct vo *vo)
+{
+    struct vo_priv *p = vo->priv;
+
+    // None of the options we need use dynamic data (see vo_opengl_cb.c).
+    struct mp_vo_opts opts = *vo->opts;
+    opts.video_driver_list = opts.vo_defs = NULL;
+    opts.winname = NULL;
+    opts.sws_opts = NULL;
+    p->ctx->vo_opts = opts;
+}
+
+// To be called from VO thread, with p->ctx->lock held. The scaler options
+// can't be read from the API user's thread, so set up a new context here.
+static void update_sws(struct vo *vo)
+{
+    struct vo_priv *p = vo->priv;
+
+    talloc_free(p->ctx->new_sws);
+    p->ctx->new_sws = mp_sws_alloc(NULL);
+    p->ctx->new_sws->log = p->ctx->log;
+    mp_sws_set_from_cmdline(p->ctx->new_sws, vo->opts->sws_opts);
+}
+
+void mpv_sw_cb_set_update_callback(struct mpv_sw_cb_context *ctx,
+                                   mpv_sw_cb_update_fn callback,
+                                   void *callback_ctx)
+{
+    pthread_mutex_lock(&ctx->lock);
+    ctx->update_cb = callback;
+    ctx->update_cb_ctx = callback_ctx;
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+int mpv_sw_cb_init(struct mpv_sw_cb_context *ctx)
+{
+    pthread_mutex_lock(&ctx->lock);
+    bool was_init = ctx->initialized;
+    ctx->initialized = true;
+    pthread_mutex_unlock(&ctx->lock);
+    return was_init ? MPV_ERROR_INVALID_PARAMETER : 0;
+}
+
+int mpv_sw_cb_uninit(struct mpv_sw_cb_context *ctx)
+{
+    pthread_mutex_lock(&ctx->lock);
+    forget_frames(ctx, true);
+    ctx->initialized = false;
+    pthread_mutex_unlock(&ctx->lock);
+
+    kill_video(ctx->client_api);
+
+    pthread_mutex_lock(&ctx->lock);
+    assert(!ctx->active);
+    pthread_mutex_unlock(&ctx->lock);
+
+    talloc_free(ctx->sws);
+    ctx->sws = NULL;
+    ctx->dst_params = (struct mp_image_params){0};
+    return 0;
+}
+
+// Wrap the user's buffer into an mp_image. Returns false if the format or the
+// buffer dimensions are not usable.
+static bool wrap_buffer(struct mpv_sw_cb_context *ctx, struct mp_image *img,
+                        const char *format, int w, int h, size_t stride,
+                        void *pixels)
+{
+    int imgfmt = format ? mp_imgfmt_from_name(bstr0(format), false) : 0;
+    struct mp_imgfmt_desc desc = mp_imgfmt_get_desc(imgfmt);
+    if (!imgfmt || desc.num_planes != 1 || !(desc.flags & MP_IMGFLAG_RGB) ||
+        !(desc.flags & MP_IMGFLAG_BYTE_ALIGNED) ||
+        !mp_sws_supported_format(imgfmt))
+    {
+        MP_ERR(ctx, "Unsupported target format '%s'.\n", format ? format : "");
+        return false;
+    }
+    if (w < 1 || h < 1 || !pixels || stride > INT_MAX ||
+        stride < (size_t)w * desc.bytes[0])
+    {
+        MP_ERR(ctx, "Invalid target buffer.\n");
+        return false;
+    }
+
+    if (ctx->dst_params.imgfmt != imgfmt || ctx->dst_params.w != w ||
+        ctx->dst_params.h != h)
+    {
+        ctx->dst_params = (struct mp_image_params){
+            .imgfmt = imgfmt,
+            .w = w, .h = h,
+            .p_w = 1, .p_h = 1,
+        };
+        mp_image_params_guess_csp(&ctx->dst_params);
+    }
+
+    *img = (struct mp_image){0};
+    mp_image_set_params(img, &ctx->dst_params);
+    img->planes[0] = pixels;
+    img->stride[0] = stride;
+    return true;
+}
+
+static void clear_borders(struct mp_image *img, struct mp_rect dst)
+{
+    mp_image_clear(img, 0, 0, img->w, dst.y0);
+    mp_image_clear(img, 0, dst.y1, img->w, img->h);
+    mp_image_clear(img, 0, dst.y0, dst.x0, dst.y1);
+    mp_image_clear(img, dst.x1, dst.y0, img->w, dst.y1);
+}
+
+int mpv_sw_cb_draw(mpv_sw_cb_context *ctx, const char *format, int w, int h,
+                   size_t stride, void *pixels)
+{
+    struct mp_image img;
+    if (!wrap_buffer(ctx, &img, format, w, h, stride, pixels))
+        return MPV_ERROR_INVALID_PARAMETER;
+
+    pthread_mutex_lock(&ctx->lock);
+
+    struct vo *vo = ctx->active;
+    struct osd_state *osd = ctx->osd;
+
+    if (ctx->new_sws) {
+        talloc_free(ctx->sws);
+        ctx->sws = ctx->new_sws;
+        ctx->new_sws = NULL;
+    }
+
+    if (ctx->reconfigured || ctx->osd_res.w != w || ctx->osd_res.h != h)
+        ctx->force_update = true;
+
+    if (ctx->force_update && vo) {
+        ctx->force_update = false;
+        mp_get_src_dst_rects(ctx->log, &ctx->vo_opts, vo->driver->caps,
+                             &ctx->img_params, w, h, 1.0,
+                             &ctx->src, &ctx->dst, &ctx->osd_res);
+    }
+    ctx->reconfigured = false;
+
+    struct vo_frame *frame = ctx->next_frame;
+    int64_t wait_present_count = ctx->present_count;
+    if (frame) {
+        ctx->next_frame = NULL;
+        wait_present_count += 1;
+        pthread_cond_signal(&ctx->wakeup);
+        talloc_free(ctx->cur_frame);
+        ctx->cur_frame = vo_frame_ref(frame);
+    } else {
+        frame = vo_frame_ref(ctx->cur_frame);
+        MP_STATS(ctx, "swcb-noframe");
+    }
+
+    pthread_mutex_unlock(&ctx->lock);
+
+    MP_STATS(ctx, "swcb-render");
+
+    struct mp_image *mpi = frame ? frame->current : NULL;
+    struct mp_rect dst = ctx->dst;
+    dst.x0 = MP_ALIGN_DOWN(dst.x0, img.fmt.align_x);
+    dst.y0 = MP_ALIGN_DOWN(dst.y0, img.fmt.align_y);
+    if (mpi && ctx->sws && mp_rect_intersection(&dst,
+                               &(struct mp_rect){0, 0, img.w, img.h}))
+    {
+        clear_borders(&img, dst);
+
+        struct mp_image src = *mpi;
+        struct mp_rect src_rc = ctx->src;
+        src_rc.x0 = MP_ALIGN_DOWN(src_rc.x0, src.fmt.align_x);
+        src_rc.y0 = MP_ALIGN_DOWN(src_rc.y0, src.fmt.align_y);
+        mp_image_crop_rc(&src, src_rc);
+
+        struct mp_image dst_img = img;
+        mp_image_crop_rc(&dst_img, dst);
+        mp_sws_scale(ctx->sws, &dst_img, &src);
+    } else {
+        mp_image_clear(&img, 0, 0, img.w, img.h);
+    }
+
+    if (osd && ctx->osd_res.w == w && ctx->osd_res.h == h)
+        osd_draw_on_image(osd, ctx->osd_res, mpi ? mpi->pts : 0, 0, &img);
+
+    talloc_free(frame);
+
+    pthread_mutex_lock(&ctx->lock);
+    while (wait_present_count > ctx->present_count)
+        pthread_cond_wait(&ctx->wakeup, &ctx->lock);
+    pthread_mutex_unlock(&ctx->lock);
+
+    return 0;
+}
+
+int mpv_sw_cb_report_flip(mpv_sw_cb_context *ctx, int64_t time)
+{
+    MP_STATS(ctx, "swcb-reportflip");
+
+    pthread_mutex_lock(&ctx->lock);
+    ctx->flip_count += 1;
+    pthread_cond_signal(&ctx->wakeup);
+    pthread_mutex_unlock(&ctx->lock);
+
+    return 0;
+}
+
+static void draw_frame(struct vo *vo, struct vo_frame *frame)
+{
+    struct vo_priv *p = vo->priv;
+
+    pthread_mutex_lock(&p->ctx->lock);
+    assert(!p->ctx->next_frame);
+    p->ctx->next_frame = vo_frame_ref(frame);
+    p->ctx->expected_flip_count = p->ctx->flip_count + 1;
+    p->ctx->redrawing = frame->redraw || !frame->current;
+    update(p->ctx);
+    pthread_mutex_unlock(&p->ctx->lock);
+}
+
+static void flip_page(struct vo *vo)
+{
+    struct vo_priv *p = vo->priv;
+    struct timespec ts = mp_rel_time_to_timespec(0.2);
+
+    pthread_mutex_lock(&p->ctx->lock);
+
+    // Wait until frame was rendered
+    while (p->ctx->next_frame) {
+        if (pthread_cond_timedwait(&p->ctx->wakeup, &p->ctx->lock, &ts)) {
+            MP_VERBOSE(vo, "mpv_sw_cb_draw() not being called or stuck.\n");
+            goto done;
+        }
+    }
+
+    // Unblock mpv_sw_cb_draw().
+    p->ctx->present_count += 1;
+    pthread_cond_signal(&p->ctx->wakeup);
+
+    if (p->ctx->redrawing)
+        goto done; // do not block for redrawing
+
+    // Wait until frame was presented
+    while (p->ctx->expected_flip_count > p->ctx->flip_count) {
+        // mpv_sw_cb_report_flip() is optional, as with opengl_cb.
+        if (!p->ctx->flip_count)
+            break;
+        if (pthread_cond_timedwait(&p->ctx->wakeup, &p->ctx->lock, &ts)) {
+            MP_VERBOSE(vo, "mpv_sw_cb_report_flip() not being called.\n");
+            goto done;
+        }
+    }
+
+done:
+
+    // Cleanup after the API user is not reacting, or is being unusually slow.
+    if (p->ctx->next_frame) {
+        talloc_free(p->ctx->next_frame);
+        p->ctx->next_frame = NULL;
+        p->ctx->present_count += 2;
+        pthread_cond_signal(&p->ctx->wakeup);
+        vo_increment_drop_count(vo, 1);
+    }
+
+    pthread_mutex_unlock(&p->ctx->lock);
+}
+
+static int query_format(struct vo *vo, int format)
+{
+    return sws_isSupportedInput(imgfmt2pixfmt(format));
+}
+
+static int reconfig(struct vo *vo, struct mp_image_params *params)
+{
+    struct vo_priv *p = vo->priv;
+
+    pthread_mutex_lock(&p->ctx->lock);
+    forget_frames(p->ctx, true);
+    p->ctx->img_params = *params;
+    p->ctx->reconfigured = true;
+    update_sws(vo);
+    pthread_mutex_unlock(&p->ctx->lock);
+
+    return 0;
+}
+
+static int control(struct vo *vo, uint32_t request, void *data)
+{
+    struct vo_priv *p = vo->priv;
+
+    switch (request) {
+    case VOCTRL_RESET:
+        pthread_mutex_lock(&p->ctx->lock);
+        forget_frames(p->ctx, false);
+        pthread_mutex_unlock(&p->ctx->lock);
+        return VO_TRUE;
+    case VOCTRL_PAUSE:
+        vo->want_redraw = true;
+        vo_wakeup(vo);
+        return VO_TRUE;
+    case VOCTRL_GET_PANSCAN:
+        return VO_TRUE;
+    case VOCTRL_SET_PANSCAN:
+        pthread_mutex_lock(&p->ctx->lock);
+        copy_vo_opts(vo);
+        p->ctx->force_update = true;
+        update(p->ctx);
+        pthread_mutex_unlock(&p->ctx->lock);
+        return VO_TRUE;
+    }
+
+    return VO_NOTIMPL;
+}
+
+static void uninit(struct vo *vo)
+{
+    struct vo_priv *p = vo->priv;
+
+    pthread_mutex_lock(&p->ctx->lock);
+    forget_frames(p->ctx, true);
+    p->ctx->img_params = (struct mp_image_params){0};
+    p->ctx->reconfigured = true;
+    p->ctx->active = NULL;
+    p->ctx->osd = NULL;
+    talloc_free(p->ctx->next_frame);
+    p->ctx->next_frame = NULL;
+    update(p->ctx);
+    pthread_mutex_unlock(&p->ctx->lock);
+}
+
+static int preinit(struct vo *vo)
+{
+    struct vo_priv *p = vo->priv;
+    p->vo = vo;
+    p->ctx = vo->extra.sw_cb_context;
+    if (!p->ctx) {
+        MP_FATAL(vo, "No context set.\n");
+        return -1;
+    }
+
+    pthread_mutex_lock(&p->ctx->lock);
+    if (!p->ctx->initialized) {
+        MP_FATAL(vo, "Software renderer not initialized.\n");
+        pthread_mutex_unlock(&p->ctx->lock);
+        return -1;
+    }
+    p->ctx->active = vo;
+    p->ctx->osd = vo->osd;
+    p->ctx->reconfigured = true;
+    copy_vo_opts(vo);
+    update_sws(vo);
+    pthread_mutex_unlock(&p->ctx->lock);
+
+    return 0;
+}
+
+const struct vo_driver video_out_sw_cb = {
+    .description = "Software rendering callbacks for libmpv",
+    .name = "sw-cb",
+    .preinit = preinit,
+    .query_format = query_format,
+    .reconfig = reconfig,
+    .control = control,
+    .draw_frame = draw_frame,
+    .flip_page = flip_page,
+    .uninit = uninit,
+    .priv_size = sizeof(struct vo_priv),
+};
@@ -27,6 +27,7 @@
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <va/va_x11.h>
+#include <va/va_vpp.h>
 
 #include "config.h"
 #include "common/msg.h"
@@ -81,6 +82,13 @@ struct priv {
     int                      visible_surface;
     int                      scaling;
     int                      force_scaled_osd;
+    int                      use_vpp;
+
+    // Video processing pipeline for scaling (if use_vpp is enabled).
+    VAConfigID               vpp_config;
+    VAContextID              vpp_context;
+    struct mp_image_pool    *vpp_pool;
+    struct mp_image         *vpp_surfaces[MAX_OUTPUT_SURFACES];
 
     VAImageFormat            osd_format; // corresponds to OSD_VA_FORMAT
     struct vaapi_osd_part    osd_parts[MAX_OSD_PARTS];
@@ -110,8 +118,10 @@ static void draw_osd(struct vo *vo);
 
 static void flush_output_surfaces(struct priv *p)
 {
-    for (int n = 0; n < MAX_OUTPUT_SURFACES; n++)
+    for (int n = 0; n < MAX_OUTPUT_SURFACES; n++) {
         mp_image_unrefp(&p->output_surfaces[n]);
+        mp_image_unrefp(&p->vpp_surfaces[n]);
+    }
     p->output_surface = 0;
     p->visible_surface = 0;
 }
@@ -128,6 +138,107 @@ static void free_video_specific(struct priv *p)
 
     if (p->pool)
         mp_image_pool_clear(p->pool);
+    if (p->vpp_pool)
+        mp_image_pool_clear(p->vpp_pool);
+}
+
+static void vpp_uninit(struct priv *p)
+{
+    for (int n = 0; n < MAX_OUTPUT_SURFACES; n++)
+        mp_image_unrefp(&p->vpp_surfaces[n]);
+    talloc_free(p->vpp_pool);
+    p->vpp_pool = NULL;
+    if (p->vpp_context != VA_INVALID_ID)
+        vaDestroyContext(p->display, p->vpp_context);
+    if (p->vpp_config != VA_INVALID_ID)
+        vaDestroyConfig(p->display, p->vpp_config);
+    p->vpp_context = VA_INVALID_ID;
+    p->vpp_config = VA_INVALID_ID;
+}
+
+static bool vpp_init(struct priv *p)
+{
+    VAStatus status;
+
+    status = vaCreateConfig(p->display, VAProfileNone, VAEntrypointVideoProc,
+                            NULL, 0, &p->vpp_config);
+    if (!CHECK_VA_STATUS(p, "vaCreateConfig()")) {
+        p->vpp_config = VA_INVALID_ID;
+        goto error;
+    }
+
+    status = vaCreateContext(p->display, p->vpp_config, 0, 0, 0, NULL, 0,
+                             &p->vpp_context);
+    if (!CHECK_VA_STATUS(p, "vaCreateContext()")) {
+        p->vpp_context = VA_INVALID_ID;
+        goto error;
+    }
+
+    p->vpp_pool = mp_image_pool_new(MAX_OUTPUT_SURFACES + 2);
+    va_pool_set_allocator(p->vpp_pool, p->mpvaapi, VA_RT_FORMAT_YUV420);
+    return true;
+
+error:
+    MP_WARN(p, "Video processing not available, using vaPutSurface scaling.\n");
+    vpp_uninit(p);
+    return false;
+}
+
+// Scale the video surface to the size of the video rectangle in the window.
+// The result is shown 1:1 with vaPutSurface. Must be called with the VA lock.
+static struct mp_image *vpp_render(struct priv *p, VASurfaceID surface)
+{
+    int w = p->dst_rect.x1 - p->dst_rect.x0;
+    int h = p->dst_rect.y1 - p->dst_rect.y0;
+    bool need_end_picture = false;
+    bool success = false;
+    VAStatus status;
+
+    struct mp_image *img = mp_image_pool_get(p->vpp_pool, IMGFMT_VAAPI, w, h);
+    VASurfaceID id = va_surface_id(img);
+    if (id == VA_INVALID_ID)
+        goto cleanup;
+
+    status = vaBeginPicture(p->display, p->vpp_context, id);
+    if (!CHECK_VA_STATUS(p, "vaBeginPicture()"))
+        goto cleanup;
+    need_end_picture = true;
+
+    VARectangle src = {
+        .x = p->src_rect.x0,
+        .y = p->src_rect.y0,
+        .width = p->src_rect.x1 - p->src_rect.x0,
+        .height = p->src_rect.y1 - p->src_rect.y0,
+    };
+    VARectangle dst = { .width = w, .height = h };
+    VAProcPipelineParameterBuffer param = {
+        .surface = surface,
+        .surface_region = &src,
+        .output_region = &dst,
+        .filter_flags = p->scaling | VA_FRAME_PICTURE,
+    };
+
+    VABufferID buffer;
+    status = vaCreateBuffer(p->display, p->vpp_context,
+                            VAProcPipelineParameterBufferType,
+                            sizeof(param), 1, &param, &buffer);
+    if (!CHECK_VA_STATUS(p, "vaCreateBuffer()"))
+        goto cleanup;
+
+    status = vaRenderPicture(p->display, p->vpp_context, &buffer, 1);
+    vaDestroyBuffer(p->display, buffer);
+    if (!CHECK_VA_STATUS(p, "vaRenderPicture()"))
+        goto cleanup;
+
+    success = true;
+
+cleanup:
+    if (need_end_picture)
+        vaEndPicture(p->display, p->vpp_context);
+    if (success)
+        return img;
+    talloc_free(img);
+    return NULL;
 }
 
 static bool alloc_swdec_surfaces(struct priv *p, int w, int h, int imgfmt)
@@ -207,6 +318,25 @@ static bool render_to_screen(struct priv *p, struct mp_image *mpi)
 
     va_lock(p->mpvaapi);
 
+    struct mp_rect src_rect = p->src_rect;
+    int scaling = p->scaling;
+    if (p->vpp_context != VA_INVALID_ID && p->dst_rect.x1 > p->dst_rect.x0 &&
+        p->dst_rect.y1 > p->dst_rect.y0)
+    {
+        struct mp_image *scaled = vpp_render(p, surface);
+        if (scaled) {
+            talloc_free(p->vpp_surfaces[p->visible_surface]);
+            p->vpp_surfaces[p->visible_surface] = scaled;
+            surface = va_surface_id(scaled);
+            src_rect = (struct mp_rect){0, 0, scaled->w, scaled->h};
+            scaling = 0;
+        } else {
+            MP_WARN(p, "Video processing failed, disabling it.\n");
+            vpp_uninit(p);
+            p->vo->want_redraw = true;
+        }
+    }
+
     for (int n = 0; n < MAX_OSD_PARTS; n++) {
         struct vaapi_osd_part *part = &p->osd_parts[n];
         if (part->active) {
@@ -226,14 +356,14 @@ static bool render_to_screen(struct priv *p, struct mp_image *mpi)
     }
 
     int flags = va_get_colorspace_flag(p->image_params.color.space) |
-                p->scaling | VA_FRAME_PICTURE;
+                scaling | VA_FRAME_PICTURE;
     status = vaPutSurface(p->display,
                           surface,
                           p->vo->x11->window,
-                          p->src_rect.x0,
-                          p->src_rect.y0,
-                          p->src_rect.x1 - p->src_rect.x0,
-                          p->src_rect.y1 - p->src_rect.y0,
+                          src_rect.x0,
+                          src_rect.y0,
+                          src_rect.x1 - src_rect.x0,
+                          src_rect.y1 - src_rect.y0,
                           p->dst_rect.x0,
                           p->dst_rect.y0,
                           p->dst_rect.x1 - p->dst_rect.x0,
@@ -428,9 +558,18 @@ static void draw_osd(struct vo *vo)
 
     struct mp_osd_res vid_res = osd_res_from_image_params(vo->params);
 
+    // With VPP scaling, subpictures are placed on the scaled surface.
+    struct mp_osd_res scaled_res = {
+        .w = p->dst_rect.x1 - p->dst_rect.x0,
+        .h = p->dst_rect.y1 - p->dst_rect.y0,
+        .display_par = 1,
+    };
+
     struct mp_osd_res *res;
     if (p->osd_screen) {
         res = &p->screen_osd_res;
+    } else if (p->vpp_context != VA_INVALID_ID) {
+        res = &scaled_res;
     } else {
         res = &vid_res;
     }
@@ -568,6 +707,7 @@ static void uninit(struct vo *vo)
 
     free_video_specific(p);
     talloc_free(p->pool);
+    vpp_uninit(p);
 
     for (int n = 0; n < MAX_OSD_PARTS; n++) {
         struct vaapi_osd_part *part = &p->osd_parts[n];
@@ -589,6 +729,8 @@ static int preinit(struct vo *vo)
     struct priv *p = vo->priv;
     p->vo = vo;
     p->log = vo->log;
+    p->vpp_config = VA_INVALID_ID;
+    p->vpp_context = VA_INVALID_ID;
 
     VAStatus status;
 
@@ -617,6 +759,9 @@ static int preinit(struct vo *vo)
     p->pool = mp_image_pool_new(MAX_OUTPUT_SURFACES + 3);
     va_pool_set_allocator(p->pool, p->mpvaapi, VA_RT_FORMAT_YUV420);
 
+    if (p->use_vpp)
+        vpp_init(p);
+
     int max_subpic_formats = vaMaxNumSubpictureFormats(p->display);
     p->va_subpic_formats = talloc_array(vo, VAImageFormat, max_subpic_formats);
     p->va_subpic_flags = talloc_array(vo, unsigned int, max_subpic_formats);
@@ -696,6 +841,7 @@ const struct vo_driver video_out_vaapi = {
                     {"hq", VA_FILTER_SCALING_HQ},
                     {"nla", VA_FILTER_SCALING_NL_ANAMORPHIC})),
         OPT_FLAG("scaled-osd", force_scaled_osd, 0),
+        OPT_FLAG("vpp", use_vpp, 0),
         {0}
     },
 };
@@ -45,6 +45,7 @@
 
 #include "sub/osd.h"
 #include "sub/draw_bmp.h"
+#include "sub/img_convert.h"
 
 #include "video/sws_utils.h"
 #include "video/fmt-conversion.h"
@@ -52,14 +53,17 @@
 #include "common/msg.h"
 #include "input/input.h"
 #include "options/options.h"
-#include "osdep/timer.h"
+
+// One buffer is shown, one can be in flight to the X server, and the third
+// one is rendered to.
+#define NUM_BUFFERS 3
 
 struct priv {
     struct vo *vo;
 
     struct mp_image *original_image;
 
-    XImage *myximage[2];
+    XImage *myximage[NUM_BUFFERS];
     int depth;
     GC gc;
 
@@ -77,16 +81,38 @@ struct priv {
     XVisualInfo vinfo;
 
     int current_buf;
+    // Buffer that was displayed last (-1 if none, or after a resize).
+    int last_buf;
+    // Part of the X image that needs to be sent on the next flip.
+    struct mp_rect put_rc;
+    // OSD area in last_buf, and the video pixels it covers.
+    struct mp_rect osd_rc;
+    struct mp_image *osd_bg;
 
 #if HAVE_SHM
     int Shmem_Flag;
-    XShmSegmentInfo Shminfo[2];
+    XShmSegmentInfo Shminfo[NUM_BUFFERS];
     int Shm_Warned_Slow;
 #endif
 };
 
 static bool resize(struct vo *vo);
 
+static bool rect_empty(struct mp_rect rc)
+{
+    return rc.x1 <= rc.x0 || rc.y1 <= rc.y0;
+}
+
+// Like mp_rect_union(), but empty rectangles are ignored.
+static void rect_add(struct mp_rect *bb, struct mp_rect rc)
+{
+    if (rect_empty(*bb)) {
+        *bb = rc;
+    } else if (!rect_empty(rc)) {
+        mp_rect_union(bb, &rc);
+    }
+}
+
 static bool getMyXImage(struct priv *p, int foo)
 {
     struct vo *vo = p->vo;
@@ -210,8 +236,10 @@ static bool resize(struct vo *vo)
     struct priv *p = vo->priv;
     struct vo_x11_state *x11 = vo->x11;
 
-    for (int i = 0; i < 2; i++)
+    for (int i = 0; i < NUM_BUFFERS; i++)
         freeMyXImage(p, i);
+    p->last_buf = -1;
+    p->osd_rc = (struct mp_rect){0};
 
     vo_get_src_dst_rects(vo, &p->src, &p->dst, &p->osd);
 
@@ -235,7 +263,7 @@ static bool resize(struct vo *vo)
     p->image_width = (p->dst_w + 7) & (~7);
     p->image_height = p->dst_h;
 
-    for (int i = 0; i < 2; i++) {
+    for (int i = 0; i < NUM_BUFFERS; i++) {
         if (!getMyXImage(p, i))
             return -1;
     }
@@ -268,6 +296,11 @@ static bool resize(struct vo *vo)
     if (mp_sws_reinit(p->sws) < 0)
         return false;
 
+    talloc_free(p->osd_bg);
+    p->osd_bg = mp_image_alloc(fmte->mpfmt, p->dst_w, p->dst_h);
+    if (!p->osd_bg)
+        return false;
+
     XFillRectangle(x11->display, x11->window, p->gc, 0, 0, vo->dwidth, vo->dheight);
 
     vo->want_redraw = true;
@@ -279,18 +312,23 @@ static void Display_Image(struct priv *p, XImage *myximage)
     struct vo *vo = p->vo;
 
     XImage *x_image = p->myximage[p->current_buf];
+    struct mp_rect rc = p->put_rc;
+    int w = rc.x1 - rc.x0, h = rc.y1 - rc.y0;
+
+    if (rect_empty(rc))
+        return;
 
 #if HAVE_SHM && HAVE_XEXT
     if (p->Shmem_Flag) {
         XShmPutImage(vo->x11->display, vo->x11->window, p->gc, x_image,
-                     0, 0, p->dst.x0, p->dst.y0, p->dst_w, p->dst_h,
+                     rc.x0, rc.y0, p->dst.x0 + rc.x0, p->dst.y0 + rc.y0, w, h,
                      True);
         vo->x11->ShmCompletionWaitCount++;
     } else
 #endif
     {
         XPutImage(vo->x11->display, vo->x11->window, p->gc, x_image,
-                  0, 0, p->dst.x0, p->dst.y0, p->dst_w, p->dst_h);
+                  rc.x0, rc.y0, p->dst.x0 + rc.x0, p->dst.y0 + rc.y0, w, h);
     }
 }
 
@@ -318,7 +356,7 @@ static void wait_for_completion(struct vo *vo, int max_outstanding)
                             " for XShm completion events...\n");
                 ctx->Shm_Warned_Slow = 1;
             }
-            mp_sleep_us(1000);
+            vo_x11_wait_x_event(vo, 10);
             vo_x11_check_events(vo);
         }
     }
@@ -329,7 +367,45 @@ static void flip_page(struct vo *vo)
 {
     struct priv *p = vo->priv;
     Display_Image(p, p->myximage[p->current_buf]);
-    p->current_buf = (p->current_buf + 1) % 2;
+    p->last_buf = p->current_buf;
+    p->current_buf = (p->current_buf + 1) % NUM_BUFFERS;
+}
+
+static void get_osd_bb(void *ctx, struct sub_bitmaps *imgs)
+{
+    struct mp_rect *bb = ctx;
+    struct mp_rect rc;
+    if (mp_sub_bitmaps_bb(imgs, &rc))
+        rect_add(bb, rc);
+}
+
+static void copy_rect(struct mp_image *dst, struct mp_image *src,
+                      struct mp_rect rc)
+{
+    struct mp_image d = *dst, s = *src;
+    mp_image_crop_rc(&d, rc);
+    mp_image_crop_rc(&s, rc);
+    mp_image_copy(&d, &s);
+}
+
+// Render the OSD into img, and remember the pixels it covers, so that a later
+// OSD-only redraw can restore them instead of converting the video again.
+// Returns the OSD area.
+static struct mp_rect draw_osd(struct vo *vo, struct mp_image *img, double pts)
+{
+    struct priv *p = vo->priv;
+
+    struct mp_rect bb = {0};
+    osd_draw(vo->osd, p->osd, pts, 0, mp_draw_sub_formats, get_osd_bb, &bb);
+    if (!rect_empty(bb) &&
+        mp_rect_intersection(&bb, &(struct mp_rect){0, 0, img->w, img->h}))
+    {
+        copy_rect(p->osd_bg, img, bb);
+        osd_draw_on_image(vo->osd, p->osd, pts, 0, img);
+    } else {
+        bb = (struct mp_rect){0};
+    }
+    return bb;
 }
 
 // Note: REDRAW_FRAME can call this with NULL.
@@ -337,7 +413,22 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
 {
     struct priv *p = vo->priv;
 
-    wait_for_completion(vo, 1);
+    if (mpi && mpi == p->original_image && p->last_buf >= 0) {
+        // Only the OSD changed: restore the video under the old OSD in the
+        // displayed buffer, draw the new OSD, and send only the changed area.
+        wait_for_completion(vo, 0);
+        p->current_buf = p->last_buf;
+        struct mp_image img = get_x_buffer(p, p->current_buf);
+        struct mp_rect rc = p->osd_rc;
+        if (!rect_empty(rc))
+            copy_rect(&img, p->osd_bg, rc);
+        p->osd_rc = draw_osd(vo, &img, mpi->pts);
+        rect_add(&rc, p->osd_rc);
+        p->put_rc = rc;
+        return;
+    }
+
+    wait_for_completion(vo, NUM_BUFFERS - 1);
 
     struct mp_image img = get_x_buffer(p, p->current_buf);
 
@@ -353,7 +444,8 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
         mp_image_clear(&img, 0, 0, img.w, img.h);
     }
 
-    osd_draw_on_image(vo->osd, p->osd, mpi ? mpi->pts : 0, 0, &img);
+    p->osd_rc = draw_osd(vo, &img, mpi ? mpi->pts : 0);
+    p->put_rc = (struct mp_rect){0, 0, p->dst_w, p->dst_h};
 
     if (mpi != p->original_image) {
         talloc_free(p->original_image);
@@ -371,14 +463,15 @@ static int query_format(struct vo *vo, int format)
 static void uninit(struct vo *vo)
 {
     struct priv *p = vo->priv;
-    if (p->myximage[0])
-        freeMyXImage(p, 0);
-    if (p->myximage[1])
-        freeMyXImage(p, 1);
+    for (int i = 0; i < NUM_BUFFERS; i++) {
+        if (p->myximage[i])
+            freeMyXImage(p, i);
+    }
     if (p->gc)
         XFreeGC(vo->x11->display, p->gc);
 
     talloc_free(p->original_image);
+    talloc_free(p->osd_bg);
 
     vo_x11_uninit(vo);
 }
@@ -387,6 +480,7 @@ static int preinit(struct vo *vo)
 {
     struct priv *p = vo->priv;
     p->vo = vo;
+    p->last_buf = -1;
     p->sws = mp_sws_alloc(vo);
 
     if (!vo_x11_init(vo))
@@ -53,7 +53,6 @@
 #include "video/csputils.h"
 #include "options/m_option.h"
 #include "input/input.h"
-#include "osdep/timer.h"
 
 #define CK_METHOD_NONE       0 // no colorkey drawing
 #define CK_METHOD_BACKGROUND 1 // set colorkey as window background
@@ -682,7 +681,7 @@ static void wait_for_completion(struct vo *vo, int max_outstanding)
                         " for XShm completion events...\n");
                 ctx->Shm_Warned_Slow = 1;
             }
-            mp_sleep_us(1000);
+            vo_x11_wait_x_event(vo, 10);
             vo_x11_check_events(vo);
         }
     }
@@ -721,8 +721,10 @@ static void frame_callback(void *data,
     if (wl->frame.function)
         wl->frame.function(wl->frame.data, time);
 
-    if (callback)
+    if (callback) {
         wl_callback_destroy(callback);
+        wl->frame.pending = false;
+    }
 
     wl->frame.callback = wl_surface_frame(wl->window.video_surface);
 
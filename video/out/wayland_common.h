@@ -59,6 +59,7 @@ struct vo_wayland_state {
         void *data;
         vo_wayland_frame_cb function;
         struct wl_callback *callback;
+        bool pending;       // a frame was swapped, but no callback yet
     } frame;
 
 #if HAVE_GL_WAYLAND
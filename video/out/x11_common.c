@@ -1942,6 +1942,20 @@ void vo_x11_wait_events(struct vo *vo, int64_t until_time_us)
         mp_flush_wakeup_pipe(x11->wakeup_pipe[0]);
 }
 
+// Wait until the X connection is readable (e.g. for a ShmCompletion event), or
+// the timeout expires. Unlike vo_x11_wait_events(), this doesn't consume the
+// VO wakeup pipe. Call vo_x11_check_events() afterwards to process the events.
+void vo_x11_wait_x_event(struct vo *vo, int timeout_ms)
+{
+    struct vo_x11_state *x11 = vo->x11;
+
+    if (XPending(x11->display))
+        return;
+
+    struct pollfd fd = { .fd = x11->event_fd, .events = POLLIN };
+    poll(&fd, 1, timeout_ms);
+}
+
 static void xscreensaver_heartbeat(struct vo_x11_state *x11)
 {
     double time = mp_time_sec();
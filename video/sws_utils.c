@@ -21,6 +21,7 @@
 #include <libavcodec/avcodec.h>
 #include <libavutil/bswap.h>
 #include <libavutil/opt.h>
+#include <libavutil/cpu.h>
 
 #include "config.h"
 
@@ -35,8 +36,22 @@
 #include "common/msg.h"
 #include "video/filter/vf.h"
 #include "osdep/endian.h"
+#include "misc/thread_pool.h"
 
 //global sws_flags from the command line
+#define MAX_SWS_THREADS 16
+
+// Stripes are aligned to this many lines (covers chroma subsampling and the
+// period of swscale's ordered dither matrix).
+#define STRIPE_ALIGN 16
+
+// Extra source lines converted above and below each stripe, so that vertical
+// filters (e.g. for chroma upsampling) see the same input as without stripes.
+#define STRIPE_MARGIN 16
+
+// Don't use stripes smaller than this.
+#define MIN_STRIPE_HEIGHT 64
+
 struct sws_opts {
     int scaler;
     float lum_gblur;
@@ -45,6 +60,7 @@ struct sws_opts {
     int chr_hshift;
     float chr_sharpen;
     float lum_sharpen;
+    int threads;
 };
 
 #define OPT_BASE_STRUCT struct sws_opts
@@ -68,11 +84,13 @@ const struct m_sub_options sws_conf = {
         OPT_INT("chs", chr_hshift, 0),
         OPT_FLOATRANGE("ls", lum_sharpen, 0, -100.0, 100.0),
         OPT_FLOATRANGE("cs", chr_sharpen, 0, -100.0, 100.0),
+        OPT_INTRANGE("threads", threads, 0, 0, MAX_SWS_THREADS),
         {0}
     },
     .size = sizeof(struct sws_opts),
     .defaults = &(const struct sws_opts){
         .scaler = SWS_BICUBIC,
+        .threads = 1,
     },
 };
 
@@ -95,6 +113,9 @@ void mp_sws_set_from_cmdline(struct mp_sws_context *ctx, struct sws_opts *opts)
 
     ctx->flags = SWS_PRINT_INFO;
     ctx->flags |= opts->scaler;
+
+    ctx->threads = opts->threads ? opts->threads
+                                 : MPMIN(av_cpu_count(), MAX_SWS_THREADS);
 }
 
 bool mp_sws_supported_format(int imgfmt)
@@ -250,18 +271,133 @@ int mp_sws_reinit(struct mp_sws_context *ctx)
 // Scale from src to dst - if src/dst have different parameters from previous
 // calls, the context is reinitialized. Return error code. (It can fail if
 // reinitialization was necessary, and swscale returned an error.)
+struct stripe_job {
+    struct mp_sws_context *ctx;
+    struct mp_image *dst, *src;
+    int stripe_h;
+    int err;                // set by workers (only ever to -1)
+};
+
+// Convert one stripe of the image with its own swscale context. The stripe is
+// converted with some margin into a temporary image, and only the inner part
+// is copied to the destination, so the stripe edges are seamless.
+static void scale_stripe(void *p, int index)
+{
+    struct stripe_job *job = p;
+    struct mp_sws_context *ctx = job->ctx;
+    struct mp_sws_context *w = ctx->workers[index];
+    int h = job->src->h;
+
+    int y0 = index * job->stripe_h;
+    int y1 = MPMIN(y0 + job->stripe_h, h);
+    int e0 = MPMAX(y0 - STRIPE_MARGIN, 0);
+    int e1 = MPMIN(y1 + STRIPE_MARGIN, h);
+
+    struct mp_image src = *job->src;
+    mp_image_crop(&src, 0, e0, src.w, e1);
+
+    struct mp_image_params params = job->dst->params;
+    params.h = e1 - e0;
+    struct mp_image *tmp = ctx->stripes[index];
+    if (!tmp || !mp_image_params_equal(&tmp->params, &params)) {
+        talloc_free(tmp);
+        tmp = ctx->stripes[index] =
+            talloc_steal(ctx, mp_image_alloc(params.imgfmt, params.w, params.h));
+        if (!tmp) {
+            job->err = -1;
+            return;
+        }
+        mp_image_set_params(tmp, &params);
+    }
+
+    // Copy the user configuration; the filters are only borrowed.
+    w->log = ctx->log;
+    w->flags = ctx->flags;
+    w->brightness = ctx->brightness;
+    w->contrast = ctx->contrast;
+    w->saturation = ctx->saturation;
+    w->params[0] = ctx->params[0];
+    w->params[1] = ctx->params[1];
+    w->src_filter = ctx->src_filter;
+    w->dst_filter = ctx->dst_filter;
+    w->src = src.params;
+    w->dst = tmp->params;
+    int r = mp_sws_reinit(w);
+    w->src_filter = w->dst_filter = NULL;
+    if (r < 0) {
+        job->err = -1;
+        return;
+    }
+    sws_scale(w->sws, (const uint8_t *const *) src.planes, src.stride,
+              0, src.h, tmp->planes, tmp->stride);
+
+    struct mp_image dst = *job->dst;
+    mp_image_crop(&dst, 0, y0, dst.w, y1);
+    struct mp_image inner = *tmp;
+    mp_image_crop(&inner, 0, y0 - e0, inner.w, y1 - e0);
+    mp_image_copy(&dst, &inner);
+}
+
+static bool scale_threaded(struct mp_sws_context *ctx, struct mp_image *dst,
+                           struct mp_image *src)
+{
+    int h = src->h;
+    if (ctx->threads < 2 || dst->h != h || h < MIN_STRIPE_HEIGHT * 2)
+        return false;
+
+    int num = MPMIN(ctx->threads, h / MIN_STRIPE_HEIGHT);
+    int stripe_h = MP_ALIGN_UP((h + num - 1) / num, STRIPE_ALIGN);
+    num = (h + stripe_h - 1) / stripe_h;
+    if (num < 2)
+        return false;
+
+    if (!ctx->pool || ctx->pool_threads != ctx->threads) {
+        talloc_free(ctx->pool);
+        // The calling thread converts a stripe too.
+        ctx->pool = mp_thread_pool_create(ctx, ctx->threads - 1);
+        ctx->pool_threads = ctx->threads;
+        if (!ctx->pool)
+            return false;
+    }
+    while (ctx->num_workers < num) {
+        MP_TARRAY_GROW(ctx, ctx->stripes, ctx->num_workers);
+        ctx->stripes[ctx->num_workers] = NULL;
+        MP_TARRAY_APPEND(ctx, ctx->workers, ctx->num_workers, mp_sws_alloc(ctx));
+    }
+    for (int n = 0; n < num; n++)
+        ctx->workers[n]->force_reload |= ctx->force_reload;
+
+    struct stripe_job job = {
+        .ctx = ctx,
+        .dst = dst,
+        .src = src,
+        .stripe_h = stripe_h,
+    };
+    mp_thread_pool_run(ctx->pool, scale_stripe, &job, num);
+    if (job.err < 0)
+        MP_ERR(ctx, "Threaded conversion failed.\n");
+    return job.err >= 0;
+}
+
 int mp_sws_scale(struct mp_sws_context *ctx, struct mp_image *dst,
                  struct mp_image *src)
 {
     ctx->src = src->params;
     ctx->dst = dst->params;
 
+    bool force_reload = ctx->force_reload;
     int r = mp_sws_reinit(ctx);
     if (r < 0) {
         MP_ERR(ctx, "libswscale initialization failed.\n");
         return r;
     }
 
+    ctx->force_reload = force_reload;
+    bool done = scale_threaded(ctx, dst, src);
+    ctx->force_reload = false;
+    if (done)
+        return 0;
+
     sws_scale(ctx->sws, (const uint8_t *const *) src->planes, src->stride,
               0, src->h, dst->planes, dst->stride);
     return 0;
@@ -31,6 +31,9 @@ struct mp_sws_context {
     // mp_sws_scale() will handle the changes transparently.
     int flags;
     int brightness, contrast, saturation;
+    // If >1, conversions which don't scale vertically are split into this
+    // many horizontal stripes, which are converted in parallel.
+    int threads;
     bool force_reload;
     // These are also implicitly set by mp_sws_scale(), and thus optional.
     // Setting them before that call makes sense when using mp_sws_reinit().
@@ -48,6 +51,13 @@ struct mp_sws_context {
 
     // Contains parameters for which sws is valid
     struct mp_sws_context *cached;
+
+    // For threads > 1 (internal).
+    struct mp_thread_pool *pool;
+    int pool_threads;
+    struct mp_sws_context **workers;
+    struct mp_image **stripes;
+    int num_workers;
 };
 
 struct mp_sws_context *mp_sws_alloc(void *talloc_ctx);
@@ -151,6 +151,10 @@ error:
 void va_destroy(struct mp_vaapi_ctx *ctx)
 {
     if (ctx) {
+        // Surfaces must be destroyed before the display.
+        for (int n = 0; n < ctx->num_cached_pools; n++)
+            talloc_free(ctx->cached_pools[n].pool);
+        ctx->num_cached_pools = 0;
         if (ctx->display)
             vaTerminate(ctx->display);
         pthread_mutex_destroy(&ctx->lock);
@@ -436,9 +440,12 @@ static struct mp_image *try_download(struct mp_image *src,
         if (dst) {
             va_lock(p->ctx);
             mp_check_gpu_memcpy(p->ctx->log, &p->ctx->gpu_memcpy_message);
+            if (!p->ctx->copy_pool)
+                p->ctx->copy_pool = mp_image_create_copy_pool(p->ctx);
+            struct mp_thread_pool *copy_pool = p->ctx->copy_pool;
             va_unlock(p->ctx);
 
-            mp_image_copy_gpu(dst, &tmp);
+            mp_image_copy_gpu_threaded(dst, &tmp, copy_pool);
             mp_image_copy_attributes(dst, src);
         }
         va_image_unmap(p->ctx, image);
@@ -546,6 +553,95 @@ void va_pool_set_allocator(struct mp_image_pool *pool, struct mp_vaapi_ctx *ctx,
     mp_image_pool_set_lru(pool);
 }
 
+struct va_cached_pool {
+    int rt_format, w, h;
+    struct mp_image_pool *pool;
+};
+
+// Rough size of a surface; only used for the cache size limit.
+static int64_t surface_size(int rt_format, int w, int h)
+{
+    int64_t size = (int64_t)w * h * 3 / 2;
+#ifdef VA_RT_FORMAT_YUV420_10BPP
+    if (rt_format == VA_RT_FORMAT_YUV420_10BPP)
+        size *= 2;
+#endif
+    return size;
+}
+
+static int64_t cached_pool_size(struct va_cached_pool *e)
+{
+    struct mp_image_pool_stats st = {0};
+    mp_image_pool_add_stats(e->pool, &st);
+    return st.images * surface_size(e->rt_format, e->w, e->h);
+}
+
+// Return a pool for decoder surfaces with the given parameters. If a previous
+// decoder left a matching pool with va_surface_cache_put(), its surfaces are
+// reused, which avoids reallocating them on decoder reinit (e.g. with streams
+// switching between a few resolutions).
+struct mp_image_pool *va_surface_cache_get(struct mp_vaapi_ctx *ctx,
+                                           int rt_format, int w, int h,
+                                           int max_count)
+{
+    struct mp_image_pool *pool = NULL;
+
+    va_lock(ctx);
+    for (int n = ctx->num_cached_pools - 1; n >= 0; n--) {
+        struct va_cached_pool *e = &ctx->cached_pools[n];
+        if (e->rt_format == rt_format && e->w == w && e->h == h) {
+            pool = e->pool;
+            MP_TARRAY_REMOVE_AT(ctx->cached_pools, ctx->num_cached_pools, n);
+            break;
+        }
+    }
+    va_unlock(ctx);
+
+    if (pool) {
+        MP_VERBOSE(ctx, "Reusing cached %dx%d surfaces.\n", w, h);
+        // Surfaces still held by the VO can't be handed to the new decoder
+        // (they'd be freed later anyway).
+        mp_image_pool_forget_used(pool);
+        mp_image_pool_set_max_count(pool, max_count);
+        return pool;
+    }
+
+    pool = mp_image_pool_new(max_count);
+    va_pool_set_allocator(pool, ctx, rt_format);
+    return pool;
+}
+
+// Keep the surfaces of a decoder that is being destroyed for reuse by
+// va_surface_cache_get(). If the cached surfaces take more than max_bytes,
+// the oldest pools are freed. pool==NULL just applies the limit.
+void va_surface_cache_put(struct mp_vaapi_ctx *ctx, struct mp_image_pool *pool,
+                          int rt_format, int w, int h, int64_t max_bytes)
+{
+    struct mp_image_pool **evict = NULL;
+    int num_evict = 0;
+
+    va_lock(ctx);
+    if (pool) {
+        struct va_cached_pool e = {rt_format, w, h, pool};
+        MP_TARRAY_APPEND(ctx, ctx->cached_pools, ctx->num_cached_pools, e);
+    }
+    int64_t total = 0;
+    for (int n = ctx->num_cached_pools - 1; n >= 0; n--) {
+        struct va_cached_pool *e = &ctx->cached_pools[n];
+        total += cached_pool_size(e);
+        if (total > max_bytes) {
+            MP_TARRAY_APPEND(NULL, evict, num_evict, e->pool);
+            MP_TARRAY_REMOVE_AT(ctx->cached_pools, ctx->num_cached_pools, n);
+        }
+    }
+    va_unlock(ctx);
+
+    // Destroying surfaces takes the lock.
+    for (int n = 0; n < num_evict; n++)
+        talloc_free(evict[n]);
+    talloc_free(evict);
+}
+
 bool va_guess_if_emulated(struct mp_vaapi_ctx *ctx)
 {
     va_lock(ctx);
@@ -35,6 +35,10 @@ struct mp_vaapi_ctx {
     VADisplay display;
     struct va_image_formats *image_formats;
     bool gpu_memcpy_message;
+    struct mp_thread_pool *copy_pool;   // for parallel readback
+    // Decoder surface pools kept for reuse (see va_surface_cache_put()).
+    struct va_cached_pool *cached_pools;
+    int num_cached_pools;
     pthread_mutex_t lock;
 };
 
@@ -61,6 +65,12 @@ void va_surface_get_uncropped_size(struct mp_image *mpi, int *out_w, int *out_h)
 void va_pool_set_allocator(struct mp_image_pool *pool, struct mp_vaapi_ctx *ctx,
                            int rt_format);
 
+struct mp_image_pool *va_surface_cache_get(struct mp_vaapi_ctx *ctx,
+                                           int rt_format, int w, int h,
+                                           int max_count);
+void va_surface_cache_put(struct mp_vaapi_ctx *ctx, struct mp_image_pool *pool,
+                          int rt_format, int w, int h, int64_t max_bytes);
+
 VASurfaceID va_surface_id(struct mp_image *mpi);
 int va_surface_rt_format(struct mp_image *mpi);
 struct mp_image *va_surface_download(struct mp_image *src,
@@ -0,0 +1,14 @@
+#include <stddef.h>
+#include <cuda.h>
+#include <cudaGL.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/hwcontext.h>
+#include <libavutil/hwcontext_cuda.h>
+
+int main(void)
+{
+    AVBufferRef *ref = av_hwdevice_ctx_alloc(AV_HWDEVICE_TYPE_CUDA);
+    (void)offsetof(AVCodecContext, hw_device_ctx);
+    cuGraphicsGLRegisterImage(NULL, 0, 0, 0);
+    return ref ? 0 : 1;
+}